@@ -29,6 +29,8 @@ struct sha256_ce_state {
 
 asmlinkage void sha2_ce_transform(struct sha256_ce_state *sst, u8 const *src,
 				  int blocks);
+asmlinkage void sha2_ce_transform2x(u32 *state1, u32 *state2,
+				    u8 const *src1, u8 const *src2, int blocks);
 
 const u32 sha256_ce_offsetof_count = offsetof(struct sha256_ce_state,
 					      sst.count);
@@ -103,11 +105,70 @@ static int sha256_ce_final(struct shash_desc *desc, u8 *out)
 	return sha256_base_finish(desc, out);
 }
 
+/*
+ * Two messages of the same length from the same state, as the blocks of a
+ * Merkle tree are, hashed interleaved. Their final blocks are padded here
+ * for the asm code to only ever see whole blocks.
+ */
+static int sha256_ce_finup_mb(struct shash_desc *desc, const u8 * const data[],
+			      unsigned int len, u8 * const outs[],
+			      unsigned int num_msgs)
+{
+	struct sha256_ce_state *sctx = shash_desc_ctx(desc);
+	unsigned int digestsize = crypto_shash_digestsize(desc->tfm);
+	unsigned int blocks = len / SHA256_BLOCK_SIZE;
+	unsigned int partial = len % SHA256_BLOCK_SIZE;
+	unsigned int tail_len;
+	u8 tail[2][2 * SHA256_BLOCK_SIZE];
+	u32 state[2][8];
+	int i, j;
+
+	if (num_msgs != 2 || sctx->sst.count % SHA256_BLOCK_SIZE ||
+	    !may_use_simd()) {
+		for (i = 0; i < num_msgs; i++) {
+			SHASH_DESC_ON_STACK(d, desc->tfm);
+
+			d->tfm = desc->tfm;
+			d->flags = desc->flags;
+			memcpy(shash_desc_ctx(d), sctx, sizeof(*sctx));
+			sha256_ce_finup(d, data[i], len, outs[i]);
+		}
+		return 0;
+	}
+
+	tail_len = partial + 1 + sizeof(__be64) > SHA256_BLOCK_SIZE ?
+		   2 * SHA256_BLOCK_SIZE : SHA256_BLOCK_SIZE;
+	for (i = 0; i < 2; i++) {
+		memcpy(state[i], sctx->sst.state, sizeof(state[i]));
+		memcpy(tail[i], data[i] + len - partial, partial);
+		tail[i][partial] = 0x80;
+		memset(tail[i] + partial + 1, 0,
+		       tail_len - partial - 1 - sizeof(__be64));
+		put_unaligned_be64((sctx->sst.count + len) << 3,
+				   tail[i] + tail_len - sizeof(__be64));
+	}
+
+	kernel_neon_begin();
+	if (blocks)
+		sha2_ce_transform2x(state[0], state[1], data[0], data[1],
+				    blocks);
+	sha2_ce_transform2x(state[0], state[1], tail[0], tail[1],
+			    tail_len / SHA256_BLOCK_SIZE);
+	kernel_neon_end();
+
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < digestsize / sizeof(u32); j++)
+			put_unaligned_be32(state[i][j], outs[i] + j * 4);
+	return 0;
+}
+
 static struct shash_alg algs[] = { {
 	.init			= sha224_base_init,
 	.update			= sha256_ce_update,
 	.final			= sha256_ce_final,
 	.finup			= sha256_ce_finup,
+	.finup_mb		= sha256_ce_finup_mb,
+	.mb_max_msgs		= 2,
 	.descsize		= sizeof(struct sha256_ce_state),
 	.digestsize		= SHA224_DIGEST_SIZE,
 	.base			= {
@@ -122,6 +183,8 @@ static struct shash_alg algs[] = { {
 	.update			= sha256_ce_update,
 	.final			= sha256_ce_final,
 	.finup			= sha256_ce_finup,
+	.finup_mb		= sha256_ce_finup_mb,
+	.mb_max_msgs		= 2,
 	.descsize		= sizeof(struct sha256_ce_state),
 	.digestsize		= SHA256_DIGEST_SIZE,
 	.base			= {
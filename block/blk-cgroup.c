@@ -1245,6 +1245,14 @@ int blkcg_init_queue(struct request_queue *q)
 		return ret;
 	}
 
+	ret = blk_iocost_init(q);
+	if (ret) {
+		spin_lock_irq(q->queue_lock);
+		blkg_destroy_all(q);
+		spin_unlock_irq(q->queue_lock);
+		return ret;
+	}
+
 	ret = blk_throtl_init(q);
 	if (ret) {
 		spin_lock_irq(q->queue_lock);
@@ -2319,6 +2319,10 @@ generic_make_request_checks(struct bio *bio)
 		break;
 	}
 
+	status = blk_crypto_submit_bio(q, bio);
+	if (unlikely(status != BLK_STS_OK))
+		goto end_io;
+
 	/*
 	 * Various block parts want %current->io_context and lazy ioc
 	 * allocation ends up trading a lot of pain for a small amount of
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Inline encryption support of the block layer
+ *
+ * Upper layers attach a struct bio_crypt_ctx to the bios whose data must
+ * be en/decrypted by the storage controller. When such a bio is submitted
+ * to a queue, its key is programmed into one of the keyslots of the queue,
+ * and the bio holds a reference on that keyslot until it is freed. The
+ * driver then programs the keyslot and data unit number of the first bio of
+ * each request into the hardware descriptor. Requests only merge bios with
+ * the same key and contiguous data unit numbers.
+ */
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/keyslot-manager.h>
+#include <linux/log2.h>
+#include <linux/mempool.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include "blk.h"
+
+static int num_prealloc_crypt_ctxs = 128;
+module_param(num_prealloc_crypt_ctxs, int, 0444);
+MODULE_PARM_DESC(num_prealloc_crypt_ctxs,
+		 "Number of bio crypto contexts to preallocate");
+
+static struct kmem_cache *bio_crypt_ctx_cache;
+static mempool_t *bio_crypt_ctx_pool;
+
+int __init bio_crypt_ctx_init(void)
+{
+	bio_crypt_ctx_cache = KMEM_CACHE(bio_crypt_ctx, 0);
+	if (!bio_crypt_ctx_cache)
+		return -ENOMEM;
+
+	bio_crypt_ctx_pool = mempool_create_slab_pool(num_prealloc_crypt_ctxs,
+						      bio_crypt_ctx_cache);
+	if (!bio_crypt_ctx_pool) {
+		kmem_cache_destroy(bio_crypt_ctx_cache);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/**
+ * blk_crypto_init_key() - Prepare a key for use with inline encryption
+ * @key: the key to initialize
+ * @raw_key: the raw bytes of the key
+ * @raw_key_size: size of @raw_key in bytes, as required by @crypto_mode
+ * @crypto_mode: the encryption algorithm
+ * @data_unit_size: the data unit size, a power of 2
+ *
+ * Return: 0 on success, -EINVAL if the parameters are invalid.
+ */
+int blk_crypto_init_key(struct blk_crypto_key *key, const u8 *raw_key,
+			unsigned int raw_key_size,
+			enum blk_crypto_mode_num crypto_mode,
+			unsigned int data_unit_size)
+{
+	memset(key, 0, sizeof(*key));
+
+	if (crypto_mode != BLK_ENCRYPTION_MODE_AES_256_XTS ||
+	    raw_key_size != BLK_CRYPTO_MAX_KEY_SIZE)
+		return -EINVAL;
+
+	if (!is_power_of_2(data_unit_size))
+		return -EINVAL;
+
+	key->crypto_mode = crypto_mode;
+	key->data_unit_size = data_unit_size;
+	key->data_unit_size_bits = ilog2(data_unit_size);
+	key->size = raw_key_size;
+	memcpy(key->raw, raw_key, raw_key_size);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(blk_crypto_init_key);
+
+/**
+ * blk_crypto_mode_supported() - Check if a queue can en/decrypt inline
+ * @q: the request queue
+ * @crypto_mode: the encryption algorithm
+ * @data_unit_size: the data unit size
+ */
+bool blk_crypto_mode_supported(struct request_queue *q,
+			       enum blk_crypto_mode_num crypto_mode,
+			       unsigned int data_unit_size)
+{
+	return keyslot_manager_crypto_mode_supported(q->ksm, crypto_mode,
+						     data_unit_size);
+}
+EXPORT_SYMBOL_GPL(blk_crypto_mode_supported);
+
+/**
+ * blk_crypto_evict_key() - Evict a key from the keyslots of a queue
+ * @q: the request queue the key was used on
+ * @key: the key, no bio may be using it anymore
+ *
+ * To be called before @key is freed so that it doesn't linger in the
+ * hardware.
+ *
+ * Return: 0 on success or if the key wasn't programmed, -errno otherwise.
+ */
+int blk_crypto_evict_key(struct request_queue *q,
+			 const struct blk_crypto_key *key)
+{
+	if (!q->ksm)
+		return 0;
+
+	return keyslot_manager_evict_key(q->ksm, key);
+}
+EXPORT_SYMBOL_GPL(blk_crypto_evict_key);
+
+/**
+ * bio_crypt_set_ctx() - Attach an inline encryption context to a bio
+ * @bio: the bio, which must not have one already
+ * @key: the key, which must outlive the bio
+ * @dun: the data unit number of the first data unit of the bio
+ * @gfp_mask: memory allocation flags, must allow direct reclaim
+ */
+void bio_crypt_set_ctx(struct bio *bio, const struct blk_crypto_key *key,
+		       u64 dun, gfp_t gfp_mask)
+{
+	struct bio_crypt_ctx *bc;
+
+	/* mempool_alloc() only never fails if it may sleep */
+	WARN_ON_ONCE(!(gfp_mask & __GFP_DIRECT_RECLAIM));
+
+	bc = mempool_alloc(bio_crypt_ctx_pool, gfp_mask);
+	bc->bc_key = key;
+	bc->bc_dun = dun;
+	bc->bc_ksm = NULL;
+	bc->bc_keyslot = -1;
+
+	bio->bi_crypt_context = bc;
+}
+EXPORT_SYMBOL_GPL(bio_crypt_set_ctx);
+
+void bio_crypt_free_ctx(struct bio *bio)
+{
+	struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+
+	if (!bc)
+		return;
+
+	if (bc->bc_keyslot >= 0)
+		keyslot_manager_put_slot(bc->bc_ksm, bc->bc_keyslot);
+	mempool_free(bc, bio_crypt_ctx_pool);
+	bio->bi_crypt_context = NULL;
+}
+
+/*
+ * Fails with -ENOMEM only when @gfp_mask doesn't allow the mempool to
+ * wait for a context, in which case @dst is left without one.
+ */
+int bio_crypt_clone(struct bio *dst, struct bio *src, gfp_t gfp_mask)
+{
+	struct bio_crypt_ctx *bc = src->bi_crypt_context;
+
+	if (!bc)
+		return 0;
+
+	dst->bi_crypt_context = mempool_alloc(bio_crypt_ctx_pool, gfp_mask);
+	if (!dst->bi_crypt_context)
+		return -ENOMEM;
+	*dst->bi_crypt_context = *bc;
+
+	if (bc->bc_keyslot >= 0)
+		keyslot_manager_get_slot(bc->bc_ksm, bc->bc_keyslot);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bio_crypt_clone);
+
+void bio_crypt_advance(struct bio *bio, unsigned int bytes)
+{
+	struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+
+	if (!bc)
+		return;
+
+	bc->bc_dun += bytes >> bc->bc_key->data_unit_size_bits;
+}
+
+/*
+ * Two bios can be in the same request only if both or none of them are
+ * encrypted, with the same key.
+ */
+bool bio_crypt_ctx_compatible(struct bio *b1, struct bio *b2)
+{
+	struct bio_crypt_ctx *bc1 = b1->bi_crypt_context;
+	struct bio_crypt_ctx *bc2 = b2->bi_crypt_context;
+
+	if (!bc1 || !bc2)
+		return !bc1 && !bc2;
+
+	return bc1->bc_key == bc2->bc_key;
+}
+
+/*
+ * Can @b2 be placed right after @b1, which is @b1_bytes long, in a request?
+ * The data unit numbers have to be contiguous too, the same IV is otherwise
+ * used for the data of both.
+ */
+bool bio_crypt_ctx_mergeable(struct bio *b1, unsigned int b1_bytes,
+			     struct bio *b2)
+{
+	struct bio_crypt_ctx *bc1 = b1->bi_crypt_context;
+	struct bio_crypt_ctx *bc2 = b2->bi_crypt_context;
+
+	if (!bio_crypt_ctx_compatible(b1, b2))
+		return false;
+
+	if (!bc1)
+		return true;
+
+	return bc1->bc_dun + (b1_bytes >> bc1->bc_key->data_unit_size_bits) ==
+	       bc2->bc_dun;
+}
+
+/* Can @bio be merged into @rq, on whichever side it is contiguous with? */
+bool blk_crypto_rq_bio_mergeable(struct request *rq, struct bio *bio)
+{
+	if (blk_rq_pos(rq) + blk_rq_sectors(rq) == bio->bi_iter.bi_sector)
+		return bio_crypt_ctx_mergeable(rq->bio, blk_rq_bytes(rq), bio);
+	if (blk_rq_pos(rq) - bio_sectors(bio) == bio->bi_iter.bi_sector)
+		return bio_crypt_ctx_mergeable(bio, bio->bi_iter.bi_size,
+					       rq->bio);
+	return bio_crypt_ctx_compatible(rq->bio, bio);
+}
+
+/*
+ * Get a keyslot of @q programmed with the key of @bio, if it has an
+ * encryption context and doesn't hold a keyslot already. There is no
+ * software fallback: queues without inline encryption support, or with
+ * support for other modes only, fail such bios.
+ */
+blk_status_t blk_crypto_submit_bio(struct request_queue *q, struct bio *bio)
+{
+	struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+	int slot;
+
+	if (!bc || bc->bc_keyslot >= 0)
+		return BLK_STS_OK;
+
+	if (!keyslot_manager_crypto_mode_supported(q->ksm,
+					bc->bc_key->crypto_mode,
+					bc->bc_key->data_unit_size))
+		return BLK_STS_NOTSUPP;
+
+	slot = keyslot_manager_get_slot_for_key(q->ksm, bc->bc_key);
+	if (slot < 0)
+		return BLK_STS_IOERR;
+
+	bc->bc_ksm = q->ksm;
+	bc->bc_keyslot = slot;
+	return BLK_STS_OK;
+}
@@ -0,0 +1,814 @@
+/*
+ * Block rq-qos cost based proportional io controller
+ *
+ * Bytes and IOPS limits don't tell how busy a device actually is: a 4k
+ * random write on flash occupies the device far longer per byte than a
+ * 512k sequential read.  Instead, this controller estimates the device time
+ * each bio takes using a per-device linear model and distributes device time
+ * between the cgroups in proportion to their weights.
+ *
+ * The model is configured on the root cgroup through io.cost.model, as
+ * the sequential and random IOPS and the bandwidth of the device in each
+ * direction.  A bio then costs
+ *
+ *	cost = (seq ? seqio : randio) + nr_4k_pages * page
+ *
+ * nanoseconds of device time, where page is the time to transfer 4k at the
+ * configured bandwidth and seqio/randio the rest of the time a 4k IO takes
+ * at the configured IOPS.  A bio is sequential if it starts within 16M of
+ * where the previous bio of the cgroup ended.  Only reads and writes are
+ * charged.
+ *
+ * Each cgroup has a weight, io.cost.weight, and its hierarchical weight,
+ * hweight, is its share of the device: the product, along the path to the
+ * root, of the weight of each node over the sum of the weights of its active
+ * siblings.  A cgroup is active if it issued IO during the last period, so
+ * the share of idle cgroups is distributed among the busy ones.
+ *
+ * Every cgroup has a virtual time running at the speed of the wall clock.
+ * Issuing a bio advances it by cost / hweight, and the bio has to wait until
+ * the wall clock catches up with the time it reserved.  A cgroup may bank
+ * up to IOC_MARGIN_NS of unused device time to absorb bursts.  Bios issued
+ * on behalf of the root cgroup, such as swap and metadata, are charged but
+ * never wait so that priority inversions can't occur.  The cgroup pays for
+ * them with its following bios.
+ *
+ * There is no feedback from the device here: the model is taken as is, so
+ * a model that overestimates the device leaves some of it idle, and one
+ * that underestimates it lets requests queue up in the device.
+ */
+#include <linux/kernel.h>
+#include <linux/blk_types.h>
+#include <linux/backing-dev.h>
+#include <linux/module.h>
+#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/sched/signal.h>
+#include "blk-rq-qos.h"
+
+#define IOC_PERIOD_NS		(100 * NSEC_PER_MSEC)
+#define IOC_MARGIN_NS		(10 * NSEC_PER_MSEC)
+
+#define IOC_PAGE_SHIFT		12
+#define IOC_PAGE_SIZE		(1 << IOC_PAGE_SHIFT)
+#define IOC_SECT_TO_PAGE_SHIFT	(IOC_PAGE_SHIFT - SECTOR_SHIFT)
+/* seeks longer than this, in pages, make a bio random */
+#define IOC_RANDIO_PAGES	4096
+
+/* fixed point 1.0 of hweight */
+#define HWEIGHT_WHOLE		(1 << 16)
+
+static struct blkcg_policy blkcg_policy_iocost;
+
+/* model parameters, as written to io.cost.model */
+enum {
+	I_LCOEF_RBPS,
+	I_LCOEF_RSEQIOPS,
+	I_LCOEF_RRANDIOPS,
+	I_LCOEF_WBPS,
+	I_LCOEF_WSEQIOPS,
+	I_LCOEF_WRANDIOPS,
+	NR_I_LCOEFS,
+};
+
+/* linear coefficients derived from them, in ns */
+enum {
+	LCOEF_RPAGE,
+	LCOEF_RSEQIO,
+	LCOEF_RRANDIO,
+	LCOEF_WPAGE,
+	LCOEF_WSEQIO,
+	LCOEF_WRANDIO,
+	NR_LCOEFS,
+};
+
+static const char *ioc_param_names[NR_I_LCOEFS] = {
+	[I_LCOEF_RBPS]		= "rbps",
+	[I_LCOEF_RSEQIOPS]	= "rseqiops",
+	[I_LCOEF_RRANDIOPS]	= "rrandiops",
+	[I_LCOEF_WBPS]		= "wbps",
+	[I_LCOEF_WSEQIOPS]	= "wseqiops",
+	[I_LCOEF_WRANDIOPS]	= "wrandiops",
+};
+
+/* a mid-range SSD, until the actual device is described */
+static const u64 ioc_default_params[NR_I_LCOEFS] = {
+	[I_LCOEF_RBPS]		= 488636629,
+	[I_LCOEF_RSEQIOPS]	= 8932,
+	[I_LCOEF_RRANDIOPS]	= 8518,
+	[I_LCOEF_WBPS]		= 427891549,
+	[I_LCOEF_WSEQIOPS]	= 28755,
+	[I_LCOEF_WRANDIOPS]	= 21940,
+};
+
+struct ioc {
+	struct rq_qos rqos;
+	bool enabled;
+
+	/* protects the fields below and the activity of the ioc_gqs */
+	spinlock_t lock;
+	u64 params[NR_I_LCOEFS];
+	u64 lcoefs[NR_LCOEFS];
+	struct list_head active_iocgs;
+	/* bumped when any hweight may have changed */
+	u32 hweight_gen;
+	struct timer_list timer;
+};
+
+struct ioc_gq {
+	struct blkg_policy_data pd;
+	struct ioc *ioc;
+
+	/* weight set for this device, 0 to use the default of the cgroup */
+	u32 cfg_weight;
+	u32 weight;
+	/* sum of the weights of the children counted as active */
+	u32 child_active_sum;
+	/* issued IO during the last period */
+	bool active;
+	/* counted in the child_active_sum of the parent */
+	bool counted;
+	struct list_head active_list;
+	u64 last_io;
+
+	u32 hweight;
+	u32 hweight_gen;
+
+	/* end of the device time reserved by the issued bios, in ns */
+	atomic64_t vtime;
+	/* end sector of the last bio, to detect sequential IO */
+	sector_t cursor;
+
+	atomic64_t usage_ns;
+	atomic64_t wait_ns;
+};
+
+struct ioc_cgrp {
+	struct blkcg_policy_data cpd;
+	u32 dfl_weight;
+};
+
+static inline struct ioc *rqos_to_ioc(struct rq_qos *rqos)
+{
+	return container_of(rqos, struct ioc, rqos);
+}
+
+static inline struct ioc_gq *pd_to_iocg(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct ioc_gq, pd) : NULL;
+}
+
+static inline struct ioc_gq *blkg_to_iocg(struct blkcg_gq *blkg)
+{
+	return pd_to_iocg(blkg_to_pd(blkg, &blkcg_policy_iocost));
+}
+
+static inline struct blkcg_gq *iocg_to_blkg(struct ioc_gq *iocg)
+{
+	return pd_to_blkg(&iocg->pd);
+}
+
+static inline struct ioc_cgrp *blkcg_to_iocc(struct blkcg *blkcg)
+{
+	return container_of(blkcg_to_cpd(blkcg, &blkcg_policy_iocost),
+			    struct ioc_cgrp, cpd);
+}
+
+static void calc_lcoefs(u64 bps, u64 seqiops, u64 randiops,
+			u64 *page, u64 *seqio, u64 *randio)
+{
+	u64 v;
+
+	*page = *seqio = *randio = 0;
+
+	if (bps)
+		*page = div64_u64((u64)NSEC_PER_SEC << IOC_PAGE_SHIFT, bps);
+
+	if (seqiops) {
+		v = div64_u64(NSEC_PER_SEC, seqiops);
+		if (v > *page)
+			*seqio = v - *page;
+	}
+
+	if (randiops) {
+		v = div64_u64(NSEC_PER_SEC, randiops);
+		if (v > *page)
+			*randio = v - *page;
+	}
+}
+
+/* ioc->lock must be held */
+static void ioc_refresh_lcoefs(struct ioc *ioc)
+{
+	u64 *u = ioc->params;
+	u64 *c = ioc->lcoefs;
+
+	calc_lcoefs(u[I_LCOEF_RBPS], u[I_LCOEF_RSEQIOPS], u[I_LCOEF_RRANDIOPS],
+		    &c[LCOEF_RPAGE], &c[LCOEF_RSEQIO], &c[LCOEF_RRANDIO]);
+	calc_lcoefs(u[I_LCOEF_WBPS], u[I_LCOEF_WSEQIOPS], u[I_LCOEF_WRANDIOPS],
+		    &c[LCOEF_WPAGE], &c[LCOEF_WSEQIO], &c[LCOEF_WRANDIO]);
+}
+
+/*
+ * Mark @iocg active and count it, and any ancestor that wasn't already, in
+ * the active weight sums.  ioc->lock must be held.
+ */
+static void iocg_activate(struct ioc_gq *iocg)
+{
+	struct ioc *ioc = iocg->ioc;
+	struct blkcg_gq *blkg;
+
+	if (iocg->active)
+		return;
+
+	iocg->active = true;
+	list_add(&iocg->active_list, &ioc->active_iocgs);
+
+	for (blkg = iocg_to_blkg(iocg); blkg->parent; blkg = blkg->parent) {
+		struct ioc_gq *child = blkg_to_iocg(blkg);
+		struct ioc_gq *parent = blkg_to_iocg(blkg->parent);
+
+		if (!parent || child->counted)
+			break;
+		child->counted = true;
+		parent->child_active_sum += child->weight;
+	}
+	ioc->hweight_gen++;
+
+	if (!timer_pending(&ioc->timer))
+		mod_timer(&ioc->timer,
+			  jiffies + nsecs_to_jiffies(IOC_PERIOD_NS));
+}
+
+/* Undo iocg_activate(), ioc->lock must be held */
+static void iocg_deactivate(struct ioc_gq *iocg)
+{
+	struct ioc *ioc = iocg->ioc;
+	struct blkcg_gq *blkg;
+
+	if (!iocg->active)
+		return;
+
+	iocg->active = false;
+	list_del_init(&iocg->active_list);
+
+	for (blkg = iocg_to_blkg(iocg); blkg->parent; blkg = blkg->parent) {
+		struct ioc_gq *child = blkg_to_iocg(blkg);
+		struct ioc_gq *parent = blkg_to_iocg(blkg->parent);
+
+		if (!parent || !child->counted || child->active ||
+		    child->child_active_sum)
+			break;
+		child->counted = false;
+		parent->child_active_sum -= child->weight;
+	}
+	ioc->hweight_gen++;
+}
+
+/* ioc->lock must be held */
+static void iocg_update_weight(struct ioc_gq *iocg)
+{
+	struct blkcg_gq *blkg = iocg_to_blkg(iocg);
+	u32 weight = iocg->cfg_weight ?: blkcg_to_iocc(blkg->blkcg)->dfl_weight;
+
+	if (weight == iocg->weight)
+		return;
+
+	if (iocg->counted && blkg->parent) {
+		struct ioc_gq *parent = blkg_to_iocg(blkg->parent);
+
+		if (parent)
+			parent->child_active_sum += weight - iocg->weight;
+	}
+	iocg->weight = weight;
+	iocg->ioc->hweight_gen++;
+}
+
+/* Share of the device of an active @iocg, ioc->lock must be held */
+static u32 iocg_hweight(struct ioc_gq *iocg)
+{
+	struct blkcg_gq *blkg;
+	u64 hweight = HWEIGHT_WHOLE;
+
+	if (iocg->hweight_gen == iocg->ioc->hweight_gen)
+		return iocg->hweight;
+
+	for (blkg = iocg_to_blkg(iocg); blkg->parent; blkg = blkg->parent) {
+		struct ioc_gq *child = blkg_to_iocg(blkg);
+		struct ioc_gq *parent = blkg_to_iocg(blkg->parent);
+
+		if (!parent || !parent->child_active_sum)
+			break;
+		hweight = div_u64(hweight * child->weight,
+				  parent->child_active_sum);
+	}
+
+	iocg->hweight = max_t(u64, hweight, 1);
+	iocg->hweight_gen = iocg->ioc->hweight_gen;
+	return iocg->hweight;
+}
+
+/* Estimated device time of @bio, in ns */
+static u64 calc_bio_cost(struct ioc_gq *iocg, struct bio *bio)
+{
+	const u64 *c = iocg->ioc->lcoefs;
+	u64 pages = max_t(u64, bio_sectors(bio) >> IOC_SECT_TO_PAGE_SHIFT, 1);
+	sector_t cursor = READ_ONCE(iocg->cursor);
+	u64 seek_pages = 0;
+	u64 coef_seqio, coef_randio, coef_page;
+
+	switch (bio_op(bio)) {
+	case REQ_OP_READ:
+		coef_seqio = READ_ONCE(c[LCOEF_RSEQIO]);
+		coef_randio = READ_ONCE(c[LCOEF_RRANDIO]);
+		coef_page = READ_ONCE(c[LCOEF_RPAGE]);
+		break;
+	case REQ_OP_WRITE:
+		coef_seqio = READ_ONCE(c[LCOEF_WSEQIO]);
+		coef_randio = READ_ONCE(c[LCOEF_WRANDIO]);
+		coef_page = READ_ONCE(c[LCOEF_WPAGE]);
+		break;
+	default:
+		return 0;
+	}
+
+	if (cursor) {
+		if (bio->bi_iter.bi_sector > cursor)
+			seek_pages = bio->bi_iter.bi_sector - cursor;
+		else
+			seek_pages = cursor - bio->bi_iter.bi_sector;
+		seek_pages >>= IOC_SECT_TO_PAGE_SHIFT;
+	}
+	WRITE_ONCE(iocg->cursor, bio_end_sector(bio));
+
+	return (seek_pages > IOC_RANDIO_PAGES ? coef_randio : coef_seqio) +
+	       pages * coef_page;
+}
+
+static struct blkcg_gq *ioc_bio_blkg(struct request_queue *q,
+				     struct bio *bio, spinlock_t *lock)
+{
+	struct blkcg *blkcg;
+	struct blkcg_gq *blkg;
+
+	/* another controller may have associated it already */
+	if (bio->bi_blkg)
+		return bio->bi_blkg;
+
+	rcu_read_lock();
+	blkcg = bio_blkcg(bio);
+	bio_associate_blkcg(bio, &blkcg->css);
+	blkg = blkg_lookup(blkcg, q);
+	if (unlikely(!blkg)) {
+		if (!lock)
+			spin_lock_irq(q->queue_lock);
+		blkg = blkg_lookup_create(blkcg, q);
+		if (IS_ERR(blkg))
+			blkg = NULL;
+		if (!lock)
+			spin_unlock_irq(q->queue_lock);
+	}
+	if (blkg)
+		bio_associate_blkg(bio, blkg);
+	rcu_read_unlock();
+
+	return bio->bi_blkg;
+}
+
+static void iocg_wait(struct ioc_gq *iocg, u64 delay_ns, spinlock_t *lock)
+	__releases(lock)
+	__acquires(lock)
+{
+	ktime_t expires = ns_to_ktime(delay_ns);
+	int token;
+
+	if (lock)
+		spin_unlock_irq(lock);
+
+	token = io_schedule_prepare();
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_REL);
+	io_schedule_finish(token);
+
+	if (lock)
+		spin_lock_irq(lock);
+
+	atomic64_add(delay_ns, &iocg->wait_ns);
+}
+
+static void ioc_rqos_throttle(struct rq_qos *rqos, struct bio *bio,
+			      spinlock_t *lock)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+	struct blkcg_gq *blkg;
+	struct ioc_gq *iocg;
+	unsigned long flags;
+	u64 abs_cost, cost, now, vtime, start;
+	u32 hweight;
+
+	if (!READ_ONCE(ioc->enabled))
+		return;
+
+	blkg = ioc_bio_blkg(rqos->q, bio, lock);
+	if (!blkg)
+		return;
+	iocg = blkg_to_iocg(blkg);
+	if (!iocg)
+		return;
+
+	abs_cost = calc_bio_cost(iocg, bio);
+	if (!abs_cost)
+		return;
+
+	now = ktime_get_ns();
+	WRITE_ONCE(iocg->last_io, now);
+
+	if (unlikely(!iocg->active ||
+		     iocg->hweight_gen != READ_ONCE(ioc->hweight_gen))) {
+		spin_lock_irqsave(&ioc->lock, flags);
+		iocg_activate(iocg);
+		hweight = iocg_hweight(iocg);
+		spin_unlock_irqrestore(&ioc->lock, flags);
+	} else {
+		hweight = READ_ONCE(iocg->hweight);
+	}
+
+	cost = div_u64(abs_cost * HWEIGHT_WHOLE, hweight);
+	atomic64_add(abs_cost, &iocg->usage_ns);
+
+	/* don't let an idle cgroup bank more than the margin */
+	vtime = atomic64_read(&iocg->vtime);
+	if ((s64)(vtime - (now - IOC_MARGIN_NS)) < 0)
+		atomic64_cmpxchg(&iocg->vtime, vtime, now - IOC_MARGIN_NS);
+
+	/* reserve [start, start + cost) of our device time */
+	start = atomic64_add_return(cost, &iocg->vtime) - cost;
+	if ((s64)(start - now) <= 0)
+		return;
+
+	/*
+	 * The root cgroup issues IO on behalf of everybody, don't make it
+	 * wait.  Nor a task being killed off, the sooner it goes away the
+	 * better.
+	 */
+	if (bio_issue_as_root_blkg(bio) || fatal_signal_pending(current))
+		return;
+
+	iocg_wait(iocg, start - now, lock);
+}
+
+static void ioc_rqos_exit(struct rq_qos *rqos)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+
+	del_timer_sync(&ioc->timer);
+	blkcg_deactivate_policy(rqos->q, &blkcg_policy_iocost);
+	kfree(ioc);
+}
+
+static struct rq_qos_ops ioc_rqos_ops = {
+	.throttle = ioc_rqos_throttle,
+	.exit = ioc_rqos_exit,
+};
+
+/* Deactivate the cgroups which didn't issue IO for a period */
+static void ioc_timer_fn(struct timer_list *t)
+{
+	struct ioc *ioc = from_timer(ioc, t, timer);
+	struct ioc_gq *iocg, *tmp;
+	u64 now = ktime_get_ns();
+	unsigned long flags;
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	list_for_each_entry_safe(iocg, tmp, &ioc->active_iocgs, active_list) {
+		if (now - READ_ONCE(iocg->last_io) >= IOC_PERIOD_NS)
+			iocg_deactivate(iocg);
+	}
+	if (!list_empty(&ioc->active_iocgs))
+		mod_timer(&ioc->timer,
+			  jiffies + nsecs_to_jiffies(IOC_PERIOD_NS));
+	spin_unlock_irqrestore(&ioc->lock, flags);
+}
+
+int blk_iocost_init(struct request_queue *q)
+{
+	struct ioc *ioc;
+	struct rq_qos *rqos;
+	int ret;
+
+	ioc = kzalloc(sizeof(*ioc), GFP_KERNEL);
+	if (!ioc)
+		return -ENOMEM;
+
+	spin_lock_init(&ioc->lock);
+	INIT_LIST_HEAD(&ioc->active_iocgs);
+	timer_setup(&ioc->timer, ioc_timer_fn, 0);
+	memcpy(ioc->params, ioc_default_params, sizeof(ioc->params));
+	ioc_refresh_lcoefs(ioc);
+
+	rqos = &ioc->rqos;
+	rqos->id = RQ_QOS_COST;
+	rqos->ops = &ioc_rqos_ops;
+	rqos->q = q;
+
+	rq_qos_add(q, rqos);
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iocost);
+	if (ret) {
+		rq_qos_del(q, rqos);
+		kfree(ioc);
+		return ret;
+	}
+
+	return 0;
+}
+
+static u64 ioc_weight_prfill(struct seq_file *sf,
+			     struct blkg_policy_data *pd, int off)
+{
+	const char *dname = blkg_dev_name(pd->blkg);
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+
+	if (dname && iocg->cfg_weight)
+		seq_printf(sf, "%s %u\n", dname, iocg->cfg_weight);
+	return 0;
+}
+
+static int ioc_weight_show(struct seq_file *sf, void *v)
+{
+	struct blkcg *blkcg = css_to_blkcg(seq_css(sf));
+	struct ioc_cgrp *iocc = blkcg_to_iocc(blkcg);
+
+	seq_printf(sf, "default %u\n", iocc->dfl_weight);
+	blkcg_print_blkgs(sf, blkcg, ioc_weight_prfill,
+			  &blkcg_policy_iocost, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t ioc_weight_write(struct kernfs_open_file *of, char *buf,
+				size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct ioc_cgrp *iocc = blkcg_to_iocc(blkcg);
+	struct blkg_conf_ctx ctx;
+	struct ioc_gq *iocg;
+	u32 v;
+	int ret;
+
+	/* "[default ]WEIGHT" sets the default of the cgroup */
+	if (!strchr(buf, ':')) {
+		struct blkcg_gq *blkg;
+
+		if (sscanf(buf, "default %u", &v) != 1 &&
+		    sscanf(buf, "%u", &v) != 1)
+			return -EINVAL;
+		if (v < CGROUP_WEIGHT_MIN || v > CGROUP_WEIGHT_MAX)
+			return -ERANGE;
+
+		spin_lock_irq(&blkcg->lock);
+		iocc->dfl_weight = v;
+		hlist_for_each_entry(blkg, &blkcg->blkg_list, blkcg_node) {
+			iocg = blkg_to_iocg(blkg);
+			if (!iocg)
+				continue;
+
+			spin_lock(&iocg->ioc->lock);
+			iocg_update_weight(iocg);
+			spin_unlock(&iocg->ioc->lock);
+		}
+		spin_unlock_irq(&blkcg->lock);
+
+		return nbytes;
+	}
+
+	/* "MAJ:MIN WEIGHT|default" overrides it for a device */
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iocost, buf, &ctx);
+	if (ret)
+		return ret;
+
+	iocg = blkg_to_iocg(ctx.blkg);
+
+	if (!strncmp(ctx.body, "default", 7)) {
+		v = 0;
+	} else if (sscanf(ctx.body, "%u", &v) != 1) {
+		ret = -EINVAL;
+		goto out;
+	} else if (v < CGROUP_WEIGHT_MIN || v > CGROUP_WEIGHT_MAX) {
+		ret = -ERANGE;
+		goto out;
+	}
+
+	spin_lock(&iocg->ioc->lock);
+	iocg->cfg_weight = v;
+	iocg_update_weight(iocg);
+	spin_unlock(&iocg->ioc->lock);
+out:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static u64 ioc_model_prfill(struct seq_file *sf,
+			    struct blkg_policy_data *pd, int off)
+{
+	const char *dname = blkg_dev_name(pd->blkg);
+	struct ioc *ioc = pd_to_iocg(pd)->ioc;
+	u64 *u = ioc->params;
+
+	if (!dname)
+		return 0;
+
+	seq_printf(sf, "%s enable=%d rbps=%llu rseqiops=%llu rrandiops=%llu "
+		   "wbps=%llu wseqiops=%llu wrandiops=%llu\n",
+		   dname, ioc->enabled,
+		   u[I_LCOEF_RBPS], u[I_LCOEF_RSEQIOPS], u[I_LCOEF_RRANDIOPS],
+		   u[I_LCOEF_WBPS], u[I_LCOEF_WSEQIOPS], u[I_LCOEF_WRANDIOPS]);
+	return 0;
+}
+
+static int ioc_model_show(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), ioc_model_prfill,
+			  &blkcg_policy_iocost, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t ioc_model_write(struct kernfs_open_file *of, char *buf,
+			       size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct ioc *ioc;
+	u64 params[NR_I_LCOEFS];
+	bool enable;
+	char *p, *tok;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iocost, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ioc = blkg_to_iocg(ctx.blkg)->ioc;
+	p = ctx.body;
+
+	spin_lock(&ioc->lock);
+	memcpy(params, ioc->params, sizeof(params));
+	enable = ioc->enabled;
+	spin_unlock(&ioc->lock);
+
+	ret = -EINVAL;
+	while ((tok = strsep(&p, " "))) {
+		char key[16];
+		char val[21];	/* 18446744073709551616 */
+		u64 v;
+		int i;
+
+		if (!*tok)
+			continue;
+
+		if (sscanf(tok, "%15[^=]=%20s", key, val) != 2 ||
+		    kstrtou64(val, 10, &v))
+			goto out;
+
+		if (!strcmp(key, "enable")) {
+			enable = v;
+			continue;
+		}
+
+		for (i = 0; i < NR_I_LCOEFS; i++) {
+			if (!strcmp(key, ioc_param_names[i]))
+				break;
+		}
+		if (i == NR_I_LCOEFS)
+			goto out;
+		params[i] = v;
+	}
+
+	spin_lock(&ioc->lock);
+	memcpy(ioc->params, params, sizeof(params));
+	ioc_refresh_lcoefs(ioc);
+	spin_unlock(&ioc->lock);
+	WRITE_ONCE(ioc->enabled, enable);
+
+	ret = 0;
+out:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static size_t ioc_pd_stat(struct blkg_policy_data *pd, char *buf, size_t size)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+
+	if (!READ_ONCE(iocg->ioc->enabled))
+		return 0;
+
+	return scnprintf(buf, size, " cost.usage=%llu cost.wait=%llu",
+			 div_u64(atomic64_read(&iocg->usage_ns), NSEC_PER_USEC),
+			 div_u64(atomic64_read(&iocg->wait_ns), NSEC_PER_USEC));
+}
+
+static struct blkcg_policy_data *ioc_cpd_alloc(gfp_t gfp)
+{
+	struct ioc_cgrp *iocc;
+
+	iocc = kzalloc(sizeof(*iocc), gfp);
+	if (!iocc)
+		return NULL;
+	return &iocc->cpd;
+}
+
+static void ioc_cpd_init(struct blkcg_policy_data *cpd)
+{
+	struct ioc_cgrp *iocc = container_of(cpd, struct ioc_cgrp, cpd);
+
+	iocc->dfl_weight = CGROUP_WEIGHT_DFL;
+}
+
+static void ioc_cpd_free(struct blkcg_policy_data *cpd)
+{
+	kfree(container_of(cpd, struct ioc_cgrp, cpd));
+}
+
+static struct blkg_policy_data *ioc_pd_alloc(gfp_t gfp, int node)
+{
+	struct ioc_gq *iocg;
+
+	iocg = kzalloc_node(sizeof(*iocg), gfp, node);
+	if (!iocg)
+		return NULL;
+	return &iocg->pd;
+}
+
+static void ioc_pd_init(struct blkg_policy_data *pd)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+	struct blkcg_gq *blkg = iocg_to_blkg(iocg);
+	struct ioc *ioc = rqos_to_ioc(rq_qos_id(blkg->q, RQ_QOS_COST));
+	unsigned long flags;
+
+	iocg->ioc = ioc;
+	INIT_LIST_HEAD(&iocg->active_list);
+	atomic64_set(&iocg->vtime, ktime_get_ns());
+
+	spin_lock_irqsave(&ioc->lock, flags);
+	iocg_update_weight(iocg);
+	iocg->hweight = HWEIGHT_WHOLE;
+	iocg->hweight_gen = ioc->hweight_gen - 1;
+	spin_unlock_irqrestore(&ioc->lock, flags);
+}
+
+static void ioc_pd_offline(struct blkg_policy_data *pd)
+{
+	struct ioc_gq *iocg = pd_to_iocg(pd);
+	unsigned long flags;
+
+	spin_lock_irqsave(&iocg->ioc->lock, flags);
+	iocg_deactivate(iocg);
+	spin_unlock_irqrestore(&iocg->ioc->lock, flags);
+}
+
+static void ioc_pd_free(struct blkg_policy_data *pd)
+{
+	kfree(pd_to_iocg(pd));
+}
+
+static struct cftype ioc_files[] = {
+	{
+		.name = "cost.weight",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = ioc_weight_show,
+		.write = ioc_weight_write,
+	},
+	{
+		.name = "cost.model",
+		.flags = CFTYPE_ONLY_ON_ROOT,
+		.seq_show = ioc_model_show,
+		.write = ioc_model_write,
+	},
+	{}
+};
+
+static struct blkcg_policy blkcg_policy_iocost = {
+	.dfl_cftypes	= ioc_files,
+	.cpd_alloc_fn	= ioc_cpd_alloc,
+	.cpd_init_fn	= ioc_cpd_init,
+	.cpd_free_fn	= ioc_cpd_free,
+	.pd_alloc_fn	= ioc_pd_alloc,
+	.pd_init_fn	= ioc_pd_init,
+	.pd_offline_fn	= ioc_pd_offline,
+	.pd_free_fn	= ioc_pd_free,
+	.pd_stat_fn	= ioc_pd_stat,
+};
+
+static int __init ioc_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iocost);
+}
+
+static void __exit ioc_exit(void)
+{
+	return blkcg_policy_unregister(&blkcg_policy_iocost);
+}
+
+module_init(ioc_init);
+module_exit(ioc_exit);
@@ -61,6 +61,15 @@
  * root cg issued io's, wethere that's some metadata intensive operation or the
  * group is using so much memory that it is pushing us into swap.
  *
+ * Reads and writes are accounted separately and can be given their own
+ * targets with rtarget and wtarget, target setting both.  A group misses its
+ * targets as soon as the mean latency of one direction exceeds its target,
+ * so that fast, cached, writes cannot hide slow reads.  Discards are
+ * throttled but not accounted as their latency says nothing about the one
+ * of regular IO.  On non-rotational devices the windows and the minimum time
+ * between two scale events are shortened, flash latencies reacting to the
+ * queue depth within a few ms.
+ *
  * Copyright (C) 2018 Josef Bacik
  */
 #include <linux/kernel.h>
@@ -80,6 +89,10 @@
 static struct blkcg_policy blkcg_policy_iolatency;
 struct iolatency_grp;
 
+struct latency_stat {
+	struct blk_rq_stat rqs[2];
+};
+
 struct blk_iolatency {
 	struct rq_qos rqos;
 	struct timer_list timer;
@@ -117,13 +130,16 @@ struct child_latency_info {
 
 struct iolatency_grp {
 	struct blkg_policy_data pd;
-	struct blk_rq_stat __percpu *stats;
+	struct latency_stat __percpu *stats;
 	struct blk_iolatency *blkiolat;
 	struct rq_depth rq_depth;
 	struct rq_wait rq_wait;
 	atomic64_t window_start;
 	atomic_t scale_cookie;
+	/* lowest of the read and write targets */
 	u64 min_lat_nsec;
+	/* per data direction targets, 0 if not accounted */
+	u64 lat_target[2];
 	u64 cur_win_nsec;
 
 	/* total running average of our io latency. */
@@ -136,6 +152,7 @@ struct iolatency_grp {
 };
 
 #define BLKIOLATENCY_MIN_WIN_SIZE (100 * NSEC_PER_MSEC)
+#define BLKIOLATENCY_FLASH_MIN_WIN_SIZE (10 * NSEC_PER_MSEC)
 #define BLKIOLATENCY_MAX_WIN_SIZE NSEC_PER_SEC
 /*
  * These are the constants used to fake the fixed-point moving average
@@ -172,6 +189,21 @@ static inline struct blkcg_gq *lat_to_blkg(struct iolatency_grp *iolat)
 	return pd_to_blkg(&iolat->pd);
 }
 
+/*
+ * The nonrot flag is set by the driver after the queue, and us, have been
+ * initialized so it has to be checked every time.
+ */
+static inline bool iolatency_flash(struct blk_iolatency *blkiolat)
+{
+	return blk_queue_nonrot(blkiolat->rqos.q);
+}
+
+static inline u64 iolatency_min_win(struct blk_iolatency *blkiolat)
+{
+	return iolatency_flash(blkiolat) ? BLKIOLATENCY_FLASH_MIN_WIN_SIZE :
+					   BLKIOLATENCY_MIN_WIN_SIZE;
+}
+
 static inline bool iolatency_may_queue(struct iolatency_grp *iolat,
 				       wait_queue_entry_t *wait,
 				       bool first_block)
@@ -440,10 +472,10 @@ static void blkcg_iolatency_throttle(struct rq_qos *rqos, struct bio *bio,
 }
 
 static void iolatency_record_time(struct iolatency_grp *iolat,
-				  struct bio_issue *issue, u64 now,
-				  bool issue_as_root)
+				  struct bio_issue *issue, int data_dir,
+				  u64 now, bool issue_as_root)
 {
-	struct blk_rq_stat *rq_stat;
+	struct latency_stat *stat;
 	u64 start = bio_issue_time(issue);
 	u64 req_time;
 
@@ -469,32 +501,60 @@ static void iolatency_record_time(struct iolatency_grp *iolat,
 		return;
 	}
 
-	rq_stat = get_cpu_ptr(iolat->stats);
-	blk_rq_stat_add(rq_stat, req_time);
-	put_cpu_ptr(rq_stat);
+	stat = get_cpu_ptr(iolat->stats);
+	blk_rq_stat_add(&stat->rqs[data_dir], req_time);
+	put_cpu_ptr(stat);
 }
 
 #define BLKIOLATENCY_MIN_ADJUST_TIME (500 * NSEC_PER_MSEC)
+#define BLKIOLATENCY_FLASH_MIN_ADJUST_TIME (50 * NSEC_PER_MSEC)
 #define BLKIOLATENCY_MIN_GOOD_SAMPLES 5
 
+static inline u64 iolatency_min_adjust_time(struct blk_iolatency *blkiolat)
+{
+	return iolatency_flash(blkiolat) ? BLKIOLATENCY_FLASH_MIN_ADJUST_TIME :
+					   BLKIOLATENCY_MIN_ADJUST_TIME;
+}
+
+/* Did the mean latency of any of the data directions exceed its target? */
+static bool iolatency_missed_target(struct iolatency_grp *iolat,
+				    struct blk_rq_stat *stat)
+{
+	int dir;
+
+	for (dir = READ; dir <= WRITE; dir++) {
+		if (iolat->lat_target[dir] && stat[dir].nr_samples &&
+		    stat[dir].mean > iolat->lat_target[dir])
+			return true;
+	}
+	return false;
+}
+
 static void iolatency_check_latencies(struct iolatency_grp *iolat, u64 now)
 {
 	struct blkcg_gq *blkg = lat_to_blkg(iolat);
 	struct iolatency_grp *parent;
 	struct child_latency_info *lat_info;
-	struct blk_rq_stat stat;
+	struct blk_rq_stat stat, dir_stat[2];
 	unsigned long flags;
-	int cpu, exp_idx;
+	bool missed;
+	int cpu, dir, exp_idx;
 
 	blk_rq_stat_init(&stat);
+	blk_rq_stat_init(&dir_stat[READ]);
+	blk_rq_stat_init(&dir_stat[WRITE]);
 	preempt_disable();
 	for_each_online_cpu(cpu) {
-		struct blk_rq_stat *s;
+		struct latency_stat *s;
 		s = per_cpu_ptr(iolat->stats, cpu);
-		blk_rq_stat_sum(&stat, s);
-		blk_rq_stat_init(s);
+		for (dir = READ; dir <= WRITE; dir++) {
+			blk_rq_stat_sum(&stat, &s->rqs[dir]);
+			blk_rq_stat_sum(&dir_stat[dir], &s->rqs[dir]);
+			blk_rq_stat_init(&s->rqs[dir]);
+		}
 	}
 	preempt_enable();
+	missed = iolatency_missed_target(iolat, dir_stat);
 
 	parent = blkg_to_lat(blkg->parent);
 	if (!parent)
@@ -515,7 +575,7 @@ static void iolatency_check_latencies(struct iolatency_grp *iolat, u64 now)
 	CALC_LOAD(iolat->lat_avg, iolatency_exp_factors[exp_idx], stat.mean);
 
 	/* Everything is ok and we don't need to adjust the scale. */
-	if (stat.mean <= iolat->min_lat_nsec &&
+	if (!missed &&
 	    atomic_read(&lat_info->scale_cookie) == DEFAULT_SCALE_COOKIE)
 		return;
 
@@ -526,17 +586,17 @@ static void iolatency_check_latencies(struct iolatency_grp *iolat, u64 now)
 	iolat->nr_samples = stat.nr_samples;
 
 	if ((lat_info->last_scale_event >= now ||
-	    now - lat_info->last_scale_event < BLKIOLATENCY_MIN_ADJUST_TIME) &&
+	    now - lat_info->last_scale_event <
+	    iolatency_min_adjust_time(iolat->blkiolat)) &&
 	    lat_info->scale_lat <= iolat->min_lat_nsec)
 		goto out;
 
-	if (stat.mean <= iolat->min_lat_nsec &&
-	    stat.nr_samples >= BLKIOLATENCY_MIN_GOOD_SAMPLES) {
+	if (!missed && stat.nr_samples >= BLKIOLATENCY_MIN_GOOD_SAMPLES) {
 		if (lat_info->scale_grp == iolat) {
 			lat_info->last_scale_event = now;
 			scale_cookie_change(iolat->blkiolat, lat_info, true);
 		}
-	} else if (stat.mean > iolat->min_lat_nsec) {
+	} else if (missed) {
 		lat_info->last_scale_event = now;
 		if (!lat_info->scale_grp ||
 		    lat_info->scale_lat > iolat->min_lat_nsec) {
@@ -579,8 +639,10 @@ static void blkcg_iolatency_done_bio(struct rq_qos *rqos, struct bio *bio)
 		atomic_dec(&rqw->inflight);
 		if (!enabled || iolat->min_lat_nsec == 0)
 			goto next;
-		iolatency_record_time(iolat, &bio->bi_issue, now,
-				      issue_as_root);
+		if (bio_op(bio) == REQ_OP_DISCARD)
+			goto next;
+		iolatency_record_time(iolat, &bio->bi_issue, bio_data_dir(bio),
+				      now, issue_as_root);
 		window_start = atomic64_read(&iolat->window_start);
 		if (now > window_start &&
 		    (now - window_start) >= iolat->cur_win_nsec) {
@@ -721,14 +783,23 @@ int blk_iolatency_init(struct request_queue *q)
 	return 0;
 }
 
-static void iolatency_set_min_lat_nsec(struct blkcg_gq *blkg, u64 val)
+static void iolatency_set_targets(struct blkcg_gq *blkg, u64 rval, u64 wval)
 {
 	struct iolatency_grp *iolat = blkg_to_lat(blkg);
 	struct blk_iolatency *blkiolat = iolat->blkiolat;
 	u64 oldval = iolat->min_lat_nsec;
+	u64 val;
 
+	if (!rval || !wval)
+		val = rval ?: wval;
+	else
+		val = min(rval, wval);
+
+	iolat->lat_target[READ] = rval;
+	iolat->lat_target[WRITE] = wval;
 	iolat->min_lat_nsec = val;
-	iolat->cur_win_nsec = max_t(u64, val << 4, BLKIOLATENCY_MIN_WIN_SIZE);
+	iolat->cur_win_nsec = max_t(u64, val << 4,
+				    iolatency_min_win(blkiolat));
 	iolat->cur_win_nsec = min_t(u64, iolat->cur_win_nsec,
 				    BLKIOLATENCY_MAX_WIN_SIZE);
 
@@ -765,8 +836,8 @@ static ssize_t iolatency_set_limit(struct kernfs_open_file *of, char *buf,
 	struct blkg_conf_ctx ctx;
 	struct iolatency_grp *iolat;
 	char *p, *tok;
-	u64 lat_val = 0;
-	u64 oldval;
+	u64 lat_val[2];
+	u64 oldval[2];
 	int ret;
 
 	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolatency, buf, &ctx);
@@ -777,34 +848,48 @@ static ssize_t iolatency_set_limit(struct kernfs_open_file *of, char *buf,
 	blkiolat = iolat->blkiolat;
 	p = ctx.body;
 
+	/* A direction left out keeps its current target */
+	lat_val[READ] = iolat->lat_target[READ];
+	lat_val[WRITE] = iolat->lat_target[WRITE];
+
 	ret = -EINVAL;
 	while ((tok = strsep(&p, " "))) {
 		char key[16];
 		char val[21];	/* 18446744073709551616 */
+		bool rtarget, wtarget;
+		u64 v;
 
 		if (sscanf(tok, "%15[^=]=%20s", key, val) != 2)
 			goto out;
 
-		if (!strcmp(key, "target")) {
-			u64 v;
+		rtarget = !strcmp(key, "rtarget");
+		wtarget = !strcmp(key, "wtarget");
+		if (!strcmp(key, "target"))
+			rtarget = wtarget = true;
+		else if (!rtarget && !wtarget)
+			goto out;
 
-			if (!strcmp(val, "max"))
-				lat_val = 0;
-			else if (sscanf(val, "%llu", &v) == 1)
-				lat_val = v * NSEC_PER_USEC;
-			else
-				goto out;
-		} else {
+		if (!strcmp(val, "max"))
+			v = 0;
+		else if (sscanf(val, "%llu", &v) == 1)
+			v *= NSEC_PER_USEC;
+		else
 			goto out;
-		}
+
+		if (rtarget)
+			lat_val[READ] = v;
+		if (wtarget)
+			lat_val[WRITE] = v;
 	}
 
 	/* Walk up the tree to see if our new val is lower than it should be. */
 	blkg = ctx.blkg;
-	oldval = iolat->min_lat_nsec;
+	oldval[READ] = iolat->lat_target[READ];
+	oldval[WRITE] = iolat->lat_target[WRITE];
 
-	iolatency_set_min_lat_nsec(blkg, lat_val);
-	if (oldval != iolat->min_lat_nsec) {
+	iolatency_set_targets(blkg, lat_val[READ], lat_val[WRITE]);
+	if (oldval[READ] != iolat->lat_target[READ] ||
+	    oldval[WRITE] != iolat->lat_target[WRITE]) {
 		iolatency_clear_scaling(blkg);
 	}
 
@@ -822,8 +907,23 @@ static u64 iolatency_prfill_limit(struct seq_file *sf,
 
 	if (!dname || !iolat->min_lat_nsec)
 		return 0;
-	seq_printf(sf, "%s target=%llu\n",
-		   dname, div_u64(iolat->min_lat_nsec, NSEC_PER_USEC));
+	if (iolat->lat_target[READ] == iolat->lat_target[WRITE]) {
+		seq_printf(sf, "%s target=%llu\n",
+			   dname, div_u64(iolat->min_lat_nsec, NSEC_PER_USEC));
+		return 0;
+	}
+	seq_printf(sf, "%s rtarget=", dname);
+	if (iolat->lat_target[READ])
+		seq_printf(sf, "%llu", div_u64(iolat->lat_target[READ],
+					       NSEC_PER_USEC));
+	else
+		seq_puts(sf, "max");
+	seq_puts(sf, " wtarget=");
+	if (iolat->lat_target[WRITE])
+		seq_printf(sf, "%llu\n", div_u64(iolat->lat_target[WRITE],
+						  NSEC_PER_USEC));
+	else
+		seq_puts(sf, "max\n");
 	return 0;
 }
 
@@ -858,8 +958,8 @@ static struct blkg_policy_data *iolatency_pd_alloc(gfp_t gfp, int node)
 	iolat = kzalloc_node(sizeof(*iolat), gfp, node);
 	if (!iolat)
 		return NULL;
-	iolat->stats = __alloc_percpu_gfp(sizeof(struct blk_rq_stat),
-				       __alignof__(struct blk_rq_stat), gfp);
+	iolat->stats = __alloc_percpu_gfp(sizeof(struct latency_stat),
+				       __alignof__(struct latency_stat), gfp);
 	if (!iolat->stats) {
 		kfree(iolat);
 		return NULL;
@@ -877,9 +977,10 @@ static void iolatency_pd_init(struct blkg_policy_data *pd)
 	int cpu;
 
 	for_each_possible_cpu(cpu) {
-		struct blk_rq_stat *stat;
+		struct latency_stat *stat;
 		stat = per_cpu_ptr(iolat->stats, cpu);
-		blk_rq_stat_init(stat);
+		blk_rq_stat_init(&stat->rqs[READ]);
+		blk_rq_stat_init(&stat->rqs[WRITE]);
 	}
 
 	rq_wait_init(&iolat->rq_wait);
@@ -888,7 +989,7 @@ static void iolatency_pd_init(struct blkg_policy_data *pd)
 	iolat->rq_depth.max_depth = UINT_MAX;
 	iolat->rq_depth.default_depth = iolat->rq_depth.queue_depth;
 	iolat->blkiolat = blkiolat;
-	iolat->cur_win_nsec = 100 * NSEC_PER_MSEC;
+	iolat->cur_win_nsec = iolatency_min_win(blkiolat);
 	atomic64_set(&iolat->window_start, now);
 
 	/*
@@ -911,7 +1012,7 @@ static void iolatency_pd_offline(struct blkg_policy_data *pd)
 	struct iolatency_grp *iolat = pd_to_lat(pd);
 	struct blkcg_gq *blkg = lat_to_blkg(iolat);
 
-	iolatency_set_min_lat_nsec(blkg, 0);
+	iolatency_set_targets(blkg, 0, 0);
 	iolatency_clear_scaling(blkg);
 }
 
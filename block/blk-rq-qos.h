@@ -10,6 +10,7 @@
 enum rq_qos_id {
 	RQ_QOS_WBT,
 	RQ_QOS_CGROUP,
+	RQ_QOS_COST,
 };
 
 struct rq_wait {
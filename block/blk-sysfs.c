@@ -476,6 +476,35 @@ static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
 	return count;
 }
 
+static ssize_t queue_wb_adaptive_show(struct request_queue *q, char *page)
+{
+	if (!wbt_rq_qos(q))
+		return -EINVAL;
+
+	return queue_var_show(wbt_get_adaptive(q), page);
+}
+
+static ssize_t queue_wb_adaptive_store(struct request_queue *q,
+				       const char *page, size_t count)
+{
+	unsigned long adaptive;
+	ssize_t ret;
+
+	ret = queue_var_store(&adaptive, page, count);
+	if (ret < 0)
+		return ret;
+
+	if (!wbt_rq_qos(q)) {
+		int err = wbt_init(q);
+
+		if (err)
+			return err;
+	}
+
+	wbt_set_adaptive(q, adaptive);
+	return ret;
+}
+
 static ssize_t queue_wc_show(struct request_queue *q, char *page)
 {
 	if (test_bit(QUEUE_FLAG_WC, &q->queue_flags))
@@ -695,6 +724,12 @@ static struct queue_sysfs_entry queue_wb_lat_entry = {
 	.store = queue_wb_lat_store,
 };
 
+static struct queue_sysfs_entry queue_wb_adaptive_entry = {
+	.attr = {.name = "wbt_adaptive", .mode = 0644 },
+	.show = queue_wb_adaptive_show,
+	.store = queue_wb_adaptive_store,
+};
+
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 static struct queue_sysfs_entry throtl_sample_time_entry = {
 	.attr = {.name = "throttle_sample_time", .mode = 0644 },
@@ -736,6 +771,7 @@ static struct attribute *default_attrs[] = {
 	&queue_fua_entry.attr,
 	&queue_dax_entry.attr,
 	&queue_wb_lat_entry.attr,
+	&queue_wb_adaptive_entry.attr,
 	&queue_poll_delay_entry.attr,
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 	&throtl_sample_time_entry.attr,
@@ -14,6 +14,12 @@
  *   scaling step of 0 if reads show up or the heavy writers finish. Unlike
  *   positive scaling steps where we shrink the monitoring window, a negative
  *   scaling step retains the default step==0 window size.
+ * - Optionally, learn the latency target from the device instead of using
+ *   a fixed one. The minimum read latency of each window is fed to a
+ *   streaming estimate of its low percentile, which tracks what reads cost
+ *   when they don't queue behind writes, and the target is a multiple of
+ *   it. Background and normal writeback limits are further shrunk by how
+ *   much the mean read latency of the last window exceeds that target.
  *
  * Copyright (C) 2016 Jens Axboe
  *
@@ -72,6 +78,15 @@ enum {
 	 * information to scale up or down, scale up.
 	 */
 	RWB_UNKNOWN_BUMP	= 5,
+
+	/*
+	 * Adaptive mode: percentile of the window minimum read latency that
+	 * is tracked, the latency target as a multiple of it, and the shift
+	 * of the relative step the estimate moves by every window.
+	 */
+	RWB_ADAPT_PERCENTILE	= 10,
+	RWB_ADAPT_TARGET_MULT	= 4,
+	RWB_ADAPT_STEP_SHIFT	= 4,
 };
 
 static inline bool rwb_enabled(struct rq_wb *rwb)
@@ -230,10 +245,47 @@ enum {
 	LAT_EXCEEDED,
 };
 
+static u64 rwb_target_lat(struct rq_wb *rwb)
+{
+	if (rwb->adaptive && rwb->lat_baseline)
+		return rwb->lat_baseline * RWB_ADAPT_TARGET_MULT;
+	return rwb->min_lat_nsec;
+}
+
+/*
+ * Move the baseline estimate up or down by a small fraction of itself
+ * depending on which side of it the sample is, the steps in each direction
+ * being weighted so that it settles where RWB_ADAPT_PERCENTILE % of the
+ * samples are below it.
+ */
+static void rwb_learn_baseline(struct rq_wb *rwb, struct blk_rq_stat *stat)
+{
+	u64 sample = stat[READ].min;
+	u64 step;
+
+	if (!stat[READ].nr_samples)
+		return;
+
+	rwb->read_lat = stat[READ].mean;
+
+	if (!rwb->lat_baseline) {
+		rwb->lat_baseline = sample;
+		return;
+	}
+
+	step = max_t(u64, rwb->lat_baseline >> RWB_ADAPT_STEP_SHIFT, 1);
+	if (sample > rwb->lat_baseline)
+		rwb->lat_baseline += div_u64(step * RWB_ADAPT_PERCENTILE, 100);
+	else if (sample < rwb->lat_baseline)
+		rwb->lat_baseline -= min(rwb->lat_baseline - sample,
+			div_u64(step * (100 - RWB_ADAPT_PERCENTILE), 100));
+}
+
 static int latency_exceeded(struct rq_wb *rwb, struct blk_rq_stat *stat)
 {
 	struct backing_dev_info *bdi = rwb->rqos.q->backing_dev_info;
 	struct rq_depth *rqd = &rwb->rq_depth;
+	u64 target = rwb_target_lat(rwb);
 	u64 thislat;
 
 	/*
@@ -247,7 +299,7 @@ static int latency_exceeded(struct rq_wb *rwb, struct blk_rq_stat *stat)
 	 */
 	thislat = rwb_sync_issue_lat(rwb);
 	if (thislat > rwb->cur_win_nsec ||
-	    (thislat > rwb->min_lat_nsec && !stat[READ].nr_samples)) {
+	    (thislat > target && !stat[READ].nr_samples)) {
 		trace_wbt_lat(bdi, thislat);
 		return LAT_EXCEEDED;
 	}
@@ -271,7 +323,7 @@ static int latency_exceeded(struct rq_wb *rwb, struct blk_rq_stat *stat)
 	/*
 	 * If the 'min' latency exceeds our target, step down.
 	 */
-	if (stat[READ].min > rwb->min_lat_nsec) {
+	if (stat[READ].min > target) {
 		trace_wbt_lat(bdi, stat[READ].min);
 		trace_wbt_stat(bdi, stat);
 		return LAT_EXCEEDED;
@@ -303,6 +355,23 @@ static void calc_wb_limits(struct rq_wb *rwb)
 		rwb->wb_normal = (rwb->rq_depth.max_depth + 1) / 2;
 		rwb->wb_background = (rwb->rq_depth.max_depth + 3) / 4;
 	}
+
+	/*
+	 * Between scale steps, shrink writeback proportionally to how far
+	 * reads are from the learned target.
+	 */
+	if (rwb->wb_normal && rwb->adaptive && rwb->lat_baseline) {
+		u64 target = rwb_target_lat(rwb);
+
+		if (rwb->read_lat > target) {
+			rwb->wb_normal = max_t(u64, 1,
+				div64_u64((u64)rwb->wb_normal * target,
+					  rwb->read_lat));
+			rwb->wb_background = max_t(u64, 1,
+				div64_u64((u64)rwb->wb_background * target,
+					  rwb->read_lat));
+		}
+	}
 }
 
 static void scale_up(struct rq_wb *rwb)
@@ -353,6 +422,9 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	unsigned int inflight = wbt_inflight(rwb);
 	int status;
 
+	if (rwb->adaptive)
+		rwb_learn_baseline(rwb, cb->stat);
+
 	status = latency_exceeded(rwb, cb->stat);
 
 	trace_wbt_timer(rwb->rqos.q->backing_dev_info, status, rqd->scale_step,
@@ -441,6 +513,28 @@ void wbt_set_min_lat(struct request_queue *q, u64 val)
 	__wbt_update_limits(RQWB(rqos));
 }
 
+bool wbt_get_adaptive(struct request_queue *q)
+{
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	if (!rqos)
+		return false;
+	return RQWB(rqos)->adaptive;
+}
+
+void wbt_set_adaptive(struct request_queue *q, bool adaptive)
+{
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	struct rq_wb *rwb;
+	if (!rqos)
+		return;
+	rwb = RQWB(rqos);
+	rwb->adaptive = adaptive;
+	/* relearn from scratch, the device or its workload may have changed */
+	rwb->lat_baseline = 0;
+	rwb->read_lat = 0;
+	__wbt_update_limits(rwb);
+}
+
 
 static bool close_io(struct rq_wb *rwb)
 {
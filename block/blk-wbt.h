@@ -64,6 +64,16 @@ struct rq_wb {
 	unsigned long last_issue;		/* last non-throttled issue */
 	unsigned long last_comp;		/* last non-throttled comp */
 	unsigned long min_lat_nsec;
+
+	/*
+	 * Adaptive mode: low percentile of the per window minimum read
+	 * latency, learned at runtime, and mean read latency of the last
+	 * window. The target becomes a multiple of the former.
+	 */
+	bool adaptive;
+	u64 lat_baseline;
+	u64 read_lat;
+
 	struct rq_qos rqos;
 	struct rq_wait rq_wait[WBT_NUM_RWQ];
 	struct rq_depth rq_depth;
@@ -94,6 +104,8 @@ void wbt_enable_default(struct request_queue *);
 
 u64 wbt_get_min_lat(struct request_queue *q);
 void wbt_set_min_lat(struct request_queue *q, u64 val);
+bool wbt_get_adaptive(struct request_queue *q);
+void wbt_set_adaptive(struct request_queue *q, bool adaptive);
 
 void wbt_set_queue_depth(struct request_queue *, unsigned int);
 void wbt_set_write_cache(struct request_queue *, bool);
@@ -131,6 +143,13 @@ static inline u64 wbt_get_min_lat(struct request_queue *q)
 static inline void wbt_set_min_lat(struct request_queue *q, u64 val)
 {
 }
+static inline bool wbt_get_adaptive(struct request_queue *q)
+{
+	return false;
+}
+static inline void wbt_set_adaptive(struct request_queue *q, bool adaptive)
+{
+}
 static inline u64 wbt_default_latency_nsec(struct request_queue *q)
 {
 	return 0;
@@ -168,6 +168,27 @@ static inline bool bio_integrity_endio(struct bio *bio)
 }
 #endif
 
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+int bio_crypt_ctx_init(void);
+bool blk_crypto_rq_bio_mergeable(struct request *rq, struct bio *bio);
+blk_status_t blk_crypto_submit_bio(struct request_queue *q, struct bio *bio);
+#else
+static inline int bio_crypt_ctx_init(void)
+{
+	return 0;
+}
+static inline bool blk_crypto_rq_bio_mergeable(struct request *rq,
+					       struct bio *bio)
+{
+	return true;
+}
+static inline blk_status_t blk_crypto_submit_bio(struct request_queue *q,
+						 struct bio *bio)
+{
+	return BLK_STS_OK;
+}
+#endif /* CONFIG_BLK_INLINE_ENCRYPTION */
+
 void blk_timeout_work(struct work_struct *work);
 unsigned long blk_rq_timeout(unsigned long timeout);
 void blk_add_timer(struct request *req);
@@ -431,4 +452,10 @@ extern int blk_iolatency_init(struct request_queue *q);
 static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
 #endif
 
+#ifdef CONFIG_BLK_CGROUP_IOCOST
+extern int blk_iocost_init(struct request_queue *q);
+#else
+static inline int blk_iocost_init(struct request_queue *q) { return 0; }
+#endif
+
 #endif /* BLK_INTERNAL_H */
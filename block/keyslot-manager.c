@@ -0,0 +1,351 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Keyslot manager of inline encryption hardware
+ *
+ * Each keyslot has a reference count of the bios using it. Slots without
+ * users are kept on an LRU list of idle slots, and a key that isn't loaded
+ * yet is programmed into the head of that list. Programming and eviction
+ * are serialized with the lookups through a rw_semaphore, lookups of keys
+ * already programmed only taking it for reading.
+ */
+#include <linux/keyslot-manager.h>
+#include <linux/atomic.h>
+#include <linux/log2.h>
+#include <linux/wait.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <crypto/algapi.h>
+
+struct keyslot {
+	atomic_t slot_refs;
+	struct list_head idle_slot_node;
+	/* copy of the key programmed in the slot, size is 0 if none */
+	struct blk_crypto_key key;
+};
+
+struct keyslot_manager {
+	unsigned int num_slots;
+	struct keyslot_mgmt_ll_ops ksm_ll_ops;
+	unsigned int crypto_mode_supported[BLK_ENCRYPTION_MODE_MAX];
+	void *ll_priv_data;
+
+	/* Protects programming and evicting keys from the device */
+	struct rw_semaphore lock;
+
+	/* List of idle slots, with least recently used slot at front */
+	wait_queue_head_t idle_slots_wait_queue;
+	struct list_head idle_slots;
+	spinlock_t idle_slots_lock;
+
+	struct keyslot slots[];
+};
+
+/**
+ * keyslot_manager_create() - Create a keyslot manager
+ * @num_slots: number of keyslots of the hardware
+ * @ksm_ll_ops: driver operations to program and evict keys
+ * @crypto_mode_supported: for each crypto mode, the bitmask of the data
+ *			   unit sizes the hardware supports, 0 if none
+ * @ll_priv_data: driver private data
+ *
+ * Return: the keyslot manager, or NULL on failure.
+ */
+struct keyslot_manager *keyslot_manager_create(unsigned int num_slots,
+	const struct keyslot_mgmt_ll_ops *ksm_ll_ops,
+	const unsigned int crypto_mode_supported[BLK_ENCRYPTION_MODE_MAX],
+	void *ll_priv_data)
+{
+	struct keyslot_manager *ksm;
+	unsigned int slot;
+
+	if (num_slots == 0)
+		return NULL;
+
+	/* Check that all ops are specified */
+	if (ksm_ll_ops->keyslot_program == NULL ||
+	    ksm_ll_ops->keyslot_evict == NULL)
+		return NULL;
+
+	ksm = kvzalloc(struct_size(ksm, slots, num_slots), GFP_KERNEL);
+	if (!ksm)
+		return NULL;
+
+	ksm->num_slots = num_slots;
+	ksm->ksm_ll_ops = *ksm_ll_ops;
+	memcpy(ksm->crypto_mode_supported, crypto_mode_supported,
+	       sizeof(ksm->crypto_mode_supported));
+	ksm->ll_priv_data = ll_priv_data;
+
+	init_rwsem(&ksm->lock);
+
+	init_waitqueue_head(&ksm->idle_slots_wait_queue);
+	INIT_LIST_HEAD(&ksm->idle_slots);
+
+	for (slot = 0; slot < num_slots; slot++) {
+		list_add_tail(&ksm->slots[slot].idle_slot_node,
+			      &ksm->idle_slots);
+	}
+
+	spin_lock_init(&ksm->idle_slots_lock);
+
+	return ksm;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_create);
+
+static inline bool keyslot_key_equal(const struct blk_crypto_key *k1,
+				     const struct blk_crypto_key *k2)
+{
+	return k1->crypto_mode == k2->crypto_mode &&
+	       k1->data_unit_size == k2->data_unit_size &&
+	       k1->size == k2->size &&
+	       !crypto_memneq(k1->raw, k2->raw, k1->size);
+}
+
+static int find_keyslot(struct keyslot_manager *ksm,
+			const struct blk_crypto_key *key)
+{
+	unsigned int slot;
+
+	for (slot = 0; slot < ksm->num_slots; slot++) {
+		if (ksm->slots[slot].key.size &&
+		    keyslot_key_equal(&ksm->slots[slot].key, key))
+			return slot;
+	}
+	return -ENOKEY;
+}
+
+static void remove_slot_from_lru_list(struct keyslot_manager *ksm, int slot)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ksm->idle_slots_lock, flags);
+	list_del(&ksm->slots[slot].idle_slot_node);
+	spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
+}
+
+static int find_and_grab_keyslot(struct keyslot_manager *ksm,
+				 const struct blk_crypto_key *key)
+{
+	int slot;
+
+	slot = find_keyslot(ksm, key);
+	if (slot < 0)
+		return slot;
+	if (atomic_inc_return(&ksm->slots[slot].slot_refs) == 1) {
+		/* Took first reference to this slot; remove it from LRU list */
+		remove_slot_from_lru_list(ksm, slot);
+	}
+	return slot;
+}
+
+/**
+ * keyslot_manager_get_slot_for_key() - Program a key into a keyslot
+ * @ksm: the keyslot manager
+ * @key: the key to program
+ *
+ * Get a keyslot that's been programmed with @key, programming it into the
+ * least recently used idle slot if it isn't loaded yet, and waiting for a
+ * slot to become idle if none is. Takes a reference on the slot that must
+ * be dropped with keyslot_manager_put_slot(). Context: process context.
+ *
+ * Return: the keyslot on success, -errno on failure.
+ */
+int keyslot_manager_get_slot_for_key(struct keyslot_manager *ksm,
+				     const struct blk_crypto_key *key)
+{
+	struct keyslot *idle_slot;
+	int slot;
+	int err;
+
+	down_read(&ksm->lock);
+	slot = find_and_grab_keyslot(ksm, key);
+	up_read(&ksm->lock);
+	if (slot != -ENOKEY)
+		return slot;
+
+	for (;;) {
+		down_write(&ksm->lock);
+		slot = find_and_grab_keyslot(ksm, key);
+		if (slot != -ENOKEY) {
+			up_write(&ksm->lock);
+			return slot;
+		}
+
+		/*
+		 * If we're here, that means there wasn't a slot that was
+		 * already programmed with the key. So try to program it.
+		 */
+		if (!list_empty(&ksm->idle_slots))
+			break;
+
+		up_write(&ksm->lock);
+		wait_event(ksm->idle_slots_wait_queue,
+			   !list_empty(&ksm->idle_slots));
+	}
+
+	idle_slot = list_first_entry(&ksm->idle_slots, struct keyslot,
+				     idle_slot_node);
+	slot = idle_slot - ksm->slots;
+
+	err = ksm->ksm_ll_ops.keyslot_program(ksm, key, slot);
+	if (err) {
+		/* the slot may be left half programmed, forget its key */
+		memzero_explicit(&idle_slot->key, sizeof(idle_slot->key));
+		wake_up(&ksm->idle_slots_wait_queue);
+		up_write(&ksm->lock);
+		return err;
+	}
+
+	idle_slot->key = *key;
+	atomic_set(&idle_slot->slot_refs, 1);
+	remove_slot_from_lru_list(ksm, slot);
+
+	up_write(&ksm->lock);
+	return slot;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_get_slot_for_key);
+
+/**
+ * keyslot_manager_get_slot() - Increment the refcount on the specified slot.
+ * @ksm: the keyslot manager
+ * @slot: the slot, on which the caller already holds a reference
+ */
+void keyslot_manager_get_slot(struct keyslot_manager *ksm, unsigned int slot)
+{
+	if (WARN_ON(slot >= ksm->num_slots))
+		return;
+
+	WARN_ON(atomic_inc_return(&ksm->slots[slot].slot_refs) < 2);
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_get_slot);
+
+/**
+ * keyslot_manager_put_slot() - Release a reference to a slot
+ * @ksm: the keyslot manager
+ * @slot: the slot to release a reference to
+ *
+ * Context: any context.
+ */
+void keyslot_manager_put_slot(struct keyslot_manager *ksm, unsigned int slot)
+{
+	unsigned long flags;
+
+	if (WARN_ON(slot >= ksm->num_slots))
+		return;
+
+	if (atomic_dec_and_lock_irqsave(&ksm->slots[slot].slot_refs,
+					&ksm->idle_slots_lock, flags)) {
+		list_add_tail(&ksm->slots[slot].idle_slot_node,
+			      &ksm->idle_slots);
+		spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
+		wake_up(&ksm->idle_slots_wait_queue);
+	}
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_put_slot);
+
+/**
+ * keyslot_manager_crypto_mode_supported() - Find out if a crypto mode and
+ *					     data unit size are supported
+ * @ksm: the keyslot manager
+ * @crypto_mode: the crypto mode to check for
+ * @data_unit_size: the data unit size to check for
+ */
+bool keyslot_manager_crypto_mode_supported(struct keyslot_manager *ksm,
+					   enum blk_crypto_mode_num crypto_mode,
+					   unsigned int data_unit_size)
+{
+	if (!ksm || crypto_mode <= BLK_ENCRYPTION_MODE_INVALID ||
+	    crypto_mode >= BLK_ENCRYPTION_MODE_MAX)
+		return false;
+	WARN_ON(!is_power_of_2(data_unit_size));
+	return ksm->crypto_mode_supported[crypto_mode] & data_unit_size;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_crypto_mode_supported);
+
+/**
+ * keyslot_manager_evict_key() - Evict a key from the hardware
+ * @ksm: the keyslot manager
+ * @key: the key to evict
+ *
+ * Return: 0 on success or if the key wasn't programmed, -EBUSY if the key
+ * is still in use, or another -errno value if the driver failed.
+ */
+int keyslot_manager_evict_key(struct keyslot_manager *ksm,
+			      const struct blk_crypto_key *key)
+{
+	struct keyslot *slotp;
+	int slot;
+	int err;
+
+	down_write(&ksm->lock);
+	slot = find_keyslot(ksm, key);
+	if (slot < 0) {
+		err = 0;
+		goto out_unlock;
+	}
+	slotp = &ksm->slots[slot];
+
+	if (atomic_read(&slotp->slot_refs) != 0) {
+		err = -EBUSY;
+		goto out_unlock;
+	}
+	err = ksm->ksm_ll_ops.keyslot_evict(ksm, key, slot);
+	if (err)
+		goto out_unlock;
+
+	memzero_explicit(&slotp->key, sizeof(slotp->key));
+out_unlock:
+	up_write(&ksm->lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_evict_key);
+
+/**
+ * keyslot_manager_reprogram_all_keys() - Re-program all keyslots.
+ * @ksm: the keyslot manager
+ *
+ * Re-program all keyslots that are supposed to have a key programmed, for
+ * use when the hardware lost them, typically after a reset.
+ */
+void keyslot_manager_reprogram_all_keys(struct keyslot_manager *ksm)
+{
+	unsigned int slot;
+
+	down_write(&ksm->lock);
+	for (slot = 0; slot < ksm->num_slots; slot++) {
+		const struct blk_crypto_key *key = &ksm->slots[slot].key;
+		int err;
+
+		if (!key->size)
+			continue;
+
+		err = ksm->ksm_ll_ops.keyslot_program(ksm, key, slot);
+		WARN_ON(err);
+	}
+	up_write(&ksm->lock);
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_reprogram_all_keys);
+
+/**
+ * keyslot_manager_private() - return the private data of the driver
+ * @ksm: the keyslot manager
+ */
+void *keyslot_manager_private(struct keyslot_manager *ksm)
+{
+	return ksm->ll_priv_data;
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_private);
+
+/**
+ * keyslot_manager_destroy() - free a keyslot manager
+ * @ksm: the keyslot manager, no bio may be using it anymore
+ */
+void keyslot_manager_destroy(struct keyslot_manager *ksm)
+{
+	if (ksm) {
+		memzero_explicit(ksm->slots,
+				 sizeof(ksm->slots[0]) * ksm->num_slots);
+		kvfree(ksm);
+	}
+}
+EXPORT_SYMBOL_GPL(keyslot_manager_destroy);
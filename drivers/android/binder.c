@@ -51,12 +51,15 @@
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
+#include <linux/dma-buf.h>
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/freezer.h>
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/miscdevice.h>
+#include <linux/mman.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/nsproxy.h>
@@ -65,12 +68,15 @@
 #include <linux/rbtree.h>
 #include <linux/sched/signal.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/topology.h>
 #include <linux/seq_file.h>
 #include <linux/uaccess.h>
 #include <linux/pid_namespace.h>
 #include <linux/security.h>
 #include <linux/spinlock.h>
 #include <linux/ratelimit.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
 
 #include <uapi/linux/android/binder.h>
 #include <uapi/linux/sched/types.h>
@@ -143,6 +149,38 @@ static uint32_t binder_debug_mask = BINDER_DEBUG_USER_ERROR |
 	BINDER_DEBUG_FAILED_TRANSACTION | BINDER_DEBUG_DEAD_TRANSACTION;
 module_param_named(debug_mask, binder_debug_mask, uint, 0644);
 
+/*
+ * Oneway transactions to a node that already has an async transaction in
+ * flight are parked on node->async_pending without taking the target's
+ * proc->inner_lock. Once BINDER_ASYNC_PENDING_MAX transactions are
+ * parked, new ones fall back to the locked path.
+ */
+#define BINDER_ASYNC_PENDING_MAX	64
+
+/* maximum number of transactions submitted by one BC_TRANSACTION_BATCH */
+#define BINDER_BATCH_MAX		64
+/* target processes whose wakeup a batch can defer */
+#define BINDER_BATCH_MAX_PROCS		8
+static bool binder_async_fast_path = true;
+module_param_named(async_fast_path, binder_async_fast_path, bool, 0644);
+
+/*
+ * How binder_select_thread_ilocked() picks among waiting threads:
+ * 0: the thread that has been waiting the longest
+ * 1: prefer a thread that last ran on the current CPU
+ * 2: as 1, then prefer a thread that shares a cache with the current CPU
+ * Only the first BINDER_SELECT_THREAD_SCAN waiting threads are considered.
+ */
+enum {
+	BINDER_SELECT_THREAD_FIFO,
+	BINDER_SELECT_THREAD_SAME_CPU,
+	BINDER_SELECT_THREAD_SAME_CLUSTER,
+};
+#define BINDER_SELECT_THREAD_SCAN	8
+static uint binder_select_thread_policy = BINDER_SELECT_THREAD_SAME_CLUSTER;
+module_param_named(select_thread_policy, binder_select_thread_policy,
+		   uint, 0644);
+
 static char *binder_devices_param = CONFIG_ANDROID_BINDER_DEVICES;
 module_param_named(devices, binder_devices_param, charp, 0444);
 
@@ -187,6 +225,9 @@ module_param_call(stop_on_user_error, binder_set_stop_on_user_error,
 #define to_binder_fd_array_object(hdr) \
 	container_of(hdr, struct binder_fd_array_object, hdr)
 
+#define to_binder_dmabuf_object(hdr) \
+	container_of(hdr, struct binder_dmabuf_object, hdr)
+
 enum binder_stat_types {
 	BINDER_STAT_PROC,
 	BINDER_STAT_THREAD,
@@ -200,7 +241,7 @@ enum binder_stat_types {
 
 struct binder_stats {
 	atomic_t br[_IOC_NR(BR_FAILED_REPLY) + 1];
-	atomic_t bc[_IOC_NR(BC_REPLY_SG) + 1];
+	atomic_t bc[_IOC_NR(BC_TRANSACTION_BATCH) + 1];
 	atomic_t obj_created[BINDER_STAT_COUNT];
 	atomic_t obj_deleted[BINDER_STAT_COUNT];
 };
@@ -262,12 +303,42 @@ static struct binder_transaction_log_entry *binder_transaction_log_add(
 	return e;
 }
 
+enum binder_latency_type {
+	BINDER_LATENCY_QUEUE,	/* transaction queued until dequeued */
+	BINDER_LATENCY_REPLY,	/* transaction dequeued until replied */
+	BINDER_LATENCY_COUNT
+};
+
+/* bucket n counts latencies in [2^(n-1), 2^n) usecs, bucket 0 < 1 usec */
+#define BINDER_LATENCY_BUCKETS	24
+
+struct binder_latency_hist {
+	u64 buckets[BINDER_LATENCY_COUNT][BINDER_LATENCY_BUCKETS];
+};
+
+static void binder_latency_add(struct binder_latency_hist __percpu *hist,
+			       enum binder_latency_type type, ktime_t start,
+			       ktime_t now)
+{
+	unsigned int bucket;
+	s64 us;
+
+	if (!hist || !start)
+		return;
+
+	us = ktime_us_delta(now, start);
+	bucket = us > 0 ? min_t(unsigned int, fls64(us),
+				BINDER_LATENCY_BUCKETS - 1) : 0;
+	this_cpu_inc(hist->buckets[type][bucket]);
+}
+
 struct binder_context {
 	struct binder_node *binder_context_mgr_node;
 	struct mutex context_mgr_node_lock;
 
 	kuid_t binder_context_mgr_uid;
 	const char *name;
+	struct binder_latency_hist __percpu *latency;
 };
 
 struct binder_device {
@@ -362,6 +433,13 @@ struct binder_error {
  *                        (invariant after initialized)
  * @async_todo:           list of async work items
  *                        (protected by @proc->inner_lock)
+ * @async_pending:        lock-free list of async transactions queued
+ *                        while @has_async_transaction was set; spliced
+ *                        onto @async_todo under @proc->inner_lock
+ *                        (producers lockless, consumers hold
+ *                        @proc->inner_lock)
+ * @async_pending_count:  number of entries on @async_pending
+ *                        (atomic, no lock needed)
  *
  * Bookkeeping structure for binder nodes.
  */
@@ -403,6 +481,8 @@ struct binder_node {
 	};
 	bool has_async_transaction;
 	struct list_head async_todo;
+	struct llist_head async_pending;
+	atomic_t async_pending_count;
 };
 
 struct binder_ref_death {
@@ -537,6 +617,8 @@ struct binder_priority {
  * @alloc:                binder allocator bookkeeping
  * @context:              binder_context for this proc
  *                        (invariant after initialized)
+ * @latency:              per-cpu transaction latency histograms
+ *                        (per-cpu counters, no lock needed)
  * @inner_lock:           can nest under outer_lock and/or node lock
  * @outer_lock:           no nesting under innor or node lock
  *                        Lock order: 1) outer, 2) node, 3) inner
@@ -569,10 +651,25 @@ struct binder_proc {
 	struct dentry *debugfs_entry;
 	struct binder_alloc alloc;
 	struct binder_context *context;
+	struct binder_latency_hist __percpu *latency;
 	spinlock_t inner_lock;
 	spinlock_t outer_lock;
 };
 
+/**
+ * struct binder_batch - wakeups deferred by BC_TRANSACTION_BATCH
+ * @nr_procs:             number of valid entries in @procs
+ * @procs:                target processes with oneway work queued to
+ *                        their todo list but not yet woken up. A
+ *                        tmp_ref is held on each of them.
+ *
+ * Lives on the stack of the thread handling BC_TRANSACTION_BATCH.
+ */
+struct binder_batch {
+	int nr_procs;
+	struct binder_proc *procs[BINDER_BATCH_MAX_PROCS];
+};
+
 enum {
 	BINDER_LOOPER_STATE_REGISTERED  = 0x01,
 	BINDER_LOOPER_STATE_ENTERED     = 0x02,
@@ -616,6 +713,9 @@ enum {
  *                        when outstanding transactions are cleaned up
  *                        (protected by @proc->inner_lock)
  * @task:                 struct task_struct for this thread
+ * @batch:                wakeups deferred by the BC_TRANSACTION_BATCH
+ *                        currently being handled, or NULL
+ *                        (only accessed by this thread)
  *
  * Bookkeeping structure for binder threads.
  */
@@ -636,6 +736,7 @@ struct binder_thread {
 	atomic_t tmp_ref;
 	bool is_dead;
 	struct task_struct *task;
+	struct binder_batch *batch;
 };
 
 struct binder_transaction {
@@ -646,7 +747,9 @@ struct binder_transaction {
 	struct binder_proc *to_proc;
 	struct binder_thread *to_thread;
 	struct binder_transaction *to_parent;
+	struct llist_node async_entry;
 	unsigned need_reply:1;
+	unsigned has_dmabuf:1;
 	/* unsigned is_dead:1; */	/* not used at the moment */
 
 	struct binder_buffer *buffer;
@@ -657,6 +760,8 @@ struct binder_transaction {
 	bool    set_priority_called;
 	kuid_t	sender_euid;
 	binder_uintptr_t security_ctx;
+	ktime_t queue_time;
+	ktime_t dequeue_time;
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
 	 *
@@ -666,6 +771,23 @@ struct binder_transaction {
 	spinlock_t lock;
 };
 
+/**
+ * binder_latency_record() - account a transaction latency
+ * @proc:	proc that handled the transaction
+ * @type:	which latency to account
+ * @start:	start of the measured interval, 0 if unknown
+ * @now:	end of the measured interval
+ *
+ * Adds the latency to the histograms of @proc and of its context.
+ */
+static void binder_latency_record(struct binder_proc *proc,
+				  enum binder_latency_type type,
+				  ktime_t start, ktime_t now)
+{
+	binder_latency_add(proc->latency, type, start, now);
+	binder_latency_add(proc->context->latency, type, start, now);
+}
+
 /**
  * binder_proc_lock() - Acquire outer lock for given binder_proc
  * @proc:         struct binder_proc to acquire
@@ -947,6 +1069,8 @@ static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 static void binder_free_thread(struct binder_thread *thread);
 static void binder_free_proc(struct binder_proc *proc);
+static void binder_release_work(struct binder_proc *proc,
+				struct list_head *list);
 static void binder_inc_node_tmpref_ilocked(struct binder_node *node);
 
 static int task_get_unused_fd_flags(struct binder_proc *proc, int flags)
@@ -1064,19 +1188,47 @@ static void binder_wakeup_poll_threads_ilocked(struct binder_proc *proc,
  * signal. Therefore, callers *should* always wake up the thread this function
  * returns.
  *
+ * Depending on binder_select_thread_policy, a waiting thread whose last CPU
+ * is the current CPU, or shares a cache with it, is preferred over the one
+ * that has been waiting the longest, to keep the work cache-warm and avoid
+ * cross-cluster wakeups.
+ *
  * Return:	If there's a thread currently waiting for process work,
  *		returns that thread. Otherwise returns NULL.
  */
 static struct binder_thread *
 binder_select_thread_ilocked(struct binder_proc *proc)
 {
-	struct binder_thread *thread;
+	struct binder_thread *thread, *itr, *cluster_thread = NULL;
+	unsigned int policy = READ_ONCE(binder_select_thread_policy);
+	int this_cpu, scanned = 0;
 
 	assert_spin_locked(&proc->inner_lock);
 	thread = list_first_entry_or_null(&proc->waiting_threads,
 					  struct binder_thread,
 					  waiting_thread_node);
+	if (!thread || policy == BINDER_SELECT_THREAD_FIFO)
+		goto out;
+
+	this_cpu = smp_processor_id();
+	list_for_each_entry(itr, &proc->waiting_threads, waiting_thread_node) {
+		int cpu = task_cpu(itr->task);
+
+		if (cpu == this_cpu) {
+			thread = itr;
+			goto out;
+		}
+		if (!cluster_thread &&
+		    policy == BINDER_SELECT_THREAD_SAME_CLUSTER &&
+		    cpus_share_cache(cpu, this_cpu))
+			cluster_thread = itr;
+		if (++scanned == BINDER_SELECT_THREAD_SCAN)
+			break;
+	}
+	if (cluster_thread)
+		thread = cluster_thread;
 
+out:
 	if (thread)
 		list_del_init(&thread->waiting_thread_node);
 
@@ -1370,6 +1522,7 @@ static struct binder_node *binder_init_node_ilocked(
 	spin_lock_init(&node->lock);
 	INIT_LIST_HEAD(&node->work.entry);
 	INIT_LIST_HEAD(&node->async_todo);
+	init_llist_head(&node->async_pending);
 	binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 		     "%d:%d node %d u%016llx c%016llx created\n",
 		     proc->pid, current->pid, node->debug_id,
@@ -2238,6 +2391,9 @@ static size_t binder_validate_object(struct binder_buffer *buffer, u64 offset)
 	case BINDER_TYPE_FDA:
 		object_size = sizeof(struct binder_fd_array_object);
 		break;
+	case BINDER_TYPE_DMABUF:
+		object_size = sizeof(struct binder_dmabuf_object);
+		break;
 	default:
 		return 0;
 	}
@@ -2433,6 +2589,16 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 			 * transaction buffer gets freed
 			 */
 			break;
+		case BINDER_TYPE_DMABUF: {
+			struct binder_dmabuf_object *dbo =
+				to_binder_dmabuf_object(hdr);
+
+			binder_debug(BINDER_DEBUG_TRANSACTION,
+				     "        dmabuf fd %d\n", dbo->fd);
+			/* a delivered mapping is owned by the receiver */
+			if (failed_at)
+				task_close_fd(proc, dbo->fd);
+		} break;
 		case BINDER_TYPE_FDA: {
 			struct binder_fd_array_object *fda;
 			struct binder_buffer_object *parent;
@@ -2663,6 +2829,96 @@ static int binder_translate_fd(int fd,
 	return ret;
 }
 
+static int binder_translate_dmabuf(struct binder_dmabuf_object *dbo,
+				   struct binder_transaction *t,
+				   struct binder_thread *thread,
+				   struct binder_transaction *in_reply_to)
+{
+	struct binder_proc *proc = thread->proc;
+	struct dma_buf *dmabuf;
+	int target_fd;
+
+	dmabuf = dma_buf_get(dbo->fd);
+	if (IS_ERR(dmabuf)) {
+		binder_user_error("%d:%d got transaction with invalid dma-buf fd, %d\n",
+				  proc->pid, thread->pid, dbo->fd);
+		return PTR_ERR(dmabuf);
+	}
+	if (dbo->flags & ~BINDER_DMABUF_FLAG_WRITE || !dbo->length ||
+	    !PAGE_ALIGNED(dbo->offset) || dbo->offset > dmabuf->size ||
+	    dbo->length > dmabuf->size - dbo->offset) {
+		binder_user_error("%d:%d got transaction with invalid dma-buf range %llx-%llx, size %zx\n",
+				  proc->pid, thread->pid, (u64)dbo->offset,
+				  (u64)dbo->length, dmabuf->size);
+		dma_buf_put(dmabuf);
+		return -EINVAL;
+	}
+	dma_buf_put(dmabuf);
+
+	target_fd = binder_translate_fd(dbo->fd, t, thread, in_reply_to);
+	if (target_fd < 0)
+		return target_fd;
+
+	dbo->fd = target_fd;
+	dbo->pad = 0;
+	dbo->buffer = 0;
+	t->has_dmabuf = 1;
+	return 0;
+}
+
+/**
+ * binder_map_dmabufs() - map dma-buf ranges of a delivered transaction
+ * @proc:	receiving proc; must be called from a thread of @proc
+ * @buffer:	buffer of the transaction being delivered
+ *
+ * Maps every binder_dmabuf_object range of @buffer into the address
+ * space of the current task. The fds were already installed in @proc by
+ * binder_translate_dmabuf(), so they are resolved again here rather than
+ * keeping file references in the buffer. Objects whose range cannot be
+ * mapped are left with a 0 @buffer for userspace to fall back to mmap().
+ */
+static void binder_map_dmabufs(struct binder_proc *proc,
+			       struct binder_buffer *buffer)
+{
+	binder_size_t *offp, *off_start, *off_end;
+
+	off_start = (binder_size_t *)(buffer->data +
+				      ALIGN(buffer->data_size, sizeof(void *)));
+	off_end = (void *)off_start + buffer->offsets_size;
+	for (offp = off_start; offp < off_end; offp++) {
+		struct binder_object_header *hdr;
+		struct binder_dmabuf_object *dbo;
+		struct dma_buf *dmabuf;
+		unsigned long addr;
+		unsigned long prot = PROT_READ;
+
+		if (!binder_validate_object(buffer, *offp))
+			continue;
+		hdr = (struct binder_object_header *)(buffer->data + *offp);
+		if (hdr->type != BINDER_TYPE_DMABUF)
+			continue;
+
+		dbo = to_binder_dmabuf_object(hdr);
+		dmabuf = dma_buf_get(dbo->fd);
+		if (IS_ERR(dmabuf))
+			continue;
+		if (dbo->length <= dmabuf->size &&
+		    dbo->offset <= dmabuf->size - dbo->length) {
+			if (dbo->flags & BINDER_DMABUF_FLAG_WRITE)
+				prot |= PROT_WRITE;
+			addr = vm_mmap(dmabuf->file, 0, PAGE_ALIGN(dbo->length),
+				       prot, MAP_SHARED, dbo->offset);
+			if (!IS_ERR_VALUE(addr))
+				dbo->buffer = addr;
+			else
+				binder_debug(BINDER_DEBUG_TRANSACTION,
+					     "%d: dmabuf fd %d map failed %ld\n",
+					     proc->pid, dbo->fd, (long)addr);
+		}
+		dma_buf_put(dmabuf);
+	}
+}
+
 static int binder_translate_fd_array(struct binder_fd_array_object *fda,
 				     struct binder_buffer_object *parent,
 				     struct binder_transaction *t,
@@ -2769,6 +3025,204 @@ static int binder_fixup_parent(struct binder_transaction *t,
 	return 0;
 }
 
+/**
+ * binder_node_splice_async_ilocked() - move parked async work to async_todo
+ * @node:	node whose @async_pending list should be drained
+ *
+ * Moves all transactions parked on @node->async_pending by
+ * binder_proc_transaction_async_fast() to the tail of @node->async_todo,
+ * preserving submission order.
+ *
+ * Requires the proc->inner_lock of @node->proc to be held.
+ */
+static void binder_node_splice_async_ilocked(struct binder_node *node)
+{
+	struct binder_transaction *t, *tmp;
+	struct llist_node *list;
+
+	list = llist_del_all(&node->async_pending);
+	if (!list)
+		return;
+
+	list = llist_reverse_order(list);
+	llist_for_each_entry_safe(t, tmp, list, async_entry) {
+		atomic_dec(&node->async_pending_count);
+		binder_enqueue_work_ilocked(&t->work, &node->async_todo);
+	}
+}
+
+/**
+ * binder_node_kick_async_nilocked() - start the next async transaction
+ * @node:	node to start the async transaction for
+ * @proc:	process owning @node
+ *
+ * If no async transaction is in progress for @node, moves the head of
+ * @node->async_todo to @proc->todo and wakes up a thread to handle it.
+ *
+ * Requires node->lock and proc->inner_lock to be held.
+ */
+static void binder_node_kick_async_nilocked(struct binder_node *node,
+					    struct binder_proc *proc)
+{
+	struct binder_work *w;
+
+	if (node->has_async_transaction)
+		return;
+
+	w = binder_dequeue_work_head_ilocked(&node->async_todo);
+	if (!w)
+		return;
+
+	node->has_async_transaction = true;
+	binder_enqueue_work_ilocked(w, &proc->todo);
+	binder_wakeup_proc_ilocked(proc);
+}
+
+/**
+ * binder_proc_transaction_async_fast() - park a oneway transaction locklessly
+ * @t:		oneway transaction to send
+ * @node:	target node of @t
+ * @proc:	process owning @node
+ *
+ * A oneway transaction to a node that already has an async transaction in
+ * flight is never delivered immediately; it waits until the receiver frees
+ * the buffer of the current one. Such transactions are pushed onto the
+ * lock-free @node->async_pending list instead of taking the node and
+ * inner locks of the target process, so that bursts of oneway calls to a
+ * busy node don't serialize on @proc->inner_lock.
+ *
+ * If the in-flight async transaction completed, or the target died, while
+ * @t was being parked, the parked work is flushed here under the locks.
+ *
+ * Return:	true if @t was queued (or dropped because @proc died
+ *		after @t was parked), false if the caller must use the
+ *		locked path
+ */
+static bool binder_proc_transaction_async_fast(struct binder_transaction *t,
+					       struct binder_node *node,
+					       struct binder_proc *proc)
+{
+	LIST_HEAD(dead_work);
+
+	if (!READ_ONCE(binder_async_fast_path) ||
+	    !READ_ONCE(node->has_async_transaction) ||
+	    READ_ONCE(proc->is_dead))
+		return false;
+
+	if (atomic_inc_return(&node->async_pending_count) >
+	    BINDER_ASYNC_PENDING_MAX) {
+		atomic_dec(&node->async_pending_count);
+		return false;
+	}
+
+	/*
+	 * llist_add() is fully ordered; it pairs with the smp_mb() after
+	 * clearing has_async_transaction in binder_node_async_done_nilocked()
+	 * and with the llist_del_all() in binder_node_release(), so either
+	 * they see @t on the list or we see their update below.
+	 */
+	llist_add(&t->async_entry, &node->async_pending);
+	if (READ_ONCE(node->has_async_transaction) &&
+	    !READ_ONCE(proc->is_dead))
+		return true;
+
+	binder_node_lock(node);
+	binder_inner_proc_lock(proc);
+	binder_node_splice_async_ilocked(node);
+	if (proc->is_dead)
+		list_splice_init(&node->async_todo, &dead_work);
+	else
+		binder_node_kick_async_nilocked(node, proc);
+	binder_inner_proc_unlock(proc);
+	binder_node_unlock(node);
+
+	binder_release_work(proc, &dead_work);
+	return true;
+}
+
+/**
+ * binder_node_async_done_nilocked() - async transaction on node completed
+ * @node:	node whose in-flight async transaction was freed
+ * @proc:	process owning @node
+ *
+ * Hands the next parked async transaction (if any) to @proc, or clears
+ * @node->has_async_transaction when there is none.
+ *
+ * Requires node->lock and proc->inner_lock to be held.
+ */
+static void binder_node_async_done_nilocked(struct binder_node *node,
+					   struct binder_proc *proc)
+{
+	struct binder_work *w;
+
+	binder_node_splice_async_ilocked(node);
+	w = binder_dequeue_work_head_ilocked(&node->async_todo);
+	if (w) {
+		binder_enqueue_work_ilocked(w, &proc->todo);
+		binder_wakeup_proc_ilocked(proc);
+		return;
+	}
+
+	WRITE_ONCE(node->has_async_transaction, false);
+	/* pairs with llist_add() in binder_proc_transaction_async_fast() */
+	smp_mb();
+	binder_node_splice_async_ilocked(node);
+	binder_node_kick_async_nilocked(node, proc);
+}
+
+/**
+ * binder_batch_add_proc_ilocked() - defer the wakeup of @proc to batch end
+ * @batch:	batch being submitted by the current thread
+ * @proc:	target process of a oneway transaction in @batch
+ *
+ * Records @proc in @batch, taking a tmp_ref on it, so that
+ * binder_batch_flush() issues a single wakeup for all oneway transactions
+ * the batch queued to it.
+ *
+ * Requires the proc->inner_lock of @proc to be held.
+ *
+ * Return:	true if the wakeup was deferred, false if @batch is full
+ */
+static bool binder_batch_add_proc_ilocked(struct binder_batch *batch,
+					  struct binder_proc *proc)
+{
+	int i;
+
+	for (i = 0; i < batch->nr_procs; i++)
+		if (batch->procs[i] == proc)
+			return true;
+
+	if (batch->nr_procs == BINDER_BATCH_MAX_PROCS)
+		return false;
+
+	proc->tmp_ref++;
+	batch->procs[batch->nr_procs++] = proc;
+	return true;
+}
+
+/**
+ * binder_batch_flush() - issue the wakeups deferred by a batch
+ * @batch:	batch whose deferred wakeups should be issued
+ *
+ * Wakes up one thread in each process that received oneway work from
+ * @batch and drops the tmp_refs taken by binder_batch_add_proc_ilocked().
+ */
+static void binder_batch_flush(struct binder_batch *batch)
+{
+	int i;
+
+	for (i = 0; i < batch->nr_procs; i++) {
+		struct binder_proc *proc = batch->procs[i];
+
+		binder_inner_proc_lock(proc);
+		if (!proc->is_dead)
+			binder_wakeup_proc_ilocked(proc);
+		binder_inner_proc_unlock(proc);
+		binder_proc_dec_tmpref(proc);
+	}
+	batch->nr_procs = 0;
+}
+
 /**
  * binder_proc_transaction() - sends a transaction to a process and wakes it up
  * @t:		transaction to send
@@ -2783,32 +3237,34 @@ static int binder_fixup_parent(struct binder_transaction *t,
  * If the @thread parameter is not NULL, the transaction is always queued
  * to the waitlist of that specific thread.
  *
+ * If @batch is not NULL, a oneway transaction is queued to the proc
+ * todo list and the wakeup of @proc is left to binder_batch_flush().
+ *
  * Return:	true if the transactions was successfully queued
  *		false if the target process or thread is dead
  */
 static bool binder_proc_transaction(struct binder_transaction *t,
 				    struct binder_proc *proc,
-				    struct binder_thread *thread)
+				    struct binder_thread *thread,
+				    struct binder_batch *batch)
 {
 	struct binder_node *node = t->buffer->target_node;
 	struct binder_priority node_prio;
 	bool oneway = !!(t->flags & TF_ONE_WAY);
 	bool pending_async = false;
+	bool defer_wakeup = false;
 
 	BUG_ON(!node);
-	binder_node_lock(node);
-	node_prio.prio = node->min_priority;
-	node_prio.sched_policy = node->sched_policy;
-
 	if (oneway) {
 		BUG_ON(thread);
-		if (node->has_async_transaction) {
-			pending_async = true;
-		} else {
-			node->has_async_transaction = true;
-		}
+		if (binder_proc_transaction_async_fast(t, node, proc))
+			return true;
 	}
 
+	binder_node_lock(node);
+	node_prio.prio = node->min_priority;
+	node_prio.sched_policy = node->sched_policy;
+
 	binder_inner_proc_lock(proc);
 
 	if (proc->is_dead || (thread && thread->is_dead)) {
@@ -2817,7 +3273,20 @@ static bool binder_proc_transaction(struct binder_transaction *t,
 		return false;
 	}
 
-	if (!thread && !pending_async)
+	if (oneway) {
+		/* keep submission order with transactions parked locklessly */
+		binder_node_splice_async_ilocked(node);
+		binder_node_kick_async_nilocked(node, proc);
+		if (node->has_async_transaction)
+			pending_async = true;
+		else
+			node->has_async_transaction = true;
+	}
+
+	if (oneway && !pending_async && batch)
+		defer_wakeup = binder_batch_add_proc_ilocked(batch, proc);
+
+	if (!thread && !pending_async && !defer_wakeup)
 		thread = binder_select_thread_ilocked(proc);
 
 	if (thread) {
@@ -2830,7 +3299,7 @@ static bool binder_proc_transaction(struct binder_transaction *t,
 		binder_enqueue_work_ilocked(&t->work, &node->async_todo);
 	}
 
-	if (!pending_async)
+	if (!pending_async && !defer_wakeup)
 		binder_wakeup_thread_ilocked(proc, thread, !oneway /* sync */);
 
 	binder_inner_proc_unlock(proc);
@@ -2947,6 +3416,8 @@ static void binder_transaction(struct binder_proc *proc,
 		}
 		thread->transaction_stack = in_reply_to->to_parent;
 		binder_inner_proc_unlock(proc);
+		binder_latency_record(proc, BINDER_LATENCY_REPLY,
+				      in_reply_to->dequeue_time, ktime_get());
 		target_thread = binder_get_txn_from_and_acq_inner(in_reply_to);
 		if (target_thread == NULL) {
 			return_error = BR_DEAD_REPLY;
@@ -3278,6 +3749,19 @@ static void binder_transaction(struct binder_proc *proc,
 			fp->pad_binder = 0;
 			fp->fd = target_fd;
 		} break;
+		case BINDER_TYPE_DMABUF: {
+			struct binder_dmabuf_object *dbo =
+				to_binder_dmabuf_object(hdr);
+
+			ret = binder_translate_dmabuf(dbo, t, thread,
+						      in_reply_to);
+			if (ret < 0) {
+				return_error = BR_FAILED_REPLY;
+				return_error_param = ret;
+				return_error_line = __LINE__;
+				goto err_translate_failed;
+			}
+		} break;
 		case BINDER_TYPE_FDA: {
 			struct binder_fd_array_object *fda =
 				to_binder_fd_array_object(hdr);
@@ -3369,6 +3853,7 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	t->work.type = BINDER_WORK_TRANSACTION;
+	t->queue_time = ktime_get();
 
 	if (reply) {
 		binder_enqueue_thread_work(thread, tcomplete);
@@ -3399,7 +3884,8 @@ static void binder_transaction(struct binder_proc *proc,
 		t->from_parent = thread->transaction_stack;
 		thread->transaction_stack = t;
 		binder_inner_proc_unlock(proc);
-		if (!binder_proc_transaction(t, target_proc, target_thread)) {
+		if (!binder_proc_transaction(t, target_proc, target_thread,
+					     NULL)) {
 			binder_inner_proc_lock(proc);
 			binder_pop_transaction_ilocked(thread, t);
 			binder_inner_proc_unlock(proc);
@@ -3409,7 +3895,8 @@ static void binder_transaction(struct binder_proc *proc,
 		BUG_ON(target_node == NULL);
 		BUG_ON(t->buffer->async_transaction != 1);
 		binder_enqueue_thread_work(thread, tcomplete);
-		if (!binder_proc_transaction(t, target_proc, NULL))
+		if (!binder_proc_transaction(t, target_proc, NULL,
+					     thread->batch))
 			goto err_dead_proc_or_thread;
 	}
 	if (target_thread)
@@ -3696,21 +4183,12 @@ static int binder_thread_write(struct binder_proc *proc,
 			}
 			if (buffer->async_transaction && buffer->target_node) {
 				struct binder_node *buf_node;
-				struct binder_work *w;
 
 				buf_node = buffer->target_node;
 				binder_node_inner_lock(buf_node);
 				BUG_ON(!buf_node->has_async_transaction);
 				BUG_ON(buf_node->proc != proc);
-				w = binder_dequeue_work_head_ilocked(
-						&buf_node->async_todo);
-				if (!w) {
-					buf_node->has_async_transaction = false;
-				} else {
-					binder_enqueue_work_ilocked(
-							w, &proc->todo);
-					binder_wakeup_proc_ilocked(proc);
-				}
+				binder_node_async_done_nilocked(buf_node, proc);
 				binder_node_inner_unlock(buf_node);
 			}
 			trace_binder_transaction_buffer_release(buffer);
@@ -3741,6 +4219,59 @@ static int binder_thread_write(struct binder_proc *proc,
 					   cmd == BC_REPLY, 0);
 			break;
 		}
+		case BC_TRANSACTION_BATCH: {
+			struct binder_transaction_batch hdr;
+			struct binder_batch batch = { .nr_procs = 0 };
+			void __user *batch_end;
+			__u32 i;
+
+			if (copy_from_user(&hdr, ptr, sizeof(hdr)))
+				return -EFAULT;
+			ptr += sizeof(hdr);
+			if (hdr.count > BINDER_BATCH_MAX || hdr.reserved) {
+				binder_user_error("%d:%d BC_TRANSACTION_BATCH invalid header, count %u\n",
+						  proc->pid, thread->pid,
+						  hdr.count);
+				return -EINVAL;
+			}
+
+			/*
+			 * Never resume in the middle of a batch: entries
+			 * after a failed transaction are skipped.
+			 */
+			batch_end = ptr + hdr.count *
+				sizeof(struct binder_transaction_data_sg);
+			ret = 0;
+			thread->batch = &batch;
+			for (i = 0; i < hdr.count; i++) {
+				struct binder_transaction_data_sg tr;
+
+				if (copy_from_user(&tr, ptr, sizeof(tr))) {
+					ret = -EFAULT;
+					break;
+				}
+				ptr += sizeof(tr);
+				if (!(tr.transaction_data.flags & TF_ONE_WAY) &&
+				    i != hdr.count - 1) {
+					binder_user_error("%d:%d BC_TRANSACTION_BATCH sync transaction %u is not last\n",
+							  proc->pid, thread->pid,
+							  i);
+					ret = -EINVAL;
+					break;
+				}
+				binder_transaction(proc, thread,
+						   &tr.transaction_data, false,
+						   tr.buffers_size);
+				if (thread->return_error.cmd != BR_OK)
+					break;
+			}
+			thread->batch = NULL;
+			binder_batch_flush(&batch);
+			if (ret)
+				return ret;
+			ptr = batch_end;
+			break;
+		}
 
 		case BC_REGISTER_LOOPER:
 			binder_debug(BINDER_DEBUG_THREADS,
@@ -4299,6 +4830,9 @@ static int binder_thread_read(struct binder_proc *proc,
 			node_prio.prio = target_node->min_priority;
 			binder_transaction_priority(current, t, node_prio,
 						    target_node->inherit_rt);
+			t->dequeue_time = ktime_get();
+			binder_latency_record(proc, BINDER_LATENCY_QUEUE,
+					      t->queue_time, t->dequeue_time);
 			cmd = BR_TRANSACTION;
 		} else {
 			trd->target.ptr = 0;
@@ -4309,6 +4843,9 @@ static int binder_thread_read(struct binder_proc *proc,
 		trd->flags = t->flags;
 		trd->sender_euid = from_kuid(current_user_ns(), t->sender_euid);
 
+		if (t->has_dmabuf)
+			binder_map_dmabufs(proc, t->buffer);
+
 		t_from = binder_get_txn_from(t);
 		if (t_from) {
 			struct task_struct *sender = t_from->proc->tsk;
@@ -4528,6 +5065,7 @@ static void binder_free_proc(struct binder_proc *proc)
 	binder_alloc_deferred_release(&proc->alloc);
 	put_task_struct(proc->tsk);
 	binder_stats_deleted(BINDER_STAT_PROC);
+	free_percpu(proc->latency);
 	kfree(proc);
 }
 
@@ -4882,6 +5420,24 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			goto err;
 		break;
 	}
+	case BINDER_SET_ALLOC_POLICY: {
+		struct binder_alloc_policy policy;
+
+		if (copy_from_user(&policy, ubuf, sizeof(policy))) {
+			ret = -EFAULT;
+			goto err;
+		}
+		if (policy.reserved) {
+			ret = -EINVAL;
+			goto err;
+		}
+		ret = binder_alloc_set_policy(&proc->alloc,
+				min_t(u64, policy.hot_size, SIZE_MAX),
+				policy.flags);
+		if (ret)
+			goto err;
+		break;
+	}
 	case BINDER_SET_CONTEXT_MGR:
 		ret = binder_ioctl_set_ctx_mgr(filp, NULL);
 		if (ret)
@@ -5049,6 +5605,11 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc = kzalloc(sizeof(*proc), GFP_KERNEL);
 	if (proc == NULL)
 		return -ENOMEM;
+	proc->latency = alloc_percpu(struct binder_latency_hist);
+	if (!proc->latency) {
+		kfree(proc);
+		return -ENOMEM;
+	}
 	spin_lock_init(&proc->inner_lock);
 	spin_lock_init(&proc->outer_lock);
 	get_task_struct(current->group_leader);
@@ -5145,6 +5706,9 @@ static int binder_node_release(struct binder_node *node, int refs)
 	int death = 0;
 	struct binder_proc *proc = node->proc;
 
+	binder_inner_proc_lock(proc);
+	binder_node_splice_async_ilocked(node);
+	binder_inner_proc_unlock(proc);
 	binder_release_work(proc, &node->async_todo);
 
 	binder_node_lock(node);
@@ -5621,6 +6185,7 @@ static const char * const binder_command_strings[] = {
 	"BC_DEAD_BINDER_DONE",
 	"BC_TRANSACTION_SG",
 	"BC_REPLY_SG",
+	"BC_TRANSACTION_BATCH",
 };
 
 static const char * const binder_objstat_strings[] = {
@@ -5726,6 +6291,7 @@ static void print_binder_proc_stats(struct seq_file *m,
 	seq_printf(m, "  buffers: %d\n", count);
 
 	binder_alloc_print_pages(m, &proc->alloc);
+	binder_alloc_print_size_classes(m, &proc->alloc);
 
 	count = 0;
 	binder_inner_proc_lock(proc);
@@ -5808,6 +6374,56 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static const char * const binder_latency_strings[] = {
+	"queue",
+	"reply",
+};
+
+static void print_binder_latency(struct seq_file *m, const char *prefix,
+				 struct binder_latency_hist __percpu *hist)
+{
+	int type, bucket, cpu;
+
+	BUILD_BUG_ON(ARRAY_SIZE(binder_latency_strings) !=
+		     BINDER_LATENCY_COUNT);
+	for (type = 0; type < BINDER_LATENCY_COUNT; type++) {
+		seq_printf(m, "%s%s:", prefix, binder_latency_strings[type]);
+		for (bucket = 0; bucket < BINDER_LATENCY_BUCKETS; bucket++) {
+			u64 count = 0;
+
+			for_each_possible_cpu(cpu)
+				count += per_cpu_ptr(hist, cpu)->
+					buckets[type][bucket];
+			if (count)
+				seq_printf(m, " <%lluus:%llu", 1ULL << bucket,
+					   count);
+		}
+		seq_puts(m, "\n");
+	}
+}
+
+static int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_device *device;
+	struct binder_proc *proc;
+
+	seq_puts(m, "binder latency:\n");
+	hlist_for_each_entry(device, &binder_devices, hlist) {
+		seq_printf(m, "context %s\n", device->context.name);
+		print_binder_latency(m, "  ", device->context.latency);
+	}
+
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, &binder_procs, proc_node) {
+		seq_printf(m, "proc %d context %s\n", proc->pid,
+			   proc->context->name);
+		print_binder_latency(m, "  ", proc->latency);
+	}
+	mutex_unlock(&binder_procs_lock);
+
+	return 0;
+}
+
 static int binder_proc_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *itr;
@@ -5887,6 +6503,7 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(latency);
 
 static int __init init_binder_device(const char *name)
 {
@@ -5904,9 +6521,16 @@ static int __init init_binder_device(const char *name)
 	binder_device->context.binder_context_mgr_uid = INVALID_UID;
 	binder_device->context.name = name;
 	mutex_init(&binder_device->context.context_mgr_node_lock);
+	binder_device->context.latency =
+		alloc_percpu(struct binder_latency_hist);
+	if (!binder_device->context.latency) {
+		kfree(binder_device);
+		return -ENOMEM;
+	}
 
 	ret = misc_register(&binder_device->miscdev);
 	if (ret < 0) {
+		free_percpu(binder_device->context.latency);
 		kfree(binder_device);
 		return ret;
 	}
@@ -5961,6 +6585,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("latency",
+				    0444,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 	}
 
 	/*
@@ -5987,6 +6616,7 @@ static int __init binder_init(void)
 	hlist_for_each_entry_safe(device, tmp, &binder_devices, hlist) {
 		misc_deregister(&device->miscdev);
 		hlist_del(&device->hlist);
+		free_percpu(device->context.latency);
 		kfree(device);
 	}
 
@@ -28,6 +28,7 @@
 #include <linux/sched.h>
 #include <linux/list_lru.h>
 #include <linux/ratelimit.h>
+#include <uapi/linux/android/binder.h>
 #include <asm/cacheflush.h>
 #include "binder_alloc.h"
 #include "binder_trace.h"
@@ -72,6 +73,11 @@ static size_t binder_alloc_buffer_size(struct binder_alloc *alloc,
 	return (u8 *)binder_buffer_next(buffer)->data - (u8 *)buffer->data;
 }
 
+static inline size_t binder_alloc_size_class(size_t size)
+{
+	return size / sizeof(void *) - 1;
+}
+
 static void binder_insert_free_buffer(struct binder_alloc *alloc,
 				      struct binder_buffer *new_buffer)
 {
@@ -89,6 +95,14 @@ static void binder_insert_free_buffer(struct binder_alloc *alloc,
 		     "%d: add free buffer, size %zd, at %pK\n",
 		      alloc->pid, new_buffer_size, new_buffer);
 
+	if (new_buffer_size < BINDER_ALLOC_SMALL_MAX) {
+		size_t class = binder_alloc_size_class(new_buffer_size);
+
+		list_add(&new_buffer->free_entry, &alloc->free_small[class]);
+		__set_bit(class, alloc->free_small_map);
+		return;
+	}
+
 	while (*p) {
 		parent = *p;
 		buffer = rb_entry(parent, struct binder_buffer, rb_node);
@@ -105,6 +119,62 @@ static void binder_insert_free_buffer(struct binder_alloc *alloc,
 	rb_insert_color(&new_buffer->rb_node, &alloc->free_buffers);
 }
 
+/**
+ * binder_erase_free_buffer() - remove a buffer from the free index
+ * @alloc:	binder_alloc for this proc
+ * @buffer:	free buffer to remove
+ *
+ * Must be called before the size of @buffer changes, i.e. before a
+ * neighbour is split off or merged into it.
+ */
+static void binder_erase_free_buffer(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_alloc_buffer_size(alloc, buffer);
+	size_t class;
+
+	BUG_ON(!buffer->free);
+
+	if (buffer_size >= BINDER_ALLOC_SMALL_MAX) {
+		rb_erase(&buffer->rb_node, &alloc->free_buffers);
+		return;
+	}
+
+	class = binder_alloc_size_class(buffer_size);
+	list_del(&buffer->free_entry);
+	if (list_empty(&alloc->free_small[class]))
+		__clear_bit(class, alloc->free_small_map);
+}
+
+/**
+ * binder_alloc_get_small_buffer() - find a small free buffer in O(1)
+ * @alloc:	binder_alloc for this proc
+ * @size:	pointer-aligned size of the requested buffer
+ *
+ * Return: the most recently freed buffer of the smallest size class that
+ * fits @size, or NULL if the request has to be served by free_buffers.
+ */
+static struct binder_buffer *
+binder_alloc_get_small_buffer(struct binder_alloc *alloc, size_t size)
+{
+	size_t class, found;
+
+	if (size >= BINDER_ALLOC_SMALL_MAX)
+		return NULL;
+
+	class = binder_alloc_size_class(size);
+	found = find_next_bit(alloc->free_small_map,
+			      BINDER_ALLOC_NR_SIZE_CLASSES, class);
+	if (found >= BINDER_ALLOC_NR_SIZE_CLASSES) {
+		alloc->class_misses[class]++;
+		return NULL;
+	}
+
+	alloc->class_hits[class]++;
+	return list_first_entry(&alloc->free_small[found],
+				struct binder_buffer, free_entry);
+}
+
 static void binder_insert_allocated_buffer_locked(
 		struct binder_alloc *alloc, struct binder_buffer *new_buffer)
 {
@@ -185,11 +255,68 @@ struct binder_buffer *binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 	return buffer;
 }
 
+/**
+ * binder_alloc_install_page() - map a page into kernel and user space
+ * @alloc:	binder_alloc for this proc
+ * @vma:	user vma of @alloc; mmap_sem must be held for read
+ * @index:	index of the page in @alloc->pages
+ * @page_ptr:	newly allocated page to map at @index
+ *
+ * On failure @page_ptr is left to the caller to free.
+ *
+ * Return: 0 on success, negative errno otherwise
+ */
+static int binder_alloc_install_page(struct binder_alloc *alloc,
+				     struct vm_area_struct *vma,
+				     size_t index, struct page *page_ptr)
+{
+	struct binder_lru_page *page = &alloc->pages[index];
+	void *page_addr = alloc->buffer + index * PAGE_SIZE;
+	unsigned long user_page_addr;
+	int ret;
+
+	page->page_ptr = page_ptr;
+	page->alloc = alloc;
+	INIT_LIST_HEAD(&page->lru);
+
+	ret = map_kernel_range_noflush((unsigned long)page_addr,
+				       PAGE_SIZE, PAGE_KERNEL,
+				       &page->page_ptr);
+	flush_cache_vmap((unsigned long)page_addr,
+			(unsigned long)page_addr + PAGE_SIZE);
+	if (ret != 1) {
+		pr_err("%d: binder_alloc_buf failed to map page at %pK in kernel\n",
+		       alloc->pid, page_addr);
+		ret = -ENOMEM;
+		goto err_map_kernel_failed;
+	}
+	user_page_addr =
+		(uintptr_t)page_addr + alloc->user_buffer_offset;
+	ret = vm_insert_page(vma, user_page_addr, page_ptr);
+	if (ret) {
+		pr_err("%d: binder_alloc_buf failed to map page at %lx in userspace\n",
+		       alloc->pid, user_page_addr);
+		goto err_vm_insert_page_failed;
+	}
+
+	if (index + 1 > alloc->pages_high)
+		alloc->pages_high = index + 1;
+
+	/* vm_insert_page does not seem to increment the refcount */
+	return 0;
+
+err_vm_insert_page_failed:
+	unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+err_map_kernel_failed:
+	page->page_ptr = NULL;
+	return ret;
+}
+
 static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 				    void *start, void *end)
 {
 	void *page_addr;
-	unsigned long user_page_addr;
+	struct page *page_ptr;
 	struct binder_lru_page *page;
 	struct vm_area_struct *vma = NULL;
 	struct mm_struct *mm = NULL;
@@ -231,7 +358,6 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 	}
 
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
 		bool on_lru;
 		size_t index;
 
@@ -239,6 +365,10 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		page = &alloc->pages[index];
 
 		if (page->page_ptr) {
+			/* pinned pages are never put on the lru */
+			if (index < alloc->pinned_pages)
+				continue;
+
 			trace_binder_alloc_lru_start(alloc, index);
 
 			on_lru = list_lru_del(&binder_alloc_lru, &page->lru);
@@ -252,41 +382,18 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 			goto err_page_ptr_cleared;
 
 		trace_binder_alloc_page_start(alloc, index);
-		page->page_ptr = alloc_page(GFP_KERNEL |
-					    __GFP_HIGHMEM |
-					    __GFP_ZERO);
-		if (!page->page_ptr) {
+		page_ptr = alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
+		if (!page_ptr) {
 			pr_err("%d: binder_alloc_buf failed for page at %pK\n",
 				alloc->pid, page_addr);
 			goto err_alloc_page_failed;
 		}
-		page->alloc = alloc;
-		INIT_LIST_HEAD(&page->lru);
-
-		ret = map_kernel_range_noflush((unsigned long)page_addr,
-					       PAGE_SIZE, PAGE_KERNEL,
-					       &page->page_ptr);
-		flush_cache_vmap((unsigned long)page_addr,
-				(unsigned long)page_addr + PAGE_SIZE);
-		if (ret != 1) {
-			pr_err("%d: binder_alloc_buf failed to map page at %pK in kernel\n",
-			       alloc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
-		user_page_addr =
-			(uintptr_t)page_addr + alloc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0].page_ptr);
-		if (ret) {
-			pr_err("%d: binder_alloc_buf failed to map page at %lx in userspace\n",
-			       alloc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
+		if (binder_alloc_install_page(alloc, vma, index, page_ptr)) {
+			__free_page(page_ptr);
+			goto err_install_page_failed;
 		}
 
-		if (index + 1 > alloc->pages_high)
-			alloc->pages_high = index + 1;
-
 		trace_binder_alloc_page_end(alloc, index);
-		/* vm_insert_page does not seem to increment the refcount */
 	}
 	if (mm) {
 		up_read(&mm->mmap_sem);
@@ -303,6 +410,9 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		index = (page_addr - alloc->buffer) / PAGE_SIZE;
 		page = &alloc->pages[index];
 
+		if (index < alloc->pinned_pages)
+			continue;
+
 		trace_binder_free_lru_start(alloc, index);
 
 		ret = list_lru_add(&binder_alloc_lru, &page->lru);
@@ -311,11 +421,7 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		trace_binder_free_lru_end(alloc, index);
 		continue;
 
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		__free_page(page->page_ptr);
-		page->page_ptr = NULL;
+err_install_page_failed:
 err_alloc_page_failed:
 err_page_ptr_cleared:
 		;
@@ -407,6 +513,10 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
+	buffer = binder_alloc_get_small_buffer(alloc, size);
+	if (buffer)
+		goto found;
+
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
@@ -429,6 +539,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		size_t free_buffers = 0;
 		size_t largest_free_size = 0;
 		size_t total_free_size = 0;
+		size_t class;
 
 		for (n = rb_first(&alloc->allocated_buffers); n != NULL;
 		     n = rb_next(n)) {
@@ -448,6 +559,18 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			if (buffer_size > largest_free_size)
 				largest_free_size = buffer_size;
 		}
+		for (class = 0; class < BINDER_ALLOC_NR_SIZE_CLASSES;
+		     class++) {
+			list_for_each_entry(buffer, &alloc->free_small[class],
+					    free_entry) {
+				buffer_size = binder_alloc_buffer_size(alloc,
+								       buffer);
+				free_buffers++;
+				total_free_size += buffer_size;
+				if (buffer_size > largest_free_size)
+					largest_free_size = buffer_size;
+			}
+		}
 		binder_alloc_debug(BINDER_DEBUG_USER_ERROR,
 				   "%d: binder_alloc_buf size %zd failed, no address space\n",
 				   alloc->pid, size);
@@ -458,10 +581,11 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				   free_buffers, largest_free_size);
 		return ERR_PTR(-ENOSPC);
 	}
-	if (n == NULL) {
+	if (n == NULL)
 		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
-		buffer_size = binder_alloc_buffer_size(alloc, buffer);
-	}
+
+found:
+	buffer_size = binder_alloc_buffer_size(alloc, buffer);
 
 	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "%d: binder_alloc_buf size %zd got buffer %pK size %zd\n",
@@ -469,7 +593,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
-	WARN_ON(n && buffer_size != size);
+	WARN_ON(buffer_size < size);
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + size);
 	if (end_page_addr > has_page_addr)
@@ -479,6 +603,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	if (ret)
 		return ERR_PTR(ret);
 
+	binder_erase_free_buffer(alloc, buffer);
 	if (buffer_size != size) {
 		struct binder_buffer *new_buffer;
 
@@ -494,7 +619,6 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		binder_insert_free_buffer(alloc, new_buffer);
 	}
 
-	rb_erase(best_fit, &alloc->free_buffers);
 	buffer->free = 0;
 	buffer->allow_user_free = 0;
 	binder_insert_allocated_buffer_locked(alloc, buffer);
@@ -514,6 +638,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	return buffer;
 
 err_alloc_buf_struct_failed:
+	binder_insert_free_buffer(alloc, buffer);
 	binder_update_page_range(alloc, 0,
 				 (void *)PAGE_ALIGN((uintptr_t)buffer->data),
 				 end_page_addr);
@@ -645,7 +770,7 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 		struct binder_buffer *next = binder_buffer_next(buffer);
 
 		if (next->free) {
-			rb_erase(&next->rb_node, &alloc->free_buffers);
+			binder_erase_free_buffer(alloc, next);
 			binder_delete_free_buffer(alloc, next);
 		}
 	}
@@ -653,8 +778,8 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 		struct binder_buffer *prev = binder_buffer_prev(buffer);
 
 		if (prev->free) {
+			binder_erase_free_buffer(alloc, prev);
 			binder_delete_free_buffer(alloc, buffer);
-			rb_erase(&prev->rb_node, &alloc->free_buffers);
 			buffer = prev;
 		}
 	}
@@ -892,6 +1017,39 @@ void binder_alloc_print_pages(struct seq_file *m,
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
+	seq_printf(m, "  pages pinned: %zu\n", alloc->pinned_pages);
+}
+
+/**
+ * binder_alloc_print_size_classes() - print small size-class statistics
+ * @m:     seq_file for output via seq_printf()
+ * @alloc: binder_alloc for this proc
+ *
+ * Prints the number of free buffers and the allocation hits and misses
+ * of every small size class that has been used.
+ */
+void binder_alloc_print_size_classes(struct seq_file *m,
+				     struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffer;
+	size_t class;
+
+	mutex_lock(&alloc->mutex);
+	for (class = 0; class < BINDER_ALLOC_NR_SIZE_CLASSES; class++) {
+		int free = 0;
+
+		list_for_each_entry(buffer, &alloc->free_small[class],
+				    free_entry)
+			free++;
+		if (!free && !alloc->class_hits[class] &&
+		    !alloc->class_misses[class])
+			continue;
+		seq_printf(m, "  size class %zu: free %d hits %lu misses %lu\n",
+			   (class + 1) * sizeof(void *), free,
+			   alloc->class_hits[class],
+			   alloc->class_misses[class]);
+	}
+	mutex_unlock(&alloc->mutex);
 }
 
 /**
@@ -926,6 +1084,133 @@ void binder_alloc_vma_close(struct binder_alloc *alloc)
 	binder_alloc_set_vma(alloc, NULL);
 }
 
+/* largest chunk of physically contiguous pages used for the hot window */
+#define BINDER_ALLOC_HOT_MAX_ORDER	4
+
+/**
+ * binder_alloc_populate_hot_locked() - populate and pin the hot window
+ * @alloc:	binder_alloc for this proc
+ * @vma:	user vma of @alloc; mmap_sem must be held for read
+ * @nr_pages:	new size of the hot window in pages
+ * @high_order:	try to back the window with higher-order allocations
+ *
+ * Pages in [@alloc->pinned_pages, @nr_pages) that are already present
+ * are taken off binder_alloc_lru, the others are allocated and mapped.
+ * @alloc->pinned_pages is advanced over every page that was handled so
+ * the pinned range stays consistent if we fail part way.
+ *
+ * Return: 0 on success, negative errno otherwise
+ */
+static int binder_alloc_populate_hot_locked(struct binder_alloc *alloc,
+					    struct vm_area_struct *vma,
+					    size_t nr_pages, bool high_order)
+{
+	while (alloc->pinned_pages < nr_pages) {
+		size_t index = alloc->pinned_pages;
+		struct page *page_ptr = NULL;
+		unsigned int order = 0;
+		size_t run, i;
+
+		if (alloc->pages[index].page_ptr) {
+			list_lru_del(&binder_alloc_lru,
+				     &alloc->pages[index].lru);
+			alloc->pinned_pages++;
+			continue;
+		}
+
+		for (run = 1; index + run < nr_pages &&
+		     run < (1 << BINDER_ALLOC_HOT_MAX_ORDER); run++)
+			if (alloc->pages[index + run].page_ptr)
+				break;
+
+		if (high_order && run > 1) {
+			order = ilog2(run);
+			page_ptr = alloc_pages(GFP_KERNEL | __GFP_HIGHMEM |
+					       __GFP_ZERO | __GFP_NORETRY |
+					       __GFP_NOWARN, order);
+			if (page_ptr)
+				split_page(page_ptr, order);
+		}
+		if (!page_ptr) {
+			order = 0;
+			page_ptr = alloc_page(GFP_KERNEL | __GFP_HIGHMEM |
+					      __GFP_ZERO);
+			if (!page_ptr)
+				return -ENOMEM;
+		}
+
+		for (i = 0; i < (1 << order); i++) {
+			int ret;
+
+			ret = binder_alloc_install_page(alloc, vma, index + i,
+							page_ptr + i);
+			if (ret) {
+				for (; i < (1 << order); i++)
+					__free_page(page_ptr + i);
+				return ret;
+			}
+			alloc->pinned_pages++;
+		}
+	}
+	return 0;
+}
+
+/**
+ * binder_alloc_set_policy() - configure the hot window of a proc
+ * @alloc:	binder_alloc for this proc
+ * @hot_size:	bytes at the start of the buffer space to keep populated
+ * @flags:	BINDER_ALLOC_POLICY_* flags
+ *
+ * Populates the first @hot_size bytes of the buffer space and exempts
+ * them from the binder shrinker, so that transactions landing there
+ * never allocate or map pages on the transaction path.
+ *
+ * Return:
+ *      0 = success
+ *      -EINVAL = invalid flags or @hot_size smaller than current window
+ *      -ESRCH = no address space mapped
+ *      -ENOMEM = failed to populate the window
+ */
+int binder_alloc_set_policy(struct binder_alloc *alloc, size_t hot_size,
+			    u32 flags)
+{
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	size_t nr_pages;
+	int ret;
+
+	if (flags & ~BINDER_ALLOC_POLICY_HIGH_ORDER)
+		return -EINVAL;
+
+	mutex_lock(&alloc->mutex);
+	nr_pages = min(PAGE_ALIGN(hot_size), alloc->buffer_size) / PAGE_SIZE;
+	if (nr_pages < alloc->pinned_pages) {
+		ret = -EINVAL;
+		goto err_unlock;
+	}
+	if (!alloc->vma_vm_mm || !mmget_not_zero(alloc->vma_vm_mm)) {
+		ret = -ESRCH;
+		goto err_unlock;
+	}
+	mm = alloc->vma_vm_mm;
+	down_read(&mm->mmap_sem);
+	vma = alloc->vma;
+	if (vma)
+		ret = binder_alloc_populate_hot_locked(alloc, vma, nr_pages,
+				flags & BINDER_ALLOC_POLICY_HIGH_ORDER);
+	else
+		ret = -ESRCH;
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+
+	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
+			   "%d: hot window %zu pages, flags %x: %d\n",
+			   alloc->pid, alloc->pinned_pages, flags, ret);
+err_unlock:
+	mutex_unlock(&alloc->mutex);
+	return ret;
+}
+
 /**
  * binder_alloc_free_page() - shrinker callback to free pages
  * @item:   item to free
@@ -1036,9 +1321,13 @@ static struct shrinker binder_shrinker = {
  */
 void binder_alloc_init(struct binder_alloc *alloc)
 {
+	size_t class;
+
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	for (class = 0; class < BINDER_ALLOC_NR_SIZE_CLASSES; class++)
+		INIT_LIST_HEAD(&alloc->free_small[class]);
 }
 
 int binder_alloc_shrinker_init(void)
@@ -26,10 +26,18 @@
 extern struct list_lru binder_alloc_lru;
 struct binder_transaction;
 
+/*
+ * Free buffers smaller than BINDER_ALLOC_SMALL_MAX are kept on one list
+ * per pointer-sized size class instead of in the free_buffers rbtree.
+ */
+#define BINDER_ALLOC_SMALL_MAX		256
+#define BINDER_ALLOC_NR_SIZE_CLASSES	(BINDER_ALLOC_SMALL_MAX / sizeof(void *) - 1)
+
 /**
  * struct binder_buffer - buffer used for binder transactions
  * @entry:              entry alloc->buffers
  * @rb_node:            node for allocated_buffers/free_buffers rb trees
+ * @free_entry:         entry in a small size-class free list
  * @free:               true if buffer is free
  * @allow_user_free:    describe the second member of struct blah,
  * @async_transaction:  describe the second member of struct blah,
@@ -45,8 +53,11 @@ struct binder_transaction;
  */
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by address */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated */
+					/* entry by address */
+		struct list_head free_entry; /* small free entry by size */
+	};
 	unsigned free:1;
 	unsigned allow_user_free:1;
 	unsigned async_transaction:1;
@@ -84,7 +95,14 @@ struct binder_lru_page {
  * @user_buffer_offset: offset between user and kernel VAs for buffer
  * @buffers:            list of all buffers for this proc
  * @free_buffers:       rb tree of buffers available for allocation
- *                      sorted by size
+ *                      sorted by size, for buffers of at least
+ *                      BINDER_ALLOC_SMALL_MAX bytes
+ * @free_small:         lists of smaller free buffers, one per size class
+ * @free_small_map:     bitmap of non-empty lists in @free_small
+ * @class_hits:         allocations served from @free_small, by requested
+ *                      size class
+ * @class_misses:       small allocations that fell back to @free_buffers,
+ *                      by requested size class
  * @allocated_buffers:  rb tree of allocated buffers sorted by address
  * @free_async_space:   VA space available for async buffers. This is
  *                      initialized at mmap time to 1/2 the full VA space
@@ -92,6 +110,8 @@ struct binder_lru_page {
  * @buffer_size:        size of address space specified via mmap
  * @pid:                pid for associated binder_proc (invariant after init)
  * @pages_high:         high watermark of offset in @pages
+ * @pinned_pages:       number of pages at the start of @pages that are
+ *                      populated and kept off binder_alloc_lru
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -106,6 +126,10 @@ struct binder_alloc {
 	ptrdiff_t user_buffer_offset;
 	struct list_head buffers;
 	struct rb_root free_buffers;
+	struct list_head free_small[BINDER_ALLOC_NR_SIZE_CLASSES];
+	DECLARE_BITMAP(free_small_map, BINDER_ALLOC_NR_SIZE_CLASSES);
+	unsigned long class_hits[BINDER_ALLOC_NR_SIZE_CLASSES];
+	unsigned long class_misses[BINDER_ALLOC_NR_SIZE_CLASSES];
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 	struct binder_lru_page *pages;
@@ -113,6 +137,7 @@ struct binder_alloc {
 	uint32_t buffer_free;
 	int pid;
 	size_t pages_high;
+	size_t pinned_pages;
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -131,6 +156,8 @@ extern struct binder_buffer *binder_alloc_new_buf(struct binder_alloc *alloc,
 extern void binder_alloc_init(struct binder_alloc *alloc);
 extern int binder_alloc_shrinker_init(void);
 extern void binder_alloc_vma_close(struct binder_alloc *alloc);
+extern int binder_alloc_set_policy(struct binder_alloc *alloc,
+				   size_t hot_size, u32 flags);
 extern struct binder_buffer *
 binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 			     uintptr_t user_ptr);
@@ -144,6 +171,8 @@ extern void binder_alloc_print_allocated(struct seq_file *m,
 					 struct binder_alloc *alloc);
 void binder_alloc_print_pages(struct seq_file *m,
 			      struct binder_alloc *alloc);
+void binder_alloc_print_size_classes(struct seq_file *m,
+				     struct binder_alloc *alloc);
 
 /**
  * binder_alloc_get_free_async_space() - get free space available for async
@@ -16,7 +16,10 @@
 #include <linux/debugfs.h>
 #include <linux/pm_wakeirq.h>
 #include <linux/types.h>
+#include <linux/uaccess.h>
+#include <linux/mm.h>
 #include <trace/events/power.h>
+#include <uapi/linux/wakeup_stats.h>
 
 #include "power.h"
 
@@ -64,6 +67,10 @@ static void pm_wakeup_timer_fn(struct timer_list *t);
 
 static LIST_HEAD(wakeup_sources);
 
+/* Protected by events_lock */
+static unsigned int nr_wakeup_sources;
+static u64 last_wakeup_source_id;
+
 static DECLARE_WAIT_QUEUE_HEAD(wakeup_count_wait_queue);
 
 DEFINE_STATIC_SRCU(wakeup_srcu);
@@ -186,6 +193,9 @@ void wakeup_source_add(struct wakeup_source *ws)
 	ws->active = false;
 
 	raw_spin_lock_irqsave(&events_lock, flags);
+	/* The list stays sorted by decreasing id */
+	ws->id = ++last_wakeup_source_id;
+	nr_wakeup_sources++;
 	list_add_rcu(&ws->entry, &wakeup_sources);
 	raw_spin_unlock_irqrestore(&events_lock, flags);
 }
@@ -204,6 +214,7 @@ void wakeup_source_remove(struct wakeup_source *ws)
 
 	raw_spin_lock_irqsave(&events_lock, flags);
 	list_del_rcu(&ws->entry);
+	nr_wakeup_sources--;
 	raw_spin_unlock_irqrestore(&events_lock, flags);
 	synchronize_srcu(&wakeup_srcu);
 }
@@ -1013,18 +1024,18 @@ void pm_wakep_autosleep_enabled(bool set)
 static struct dentry *wakeup_sources_stats_dentry;
 
 /**
- * print_wakeup_source_stats - Print wakeup source statistics information.
- * @m: seq_file to print the statistics into.
- * @ws: Wakeup source object to print the statistics for.
+ * get_wakeup_source_stats - Snapshot wakeup source statistics information.
+ * @ws: Wakeup source object to get the statistics of.
+ * @st: Statistics, with the time in ns.
+ * @active_time: Time the source has been active for, if it is active.
  */
-static int print_wakeup_source_stats(struct seq_file *m,
-				     struct wakeup_source *ws)
+static void get_wakeup_source_stats(struct wakeup_source *ws,
+				    struct wakeup_source_stats *st,
+				    ktime_t *active_time)
 {
 	unsigned long flags;
 	ktime_t total_time;
 	ktime_t max_time;
-	unsigned long active_count;
-	ktime_t active_time;
 	ktime_t prevent_sleep_time;
 
 	spin_lock_irqsave(&ws->lock, flags);
@@ -1032,30 +1043,56 @@ static int print_wakeup_source_stats(struct seq_file *m,
 	total_time = ws->total_time;
 	max_time = ws->max_time;
 	prevent_sleep_time = ws->prevent_sleep_time;
-	active_count = ws->active_count;
 	if (ws->active) {
 		ktime_t now = ktime_get();
 
-		active_time = ktime_sub(now, ws->last_time);
-		total_time = ktime_add(total_time, active_time);
-		if (active_time > max_time)
-			max_time = active_time;
+		*active_time = ktime_sub(now, ws->last_time);
+		total_time = ktime_add(total_time, *active_time);
+		if (*active_time > max_time)
+			max_time = *active_time;
 
 		if (ws->autosleep_enabled)
 			prevent_sleep_time = ktime_add(prevent_sleep_time,
 				ktime_sub(now, ws->start_prevent_time));
 	} else {
-		active_time = 0;
+		*active_time = 0;
 	}
 
-	seq_printf(m, "%-12s\t%lu\t\t%lu\t\t%lu\t\t%lu\t\t%lld\t\t%lld\t\t%lld\t\t%lld\t\t%lld\n",
-		   ws->name, active_count, ws->event_count,
-		   ws->wakeup_count, ws->expire_count,
-		   ktime_to_ms(active_time), ktime_to_ms(total_time),
-		   ktime_to_ms(max_time), ktime_to_ms(ws->last_time),
-		   ktime_to_ms(prevent_sleep_time));
+	st->id = ws->id;
+	st->total_time_ns = ktime_to_ns(total_time);
+	st->max_time_ns = ktime_to_ns(max_time);
+	st->last_change_ns = ktime_to_ns(ws->last_time);
+	st->prevent_sleep_time_ns = ktime_to_ns(prevent_sleep_time);
+	st->active_count = ws->active_count;
+	st->event_count = ws->event_count;
+	st->wakeup_count = ws->wakeup_count;
+	st->expire_count = ws->expire_count;
+	st->active = ws->active;
 
 	spin_unlock_irqrestore(&ws->lock, flags);
+}
+
+/**
+ * print_wakeup_source_stats - Print wakeup source statistics information.
+ * @m: seq_file to print the statistics into.
+ * @ws: Wakeup source object to print the statistics for.
+ */
+static int print_wakeup_source_stats(struct seq_file *m,
+				     struct wakeup_source *ws)
+{
+	struct wakeup_source_stats st;
+	ktime_t active_time;
+
+	get_wakeup_source_stats(ws, &st, &active_time);
+
+	seq_printf(m, "%-12s\t%llu\t\t%llu\t\t%llu\t\t%llu\t\t%lld\t\t%llu\t\t%llu\t\t%llu\t\t%llu\n",
+		   ws->name, st.active_count, st.event_count,
+		   st.wakeup_count, st.expire_count,
+		   ktime_to_ms(active_time),
+		   div_u64(st.total_time_ns, NSEC_PER_MSEC),
+		   div_u64(st.max_time_ns, NSEC_PER_MSEC),
+		   div_u64(st.last_change_ns, NSEC_PER_MSEC),
+		   div_u64(st.prevent_sleep_time_ns, NSEC_PER_MSEC));
 
 	return 0;
 }
@@ -1139,10 +1176,231 @@ static const struct file_operations wakeup_sources_stats_fops = {
 	.release = seq_release_private,
 };
 
+#define WAKEUP_STATS_DEFAULT_TOP_N	16
+#define WAKEUP_STATS_MAX_TOP_N		256
+
+/* Total active time of a wakeup source at the previous snapshot */
+struct wakeup_source_prev {
+	u64 id;
+	u64 total_time_ns;
+};
+
+/**
+ * struct wakeup_stats_file - state of an open wakeup_sources_top file
+ * @lock: serializes the readers of the file
+ * @top_n: maximum number of records of a snapshot
+ * @prev: total active times at the previous snapshot, by decreasing id
+ * @nr_prev: number of entries of @prev
+ * @since: time of the previous snapshot
+ * @buf: snapshot being read, built when reading from offset 0
+ * @len: size of @buf
+ */
+struct wakeup_stats_file {
+	struct mutex lock;
+	unsigned int top_n;
+	struct wakeup_source_prev *prev;
+	unsigned int nr_prev;
+	ktime_t since;
+	void *buf;
+	size_t len;
+};
+
+static u64 wakeup_stats_prev_total(struct wakeup_stats_file *f, u64 id)
+{
+	unsigned int lo = 0, hi = f->nr_prev;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (f->prev[mid].id == id)
+			return f->prev[mid].total_time_ns;
+		if (f->prev[mid].id > id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return 0;
+}
+
+/*
+ * Keep the sources active the longest since the previous snapshot at the
+ * start of @top, sorted by decreasing active time.
+ */
+static void wakeup_stats_insert(struct wakeup_source_stats *top,
+				unsigned int *nr_top, unsigned int top_n,
+				struct wakeup_source_stats *st)
+{
+	unsigned int i = *nr_top;
+
+	if (i == top_n) {
+		if (top[i - 1].active_time_ns >= st->active_time_ns)
+			return;
+		i--;
+	} else {
+		(*nr_top)++;
+	}
+
+	for (; i > 0 && top[i - 1].active_time_ns < st->active_time_ns; i--)
+		top[i] = top[i - 1];
+	top[i] = *st;
+}
+
+static int wakeup_stats_snapshot(struct wakeup_stats_file *f)
+{
+	struct wakeup_source_prev *prev;
+	struct wakeup_stats_header *hdr;
+	struct wakeup_source_stats *top, st;
+	struct wakeup_source *ws;
+	unsigned int nr_prev = 0, nr_top = 0, max_prev;
+	ktime_t now, active_time;
+	int srcuidx;
+	void *buf;
+
+	buf = kvzalloc(sizeof(*hdr) + f->top_n * sizeof(*top), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	/* Leave some room for the sources registered meanwhile */
+	max_prev = READ_ONCE(nr_wakeup_sources) + 16;
+	prev = kvmalloc_array(max_prev, sizeof(*prev), GFP_KERNEL);
+	if (!prev) {
+		kvfree(buf);
+		return -ENOMEM;
+	}
+
+	hdr = buf;
+	top = (struct wakeup_source_stats *)(hdr + 1);
+	now = ktime_get();
+
+	srcuidx = srcu_read_lock(&wakeup_srcu);
+	list_for_each_entry_rcu(ws, &wakeup_sources, entry) {
+		u64 prev_total;
+
+		memset(&st, 0, sizeof(st));
+		get_wakeup_source_stats(ws, &st, &active_time);
+		prev_total = wakeup_stats_prev_total(f, st.id);
+		st.active_time_ns = st.total_time_ns -
+				    min(st.total_time_ns, prev_total);
+
+		/* Sources beyond max_prev are all reported again next time */
+		if (nr_prev < max_prev) {
+			prev[nr_prev].id = st.id;
+			prev[nr_prev++].total_time_ns = st.total_time_ns;
+		}
+
+		if (!st.active_time_ns)
+			continue;
+
+		strlcpy(st.name, ws->name ? ws->name : "", sizeof(st.name));
+		wakeup_stats_insert(top, &nr_top, f->top_n, &st);
+	}
+	srcu_read_unlock(&wakeup_srcu, srcuidx);
+
+	hdr->version = WAKEUP_STATS_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->record_size = sizeof(*top);
+	hdr->nr_records = nr_top;
+	hdr->since_ns = ktime_to_ns(f->since);
+	hdr->now_ns = ktime_to_ns(now);
+
+	kvfree(f->prev);
+	f->prev = prev;
+	f->nr_prev = nr_prev;
+	f->since = now;
+
+	f->buf = buf;
+	f->len = sizeof(*hdr) + nr_top * sizeof(*top);
+
+	return 0;
+}
+
+static int wakeup_stats_open(struct inode *inode, struct file *file)
+{
+	struct wakeup_stats_file *f;
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		return -ENOMEM;
+
+	mutex_init(&f->lock);
+	f->top_n = WAKEUP_STATS_DEFAULT_TOP_N;
+	file->private_data = f;
+
+	return 0;
+}
+
+static ssize_t wakeup_stats_read(struct file *file, char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	struct wakeup_stats_file *f = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&f->lock);
+	if (*ppos == 0) {
+		kvfree(f->buf);
+		f->buf = NULL;
+		f->len = 0;
+		ret = wakeup_stats_snapshot(f);
+		if (ret)
+			goto unlock;
+	}
+	ret = simple_read_from_buffer(ubuf, count, ppos, f->buf, f->len);
+unlock:
+	mutex_unlock(&f->lock);
+
+	return ret;
+}
+
+static long wakeup_stats_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct wakeup_stats_file *f = file->private_data;
+	u32 top_n;
+
+	if (cmd != WAKEUP_STATS_IOC_SET_TOP_N)
+		return -ENOTTY;
+
+	if (copy_from_user(&top_n, (void __user *)arg, sizeof(top_n)))
+		return -EFAULT;
+
+	if (!top_n || top_n > WAKEUP_STATS_MAX_TOP_N)
+		return -EINVAL;
+
+	mutex_lock(&f->lock);
+	f->top_n = top_n;
+	mutex_unlock(&f->lock);
+
+	return 0;
+}
+
+static int wakeup_stats_release(struct inode *inode, struct file *file)
+{
+	struct wakeup_stats_file *f = file->private_data;
+
+	kvfree(f->buf);
+	kvfree(f->prev);
+	kfree(f);
+
+	return 0;
+}
+
+static const struct file_operations wakeup_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= wakeup_stats_open,
+	.read		= wakeup_stats_read,
+	.unlocked_ioctl	= wakeup_stats_ioctl,
+	.compat_ioctl	= wakeup_stats_ioctl,
+	.llseek		= default_llseek,
+	.release	= wakeup_stats_release,
+};
+
 static int __init wakeup_sources_debugfs_init(void)
 {
 	wakeup_sources_stats_dentry = debugfs_create_file("wakeup_sources",
 			S_IRUGO, NULL, NULL, &wakeup_sources_stats_fops);
+	debugfs_create_file("wakeup_sources_top", S_IRUGO, NULL, NULL,
+			    &wakeup_stats_fops);
 	return 0;
 }
 
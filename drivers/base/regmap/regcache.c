@@ -19,6 +19,12 @@
 #include "trace.h"
 #include "internal.h"
 
+/*
+ * Longest raw write regcache_default_sync() coalesces adjacent registers
+ * into.
+ */
+#define REGCACHE_SYNC_BATCH_BYTES	128
+
 static const struct regcache_ops *cache_types[] = {
 	&regcache_rbtree_ops,
 #if IS_ENABLED(CONFIG_REGCACHE_COMPRESSED)
@@ -295,25 +301,96 @@ static bool regcache_reg_needs_sync(struct regmap *map, unsigned int reg,
 	return true;
 }
 
+static int regcache_default_sync_flush(struct regmap *map, void *buf,
+				       unsigned int base, unsigned int *count)
+{
+	unsigned int last;
+	bool async = map->async;
+	int ret;
+
+	if (!*count)
+		return 0;
+
+	last = base + (*count - 1) * map->reg_stride;
+
+	/* @buf is refilled for the next run, so wait for this one */
+	map->async = false;
+	map->cache_bypass = true;
+	ret = _regmap_raw_write(map, base, buf,
+				*count * map->format.val_bytes);
+	map->cache_bypass = false;
+	map->async = async;
+	if (ret)
+		dev_err(map->dev, "Unable to sync registers %#x-%#x. %d\n",
+			base, last, ret);
+	else
+		dev_dbg(map->dev, "Synced %u registers from %#x-%#x\n",
+			*count, base, last);
+
+	*count = 0;
+
+	return ret;
+}
+
 static int regcache_default_sync(struct regmap *map, unsigned int min,
 				 unsigned int max)
 {
-	unsigned int reg;
+	size_t val_bytes = map->format.val_bytes;
+	unsigned int reg, base = 0, count = 0, max_count = 0;
+	void *buf = NULL;
+	int ret = 0;
+
+	/*
+	 * Caches using this don't keep the values in the device format, so
+	 * runs of adjacent registers to write are formatted into @buf and
+	 * written in one go where the bus allows it.
+	 */
+	if (regmap_can_raw_write(map) && !map->use_single_write) {
+		max_count = REGCACHE_SYNC_BATCH_BYTES / val_bytes;
+		if (map->max_raw_write)
+			max_count = min_t(size_t, max_count,
+					  map->max_raw_write / val_bytes);
+		if (max_count > 1)
+			buf = kmalloc(max_count * val_bytes, map->alloc_flags);
+	}
 
 	for (reg = min; reg <= max; reg += map->reg_stride) {
 		unsigned int val;
-		int ret;
 
 		if (regmap_volatile(map, reg) ||
-		    !regmap_writeable(map, reg))
+		    !regmap_writeable(map, reg)) {
+			ret = regcache_default_sync_flush(map, buf,
+							  base, &count);
+			if (ret)
+				goto out;
 			continue;
+		}
 
 		ret = regcache_read(map, reg, &val);
 		if (ret)
-			return ret;
+			goto out;
 
-		if (!regcache_reg_needs_sync(map, reg, val))
+		if (!regcache_reg_needs_sync(map, reg, val)) {
+			ret = regcache_default_sync_flush(map, buf,
+							  base, &count);
+			if (ret)
+				goto out;
 			continue;
+		}
+
+		if (buf) {
+			if (count == max_count) {
+				ret = regcache_default_sync_flush(map, buf,
+								  base, &count);
+				if (ret)
+					goto out;
+			}
+			if (!count)
+				base = reg;
+			map->format.format_val(buf + count * val_bytes, val, 0);
+			count++;
+			continue;
+		}
 
 		map->cache_bypass = true;
 		ret = _regmap_write(map, reg, val);
@@ -321,12 +398,15 @@ static int regcache_default_sync(struct regmap *map, unsigned int min,
 		if (ret) {
 			dev_err(map->dev, "Unable to sync register %#x. %d\n",
 				reg, ret);
-			return ret;
+			goto out;
 		}
 		dev_dbg(map->dev, "Synced register %#x, value %#x\n", reg, val);
 	}
 
-	return 0;
+	ret = regcache_default_sync_flush(map, buf, base, &count);
+out:
+	kfree(buf);
+	return ret;
 }
 
 /**
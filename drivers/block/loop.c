@@ -88,6 +88,15 @@ static DEFINE_MUTEX(loop_ctl_mutex);
 static int max_part;
 static int part_shift;
 
+static bool dio = true;
+module_param(dio, bool, 0644);
+MODULE_PARM_DESC(dio, "Use direct I/O to the backing file by default");
+
+static unsigned int nr_hw_queues;
+module_param(nr_hw_queues, uint, 0444);
+MODULE_PARM_DESC(nr_hw_queues,
+		 "Number of hardware queues and worker threads per device");
+
 static int transfer_xor(struct loop_device *lo, int cmd,
 			struct page *raw_page, unsigned raw_off,
 			struct page *loop_page, unsigned loop_off,
@@ -166,33 +175,59 @@ static loff_t get_loop_size(struct loop_device *lo, struct file *file)
 	return get_size(lo->lo_offset, lo->lo_sizelimit, file);
 }
 
+/* The block device the backing file is on, or is */
+static struct block_device *loop_backing_bdev(struct loop_device *lo)
+{
+	struct inode *inode = lo->lo_backing_file->f_mapping->host;
+
+	if (S_ISBLK(inode->i_mode))
+		return I_BDEV(inode);
+	return inode->i_sb->s_bdev;
+}
+
+/*
+ * With direct I/O, a request of the loop device turns into a single request
+ * of the backing device, so let it be as large as the backing device takes.
+ */
+static void loop_update_limits(struct loop_device *lo)
+{
+	struct block_device *bdev = loop_backing_bdev(lo);
+	struct request_queue *q = lo->lo_queue;
+	unsigned int max_sectors = BLK_DEF_MAX_SECTORS;
+	unsigned int io_opt = 0;
+
+	if (lo->use_dio && bdev) {
+		struct request_queue *backing_q = bdev_get_queue(bdev);
+
+		max_sectors = queue_max_sectors(backing_q);
+		io_opt = queue_io_opt(backing_q);
+	}
+
+	blk_queue_max_hw_sectors(q, max_sectors);
+	blk_queue_io_opt(q, io_opt);
+}
+
 static void __loop_update_dio(struct loop_device *lo, bool dio)
 {
 	struct file *file = lo->lo_backing_file;
 	struct address_space *mapping = file->f_mapping;
-	struct inode *inode = mapping->host;
-	unsigned short sb_bsize = 0;
+	struct block_device *bdev = loop_backing_bdev(lo);
 	unsigned dio_align = 0;
 	bool use_dio;
 
-	if (inode->i_sb->s_bdev) {
-		sb_bsize = bdev_logical_block_size(inode->i_sb->s_bdev);
-		dio_align = sb_bsize - 1;
-	}
+	if (bdev)
+		dio_align = bdev_logical_block_size(bdev) - 1;
 
 	/*
 	 * We support direct I/O only if lo_offset is aligned with the
-	 * logical I/O size of backing device, and the logical block
-	 * size of loop is bigger than the backing device's and the loop
-	 * needn't transform transfer.
-	 *
-	 * TODO: the above condition may be loosed in the future, and
-	 * direct I/O may be switched runtime at that time because most
-	 * of requests in sane applications should be PAGE_SIZE aligned
+	 * logical I/O size of backing device and the loop needn't
+	 * transform transfer.  Requests which aren't aligned with it,
+	 * possible if the logical block size of loop is smaller, are
+	 * still handled with buffered I/O, see loop_can_dio().
 	 */
+	lo->dio_align = dio_align;
 	if (dio) {
-		if (queue_logical_block_size(lo->lo_queue) >= sb_bsize &&
-				!(lo->lo_offset & dio_align) &&
+		if (!(lo->lo_offset & dio_align) &&
 				mapping->a_ops->direct_IO &&
 				!lo->transfer)
 			use_dio = true;
@@ -222,9 +257,33 @@ static void __loop_update_dio(struct loop_device *lo, bool dio)
 		blk_queue_flag_set(QUEUE_FLAG_NOMERGES, lo->lo_queue);
 		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
 	}
+	loop_update_limits(lo);
 	blk_mq_unfreeze_queue(lo->lo_queue);
 }
 
+/* Can @rq be handed to the backing file with direct I/O? */
+static bool loop_can_dio(struct loop_device *lo, struct request *rq)
+{
+	struct req_iterator iter;
+	struct bio_vec bvec;
+
+	if (!lo->use_dio)
+		return false;
+
+	/* Everything is aligned to the logical block size of loop */
+	if (queue_logical_block_size(lo->lo_queue) > lo->dio_align)
+		return true;
+
+	if ((blk_rq_pos(rq) << 9 | blk_rq_bytes(rq)) & lo->dio_align)
+		return false;
+
+	rq_for_each_segment(bvec, rq, iter) {
+		if ((bvec.bv_offset | bvec.bv_len) & lo->dio_align)
+			return false;
+	}
+	return true;
+}
+
 static int
 figure_loop_size(struct loop_device *lo, loff_t offset, loff_t sizelimit)
 {
@@ -878,10 +937,19 @@ static void loop_config_discard(struct loop_device *lo)
 	blk_queue_flag_set(QUEUE_FLAG_DISCARD, q);
 }
 
+static void loop_stop_workers(struct loop_device *lo, unsigned int nr)
+{
+	while (nr--) {
+		kthread_flush_worker(&lo->workers[nr].worker);
+		kthread_stop(lo->workers[nr].task);
+	}
+	kfree(lo->workers);
+	lo->workers = NULL;
+}
+
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
+	loop_stop_workers(lo, lo->tag_set.nr_hw_queues);
 }
 
 static int loop_kthread_worker_fn(void *worker_ptr)
@@ -892,12 +960,31 @@ static int loop_kthread_worker_fn(void *worker_ptr)
 
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	unsigned int nr = lo->tag_set.nr_hw_queues;
+	unsigned int i;
+
+	lo->workers = kcalloc(nr, sizeof(*lo->workers), GFP_KERNEL);
+	if (!lo->workers)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	for (i = 0; i < nr; i++) {
+		struct loop_worker *w = &lo->workers[i];
+
+		kthread_init_worker(&w->worker);
+		if (nr == 1)
+			w->task = kthread_run(loop_kthread_worker_fn,
+					      &w->worker, "loop%d",
+					      lo->lo_number);
+		else
+			w->task = kthread_run(loop_kthread_worker_fn,
+					      &w->worker, "loop%d.%u",
+					      lo->lo_number, i);
+		if (IS_ERR(w->task)) {
+			loop_stop_workers(lo, i);
+			return -ENOMEM;
+		}
+		set_user_nice(w->task, MIN_NICE);
+	}
 	return 0;
 }
 
@@ -964,7 +1051,8 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	if (!(lo_flags & LO_FLAGS_READ_ONLY) && file->f_op->fsync)
 		blk_queue_write_cache(lo->lo_queue, true, false);
 
-	loop_update_dio(lo);
+	loop_update_limits(lo);
+	__loop_update_dio(lo, dio || io_is_direct(file));
 	set_capacity(lo->lo_disk, size);
 	bd_set_size(bdev, size << 9);
 	loop_sysfs_init(lo);
@@ -1846,7 +1934,7 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		cmd->use_aio = false;
 		break;
 	default:
-		cmd->use_aio = lo->use_dio;
+		cmd->use_aio = loop_can_dio(lo, rq);
 		break;
 	}
 
@@ -1858,7 +1946,7 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 	} else
 #endif
 		cmd->css = NULL;
-	kthread_queue_work(&lo->worker, &cmd->work);
+	kthread_queue_work(&lo->workers[hctx->queue_num].worker, &cmd->work);
 
 	return BLK_STS_OK;
 }
@@ -1934,7 +2022,7 @@ static int loop_add(struct loop_device **l, int i)
 
 	err = -ENOMEM;
 	lo->tag_set.ops = &loop_mq_ops;
-	lo->tag_set.nr_hw_queues = 1;
+	lo->tag_set.nr_hw_queues = nr_hw_queues;
 	lo->tag_set.queue_depth = 128;
 	lo->tag_set.numa_node = NUMA_NO_NODE;
 	lo->tag_set.cmd_size = sizeof(struct loop_cmd);
@@ -2176,6 +2264,10 @@ static int __init loop_init(void)
 		goto err_out;
 	}
 
+	if (!nr_hw_queues)
+		nr_hw_queues = min(num_online_cpus(), 4U);
+	nr_hw_queues = min(nr_hw_queues, nr_cpu_ids);
+
 	/*
 	 * If max_loop is specified, create that many devices upfront.
 	 * This also becomes a hard limit. If max_loop is not specified,
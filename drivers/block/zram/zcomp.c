@@ -84,6 +84,12 @@ bool zcomp_available_algorithm(const char *comp)
 	return crypto_has_comp(comp, 0, 0) == 1;
 }
 
+/* the name of the @i-th known compressor, or NULL past the last one */
+const char *zcomp_backend(unsigned int i)
+{
+	return i < ARRAY_SIZE(backends) ? backends[i] : NULL;
+}
+
 /* show available compressors */
 ssize_t zcomp_available_show(const char *comp, char *buf)
 {
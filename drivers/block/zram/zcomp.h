@@ -27,6 +27,7 @@ int zcomp_cpu_up_prepare(unsigned int cpu, struct hlist_node *node);
 int zcomp_cpu_dead(unsigned int cpu, struct hlist_node *node);
 ssize_t zcomp_available_show(const char *comp, char *buf);
 bool zcomp_available_algorithm(const char *comp);
+const char *zcomp_backend(unsigned int i);
 
 struct zcomp *zcomp_create(const char *comp);
 void zcomp_destroy(struct zcomp *comp);
@@ -0,0 +1,163 @@
+/*
+ * Benchmark of the compression backends on the data stored in zram
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+
+#include "zram_drv.h"
+
+struct zram_bench_work {
+	struct zcomp *comp;
+	const void *pages;
+	unsigned int nr;
+	void *scratch;
+	u32 *comp_ns;
+	u32 *decomp_ns;
+	u64 comp_total;
+	u64 decomp_total;
+	u64 comp_len;
+};
+
+/* Compresses and decompresses every page with @w->comp, on the bench CPU */
+static long zram_bench_backend(void *data)
+{
+	struct zram_bench_work *w = data;
+	unsigned int i;
+
+	for (i = 0; i < w->nr; i++) {
+		const void *src = w->pages + (size_t)i * PAGE_SIZE;
+		struct zcomp_strm *zstrm;
+		unsigned int len;
+		u64 t0, t1, t2;
+		int ret;
+
+		zstrm = zcomp_stream_get(w->comp);
+		t0 = ktime_get_ns();
+		ret = zcomp_compress(zstrm, src, &len);
+		t1 = ktime_get_ns();
+		if (!ret)
+			ret = zcomp_decompress(zstrm, zstrm->buffer, len,
+					       w->scratch);
+		t2 = ktime_get_ns();
+		zcomp_stream_put(w->comp);
+		if (ret)
+			return ret;
+
+		w->comp_ns[i] = min_t(u64, t1 - t0, U32_MAX);
+		w->decomp_ns[i] = min_t(u64, t2 - t1, U32_MAX);
+		w->comp_total += t1 - t0;
+		w->decomp_total += t2 - t1;
+		/* zram stores the pages that don't compress as they are */
+		w->comp_len += min_t(unsigned int, len, PAGE_SIZE);
+		cond_resched();
+	}
+	return 0;
+}
+
+static int zram_bench_cmp(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static u32 zram_bench_pct(const u32 *ns, unsigned int nr, unsigned int pct)
+{
+	return ns[(nr - 1) * pct / 100];
+}
+
+/* MB/s of @nr pages processed in @ns */
+static u64 zram_bench_mbps(unsigned int nr, u64 ns)
+{
+	return div64_u64((u64)nr * PAGE_SIZE * 1000, max_t(u64, ns, 1));
+}
+
+static int zram_bench_show(char *buf, size_t size, const char *name,
+			   struct zram_bench_work *w)
+{
+	u64 ratio = div64_u64((u64)w->nr * PAGE_SIZE * 100,
+			      max_t(u64, w->comp_len, 1));
+
+	sort(w->comp_ns, w->nr, sizeof(u32), zram_bench_cmp, NULL);
+	sort(w->decomp_ns, w->nr, sizeof(u32), zram_bench_cmp, NULL);
+
+	return scnprintf(buf, size,
+		"%-8s %4llu.%02llu %8llu %8u %8u %8u %8llu %8u %8u %8u\n",
+		name, ratio / 100, ratio % 100,
+		zram_bench_mbps(w->nr, w->comp_total),
+		zram_bench_pct(w->comp_ns, w->nr, 50),
+		zram_bench_pct(w->comp_ns, w->nr, 90),
+		zram_bench_pct(w->comp_ns, w->nr, 99),
+		zram_bench_mbps(w->nr, w->decomp_total),
+		zram_bench_pct(w->decomp_ns, w->nr, 50),
+		zram_bench_pct(w->decomp_ns, w->nr, 90),
+		zram_bench_pct(w->decomp_ns, w->nr, 99));
+}
+
+/*
+ * Compresses the @nr pages at @pages with every known backend on @cpu, and
+ * formats the compression ratio, the throughputs and the latency
+ * percentiles of each into @buf. Backends that can't be set up are left
+ * out. Returns the length of the report or an error.
+ */
+ssize_t zram_bench_run(const void *pages, unsigned int nr, int cpu,
+			char *buf, size_t size)
+{
+	struct zram_bench_work w = { .pages = pages, .nr = nr };
+	const char *name;
+	ssize_t sz;
+	long ret = 0;
+	int i;
+
+	w.scratch = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	w.comp_ns = kvmalloc_array(nr, sizeof(u32), GFP_KERNEL);
+	w.decomp_ns = kvmalloc_array(nr, sizeof(u32), GFP_KERNEL);
+	if (!w.scratch || !w.comp_ns || !w.decomp_ns) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	sz = scnprintf(buf, size,
+		"# cpu %d, %u pages, latencies in ns\n"
+		"# algo ratio comp_MB/s comp_p50 comp_p90 comp_p99 decomp_MB/s decomp_p50 decomp_p90 decomp_p99\n",
+		cpu, nr);
+
+	for (i = 0; (name = zcomp_backend(i)); i++) {
+		w.comp = zcomp_create(name);
+		if (IS_ERR(w.comp))
+			continue;
+
+		w.comp_total = w.decomp_total = w.comp_len = 0;
+		ret = work_on_cpu(cpu, zram_bench_backend, &w);
+		zcomp_destroy(w.comp);
+		if (ret) {
+			pr_warn("bench of %s failed: %ld\n", name, ret);
+			ret = 0;
+			continue;
+		}
+
+		sz += zram_bench_show(buf + sz, size - sz, name, &w);
+	}
+	ret = sz;
+out:
+	kvfree(w.decomp_ns);
+	kvfree(w.comp_ns);
+	kfree(w.scratch);
+	return ret;
+}
@@ -0,0 +1,21 @@
+/*
+ * Benchmark of the compression backends on the data stored in zram
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZRAM_BENCH_H_
+#define _ZRAM_BENCH_H_
+
+/* most pages sampled by one run, 4MB of them with 4K pages */
+#define ZRAM_BENCH_MAX_PAGES	1024
+
+#ifdef CONFIG_ZRAM_BENCH
+ssize_t zram_bench_run(const void *pages, unsigned int nr, int cpu,
+			char *buf, size_t size);
+#endif
+
+#endif /* _ZRAM_BENCH_H_ */
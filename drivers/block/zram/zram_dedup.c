@@ -0,0 +1,167 @@
+/*
+ * Content-based deduplication of zram objects
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "zram_drv.h"
+
+void zram_dedup_init(struct zram *zram)
+{
+	zram->dedup_root = RB_ROOT;
+	spin_lock_init(&zram->dedup_lock);
+}
+
+u32 zram_dedup_checksum(struct page *page)
+{
+	void *mem;
+	u32 checksum;
+
+	mem = kmap_atomic(page);
+	checksum = jhash(mem, PAGE_SIZE, 0);
+	kunmap_atomic(mem);
+
+	return checksum;
+}
+
+/* Every reference beyond the first is a page stored for free */
+static void zram_dedup_get_locked(struct zram *zram, struct zram_entry *entry)
+{
+	if (entry->refcount++)
+		atomic64_add(entry->len, &zram->stats.dup_data_size);
+}
+
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	spin_lock(&zram->dedup_lock);
+	if (--entry->refcount) {
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		spin_unlock(&zram->dedup_lock);
+		return;
+	}
+	rb_erase(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	zs_free(zram->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	kfree(entry);
+}
+
+static bool zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+				struct page *page)
+{
+	void *src, *mem;
+	bool match;
+
+	src = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	if (entry->len == PAGE_SIZE) {
+		mem = kmap_atomic(page);
+		match = !memcmp(src, mem, PAGE_SIZE);
+		kunmap_atomic(mem);
+	} else {
+		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+
+		/* the stream buffer is two pages, enough for the result */
+		match = !zcomp_decompress(zstrm, src, entry->len,
+					zstrm->buffer);
+		if (match) {
+			mem = kmap_atomic(page);
+			match = !memcmp(zstrm->buffer, mem, PAGE_SIZE);
+			kunmap_atomic(mem);
+		}
+		zcomp_stream_put(zram->comp);
+	}
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look for a stored object with the same content as @page. Returns the
+ * entry with a reference held for the caller's slot, or NULL.
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				u32 checksum)
+{
+	struct rb_node *node;
+	struct zram_entry *entry = NULL;
+
+	spin_lock(&zram->dedup_lock);
+	node = zram->dedup_root.rb_node;
+	while (node) {
+		struct zram_entry *cur = rb_entry(node, struct zram_entry,
+						rb_node);
+
+		if (checksum < cur->checksum) {
+			node = node->rb_left;
+		} else if (checksum > cur->checksum) {
+			node = node->rb_right;
+		} else {
+			entry = cur;
+			zram_dedup_get_locked(zram, entry);
+			break;
+		}
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	if (!entry)
+		return NULL;
+
+	/* Hash collision: store the page on its own */
+	if (!zram_dedup_match(zram, entry, page)) {
+		zram_dedup_put(zram, entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+/*
+ * Make a freshly stored object findable by later writes of the same
+ * content. Returns NULL if no entry could be allocated, in which case
+ * the caller stores @handle in its slot as usual.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, u32 checksum,
+				unsigned long handle, unsigned int len)
+{
+	struct rb_node **link, *parent = NULL;
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	spin_lock(&zram->dedup_lock);
+	link = &zram->dedup_root.rb_node;
+	while (*link) {
+		struct zram_entry *cur;
+
+		parent = *link;
+		cur = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < cur->checksum)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, link);
+	rb_insert_color(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
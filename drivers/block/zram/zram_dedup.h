@@ -0,0 +1,63 @@
+/*
+ * Content-based deduplication of zram objects
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/rbtree.h>
+
+struct zram;
+
+/*
+ * A compressed object that may be shared by several slots. Such slots
+ * carry ZRAM_DEDUP and their table[].handle points at the entry rather
+ * than at the zsmalloc object.
+ */
+struct zram_entry {
+	struct rb_node rb_node;
+	unsigned long handle;
+	unsigned int len;
+	u32 checksum;
+	/* protected by zram->dedup_lock */
+	unsigned int refcount;
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+static inline bool zram_dedup_enabled(struct zram *zram)
+{
+	return zram->use_dedup;
+}
+
+void zram_dedup_init(struct zram *zram);
+u32 zram_dedup_checksum(struct page *page);
+struct zram_entry *zram_dedup_find(struct zram *zram, struct page *page,
+				u32 checksum);
+struct zram_entry *zram_dedup_insert(struct zram *zram, u32 checksum,
+				unsigned long handle, unsigned int len);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+#else
+static inline bool zram_dedup_enabled(struct zram *zram) { return false; }
+static inline void zram_dedup_init(struct zram *zram) {}
+static inline u32 zram_dedup_checksum(struct page *page) { return 0; }
+static inline struct zram_entry *zram_dedup_find(struct zram *zram,
+				struct page *page, u32 checksum)
+{
+	return NULL;
+}
+static inline struct zram_entry *zram_dedup_insert(struct zram *zram,
+				u32 checksum, unsigned long handle,
+				unsigned int len)
+{
+	return NULL;
+}
+static inline void zram_dedup_put(struct zram *zram,
+				struct zram_entry *entry) {}
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -20,6 +20,7 @@
 #include <linux/bio.h>
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
+#include <linux/ctype.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
@@ -33,6 +34,7 @@
 #include <linux/sysfs.h>
 #include <linux/debugfs.h>
 #include <linux/cpuhotplug.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -50,6 +52,8 @@ static unsigned int num_devices = 1;
  * uncompressed in memory.
  */
 static size_t huge_class_size;
+/* Per-CPU workers compressing pages of asynchronous writes */
+static struct workqueue_struct *zram_write_wq;
 
 static void zram_free_page(struct zram *zram, size_t index);
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
@@ -134,6 +138,13 @@ static void zram_set_obj_size(struct zram *zram,
 	zram->table[index].flags = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+static struct zcomp *zram_slot_comp(struct zram *zram, u32 index)
+{
+	if (zram_test_flag(zram, index, ZRAM_RECOMP))
+		return zram->recomp;
+	return zram->comp;
+}
+
 static inline bool zram_allocated(struct zram *zram, u32 index)
 {
 	return zram_get_obj_size(zram, index) ||
@@ -574,6 +585,17 @@ static unsigned long alloc_block_bdev(struct zram *zram)
 	return blk_idx;
 }
 
+static unsigned long alloc_block_bdev_next(struct zram *zram,
+					   unsigned long blk_idx)
+{
+	if (blk_idx >= zram->nr_pages ||
+	    test_and_set_bit(blk_idx, zram->bitmap))
+		return 0;
+
+	atomic64_inc(&zram->stats.bd_count);
+	return blk_idx;
+}
+
 static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
 {
 	int was_set;
@@ -626,15 +648,215 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 #define HUGE_WRITEBACK 1
 #define IDLE_WRITEBACK 2
 
+/* Pages per writeback bio, and writeback bios kept in flight */
+#define ZRAM_WB_BATCH_PAGES	32
+#define ZRAM_WB_MAX_INFLIGHT	4
+
+/*
+ * A writeback bio covering nr slots stored in consecutive backing device
+ * blocks starting at blk_idx.
+ */
+struct zram_wb_req {
+	struct zram_wb_ctl *ctl;
+	struct bio *bio;
+	struct list_head entry;
+	unsigned long blk_idx;
+	unsigned int nr;
+	u32 index[ZRAM_WB_BATCH_PAGES];
+	struct page *pages[ZRAM_WB_BATCH_PAGES];
+};
+
+struct zram_wb_ctl {
+	struct list_head idle_reqs;
+	/* completed requests, filled from bio completion */
+	struct list_head done_reqs;
+	spinlock_t done_lock;
+	wait_queue_head_t done_wait;
+	unsigned int nr_inflight;
+	int err;	/* of the first write that failed */
+	struct zram_wb_req reqs[ZRAM_WB_MAX_INFLIGHT];
+};
+
+static void zram_wb_ctl_free(struct zram_wb_ctl *ctl)
+{
+	int i, j;
+
+	for (i = 0; i < ZRAM_WB_MAX_INFLIGHT; i++) {
+		for (j = 0; j < ZRAM_WB_BATCH_PAGES; j++) {
+			if (ctl->reqs[i].pages[j])
+				__free_page(ctl->reqs[i].pages[j]);
+		}
+	}
+	kfree(ctl);
+}
+
+static struct zram_wb_ctl *zram_wb_ctl_alloc(void)
+{
+	struct zram_wb_ctl *ctl;
+	int i, j;
+
+	ctl = kzalloc(sizeof(*ctl), GFP_KERNEL);
+	if (!ctl)
+		return NULL;
+
+	INIT_LIST_HEAD(&ctl->idle_reqs);
+	INIT_LIST_HEAD(&ctl->done_reqs);
+	spin_lock_init(&ctl->done_lock);
+	init_waitqueue_head(&ctl->done_wait);
+
+	for (i = 0; i < ZRAM_WB_MAX_INFLIGHT; i++) {
+		struct zram_wb_req *req = &ctl->reqs[i];
+
+		req->ctl = ctl;
+		for (j = 0; j < ZRAM_WB_BATCH_PAGES; j++) {
+			req->pages[j] = alloc_page(GFP_KERNEL);
+			if (!req->pages[j]) {
+				zram_wb_ctl_free(ctl);
+				return NULL;
+			}
+		}
+		list_add_tail(&req->entry, &ctl->idle_reqs);
+	}
+
+	return ctl;
+}
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_req *req = bio->bi_private;
+	struct zram_wb_ctl *ctl = req->ctl;
+	unsigned long flags;
+
+	/*
+	 * Wake up under done_lock: the waiter has to take it to reap this
+	 * request, so ctl can't be freed before we are done with it.
+	 */
+	spin_lock_irqsave(&ctl->done_lock, flags);
+	list_add_tail(&req->entry, &ctl->done_reqs);
+	wake_up(&ctl->done_wait);
+	spin_unlock_irqrestore(&ctl->done_lock, flags);
+}
+
+static void zram_wb_submit(struct zram *zram, struct zram_wb_ctl *ctl,
+			   struct zram_wb_req *req)
+{
+	struct bio *bio;
+	unsigned int i;
+
+	/* bio_alloc() with __GFP_DIRECT_RECLAIM cannot fail */
+	bio = bio_alloc(GFP_KERNEL, req->nr);
+	bio_set_dev(bio, zram->bdev);
+	bio->bi_iter.bi_sector = req->blk_idx * (PAGE_SIZE >> 9);
+	bio->bi_opf = REQ_OP_WRITE;
+	bio->bi_end_io = zram_wb_end_io;
+	bio->bi_private = req;
+	for (i = 0; i < req->nr; i++)
+		bio_add_page(bio, req->pages[i], PAGE_SIZE, 0);
+
+	req->bio = bio;
+	ctl->nr_inflight++;
+	atomic64_add(req->nr, &zram->stats.bd_wb_pending);
+	submit_bio(bio);
+}
+
+/*
+ * Finish a completed writeback bio: slots whose write succeeded and that
+ * were not changed meanwhile now point at their backing device block;
+ * everything else gets its block released.
+ */
+static void zram_wb_complete(struct zram *zram, struct zram_wb_req *req)
+{
+	blk_status_t status = req->bio->bi_status;
+	unsigned int i;
+
+	if (status && !req->ctl->err)
+		req->ctl->err = blk_status_to_errno(status);
+
+	for (i = 0; i < req->nr; i++) {
+		u32 index = req->index[i];
+		unsigned long blk_idx = req->blk_idx + i;
+
+		zram_slot_lock(zram, index);
+		/*
+		 * We released zram_slot_lock so need to check if the slot was
+		 * changed. If there is freeing for the slot, we can catch it
+		 * easily by zram_allocated.
+		 * A subtle case is the slot is freed/reallocated/marked as
+		 * ZRAM_IDLE again. To close the race, idle_store doesn't
+		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 */
+		if (status || !zram_allocated(zram, index) ||
+			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			zram_slot_unlock(zram, index);
+			free_block_bdev(zram, blk_idx);
+			spin_lock(&zram->wb_limit_lock);
+			if (zram->wb_limit_enable)
+				zram->bd_wb_limit += 1UL << (PAGE_SHIFT - 12);
+			spin_unlock(&zram->wb_limit_lock);
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_set_element(zram, index, blk_idx);
+		atomic64_inc(&zram->stats.pages_stored);
+		zram_slot_unlock(zram, index);
+	}
+
+	if (!status)
+		atomic64_add(req->nr, &zram->stats.bd_writes);
+	atomic64_sub(req->nr, &zram->stats.bd_wb_pending);
+	bio_put(req->bio);
+	req->bio = NULL;
+	req->nr = 0;
+}
+
+/*
+ * Return an idle request, waiting for in-flight ones to complete if there
+ * is none. With @all set, wait for every in-flight request and return
+ * NULL.
+ */
+static struct zram_wb_req *zram_wb_get_req(struct zram *zram,
+					   struct zram_wb_ctl *ctl, bool all)
+{
+	struct zram_wb_req *req, *tmp;
+	LIST_HEAD(done);
+
+	while (ctl->nr_inflight &&
+	       (all || list_empty(&ctl->idle_reqs))) {
+		wait_event(ctl->done_wait, !list_empty(&ctl->done_reqs));
+
+		spin_lock_irq(&ctl->done_lock);
+		list_splice_init(&ctl->done_reqs, &done);
+		spin_unlock_irq(&ctl->done_lock);
+
+		list_for_each_entry_safe(req, tmp, &done, entry) {
+			zram_wb_complete(zram, req);
+			ctl->nr_inflight--;
+			list_move_tail(&req->entry, &ctl->idle_reqs);
+		}
+	}
+
+	if (all || list_empty(&ctl->idle_reqs))
+		return NULL;
+
+	req = list_first_entry(&ctl->idle_reqs, struct zram_wb_req, entry);
+	list_del(&req->entry);
+	return req;
+}
+
 static ssize_t writeback_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	struct zram *zram = dev_to_zram(dev);
 	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
 	unsigned long index;
-	struct bio bio;
-	struct bio_vec bio_vec;
-	struct page *page;
+	struct zram_wb_ctl *ctl;
+	struct zram_wb_req *req = NULL;
 	ssize_t ret, sz;
 	char mode_buf[8];
 	int mode = -1;
@@ -667,19 +889,17 @@ static ssize_t writeback_store(struct device *dev,
 		goto release_init_lock;
 	}
 
-	page = alloc_page(GFP_KERNEL);
-	if (!page) {
+	ctl = zram_wb_ctl_alloc();
+	if (!ctl) {
 		ret = -ENOMEM;
 		goto release_init_lock;
 	}
 
+	ret = 0;
+
 	for (index = 0; index < nr_pages; index++) {
 		struct bio_vec bvec;
 
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
-
 		spin_lock(&zram->wb_limit_lock);
 		if (zram->wb_limit_enable && !zram->bd_wb_limit) {
 			spin_unlock(&zram->wb_limit_lock);
@@ -688,6 +908,20 @@ static ssize_t writeback_store(struct device *dev,
 		}
 		spin_unlock(&zram->wb_limit_lock);
 
+		/*
+		 * Grow the current bio with the next block if it is free,
+		 * otherwise send it off and start a new one wherever there
+		 * is space.
+		 */
+		if (!blk_idx && req && req->nr) {
+			blk_idx = alloc_block_bdev_next(zram,
+						req->blk_idx + req->nr);
+			if (!blk_idx) {
+				zram_wb_submit(zram, ctl, req);
+				req = NULL;
+			}
+		}
+
 		if (!blk_idx) {
 			blk_idx = alloc_block_bdev(zram);
 			if (!blk_idx) {
@@ -696,6 +930,9 @@ static ssize_t writeback_store(struct device *dev,
 			}
 		}
 
+		if (!req)
+			req = zram_wb_get_req(zram, ctl, false);
+
 		zram_slot_lock(zram, index);
 		if (!zram_allocated(zram, index))
 			goto next;
@@ -719,27 +956,11 @@ static ssize_t writeback_store(struct device *dev,
 		/* Need for hugepage writeback racing */
 		zram_set_flag(zram, index, ZRAM_IDLE);
 		zram_slot_unlock(zram, index);
-		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
-			zram_slot_lock(zram, index);
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			zram_slot_unlock(zram, index);
-			continue;
-		}
 
-		bio_init(&bio, &bio_vec, 1);
-		bio_set_dev(&bio, zram->bdev);
-		bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
-		bio.bi_opf = REQ_OP_WRITE | REQ_SYNC;
-
-		bio_add_page(&bio, bvec.bv_page, bvec.bv_len,
-				bvec.bv_offset);
-		/*
-		 * XXX: A single page IO would be inefficient for write
-		 * but it would be not bad as starter.
-		 */
-		ret = submit_bio_wait(&bio);
-		if (ret) {
+		bvec.bv_page = req->pages[req->nr];
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
 			zram_slot_lock(zram, index);
 			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 			zram_clear_flag(zram, index, ZRAM_IDLE);
@@ -747,42 +968,37 @@ static ssize_t writeback_store(struct device *dev,
 			continue;
 		}
 
-		atomic64_inc(&zram->stats.bd_writes);
-		/*
-		 * We released zram_slot_lock so need to check if the slot was
-		 * changed. If there is freeing for the slot, we can catch it
-		 * easily by zram_allocated.
-		 * A subtle case is the slot is freed/reallocated/marked as
-		 * ZRAM_IDLE again. To close the race, idle_store doesn't
-		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
-		 * Thus, we could close the race by checking ZRAM_IDLE bit.
-		 */
-		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index) ||
-			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			goto next;
-		}
-
-		zram_free_page(zram, index);
-		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-		zram_set_flag(zram, index, ZRAM_WB);
-		zram_set_element(zram, index, blk_idx);
+		if (!req->nr)
+			req->blk_idx = blk_idx;
+		req->index[req->nr++] = index;
 		blk_idx = 0;
-		atomic64_inc(&zram->stats.pages_stored);
+
+		/* Charged up front, refunded if the write does not stick */
 		spin_lock(&zram->wb_limit_lock);
 		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
 			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
 		spin_unlock(&zram->wb_limit_lock);
+
+		if (req->nr == ZRAM_WB_BATCH_PAGES) {
+			zram_wb_submit(zram, ctl, req);
+			req = NULL;
+		}
+		continue;
 next:
 		zram_slot_unlock(zram, index);
 	}
 
+	if (req && req->nr)
+		zram_wb_submit(zram, ctl, req);
+	zram_wb_get_req(zram, ctl, true);
+
 	if (blk_idx)
 		free_block_bdev(zram, blk_idx);
-	ret = len;
-	__free_page(page);
+	if (!ret)
+		ret = ctl->err;
+	if (!ret)
+		ret = len;
+	zram_wb_ctl_free(ctl);
 release_init_lock:
 	up_read(&zram->init_lock);
 
@@ -907,13 +1123,15 @@ static ssize_t read_block_state(struct file *file, char __user *buf,
 
 		ts = ktime_to_timespec64(zram->table[index].ac_time);
 		copied = snprintf(kbuf + written, count,
-			"%12zd %12lld.%06lu %c%c%c%c\n",
+			"%12zd %12lld.%06lu %c%c%c%c%c%c\n",
 			index, (s64)ts.tv_sec,
 			ts.tv_nsec / NSEC_PER_USEC,
 			zram_test_flag(zram, index, ZRAM_SAME) ? 's' : '.',
 			zram_test_flag(zram, index, ZRAM_WB) ? 'w' : '.',
 			zram_test_flag(zram, index, ZRAM_HUGE) ? 'h' : '.',
-			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.');
+			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.',
+			zram_test_flag(zram, index, ZRAM_RECOMP) ? 'r' : '.',
+			zram_test_flag(zram, index, ZRAM_DEDUP) ? 'd' : '.');
 
 		if (count < copied) {
 			zram_slot_unlock(zram, index);
@@ -940,6 +1158,153 @@ static const struct file_operations proc_zram_block_state_op = {
 	.llseek = default_llseek,
 };
 
+#ifdef CONFIG_ZRAM_BENCH
+static DEFINE_MUTEX(zram_bench_mutex);
+
+static bool zram_bench_slot(struct zram *zram, u32 index)
+{
+	return zram_allocated(zram, index) &&
+		!zram_test_flag(zram, index, ZRAM_WB) &&
+		!zram_test_flag(zram, index, ZRAM_UNDER_WB) &&
+		!zram_test_flag(zram, index, ZRAM_SAME) &&
+		!zram_test_flag(zram, index, ZRAM_DEDUP);
+}
+
+/*
+ * Decompresses up to @nr pages spread over the device into @pages, and
+ * returns how many. Only slots holding an object of their own in the pool
+ * are sampled, each decompressed with the algorithm that stored it.
+ */
+static long zram_bench_sample(struct zram *zram, void *pages, unsigned int nr)
+{
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long index, eligible = 0, stride, seen = 0;
+	unsigned int n = 0;
+	int ret = 0;
+
+	for (index = 0; index < nr_pages; index++) {
+		zram_slot_lock(zram, index);
+		eligible += zram_bench_slot(zram, index);
+		zram_slot_unlock(zram, index);
+	}
+	stride = max(eligible / nr, 1UL);
+
+	for (index = 0; index < nr_pages && n < nr && !ret; index++) {
+		unsigned long handle;
+		unsigned int size;
+		void *src, *dst;
+
+		zram_slot_lock(zram, index);
+		if (!zram_bench_slot(zram, index) || seen++ % stride)
+			goto next;
+
+		handle = zram_get_handle(zram, index);
+		size = zram_get_obj_size(zram, index);
+		dst = pages + (size_t)n * PAGE_SIZE;
+		src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+		if (size == PAGE_SIZE) {
+			memcpy(dst, src, PAGE_SIZE);
+		} else {
+			struct zcomp *comp = zram_slot_comp(zram, index);
+			struct zcomp_strm *zstrm = zcomp_stream_get(comp);
+
+			ret = zcomp_decompress(zstrm, src, size, dst);
+			zcomp_stream_put(comp);
+		}
+		zs_unmap_object(zram->mem_pool, handle);
+		n++;
+next:
+		zram_slot_unlock(zram, index);
+		cond_resched();
+	}
+
+	return ret ? ret : n;
+}
+
+static ssize_t read_bench(struct file *file, char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	struct zram *zram = file->private_data;
+	ssize_t ret = 0;
+
+	mutex_lock(&zram_bench_mutex);
+	if (zram->bench_report)
+		ret = simple_read_from_buffer(buf, count, ppos,
+				zram->bench_report, strlen(zram->bench_report));
+	mutex_unlock(&zram_bench_mutex);
+
+	return ret;
+}
+
+static ssize_t write_bench(struct file *file, const char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	struct zram *zram = file->private_data;
+	char kbuf[32];
+	unsigned int nr;
+	int cpu = -1;
+	void *pages;
+	long n;
+	ssize_t ret;
+
+	if (count >= sizeof(kbuf))
+		return -EINVAL;
+	if (copy_from_user(kbuf, buf, count))
+		return -EFAULT;
+	kbuf[count] = '\0';
+
+	if (sscanf(kbuf, "%u %d", &nr, &cpu) < 1 || !nr)
+		return -EINVAL;
+	nr = min_t(unsigned int, nr, ZRAM_BENCH_MAX_PAGES);
+	if (cpu == -1)
+		cpu = raw_smp_processor_id();
+	if (cpu < 0 || cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return -EINVAL;
+
+	pages = vmalloc((size_t)nr * PAGE_SIZE);
+	if (!pages)
+		return -ENOMEM;
+
+	mutex_lock(&zram_bench_mutex);
+	if (!zram->bench_report) {
+		zram->bench_report = kzalloc(PAGE_SIZE, GFP_KERNEL);
+		if (!zram->bench_report) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		ret = -EINVAL;
+		goto out;
+	}
+	n = zram_bench_sample(zram, pages, nr);
+	up_read(&zram->init_lock);
+	if (n <= 0) {
+		ret = n ? n : -ENODATA;
+		goto out;
+	}
+
+	ret = zram_bench_run(pages, n, cpu, zram->bench_report, PAGE_SIZE);
+	if (ret >= 0)
+		ret = count;
+out:
+	mutex_unlock(&zram_bench_mutex);
+	vfree(pages);
+
+	return ret;
+}
+
+static const struct file_operations proc_zram_bench_op = {
+	.open = simple_open,
+	.read = read_bench,
+	.write = write_bench,
+	.llseek = default_llseek,
+};
+#endif
+
 static void zram_debugfs_register(struct zram *zram)
 {
 	if (!zram_debugfs_root)
@@ -949,11 +1314,18 @@ static void zram_debugfs_register(struct zram *zram)
 						zram_debugfs_root);
 	debugfs_create_file("block_state", 0400, zram->debugfs_dir,
 				zram, &proc_zram_block_state_op);
+#ifdef CONFIG_ZRAM_BENCH
+	debugfs_create_file("bench", 0600, zram->debugfs_dir,
+				zram, &proc_zram_bench_op);
+#endif
 }
 
 static void zram_debugfs_unregister(struct zram *zram)
 {
 	debugfs_remove_recursive(zram->debugfs_dir);
+#ifdef CONFIG_ZRAM_BENCH
+	kfree(zram->bench_report);
+#endif
 }
 #else
 static void zram_debugfs_create(void) {};
@@ -987,6 +1359,35 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	return len;
 }
 
+static ssize_t async_write_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->async_write;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+static ssize_t async_write_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	WRITE_ONCE(zram->async_write, val);
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
 static ssize_t comp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -1028,6 +1429,249 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+#ifdef CONFIG_ZRAM_DEDUP
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_MEMCG
+static ssize_t cgroup_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return zram_memcg_show(zram, buf);
+}
+
+static ssize_t cgroup_limit_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long ino;
+	char *limit;
+	int ret;
+
+	/* "<cgroup inode> <limit>", where limit accepts K/M/G suffixes */
+	ino = simple_strtoul(buf, &limit, 10);
+	if (!ino || limit == buf || !isspace(*limit))
+		return -EINVAL;
+
+	ret = zram_memcg_set_limit(zram, ino,
+				   memparse(skip_spaces(limit), NULL));
+
+	return ret ? ret : len;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char compressor[ARRAY_SIZE(zram->recomp_algorithm)];
+	size_t sz;
+
+	strlcpy(compressor, buf, sizeof(compressor));
+	/* ignore trailing newline */
+	sz = strlen(compressor);
+	if (sz > 0 && compressor[sz - 1] == '\n')
+		compressor[sz - 1] = 0x00;
+
+	if (!zcomp_available_algorithm(compressor))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+
+	strcpy(zram->recomp_algorithm, compressor);
+	up_write(&zram->init_lock);
+	return len;
+}
+
+/*
+ * Recompress the slot at @index with the secondary algorithm, using @page
+ * as scratch space for the uncompressed data. The result is only kept if
+ * it is smaller than the current object; otherwise the slot is left as
+ * it is, minus its idle mark, so that it is not retried before the next
+ * idle marking. Called with the slot lock held.
+ */
+static int zram_recompress_slot(struct zram *zram, u32 index,
+				struct page *page)
+{
+	unsigned long handle_old, handle_new;
+	unsigned int comp_len_old, comp_len_new;
+	struct zcomp_strm *zstrm;
+	void *src, *dst;
+	int ret = 0;
+
+	handle_old = zram_get_handle(zram, index);
+	comp_len_old = zram_get_obj_size(zram, index);
+
+	src = zs_map_object(zram->mem_pool, handle_old, ZS_MM_RO);
+	dst = kmap_atomic(page);
+	if (comp_len_old == PAGE_SIZE) {
+		memcpy(dst, src, PAGE_SIZE);
+	} else {
+		zstrm = zcomp_stream_get(zram->comp);
+		ret = zcomp_decompress(zstrm, src, comp_len_old, dst);
+		zcomp_stream_put(zram->comp);
+	}
+	kunmap_atomic(dst);
+	zs_unmap_object(zram->mem_pool, handle_old);
+	if (ret)
+		return ret;
+
+	zstrm = zcomp_stream_get(zram->recomp);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &comp_len_new);
+	kunmap_atomic(src);
+	if (ret) {
+		zcomp_stream_put(zram->recomp);
+		return ret;
+	}
+
+	if (comp_len_new >= huge_class_size || comp_len_new >= comp_len_old) {
+		zcomp_stream_put(zram->recomp);
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+		return 0;
+	}
+
+	/* The slot lock is held, so we must not enter direct reclaim */
+	handle_new = zs_malloc(zram->mem_pool, comp_len_new,
+			__GFP_KSWAPD_RECLAIM |
+			__GFP_NOWARN |
+			__GFP_HIGHMEM |
+			__GFP_MOVABLE);
+	if (!handle_new) {
+		zcomp_stream_put(zram->recomp);
+		return -ENOMEM;
+	}
+
+	dst = zs_map_object(zram->mem_pool, handle_new, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len_new);
+	zcomp_stream_put(zram->recomp);
+	zs_unmap_object(zram->mem_pool, handle_new);
+
+	zs_free(zram->mem_pool, handle_old);
+	atomic64_sub(comp_len_old, &zram->stats.compr_data_size);
+	atomic64_add(comp_len_new, &zram->stats.compr_data_size);
+	zram_memcg_uncharge(zram, zram_get_memcg(zram, index),
+			    comp_len_old - comp_len_new, false);
+
+	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
+		zram_clear_flag(zram, index, ZRAM_HUGE);
+		atomic64_dec(&zram->stats.huge_pages);
+	}
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_set_flag(zram, index, ZRAM_RECOMP);
+	zram_set_handle(zram, index, handle_new);
+	zram_set_obj_size(zram, index, comp_len_new);
+	atomic64_inc(&zram->stats.recomp_pages);
+
+	return 0;
+}
+
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	unsigned long index;
+	struct page *page;
+	ssize_t ret = len;
+
+	if (!sysfs_streq(buf, "idle"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	for (index = 0; index < nr_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(zram, index);
+		if (zram_allocated(zram, index) &&
+				zram_test_flag(zram, index, ZRAM_IDLE) &&
+				!zram_test_flag(zram, index, ZRAM_WB) &&
+				!zram_test_flag(zram, index, ZRAM_UNDER_WB) &&
+				!zram_test_flag(zram, index, ZRAM_SAME) &&
+				!zram_test_flag(zram, index, ZRAM_DEDUP) &&
+				!zram_test_flag(zram, index, ZRAM_RECOMP))
+			err = zram_recompress_slot(zram, index, page);
+		zram_slot_unlock(zram, index);
+
+		if (err) {
+			ret = err;
+			break;
+		}
+		cond_resched();
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -1063,6 +1707,13 @@ static ssize_t io_stat_show(struct device *dev,
 	return ret;
 }
 
+/*
+ * Columns, in order: orig_data_size, compr_data_size, mem_used_total,
+ * mem_limit, mem_used_max, same_pages, pages_compacted, huge_pages,
+ * recomp_pages, dup_data_size and meta_data_size.  The last three are
+ * always printed, and read 0 without CONFIG_ZRAM_MULTI_COMP or
+ * CONFIG_ZRAM_DEDUP, so the layout doesn't depend on the config.
+ */
 static ssize_t mm_stat_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -1084,7 +1735,8 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu"
+			" %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
@@ -1092,7 +1744,10 @@ static ssize_t mm_stat_show(struct device *dev,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
 			pool_stats.pages_compacted,
-			(u64)atomic64_read(&zram->stats.huge_pages));
+			(u64)atomic64_read(&zram->stats.huge_pages),
+			(u64)atomic64_read(&zram->stats.recomp_pages),
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1108,10 +1763,11 @@ static ssize_t bd_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-		"%8llu %8llu %8llu\n",
+		"%8llu %8llu %8llu %8llu\n",
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_wb_pending)));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1191,6 +1847,11 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (zram_test_flag(zram, index, ZRAM_IDLE))
 		zram_clear_flag(zram, index, ZRAM_IDLE);
 
+	if (zram_test_flag(zram, index, ZRAM_RECOMP)) {
+		zram_clear_flag(zram, index, ZRAM_RECOMP);
+		atomic64_dec(&zram->stats.recomp_pages);
+	}
+
 	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
 		zram_clear_flag(zram, index, ZRAM_HUGE);
 		atomic64_dec(&zram->stats.huge_pages);
@@ -1216,6 +1877,18 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (!handle)
 		return;
 
+	/* Every slot was charged on its own, shared object or not */
+	zram_memcg_uncharge(zram, zram_get_memcg(zram, index),
+			    zram_get_obj_size(zram, index), true);
+	zram_set_memcg(zram, index, NULL);
+
+	/* Shared objects are freed with their last slot */
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		zram_dedup_put(zram, (struct zram_entry *)handle);
+		goto out;
+	}
+
 	zs_free(zram->mem_pool, handle);
 
 	atomic64_sub(zram_get_obj_size(zram, index),
@@ -1264,6 +1937,8 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 	}
 
 	size = zram_get_obj_size(zram, index);
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		handle = ((struct zram_entry *)handle)->handle;
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 	if (size == PAGE_SIZE) {
@@ -1272,12 +1947,13 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		kunmap_atomic(dst);
 		ret = 0;
 	} else {
-		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+		struct zcomp *comp = zram_slot_comp(zram, index);
+		struct zcomp_strm *zstrm = zcomp_stream_get(comp);
 
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, handle);
 	zram_slot_unlock(zram, index);
@@ -1334,6 +2010,9 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	struct page *page = bvec->bv_page;
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
+	struct zram_entry *entry = NULL;
+	struct zram_memcg *memcg = NULL;
+	u32 checksum = 0;
 
 	mem = kmap_atomic(page);
 	if (page_same_filled(mem, &element)) {
@@ -1345,6 +2024,15 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	}
 	kunmap_atomic(mem);
 
+	if (zram_dedup_enabled(zram)) {
+		checksum = zram_dedup_checksum(page);
+		entry = zram_dedup_find(zram, page, checksum);
+		if (entry) {
+			comp_len = entry->len;
+			goto out;
+		}
+	}
+
 compress_again:
 	zstrm = zcomp_stream_get(zram->comp);
 	src = kmap_atomic(page);
@@ -1411,7 +2099,24 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	zcomp_stream_put(zram->comp);
 	zs_unmap_object(zram->mem_pool, handle);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
+
+	if (zram_dedup_enabled(zram))
+		entry = zram_dedup_insert(zram, checksum, handle, comp_len);
 out:
+	if (!flags) {
+		ret = zram_memcg_charge(zram, page, comp_len, &memcg);
+		if (ret) {
+			if (entry) {
+				zram_dedup_put(zram, entry);
+			} else {
+				zs_free(zram->mem_pool, handle);
+				atomic64_sub(comp_len,
+					     &zram->stats.compr_data_size);
+			}
+			return ret;
+		}
+	}
+
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
@@ -1427,10 +2132,15 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	if (flags) {
 		zram_set_flag(zram, index, flags);
 		zram_set_element(zram, index, element);
-	}  else {
+	} else if (entry) {
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+		zram_set_handle(zram, index, (unsigned long)entry);
+		zram_set_obj_size(zram, index, comp_len);
+	} else {
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
 	}
+	zram_set_memcg(zram, index, memcg);
 	zram_slot_unlock(zram, index);
 
 	/* Update stats */
@@ -1557,12 +2267,108 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+/*
+ * A write bio whose pages are being compressed on zram_write_wq. The
+ * submitter holds one reference while it walks the bio and every queued
+ * page holds another; the bio is completed when the last one is dropped.
+ */
+struct zram_write_ctl {
+	struct bio *bio;
+	atomic_t pending;
+	blk_status_t status;
+};
+
+struct zram_write_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct zram_write_ctl *ctl;
+	struct bio_vec bvec;
+	u32 index;
+};
+
+static struct zram_write_ctl *zram_write_ctl_alloc(struct zram *zram,
+						   struct bio *bio)
+{
+	struct zram_write_ctl *ctl;
+
+	if (!READ_ONCE(zram->async_write) || num_online_cpus() < 2)
+		return NULL;
+
+	ctl = kmalloc(sizeof(*ctl), GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!ctl)
+		return NULL;
+
+	ctl->bio = bio;
+	atomic_set(&ctl->pending, 1);
+	ctl->status = BLK_STS_OK;
+	return ctl;
+}
+
+static void zram_write_ctl_put(struct zram_write_ctl *ctl)
+{
+	if (!atomic_dec_and_test(&ctl->pending))
+		return;
+
+	ctl->bio->bi_status = READ_ONCE(ctl->status);
+	bio_endio(ctl->bio);
+	kfree(ctl);
+}
+
+static void zram_write_work_fn(struct work_struct *work)
+{
+	struct zram_write_work *zw = container_of(work, struct zram_write_work,
+						  work);
+	struct zram_write_ctl *ctl = zw->ctl;
+
+	if (zram_bvec_rw(zw->zram, &zw->bvec, zw->index, 0, REQ_OP_WRITE,
+			 ctl->bio) < 0)
+		WRITE_ONCE(ctl->status, BLK_STS_IOERR);
+
+	kfree(zw);
+	zram_write_ctl_put(ctl);
+}
+
+/*
+ * Hand a full-page write over to the next online CPU's worker. Returns
+ * false if the page could not be queued, in which case the caller
+ * should write it synchronously.
+ */
+static bool zram_queue_write(struct zram *zram, struct zram_write_ctl *ctl,
+			     struct bio_vec *bvec, u32 index, int *cpu)
+{
+	struct zram_write_work *zw;
+
+	zw = kmalloc(sizeof(*zw), GFP_NOIO | __GFP_NORETRY | __GFP_NOWARN);
+	if (!zw)
+		return false;
+
+	INIT_WORK(&zw->work, zram_write_work_fn);
+	zw->zram = zram;
+	zw->ctl = ctl;
+	zw->bvec = *bvec;
+	zw->index = index;
+	atomic_inc(&ctl->pending);
+
+	/*
+	 * Racing with CPU hotplug is harmless: work queued on a CPU that
+	 * goes down is run by the workqueue's unbound fallback workers.
+	 */
+	*cpu = cpumask_next(*cpu, cpu_online_mask);
+	if (*cpu >= nr_cpu_ids)
+		*cpu = cpumask_first(cpu_online_mask);
+	queue_work_on(*cpu, zram_write_wq, &zw->work);
+
+	return true;
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int offset;
 	u32 index;
 	struct bio_vec bvec;
 	struct bvec_iter iter;
+	struct zram_write_ctl *ctl = NULL;
+	int cpu = raw_smp_processor_id();
 
 	index = bio->bi_iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = (bio->bi_iter.bi_sector &
@@ -1574,6 +2380,9 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		zram_bio_discard(zram, index, offset, bio);
 		bio_endio(bio);
 		return;
+	case REQ_OP_WRITE:
+		ctl = zram_write_ctl_alloc(zram, bio);
+		break;
 	default:
 		break;
 	}
@@ -1585,9 +2394,12 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		do {
 			bv.bv_len = min_t(unsigned int, PAGE_SIZE - offset,
 							unwritten);
-			if (zram_bvec_rw(zram, &bv, index, offset,
-					 bio_op(bio), bio) < 0)
-				goto out;
+			if (!ctl || is_partial_io(&bv) ||
+			    !zram_queue_write(zram, ctl, &bv, index, &cpu)) {
+				if (zram_bvec_rw(zram, &bv, index, offset,
+						 bio_op(bio), bio) < 0)
+					goto out;
+			}
 
 			bv.bv_offset += bv.bv_len;
 			unwritten -= bv.bv_len;
@@ -1596,10 +2408,19 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		} while (unwritten);
 	}
 
+	if (ctl) {
+		zram_write_ctl_put(ctl);
+		return;
+	}
 	bio_endio(bio);
 	return;
 
 out:
+	if (ctl) {
+		WRITE_ONCE(ctl->status, BLK_STS_IOERR);
+		zram_write_ctl_put(ctl);
+		return;
+	}
 	bio_io_error(bio);
 }
 
@@ -1653,6 +2474,14 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 		return -ENOTSUPP;
 	zram = bdev->bd_disk->private_data;
 
+	/*
+	 * rw_page has to complete the write before returning, so push
+	 * writes back to the bio path where they are compressed in
+	 * parallel.
+	 */
+	if (op_is_write(op) && READ_ONCE(zram->async_write))
+		return -ENOTSUPP;
+
 	if (!valid_io_request(zram, sector, PAGE_SIZE)) {
 		atomic64_inc(&zram->stats.invalid_io);
 		ret = -EINVAL;
@@ -1694,7 +2523,7 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 
 static void zram_reset_device(struct zram *zram)
 {
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp;
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -1707,6 +2536,8 @@ static void zram_reset_device(struct zram *zram)
 	}
 
 	comp = zram->comp;
+	recomp = zram->recomp;
+	zram->recomp = NULL;
 	disksize = zram->disksize;
 	zram->disksize = 0;
 
@@ -1714,10 +2545,14 @@ static void zram_reset_device(struct zram *zram)
 	part_stat_set_all(&zram->disk->part0, 0);
 
 	up_write(&zram->init_lock);
+	/* Wait for asynchronous writes still being compressed */
+	flush_workqueue(zram_write_wq);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
+	if (recomp)
+		zcomp_destroy(recomp);
 	reset_bdev(zram);
 }
 
@@ -1725,7 +2560,7 @@ static ssize_t disksize_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	u64 disksize;
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp = NULL;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
 
@@ -1754,7 +2589,18 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+	if (zram->recomp_algorithm[0]) {
+		recomp = zcomp_create(zram->recomp_algorithm);
+		if (IS_ERR(recomp)) {
+			pr_err("Cannot initialise %s recompressing backend\n",
+					zram->recomp_algorithm);
+			err = PTR_ERR(recomp);
+			goto out_free_comp;
+		}
+	}
+
 	zram->comp = comp;
+	zram->recomp = recomp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
@@ -1763,6 +2609,8 @@ static ssize_t disksize_store(struct device *dev,
 
 	return len;
 
+out_free_comp:
+	zcomp_destroy(comp);
 out_free_meta:
 	zram_meta_free(zram, disksize);
 out_unlock:
@@ -1846,6 +2694,18 @@ static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RW(async_write);
+#ifdef CONFIG_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#endif
+#ifdef CONFIG_ZRAM_MEMCG
+static DEVICE_ATTR_RO(cgroup_stat);
+static DEVICE_ATTR_WO(cgroup_limit);
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 static DEVICE_ATTR_WO(writeback);
@@ -1863,6 +2723,18 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_idle.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_async_write.attr,
+#ifdef CONFIG_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
+#endif
+#ifdef CONFIG_ZRAM_MEMCG
+	&dev_attr_cgroup_stat.attr,
+	&dev_attr_cgroup_limit.attr,
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 	&dev_attr_writeback.attr,
@@ -1910,6 +2782,8 @@ static int zram_add(void)
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spin_lock_init(&zram->wb_limit_lock);
 #endif
+	zram_dedup_init(zram);
+	zram_memcg_init(zram);
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
 		pr_err("Error allocating disk queue for device %d\n",
@@ -2016,6 +2890,7 @@ static int zram_remove(struct zram *zram)
 	del_gendisk(zram->disk);
 	blk_cleanup_queue(zram->disk->queue);
 	put_disk(zram->disk);
+	zram_memcg_destroy(zram);
 	kfree(zram);
 	return 0;
 }
@@ -2101,6 +2976,7 @@ static void destroy_devices(void)
 	zram_debugfs_destroy();
 	idr_destroy(&zram_index_idr);
 	unregister_blkdev(zram_major, "zram");
+	destroy_workqueue(zram_write_wq);
 	cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 }
 
@@ -2108,14 +2984,24 @@ static int __init zram_init(void)
 {
 	int ret;
 
+	BUILD_BUG_ON(__NR_ZRAM_PAGEFLAGS > BITS_PER_LONG);
+
 	ret = cpuhp_setup_state_multi(CPUHP_ZCOMP_PREPARE, "block/zram:prepare",
 				      zcomp_cpu_up_prepare, zcomp_cpu_dead);
 	if (ret < 0)
 		return ret;
 
+	zram_write_wq = alloc_workqueue("zram_write",
+					WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
+	if (!zram_write_wq) {
+		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
+		return -ENOMEM;
+	}
+
 	ret = class_register(&zram_control_class);
 	if (ret) {
 		pr_err("Unable to register zram-control class\n");
+		destroy_workqueue(zram_write_wq);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return ret;
 	}
@@ -2125,6 +3011,7 @@ static int __init zram_init(void)
 	if (zram_major <= 0) {
 		pr_err("Unable to get major number\n");
 		class_unregister(&zram_control_class);
+		destroy_workqueue(zram_write_wq);
 		cpuhp_remove_multi_state(CPUHP_ZCOMP_PREPARE);
 		return -EBUSY;
 	}
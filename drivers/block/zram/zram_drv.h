@@ -16,6 +16,8 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/rwsem.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
 #include <linux/zsmalloc.h>
 #include <linux/crypto.h>
 
@@ -50,6 +52,8 @@ enum zram_pageflags {
 	ZRAM_UNDER_WB,	/* page is under writeback */
 	ZRAM_HUGE,	/* Incompressible page */
 	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_RECOMP,	/* page is compressed with the secondary algorithm */
+	ZRAM_DEDUP,	/* handle points to a shared struct zram_entry */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -66,6 +70,9 @@ struct zram_table_entry {
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	ktime_t ac_time;
 #endif
+#ifdef CONFIG_ZRAM_MEMCG
+	struct zram_memcg *memcg;
+#endif
 };
 
 struct zram_stats {
@@ -82,10 +89,14 @@ struct zram_stats {
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
 	atomic64_t miss_free;		/* no. of missed free */
+	atomic64_t recomp_pages;	/* no. of recompressed pages */
+	atomic64_t dup_data_size;	/* compressed bytes saved by dedup */
+	atomic64_t meta_data_size;	/* size of dedup entries */
 #ifdef	CONFIG_ZRAM_WRITEBACK
 	atomic64_t bd_count;		/* no. of pages in backing device */
 	atomic64_t bd_reads;		/* no. of reads from backing device */
 	atomic64_t bd_writes;		/* no. of writes from backing device */
+	atomic64_t bd_wb_pending;	/* no. of pages under writeback I/O */
 #endif
 };
 
@@ -93,6 +104,8 @@ struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
 	struct zcomp *comp;
+	/* secondary algorithm used to recompress idle pages, if any */
+	struct zcomp *recomp;
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -108,10 +121,16 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[CRYPTO_MAX_ALG_NAME];
+	char recomp_algorithm[CRYPTO_MAX_ALG_NAME];
 	/*
 	 * zram is claimed so open request will be failed
 	 */
 	bool claim; /* Protected by bdev->bd_mutex */
+	/*
+	 * compress full-page writes on per-CPU workers instead of in
+	 * the bio submitter's context
+	 */
+	bool async_write;
 	struct file *backing_dev;
 #ifdef CONFIG_ZRAM_WRITEBACK
 	spinlock_t wb_limit_lock;
@@ -122,8 +141,27 @@ struct zram {
 	unsigned long *bitmap;
 	unsigned long nr_pages;
 #endif
+#ifdef CONFIG_ZRAM_DEDUP
+	bool use_dedup;
+	/* zram_entry objects keyed by content checksum */
+	struct rb_root dedup_root;
+	spinlock_t dedup_lock;
+#endif
+#ifdef CONFIG_ZRAM_MEMCG
+	/* zram_memcg records keyed by cgroup inode number */
+	struct rb_root memcg_root;
+	spinlock_t memcg_lock;
+#endif
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
 #endif
+#ifdef CONFIG_ZRAM_BENCH
+	/* report of the last benchmark run, protected by zram_bench_mutex */
+	char *bench_report;
+#endif
 };
+
+#include "zram_bench.h"
+#include "zram_dedup.h"
+#include "zram_memcg.h"
 #endif
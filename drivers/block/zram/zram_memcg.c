@@ -0,0 +1,229 @@
+/*
+ * Per memory cgroup accounting of zram usage
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/cgroup.h>
+#include <linux/memcontrol.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "zram_drv.h"
+
+void zram_memcg_init(struct zram *zram)
+{
+	zram->memcg_root = RB_ROOT;
+	spin_lock_init(&zram->memcg_lock);
+}
+
+static struct zram_memcg *zram_memcg_lookup_locked(struct zram *zram,
+						   unsigned long ino)
+{
+	struct rb_node *node = zram->memcg_root.rb_node;
+
+	while (node) {
+		struct zram_memcg *rec = rb_entry(node, struct zram_memcg,
+						  rb_node);
+
+		if (ino < rec->ino)
+			node = node->rb_left;
+		else if (ino > rec->ino)
+			node = node->rb_right;
+		else
+			return rec;
+	}
+
+	return NULL;
+}
+
+static struct zram_memcg *zram_memcg_get_locked(struct zram *zram,
+						unsigned long ino)
+{
+	struct rb_node **link = &zram->memcg_root.rb_node, *parent = NULL;
+	struct zram_memcg *rec;
+
+	while (*link) {
+		parent = *link;
+		rec = rb_entry(parent, struct zram_memcg, rb_node);
+		if (ino < rec->ino)
+			link = &parent->rb_left;
+		else if (ino > rec->ino)
+			link = &parent->rb_right;
+		else
+			return rec;
+	}
+
+	rec = kzalloc(sizeof(*rec), GFP_NOWAIT | __GFP_NOWARN);
+	if (!rec)
+		return NULL;
+
+	rec->ino = ino;
+	rb_link_node(&rec->rb_node, parent, link);
+	rb_insert_color(&rec->rb_node, &zram->memcg_root);
+	return rec;
+}
+
+static void zram_memcg_put_locked(struct zram *zram, struct zram_memcg *rec)
+{
+	while (rec && !--rec->refs) {
+		struct zram_memcg *parent = rec->parent;
+
+		rb_erase(&rec->rb_node, &zram->memcg_root);
+		kfree(rec);
+		rec = parent;
+	}
+}
+
+/* Drop a record that nothing refers to yet */
+static void zram_memcg_release_locked(struct zram *zram,
+				      struct zram_memcg *rec)
+{
+	if (rec && !rec->refs) {
+		rec->refs++;
+		zram_memcg_put_locked(zram, rec);
+	}
+}
+
+void zram_memcg_destroy(struct zram *zram)
+{
+	struct zram_memcg *rec, *tmp;
+
+	rbtree_postorder_for_each_entry_safe(rec, tmp, &zram->memcg_root,
+					     rb_node)
+		kfree(rec);
+	zram->memcg_root = RB_ROOT;
+}
+
+/*
+ * Charge @size compressed bytes to the memory cgroup @page belongs to and
+ * to all its ancestors. Returns -ENOMEM if that would take any of them
+ * over its limit. On success *@memcgp is the record to store in the slot,
+ * or NULL if the page is not charged to anybody.
+ */
+int zram_memcg_charge(struct zram *zram, struct page *page,
+			unsigned int size, struct zram_memcg **memcgp)
+{
+	struct mem_cgroup *memcg = page->mem_cgroup;
+	struct zram_memcg *leaf = NULL, *child = NULL, *rec;
+	int ret = 0;
+
+	*memcgp = NULL;
+	if (mem_cgroup_disabled() || !memcg)
+		return 0;
+
+	spin_lock(&zram->memcg_lock);
+	/*
+	 * The page keeps its cgroup, and a cgroup its ancestors, alive, so
+	 * the chain can be walked without further references.
+	 */
+	for (; memcg && !mem_cgroup_is_root(memcg);
+	     memcg = parent_mem_cgroup(memcg)) {
+		unsigned long ino = cgroup_ino(memcg->css.cgroup);
+
+		rec = zram_memcg_get_locked(zram, ino);
+		if (!rec) {
+			/* Out of memory: leave the page uncharged */
+			zram_memcg_release_locked(zram, leaf);
+			goto out;
+		}
+		if (!leaf)
+			leaf = rec;
+		if (child && !child->parent) {
+			child->parent = rec;
+			rec->refs++;
+		}
+		child = rec;
+	}
+
+	for (rec = leaf; rec; rec = rec->parent) {
+		if (rec->limit && rec->usage + size > rec->limit) {
+			rec->failcnt++;
+			zram_memcg_release_locked(zram, leaf);
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (rec = leaf; rec; rec = rec->parent)
+		rec->usage += size;
+	if (leaf) {
+		leaf->refs++;
+		*memcgp = leaf;
+	}
+out:
+	spin_unlock(&zram->memcg_lock);
+	return ret;
+}
+
+/*
+ * Uncharge @size bytes from @memcg and its ancestors. With @put set, the
+ * slot gives up its reference on @memcg as well.
+ */
+void zram_memcg_uncharge(struct zram *zram, struct zram_memcg *memcg,
+			unsigned int size, bool put)
+{
+	struct zram_memcg *rec;
+
+	if (!memcg)
+		return;
+
+	spin_lock(&zram->memcg_lock);
+	for (rec = memcg; rec; rec = rec->parent)
+		rec->usage -= size;
+	if (put)
+		zram_memcg_put_locked(zram, memcg);
+	spin_unlock(&zram->memcg_lock);
+}
+
+int zram_memcg_set_limit(struct zram *zram, unsigned long ino, u64 limit)
+{
+	struct zram_memcg *rec;
+	int ret = 0;
+
+	spin_lock(&zram->memcg_lock);
+	if (!limit) {
+		rec = zram_memcg_lookup_locked(zram, ino);
+		if (rec && rec->limit) {
+			rec->limit = 0;
+			zram_memcg_put_locked(zram, rec);
+		}
+		goto out;
+	}
+
+	rec = zram_memcg_get_locked(zram, ino);
+	if (!rec) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	/* a limit pins the record, so it survives its last slot */
+	if (!rec->limit)
+		rec->refs++;
+	rec->limit = limit;
+out:
+	spin_unlock(&zram->memcg_lock);
+	return ret;
+}
+
+ssize_t zram_memcg_show(struct zram *zram, char *buf)
+{
+	struct zram_memcg *rec;
+	struct rb_node *node;
+	ssize_t written = 0;
+
+	spin_lock(&zram->memcg_lock);
+	for (node = rb_first(&zram->memcg_root); node; node = rb_next(node)) {
+		rec = rb_entry(node, struct zram_memcg, rb_node);
+		written += scnprintf(buf + written, PAGE_SIZE - written,
+				"%8lu %12llu %12llu %8llu\n",
+				rec->ino, rec->usage, rec->limit,
+				rec->failcnt);
+	}
+	spin_unlock(&zram->memcg_lock);
+
+	return written;
+}
@@ -0,0 +1,73 @@
+/*
+ * Per memory cgroup accounting of zram usage
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZRAM_MEMCG_H_
+#define _ZRAM_MEMCG_H_
+
+#include <linux/rbtree.h>
+
+struct zram;
+
+/*
+ * Compressed bytes charged to one memory cgroup, including its
+ * descendants, keyed by the cgroup's inode number. Records mirror the
+ * cgroup hierarchy through ->parent and live as long as a slot, a child
+ * record or a limit refers to them.
+ */
+struct zram_memcg {
+	struct rb_node rb_node;
+	struct zram_memcg *parent;
+	unsigned long ino;
+	u64 usage;
+	u64 limit;		/* 0 means unlimited */
+	u64 failcnt;
+	unsigned int refs;
+};
+
+#ifdef CONFIG_ZRAM_MEMCG
+static inline struct zram_memcg *zram_get_memcg(struct zram *zram, u32 index)
+{
+	return zram->table[index].memcg;
+}
+
+static inline void zram_set_memcg(struct zram *zram, u32 index,
+				struct zram_memcg *memcg)
+{
+	zram->table[index].memcg = memcg;
+}
+
+void zram_memcg_init(struct zram *zram);
+void zram_memcg_destroy(struct zram *zram);
+int zram_memcg_charge(struct zram *zram, struct page *page,
+			unsigned int size, struct zram_memcg **memcgp);
+void zram_memcg_uncharge(struct zram *zram, struct zram_memcg *memcg,
+			unsigned int size, bool put);
+int zram_memcg_set_limit(struct zram *zram, unsigned long ino, u64 limit);
+ssize_t zram_memcg_show(struct zram *zram, char *buf);
+#else
+static inline struct zram_memcg *zram_get_memcg(struct zram *zram, u32 index)
+{
+	return NULL;
+}
+static inline void zram_set_memcg(struct zram *zram, u32 index,
+				struct zram_memcg *memcg) {}
+static inline void zram_memcg_init(struct zram *zram) {}
+static inline void zram_memcg_destroy(struct zram *zram) {}
+static inline int zram_memcg_charge(struct zram *zram, struct page *page,
+			unsigned int size, struct zram_memcg **memcgp)
+{
+	*memcgp = NULL;
+	return 0;
+}
+static inline void zram_memcg_uncharge(struct zram *zram,
+			struct zram_memcg *memcg, unsigned int size,
+			bool put) {}
+#endif
+
+#endif /* _ZRAM_MEMCG_H_ */
@@ -2356,6 +2356,53 @@ void cpufreq_update_policy(unsigned int cpu)
 }
 EXPORT_SYMBOL(cpufreq_update_policy);
 
+/**
+ * cpufreq_lower_max_freq - lower the maximum frequency of a policy
+ * @policy: policy to update
+ * @max: new maximum frequency in kHz, valid for the driver
+ *
+ * Lighter alternative to cpufreq_update_policy() for the policy notifiers
+ * which only lower policy->max in CPUFREQ_ADJUST: as long as the policy
+ * limits stay consistent, tightening the maximum cannot change what the
+ * other notifiers decided, so @max is applied directly and the governor is
+ * told about the new limits, without asking the driver for the current
+ * frequency nor running the policy notifiers again.  Nothing is done if
+ * policy->max already is at most @max.
+ *
+ * Return: false if the caller has to use cpufreq_update_policy() instead.
+ */
+bool cpufreq_lower_max_freq(struct cpufreq_policy *policy, unsigned int max)
+{
+	bool ret = false;
+
+	down_write(&policy->rwsem);
+
+	if (policy_is_inactive(policy) || cpufreq_driver->setpolicy ||
+	    !policy->governor || max < policy->min)
+		goto unlock;
+
+	ret = true;
+	if (max >= policy->max)
+		goto unlock;
+
+	policy->max = max;
+	trace_cpu_frequency_limits(policy);
+
+	arch_set_max_freq_scale(policy->cpus, policy->max);
+
+	policy->cached_target_freq = UINT_MAX;
+
+	pr_debug("lowered max freq of CPU %u to %u kHz\n", policy->cpu, max);
+
+	cpufreq_governor_limits(policy);
+
+unlock:
+	up_write(&policy->rwsem);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(cpufreq_lower_max_freq);
+
 /*********************************************************************
  *               BOOST						     *
  *********************************************************************/
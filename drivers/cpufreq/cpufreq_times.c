@@ -18,31 +18,52 @@
 #include <linux/hashtable.h>
 #include <linux/init.h>
 #include <linux/jiffies.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
 #include <linux/proc_fs.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/threads.h>
+#include <linux/uaccess.h>
 
 #define UID_HASH_BITS 10
 
 static DECLARE_HASHTABLE(uid_hash_table, UID_HASH_BITS);
 
-static DEFINE_SPINLOCK(task_time_in_state_lock); /* task->time_in_state */
 static DEFINE_SPINLOCK(uid_lock); /* uid_hash_table */
 
+/* Generation of the next uid_time_in_state_bin snapshot, see uid_entry->gen */
+static atomic64_t uid_gen = ATOMIC64_INIT(1);
+
 struct concurrent_times {
 	atomic64_t active[NR_CPUS];
 	atomic64_t policy[NR_CPUS];
 };
 
+/*
+ * The time in state of a UID is accumulated per CPU from the tick without
+ * any lock, and folded by the readers.
+ */
 struct uid_entry {
 	uid_t uid;
 	unsigned int max_state;
+	u64 gen; /* uid_gen when last updated */
 	struct hlist_node hash;
 	struct rcu_head rcu;
 	struct concurrent_times *concurrent_times;
+	u64 __percpu *time_in_state;
+};
+
+/*
+ * Only the CPU a task runs on accounts time to it, so task->time_in_state
+ * has a single writer. RCU protects the readers against the array being
+ * resized or freed.
+ */
+struct cpufreq_task_times {
+	struct rcu_head rcu;
+	unsigned int max_state;
 	u64 time_in_state[0];
 };
 
@@ -89,47 +110,95 @@ static struct uid_entry *find_uid_entry_locked(uid_t uid)
 	return NULL;
 }
 
+static struct uid_entry *uid_entry_alloc(uid_t uid, unsigned int max_state)
+{
+	struct uid_entry *uid_entry;
+
+	uid_entry = kzalloc(sizeof(*uid_entry), GFP_ATOMIC);
+	if (!uid_entry)
+		return NULL;
+
+	uid_entry->time_in_state = __alloc_percpu_gfp(max_state * sizeof(u64),
+						      sizeof(u64), GFP_ATOMIC);
+	if (!uid_entry->time_in_state) {
+		kfree(uid_entry);
+		return NULL;
+	}
+
+	uid_entry->uid = uid;
+	uid_entry->max_state = max_state;
+
+	return uid_entry;
+}
+
+static void uid_entry_free(struct rcu_head *rcu)
+{
+	struct uid_entry *uid_entry = container_of(rcu, struct uid_entry, rcu);
+
+	free_percpu(uid_entry->time_in_state);
+	kfree(uid_entry);
+}
+
+static void uid_entry_reclaim(struct rcu_head *rcu)
+{
+	struct uid_entry *uid_entry = container_of(rcu, struct uid_entry, rcu);
+
+	kfree(uid_entry->concurrent_times);
+	uid_entry_free(rcu);
+}
+
+/* Caller must hold rcu_read_lock() */
+static u64 uid_entry_time_in_state(struct uid_entry *uid_entry,
+				   unsigned int state)
+{
+	u64 time = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		time += per_cpu_ptr(uid_entry->time_in_state, cpu)[state];
+
+	return time;
+}
+
 /* Caller must hold uid lock */
 static struct uid_entry *find_or_register_uid_locked(uid_t uid)
 {
 	struct uid_entry *uid_entry, *temp;
 	struct concurrent_times *times;
 	unsigned int max_state = READ_ONCE(next_offset);
-	size_t alloc_size = sizeof(*uid_entry) + max_state *
-		sizeof(uid_entry->time_in_state[0]);
+	int cpu;
 
 	uid_entry = find_uid_entry_locked(uid);
 	if (uid_entry) {
 		if (uid_entry->max_state == max_state)
 			return uid_entry;
 		/* uid_entry->time_in_state is too small to track all freqs, so
-		 * expand it.
+		 * expand it. Times accounted to the old entry while copying
+		 * are lost, which only happens when a policy is created.
 		 */
-		temp = __krealloc(uid_entry, alloc_size, GFP_ATOMIC);
+		temp = uid_entry_alloc(uid, max_state);
 		if (!temp)
 			return uid_entry;
-		temp->max_state = max_state;
-		memset(temp->time_in_state + uid_entry->max_state, 0,
-		       (max_state - uid_entry->max_state) *
-		       sizeof(uid_entry->time_in_state[0]));
-		if (temp != uid_entry) {
-			hlist_replace_rcu(&uid_entry->hash, &temp->hash);
-			kfree_rcu(uid_entry, rcu);
-		}
+		for_each_possible_cpu(cpu)
+			memcpy(per_cpu_ptr(temp->time_in_state, cpu),
+			       per_cpu_ptr(uid_entry->time_in_state, cpu),
+			       uid_entry->max_state * sizeof(u64));
+		temp->gen = uid_entry->gen;
+		temp->concurrent_times = uid_entry->concurrent_times;
+		hlist_replace_rcu(&uid_entry->hash, &temp->hash);
+		call_rcu(&uid_entry->rcu, uid_entry_free);
 		return temp;
 	}
 
-	uid_entry = kzalloc(alloc_size, GFP_ATOMIC);
+	uid_entry = uid_entry_alloc(uid, max_state);
 	if (!uid_entry)
 		return NULL;
 	times = kzalloc(sizeof(*times), GFP_ATOMIC);
 	if (!times) {
-		kfree(uid_entry);
+		uid_entry_free(&uid_entry->rcu);
 		return NULL;
 	}
 
-	uid_entry->uid = uid;
-	uid_entry->max_state = max_state;
 	uid_entry->concurrent_times = times;
 
 	hash_add_rcu(uid_hash_table, &uid_entry->hash, uid);
@@ -174,7 +243,7 @@ static int single_uid_time_in_state_show(struct seq_file *m, void *ptr)
 	for (i = 0; i < uid_entry->max_state; ++i) {
 		if (freq_index_invalid(i))
 			continue;
-		time = nsec_to_clock_t(uid_entry->time_in_state[i]);
+		time = nsec_to_clock_t(uid_entry_time_in_state(uid_entry, i));
 		seq_write(m, &time, sizeof(time));
 	}
 
@@ -240,7 +309,8 @@ static int uid_time_in_state_seq_show(struct seq_file *m, void *v)
 			u64 time;
 			if (freq_index_invalid(i))
 				continue;
-			time = nsec_to_clock_t(uid_entry->time_in_state[i]);
+			time = nsec_to_clock_t(uid_entry_time_in_state(uid_entry,
+								       i));
 			seq_put_decimal_ull(m, " ", time);
 		}
 		if (uid_entry->max_state)
@@ -333,60 +403,54 @@ static int concurrent_policy_time_seq_show(struct seq_file *m, void *v)
 
 void cpufreq_task_times_init(struct task_struct *p)
 {
-	unsigned long flags;
-
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
-	p->time_in_state = NULL;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
-	p->max_state = 0;
+	RCU_INIT_POINTER(p->time_in_state, NULL);
 }
 
-void cpufreq_task_times_alloc(struct task_struct *p)
+static struct cpufreq_task_times *cpufreq_task_times_new(void)
 {
-	void *temp;
-	unsigned long flags;
 	unsigned int max_state = READ_ONCE(next_offset);
+	struct cpufreq_task_times *times;
 
 	/* We use one array to avoid multiple allocs per task */
-	temp = kcalloc(max_state, sizeof(p->time_in_state[0]), GFP_ATOMIC);
-	if (!temp)
-		return;
+	times = kzalloc(sizeof(*times) + max_state * sizeof(u64), GFP_ATOMIC);
+	if (times)
+		times->max_state = max_state;
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
-	p->time_in_state = temp;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
-	p->max_state = max_state;
+	return times;
 }
 
-/* Caller must hold task_time_in_state_lock */
-static int cpufreq_task_times_realloc_locked(struct task_struct *p)
+void cpufreq_task_times_alloc(struct task_struct *p)
 {
-	void *temp;
-	unsigned int max_state = READ_ONCE(next_offset);
+	rcu_assign_pointer(p->time_in_state, cpufreq_task_times_new());
+}
 
-	temp = krealloc(p->time_in_state, max_state * sizeof(u64), GFP_ATOMIC);
-	if (!temp)
-		return -ENOMEM;
-	p->time_in_state = temp;
-	memset(p->time_in_state + p->max_state, 0,
-	       (max_state - p->max_state) * sizeof(u64));
-	p->max_state = max_state;
-	return 0;
+/* Called from the CPU @p runs on, with rcu_read_lock() held */
+static struct cpufreq_task_times *
+cpufreq_task_times_realloc(struct task_struct *p,
+			   struct cpufreq_task_times *old)
+{
+	struct cpufreq_task_times *times;
+
+	times = cpufreq_task_times_new();
+	if (!times)
+		return old;
+
+	memcpy(times->time_in_state, old->time_in_state,
+	       old->max_state * sizeof(u64));
+	rcu_assign_pointer(p->time_in_state, times);
+	kfree_rcu(old, rcu);
+
+	return times;
 }
 
 void cpufreq_task_times_exit(struct task_struct *p)
 {
-	unsigned long flags;
-	void *temp;
+	struct cpufreq_task_times *times;
 
-	if (!p->time_in_state)
-		return;
-
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
-	temp = p->time_in_state;
-	p->time_in_state = NULL;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
-	kfree(temp);
+	times = xchg((__force struct cpufreq_task_times **)&p->time_in_state,
+		     NULL);
+	if (times)
+		kfree_rcu(times, rcu);
 }
 
 int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
@@ -394,11 +458,12 @@ int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
 {
 	unsigned int cpu, i;
 	u64 cputime;
-	unsigned long flags;
 	struct cpu_freqs *freqs;
 	struct cpu_freqs *last_freqs = NULL;
+	struct cpufreq_task_times *times;
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
+	rcu_read_lock();
+	times = rcu_dereference(p->time_in_state);
 	for_each_possible_cpu(cpu) {
 		freqs = all_freqs[cpu];
 		if (!freqs || freqs == last_freqs)
@@ -410,17 +475,28 @@ int proc_time_in_state_show(struct seq_file *m, struct pid_namespace *ns,
 			if (freqs->freq_table[i] == CPUFREQ_ENTRY_INVALID)
 				continue;
 			cputime = 0;
-			if (freqs->offset + i < p->max_state &&
-			    p->time_in_state)
-				cputime = p->time_in_state[freqs->offset + i];
+			if (times && freqs->offset + i < times->max_state)
+				cputime = READ_ONCE(times->time_in_state[
+							freqs->offset + i]);
 			seq_printf(m, "%u %lu\n", freqs->freq_table[i],
 				   (unsigned long)nsec_to_clock_t(cputime));
 		}
 	}
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
+	rcu_read_unlock();
 	return 0;
 }
 
+/*
+ * Stamp an entry after its times changed. Pairs with the increment of
+ * uid_gen in uid_times_snapshot(): a snapshot either sees the new times, or
+ * the entry is stamped with the generation of the snapshot or later.
+ */
+static void uid_entry_touch(struct uid_entry *uid_entry)
+{
+	smp_mb();
+	WRITE_ONCE(uid_entry->gen, atomic64_read(&uid_gen));
+}
+
 void cpufreq_acct_update_power(struct task_struct *p, u64 cputime)
 {
 	unsigned long flags;
@@ -431,6 +507,7 @@ void cpufreq_acct_update_power(struct task_struct *p, u64 cputime)
 	struct uid_entry *uid_entry;
 	struct cpu_freqs *freqs = all_freqs[task_cpu(p)];
 	struct cpufreq_policy *policy;
+	struct cpufreq_task_times *times;
 	uid_t uid = from_kuid_munged(current_user_ns(), task_uid(p));
 	int cpu = 0;
 
@@ -439,25 +516,29 @@ void cpufreq_acct_update_power(struct task_struct *p, u64 cputime)
 
 	state = freqs->offset + READ_ONCE(freqs->last_index);
 
-	spin_lock_irqsave(&task_time_in_state_lock, flags);
-	if ((state < p->max_state || !cpufreq_task_times_realloc_locked(p)) &&
-	    p->time_in_state)
-		p->time_in_state[state] += cputime;
-	spin_unlock_irqrestore(&task_time_in_state_lock, flags);
+	rcu_read_lock();
 
-	spin_lock_irqsave(&uid_lock, flags);
-	uid_entry = find_or_register_uid_locked(uid);
-	if (uid_entry && state < uid_entry->max_state)
-		uid_entry->time_in_state[state] += cputime;
-	spin_unlock_irqrestore(&uid_lock, flags);
+	times = rcu_dereference(p->time_in_state);
+	if (times && state >= times->max_state)
+		times = cpufreq_task_times_realloc(p, times);
+	if (times && state < times->max_state)
+		WRITE_ONCE(times->time_in_state[state],
+			   times->time_in_state[state] + cputime);
 
-	rcu_read_lock();
 	uid_entry = find_uid_entry_rcu(uid);
-	if (!uid_entry) {
-		rcu_read_unlock();
-		return;
+	if (unlikely(!uid_entry || state >= uid_entry->max_state)) {
+		spin_lock_irqsave(&uid_lock, flags);
+		uid_entry = find_or_register_uid_locked(uid);
+		spin_unlock_irqrestore(&uid_lock, flags);
+		if (!uid_entry) {
+			rcu_read_unlock();
+			return;
+		}
 	}
 
+	if (state < uid_entry->max_state)
+		this_cpu_add(uid_entry->time_in_state[state], cputime);
+
 	for_each_possible_cpu(cpu)
 		if (!idle_cpu(cpu))
 			++active_cpu_cnt;
@@ -471,6 +552,7 @@ void cpufreq_acct_update_power(struct task_struct *p, u64 cputime)
 		 * This CPU may have just come up and not have a cpufreq policy
 		 * yet.
 		 */
+		uid_entry_touch(uid_entry);
 		rcu_read_unlock();
 		return;
 	}
@@ -485,6 +567,7 @@ void cpufreq_acct_update_power(struct task_struct *p, u64 cputime)
 	atomic64_add(cputime,
 		     &uid_entry->concurrent_times->policy[policy_first_cpu +
 							  policy_cpu_cnt - 1]);
+	uid_entry_touch(uid_entry);
 	rcu_read_unlock();
 }
 
@@ -527,14 +610,6 @@ void cpufreq_times_create_policy(struct cpufreq_policy *policy)
 		all_freqs[cpu] = freqs;
 }
 
-static void uid_entry_reclaim(struct rcu_head *rcu)
-{
-	struct uid_entry *uid_entry = container_of(rcu, struct uid_entry, rcu);
-
-	kfree(uid_entry->concurrent_times);
-	kfree(uid_entry);
-}
-
 void cpufreq_task_times_remove_uids(uid_t uid_start, uid_t uid_end)
 {
 	struct uid_entry *uid_entry;
@@ -569,6 +644,221 @@ void cpufreq_times_record_transition(struct cpufreq_policy *policy,
 		WRITE_ONCE(freqs->last_index, index);
 }
 
+/**
+ * struct uid_times_file - state of an open uid_time_in_state_bin file
+ * @lock: serializes the readers of the file
+ * @since: only report the UIDs updated since that generation
+ * @buf: snapshot being read, built when reading from offset 0
+ * @len: size of @buf
+ */
+struct uid_times_file {
+	struct mutex lock;
+	u64 since;
+	void *buf;
+	size_t len;
+};
+
+/*
+ * Fill @freq_table with the valid frequencies, in the order of the text
+ * files, and @states with their index in the time_in_state arrays.
+ */
+static unsigned int uid_times_columns(u32 *freq_table, unsigned int *states,
+				      unsigned int max_state)
+{
+	struct cpu_freqs *freqs, *last_freqs = NULL;
+	unsigned int i, nr = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		freqs = all_freqs[cpu];
+		if (!freqs || freqs == last_freqs)
+			continue;
+		last_freqs = freqs;
+		for (i = 0; i < freqs->max_state; i++) {
+			if (freqs->freq_table[i] == CPUFREQ_ENTRY_INVALID ||
+			    freqs->offset + i >= max_state)
+				continue;
+			freq_table[nr] = freqs->freq_table[i];
+			states[nr++] = freqs->offset + i;
+		}
+	}
+
+	return nr;
+}
+
+static int uid_times_snapshot(struct uid_times_file *f)
+{
+	unsigned int max_state = READ_ONCE(next_offset);
+	unsigned int nr_cpus = num_possible_cpus();
+	unsigned int nr_freqs, nr_uids, nr_records, i;
+	struct uid_times_header *hdr;
+	struct uid_times_record *rec;
+	struct uid_entry *uid_entry;
+	unsigned int *states;
+	size_t head_size, record_size;
+	u32 *freq_table;
+	void *buf;
+	u64 *times;
+	u64 gen;
+	int bkt;
+
+	states = kmalloc_array(max_state, sizeof(*states), GFP_KERNEL);
+	freq_table = kmalloc_array(max_state, sizeof(*freq_table), GFP_KERNEL);
+	if (!states || !freq_table) {
+		kfree(states);
+		kfree(freq_table);
+		return -ENOMEM;
+	}
+	nr_freqs = uid_times_columns(freq_table, states, max_state);
+
+	head_size = sizeof(*hdr) + ALIGN(nr_freqs * sizeof(u32), sizeof(u64));
+	record_size = sizeof(*rec) + (nr_freqs + 2 * nr_cpus) * sizeof(u64);
+
+	/* From now on, updated entries are stamped with gen or later */
+	gen = atomic64_inc_return(&uid_gen);
+
+retry:
+	nr_uids = 0;
+	rcu_read_lock();
+	hash_for_each_rcu(uid_hash_table, bkt, uid_entry, hash)
+		nr_uids++;
+	rcu_read_unlock();
+	/* Leave some room for the UIDs registered meanwhile */
+	nr_uids += 16;
+
+	buf = kvzalloc(head_size + nr_uids * record_size, GFP_KERNEL);
+	if (!buf) {
+		kfree(states);
+		kfree(freq_table);
+		return -ENOMEM;
+	}
+
+	nr_records = 0;
+	rcu_read_lock();
+	hash_for_each_rcu(uid_hash_table, bkt, uid_entry, hash) {
+		struct concurrent_times *ct = uid_entry->concurrent_times;
+
+		if (READ_ONCE(uid_entry->gen) < f->since)
+			continue;
+
+		if (nr_records == nr_uids) {
+			rcu_read_unlock();
+			kvfree(buf);
+			goto retry;
+		}
+
+		rec = buf + head_size + nr_records++ * record_size;
+		rec->uid = uid_entry->uid;
+		times = (u64 *)(rec + 1);
+
+		for (i = 0; i < nr_freqs; i++) {
+			if (states[i] < uid_entry->max_state)
+				times[i] = uid_entry_time_in_state(uid_entry,
+								   states[i]);
+		}
+		times += nr_freqs;
+
+		for (i = 0; i < nr_cpus; i++) {
+			times[i] = atomic64_read(&ct->active[i]);
+			times[nr_cpus + i] = atomic64_read(&ct->policy[i]);
+		}
+	}
+	rcu_read_unlock();
+
+	hdr = buf;
+	hdr->version = UID_TIMES_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->record_size = record_size;
+	hdr->nr_freqs = nr_freqs;
+	hdr->nr_cpus = nr_cpus;
+	hdr->nr_records = nr_records;
+	hdr->generation = gen;
+	hdr->since = f->since;
+	memcpy(hdr + 1, freq_table, nr_freqs * sizeof(u32));
+
+	kfree(states);
+	kfree(freq_table);
+
+	f->buf = buf;
+	f->len = head_size + nr_records * record_size;
+
+	return 0;
+}
+
+static int uid_times_open(struct inode *inode, struct file *file)
+{
+	struct uid_times_file *f;
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		return -ENOMEM;
+
+	mutex_init(&f->lock);
+	file->private_data = f;
+
+	return 0;
+}
+
+static ssize_t uid_times_read(struct file *file, char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	struct uid_times_file *f = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&f->lock);
+	if (*ppos == 0) {
+		kvfree(f->buf);
+		f->buf = NULL;
+		f->len = 0;
+		ret = uid_times_snapshot(f);
+		if (ret)
+			goto unlock;
+	}
+	ret = simple_read_from_buffer(ubuf, count, ppos, f->buf, f->len);
+unlock:
+	mutex_unlock(&f->lock);
+
+	return ret;
+}
+
+static long uid_times_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct uid_times_file *f = file->private_data;
+	u64 since;
+
+	if (cmd != UID_TIMES_IOC_SET_SINCE)
+		return -ENOTTY;
+
+	if (copy_from_user(&since, (void __user *)arg, sizeof(since)))
+		return -EFAULT;
+
+	mutex_lock(&f->lock);
+	f->since = since;
+	mutex_unlock(&f->lock);
+
+	return 0;
+}
+
+static int uid_times_release(struct inode *inode, struct file *file)
+{
+	struct uid_times_file *f = file->private_data;
+
+	kvfree(f->buf);
+	kfree(f);
+
+	return 0;
+}
+
+static const struct file_operations uid_times_fops = {
+	.open		= uid_times_open,
+	.read		= uid_times_read,
+	.unlocked_ioctl	= uid_times_ioctl,
+	.compat_ioctl	= uid_times_ioctl,
+	.llseek		= default_llseek,
+	.release	= uid_times_release,
+};
+
 static const struct seq_operations uid_time_in_state_seq_ops = {
 	.start = uid_seq_start,
 	.next = uid_seq_next,
@@ -643,6 +933,9 @@ static int __init cpufreq_times_init(void)
 	proc_create_data("uid_concurrent_policy_time", 0444, NULL,
 			 &concurrent_policy_time_fops, NULL);
 
+	proc_create_data("uid_time_in_state_bin", 0444, NULL,
+			 &uid_times_fops, NULL);
+
 	return 0;
 }
 
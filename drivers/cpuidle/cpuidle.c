@@ -18,6 +18,7 @@
 #include <linux/cpu.h>
 #include <linux/cpuidle.h>
 #include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/hrtimer.h>
 #include <linux/module.h>
 #include <linux/suspend.h>
@@ -188,6 +189,50 @@ int cpuidle_enter_s2idle(struct cpuidle_driver *drv, struct cpuidle_device *dev)
 }
 #endif /* CONFIG_SUSPEND */
 
+static bool cpuidle_state_enabled(struct cpuidle_driver *drv,
+				  struct cpuidle_device *dev, int index)
+{
+	return !drv->states[index].disabled &&
+	       !dev->states_usage[index].disable;
+}
+
+/*
+ * Compare the measured residency to what the entered state was worth: it was
+ * too deep if it was left before its target residency while a shallower
+ * state was available, and too shallow if the next enabled deeper state
+ * would have been worth it.
+ */
+static void cpuidle_update_prediction_stats(struct cpuidle_driver *drv,
+					    struct cpuidle_device *dev,
+					    int index, int residency)
+{
+	struct cpuidle_state_usage *su = &dev->states_usage[index];
+	struct cpuidle_state *s = &drv->states[index];
+	int i;
+
+	if (residency < s->target_residency) {
+		for (i = index - 1; i >= 0; i--) {
+			if (cpuidle_state_enabled(drv, dev, i)) {
+				su->above++;
+				break;
+			}
+		}
+	} else {
+		for (i = index + 1; i < drv->state_count; i++) {
+			if (!cpuidle_state_enabled(drv, dev, i))
+				continue;
+			if (residency >= drv->states[i].target_residency)
+				su->below++;
+			break;
+		}
+	}
+
+#ifdef CONFIG_CPU_IDLE_RESIDENCY_HIST
+	i = residency > 1 ? ilog2(residency) : 0;
+	su->residency_hist[min(i, CPUIDLE_RESIDENCY_HIST_BUCKETS - 1)]++;
+#endif
+}
+
 /**
  * cpuidle_enter_state - enter the state and update stats
  * @dev: cpuidle device for this cpu
@@ -260,6 +305,8 @@ int cpuidle_enter_state(struct cpuidle_device *dev, struct cpuidle_driver *drv,
 		 */
 		dev->states_usage[entered_state].time += dev->last_residency;
 		dev->states_usage[entered_state].usage++;
+		cpuidle_update_prediction_stats(drv, dev, entered_state,
+						dev->last_residency);
 	} else {
 		dev->last_residency = 0;
 	}
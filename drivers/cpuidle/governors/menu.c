@@ -15,8 +15,10 @@
 #include <linux/time.h>
 #include <linux/ktime.h>
 #include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 #include <linux/tick.h>
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <linux/sched/loadavg.h>
 #include <linux/sched/stat.h>
 #include <linux/math64.h>
@@ -274,6 +276,30 @@ static unsigned int get_typical_interval(struct menu_device *data)
 	goto again;
 }
 
+#ifdef CONFIG_CPU_IDLE_GOV_MENU_IRQ_TIMINGS
+/*
+ * Time till the next interrupt predicted from the interrupt timings of this
+ * CPU, UINT_MAX if none is expected. An overdue prediction is ignored, the
+ * interrupt may never come and waiting for it in a shallow state is what
+ * costs the most.
+ */
+static unsigned int menu_next_irq_us(void)
+{
+	u64 now = local_clock();
+	u64 next_irq = irq_timings_next_event(now);
+
+	if (next_irq == U64_MAX || next_irq <= now)
+		return UINT_MAX;
+
+	return min_t(u64, div_u64(next_irq - now, NSEC_PER_USEC), UINT_MAX);
+}
+#else
+static inline unsigned int menu_next_irq_us(void)
+{
+	return UINT_MAX;
+}
+#endif
+
 /**
  * menu_select - selects the next idle state to enter
  * @drv: cpuidle driver containing state data
@@ -364,6 +390,12 @@ static int menu_select(struct cpuidle_driver *drv, struct cpuidle_device *dev,
 			latency_req = interactivity_req;
 	}
 
+	/*
+	 * A device interrupt expected before the predicted wakeup will end
+	 * the idle period anyway, even with the tick stopped.
+	 */
+	data->predicted_us = min(data->predicted_us, menu_next_irq_us());
+
 	expected_interval = data->predicted_us;
 	/*
 	 * Find the idle state with the lowest power while satisfying
@@ -593,6 +625,9 @@ static struct cpuidle_governor menu_governor = {
  */
 static int __init init_menu(void)
 {
+#ifdef CONFIG_CPU_IDLE_GOV_MENU_IRQ_TIMINGS
+	irq_timings_enable();
+#endif
 	return cpuidle_register_governor(&menu_governor);
 }
 
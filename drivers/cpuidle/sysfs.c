@@ -297,6 +297,8 @@ define_show_state_function(target_residency)
 define_show_state_function(power_usage)
 define_show_state_ull_function(usage)
 define_show_state_ull_function(time)
+define_show_state_ull_function(above)
+define_show_state_ull_function(below)
 define_show_state_str_function(name)
 define_show_state_str_function(desc)
 define_show_state_ull_function(disable)
@@ -309,8 +311,29 @@ define_one_state_ro(residency, show_state_target_residency);
 define_one_state_ro(power, show_state_power_usage);
 define_one_state_ro(usage, show_state_usage);
 define_one_state_ro(time, show_state_time);
+define_one_state_ro(above, show_state_above);
+define_one_state_ro(below, show_state_below);
 define_one_state_rw(disable, show_state_disable, store_state_disable);
 
+#ifdef CONFIG_CPU_IDLE_RESIDENCY_HIST
+/* one "<lowest residency in us> <count>" line per bucket */
+static ssize_t show_state_residency_hist(struct cpuidle_state *state,
+					 struct cpuidle_state_usage *state_usage,
+					 char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < CPUIDLE_RESIDENCY_HIST_BUCKETS; i++)
+		len += sprintf(buf + len, "%lu %llu\n", i ? 1UL << i : 0,
+			       state_usage->residency_hist[i]);
+
+	return len;
+}
+
+define_one_state_ro(residency_hist, show_state_residency_hist);
+#endif
+
 static struct attribute *cpuidle_state_default_attrs[] = {
 	&attr_name.attr,
 	&attr_desc.attr,
@@ -319,7 +342,12 @@ static struct attribute *cpuidle_state_default_attrs[] = {
 	&attr_power.attr,
 	&attr_usage.attr,
 	&attr_time.attr,
+	&attr_above.attr,
+	&attr_below.attr,
 	&attr_disable.attr,
+#ifdef CONFIG_CPU_IDLE_RESIDENCY_HIST
+	&attr_residency_hist.attr,
+#endif
 	NULL
 };
 
@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * linux/drivers/devfreq/governor_memstall.c
+ *
+ * Memory bus governor coupling the bus load with the memory stalls of the
+ * CPUs: cores waiting on memory are a reason to raise the frequency even
+ * when the bus does not look busy.
+ */
+
+#include <linux/cpu.h>
+#include <linux/devfreq.h>
+#include <linux/errno.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/perf_event.h>
+#include "governor.h"
+
+/* Default constants for DevFreq-MemStall (DFMS) */
+#define DFMS_UPTHRESHOLD	(90)
+#define DFMS_DOWNDIFFERENTIAL	(5)
+#define DFMS_STALL_UPTHRESHOLD	(30)
+
+struct devfreq_memstall_cpu {
+	struct perf_event *cycles;
+	struct perf_event *stalls;
+	u64 prev_cycles;
+	u64 prev_stalls;
+};
+
+static u64 memstall_read(struct perf_event *event, u64 *prev)
+{
+	u64 enabled, running, count, delta;
+
+	count = perf_event_read_value(event, &enabled, &running);
+	delta = count - *prev;
+	*prev = count;
+
+	return delta;
+}
+
+/* Share of the CPU cycles stalled on memory since the last call, in % */
+static unsigned int memstall_stall_ratio(struct devfreq_memstall_data *data)
+{
+	u64 cycles = 0, stalls = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct devfreq_memstall_cpu *mc = per_cpu_ptr(data->cpus, cpu);
+
+		if (!mc->cycles || !mc->stalls)
+			continue;
+
+		cycles += memstall_read(mc->cycles, &mc->prev_cycles);
+		stalls += memstall_read(mc->stalls, &mc->prev_stalls);
+	}
+
+	if (!cycles)
+		return 0;
+
+	return div64_u64(min(stalls, cycles) * 100, cycles);
+}
+
+/* Same as the simple ondemand governor, from the bus load alone */
+static unsigned long memstall_load_freq(struct devfreq *df,
+					unsigned int upthreshold,
+					unsigned int downdifferential,
+					unsigned long max)
+{
+	struct devfreq_dev_status *stat = &df->last_status;
+	unsigned long long a, b;
+
+	if (stat->total_time == 0 || stat->current_frequency == 0)
+		return max;
+
+	/* Prevent overflow */
+	if (stat->busy_time >= (1 << 24) || stat->total_time >= (1 << 24)) {
+		stat->busy_time >>= 7;
+		stat->total_time >>= 7;
+	}
+
+	if (stat->busy_time * 100 > stat->total_time * upthreshold)
+		return max;
+
+	if (stat->busy_time * 100 >
+	    stat->total_time * (upthreshold - downdifferential))
+		return stat->current_frequency;
+
+	a = stat->busy_time;
+	a *= stat->current_frequency;
+	b = div_u64(a, stat->total_time);
+	b *= 100;
+	b = div_u64(b, (upthreshold - downdifferential / 2));
+
+	return (unsigned long)b;
+}
+
+static int devfreq_memstall_func(struct devfreq *df, unsigned long *freq)
+{
+	struct devfreq_memstall_data *data = df->data;
+	unsigned int upthreshold = DFMS_UPTHRESHOLD;
+	unsigned int downdifferential = DFMS_DOWNDIFFERENTIAL;
+	unsigned int stall_upthreshold = DFMS_STALL_UPTHRESHOLD;
+	unsigned long max = (df->max_freq) ? df->max_freq : UINT_MAX;
+	unsigned int stall;
+	int err;
+
+	if (!data || !data->cpus)
+		return -EINVAL;
+
+	err = devfreq_update_stats(df);
+	if (err)
+		return err;
+
+	if (data->upthreshold)
+		upthreshold = data->upthreshold;
+	if (data->downdifferential)
+		downdifferential = data->downdifferential;
+	if (data->stall_upthreshold)
+		stall_upthreshold = data->stall_upthreshold;
+	if (upthreshold > 100 || upthreshold < downdifferential ||
+	    stall_upthreshold > 100)
+		return -EINVAL;
+
+	*freq = memstall_load_freq(df, upthreshold, downdifferential, max);
+
+	/*
+	 * The more the CPUs stall on memory, the higher the floor, up to the
+	 * maximum frequency when stall_upthreshold is reached.
+	 */
+	stall = memstall_stall_ratio(data);
+	if (stall >= stall_upthreshold)
+		*freq = max;
+	else
+		*freq = max(*freq, mult_frac(max, stall, stall_upthreshold));
+
+	if (df->min_freq && *freq < df->min_freq)
+		*freq = df->min_freq;
+	if (df->max_freq && *freq > df->max_freq)
+		*freq = df->max_freq;
+
+	return 0;
+}
+
+static struct perf_event *memstall_create_event(int cpu, u32 type, u64 config)
+{
+	struct perf_event_attr attr = {
+		.type		= type,
+		.size		= sizeof(struct perf_event_attr),
+		.config		= config,
+		.pinned		= 1,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, cpu, NULL, NULL, NULL);
+
+	return IS_ERR(event) ? NULL : event;
+}
+
+static void memstall_release_events(struct devfreq_memstall_data *data)
+{
+	int cpu;
+
+	if (!data->cpus)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct devfreq_memstall_cpu *mc = per_cpu_ptr(data->cpus, cpu);
+
+		if (mc->cycles)
+			perf_event_release_kernel(mc->cycles);
+		if (mc->stalls)
+			perf_event_release_kernel(mc->stalls);
+	}
+
+	free_percpu(data->cpus);
+	data->cpus = NULL;
+}
+
+/*
+ * Count the cycles and the memory stalls of each online CPU. A CPU whose
+ * PMU cannot count them simply does not contribute to the stall ratio.
+ */
+static int memstall_create_events(struct devfreq *df,
+				  struct devfreq_memstall_data *data)
+{
+	u32 type = PERF_TYPE_HARDWARE;
+	u64 config = PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+	int cpu, nr = 0;
+
+	if (data->stall_event) {
+		type = PERF_TYPE_RAW;
+		config = data->stall_event;
+	}
+
+	data->cpus = alloc_percpu(struct devfreq_memstall_cpu);
+	if (!data->cpus)
+		return -ENOMEM;
+
+	cpus_read_lock();
+	for_each_online_cpu(cpu) {
+		struct devfreq_memstall_cpu *mc = per_cpu_ptr(data->cpus, cpu);
+
+		mc->cycles = memstall_create_event(cpu, PERF_TYPE_HARDWARE,
+						   PERF_COUNT_HW_CPU_CYCLES);
+		mc->stalls = memstall_create_event(cpu, type, config);
+		if (mc->cycles && mc->stalls)
+			nr++;
+	}
+	cpus_read_unlock();
+
+	if (!nr)
+		dev_warn(&df->dev, "no CPU memory stall counters, using the bus load only\n");
+
+	return 0;
+}
+
+static int devfreq_memstall_handler(struct devfreq *devfreq,
+				unsigned int event, void *data)
+{
+	struct devfreq_memstall_data *ms_data = devfreq->data;
+	int ret;
+
+	switch (event) {
+	case DEVFREQ_GOV_START:
+		if (!ms_data)
+			return -EINVAL;
+
+		ret = memstall_create_events(devfreq, ms_data);
+		if (ret)
+			return ret;
+		devfreq_monitor_start(devfreq);
+		break;
+
+	case DEVFREQ_GOV_STOP:
+		if (!ms_data)
+			return -EINVAL;
+
+		devfreq_monitor_stop(devfreq);
+		memstall_release_events(ms_data);
+		break;
+
+	case DEVFREQ_GOV_INTERVAL:
+		devfreq_interval_update(devfreq, (unsigned int *)data);
+		break;
+
+	case DEVFREQ_GOV_SUSPEND:
+		devfreq_monitor_suspend(devfreq);
+		break;
+
+	case DEVFREQ_GOV_RESUME:
+		devfreq_monitor_resume(devfreq);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Immutable, as devfreq->data must be the devfreq_memstall_data the device
+ * was added with: switching to this governor through sysfs would leave
+ * devfreq->data as the previous governor's data, or NULL.
+ */
+static struct devfreq_governor devfreq_memstall = {
+	.name = DEVFREQ_GOV_MEMSTALL,
+	.immutable = 1,
+	.get_target_freq = devfreq_memstall_func,
+	.event_handler = devfreq_memstall_handler,
+};
+
+static int __init devfreq_memstall_init(void)
+{
+	return devfreq_add_governor(&devfreq_memstall);
+}
+subsys_initcall(devfreq_memstall_init);
+
+static void __exit devfreq_memstall_exit(void)
+{
+	int ret;
+
+	ret = devfreq_remove_governor(&devfreq_memstall);
+	if (ret)
+		pr_err("%s: failed remove governor %d\n", __func__, ret);
+}
+module_exit(devfreq_memstall_exit);
+
+MODULE_DESCRIPTION("DEVFREQ CPU memory stall aware governor");
+MODULE_LICENSE("GPL");
@@ -34,8 +34,11 @@
 #include <linux/poll.h>
 #include <linux/reservation.h>
 #include <linux/mm.h>
+#include <linux/fdtable.h>
+#include <linux/sched/mm.h>
 
 #include <uapi/linux/dma-buf.h>
+#include <uapi/linux/dma-buf-partial.h>
 
 static inline int is_dma_buf_file(struct file *);
 
@@ -46,6 +49,112 @@ struct dma_buf_list {
 
 static struct dma_buf_list db_list;
 
+/*
+ * Per-process dma-buf accounting.
+ *
+ * /proc/<pid>/dmabuf walks the fd table and the mappings of the task
+ * once, without taking db_list.lock, and sums up the distinct buffers found
+ * there.  The numbers are derived when read, so they stay right however the
+ * fds got there: dma_buf_fd(), binder, dup(), fork() or SCM_RIGHTS, and
+ * include buffers which are still mapped after their last fd was closed.
+ *
+ * Each walk stamps the buffers it counted with its own sequence number, so
+ * that a buffer behind several fds or mappings is only counted once.  The
+ * walks are serialised by dma_buf_proc_lock, which also protects the stamps.
+ */
+static DEFINE_MUTEX(dma_buf_proc_lock);
+static u64 dma_buf_proc_seq;
+
+struct dma_buf_proc_walk {
+	u64 seq;
+	size_t size;
+	unsigned int count;
+};
+
+static void dma_buf_proc_walk_file(struct dma_buf_proc_walk *walk,
+				   struct file *file)
+{
+	struct dma_buf *dmabuf;
+
+	if (!is_dma_buf_file(file))
+		return;
+
+	dmabuf = file->private_data;
+	if (dmabuf->proc_seq == walk->seq)
+		return;
+
+	dmabuf->proc_seq = walk->seq;
+	walk->size += dmabuf->size;
+	walk->count++;
+}
+
+/* called by iterate_fd() with the fd table locked */
+static int dma_buf_proc_walk_fd(const void *p, struct file *file,
+				unsigned int fd)
+{
+	dma_buf_proc_walk_file((struct dma_buf_proc_walk *)p, file);
+	return 0;
+}
+
+/*
+ * dma_buf_mmap() points the vma of an exporter's own mmap() at the dma-buf
+ * file too, so checking vm_file finds every mapping of a dma-buf.
+ *
+ * Called with mmap_sem held for read, which is taken before
+ * dma_buf_proc_lock so that the mutex never nests outside it.
+ */
+static void dma_buf_proc_walk_mm(struct dma_buf_proc_walk *walk,
+				 struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next)
+		if (vma->vm_file)
+			dma_buf_proc_walk_file(walk, vma->vm_file);
+}
+
+/**
+ * proc_dmabuf_show - show the dma-buf footprint of a task
+ * @m:		[in]	seq_file for /proc/<pid>/dmabuf
+ * @ns:		[in]	pid namespace of the proc mount
+ * @pid:	[in]	pid of @task
+ * @task:	[in]	task to report on
+ *
+ * Prints the total size and number of the distinct dma-bufs referenced
+ * through fds in @task's fd table or mapped in its address space.
+ */
+int proc_dmabuf_show(struct seq_file *m, struct pid_namespace *ns,
+		     struct pid *pid, struct task_struct *task)
+{
+	struct dma_buf_proc_walk walk = { };
+	struct files_struct *files;
+	struct mm_struct *mm;
+
+	files = get_files_struct(task);
+	mm = get_task_mm(task);
+	if (mm)
+		down_read(&mm->mmap_sem);
+
+	mutex_lock(&dma_buf_proc_lock);
+	walk.seq = ++dma_buf_proc_seq;
+	if (files)
+		iterate_fd(files, 0, dma_buf_proc_walk_fd, &walk);
+	if (mm)
+		dma_buf_proc_walk_mm(&walk, mm);
+	mutex_unlock(&dma_buf_proc_lock);
+
+	if (mm) {
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	if (files)
+		put_files_struct(files);
+
+	seq_printf(m, "Size:\t%8zu kB\nCount:\t%8u\n", walk.size >> 10,
+		   walk.count);
+	return 0;
+}
+
 static int dma_buf_release(struct inode *inode, struct file *file)
 {
 	struct dma_buf *dmabuf;
@@ -276,11 +385,35 @@ static __poll_t dma_buf_poll(struct file *file, poll_table *poll)
 	return events;
 }
 
+static int dma_buf_sync_direction(u64 flags,
+				  enum dma_data_direction *direction)
+{
+	if (flags & ~DMA_BUF_SYNC_VALID_FLAGS_MASK)
+		return -EINVAL;
+
+	switch (flags & DMA_BUF_SYNC_RW) {
+	case DMA_BUF_SYNC_READ:
+		*direction = DMA_FROM_DEVICE;
+		break;
+	case DMA_BUF_SYNC_WRITE:
+		*direction = DMA_TO_DEVICE;
+		break;
+	case DMA_BUF_SYNC_RW:
+		*direction = DMA_BIDIRECTIONAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static long dma_buf_ioctl(struct file *file,
 			  unsigned int cmd, unsigned long arg)
 {
 	struct dma_buf *dmabuf;
 	struct dma_buf_sync sync;
+	struct dma_buf_sync_partial sync_p;
 	enum dma_data_direction direction;
 	int ret;
 
@@ -291,28 +424,39 @@ static long dma_buf_ioctl(struct file *file,
 		if (copy_from_user(&sync, (void __user *) arg, sizeof(sync)))
 			return -EFAULT;
 
-		if (sync.flags & ~DMA_BUF_SYNC_VALID_FLAGS_MASK)
-			return -EINVAL;
-
-		switch (sync.flags & DMA_BUF_SYNC_RW) {
-		case DMA_BUF_SYNC_READ:
-			direction = DMA_FROM_DEVICE;
-			break;
-		case DMA_BUF_SYNC_WRITE:
-			direction = DMA_TO_DEVICE;
-			break;
-		case DMA_BUF_SYNC_RW:
-			direction = DMA_BIDIRECTIONAL;
-			break;
-		default:
-			return -EINVAL;
-		}
+		ret = dma_buf_sync_direction(sync.flags, &direction);
+		if (ret)
+			return ret;
 
 		if (sync.flags & DMA_BUF_SYNC_END)
 			ret = dma_buf_end_cpu_access(dmabuf, direction);
 		else
 			ret = dma_buf_begin_cpu_access(dmabuf, direction);
 
+		return ret;
+	case DMA_BUF_IOCTL_SYNC_PARTIAL:
+		if (copy_from_user(&sync_p, (void __user *) arg,
+				   sizeof(sync_p)))
+			return -EFAULT;
+
+		ret = dma_buf_sync_direction(sync_p.flags, &direction);
+		if (ret)
+			return ret;
+
+		if (!sync_p.len || sync_p.offset > dmabuf->size ||
+		    sync_p.len > dmabuf->size - sync_p.offset)
+			return -EINVAL;
+
+		if (sync_p.flags & DMA_BUF_SYNC_END)
+			ret = dma_buf_end_cpu_access_partial(dmabuf, direction,
+							     sync_p.offset,
+							     sync_p.len);
+		else
+			ret = dma_buf_begin_cpu_access_partial(dmabuf,
+							       direction,
+							       sync_p.offset,
+							       sync_p.len);
+
 		return ret;
 	default:
 		return -ENOTTY;
@@ -846,6 +990,75 @@ int dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 }
 EXPORT_SYMBOL_GPL(dma_buf_end_cpu_access);
 
+/**
+ * dma_buf_begin_cpu_access_partial - Ranged variant of
+ * dma_buf_begin_cpu_access(). Coherency is only guaranteed for the @len
+ * bytes at @offset, which lets exporters skip cache maintenance for the
+ * rest of the buffer.
+ * @dmabuf:	[in]	buffer to prepare cpu access for.
+ * @direction:	[in]	direction of the cpu access.
+ * @offset:	[in]	start of the accessed range in bytes.
+ * @len:	[in]	length of the accessed range in bytes.
+ *
+ * Exporters without &dma_buf_ops.begin_cpu_access_partial get the whole
+ * buffer prepared. Must be paired with dma_buf_end_cpu_access_partial()
+ * for the same range.
+ *
+ * Can return negative error values, returns 0 on success.
+ */
+int dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
+				     enum dma_data_direction direction,
+				     unsigned long offset, unsigned long len)
+{
+	int ret = 0;
+
+	if (WARN_ON(!dmabuf))
+		return -EINVAL;
+
+	if (dmabuf->ops->begin_cpu_access_partial)
+		ret = dmabuf->ops->begin_cpu_access_partial(dmabuf, direction,
+							    offset, len);
+	else if (dmabuf->ops->begin_cpu_access)
+		ret = dmabuf->ops->begin_cpu_access(dmabuf, direction);
+
+	if (ret == 0)
+		ret = __dma_buf_begin_cpu_access(dmabuf, direction);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dma_buf_begin_cpu_access_partial);
+
+/**
+ * dma_buf_end_cpu_access_partial - Ranged variant of
+ * dma_buf_end_cpu_access().
+ * @dmabuf:	[in]	buffer to complete cpu access for.
+ * @direction:	[in]	direction of the cpu access.
+ * @offset:	[in]	start of the accessed range in bytes.
+ * @len:	[in]	length of the accessed range in bytes.
+ *
+ * This terminates CPU access started with
+ * dma_buf_begin_cpu_access_partial().
+ *
+ * Can return negative error values, returns 0 on success.
+ */
+int dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
+				   enum dma_data_direction direction,
+				   unsigned long offset, unsigned long len)
+{
+	int ret = 0;
+
+	WARN_ON(!dmabuf);
+
+	if (dmabuf->ops->end_cpu_access_partial)
+		ret = dmabuf->ops->end_cpu_access_partial(dmabuf, direction,
+							  offset, len);
+	else if (dmabuf->ops->end_cpu_access)
+		ret = dmabuf->ops->end_cpu_access(dmabuf, direction);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dma_buf_end_cpu_access_partial);
+
 /**
  * dma_buf_kmap - Map a page of the buffer object into kernel address space. The
  * same restrictions as for kmap and friends apply.
@@ -21,10 +21,12 @@
 #include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/uaccess.h>
 #include <linux/anon_inodes.h>
 #include <linux/sync_file.h>
 #include <uapi/linux/sync_file.h>
+#include <uapi/linux/sync_file_batch.h>
 
 static const struct file_operations sync_file_fops;
 
@@ -300,6 +302,93 @@ static struct sync_file *sync_file_merge(const char *name, struct sync_file *a,
 
 }
 
+static int fence_context_cmp(const void *a, const void *b)
+{
+	const struct dma_fence *fa = *(const struct dma_fence **)a;
+	const struct dma_fence *fb = *(const struct dma_fence **)b;
+
+	if (fa->context < fb->context)
+		return -1;
+	return fa->context > fb->context;
+}
+
+/**
+ * sync_file_merge_array() - merge any number of sync_files
+ * @name:	name of new fence
+ * @files:	sync_files to merge
+ * @num_files:	number of entries in @files
+ *
+ * Creates a new sync_file which contains copies of all the fences in
+ * @files, keeping only the latest fence of each context. Unlike chained
+ * sync_file_merge() calls this needs a single allocation and an
+ * O(n log n) sort rather than one merge and reallocation per file.
+ * Returns the new merged sync_file or NULL in case of error.
+ */
+static struct sync_file *sync_file_merge_array(const char *name,
+					       struct sync_file **files,
+					       int num_files)
+{
+	struct sync_file *sync_file;
+	struct dma_fence **fences, **src;
+	int i, j, n, num_fences = 0;
+
+	for (i = 0; i < num_files; i++) {
+		get_fences(files[i], &n);
+		if (num_fences > INT_MAX - n)
+			return NULL;
+		num_fences += n;
+	}
+
+	sync_file = sync_file_alloc();
+	if (!sync_file)
+		return NULL;
+
+	fences = kcalloc(num_fences, sizeof(*fences), GFP_KERNEL);
+	if (!fences)
+		goto err;
+
+	for (i = j = 0; i < num_files; i++) {
+		src = get_fences(files[i], &n);
+		memcpy(&fences[j], src, n * sizeof(*fences));
+		j += n;
+	}
+
+	sort(fences, num_fences, sizeof(*fences), fence_context_cmp, NULL);
+
+	/* keep the latest fence of each context, as sync_file_merge() does */
+	for (i = 0, j = 1; j < num_fences; j++) {
+		if (fences[j]->context != fences[i]->context)
+			fences[++i] = fences[j];
+		else if (fences[j]->seqno - fences[i]->seqno <= INT_MAX)
+			fences[i] = fences[j];
+	}
+	num_fences = i + 1;
+
+	for (i = j = 0; j < num_fences; j++)
+		add_fence(fences, &i, fences[j]);
+
+	if (i == 0)
+		fences[i++] = dma_fence_get(fences[0]);
+
+	/*
+	 * The array may be larger than needed, dma_fence_array only
+	 * looks at the first i entries, so skip the krealloc().
+	 */
+	if (sync_file_set_fence(sync_file, fences, i) < 0) {
+		while (i--)
+			dma_fence_put(fences[i]);
+		kfree(fences);
+		goto err;
+	}
+
+	strlcpy(sync_file->user_name, name, sizeof(sync_file->user_name));
+	return sync_file;
+
+err:
+	fput(sync_file->file);
+	return NULL;
+}
+
 static int sync_file_release(struct inode *inode, struct file *file)
 {
 	struct sync_file *sync_file = file->private_data;
@@ -383,6 +472,168 @@ static long sync_file_ioctl_merge(struct sync_file *sync_file,
 	return err;
 }
 
+/*
+ * Look up the @num_fds fds at @ufds. The returned array holds @sync_file
+ * in slot 0 followed by a referenced sync_file per fd, and must be
+ * released with sync_file_put_array().
+ */
+static struct sync_file **sync_file_fdget_array(struct sync_file *sync_file,
+						u64 ufds, u32 num_fds)
+{
+	struct sync_file **files;
+	s32 *fds;
+	u32 i;
+
+	if (!num_fds || num_fds > SYNC_BATCH_MAX_FDS)
+		return ERR_PTR(-EINVAL);
+
+	fds = memdup_user(u64_to_user_ptr(ufds), num_fds * sizeof(*fds));
+	if (IS_ERR(fds))
+		return ERR_CAST(fds);
+
+	files = kcalloc(num_fds + 1, sizeof(*files), GFP_KERNEL);
+	if (!files) {
+		files = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+
+	files[0] = sync_file;
+	for (i = 0; i < num_fds; i++) {
+		files[i + 1] = sync_file_fdget(fds[i]);
+		if (!files[i + 1]) {
+			while (i--)
+				fput(files[i + 1]->file);
+			kfree(files);
+			files = ERR_PTR(-ENOENT);
+			goto out;
+		}
+	}
+
+out:
+	kfree(fds);
+	return files;
+}
+
+static void sync_file_put_array(struct sync_file **files, u32 num_fds)
+{
+	u32 i;
+
+	for (i = 1; i <= num_fds; i++)
+		fput(files[i]->file);
+	kfree(files);
+}
+
+static long sync_file_ioctl_merge_batch(struct sync_file *sync_file,
+					unsigned long arg)
+{
+	int fd = get_unused_fd_flags(O_CLOEXEC);
+	int err;
+	struct sync_file **files, *merged;
+	struct sync_merge_batch_data data;
+
+	if (fd < 0)
+		return fd;
+
+	if (copy_from_user(&data, (void __user *)arg, sizeof(data))) {
+		err = -EFAULT;
+		goto err_put_fd;
+	}
+
+	if (data.flags || data.pad) {
+		err = -EINVAL;
+		goto err_put_fd;
+	}
+
+	files = sync_file_fdget_array(sync_file, data.fds, data.num_fds);
+	if (IS_ERR(files)) {
+		err = PTR_ERR(files);
+		goto err_put_fd;
+	}
+
+	data.name[sizeof(data.name) - 1] = '\0';
+	merged = sync_file_merge_array(data.name, files, data.num_fds + 1);
+	sync_file_put_array(files, data.num_fds);
+	if (!merged) {
+		err = -ENOMEM;
+		goto err_put_fd;
+	}
+
+	data.fence = fd;
+	if (copy_to_user((void __user *)arg, &data, sizeof(data))) {
+		err = -EFAULT;
+		goto err_put_merged;
+	}
+
+	fd_install(fd, merged->file);
+	return 0;
+
+err_put_merged:
+	fput(merged->file);
+
+err_put_fd:
+	put_unused_fd(fd);
+	return err;
+}
+
+static long sync_file_ioctl_wait(struct sync_file *sync_file,
+				 unsigned long arg)
+{
+	struct sync_wait_data data;
+	struct sync_file **files;
+	struct dma_fence **fences;
+	signed long timeout, ret;
+	u32 i, num;
+
+	if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+		return -EFAULT;
+
+	if ((data.flags & ~SYNC_WAIT_ANY) || data.pad)
+		return -EINVAL;
+
+	files = sync_file_fdget_array(sync_file, data.fds, data.num_fds);
+	if (IS_ERR(files))
+		return PTR_ERR(files);
+
+	num = data.num_fds + 1;
+	fences = kcalloc(num, sizeof(*fences), GFP_KERNEL);
+	if (!fences) {
+		ret = -ENOMEM;
+		goto out_put_files;
+	}
+
+	for (i = 0; i < num; i++)
+		fences[i] = files[i]->fence;
+
+	if (data.timeout_ns < 0)
+		timeout = MAX_SCHEDULE_TIMEOUT;
+	else
+		timeout = min_t(u64, nsecs_to_jiffies64(data.timeout_ns),
+				MAX_SCHEDULE_TIMEOUT - 1);
+
+	if (data.flags & SYNC_WAIT_ANY) {
+		ret = dma_fence_wait_any_timeout(fences, num, true, timeout,
+						 &data.index);
+	} else {
+		data.index = 0;
+		for (i = 0, ret = 1; i < num && ret > 0; i++) {
+			ret = dma_fence_wait_timeout(fences[i], true, timeout);
+			if (ret > 0)
+				timeout = ret;
+		}
+	}
+
+	if (ret == 0)
+		ret = -ETIME;
+	else if (ret > 0)
+		ret = copy_to_user((void __user *)arg, &data, sizeof(data)) ?
+		      -EFAULT : 0;
+
+	kfree(fences);
+out_put_files:
+	sync_file_put_array(files, data.num_fds);
+	return ret;
+}
+
 static int sync_fill_fence_info(struct dma_fence *fence,
 				 struct sync_fence_info *info)
 {
@@ -479,6 +730,12 @@ static long sync_file_ioctl(struct file *file, unsigned int cmd,
 	case SYNC_IOC_FILE_INFO:
 		return sync_file_ioctl_fence_info(sync_file, arg);
 
+	case SYNC_IOC_MERGE_BATCH:
+		return sync_file_ioctl_merge_batch(sync_file, arg);
+
+	case SYNC_IOC_WAIT:
+		return sync_file_ioctl_wait(sync_file, arg);
+
 	default:
 		return -ENOTTY;
 	}
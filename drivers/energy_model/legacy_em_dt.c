@@ -58,6 +58,38 @@ static int get_power(unsigned long *mW, unsigned long *KHz, int cpu)
 	return 0;
 }
 
+/*
+ * The cluster costs of the legacy binding list the power of the cluster in
+ * each of its idle states, from the shallowest to the deepest one: the
+ * difference is what the cluster costs whenever it is awake.
+ */
+static void em_dt_set_idle_cost(struct device_node *cn, int cpu)
+{
+	const struct property *prop;
+	struct device_node *cp;
+	unsigned long idle, off;
+	int nr;
+
+	cp = of_parse_phandle(cn, "sched-energy-costs", 1);
+	if (!cp)
+		return;
+
+	prop = of_find_property(cp, "idle-cost-data", NULL);
+	if (!prop || !prop->value)
+		goto put;
+
+	nr = prop->length / sizeof(u32);
+	if (nr < 2)
+		goto put;
+
+	idle = be32_to_cpup(prop->value);
+	off = be32_to_cpup((const __be32 *)prop->value + nr - 1);
+	if (idle > off)
+		em_pd_set_idle_cost(em_cpu_get(cpu), idle - off, 0);
+put:
+	of_node_put(cp);
+}
+
 static int init_em_dt_callback(struct notifier_block *nb, unsigned long val,
 			       void *data)
 {
@@ -146,7 +178,8 @@ static int init_em_dt_callback(struct notifier_block *nb, unsigned long val,
 	}
 
 	pr_info("Registering EM of %*pbl\n", cpumask_pr_args(policy->cpus));
-	em_register_perf_domain(policy->cpus, nstates, &em_cb);
+	if (!em_register_perf_domain(policy->cpus, nstates, &em_cb))
+		em_dt_set_idle_cost(cn, cpu);
 
 	/* Finish the work when all possible CPUs have been registered. */
 	cpumask_andnot(cpus_to_visit, cpus_to_visit, policy->cpus);
@@ -184,6 +184,9 @@ int etnaviv_sched_init(struct etnaviv_gpu *gpu)
 	if (ret)
 		return ret;
 
+	/* etnaviv_sched_dependency() hands out each fence only once */
+	gpu->sched.batch_deps = true;
+
 	return 0;
 }
 
@@ -42,8 +42,16 @@
  *    the hardware.
  *
  * The jobs in a entity are always scheduled in the order that they were pushed.
+ *
+ * With the sched_policy=1 module parameter, the entities of all run queues
+ * but the kernel one are selected by weighted fair queueing instead: each
+ * entity is charged the GPU time of its jobs, scaled down by the weight of
+ * its priority, and the ready entity with the least charged time runs
+ * next.  An entity left waiting for longer than aging_ms runs next
+ * regardless, so that no entity starves.
  */
 
+#include <linux/dma-fence-array.h>
 #include <linux/kthread.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
@@ -58,6 +66,28 @@
 #define to_drm_sched_job(sched_job)		\
 		container_of((sched_job), struct drm_sched_job, queue_node)
 
+#define DRM_SCHED_POLICY_RR	0
+#define DRM_SCHED_POLICY_FAIR	1
+
+static int drm_sched_policy = DRM_SCHED_POLICY_RR;
+module_param_named(sched_policy, drm_sched_policy, int, 0644);
+MODULE_PARM_DESC(sched_policy, "Entity selection (0 = round robin per priority (default), 1 = weighted fair with aging)");
+
+static unsigned int drm_sched_aging_ms = 100;
+module_param_named(aging_ms, drm_sched_aging_ms, uint, 0644);
+MODULE_PARM_DESC(aging_ms, "Longest time a ready entity waits with sched_policy=1 (0 = no aging)");
+
+/* Cost charged for a job until jobs of its entity have been timed */
+#define DRM_SCHED_MIN_JOB_NS	(100 * NSEC_PER_USEC)
+
+static const unsigned int drm_sched_weights[DRM_SCHED_PRIORITY_MAX] = {
+	[DRM_SCHED_PRIORITY_LOW]	= 512,
+	[DRM_SCHED_PRIORITY_NORMAL]	= 1024,
+	[DRM_SCHED_PRIORITY_HIGH_SW]	= 2048,
+	[DRM_SCHED_PRIORITY_HIGH_HW]	= 4096,
+	[DRM_SCHED_PRIORITY_KERNEL]	= 4096,
+};
+
 static bool drm_sched_entity_is_ready(struct drm_sched_entity *entity);
 static void drm_sched_wakeup(struct drm_gpu_scheduler *sched);
 static void drm_sched_process_job(struct dma_fence *f, struct dma_fence_cb *cb);
@@ -89,10 +119,17 @@ static void drm_sched_rq_init(struct drm_gpu_scheduler *sched,
 static void drm_sched_rq_add_entity(struct drm_sched_rq *rq,
 				    struct drm_sched_entity *entity)
 {
-	if (!list_empty(&entity->list))
-		return;
+	u64 min_vruntime = atomic64_read(&rq->sched->min_vruntime);
+
 	spin_lock(&rq->lock);
-	list_add_tail(&entity->list, &rq->entities);
+	/*
+	 * The entity was idle, don't let it make up for that time at the
+	 * expense of the others, nor count it as waiting.
+	 */
+	entity->vruntime = max(entity->vruntime, min_vruntime);
+	entity->last_served = jiffies;
+	if (list_empty(&entity->list))
+		list_add_tail(&entity->list, &rq->entities);
 	spin_unlock(&rq->lock);
 }
 
@@ -158,6 +195,53 @@ drm_sched_rq_select_entity(struct drm_sched_rq *rq)
 	return NULL;
 }
 
+/**
+ * drm_sched_select_entity_fair - Select an entity by weighted fair queueing
+ *
+ * @sched: scheduler instance
+ *
+ * Looks at the run queues of all priorities but the kernel one, and picks
+ * the ready entity which waited the longest beyond the aging time, or else
+ * the ready entity with the least charged time.
+ *
+ * Returns the entity or NULL if none is ready.
+ */
+static struct drm_sched_entity *
+drm_sched_select_entity_fair(struct drm_gpu_scheduler *sched)
+{
+	unsigned long aging = msecs_to_jiffies(drm_sched_aging_ms);
+	struct drm_sched_entity *entity, *best = NULL, *oldest = NULL;
+	int i;
+
+	for (i = DRM_SCHED_PRIORITY_MIN; i < DRM_SCHED_PRIORITY_KERNEL; i++) {
+		struct drm_sched_rq *rq = &sched->sched_rq[i];
+
+		spin_lock(&rq->lock);
+		list_for_each_entry(entity, &rq->entities, list) {
+			if (!drm_sched_entity_is_ready(entity))
+				continue;
+
+			if (aging &&
+			    time_after(jiffies, entity->last_served + aging) &&
+			    (!oldest || time_before(entity->last_served,
+						    oldest->last_served)))
+				oldest = entity;
+
+			if (!best || entity->vruntime < best->vruntime)
+				best = entity;
+		}
+		spin_unlock(&rq->lock);
+	}
+
+	if (oldest)
+		return oldest;
+
+	if (best && best->vruntime > atomic64_read(&sched->min_vruntime))
+		atomic64_set(&sched->min_vruntime, best->vruntime);
+
+	return best;
+}
+
 /**
  * drm_sched_entity_init - Init a context entity used by scheduler when
  * submit to HW ring.
@@ -322,6 +406,8 @@ void drm_sched_entity_fini(struct drm_sched_entity *entity)
 			dma_fence_put(entity->dependency);
 			entity->dependency = NULL;
 		}
+		while (entity->num_deps)
+			dma_fence_put(entity->deps[--entity->num_deps]);
 
 		while ((job = to_drm_sched_job(spsc_queue_pop(&entity->job_queue)))) {
 			struct drm_sched_fence *s_fence = job->s_fence;
@@ -433,10 +519,21 @@ bool drm_sched_dependency_optimized(struct dma_fence* fence,
 }
 EXPORT_SYMBOL(drm_sched_dependency_optimized);
 
-static bool drm_sched_entity_add_dependency_cb(struct drm_sched_entity *entity)
+/**
+ * drm_sched_entity_filter_dep - Find out what is to be waited for of a fence
+ *
+ * @entity: the entity which depends on the fence
+ * @fence: a dependency fence of the job on top of the queue
+ *
+ * Takes over the reference to @fence.
+ *
+ * Returns the fence to wait for, or NULL if there's none to wait for.
+ */
+static struct dma_fence *
+drm_sched_entity_filter_dep(struct drm_sched_entity *entity,
+			    struct dma_fence *fence)
 {
 	struct drm_gpu_scheduler *sched = entity->rq->sched;
-	struct dma_fence * fence = entity->dependency;
 	struct drm_sched_fence *s_fence;
 
 	if (fence->context == entity->fence_context ||
@@ -446,37 +543,156 @@ static bool drm_sched_entity_add_dependency_cb(struct drm_sched_entity *entity)
                  * which belongs to the same entity, we can ignore
                  * fences from ourself
                  */
-		dma_fence_put(entity->dependency);
-		return false;
+		dma_fence_put(fence);
+		return NULL;
 	}
 
 	s_fence = to_drm_sched_fence(fence);
 	if (s_fence && s_fence->sched == sched) {
-
 		/*
 		 * Fence is from the same scheduler, only need to wait for
 		 * it to be scheduled
 		 */
-		fence = dma_fence_get(&s_fence->scheduled);
-		dma_fence_put(entity->dependency);
-		entity->dependency = fence;
-		if (!dma_fence_add_callback(fence, &entity->cb,
-					    drm_sched_entity_clear_dep))
-			return true;
+		dma_fence_get(&s_fence->scheduled);
+		dma_fence_put(fence);
+		fence = &s_fence->scheduled;
+	}
 
-		/* Ignore it when it is already scheduled */
+	if (dma_fence_is_signaled(fence)) {
 		dma_fence_put(fence);
-		return false;
+		return NULL;
+	}
+
+	return fence;
+}
+
+/**
+ * drm_sched_entity_collect_deps - Gather the dependencies of a job
+ *
+ * @entity: scheduler entity
+ * @sched_job: the job on top of the queue of @entity
+ *
+ * Asks the driver for up to DRM_SCHED_DEP_BATCH dependencies of the job,
+ * or one unless the scheduler has batch_deps set, and keeps those still to
+ * be waited for in @entity, so that a single wakeup can resolve all of them.
+ *
+ * Returns false once the job has no dependency left.
+ */
+static bool drm_sched_entity_collect_deps(struct drm_sched_entity *entity,
+					  struct drm_sched_job *sched_job)
+{
+	struct drm_gpu_scheduler *sched = entity->rq->sched;
+	unsigned int max_deps = sched->batch_deps ? DRM_SCHED_DEP_BATCH : 1;
+	struct dma_fence *fence;
+
+	while (entity->num_deps < max_deps) {
+		fence = sched->ops->dependency(sched_job, entity);
+		if (!fence)
+			return entity->num_deps;
+
+		fence = drm_sched_entity_filter_dep(entity, fence);
+		if (fence)
+			entity->deps[entity->num_deps++] = fence;
+	}
+
+	return true;
+}
+
+/**
+ * drm_sched_entity_add_dependency_cb - Wait for the gathered dependencies
+ *
+ * @entity: scheduler entity
+ *
+ * Merges the dependencies gathered in @entity into a fence array and
+ * waits for that.  Should that fail, the dependencies are waited for one
+ * at a time.
+ *
+ * Returns true if the entity has to wait, false if the fence waited for
+ * has already signaled.
+ */
+static bool drm_sched_entity_add_dependency_cb(struct drm_sched_entity *entity)
+{
+	struct drm_gpu_scheduler *sched = entity->rq->sched;
+	unsigned int num_deps = entity->num_deps;
+	struct dma_fence_array *array = NULL;
+	struct drm_sched_fence *s_fence;
+	struct dma_fence **fences;
+	struct dma_fence *fence;
+
+	if (num_deps > 1) {
+		fences = kmemdup(entity->deps, num_deps * sizeof(*fences),
+				 GFP_KERNEL);
+		if (fences) {
+			u64 context = dma_fence_context_alloc(1);
+
+			array = dma_fence_array_create(num_deps, fences,
+						       context, 1, false);
+			if (!array)
+				kfree(fences);
+		}
 	}
 
-	if (!dma_fence_add_callback(entity->dependency, &entity->cb,
-				    drm_sched_entity_wakeup))
+	if (array) {
+		entity->num_deps = 0;
+		fence = &array->base;
+	} else {
+		fence = entity->deps[--entity->num_deps];
+	}
+	entity->dependency = fence;
+
+	/*
+	 * The scheduled fence of a job of the same scheduler is signaled by
+	 * the scheduler thread itself, which doesn't need waking up.
+	 */
+	s_fence = to_drm_sched_fence(fence);
+	if (s_fence && s_fence->sched == sched) {
+		if (!dma_fence_add_callback(fence, &entity->cb,
+					    drm_sched_entity_clear_dep))
+			return true;
+	} else if (!dma_fence_add_callback(fence, &entity->cb,
+					   drm_sched_entity_wakeup)) {
 		return true;
+	}
 
-	dma_fence_put(entity->dependency);
+	/* Ignore it when it has signaled meanwhile */
+	dma_fence_put(fence);
+	entity->dependency = NULL;
 	return false;
 }
 
+/**
+ * drm_sched_entity_charge - Account for a job of an entity
+ *
+ * @entity: scheduler entity
+ *
+ * Times the last job of @entity, if it is done, and charges the entity for
+ * the job about to run, from the average time of its past jobs scaled down
+ * by the weight of its priority.
+ */
+static void drm_sched_entity_charge(struct drm_sched_entity *entity)
+{
+	struct drm_gpu_scheduler *sched = entity->rq->sched;
+	struct dma_fence *last = entity->last_scheduled;
+	unsigned int weight = drm_sched_weights[entity->rq - sched->sched_rq];
+	s64 avg = entity->avg_runtime;
+	u64 cost;
+
+	if (last && test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &last->flags)) {
+		struct drm_sched_fence *s_fence = to_drm_sched_fence(last);
+		s64 ns = ktime_to_ns(ktime_sub(last->timestamp,
+					       s_fence->scheduled.timestamp));
+
+		/* Moving average over the last eight jobs or so */
+		if (ns > 0)
+			entity->avg_runtime = avg + div_s64(ns - avg, 8);
+	}
+
+	cost = max_t(u64, entity->avg_runtime, DRM_SCHED_MIN_JOB_NS);
+	cost *= drm_sched_weights[DRM_SCHED_PRIORITY_NORMAL];
+	entity->vruntime += div_u64(cost, weight);
+	entity->last_served = jiffies;
+}
+
 static struct drm_sched_job *
 drm_sched_entity_pop_job(struct drm_sched_entity *entity)
 {
@@ -487,7 +703,8 @@ drm_sched_entity_pop_job(struct drm_sched_entity *entity)
 	if (!sched_job)
 		return NULL;
 
-	while ((entity->dependency = sched->ops->dependency(sched_job, entity)))
+	while (entity->num_deps ||
+	       drm_sched_entity_collect_deps(entity, sched_job))
 		if (drm_sched_entity_add_dependency_cb(entity))
 			return NULL;
 
@@ -495,6 +712,8 @@ drm_sched_entity_pop_job(struct drm_sched_entity *entity)
 	if (entity->guilty && atomic_read(entity->guilty))
 		dma_fence_set_error(&sched_job->s_fence->finished, -ECANCELED);
 
+	drm_sched_entity_charge(entity);
+
 	dma_fence_put(entity->last_scheduled);
 	entity->last_scheduled = dma_fence_get(&sched_job->s_fence->finished);
 
@@ -787,6 +1006,14 @@ drm_sched_select_entity(struct drm_gpu_scheduler *sched)
 	if (!drm_sched_ready(sched))
 		return NULL;
 
+	if (drm_sched_policy == DRM_SCHED_POLICY_FAIR) {
+		entity = drm_sched_rq_select_entity(
+				&sched->sched_rq[DRM_SCHED_PRIORITY_KERNEL]);
+		if (!entity)
+			entity = drm_sched_select_entity_fair(sched);
+		return entity;
+	}
+
 	/* Kernel run queue has higher priority than normal run queue*/
 	for (i = DRM_SCHED_PRIORITY_MAX - 1; i >= DRM_SCHED_PRIORITY_MIN; i--) {
 		entity = drm_sched_rq_select_entity(&sched->sched_rq[i]);
@@ -922,6 +1149,7 @@ int drm_sched_init(struct drm_gpu_scheduler *sched,
 	sched->name = name;
 	sched->timeout = timeout;
 	sched->hang_limit = hang_limit;
+	sched->batch_deps = false;
 	for (i = DRM_SCHED_PRIORITY_MIN; i < DRM_SCHED_PRIORITY_MAX; i++)
 		drm_sched_rq_init(sched, &sched->sched_rq[i]);
 
@@ -931,6 +1159,7 @@ int drm_sched_init(struct drm_gpu_scheduler *sched,
 	spin_lock_init(&sched->job_list_lock);
 	atomic_set(&sched->hw_rq_count, 0);
 	atomic64_set(&sched->job_id_count, 0);
+	atomic64_set(&sched->min_vruntime, 0);
 
 	/* Each scheduler will run on a seperate kernel thread */
 	sched->thread = kthread_run(drm_sched_main, sched, sched->name);
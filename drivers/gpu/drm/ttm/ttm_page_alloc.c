@@ -65,6 +65,7 @@
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @nid: NUMA node the pages of the pool are on.
  */
 struct ttm_page_pool {
 	spinlock_t		lock;
@@ -76,6 +77,7 @@ struct ttm_page_pool {
 	unsigned long		nfrees;
 	unsigned long		nrefills;
 	unsigned int		order;
+	int			nid;
 };
 
 /**
@@ -103,24 +105,15 @@ struct ttm_pool_opts {
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
  *
- * @pools: All pool objects in use.
+ * @pools: All pool objects in use, NUM_POOLS for each node: wc, uc,
+ * wc dma32, uc dma32, wc huge and uc huge.
  **/
 struct ttm_pool_manager {
 	struct kobject		kobj;
 	struct shrinker		mm_shrink;
 	struct ttm_pool_opts	options;
 
-	union {
-		struct ttm_page_pool	pools[NUM_POOLS];
-		struct {
-			struct ttm_page_pool	wc_pool;
-			struct ttm_page_pool	uc_pool;
-			struct ttm_page_pool	wc_pool_dma32;
-			struct ttm_page_pool	uc_pool_dma32;
-			struct ttm_page_pool	wc_pool_huge;
-			struct ttm_page_pool	uc_pool_huge;
-		} ;
-	};
+	struct ttm_page_pool	pools[];
 };
 
 static struct attribute ttm_page_pool_max = {
@@ -216,10 +209,14 @@ static struct kobj_type ttm_pool_kobj_type = {
 
 static struct ttm_pool_manager *_manager;
 
+#define ttm_node_pools(nid)	(&_manager->pools[(nid) * NUM_POOLS])
+
 /**
- * Select the right pool or requested caching state and ttm flags. */
+ * Select the right pool or requested caching state and ttm flags, on the
+ * given node. */
 static struct ttm_page_pool *ttm_get_pool(int flags, bool huge,
-					  enum ttm_caching_state cstate)
+					  enum ttm_caching_state cstate,
+					  int nid)
 {
 	int pool_index;
 
@@ -240,7 +237,7 @@ static struct ttm_page_pool *ttm_get_pool(int flags, bool huge,
 		pool_index |= 0x4;
 	}
 
-	return &_manager->pools[pool_index];
+	return &ttm_node_pools(nid)[pool_index];
 }
 
 /* set memory back to wb and free the pages. */
@@ -388,15 +385,21 @@ ttm_pool_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 	if (!mutex_trylock(&lock))
 		return SHRINK_STOP;
 	pool_offset = ++start_pool % NUM_POOLS;
-	/* select start pool in round robin fashion */
-	for (i = 0; i < NUM_POOLS; ++i) {
+	/*
+	 * select start pool in round robin fashion, and only break up huge
+	 * pages once the pools of single pages are empty
+	 */
+	for (i = 0; i < 2 * NUM_POOLS; ++i) {
 		unsigned nr_free = shrink_pages;
 		unsigned page_nr;
 
 		if (shrink_pages == 0)
 			break;
 
-		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		pool = &ttm_node_pools(sc->nid)[(i + pool_offset) % NUM_POOLS];
+		if (!pool->order != (i < NUM_POOLS))
+			continue;
+
 		page_nr = (1 << pool->order);
 		/* OK to use static buffer since global mutex is held. */
 		nr_free_pool = roundup(nr_free, page_nr) >> pool->order;
@@ -419,7 +422,7 @@ ttm_pool_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 	struct ttm_page_pool *pool;
 
 	for (i = 0; i < NUM_POOLS; ++i) {
-		pool = &_manager->pools[i];
+		pool = &ttm_node_pools(sc->nid)[i];
 		count += (pool->npages << pool->order);
 	}
 
@@ -431,6 +434,9 @@ static int ttm_pool_mm_shrink_init(struct ttm_pool_manager *manager)
 	manager->mm_shrink.count_objects = ttm_pool_shrink_count;
 	manager->mm_shrink.scan_objects = ttm_pool_shrink_scan;
 	manager->mm_shrink.seeks = 1;
+	/* free a whole caching change worth of pages per call */
+	manager->mm_shrink.batch = NUM_PAGES_TO_ALLOC;
+	manager->mm_shrink.flags = SHRINKER_NUMA_AWARE;
 	return register_shrinker(&manager->mm_shrink);
 }
 
@@ -479,14 +485,14 @@ static void ttm_handle_caching_state_failure(struct list_head *pages,
 }
 
 /**
- * Allocate new pages with correct caching.
+ * Allocate new pages with correct caching, preferably on node nid.
  *
  * This function is reentrant if caller updates count depending on number of
  * pages returned in pages array.
  */
 static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 			       int ttm_flags, enum ttm_caching_state cstate,
-			       unsigned count, unsigned order)
+			       unsigned count, unsigned order, int nid)
 {
 	struct page **caching_array;
 	struct page *p;
@@ -505,7 +511,7 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 	}
 
 	for (i = 0, cpages = 0; i < count; ++i) {
-		p = alloc_pages(gfp_flags, order);
+		p = alloc_pages_node(nid, gfp_flags, order);
 
 		if (!p) {
 			pr_debug("Unable to get page %u\n", i);
@@ -600,7 +606,7 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool, int ttm_flags,
 
 		INIT_LIST_HEAD(&new_pages);
 		r = ttm_alloc_new_pages(&new_pages, pool->gfp_flags, ttm_flags,
-					cstate, alloc_size, 0);
+					cstate, alloc_size, 0, pool->nid);
 		spin_lock_irqsave(&pool->lock, *irq_flags);
 
 		if (!r) {
@@ -698,20 +704,42 @@ static int ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 		 * multiple requests in parallel.
 		 **/
 		r = ttm_alloc_new_pages(pages, gfp_flags, ttm_flags, cstate,
-					count, order);
+					count, order, pool->nid);
 	}
 
 	return r;
 }
 
-/* Put all pages in pages list to correct pool to wait for reuse */
+/*
+ * Unlock a pool pages were put into, and free what goes over max_size pages
+ * but at least min_free pages.
+ */
+static void ttm_page_pool_put_unlock(struct ttm_page_pool *pool,
+				     unsigned long irq_flags,
+				     unsigned max_size, unsigned min_free)
+{
+	unsigned n2free = 0;
+
+	if (pool->npages > max_size)
+		n2free = max(pool->npages - max_size, min_free);
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	if (n2free)
+		ttm_page_pool_free(pool, n2free, false);
+}
+
+/*
+ * Put all pages in pages list to correct pool to wait for reuse, the pool
+ * of the node of each page
+ */
 static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 			  enum ttm_caching_state cstate)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, false, cstate);
+	struct ttm_page_pool *pool = ttm_get_pool(flags, false, cstate, 0);
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
-	struct ttm_page_pool *huge = ttm_get_pool(flags, true, cstate);
+	struct ttm_page_pool *huge = ttm_get_pool(flags, true, cstate, 0);
 #endif
+	unsigned max_size = _manager->options.max_size;
+	struct ttm_page_pool *node_pool;
 	unsigned long irq_flags;
 	unsigned i;
 
@@ -756,9 +784,6 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 	i = 0;
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	if (huge) {
-		unsigned max_size, n2free;
-
-		spin_lock_irqsave(&huge->lock, irq_flags);
 		while (i < npages) {
 			struct page *p = pages[i];
 			unsigned j;
@@ -773,29 +798,40 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 			if (j != HPAGE_PMD_NR)
 				break;
 
-			list_add_tail(&pages[i]->lru, &huge->list);
+			node_pool = ttm_get_pool(flags, true, cstate,
+						 page_to_nid(pages[i]));
+			spin_lock_irqsave(&node_pool->lock, irq_flags);
+			list_add_tail(&pages[i]->lru, &node_pool->list);
+			node_pool->npages++;
+			/* Check that we don't go over the pool limit */
+			ttm_page_pool_put_unlock(node_pool, irq_flags,
+						 max_size / HPAGE_PMD_NR, 0);
 
 			for (j = 0; j < HPAGE_PMD_NR; ++j)
 				pages[i++] = NULL;
-			huge->npages++;
 		}
-
-		/* Check that we don't go over the pool limit */
-		max_size = _manager->options.max_size;
-		max_size /= HPAGE_PMD_NR;
-		if (huge->npages > max_size)
-			n2free = huge->npages - max_size;
-		else
-			n2free = 0;
-		spin_unlock_irqrestore(&huge->lock, irq_flags);
-		if (n2free)
-			ttm_page_pool_free(huge, n2free, false);
 	}
 #endif
 
-	spin_lock_irqsave(&pool->lock, irq_flags);
+	/* Runs of pages of the same node go in under a single lock */
+	pool = NULL;
 	while (i < npages) {
 		if (pages[i]) {
+			node_pool = ttm_get_pool(flags, false, cstate,
+						 page_to_nid(pages[i]));
+			if (node_pool != pool) {
+				/*
+				 * free at least NUM_PAGES_TO_ALLOC number of
+				 * pages to reduce calls to set_memory_wb
+				 */
+				if (pool)
+					ttm_page_pool_put_unlock(pool,
+						irq_flags, max_size,
+						NUM_PAGES_TO_ALLOC);
+				pool = node_pool;
+				spin_lock_irqsave(&pool->lock, irq_flags);
+			}
+
 			if (page_count(pages[i]) != 1)
 				pr_err("Erroneous page count. Leaking pages.\n");
 			list_add_tail(&pages[i]->lru, &pool->list);
@@ -804,18 +840,9 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 		}
 		++i;
 	}
-	/* Check that we don't go over the pool limit */
-	npages = 0;
-	if (pool->npages > _manager->options.max_size) {
-		npages = pool->npages - _manager->options.max_size;
-		/* free at least NUM_PAGES_TO_ALLOC number of pages
-		 * to reduce calls to set_memory_wb */
-		if (npages < NUM_PAGES_TO_ALLOC)
-			npages = NUM_PAGES_TO_ALLOC;
-	}
-	spin_unlock_irqrestore(&pool->lock, irq_flags);
-	if (npages)
-		ttm_page_pool_free(pool, npages, false);
+	if (pool)
+		ttm_page_pool_put_unlock(pool, irq_flags, max_size,
+					 NUM_PAGES_TO_ALLOC);
 }
 
 /*
@@ -825,9 +852,10 @@ static void ttm_put_pages(struct page **pages, unsigned npages, int flags,
 static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 			 enum ttm_caching_state cstate)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, false, cstate);
+	int nid = numa_node_id();
+	struct ttm_page_pool *pool = ttm_get_pool(flags, false, cstate, nid);
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
-	struct ttm_page_pool *huge = ttm_get_pool(flags, true, cstate);
+	struct ttm_page_pool *huge = ttm_get_pool(flags, true, cstate, nid);
 #endif
 	struct list_head plist;
 	struct page *p = NULL;
@@ -939,7 +967,7 @@ static int ttm_get_pages(struct page **pages, unsigned npages, int flags,
 }
 
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
-		char *name, unsigned int order)
+		char *name, unsigned int order, int nid)
 {
 	spin_lock_init(&pool->lock);
 	pool->fill_lock = false;
@@ -948,46 +976,51 @@ static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, gfp_t flags,
 	pool->gfp_flags = flags;
 	pool->name = name;
 	pool->order = order;
+	pool->nid = nid;
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 {
-	int ret;
+	int ret, nid;
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	unsigned order = HPAGE_PMD_ORDER;
 #else
 	unsigned order = 0;
 #endif
+	gfp_t huge_flags = (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
+			    __GFP_KSWAPD_RECLAIM) &
+			   ~(__GFP_MOVABLE | __GFP_COMP);
 
 	WARN_ON(_manager);
 
 	pr_info("Initializing pool allocator\n");
 
-	_manager = kzalloc(sizeof(*_manager), GFP_KERNEL);
+	_manager = kzalloc(struct_size(_manager, pools,
+				       NUM_POOLS * nr_node_ids), GFP_KERNEL);
 	if (!_manager)
 		return -ENOMEM;
 
-	ttm_page_pool_init_locked(&_manager->wc_pool, GFP_HIGHUSER, "wc", 0);
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		struct ttm_page_pool *pools = ttm_node_pools(nid);
 
-	ttm_page_pool_init_locked(&_manager->uc_pool, GFP_HIGHUSER, "uc", 0);
+		ttm_page_pool_init_locked(&pools[0], GFP_HIGHUSER, "wc", 0,
+					  nid);
 
-	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "wc dma", 0);
+		ttm_page_pool_init_locked(&pools[1], GFP_HIGHUSER, "uc", 0,
+					  nid);
 
-	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "uc dma", 0);
+		ttm_page_pool_init_locked(&pools[2], GFP_USER | GFP_DMA32,
+					  "wc dma", 0, nid);
 
-	ttm_page_pool_init_locked(&_manager->wc_pool_huge,
-				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
-				   __GFP_KSWAPD_RECLAIM) &
-				  ~(__GFP_MOVABLE | __GFP_COMP),
-				  "wc huge", order);
+		ttm_page_pool_init_locked(&pools[3], GFP_USER | GFP_DMA32,
+					  "uc dma", 0, nid);
 
-	ttm_page_pool_init_locked(&_manager->uc_pool_huge,
-				  (GFP_TRANSHUGE_LIGHT | __GFP_NORETRY |
-				   __GFP_KSWAPD_RECLAIM) &
-				  ~(__GFP_MOVABLE | __GFP_COMP)
-				  , "uc huge", order);
+		ttm_page_pool_init_locked(&pools[4], huge_flags, "wc huge",
+					  order, nid);
+
+		ttm_page_pool_init_locked(&pools[5], huge_flags, "uc huge",
+					  order, nid);
+	}
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
@@ -1017,7 +1050,7 @@ void ttm_page_alloc_fini(void)
 	ttm_pool_mm_shrink_fini(_manager);
 
 	/* OK to use static buffer since global mutex is no longer used. */
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < NUM_POOLS * nr_node_ids; ++i)
 		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES, true);
 
 	kobject_put(&_manager->kobj);
@@ -1169,18 +1202,18 @@ int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 {
 	struct ttm_page_pool *p;
 	unsigned i;
-	char *h[] = {"pool", "refills", "pages freed", "size"};
+	char *h[] = {"pool", "node", "refills", "pages freed", "size"};
 	if (!_manager) {
 		seq_printf(m, "No pool allocator running.\n");
 		return 0;
 	}
-	seq_printf(m, "%7s %12s %13s %8s\n",
-			h[0], h[1], h[2], h[3]);
-	for (i = 0; i < NUM_POOLS; ++i) {
+	seq_printf(m, "%7s %4s %12s %13s %8s\n",
+			h[0], h[1], h[2], h[3], h[4]);
+	for (i = 0; i < NUM_POOLS * nr_node_ids; ++i) {
 		p = &_manager->pools[i];
 
-		seq_printf(m, "%7s %12ld %13ld %8d\n",
-				p->name, p->nrefills,
+		seq_printf(m, "%7s %4d %12ld %13ld %8d\n",
+				p->name, p->nid, p->nrefills,
 				p->nfrees, p->npages);
 	}
 	return 0;
@@ -7,6 +7,7 @@
 #include <linux/coresight.h>
 #include <linux/dma-mapping.h>
 #include <linux/iommu.h>
+#include <linux/perf_event.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include "coresight-catu.h"
@@ -20,6 +21,21 @@ struct etr_flat_buf {
 	size_t		size;
 };
 
+/*
+ * struct etr_perf_buffer - Perf AUX buffer the ETR writes to directly.
+ * @etr_buf:	ETR buffer built over the pages of the AUX buffer.
+ * @head:	Offset in the AUX buffer the ETR starts writing at.
+ * @data_size:	Trace collected in the last run, or the new head of the
+ *		AUX buffer in snapshot mode.
+ * @snapshot:	Perf session is in snapshot (overwrite) mode.
+ */
+struct etr_perf_buffer {
+	struct etr_buf	*etr_buf;
+	unsigned long	head;
+	local_t		data_size;
+	bool		snapshot;
+};
+
 /*
  * The TMC ETR SG has a page size of 4K. The SG table contains pointers
  * to 4KB buffers. However, the OS may use a PAGE_SIZE different from
@@ -855,6 +871,28 @@ static ssize_t tmc_etr_buf_get_data(struct etr_buf *etr_buf,
 	return etr_buf->ops->get_data(etr_buf, (u64)offset, len, bufpp);
 }
 
+/*
+ * tmc_etr_buf_offset_to_hwaddr: Address the ETR writes the byte at @offset
+ * of @etr_buf to, i.e. the value of RRP/RWP that points there.
+ */
+static dma_addr_t tmc_etr_buf_offset_to_hwaddr(struct etr_buf *etr_buf,
+					       unsigned long offset)
+{
+	struct etr_sg_table *etr_table;
+	struct tmc_pages *data_pages;
+
+	switch (etr_buf->mode) {
+	case ETR_MODE_ETR_SG:
+		etr_table = etr_buf->private;
+		data_pages = &etr_table->sg_table->data_pages;
+		return data_pages->daddrs[offset >> PAGE_SHIFT] +
+		       (offset & (PAGE_SIZE - 1));
+	default:
+		/* Flat buffers and the CATU address space are linear */
+		return etr_buf->hwaddr + offset;
+	}
+}
+
 static inline s64
 tmc_etr_buf_insert_barrier_packet(struct etr_buf *etr_buf, u64 offset)
 {
@@ -895,7 +933,12 @@ static void tmc_sync_etr_buf(struct tmc_drvdata *drvdata)
 		tmc_etr_buf_insert_barrier_packet(etr_buf, etr_buf->offset);
 }
 
-static void tmc_etr_enable_hw(struct tmc_drvdata *drvdata)
+/*
+ * __tmc_etr_enable_hw: Start the ETR, with the pointers at @start when they
+ * have to be programmed (see TMC_ETR_SAVE_RESTORE).
+ */
+static void __tmc_etr_enable_hw(struct tmc_drvdata *drvdata,
+				dma_addr_t start)
 {
 	u32 axictl, sts;
 	struct etr_buf *etr_buf = drvdata->etr_buf;
@@ -938,8 +981,8 @@ static void tmc_etr_enable_hw(struct tmc_drvdata *drvdata)
 	 * STS to "not full").
 	 */
 	if (tmc_etr_has_cap(drvdata, TMC_ETR_SAVE_RESTORE)) {
-		tmc_write_rrp(drvdata, etr_buf->hwaddr);
-		tmc_write_rwp(drvdata, etr_buf->hwaddr);
+		tmc_write_rrp(drvdata, start);
+		tmc_write_rwp(drvdata, start);
 		sts = readl_relaxed(drvdata->base + TMC_STS) & ~TMC_STS_FULL;
 		writel_relaxed(sts, drvdata->base + TMC_STS);
 	}
@@ -954,6 +997,11 @@ static void tmc_etr_enable_hw(struct tmc_drvdata *drvdata)
 	CS_LOCK(drvdata->base);
 }
 
+static void tmc_etr_enable_hw(struct tmc_drvdata *drvdata)
+{
+	__tmc_etr_enable_hw(drvdata, drvdata->etr_buf->hwaddr);
+}
+
 /*
  * Return the available trace data in the buffer (starts at etr_buf->offset,
  * limited by etr_buf->len) from @pos, with a maximum limit of @len,
@@ -1087,8 +1135,50 @@ static int tmc_enable_etr_sink_sysfs(struct coresight_device *csdev)
 
 static int tmc_enable_etr_sink_perf(struct coresight_device *csdev)
 {
-	/* We don't support perf mode yet ! */
-	return -EINVAL;
+	int ret = 0;
+	unsigned long flags;
+	struct etr_perf_buffer *etr_perf;
+	struct tmc_drvdata *drvdata = dev_get_drvdata(csdev->dev.parent);
+
+	spin_lock_irqsave(&drvdata->spinlock, flags);
+	if (drvdata->reading) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/*
+	 * In Perf mode there can be only one writer per sink.  There
+	 * is also no need to continue if the ETR is already operated
+	 * from sysFS.
+	 */
+	if (drvdata->mode != CS_MODE_DISABLED) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* Trace of a sysFS session which hasn't been read yet */
+	if (drvdata->etr_buf) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	etr_perf = drvdata->perf_buf;
+	if (!etr_perf) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	drvdata->etr_buf = etr_perf->etr_buf;
+	drvdata->mode = CS_MODE_PERF;
+	__tmc_etr_enable_hw(drvdata,
+			    tmc_etr_buf_offset_to_hwaddr(drvdata->etr_buf,
+							 etr_perf->head));
+out:
+	/* Give up the claim of tmc_set_etr_buffer(), whatever happened */
+	drvdata->perf_buf = NULL;
+	spin_unlock_irqrestore(&drvdata->spinlock, flags);
+
+	return ret;
 }
 
 static int tmc_enable_etr_sink(struct coresight_device *csdev, u32 mode)
@@ -1118,6 +1208,9 @@ static void tmc_disable_etr_sink(struct coresight_device *csdev)
 	/* Disable the TMC only if it needs to */
 	if (drvdata->mode != CS_MODE_DISABLED) {
 		tmc_etr_disable_hw(drvdata);
+		/* The AUX buffer belongs to the perf session, not to us */
+		if (drvdata->mode == CS_MODE_PERF)
+			drvdata->etr_buf = NULL;
 		drvdata->mode = CS_MODE_DISABLED;
 	}
 
@@ -1126,9 +1219,176 @@ static void tmc_disable_etr_sink(struct coresight_device *csdev)
 	dev_info(drvdata->dev, "TMC-ETR disabled\n");
 }
 
+/*
+ * In perf mode the pages of the AUX buffer are the trace buffer of the ETR:
+ * they are mapped through the ETR SG table or the CATU, and the ETR is
+ * started at the head of the AUX buffer so that the trace lands where perf
+ * expects it.  Nothing is copied when a run ends; the trace sitting at the
+ * head is only synced for the CPU and handed out.
+ */
+static void *tmc_alloc_etr_buffer(struct coresight_device *csdev, int cpu,
+				  void **pages, int nr_pages, bool overwrite)
+{
+	int node;
+	struct etr_perf_buffer *etr_perf;
+	struct tmc_drvdata *drvdata = dev_get_drvdata(csdev->dev.parent);
+
+	/*
+	 * Starting at the head needs an ETR which resumes from the pointers
+	 * it is programmed with.  Others always restart at the base of the
+	 * buffer.
+	 */
+	if (!tmc_etr_has_cap(drvdata, TMC_ETR_SAVE_RESTORE))
+		return NULL;
+
+	if (cpu == -1)
+		cpu = smp_processor_id();
+	node = cpu_to_node(cpu);
+
+	etr_perf = kzalloc_node(sizeof(*etr_perf), GFP_KERNEL, node);
+	if (!etr_perf)
+		return NULL;
+
+	/* Fails unless the ETR can use scatter-gather, see tmc_alloc_etr_buf */
+	etr_perf->etr_buf = tmc_alloc_etr_buf(drvdata,
+					      (ssize_t)nr_pages << PAGE_SHIFT,
+					      0, node, pages);
+	if (IS_ERR(etr_perf->etr_buf)) {
+		kfree(etr_perf);
+		return NULL;
+	}
+
+	etr_perf->snapshot = overwrite;
+
+	return etr_perf;
+}
+
+static void tmc_free_etr_buffer(void *config)
+{
+	struct etr_perf_buffer *etr_perf = config;
+
+	tmc_free_etr_buf(etr_perf->etr_buf);
+	kfree(etr_perf);
+}
+
+static int tmc_set_etr_buffer(struct coresight_device *csdev,
+			      struct perf_output_handle *handle,
+			      void *sink_config)
+{
+	int ret = 0;
+	unsigned long flags;
+	struct etr_perf_buffer *etr_perf = sink_config;
+	struct tmc_drvdata *drvdata = dev_get_drvdata(csdev->dev.parent);
+
+	/*
+	 * Claim the sink for this session until tmc_enable_etr_sink_perf()
+	 * picks the buffer up, so that a start on another CPU can't slip
+	 * its own buffer in between.
+	 */
+	spin_lock_irqsave(&drvdata->spinlock, flags);
+	if (drvdata->mode != CS_MODE_DISABLED || drvdata->perf_buf) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	/* wrap head around to the amount of space we have */
+	etr_perf->head = handle->head & (etr_perf->etr_buf->size - 1);
+	local_set(&etr_perf->data_size, 0);
+	drvdata->perf_buf = etr_perf;
+out:
+	spin_unlock_irqrestore(&drvdata->spinlock, flags);
+
+	return ret;
+}
+
+static unsigned long tmc_reset_etr_buffer(struct coresight_device *csdev,
+					  struct perf_output_handle *handle,
+					  void *sink_config)
+{
+	long size = 0;
+	struct etr_perf_buffer *etr_perf = sink_config;
+
+	if (etr_perf) {
+		/*
+		 * In snapshot mode ->data_size holds the new address of the
+		 * ring buffer's head.  The size itself is the whole address
+		 * range since we want the latest information.
+		 */
+		if (etr_perf->snapshot)
+			handle->head = local_xchg(&etr_perf->data_size,
+						  etr_perf->etr_buf->size);
+		size = local_xchg(&etr_perf->data_size, 0);
+	}
+
+	return size;
+}
+
+static void tmc_update_etr_buffer(struct coresight_device *csdev,
+				  struct perf_output_handle *handle,
+				  void *sink_config)
+{
+	bool lost;
+	s64 len;
+	unsigned long flags;
+	struct etr_buf *etr_buf;
+	struct etr_perf_buffer *etr_perf = sink_config;
+	struct tmc_drvdata *drvdata = dev_get_drvdata(csdev->dev.parent);
+
+	if (!etr_perf)
+		return;
+
+	etr_buf = etr_perf->etr_buf;
+
+	spin_lock_irqsave(&drvdata->spinlock, flags);
+
+	/* This shouldn't happen */
+	if (WARN_ON_ONCE(drvdata->mode != CS_MODE_PERF))
+		goto out;
+
+	/* The sink went to another session between set_buffer and enable */
+	if (drvdata->etr_buf != etr_buf)
+		goto out;
+
+	CS_UNLOCK(drvdata->base);
+	tmc_flush_and_stop(drvdata);
+	tmc_sync_etr_buf(drvdata);
+	CS_LOCK(drvdata->base);
+
+	lost = etr_buf->full;
+	len = etr_buf->len;
+
+	if (etr_perf->snapshot) {
+		local_set(&etr_perf->data_size,
+			  (etr_buf->offset + len) & (etr_buf->size - 1));
+	} else {
+		/*
+		 * The ETR went past the space perf gave us, over trace that
+		 * may not have been consumed yet, or round the whole AUX
+		 * buffer so that what sits at the head is no longer the start
+		 * of the run.  Nothing in there can be trusted: report the
+		 * run as lost rather than handing out a scrambled window.
+		 */
+		if (lost || len > handle->size) {
+			len = 0;
+			lost = true;
+		}
+		local_add(len, &etr_perf->data_size);
+	}
+
+	if (lost)
+		perf_aux_output_flag(handle, PERF_AUX_FLAG_TRUNCATED);
+out:
+	spin_unlock_irqrestore(&drvdata->spinlock, flags);
+}
+
 static const struct coresight_ops_sink tmc_etr_sink_ops = {
 	.enable		= tmc_enable_etr_sink,
 	.disable	= tmc_disable_etr_sink,
+	.alloc_buffer	= tmc_alloc_etr_buffer,
+	.free_buffer	= tmc_free_etr_buffer,
+	.set_buffer	= tmc_set_etr_buffer,
+	.reset_buffer	= tmc_reset_etr_buffer,
+	.update_buffer	= tmc_update_etr_buffer,
 };
 
 const struct coresight_ops tmc_etr_cs_ops = {
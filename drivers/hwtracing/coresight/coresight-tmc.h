@@ -130,6 +130,7 @@ enum etr_mode {
 };
 
 struct etr_buf_operations;
+struct etr_perf_buffer;
 
 /**
  * struct etr_buf - Details of the buffer used by ETR
@@ -162,6 +163,7 @@ struct etr_buf {
  * @spinlock:	only one at a time pls.
  * @buf:	Snapshot of the trace data for ETF/ETB.
  * @etr_buf:	details of buffer used in TMC-ETR
+ * @perf_buf:	AUX buffer the next perf run of the TMC-ETR writes to.
  * @len:	size of the available trace for ETF/ETB.
  * @size:	trace buffer size for this TMC (common for all modes).
  * @mode:	how this TMC is being used.
@@ -182,6 +184,7 @@ struct tmc_drvdata {
 		char		*buf;		/* TMC ETB */
 		struct etr_buf	*etr_buf;	/* TMC ETR */
 	};
+	struct etr_perf_buffer	*perf_buf;
 	u32			len;
 	u32			size;
 	u32			mode;
@@ -14,6 +14,7 @@
 #define EVDEV_MINORS		32
 #define EVDEV_MIN_BUFFER_SIZE	64U
 #define EVDEV_BUF_PACKETS	8
+#define EVDEV_READ_BATCH	16
 
 #include <linux/poll.h>
 #include <linux/sched.h>
@@ -572,22 +573,47 @@ static ssize_t evdev_write(struct file *file, const char __user *buffer,
 	return retval;
 }
 
-static int evdev_fetch_next_event(struct evdev_client *client,
-				  struct input_event *event)
+/*
+ * Fetch up to @max events from the client buffer under a single
+ * acquisition of buffer_lock, so that a reader of a high report rate
+ * device does not bounce the lock against evdev_pass_values() for every
+ * event.
+ */
+static unsigned int evdev_fetch_events(struct evdev_client *client,
+				       struct input_event *events,
+				       unsigned int max)
 {
-	int have_event;
+	unsigned int n = 0;
 
 	spin_lock_irq(&client->buffer_lock);
 
-	have_event = client->packet_head != client->tail;
-	if (have_event) {
-		*event = client->buffer[client->tail++];
+	while (n < max && client->packet_head != client->tail) {
+		events[n++] = client->buffer[client->tail++];
 		client->tail &= client->bufsize - 1;
 	}
 
 	spin_unlock_irq(&client->buffer_lock);
 
-	return have_event;
+	return n;
+}
+
+static int evdev_events_to_user(char __user *buffer,
+				const struct input_event *events,
+				unsigned int n)
+{
+	unsigned int i;
+
+	/* Without a compat layout the batch goes out in one copy */
+	if (input_event_size() == sizeof(struct input_event))
+		return copy_to_user(buffer, events, n * sizeof(*events)) ?
+			-EFAULT : 0;
+
+	for (i = 0; i < n; i++)
+		if (input_event_to_user(buffer + i * input_event_size(),
+					&events[i]))
+			return -EFAULT;
+
+	return 0;
 }
 
 static ssize_t evdev_read(struct file *file, char __user *buffer,
@@ -595,7 +621,8 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 {
 	struct evdev_client *client = file->private_data;
 	struct evdev *evdev = client->evdev;
-	struct input_event event;
+	struct input_event events[EVDEV_READ_BATCH];
+	unsigned int n;
 	size_t read = 0;
 	int error;
 
@@ -617,13 +644,17 @@ static ssize_t evdev_read(struct file *file, char __user *buffer,
 		if (count == 0)
 			break;
 
-		while (read + input_event_size() <= count &&
-		       evdev_fetch_next_event(client, &event)) {
+		while (read + input_event_size() <= count) {
+			n = min_t(size_t, (count - read) / input_event_size(),
+				  EVDEV_READ_BATCH);
+			n = evdev_fetch_events(client, events, n);
+			if (!n)
+				break;
 
-			if (input_event_to_user(buffer + read, &event))
+			if (evdev_events_to_user(buffer + read, events, n))
 				return -EFAULT;
 
-			read += input_event_size();
+			read += n * input_event_size();
 		}
 
 		if (read)
@@ -65,6 +65,13 @@
 #define TLB_LOOP_TIMEOUT		1000000	/* 1s! */
 #define TLB_SPIN_COUNT			10
 
+/*
+ * Stage 1 unmaps covering more pages of the smallest size than this
+ * invalidate the whole ASID once at the next sync instead of every page
+ * by VA.
+ */
+#define TLB_INV_ASID_THRESHOLD		512
+
 /* Maximum number of context banks per SMMU */
 #define ARM_SMMU_MAX_CBS		128
 
@@ -249,6 +256,8 @@ struct arm_smmu_domain {
 	enum arm_smmu_domain_stage	stage;
 	struct mutex			init_mutex; /* Protects smmu pointer */
 	spinlock_t			cb_lock; /* Serialises ATS1* ops and TLB syncs */
+	atomic_t			tlb_asid_unmaps;
+	bool				tlb_asid_pending; /* under cb_lock */
 	struct iommu_domain		domain;
 };
 
@@ -430,6 +439,16 @@ static void arm_smmu_tlb_sync_context(void *cookie)
 	unsigned long flags;
 
 	spin_lock_irqsave(&smmu_domain->cb_lock, flags);
+	/*
+	 * Issue the ASID invalidation batched up by large unmaps before the
+	 * sync waits for it; under cb_lock, so nobody else's sync can return
+	 * in between believing their own pages covered.
+	 */
+	if (smmu_domain->tlb_asid_pending) {
+		smmu_domain->tlb_asid_pending = false;
+		writel_relaxed(smmu_domain->cfg.asid,
+			       base + ARM_SMMU_CB_S1_TLBIASID);
+	}
 	__arm_smmu_tlb_sync(smmu, base + ARM_SMMU_CB_TLBSYNC,
 			    base + ARM_SMMU_CB_TLBSTATUS);
 	spin_unlock_irqrestore(&smmu_domain->cb_lock, flags);
@@ -473,6 +492,12 @@ static void arm_smmu_tlb_inv_range_nosync(unsigned long iova, size_t size,
 	if (smmu_domain->smmu->features & ARM_SMMU_FEAT_COHERENT_WALK)
 		wmb();
 
+	if (stage1 && atomic_read(&smmu_domain->tlb_asid_unmaps)) {
+		/* Left to arm_smmu_tlb_sync_context() */
+		WRITE_ONCE(smmu_domain->tlb_asid_pending, true);
+		return;
+	}
+
 	if (stage1) {
 		reg += leaf ? ARM_SMMU_CB_S1_TLBIVAL : ARM_SMMU_CB_S1_TLBIVA;
 
@@ -963,6 +988,7 @@ static struct iommu_domain *arm_smmu_domain_alloc(unsigned type)
 
 	mutex_init(&smmu_domain->init_mutex);
 	spin_lock_init(&smmu_domain->cb_lock);
+	atomic_set(&smmu_domain->tlb_asid_unmaps, 0);
 
 	return &smmu_domain->domain;
 }
@@ -1251,12 +1277,25 @@ static int arm_smmu_map(struct iommu_domain *domain, unsigned long iova,
 static size_t arm_smmu_unmap(struct iommu_domain *domain, unsigned long iova,
 			     size_t size)
 {
-	struct io_pgtable_ops *ops = to_smmu_domain(domain)->pgtbl_ops;
+	struct arm_smmu_domain *smmu_domain = to_smmu_domain(domain);
+	struct io_pgtable_ops *ops = smmu_domain->pgtbl_ops;
+	bool inv_asid;
+	size_t ret;
 
 	if (!ops)
 		return 0;
 
-	return ops->unmap(ops, iova, size);
+	inv_asid = smmu_domain->cfg.cbar != CBAR_TYPE_S2_TRANS &&
+		   (size >> __ffs(domain->pgsize_bitmap)) >
+		   TLB_INV_ASID_THRESHOLD;
+	if (!inv_asid)
+		return ops->unmap(ops, iova, size);
+
+	atomic_inc(&smmu_domain->tlb_asid_unmaps);
+	ret = ops->unmap(ops, iova, size);
+	atomic_dec(&smmu_domain->tlb_asid_unmaps);
+
+	return ret;
 }
 
 static void arm_smmu_iotlb_sync(struct iommu_domain *domain)
@@ -20,6 +20,7 @@
  */
 
 #include <linux/acpi_iort.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/dma-iommu.h>
 #include <linux/gfp.h>
@@ -55,6 +56,11 @@ struct iommu_dma_cookie {
 	};
 	struct list_head		msi_page_list;
 	spinlock_t			msi_lock;
+#ifdef CONFIG_IOMMU_DEBUGFS
+	/* On iommu_dma_cookies once iovad is initialised */
+	struct list_head		stats_list;
+	unsigned int			stats_id;
+#endif
 };
 
 static inline size_t cookie_msi_granule(struct iommu_dma_cookie *cookie)
@@ -82,6 +88,58 @@ int iommu_dma_init(void)
 	return iova_cache_get();
 }
 
+#ifdef CONFIG_IOMMU_DEBUGFS
+static LIST_HEAD(iommu_dma_cookies);
+static DEFINE_MUTEX(iommu_dma_cookies_lock);
+static unsigned int iommu_dma_next_stats_id;
+
+static void iommu_dma_stats_add(struct iommu_dma_cookie *cookie)
+{
+	mutex_lock(&iommu_dma_cookies_lock);
+	cookie->stats_id = iommu_dma_next_stats_id++;
+	list_add_tail(&cookie->stats_list, &iommu_dma_cookies);
+	mutex_unlock(&iommu_dma_cookies_lock);
+}
+
+static void iommu_dma_stats_del(struct iommu_dma_cookie *cookie)
+{
+	mutex_lock(&iommu_dma_cookies_lock);
+	list_del(&cookie->stats_list);
+	mutex_unlock(&iommu_dma_cookies_lock);
+}
+
+/* One line of IOVA allocator statistics per DMA domain */
+static int iova_stats_show(struct seq_file *m, void *unused)
+{
+	struct iommu_dma_cookie *cookie;
+	struct iova_stats stats;
+
+	seq_puts(m, "domain rcache_hits rbtree_allocs rbtree_fails rbtree_frees\n");
+	mutex_lock(&iommu_dma_cookies_lock);
+	list_for_each_entry(cookie, &iommu_dma_cookies, stats_list) {
+		iova_domain_stats(&cookie->iovad, &stats);
+		seq_printf(m, "%u %lu %lu %lu %lu\n", cookie->stats_id,
+			   stats.rcache_hits, stats.rbtree_allocs,
+			   stats.rbtree_fails, stats.rbtree_frees);
+	}
+	mutex_unlock(&iommu_dma_cookies_lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(iova_stats);
+
+static int __init iommu_dma_debugfs_init(void)
+{
+	if (iommu_debugfs_dir)
+		debugfs_create_file("iova_stats", 0400, iommu_debugfs_dir,
+				    NULL, &iova_stats_fops);
+	return 0;
+}
+late_initcall(iommu_dma_debugfs_init);
+#else
+static inline void iommu_dma_stats_add(struct iommu_dma_cookie *cookie) {}
+static inline void iommu_dma_stats_del(struct iommu_dma_cookie *cookie) {}
+#endif
+
 /**
  * iommu_get_dma_cookie - Acquire DMA-API resources for a domain
  * @domain: IOMMU domain to prepare for DMA-API usage
@@ -149,8 +207,10 @@ void iommu_put_dma_cookie(struct iommu_domain *domain)
 	if (!cookie)
 		return;
 
-	if (cookie->type == IOMMU_DMA_IOVA_COOKIE && cookie->iovad.granule)
+	if (cookie->type == IOMMU_DMA_IOVA_COOKIE && cookie->iovad.granule) {
+		iommu_dma_stats_del(cookie);
 		put_iova_domain(&cookie->iovad);
+	}
 
 	list_for_each_entry_safe(msi, tmp, &cookie->msi_page_list, list) {
 		list_del(&msi->list);
@@ -308,6 +368,7 @@ int iommu_dma_init_domain(struct iommu_domain *domain, dma_addr_t base,
 	}
 
 	init_iova_domain(iovad, 1UL << order, base_pfn);
+	iommu_dma_stats_add(cookie);
 	if (!dev)
 		return 0;
 
@@ -56,6 +56,8 @@ init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	iovad->granule = granule;
 	iovad->start_pfn = start_pfn;
 	iovad->dma_32bit_pfn = 1UL << (32 - iova_shift(iovad));
+	iovad->max32_alloc_size = iovad->dma_32bit_pfn;
+	memset(&iovad->stats, 0, sizeof(iovad->stats));
 	iovad->flush_cb = NULL;
 	iovad->fq = NULL;
 	iovad->anchor.pfn_lo = iovad->anchor.pfn_hi = IOVA_ANCHOR;
@@ -142,6 +144,10 @@ __cached_rbnode_delete_update(struct iova_domain *iovad, struct iova *free)
 	    free->pfn_lo >= cached_iova->pfn_lo)
 		iovad->cached32_node = rb_next(&free->node);
 
+	/* Freed space below 4GB may fit what failed there last time */
+	if (free->pfn_hi < iovad->dma_32bit_pfn)
+		iovad->max32_alloc_size = iovad->dma_32bit_pfn;
+
 	cached_iova = rb_entry(iovad->cached_node, struct iova, node);
 	if (free->pfn_lo >= cached_iova->pfn_lo)
 		iovad->cached_node = rb_next(&free->node);
@@ -184,12 +190,24 @@ static int __alloc_and_insert_iova_range(struct iova_domain *iovad,
 	unsigned long flags;
 	unsigned long new_pfn;
 	unsigned long align_mask = ~0UL;
+	bool limit32;
 
 	if (size_aligned)
 		align_mask <<= fls_long(size - 1);
 
 	/* Walk the tree backwards */
 	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
+	iovad->stats.rbtree_allocs++;
+
+	/*
+	 * Once the space below 4GB has no room for an allocation of some
+	 * size, don't walk it again for one as large before anything there
+	 * has been freed.
+	 */
+	limit32 = limit_pfn <= iovad->dma_32bit_pfn;
+	if (limit32 && size >= iovad->max32_alloc_size)
+		goto fail;
+
 	curr = __get_cached_rbnode(iovad, limit_pfn);
 	curr_iova = rb_entry(curr, struct iova, node);
 	do {
@@ -201,8 +219,9 @@ static int __alloc_and_insert_iova_range(struct iova_domain *iovad,
 	} while (curr && new_pfn <= curr_iova->pfn_hi);
 
 	if (limit_pfn < size || new_pfn < iovad->start_pfn) {
-		spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
-		return -ENOMEM;
+		if (limit32)
+			iovad->max32_alloc_size = size;
+		goto fail;
 	}
 
 	/* pfn_lo will point to size aligned address if size_aligned is set */
@@ -217,6 +236,11 @@ static int __alloc_and_insert_iova_range(struct iova_domain *iovad,
 
 
 	return 0;
+
+fail:
+	iovad->stats.rbtree_fails++;
+	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
+	return -ENOMEM;
 }
 
 static struct kmem_cache *iova_cache;
@@ -330,6 +354,7 @@ private_find_iova(struct iova_domain *iovad, unsigned long pfn)
 static void private_free_iova(struct iova_domain *iovad, struct iova *iova)
 {
 	assert_spin_locked(&iovad->iova_rbtree_lock);
+	iovad->stats.rbtree_frees++;
 	__cached_rbnode_delete_update(iovad, iova);
 	rb_erase(&iova->node, &iovad->rbroot);
 	free_iova_mem(iova);
@@ -775,6 +800,7 @@ struct iova_cpu_rcache {
 	spinlock_t lock;
 	struct iova_magazine *loaded;
 	struct iova_magazine *prev;
+	unsigned long hits;
 };
 
 static struct iova_magazine *iova_magazine_alloc(gfp_t flags)
@@ -864,6 +890,7 @@ static void init_iova_rcaches(struct iova_domain *iovad)
 		for_each_possible_cpu(cpu) {
 			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
 			spin_lock_init(&cpu_rcache->lock);
+			cpu_rcache->hits = 0;
 			cpu_rcache->loaded = iova_magazine_alloc(GFP_KERNEL);
 			cpu_rcache->prev = iova_magazine_alloc(GFP_KERNEL);
 		}
@@ -968,6 +995,8 @@ static unsigned long __iova_rcache_get(struct iova_rcache *rcache,
 
 	if (has_pfn)
 		iova_pfn = iova_magazine_pop(cpu_rcache->loaded, limit_pfn);
+	if (iova_pfn)
+		cpu_rcache->hits++;
 
 	spin_unlock_irqrestore(&cpu_rcache->lock, flags);
 
@@ -1034,5 +1063,33 @@ void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad)
 	}
 }
 
+/**
+ * iova_domain_stats - snapshot the allocator statistics of a domain
+ * @iovad: - iova domain in question
+ * @stats: - filled in with the counters since init_iova_domain()
+ */
+void iova_domain_stats(struct iova_domain *iovad, struct iova_stats *stats)
+{
+	struct iova_cpu_rcache *cpu_rcache;
+	unsigned long flags;
+	unsigned int cpu;
+	int i;
+
+	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
+	*stats = iovad->stats;
+	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
+
+	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+		if (!iovad->rcaches[i].cpu_rcaches)
+			continue;
+		for_each_possible_cpu(cpu) {
+			cpu_rcache = per_cpu_ptr(iovad->rcaches[i].cpu_rcaches,
+						 cpu);
+			stats->rcache_hits += READ_ONCE(cpu_rcache->hits);
+		}
+	}
+}
+EXPORT_SYMBOL_GPL(iova_domain_stats);
+
 MODULE_AUTHOR("Anil S Keshavamurthy <anil.s.keshavamurthy@intel.com>");
 MODULE_LICENSE("GPL");
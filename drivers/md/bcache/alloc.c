@@ -587,6 +587,47 @@ static struct open_bucket *pick_data_bucket(struct cache_set *c,
 	return ret;
 }
 
+/*
+ * Allocates a data bucket to @k like bch_bucket_alloc_set() does, and with
+ * the same hold of bucket_lock up to DATA_BUCKET_RESERVE more ones for the
+ * next calls, as long as that leaves half of the free buckets to the others.
+ */
+static int bch_data_bucket_refill(struct cache_set *c, struct bkey *k,
+				  bool wait)
+{
+	BKEY_PADDED(key) extra[DATA_BUCKET_RESERVE];
+	struct cache *ca;
+	unsigned int i, nr = 0;
+
+	mutex_lock(&c->bucket_lock);
+	if (__bch_bucket_alloc_set(c, RESERVE_NONE, k, 1, wait)) {
+		mutex_unlock(&c->bucket_lock);
+		return -1;
+	}
+
+	ca = c->cache_by_alloc[0];
+	while (nr < DATA_BUCKET_RESERVE &&
+	       fifo_used(&ca->free[RESERVE_NONE]) >
+	       ca->free[RESERVE_NONE].size / 2 &&
+	       !__bch_bucket_alloc_set(c, RESERVE_NONE, &extra[nr].key, 1,
+				       false))
+		nr++;
+	mutex_unlock(&c->bucket_lock);
+
+	spin_lock(&c->data_bucket_lock);
+	for (i = 0; i < nr; i++) {
+		if (c->nr_data_bucket_reserve < DATA_BUCKET_RESERVE)
+			bkey_copy(&c->data_bucket_reserve[
+					c->nr_data_bucket_reserve++].key,
+				  &extra[i].key);
+		else
+			bkey_put(c, &extra[i].key);
+	}
+	spin_unlock(&c->data_bucket_lock);
+
+	return 0;
+}
+
 /*
  * Allocates some space in the cache to write to, and k to point to the newly
  * allocated space, and updates KEY_SIZE(k) and KEY_OFFSET(k) (to point to the
@@ -619,13 +660,18 @@ bool bch_alloc_sectors(struct cache_set *c,
 	spin_lock(&c->data_bucket_lock);
 
 	while (!(b = pick_data_bucket(c, k, write_point, &alloc.key))) {
-		unsigned int watermark = write_prio
-			? RESERVE_MOVINGGC
-			: RESERVE_NONE;
+		if (!write_prio && c->nr_data_bucket_reserve) {
+			bkey_copy(&alloc.key, &c->data_bucket_reserve[
+					--c->nr_data_bucket_reserve].key);
+			continue;
+		}
 
 		spin_unlock(&c->data_bucket_lock);
 
-		if (bch_bucket_alloc_set(c, watermark, &alloc.key, 1, wait))
+		if (write_prio
+		    ? bch_bucket_alloc_set(c, RESERVE_MOVINGGC, &alloc.key, 1,
+					   wait)
+		    : bch_data_bucket_refill(c, &alloc.key, wait))
 			return false;
 
 		spin_lock(&c->data_bucket_lock);
@@ -634,10 +680,18 @@ bool bch_alloc_sectors(struct cache_set *c,
 	/*
 	 * If we had to allocate, we might race and not need to allocate the
 	 * second time we call pick_data_bucket(). If we allocated a bucket but
-	 * didn't use it, drop the refcount bch_bucket_alloc_set() took:
+	 * didn't use it, keep it for the next time if it fits the reserve, or
+	 * drop the refcount bch_bucket_alloc_set() took:
 	 */
-	if (KEY_PTRS(&alloc.key))
-		bkey_put(c, &alloc.key);
+	if (KEY_PTRS(&alloc.key)) {
+		if (!write_prio &&
+		    c->nr_data_bucket_reserve < DATA_BUCKET_RESERVE)
+			bkey_copy(&c->data_bucket_reserve[
+					c->nr_data_bucket_reserve++].key,
+				  &alloc.key);
+		else
+			bkey_put(c, &alloc.key);
+	}
 
 	for (i = 0; i < KEY_PTRS(&b->key); i++)
 		EBUG_ON(ptr_stale(c, &b->key, i));
@@ -668,6 +668,15 @@ struct cache_set {
 	struct list_head	data_buckets;
 	spinlock_t		data_bucket_lock;
 
+	/*
+	 * Data buckets allocated ahead of need, for bch_alloc_sectors() to
+	 * reopen a bucket without going through bucket_lock most of the time.
+	 * Each key holds the pin of its bucket. Protected by data_bucket_lock.
+	 */
+#define DATA_BUCKET_RESERVE	4
+	BKEY_PADDED(key)	data_bucket_reserve[DATA_BUCKET_RESERVE];
+	unsigned int		nr_data_bucket_reserve;
+
 	struct journal		journal;
 
 #define CONGESTED_MAX		1024
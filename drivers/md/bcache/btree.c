@@ -979,6 +979,10 @@ static struct btree *mca_alloc(struct cache_set *c, struct btree_op *op,
  *
  * The btree node will have either a read or a write lock held, depending on
  * level and op->lock.
+ *
+ * Finding the node in the cache is already lockless (mca_find() walks the
+ * hash under RCU); the read lock is what keeps its bsets stable, as inserts
+ * and sorts rewrite them and their auxiliary search trees in place.
  */
 struct btree *bch_btree_node_get(struct cache_set *c, struct btree_op *op,
 				 struct bkey *k, int level, bool write,
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Inserts ascending runs of keys with dm_btree_insert_many(), enough of
+ * them for the root to split beneath, then its leaves and internal nodes
+ * to split, and checks that every key can be looked up and that a range
+ * walk returns them all in order.  Runs once at load time, on the scratch
+ * device given as dev=, whose contents it overwrites.
+ */
+
+#include "dm-btree.h"
+#include "dm-space-map.h"
+#include "dm-transaction-manager.h"
+
+#include <linux/blkdev.h>
+#include <linux/device-mapper.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#define DM_MSG_PREFIX "btree test"
+
+#define TEST_BLOCK_SIZE		4096
+#define TEST_MAX_LOCKS		5
+#define TEST_BATCH		256
+#define TEST_RANGE		64
+
+static char *dev;
+module_param(dev, charp, 0444);
+MODULE_PARM_DESC(dev, "Scratch block device to run the test on");
+
+static unsigned int nr_keys = 100000;
+module_param(nr_keys, uint, 0444);
+MODULE_PARM_DESC(nr_keys, "Number of keys to insert per run");
+
+static __le64 test_value(uint64_t key)
+{
+	return cpu_to_le64(key * 3 + 1);
+}
+
+/*
+ * Inserts the keys from @first up to nr_keys, @stride apart, in batches,
+ * under the upper level key 7 when @levels is 2.
+ */
+static int test_insert(struct dm_btree_info *info, dm_block_t *root,
+		       uint64_t first, unsigned int stride)
+{
+	uint64_t keys[2] = { 7, 0 };
+	uint64_t *leaf_keys;
+	__le64 *values;
+	uint64_t key = first;
+	unsigned int n, nr_inserted;
+	int r = 0;
+
+	leaf_keys = kmalloc_array(TEST_BATCH, sizeof(*leaf_keys), GFP_KERNEL);
+	values = kmalloc_array(TEST_BATCH, sizeof(*values), GFP_KERNEL);
+	if (!leaf_keys || !values) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	while (key < nr_keys) {
+		for (n = 0; n < TEST_BATCH && key < nr_keys; n++, key += stride) {
+			leaf_keys[n] = key;
+			values[n] = test_value(key);
+		}
+
+		nr_inserted = 0;
+		__dm_bless_for_disk(values);
+		r = dm_btree_insert_many(info, *root, keys, leaf_keys, values,
+					 n, root, &nr_inserted);
+		if (r)
+			break;
+		if (nr_inserted != n) {
+			DMERR("inserted %u of %u new keys", nr_inserted, n);
+			r = -EINVAL;
+			break;
+		}
+		cond_resched();
+	}
+
+out:
+	kfree(leaf_keys);
+	kfree(values);
+	return r;
+}
+
+static int test_check(struct dm_btree_info *info, dm_block_t root)
+{
+	uint64_t keys[2] = { 7, 0 };
+	uint64_t *result_keys;
+	__le64 *values, value;
+	uint64_t key, expected = 0;
+	unsigned int i, nr_found;
+	int r;
+
+	for (key = 0; key < nr_keys; key++) {
+		keys[info->levels - 1] = key;
+		r = dm_btree_lookup(info, root, keys, &value);
+		if (r || value != test_value(key)) {
+			DMERR("lookup of key %llu failed: %d", key, r);
+			return r ? r : -EINVAL;
+		}
+	}
+
+	result_keys = kmalloc_array(TEST_RANGE, sizeof(*result_keys),
+				    GFP_KERNEL);
+	values = kmalloc_array(TEST_RANGE, sizeof(*values), GFP_KERNEL);
+	if (!result_keys || !values) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	keys[info->levels - 1] = 0;
+	for (;;) {
+		r = dm_btree_lookup_range(info, root, keys, ~0ULL, result_keys,
+					  values, TEST_RANGE, &nr_found);
+		if (r == -ENODATA || (!r && !nr_found)) {
+			r = 0;
+			break;
+		}
+		if (r)
+			break;
+
+		for (i = 0; i < nr_found; i++, expected++) {
+			if (result_keys[i] != expected ||
+			    values[i] != test_value(expected)) {
+				DMERR("range walk returned key %llu for %llu",
+				      result_keys[i], expected);
+				r = -EINVAL;
+				goto out;
+			}
+		}
+		keys[info->levels - 1] = result_keys[nr_found - 1] + 1;
+	}
+
+	if (!r && expected != nr_keys) {
+		DMERR("range walk returned %llu of %u keys", expected, nr_keys);
+		r = -EINVAL;
+	}
+out:
+	kfree(result_keys);
+	kfree(values);
+	return r;
+}
+
+static int test_run(struct dm_block_manager *bm, unsigned int levels,
+		    unsigned int stride)
+{
+	struct dm_transaction_manager *tm;
+	struct dm_space_map *sm;
+	struct dm_btree_info info = {
+		.levels = levels,
+		.value_type = {
+			.size = sizeof(__le64),
+		},
+	};
+	dm_block_t root;
+	unsigned int pass;
+	int r;
+
+	r = dm_tm_create_with_sm(bm, 0, &tm, &sm);
+	if (r)
+		return r;
+	info.tm = tm;
+
+	r = dm_btree_empty(&info, &root);
+	if (r)
+		goto out;
+
+	/* each pass fills in keys between those of the previous ones */
+	for (pass = 0; pass < stride; pass++) {
+		r = test_insert(&info, &root, pass, stride);
+		if (r)
+			goto out;
+	}
+
+	r = test_check(&info, root);
+	DMINFO("%u levels, %u keys in %u passes: %s",
+	       levels, nr_keys, stride, r ? "FAILED" : "ok");
+out:
+	dm_sm_destroy(sm);
+	dm_tm_destroy(tm);
+	return r;
+}
+
+static int __init dm_btree_test_init(void)
+{
+	struct block_device *bdev;
+	struct dm_block_manager *bm;
+	int r;
+
+	if (!dev) {
+		DMERR("no scratch device given with dev=");
+		return -EINVAL;
+	}
+
+	bdev = blkdev_get_by_path(dev, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				  &dev);
+	if (IS_ERR(bdev))
+		return PTR_ERR(bdev);
+
+	bm = dm_block_manager_create(bdev, TEST_BLOCK_SIZE, TEST_MAX_LOCKS);
+	if (IS_ERR(bm)) {
+		r = PTR_ERR(bm);
+		goto out;
+	}
+
+	r = test_run(bm, 1, 1);
+	if (!r)
+		r = test_run(bm, 2, 1);
+	if (!r)
+		r = test_run(bm, 1, 3);
+
+	dm_block_manager_destroy(bm);
+out:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	return r;
+}
+
+static void __exit dm_btree_test_exit(void)
+{
+}
+
+module_init(dm_btree_test_init);
+module_exit(dm_btree_test_exit);
+
+MODULE_DESCRIPTION("Test of batched inserts into persistent data btrees");
+MODULE_LICENSE("GPL");
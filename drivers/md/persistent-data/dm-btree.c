@@ -499,6 +499,120 @@ int dm_btree_lookup_next(struct dm_btree_info *info, dm_block_t root,
 
 EXPORT_SYMBOL_GPL(dm_btree_lookup_next);
 
+struct lookup_range {
+	uint64_t end_key;
+	unsigned max, nr;
+	uint64_t *result_keys;
+	void *values_le;
+};
+
+static int lookup_range_single(struct dm_btree_info *info, dm_block_t root,
+			       uint64_t key, struct lookup_range *lr)
+{
+	int r = 0, i;
+	unsigned j, end;
+	uint32_t flags, nr_entries;
+	struct dm_block *node;
+	struct btree_node *n;
+
+	r = bn_read_lock(info, root, &node);
+	if (r)
+		return r;
+
+	n = dm_block_data(node);
+	flags = le32_to_cpu(n->header.flags);
+	nr_entries = le32_to_cpu(n->header.nr_entries);
+	i = lower_bound(n, key);
+
+	if (flags & INTERNAL_NODE) {
+		struct dm_block_manager *bm = dm_tm_get_bm(info->tm);
+
+		if (i < 0)
+			i = 0;
+
+		/*
+		 * Children [i, end) may hold keys of the range.  Each holds
+		 * at least one, so only as many as there are values left to
+		 * find are read ahead, while the first one is looked at.
+		 */
+		for (end = i + 1; end < nr_entries; end++)
+			if (le64_to_cpu(n->keys[end]) >= lr->end_key)
+				break;
+
+		for (j = i + 1; j < end && j - i < lr->max - lr->nr; j++)
+			dm_bm_prefetch(bm, value64(n, j));
+
+		for (j = i; j < end && lr->nr < lr->max && !r; j++)
+			r = lookup_range_single(info, value64(n, j), key, lr);
+
+	} else {
+		if (i < 0 || le64_to_cpu(n->keys[i]) < key)
+			i++;
+
+		for (; i < nr_entries && lr->nr < lr->max; i++) {
+			uint64_t k = le64_to_cpu(n->keys[i]);
+
+			if (k >= lr->end_key)
+				break;
+
+			lr->result_keys[lr->nr] = k;
+			memcpy(lr->values_le + lr->nr * info->value_type.size,
+			       value_ptr(n, i), info->value_type.size);
+			lr->nr++;
+		}
+	}
+
+	dm_tm_unlock(info->tm, node);
+	return r;
+}
+
+int dm_btree_lookup_range(struct dm_btree_info *info, dm_block_t root,
+			  uint64_t *keys, uint64_t end_key,
+			  uint64_t *result_keys, void *values_le,
+			  unsigned max, unsigned *nr_found)
+{
+	unsigned level;
+	int r = 0;
+	uint64_t rkey;
+	__le64 internal_value_le;
+	struct ro_spine spine;
+	struct lookup_range lr = {
+		.end_key = end_key,
+		.max = max,
+		.result_keys = result_keys,
+		.values_le = values_le,
+	};
+
+	*nr_found = 0;
+
+	init_ro_spine(&spine, info);
+	for (level = 0; level < info->levels - 1u; level++) {
+		r = btree_lookup_raw(&spine, root, keys[level],
+				     lower_bound, &rkey,
+				     &internal_value_le, sizeof(uint64_t));
+		if (r)
+			goto out;
+
+		if (rkey != keys[level]) {
+			r = -ENODATA;
+			goto out;
+		}
+
+		root = le64_to_cpu(internal_value_le);
+	}
+
+	if (max && keys[level] < end_key)
+		r = lookup_range_single(info, root, keys[level], &lr);
+
+	*nr_found = lr.nr;
+	if (!r && !lr.nr)
+		r = -ENODATA;
+out:
+	exit_ro_spine(&spine);
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_lookup_range);
+
 /*
  * Splits a node by creating a sibling node and shifting half the nodes
  * contents across.  Assumes there is a parent node, and it has room for
@@ -688,11 +802,32 @@ static int btree_split_beneath(struct shadow_spine *s, uint64_t key)
 	return 0;
 }
 
+/*
+ * The end of the range of keys of the child of @parent that @key goes to,
+ * @parent_end being the end of the range of @parent.
+ */
+static uint64_t child_end(struct btree_node *parent, uint64_t key,
+			  uint64_t parent_end)
+{
+	int i = lower_bound(parent, key);
+
+	if (i + 1 < (int) le32_to_cpu(parent->header.nr_entries))
+		return le64_to_cpu(parent->keys[i + 1]);
+
+	return parent_end;
+}
+
+/*
+ * If @leaf_end is given, it is set to the end of the range of keys of the
+ * leaf the spine ends at, which any key from @key up to it may be inserted
+ * into.
+ */
 static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 			    struct dm_btree_value_type *vt,
-			    uint64_t key, unsigned *index)
+			    uint64_t key, unsigned *index, uint64_t *leaf_end)
 {
 	int r, i = *index, top = 1;
+	uint64_t end = ~0ULL, parent_end = ~0ULL;
 	struct btree_node *node;
 
 	for (;;) {
@@ -729,6 +864,21 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 
 		node = dm_block_data(shadow_current(s));
 
+		/*
+		 * The range of the current node is only known once it is
+		 * split, as the split adds a key to the parent or makes the
+		 * node a new parent.  Recompute it from the parent on every
+		 * level below the top of this tree; the parent above the top
+		 * is a node of the level above, whose keys are unrelated.  A
+		 * split beneath leaves the top node current, with the whole
+		 * range, and the next level takes its range from it.
+		 */
+		if (top)
+			end = ~0ULL;
+		else
+			end = child_end(dm_block_data(shadow_parent(s)),
+					key, parent_end);
+
 		i = lower_bound(node, key);
 
 		if (le32_to_cpu(node->header.flags) & LEAF_NODE)
@@ -741,6 +891,7 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 		}
 
 		root = value64(node, i);
+		parent_end = end;
 		top = 0;
 	}
 
@@ -748,6 +899,8 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 		i++;
 
 	*index = i;
+	if (leaf_end)
+		*leaf_end = end;
 	return 0;
 }
 
@@ -758,13 +911,47 @@ static bool need_insert(struct btree_node *node, uint64_t *keys,
 		(le64_to_cpu(node->keys[index]) != keys[level]));
 }
 
+static int insert_into_leaf(struct dm_btree_info *info, struct btree_node *n,
+			    unsigned index, uint64_t key, void *value,
+			    unsigned *nr_inserted)
+			    __dm_written_to_disk(value)
+{
+	if (need_insert(n, &key, 0, index)) {
+		(*nr_inserted)++;
+
+		return insert_at(info->value_type.size, n, index, key, value);
+	}
+
+	if (info->value_type.dec &&
+	    (!info->value_type.equal ||
+	     !info->value_type.equal(
+		     info->value_type.context,
+		     value_ptr(n, index),
+		     value))) {
+		info->value_type.dec(info->value_type.context,
+				     value_ptr(n, index));
+	}
+	memcpy_disk(value_ptr(n, index),
+		    value, info->value_type.size);
+
+	return 0;
+}
+
+/*
+ * Inserts the first of @count values, whose bottom level keys are in
+ * @leaf_keys, then as many of the next ones as go to the same leaf and fit
+ * in it without a split, so that the spine to it is shadowed once for them.
+ */
 static int insert(struct dm_btree_info *info, dm_block_t root,
-		  uint64_t *keys, void *value, dm_block_t *new_root,
-		  int *inserted)
-		  __dm_written_to_disk(value)
+		  uint64_t *keys, const uint64_t *leaf_keys, void *values,
+		  unsigned count, dm_block_t *new_root,
+		  unsigned *nr_done, unsigned *nr_inserted)
+		  __dm_written_to_disk(values)
 {
 	int r;
 	unsigned level, index = -1, last_level = info->levels - 1;
+	size_t size = info->value_type.size;
+	uint64_t leaf_end;
 	dm_block_t block = root;
 	struct shadow_spine spine;
 	struct btree_node *n;
@@ -774,7 +961,8 @@ static int insert(struct dm_btree_info *info, dm_block_t root,
 	init_shadow_spine(&spine, info);
 
 	for (level = 0; level < (info->levels - 1); level++) {
-		r = btree_insert_raw(&spine, block, &le64_type, keys[level], &index);
+		r = btree_insert_raw(&spine, block, &le64_type, keys[level],
+				     &index, NULL);
 		if (r < 0)
 			goto bad;
 
@@ -802,35 +990,36 @@ static int insert(struct dm_btree_info *info, dm_block_t root,
 	}
 
 	r = btree_insert_raw(&spine, block, &info->value_type,
-			     keys[level], &index);
+			     leaf_keys[0], &index, &leaf_end);
 	if (r < 0)
 		goto bad;
 
 	n = dm_block_data(shadow_current(&spine));
 
-	if (need_insert(n, keys, level, index)) {
-		if (inserted)
-			*inserted = 1;
+	r = insert_into_leaf(info, n, index, leaf_keys[0], values, nr_inserted);
+	if (r)
+		goto bad_unblessed;
+
+	for (*nr_done = 1; *nr_done < count; (*nr_done)++) {
+		uint64_t key = leaf_keys[*nr_done];
+		void *value = values + *nr_done * size;
+		int i;
+
+		if (key <= leaf_keys[*nr_done - 1] || key >= leaf_end)
+			break;
+
+		i = lower_bound(n, key);
+		if (i < 0 || le64_to_cpu(n->keys[i]) != key)
+			i++;
+		index = i;
 
-		r = insert_at(info->value_type.size, n, index,
-			      keys[level], value);
+		if (need_insert(n, &key, 0, index) &&
+		    n->header.nr_entries == n->header.max_entries)
+			break;
+
+		r = insert_into_leaf(info, n, index, key, value, nr_inserted);
 		if (r)
 			goto bad_unblessed;
-	} else {
-		if (inserted)
-			*inserted = 0;
-
-		if (info->value_type.dec &&
-		    (!info->value_type.equal ||
-		     !info->value_type.equal(
-			     info->value_type.context,
-			     value_ptr(n, index),
-			     value))) {
-			info->value_type.dec(info->value_type.context,
-					     value_ptr(n, index));
-		}
-		memcpy_disk(value_ptr(n, index),
-			    value, info->value_type.size);
 	}
 
 	*new_root = shadow_root(&spine);
@@ -839,7 +1028,7 @@ static int insert(struct dm_btree_info *info, dm_block_t root,
 	return 0;
 
 bad:
-	__dm_unbless_for_disk(value);
+	__dm_unbless_for_disk(values);
 bad_unblessed:
 	exit_shadow_spine(&spine);
 	return r;
@@ -849,7 +1038,10 @@ int dm_btree_insert(struct dm_btree_info *info, dm_block_t root,
 		    uint64_t *keys, void *value, dm_block_t *new_root)
 		    __dm_written_to_disk(value)
 {
-	return insert(info, root, keys, value, new_root, NULL);
+	unsigned nr_done, nr_inserted = 0;
+
+	return insert(info, root, keys, keys + info->levels - 1, value, 1,
+		      new_root, &nr_done, &nr_inserted);
 }
 EXPORT_SYMBOL_GPL(dm_btree_insert);
 
@@ -858,10 +1050,44 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 			   int *inserted)
 			   __dm_written_to_disk(value)
 {
-	return insert(info, root, keys, value, new_root, inserted);
+	unsigned nr_done, nr_inserted = 0;
+	int r;
+
+	r = insert(info, root, keys, keys + info->levels - 1, value, 1,
+		   new_root, &nr_done, &nr_inserted);
+	if (!r && inserted)
+		*inserted = nr_inserted;
+
+	return r;
 }
 EXPORT_SYMBOL_GPL(dm_btree_insert_notify);
 
+int dm_btree_insert_many(struct dm_btree_info *info, dm_block_t root,
+			 uint64_t *keys, const uint64_t *leaf_keys,
+			 void *values, unsigned count, dm_block_t *new_root,
+			 unsigned *nr_inserted)
+			 __dm_written_to_disk(values)
+{
+	int r = 0;
+	unsigned done = 0, nr_done;
+
+	*nr_inserted = 0;
+	*new_root = root;
+
+	while (done < count) {
+		r = insert(info, *new_root, keys, leaf_keys + done,
+			   values + done * info->value_type.size,
+			   count - done, new_root, &nr_done, nr_inserted);
+		if (r)
+			break;
+
+		done += nr_done;
+	}
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_insert_many);
+
 /*----------------------------------------------------------------*/
 
 static int find_key(struct ro_spine *s, dm_block_t block, bool find_highest,
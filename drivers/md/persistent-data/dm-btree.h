@@ -116,6 +116,17 @@ int dm_btree_lookup(struct dm_btree_info *info, dm_block_t root,
 int dm_btree_lookup_next(struct dm_btree_info *info, dm_block_t root,
 			 uint64_t *keys, uint64_t *rkey, void *value_le);
 
+/*
+ * Finds up to @max values in order whose bottom level key is >= to that
+ * given and < @end_key, filling out @result_keys and @values_le with
+ * @nr_found of them.  The nodes the range spans are prefetched as it is
+ * walked, rather than read one at a time as repeated lookups would.
+ */
+int dm_btree_lookup_range(struct dm_btree_info *info, dm_block_t root,
+			  uint64_t *keys, uint64_t end_key,
+			  uint64_t *result_keys, void *values_le,
+			  unsigned max, unsigned *nr_found);
+
 /*
  * Insertion (or overwrite an existing value).  O(ln(n))
  */
@@ -133,6 +144,19 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 			   int *inserted)
 			   __dm_written_to_disk(value);
 
+/*
+ * Inserts (or overwrites) @count values under the same upper level keys,
+ * their bottom level keys being @leaf_keys.  When those are in ascending
+ * order the values going to the same leaf are inserted with one walk, so
+ * one shadowing of the spine.  @nr_inserted is set to the number of values
+ * that were not overwrites.
+ */
+int dm_btree_insert_many(struct dm_btree_info *info, dm_block_t root,
+			 uint64_t *keys, const uint64_t *leaf_keys,
+			 void *values, unsigned count, dm_block_t *new_root,
+			 unsigned *nr_inserted)
+			 __dm_written_to_disk(values);
+
 /*
  * Remove a key if present.  This doesn't remove empty sub trees.  Normally
  * subtrees represent a separate entity, like a snapshot map, so this is
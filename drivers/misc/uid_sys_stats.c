@@ -18,6 +18,7 @@
 #include <linux/err.h>
 #include <linux/hashtable.h>
 #include <linux/init.h>
+#include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/mm.h>
@@ -57,6 +58,15 @@ struct io_stats {
 
 #define MAX_TASK_COMM_LEN 256
 
+/*
+ * Live tasks are folded into the UID stats by the first read after this
+ * interval, the other reads only print the already folded stats.
+ */
+#define UID_FOLD_INTERVAL	HZ
+
+static unsigned long uid_last_fold;
+static bool uid_folded;
+
 struct task_entry {
 	char comm[MAX_TASK_COMM_LEN];
 	pid_t pid;
@@ -66,10 +76,18 @@ struct task_entry {
 
 struct uid_entry {
 	uid_t uid;
+	/* Reported totals, updated at each fold */
 	u64 utime;
 	u64 stime;
+	/* Time of the live tasks, at the last fold */
 	u64 active_utime;
 	u64 active_stime;
+	/* Time of the live tasks, while folding */
+	u64 curr_utime;
+	u64 curr_stime;
+	/* Time of the tasks exited since the last fold */
+	u64 dead_utime;
+	u64 dead_stime;
 	int state;
 	struct io_stats io[UID_STATE_SIZE];
 	struct hlist_node hash;
@@ -329,7 +347,36 @@ static struct uid_entry *find_or_register_uid(uid_t uid)
 	return uid_entry;
 }
 
-static int uid_cputime_show(struct seq_file *m, void *v)
+/*
+ * Same as compute_io_bucket_stats(): add what the tasks of the UID ran
+ * since the last fold, tasks changing UID can make it negative.
+ */
+static void compute_cputime_stats(struct uid_entry *uid_entry)
+{
+	int64_t delta;
+
+	delta = uid_entry->curr_utime + uid_entry->dead_utime -
+		uid_entry->active_utime;
+	uid_entry->utime += delta > 0 ? delta : 0;
+	delta = uid_entry->curr_stime + uid_entry->dead_stime -
+		uid_entry->active_stime;
+	uid_entry->stime += delta > 0 ? delta : 0;
+
+	uid_entry->active_utime = uid_entry->curr_utime;
+	uid_entry->active_stime = uid_entry->curr_stime;
+	uid_entry->dead_utime = 0;
+	uid_entry->dead_stime = 0;
+}
+
+static void add_uid_io_stats(struct uid_entry *uid_entry,
+			struct task_struct *task, int slot);
+
+/*
+ * Walk all the threads once to fold the cputime and io stats of the live
+ * tasks into their UID, unless that was done less than UID_FOLD_INTERVAL
+ * ago. The tasks exiting in between are accounted by process_notifier().
+ */
+static int uid_fold_locked(void)
 {
 	struct uid_entry *uid_entry = NULL;
 	struct task_struct *task, *temp;
@@ -338,39 +385,72 @@ static int uid_cputime_show(struct seq_file *m, void *v)
 	u64 stime;
 	unsigned long bkt;
 	uid_t uid;
+	int ret = 0;
 
-	rt_mutex_lock(&uid_lock);
+	if (uid_folded && time_before(jiffies,
+				      uid_last_fold + UID_FOLD_INTERVAL))
+		return 0;
 
 	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		uid_entry->active_stime = 0;
-		uid_entry->active_utime = 0;
+		uid_entry->curr_utime = 0;
+		uid_entry->curr_stime = 0;
+		memset(&uid_entry->io[UID_STATE_TOTAL_CURR], 0,
+			sizeof(struct io_stats));
+		set_io_uid_tasks_zero(uid_entry);
 	}
 
+	uid_entry = NULL;
 	rcu_read_lock();
 	do_each_thread(temp, task) {
 		uid = from_kuid_munged(user_ns, task_uid(task));
 		if (!uid_entry || uid_entry->uid != uid)
 			uid_entry = find_or_register_uid(uid);
 		if (!uid_entry) {
-			rcu_read_unlock();
-			rt_mutex_unlock(&uid_lock);
 			pr_err("%s: failed to find the uid_entry for uid %d\n",
 				__func__, uid);
-			return -ENOMEM;
+			ret = -ENOMEM;
+			continue;
 		}
 		task_cputime_adjusted(task, &utime, &stime);
-		uid_entry->active_utime += utime;
-		uid_entry->active_stime += stime;
+		uid_entry->curr_utime += utime;
+		uid_entry->curr_stime += stime;
+		add_uid_io_stats(uid_entry, task, UID_STATE_TOTAL_CURR);
 	} while_each_thread(temp, task);
 	rcu_read_unlock();
 
 	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		u64 total_utime = uid_entry->utime +
-							uid_entry->active_utime;
-		u64 total_stime = uid_entry->stime +
-							uid_entry->active_stime;
+		compute_cputime_stats(uid_entry);
+		compute_io_bucket_stats(&uid_entry->io[uid_entry->state],
+					&uid_entry->io[UID_STATE_TOTAL_CURR],
+					&uid_entry->io[UID_STATE_TOTAL_LAST],
+					&uid_entry->io[UID_STATE_DEAD_TASKS]);
+		compute_io_uid_tasks(uid_entry);
+	}
+
+	uid_last_fold = jiffies;
+	uid_folded = true;
+
+	return ret;
+}
+
+static int uid_cputime_show(struct seq_file *m, void *v)
+{
+	struct uid_entry *uid_entry = NULL;
+	unsigned long bkt;
+	int ret;
+
+	rt_mutex_lock(&uid_lock);
+
+	ret = uid_fold_locked();
+	if (ret) {
+		rt_mutex_unlock(&uid_lock);
+		return ret;
+	}
+
+	hash_for_each(hash_table, bkt, uid_entry, hash) {
 		seq_printf(m, "%d: %llu %llu\n", uid_entry->uid,
-			ktime_to_ms(total_utime), ktime_to_ms(total_stime));
+			ktime_to_ms(uid_entry->utime),
+			ktime_to_ms(uid_entry->stime));
 	}
 
 	rt_mutex_unlock(&uid_lock);
@@ -462,40 +542,6 @@ static void add_uid_io_stats(struct uid_entry *uid_entry,
 	add_uid_tasks_io_stats(uid_entry, task, slot);
 }
 
-static void update_io_stats_all_locked(void)
-{
-	struct uid_entry *uid_entry = NULL;
-	struct task_struct *task, *temp;
-	struct user_namespace *user_ns = current_user_ns();
-	unsigned long bkt;
-	uid_t uid;
-
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		memset(&uid_entry->io[UID_STATE_TOTAL_CURR], 0,
-			sizeof(struct io_stats));
-		set_io_uid_tasks_zero(uid_entry);
-	}
-
-	rcu_read_lock();
-	do_each_thread(temp, task) {
-		uid = from_kuid_munged(user_ns, task_uid(task));
-		if (!uid_entry || uid_entry->uid != uid)
-			uid_entry = find_or_register_uid(uid);
-		if (!uid_entry)
-			continue;
-		add_uid_io_stats(uid_entry, task, UID_STATE_TOTAL_CURR);
-	} while_each_thread(temp, task);
-	rcu_read_unlock();
-
-	hash_for_each(hash_table, bkt, uid_entry, hash) {
-		compute_io_bucket_stats(&uid_entry->io[uid_entry->state],
-					&uid_entry->io[UID_STATE_TOTAL_CURR],
-					&uid_entry->io[UID_STATE_TOTAL_LAST],
-					&uid_entry->io[UID_STATE_DEAD_TASKS]);
-		compute_io_uid_tasks(uid_entry);
-	}
-}
-
 static void update_io_stats_uid_locked(struct uid_entry *uid_entry)
 {
 	struct task_struct *task, *temp;
@@ -528,7 +574,7 @@ static int uid_io_show(struct seq_file *m, void *v)
 
 	rt_mutex_lock(&uid_lock);
 
-	update_io_stats_all_locked();
+	uid_fold_locked();
 
 	hash_for_each(hash_table, bkt, uid_entry, hash) {
 		seq_printf(m, "%d %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
@@ -639,8 +685,8 @@ static int process_notifier(struct notifier_block *self,
 	}
 
 	task_cputime_adjusted(task, &utime, &stime);
-	uid_entry->utime += utime;
-	uid_entry->stime += stime;
+	uid_entry->dead_utime += utime;
+	uid_entry->dead_stime += stime;
 
 	add_uid_io_stats(uid_entry, task, UID_STATE_DEAD_TASKS);
 
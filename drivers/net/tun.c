@@ -129,6 +129,10 @@ do {								\
 #define TUN_FEATURES (IFF_NO_PI | IFF_ONE_QUEUE | IFF_VNET_HDR | \
 		      IFF_MULTI_QUEUE | IFF_NAPI | IFF_NAPI_FRAGS)
 
+#ifndef TUNSETMULTIPKT
+#define TUNSETMULTIPKT	_IOW('T', 240, int)
+#endif
+
 #define GOODCOPY_LEN 128
 
 #define FLT_EXACT_COUNT 8
@@ -187,6 +191,8 @@ struct tun_file {
 	struct tun_struct *detached;
 	struct ptr_ring tx_ring;
 	struct xdp_rxq_info xdp_rxq;
+	/* Several packets per read and write, see TUNSETMULTIPKT */
+	bool multi_pkt;
 };
 
 struct tun_flow_entry {
@@ -1961,6 +1967,43 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 	return total_len;
 }
 
+/* In multi packet mode, each packet of a write is preceded by its length
+ * as a native endian u32, and is laid out as in a single packet write.
+ * The packets are handed to tun_get_user() one at a time, telling it more
+ * are coming, so the NAPI path flushes once per write.  Returns the bytes
+ * of the packets taken, or the error of the first packet.
+ */
+static ssize_t tun_get_user_multi(struct tun_struct *tun,
+				  struct tun_file *tfile,
+				  struct iov_iter *from, int noblock)
+{
+	size_t total = 0;
+	ssize_t ret = 0;
+
+	while (iov_iter_count(from)) {
+		struct iov_iter pkt;
+		u32 len;
+
+		if (copy_from_iter(&len, sizeof(len), from) != sizeof(len) ||
+		    len > iov_iter_count(from)) {
+			ret = -EINVAL;
+			break;
+		}
+
+		pkt = *from;
+		iov_iter_truncate(&pkt, len);
+		iov_iter_advance(from, len);
+
+		ret = tun_get_user(tun, tfile, NULL, &pkt, noblock,
+				   iov_iter_count(from) != 0);
+		if (ret < 0)
+			break;
+		total += sizeof(len) + len;
+	}
+
+	return total ? total : ret;
+}
+
 static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
 	struct file *file = iocb->ki_filp;
@@ -1971,8 +2014,12 @@ static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (!tun)
 		return -EBADFD;
 
-	result = tun_get_user(tun, tfile, NULL, from,
-			      file->f_flags & O_NONBLOCK, false);
+	if (tfile->multi_pkt)
+		result = tun_get_user_multi(tun, tfile, from,
+					    file->f_flags & O_NONBLOCK);
+	else
+		result = tun_get_user(tun, tfile, NULL, from,
+				      file->f_flags & O_NONBLOCK, false);
 
 	tun_put(tun);
 	return result;
@@ -2148,6 +2195,20 @@ static void *tun_ring_recv(struct tun_file *tfile, int noblock, int *err)
 	return ptr;
 }
 
+static int tun_ptr_peek_len(void *ptr)
+{
+	if (likely(ptr)) {
+		if (tun_is_xdp_frame(ptr)) {
+			struct xdp_frame *xdpf = tun_ptr_to_xdp(ptr);
+
+			return xdpf->len;
+		}
+		return __skb_array_len_with_tag(ptr);
+	} else {
+		return 0;
+	}
+}
+
 static ssize_t tun_do_read(struct tun_struct *tun, struct tun_file *tfile,
 			   struct iov_iter *to,
 			   int noblock, void *ptr)
@@ -2187,6 +2248,59 @@ static ssize_t tun_do_read(struct tun_struct *tun, struct tun_file *tfile,
 	return ret;
 }
 
+/* The read side of multi packet mode: each packet is preceded by the
+ * length written for it.  Only the first packet is waited for, and further
+ * ones are read while they are queued and fit whole in what is left.
+ */
+static ssize_t tun_do_read_multi(struct tun_struct *tun,
+				 struct tun_file *tfile,
+				 struct iov_iter *to, int noblock)
+{
+	size_t room = tun->flags & IFF_NO_PI ? 0 : sizeof(struct tun_pi);
+	size_t total = 0;
+	ssize_t ret;
+	u32 len;
+
+	if (tun->flags & IFF_VNET_HDR)
+		room += READ_ONCE(tun->vnet_hdr_sz);
+	room += sizeof(len);
+
+	if (iov_iter_count(to) <= sizeof(len))
+		return -EINVAL;
+
+	do {
+		struct iov_iter hdr;
+		size_t avail;
+
+		/* The peeked length counts the VLAN tag of an skb, which
+		 * tun_put_user() inserts, through __skb_array_len_with_tag().
+		 */
+		if (total) {
+			int peek = PTR_RING_PEEK_CALL(&tfile->tx_ring,
+						      tun_ptr_peek_len);
+
+			if (!peek || iov_iter_count(to) < room + peek)
+				break;
+		}
+
+		hdr = *to;
+		iov_iter_advance(to, sizeof(len));
+		avail = iov_iter_count(to);
+
+		ret = tun_do_read(tun, tfile, to, noblock || total, NULL);
+		if (ret <= 0)
+			break;
+
+		/* A first packet larger than the buffer is truncated */
+		len = min_t(size_t, ret, avail);
+		if (copy_to_iter(&len, sizeof(len), &hdr) != sizeof(len))
+			return total ? total : -EFAULT;
+		total += sizeof(len) + len;
+	} while (iov_iter_count(to) > sizeof(len));
+
+	return total ? total : ret;
+}
+
 static ssize_t tun_chr_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
 	struct file *file = iocb->ki_filp;
@@ -2196,7 +2310,12 @@ static ssize_t tun_chr_read_iter(struct kiocb *iocb, struct iov_iter *to)
 
 	if (!tun)
 		return -EBADFD;
-	ret = tun_do_read(tun, tfile, to, file->f_flags & O_NONBLOCK, NULL);
+	if (tfile->multi_pkt)
+		ret = tun_do_read_multi(tun, tfile, to,
+					file->f_flags & O_NONBLOCK);
+	else
+		ret = tun_do_read(tun, tfile, to, file->f_flags & O_NONBLOCK,
+				  NULL);
 	ret = min_t(ssize_t, ret, len);
 	if (ret > 0)
 		iocb->ki_pos = ret;
@@ -2412,20 +2531,6 @@ static int tun_recvmsg(struct socket *sock, struct msghdr *m, size_t total_len,
 	return ret;
 }
 
-static int tun_ptr_peek_len(void *ptr)
-{
-	if (likely(ptr)) {
-		if (tun_is_xdp_frame(ptr)) {
-			struct xdp_frame *xdpf = tun_ptr_to_xdp(ptr);
-
-			return xdpf->len;
-		}
-		return __skb_array_len_with_tag(ptr);
-	} else {
-		return 0;
-	}
-}
-
 static int tun_peek_len(struct socket *sock)
 {
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
@@ -2932,6 +3037,13 @@ static long __tun_chr_ioctl(struct file *file, unsigned int cmd,
 			  arg ? "disabled" : "enabled");
 		break;
 
+	case TUNSETMULTIPKT:
+		/* Frame several packets per read and write on this queue */
+		tfile->multi_pkt = !!arg;
+		tun_debug(KERN_INFO, tun, "multi packet %s\n",
+			  arg ? "enabled" : "disabled");
+		break;
+
 	case TUNSETPERSIST:
 		/* Disable/Enable persist mode. Keep an extra reference to the
 		 * module to prevent the module being unprobed.
@@ -3215,6 +3327,7 @@ static int tun_chr_open(struct inode *inode, struct file * file)
 	RCU_INIT_POINTER(tfile->tun, NULL);
 	tfile->flags = 0;
 	tfile->ifindex = 0;
+	tfile->multi_pkt = false;
 
 	init_waitqueue_head(&tfile->wq.wait);
 	RCU_INIT_POINTER(tfile->socket.wq, &tfile->wq);
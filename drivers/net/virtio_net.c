@@ -169,6 +169,9 @@ struct receive_queue {
 	/* Min single buffer size for mergeable buffers case. */
 	unsigned int min_buf_len;
 
+	/* Buffers were put back by virtnet_rx_recycle() since the last kick */
+	bool recycled;
+
 	/* Name of this receive queue: input.$index */
 	char name[40];
 
@@ -637,6 +640,22 @@ static struct page *xdp_linearize_page(struct receive_queue *rq,
 	return NULL;
 }
 
+/* Post a receive buffer an XDP program dropped back on the ring as is,
+ * rather than freeing its page and carving a new one on the next refill.
+ */
+static void virtnet_rx_recycle(struct receive_queue *rq, void *buf,
+			       void *data, unsigned int len, void *ctx)
+{
+	int err;
+
+	sg_init_one(rq->sg, data, len);
+	err = virtqueue_add_inbuf_ctx(rq->vq, rq->sg, 1, buf, ctx, GFP_ATOMIC);
+	if (unlikely(err < 0))
+		put_page(virt_to_head_page(buf));
+	else
+		rq->recycled = true;
+}
+
 static struct sk_buff *receive_small(struct net_device *dev,
 				     struct virtnet_info *vi,
 				     struct receive_queue *rq,
@@ -735,7 +754,15 @@ static struct sk_buff *receive_small(struct net_device *dev,
 		case XDP_ABORTED:
 			trace_xdp_exception(vi->dev, xdp_prog, act);
 		case XDP_DROP:
-			goto err_xdp;
+			/* Not linearized, so still laid out as it was posted */
+			if (unlikely((unsigned long)ctx != xdp_headroom))
+				goto err_xdp;
+			rcu_read_unlock();
+			stats->xdp_drops++;
+			stats->drops++;
+			virtnet_rx_recycle(rq, buf, buf + header_offset,
+					   vi->hdr_len + GOOD_PACKET_LEN, ctx);
+			goto xdp_xmit;
 		}
 	}
 	rcu_read_unlock();
@@ -918,9 +945,16 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 			trace_xdp_exception(vi->dev, xdp_prog, act);
 			/* fall through */
 		case XDP_DROP:
-			if (unlikely(xdp_page != page))
+			if (unlikely(xdp_page != page)) {
 				__free_pages(xdp_page, 0);
-			goto err_xdp;
+				goto err_xdp;
+			}
+			rcu_read_unlock();
+			stats->xdp_drops++;
+			stats->drops++;
+			virtnet_rx_recycle(rq, buf, buf,
+					   mergeable_ctx_to_truesize(ctx), ctx);
+			goto xdp_xmit;
 		}
 	}
 	rcu_read_unlock();
@@ -1347,6 +1381,13 @@ static int virtnet_receive(struct receive_queue *rq, int budget,
 			schedule_delayed_work(&vi->refill, 0);
 	}
 
+	/* The device has to learn about the recycled buffers too */
+	if (rq->recycled) {
+		rq->recycled = false;
+		if (virtqueue_kick_prepare(rq->vq) && virtqueue_notify(rq->vq))
+			stats.kicks++;
+	}
+
 	u64_stats_update_begin(&rq->stats.syncp);
 	for (i = 0; i < VIRTNET_RQ_STATS_LEN; i++) {
 		size_t offset = virtnet_rq_stats_desc[i].offset;
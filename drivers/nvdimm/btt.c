@@ -1116,13 +1116,15 @@ static int btt_data_read(struct arena_info *arena, struct page *page,
 }
 
 static int btt_data_write(struct arena_info *arena, u32 lba,
-			struct page *page, unsigned int off, u32 len)
+			struct page *page, unsigned int off, u32 len,
+			unsigned long flags)
 {
 	int ret;
 	u64 nsoff = to_namespace_offset(arena, lba);
 	void *mem = kmap_atomic(page);
 
-	ret = arena_write_bytes(arena, nsoff, mem + off, len, NVDIMM_IO_ATOMIC);
+	ret = arena_write_bytes(arena, nsoff, mem + off, len,
+			NVDIMM_IO_ATOMIC | flags);
 	kunmap_atomic(mem);
 
 	return ret;
@@ -1361,7 +1363,13 @@ static int btt_write_pg(struct btt *btt, struct bio_integrity_payload *bip,
 			goto out_lane;
 		}
 
-		ret = btt_data_write(arena, new_postmap, page, off, cur_len);
+		/*
+		 * The data only has to be durable before the log entry is
+		 * written, so when there is integrity metadata the flush of
+		 * its write covers both.
+		 */
+		ret = btt_data_write(arena, new_postmap, page, off, cur_len,
+				bip ? NVDIMM_IO_NOFLUSH : 0);
 		if (ret)
 			goto out_lane;
 
@@ -1393,8 +1401,14 @@ static int btt_write_pg(struct btt *btt, struct bio_integrity_payload *bip,
 		if (ret)
 			goto out_map;
 
+		/*
+		 * Once the log entry is durable, btt_freelist_init() redoes
+		 * a lost map update from it, so the map entry is left for the
+		 * flush of the next write of this lane, which comes before
+		 * that entry can be overwritten.
+		 */
 		ret = btt_map_write(arena, premap, new_postmap, 0, 0,
-			NVDIMM_IO_ATOMIC);
+			NVDIMM_IO_ATOMIC | NVDIMM_IO_NOFLUSH);
 		if (ret)
 			goto out_map;
 
@@ -301,7 +301,10 @@ static int nsio_rw_bytes(struct nd_namespace_common *ndns,
 	}
 
 	memcpy_flushcache(nsio->addr + offset, buf, size);
-	nvdimm_flush(to_nd_region(ndns->dev.parent));
+	if (flags & NVDIMM_IO_NOFLUSH)
+		wmb();
+	else
+		nvdimm_flush(to_nd_region(ndns->dev.parent));
 
 	return rc;
 }
@@ -31,6 +31,11 @@ enum {
 	ND_MAX_LANES = 256,
 	INT_LBASIZE_ALIGNMENT = 64,
 	NVDIMM_IO_ATOMIC = 1,
+	/*
+	 * Only order a pmem write before the ones after it, leaving it to a
+	 * later write to flush the posted write queues to media.
+	 */
+	NVDIMM_IO_NOFLUSH = 2,
 };
 
 struct nvdimm_drvdata {
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * UFS Host Controller inline encryption support
+ *
+ * Controllers implementing the crypto extension of UFSHCI 2.1 advertise
+ * the algorithms, key sizes and data unit sizes they support in their
+ * crypto capability registers, and hold the keys in an array of crypto
+ * configurations, one per keyslot. The keyslot manager of the host
+ * programs keys into those configurations, and requests then only carry
+ * the index of their configuration and their data unit number.
+ *
+ * Configurations are cleared by host controller resets so a copy of each
+ * is kept and written back once the controller is enabled again.
+ */
+
+#include <linux/pm_runtime.h>
+
+#include "ufshcd.h"
+#include "ufshcd-crypto.h"
+
+static const struct ufs_crypto_alg_entry {
+	enum ufs_crypto_alg ufs_alg;
+	enum ufs_crypto_key_size ufs_key_size;
+} ufs_crypto_algs[BLK_ENCRYPTION_MODE_MAX] = {
+	[BLK_ENCRYPTION_MODE_AES_256_XTS] = {
+		.ufs_alg = UFS_CRYPTO_ALG_AES_XTS,
+		.ufs_key_size = UFS_CRYPTO_KEY_SIZE_256,
+	},
+};
+
+/* Index of the crypto capability of @key, or -EINVAL if none matches */
+static int ufshcd_crypto_cap_find(struct ufs_hba *hba,
+				  const struct blk_crypto_key *key)
+{
+	const struct ufs_crypto_alg_entry *alg;
+	u8 data_unit_mask = key->data_unit_size / 512;
+	int i;
+
+	if (key->crypto_mode <= BLK_ENCRYPTION_MODE_INVALID ||
+	    key->crypto_mode >= BLK_ENCRYPTION_MODE_MAX)
+		return -EINVAL;
+	alg = &ufs_crypto_algs[key->crypto_mode];
+
+	for (i = 0; i < hba->crypto_capabilities.num_crypto_cap; i++) {
+		union ufs_crypto_cap_entry *ccap = &hba->crypto_cap_array[i];
+
+		if (ccap->algorithm_id == alg->ufs_alg &&
+		    ccap->key_size == alg->ufs_key_size &&
+		    (ccap->sdus_mask & data_unit_mask))
+			return i;
+	}
+	return -EINVAL;
+}
+
+/* Write configuration @slot to the controller, with crypto_cfg_lock held */
+static void ufshcd_crypto_write_cfg(struct ufs_hba *hba, unsigned int slot)
+{
+	const union ufs_crypto_cfg_entry *cfg = &hba->crypto_cfgs[slot];
+	u32 slot_offset = hba->crypto_cfg_register + slot * sizeof(*cfg);
+	int i;
+
+	/* Disable the slot while the key is being written, then enable it */
+	ufshcd_writel(hba, 0, slot_offset + 16 * sizeof(cfg->reg_val[0]));
+	for (i = 0; i < 16; i++) {
+		ufshcd_writel(hba, le32_to_cpu(cfg->reg_val[i]),
+			      slot_offset + i * sizeof(cfg->reg_val[0]));
+	}
+	ufshcd_writel(hba, le32_to_cpu(cfg->reg_val[17]),
+		      slot_offset + 17 * sizeof(cfg->reg_val[0]));
+	ufshcd_writel(hba, le32_to_cpu(cfg->reg_val[16]),
+		      slot_offset + 16 * sizeof(cfg->reg_val[0]));
+}
+
+static void ufshcd_crypto_program_cfg(struct ufs_hba *hba, unsigned int slot,
+				      const union ufs_crypto_cfg_entry *cfg)
+{
+	unsigned long flags;
+
+	pm_runtime_get_sync(hba->dev);
+	ufshcd_hold(hba, false);
+
+	spin_lock_irqsave(&hba->crypto_cfg_lock, flags);
+	hba->crypto_cfgs[slot] = *cfg;
+	ufshcd_crypto_write_cfg(hba, slot);
+	spin_unlock_irqrestore(&hba->crypto_cfg_lock, flags);
+
+	ufshcd_release(hba);
+	pm_runtime_put_sync(hba->dev);
+}
+
+static int ufshcd_crypto_keyslot_program(struct keyslot_manager *ksm,
+					 const struct blk_crypto_key *key,
+					 unsigned int slot)
+{
+	struct ufs_hba *hba = keyslot_manager_private(ksm);
+	union ufs_crypto_cfg_entry cfg;
+	int cap_idx;
+
+	cap_idx = ufshcd_crypto_cap_find(hba, key);
+	if (cap_idx < 0)
+		return cap_idx;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.data_unit_size = key->data_unit_size / 512;
+	cfg.crypto_cap_idx = cap_idx;
+	cfg.config_enable = UFS_CRYPTO_CONFIGURATION_ENABLE;
+	/* XTS keys are two keys, each taking half of the key field */
+	memcpy(cfg.crypto_key, key->raw, key->size / 2);
+	memcpy(cfg.crypto_key + UFS_CRYPTO_KEY_MAX_SIZE / 2,
+	       key->raw + key->size / 2, key->size / 2);
+
+	ufshcd_crypto_program_cfg(hba, slot, &cfg);
+
+	memzero_explicit(&cfg, sizeof(cfg));
+	return 0;
+}
+
+static int ufshcd_crypto_keyslot_evict(struct keyslot_manager *ksm,
+				       const struct blk_crypto_key *key,
+				       unsigned int slot)
+{
+	struct ufs_hba *hba = keyslot_manager_private(ksm);
+	union ufs_crypto_cfg_entry cfg;
+
+	/* Clear the key and the enable bit */
+	memset(&cfg, 0, sizeof(cfg));
+	ufshcd_crypto_program_cfg(hba, slot, &cfg);
+	return 0;
+}
+
+static const struct keyslot_mgmt_ll_ops ufshcd_ksm_ops = {
+	.keyslot_program	= ufshcd_crypto_keyslot_program,
+	.keyslot_evict		= ufshcd_crypto_keyslot_evict,
+};
+
+/**
+ * ufshcd_crypto_restore_keys - write the crypto configurations back
+ * @hba: per adapter instance
+ *
+ * To be called once the controller was enabled again after a reset, which
+ * cleared them.
+ */
+void ufshcd_crypto_restore_keys(struct ufs_hba *hba)
+{
+	unsigned long flags;
+	int slot;
+
+	if (!ufshcd_hba_is_crypto_supported(hba))
+		return;
+
+	spin_lock_irqsave(&hba->crypto_cfg_lock, flags);
+	for (slot = 0; slot < hba->crypto_capabilities.config_count; slot++) {
+		if (hba->crypto_cfgs[slot].config_enable)
+			ufshcd_crypto_write_cfg(hba, slot);
+	}
+	spin_unlock_irqrestore(&hba->crypto_cfg_lock, flags);
+}
+
+/**
+ * ufshcd_hba_init_crypto - read crypto capabilities and set up the keyslot
+ *			    manager of the host
+ * @hba: per adapter instance, with its capabilities read
+ *
+ * Returns 0 on success or if the controller doesn't support crypto, in
+ * which case UFSHCD_CAP_CRYPTO is left clear, else a negative error code.
+ */
+int ufshcd_hba_init_crypto(struct ufs_hba *hba)
+{
+	unsigned int crypto_modes_supported[BLK_ENCRYPTION_MODE_MAX] = { 0 };
+	int cap_idx;
+	int mode;
+	int err;
+
+	hba->caps &= ~UFSHCD_CAP_CRYPTO;
+	if (!(hba->capabilities & MASK_CRYPTO_SUPPORT))
+		return 0;
+
+	hba->crypto_capabilities.reg_val =
+			cpu_to_le32(ufshcd_readl(hba, REG_UFS_CCAP));
+	hba->crypto_cfg_register =
+		(u32)hba->crypto_capabilities.config_array_ptr * 0x100;
+	if (!hba->crypto_capabilities.num_crypto_cap ||
+	    !hba->crypto_capabilities.config_count)
+		return 0;
+
+	hba->crypto_cap_array =
+		devm_kcalloc(hba->dev, hba->crypto_capabilities.num_crypto_cap,
+			     sizeof(hba->crypto_cap_array[0]), GFP_KERNEL);
+	hba->crypto_cfgs =
+		devm_kcalloc(hba->dev, hba->crypto_capabilities.config_count,
+			     sizeof(hba->crypto_cfgs[0]), GFP_KERNEL);
+	if (!hba->crypto_cap_array || !hba->crypto_cfgs) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	/*
+	 * Store all the capabilities now so that we don't need to repeatedly
+	 * access the device each time we want to know its capabilities
+	 */
+	for (cap_idx = 0; cap_idx < hba->crypto_capabilities.num_crypto_cap;
+	     cap_idx++) {
+		hba->crypto_cap_array[cap_idx].reg_val =
+			cpu_to_le32(ufshcd_readl(hba, REG_UFS_CRYPTOCAP +
+						 cap_idx * sizeof(__le32)));
+	}
+
+	for (mode = 0; mode < BLK_ENCRYPTION_MODE_MAX; mode++) {
+		const struct ufs_crypto_alg_entry *alg = &ufs_crypto_algs[mode];
+
+		if (mode == BLK_ENCRYPTION_MODE_INVALID)
+			continue;
+
+		for (cap_idx = 0;
+		     cap_idx < hba->crypto_capabilities.num_crypto_cap;
+		     cap_idx++) {
+			union ufs_crypto_cap_entry *ccap =
+				&hba->crypto_cap_array[cap_idx];
+
+			if (ccap->algorithm_id == alg->ufs_alg &&
+			    ccap->key_size == alg->ufs_key_size)
+				crypto_modes_supported[mode] |=
+					ccap->sdus_mask * 512;
+		}
+	}
+
+	spin_lock_init(&hba->crypto_cfg_lock);
+	hba->ksm = keyslot_manager_create(hba->crypto_capabilities.config_count,
+					  &ufshcd_ksm_ops,
+					  crypto_modes_supported, hba);
+	if (!hba->ksm) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	hba->caps |= UFSHCD_CAP_CRYPTO;
+	return 0;
+
+out_free:
+	devm_kfree(hba->dev, hba->crypto_cfgs);
+	devm_kfree(hba->dev, hba->crypto_cap_array);
+	hba->crypto_cfgs = NULL;
+	hba->crypto_cap_array = NULL;
+	return err;
+}
+
+/**
+ * ufshcd_crypto_setup_rq_keyslot_manager - let a queue use inline crypto
+ * @hba: per adapter instance
+ * @q: the request queue of one of the LUs of the host
+ */
+void ufshcd_crypto_setup_rq_keyslot_manager(struct ufs_hba *hba,
+					    struct request_queue *q)
+{
+	if (ufshcd_hba_is_crypto_supported(hba))
+		q->ksm = hba->ksm;
+}
+
+void ufshcd_crypto_destroy_keyslot_manager(struct ufs_hba *hba)
+{
+	keyslot_manager_destroy(hba->ksm);
+	hba->ksm = NULL;
+	hba->caps &= ~UFSHCD_CAP_CRYPTO;
+}
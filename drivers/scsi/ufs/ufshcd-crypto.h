@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * UFS Host Controller inline encryption support
+ */
+
+#ifndef _UFSHCD_CRYPTO_H
+#define _UFSHCD_CRYPTO_H
+
+#include <linux/keyslot-manager.h>
+
+#include "ufshcd.h"
+
+#ifdef CONFIG_SCSI_UFS_CRYPTO
+
+static inline bool ufshcd_hba_is_crypto_supported(struct ufs_hba *hba)
+{
+	return hba->caps & UFSHCD_CAP_CRYPTO;
+}
+
+static inline void ufshcd_prepare_lrbp_crypto(struct ufs_hba *hba,
+					      struct request *rq,
+					      struct ufshcd_lrb *lrbp)
+{
+	struct bio_crypt_ctx *bc;
+
+	lrbp->crypto_enable = false;
+	if (!rq || !rq->bio || !bio_has_crypt_ctx(rq->bio))
+		return;
+
+	bc = rq->bio->bi_crypt_context;
+	if (WARN_ON_ONCE(bc->bc_keyslot < 0 || bc->bc_ksm != hba->ksm))
+		return;
+
+	lrbp->crypto_enable = true;
+	lrbp->crypto_key_slot = bc->bc_keyslot;
+	lrbp->data_unit_num = bc->bc_dun;
+}
+
+static inline void ufshcd_prepare_req_desc_hdr_crypto(struct ufshcd_lrb *lrbp,
+						      u32 *dword_0,
+						      u32 *dword_1,
+						      u32 *dword_3)
+{
+	if (lrbp->crypto_enable) {
+		*dword_0 |= UTP_REQ_DESC_CRYPTO_ENABLE_CMD;
+		*dword_0 |= lrbp->crypto_key_slot;
+		*dword_1 = lower_32_bits(lrbp->data_unit_num);
+		*dword_3 = upper_32_bits(lrbp->data_unit_num);
+	}
+}
+
+int ufshcd_hba_init_crypto(struct ufs_hba *hba);
+void ufshcd_crypto_restore_keys(struct ufs_hba *hba);
+void ufshcd_crypto_setup_rq_keyslot_manager(struct ufs_hba *hba,
+					    struct request_queue *q);
+void ufshcd_crypto_destroy_keyslot_manager(struct ufs_hba *hba);
+
+#else /* CONFIG_SCSI_UFS_CRYPTO */
+
+static inline bool ufshcd_hba_is_crypto_supported(struct ufs_hba *hba)
+{
+	return false;
+}
+
+static inline void ufshcd_prepare_lrbp_crypto(struct ufs_hba *hba,
+					      struct request *rq,
+					      struct ufshcd_lrb *lrbp)
+{
+}
+
+static inline void ufshcd_prepare_req_desc_hdr_crypto(struct ufshcd_lrb *lrbp,
+						      u32 *dword_0,
+						      u32 *dword_1,
+						      u32 *dword_3)
+{
+}
+
+static inline int ufshcd_hba_init_crypto(struct ufs_hba *hba)
+{
+	return 0;
+}
+
+static inline void ufshcd_crypto_restore_keys(struct ufs_hba *hba)
+{
+}
+
+static inline void ufshcd_crypto_setup_rq_keyslot_manager(struct ufs_hba *hba,
+						struct request_queue *q)
+{
+}
+
+static inline void ufshcd_crypto_destroy_keyslot_manager(struct ufs_hba *hba)
+{
+}
+
+#endif /* CONFIG_SCSI_UFS_CRYPTO */
+
+#endif /* _UFSHCD_CRYPTO_H */
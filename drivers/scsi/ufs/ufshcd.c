@@ -42,10 +42,12 @@
 #include <linux/nls.h>
 #include <linux/of.h>
 #include <linux/bitfield.h>
+#include <linux/ioprio.h>
 #include "ufshcd.h"
 #include "ufs_quirks.h"
 #include "unipro.h"
 #include "ufs-sysfs.h"
+#include "ufshcd-crypto.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/ufs.h>
@@ -734,7 +736,11 @@ static inline void ufshcd_utmrl_clear(struct ufs_hba *hba, u32 pos)
  */
 static inline void ufshcd_outstanding_req_clear(struct ufs_hba *hba, int tag)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&hba->outstanding_lock, flags);
 	__clear_bit(tag, &hba->outstanding_reqs);
+	spin_unlock_irqrestore(&hba->outstanding_lock, flags);
 }
 
 /**
@@ -881,7 +887,11 @@ static void ufshcd_enable_run_stop_reg(struct ufs_hba *hba)
  */
 static inline void ufshcd_hba_start(struct ufs_hba *hba)
 {
-	ufshcd_writel(hba, CONTROLLER_ENABLE, REG_CONTROLLER_ENABLE);
+	u32 val = CONTROLLER_ENABLE;
+
+	if (ufshcd_hba_is_crypto_supported(hba))
+		val |= CRYPTO_GENERAL_ENABLE;
+	ufshcd_writel(hba, val, REG_CONTROLLER_ENABLE);
 }
 
 /**
@@ -1333,10 +1343,26 @@ static int ufshcd_devfreq_get_dev_status(struct device *dev,
 	return 0;
 }
 
+static int ufshcd_devfreq_get_cur_freq(struct device *dev,
+		unsigned long *freq)
+{
+	struct ufs_hba *hba = dev_get_drvdata(dev);
+	struct ufs_clk_info *clki;
+
+	if (list_empty(&hba->clk_list_head))
+		return -EINVAL;
+
+	/* clocks may have been scaled up behind devfreq for a read burst */
+	clki = list_first_entry(&hba->clk_list_head, struct ufs_clk_info, list);
+	*freq = clki->curr_freq;
+	return 0;
+}
+
 static struct devfreq_dev_profile ufs_devfreq_profile = {
 	.polling_ms	= 100,
 	.target		= ufshcd_devfreq_target,
 	.get_dev_status	= ufshcd_devfreq_get_dev_status,
+	.get_cur_freq	= ufshcd_devfreq_get_cur_freq,
 };
 
 static int ufshcd_devfreq_init(struct ufs_hba *hba)
@@ -1463,6 +1489,7 @@ static ssize_t ufshcd_clkscale_enable_store(struct device *dev,
 
 	cancel_work_sync(&hba->clk_scaling.suspend_work);
 	cancel_work_sync(&hba->clk_scaling.resume_work);
+	cancel_work_sync(&hba->clk_scaling.boost_work);
 
 	hba->clk_scaling.is_allowed = value;
 
@@ -1682,9 +1709,18 @@ static void ufshcd_gate_work(struct work_struct *work)
 	return;
 }
 
+static bool ufshcd_in_io_burst(struct ufs_hba *hba)
+{
+	return hba->io_burst.window_ms &&
+	       time_in_range(jiffies, READ_ONCE(hba->io_burst.start),
+			     READ_ONCE(hba->io_burst.end));
+}
+
 /* host lock must be held before calling this variant */
 static void __ufshcd_release(struct ufs_hba *hba)
 {
+	unsigned long delay;
+
 	if (!ufshcd_is_clkgating_allowed(hba))
 		return;
 
@@ -1697,11 +1733,15 @@ static void __ufshcd_release(struct ufs_hba *hba)
 		|| ufshcd_eh_in_progress(hba))
 		return;
 
+	/* keep the link out of hibern8 until the read burst is over */
+	delay = msecs_to_jiffies(hba->clk_gating.delay_ms);
+	if (ufshcd_in_io_burst(hba))
+		delay = max(delay, READ_ONCE(hba->io_burst.end) - jiffies);
+
 	hba->clk_gating.state = REQ_CLKS_OFF;
 	trace_ufshcd_clk_gating(dev_name(hba->dev), hba->clk_gating.state);
 	queue_delayed_work(hba->clk_gating.clk_gating_workq,
-			   &hba->clk_gating.gate_work,
-			   msecs_to_jiffies(hba->clk_gating.delay_ms));
+			   &hba->clk_gating.gate_work, delay);
 }
 
 void ufshcd_release(struct ufs_hba *hba)
@@ -1818,19 +1858,130 @@ static void ufshcd_exit_clk_gating(struct ufs_hba *hba)
 	destroy_workqueue(hba->clk_gating.clk_gating_workq);
 }
 
-/* Must be called with host lock acquired */
+static ssize_t ufshcd_io_burst_window_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ufs_hba *hba = dev_get_drvdata(dev);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", hba->io_burst.window_ms);
+}
+
+static ssize_t ufshcd_io_burst_window_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct ufs_hba *hba = dev_get_drvdata(dev);
+	u32 value;
+
+	if (kstrtou32(buf, 0, &value))
+		return -EINVAL;
+
+	WRITE_ONCE(hba->io_burst.window_ms, value);
+	return count;
+}
+
+static void ufshcd_init_io_burst(struct ufs_hba *hba)
+{
+	hba->io_burst.window_ms = 200;
+
+	hba->io_burst.window_attr.show = ufshcd_io_burst_window_show;
+	hba->io_burst.window_attr.store = ufshcd_io_burst_window_store;
+	sysfs_attr_init(&hba->io_burst.window_attr.attr);
+	hba->io_burst.window_attr.attr.name = "io_burst_ms";
+	hba->io_burst.window_attr.attr.mode = 0644;
+	if (device_create_file(hba->dev, &hba->io_burst.window_attr))
+		dev_err(hba->dev, "Failed to create sysfs for io_burst_ms\n");
+}
+
+static void ufshcd_exit_io_burst(struct ufs_hba *hba)
+{
+	device_remove_file(hba->dev, &hba->io_burst.window_attr);
+}
+
+/**
+ * ufshcd_io_burst_hint - start a burst for a foreground read if needed
+ * @hba: per adapter instance
+ * @cmd: the command being queued
+ *
+ * A read that isn't background or idle class I/O, issued while more
+ * synchronous requests are already allocated on its queue, starts a burst
+ * of io_burst.window_ms unless one is in progress.
+ *
+ * Returns true if a burst was started.
+ */
+static bool ufshcd_io_burst_hint(struct ufs_hba *hba, struct scsi_cmnd *cmd)
+{
+	struct request *rq = cmd->request;
+	unsigned int window_ms = READ_ONCE(hba->io_burst.window_ms);
+
+	if (!window_ms || ufshcd_in_io_burst(hba))
+		return false;
+
+	if (rq_data_dir(rq) != READ || (rq->cmd_flags & REQ_BACKGROUND) ||
+	    IOPRIO_PRIO_CLASS(req_get_ioprio(rq)) == IOPRIO_CLASS_IDLE)
+		return false;
+
+	/* a lone read is latency bound, a queue of them is a burst */
+	if (cmd->device->request_queue->nr_rqs[BLK_RW_SYNC] < 2)
+		return false;
+
+	WRITE_ONCE(hba->io_burst.start, jiffies);
+	WRITE_ONCE(hba->io_burst.end, jiffies + msecs_to_jiffies(window_ms));
+	return true;
+}
+
+/* Scale clocks up now instead of waiting for the next devfreq poll */
+static void ufshcd_io_burst_boost(struct ufs_hba *hba)
+{
+	if (!ufshcd_is_clkscaling_supported(hba) || !hba->devfreq ||
+	    !hba->clk_scaling.is_allowed)
+		return;
+
+	queue_work(hba->clk_scaling.workq, &hba->clk_scaling.boost_work);
+}
+
+static void ufshcd_clk_scaling_boost_work(struct work_struct *work)
+{
+	struct ufs_hba *hba = container_of(work, struct ufs_hba,
+					   clk_scaling.boost_work);
+	unsigned long irq_flags;
+	ktime_t start;
+	int ret;
+
+	/* serialize with ufshcd_devfreq_target() */
+	mutex_lock(&hba->devfreq->lock);
+	spin_lock_irqsave(hba->host->host_lock, irq_flags);
+	if (ufshcd_eh_in_progress(hba) || hba->clk_scaling.is_suspended ||
+	    !ufshcd_in_io_burst(hba) ||
+	    !ufshcd_is_devfreq_scaling_required(hba, true)) {
+		spin_unlock_irqrestore(hba->host->host_lock, irq_flags);
+		goto out;
+	}
+	spin_unlock_irqrestore(hba->host->host_lock, irq_flags);
+
+	start = ktime_get();
+	ret = ufshcd_devfreq_scale(hba, true);
+
+	trace_ufshcd_profile_clk_scaling(dev_name(hba->dev), "up",
+		ktime_to_us(ktime_sub(ktime_get(), start)), ret);
+out:
+	mutex_unlock(&hba->devfreq->lock);
+}
+
+/* Takes the host lock itself, callers must not hold it */
 static void ufshcd_clk_scaling_start_busy(struct ufs_hba *hba)
 {
 	bool queue_resume_work = false;
+	unsigned long flags;
 
 	if (!ufshcd_is_clkscaling_supported(hba))
 		return;
 
+	spin_lock_irqsave(hba->host->host_lock, flags);
 	if (!hba->clk_scaling.active_reqs++)
 		queue_resume_work = true;
 
 	if (!hba->clk_scaling.is_allowed || hba->pm_op_in_progress)
-		return;
+		goto out_unlock;
 
 	if (queue_resume_work)
 		queue_work(hba->clk_scaling.workq,
@@ -1846,6 +1997,8 @@ static void ufshcd_clk_scaling_start_busy(struct ufs_hba *hba)
 		hba->clk_scaling.busy_start_t = ktime_get();
 		hba->clk_scaling.is_busy_started = true;
 	}
+out_unlock:
+	spin_unlock_irqrestore(hba->host->host_lock, flags);
 }
 
 static void ufshcd_clk_scaling_update_busy(struct ufs_hba *hba)
@@ -1866,17 +2019,28 @@ static void ufshcd_clk_scaling_update_busy(struct ufs_hba *hba)
  * ufshcd_send_command - Send SCSI or device management commands
  * @hba: per adapter instance
  * @task_tag: Task tag of the command
+ *
+ * Called without host_lock, the doorbell being serialized with the
+ * completion path by outstanding_lock only.
  */
 static inline
 void ufshcd_send_command(struct ufs_hba *hba, unsigned int task_tag)
 {
-	hba->lrb[task_tag].issue_time_stamp = ktime_get();
-	hba->lrb[task_tag].compl_time_stamp = ktime_set(0, 0);
+	struct ufshcd_lrb *lrbp = &hba->lrb[task_tag];
+	unsigned long flags;
+
+	lrbp->issue_time_stamp = ktime_get();
+	lrbp->compl_time_stamp = ktime_set(0, 0);
 	ufshcd_clk_scaling_start_busy(hba);
+
+	spin_lock_irqsave(&hba->outstanding_lock, flags);
+	ufshcd_vops_setup_xfer_req(hba, task_tag, (lrbp->cmd ? true : false));
 	__set_bit(task_tag, &hba->outstanding_reqs);
 	ufshcd_writel(hba, 1 << task_tag, REG_UTP_TRANSFER_REQ_DOOR_BELL);
 	/* Make sure that doorbell is committed immediately */
 	wmb();
+	spin_unlock_irqrestore(&hba->outstanding_lock, flags);
+
 	ufshcd_add_command_trace(hba, task_tag, "send");
 }
 
@@ -2188,6 +2352,8 @@ static void ufshcd_prepare_req_desc_hdr(struct ufshcd_lrb *lrbp,
 	struct utp_transfer_req_desc *req_desc = lrbp->utr_descriptor_ptr;
 	u32 data_direction;
 	u32 dword_0;
+	u32 dword_1 = 0;
+	u32 dword_3 = 0;
 
 	if (cmd_dir == DMA_FROM_DEVICE) {
 		data_direction = UTP_DEVICE_TO_HOST;
@@ -2205,10 +2371,13 @@ static void ufshcd_prepare_req_desc_hdr(struct ufshcd_lrb *lrbp,
 	if (lrbp->intr_cmd)
 		dword_0 |= UTP_REQ_DESC_INT_CMD;
 
+	/* Keyslot and data unit number, if the data is en/decrypted inline */
+	ufshcd_prepare_req_desc_hdr_crypto(lrbp, &dword_0, &dword_1, &dword_3);
+
 	/* Transfer request descriptor header fields */
 	req_desc->header.dword_0 = cpu_to_le32(dword_0);
-	/* dword_1 is reserved, hence it is set to 0 */
-	req_desc->header.dword_1 = 0;
+	/* dword_1 is the low half of the DUN, otherwise reserved */
+	req_desc->header.dword_1 = cpu_to_le32(dword_1);
 	/*
 	 * assigning invalid value for command status. Controller
 	 * updates OCS on command completion, with the command
@@ -2216,8 +2385,8 @@ static void ufshcd_prepare_req_desc_hdr(struct ufshcd_lrb *lrbp,
 	 */
 	req_desc->header.dword_2 =
 		cpu_to_le32(OCS_INVALID_COMMAND_STATUS);
-	/* dword_3 is reserved, hence it is set to 0 */
-	req_desc->header.dword_3 = 0;
+	/* dword_3 is the high half of the DUN, otherwise reserved */
+	req_desc->header.dword_3 = cpu_to_le32(dword_3);
 
 	req_desc->prd_table_length = 0;
 }
@@ -2389,7 +2558,7 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 {
 	struct ufshcd_lrb *lrbp;
 	struct ufs_hba *hba;
-	unsigned long flags;
+	bool burst;
 	int tag;
 	int err = 0;
 
@@ -2406,33 +2575,36 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 	if (!down_read_trylock(&hba->clk_scaling_lock))
 		return SCSI_MLQUEUE_HOST_BUSY;
 
-	spin_lock_irqsave(hba->host->host_lock, flags);
-	switch (hba->ufshcd_state) {
+	/*
+	 * No need for host_lock here: the error handler blocks the SCSI
+	 * requests before changing the state, and aborts or resets whatever
+	 * was issued before that.
+	 */
+	switch (READ_ONCE(hba->ufshcd_state)) {
 	case UFSHCD_STATE_OPERATIONAL:
 		break;
 	case UFSHCD_STATE_EH_SCHEDULED:
 	case UFSHCD_STATE_RESET:
 		err = SCSI_MLQUEUE_HOST_BUSY;
-		goto out_unlock;
+		goto out;
 	case UFSHCD_STATE_ERROR:
 		set_host_byte(cmd, DID_ERROR);
 		cmd->scsi_done(cmd);
-		goto out_unlock;
+		goto out;
 	default:
 		dev_WARN_ONCE(hba->dev, 1, "%s: invalid state %d\n",
 				__func__, hba->ufshcd_state);
 		set_host_byte(cmd, DID_BAD_TARGET);
 		cmd->scsi_done(cmd);
-		goto out_unlock;
+		goto out;
 	}
 
 	/* if error handling is in progress, don't issue commands */
 	if (ufshcd_eh_in_progress(hba)) {
 		set_host_byte(cmd, DID_ERROR);
 		cmd->scsi_done(cmd);
-		goto out_unlock;
+		goto out;
 	}
-	spin_unlock_irqrestore(hba->host->host_lock, flags);
 
 	hba->req_abort_count = 0;
 
@@ -2448,6 +2620,8 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 		goto out;
 	}
 
+	burst = ufshcd_io_burst_hint(hba, cmd);
+
 	err = ufshcd_hold(hba, true);
 	if (err) {
 		err = SCSI_MLQUEUE_HOST_BUSY;
@@ -2467,6 +2641,8 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 	lrbp->intr_cmd = !ufshcd_is_intr_aggr_allowed(hba) ? true : false;
 	lrbp->req_abort_skip = false;
 
+	ufshcd_prepare_lrbp_crypto(hba, cmd->request, lrbp);
+
 	ufshcd_comp_scsi_upiu(hba, lrbp);
 
 	err = ufshcd_map_sg(hba, lrbp);
@@ -2479,11 +2655,10 @@ static int ufshcd_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *cmd)
 	wmb();
 
 	/* issue command to the controller */
-	spin_lock_irqsave(hba->host->host_lock, flags);
-	ufshcd_vops_setup_xfer_req(hba, tag, (lrbp->cmd ? true : false));
 	ufshcd_send_command(hba, tag);
-out_unlock:
-	spin_unlock_irqrestore(hba->host->host_lock, flags);
+	/* after the busy period started, which resumes scaling if suspended */
+	if (burst)
+		ufshcd_io_burst_boost(hba);
 out:
 	up_read(&hba->clk_scaling_lock);
 	return err;
@@ -2498,6 +2673,7 @@ static int ufshcd_compose_dev_cmd(struct ufs_hba *hba,
 	lrbp->task_tag = tag;
 	lrbp->lun = 0; /* device management cmd is not specific to any LUN */
 	lrbp->intr_cmd = true; /* No interrupt aggregation */
+	ufshcd_prepare_lrbp_crypto(hba, NULL, lrbp);
 	hba->dev_cmd.type = cmd_type;
 
 	return ufshcd_comp_devman_upiu(hba, lrbp);
@@ -2673,7 +2849,6 @@ static int ufshcd_exec_dev_cmd(struct ufs_hba *hba,
 	int err;
 	int tag;
 	struct completion wait;
-	unsigned long flags;
 
 	down_read(&hba->clk_scaling_lock);
 
@@ -2696,10 +2871,7 @@ static int ufshcd_exec_dev_cmd(struct ufs_hba *hba,
 	ufshcd_add_query_upiu_trace(hba, tag, "query_send");
 	/* Make sure descriptors are ready before ringing the doorbell */
 	wmb();
-	spin_lock_irqsave(hba->host->host_lock, flags);
-	ufshcd_vops_setup_xfer_req(hba, tag, (lrbp->cmd ? true : false));
 	ufshcd_send_command(hba, tag);
-	spin_unlock_irqrestore(hba->host->host_lock, flags);
 
 	err = ufshcd_wait_for_dev_cmd(hba, lrbp, timeout);
 
@@ -4286,6 +4458,10 @@ static int ufshcd_hba_enable(struct ufs_hba *hba)
 		ret = ufshcd_hba_execute_hce(hba);
 	}
 
+	/* The controller reset cleared the keys, program them again */
+	if (!ret)
+		ufshcd_crypto_restore_keys(hba);
+
 	return ret;
 }
 static int ufshcd_disable_tx_lcc(struct ufs_hba *hba, bool peer)
@@ -4582,11 +4758,14 @@ static int ufshcd_change_queue_depth(struct scsi_device *sdev, int depth)
  */
 static int ufshcd_slave_configure(struct scsi_device *sdev)
 {
+	struct ufs_hba *hba = shost_priv(sdev->host);
 	struct request_queue *q = sdev->request_queue;
 
 	blk_queue_update_dma_pad(q, PRDT_DATA_BYTE_COUNT_PAD - 1);
 	blk_queue_max_segment_size(q, PRDT_DATA_BYTE_COUNT_MAX);
 
+	ufshcd_crypto_setup_rq_keyslot_manager(hba, q);
+
 	return 0;
 }
 
@@ -4798,7 +4977,8 @@ static void ufshcd_uic_cmd_compl(struct ufs_hba *hba, u32 intr_status)
 /**
  * __ufshcd_transfer_req_compl - handle SCSI and query command completion
  * @hba: per adapter instance
- * @completed_reqs: requests to complete
+ * @completed_reqs: requests to complete, already cleared from
+ *	outstanding_reqs
  */
 static void __ufshcd_transfer_req_compl(struct ufs_hba *hba,
 					unsigned long completed_reqs)
@@ -4836,9 +5016,6 @@ static void __ufshcd_transfer_req_compl(struct ufs_hba *hba,
 		lrbp->compl_time_stamp = ktime_get();
 	}
 
-	/* clear corresponding bits of completed commands */
-	hba->outstanding_reqs ^= completed_reqs;
-
 	ufshcd_clk_scaling_update_busy(hba);
 
 	/* we might have free'd some tags above */
@@ -4852,6 +5029,7 @@ static void __ufshcd_transfer_req_compl(struct ufs_hba *hba,
 static void ufshcd_transfer_req_compl(struct ufs_hba *hba)
 {
 	unsigned long completed_reqs;
+	unsigned long flags;
 	u32 tr_doorbell;
 
 	/* Resetting interrupt aggregation counters first and reading the
@@ -4865,8 +5043,16 @@ static void ufshcd_transfer_req_compl(struct ufs_hba *hba)
 	    !(hba->quirks & UFSHCI_QUIRK_SKIP_RESET_INTR_AGGR))
 		ufshcd_reset_intr_aggr(hba);
 
+	/*
+	 * The doorbell and outstanding_reqs must be read together, a command
+	 * issued in between would otherwise be taken for completed.
+	 */
+	spin_lock_irqsave(&hba->outstanding_lock, flags);
 	tr_doorbell = ufshcd_readl(hba, REG_UTP_TRANSFER_REQ_DOOR_BELL);
 	completed_reqs = tr_doorbell ^ hba->outstanding_reqs;
+	/* clear corresponding bits of completed commands */
+	hba->outstanding_reqs &= ~completed_reqs;
+	spin_unlock_irqrestore(&hba->outstanding_lock, flags);
 
 	__ufshcd_transfer_req_compl(hba, completed_reqs);
 }
@@ -5345,9 +5531,11 @@ static void ufshcd_err_handler(struct work_struct *work)
 		 * If there is no slot empty at this moment then free up last
 		 * slot forcefully.
 		 */
-		if (hba->outstanding_reqs == max_doorbells)
+		if (hba->outstanding_reqs == max_doorbells) {
+			ufshcd_outstanding_req_clear(hba, hba->nutrs - 1);
 			__ufshcd_transfer_req_compl(hba,
 						    (1UL << (hba->nutrs - 1)));
+		}
 
 		spin_unlock_irqrestore(hba->host->host_lock, flags);
 		err = ufshcd_reset_and_restore(hba);
@@ -7494,6 +7682,7 @@ static int ufshcd_suspend(struct ufs_hba *hba, enum ufs_pm_op pm_op)
 	if (hba->clk_scaling.is_allowed) {
 		cancel_work_sync(&hba->clk_scaling.suspend_work);
 		cancel_work_sync(&hba->clk_scaling.resume_work);
+		cancel_work_sync(&hba->clk_scaling.boost_work);
 		ufshcd_suspend_clkscaling(hba);
 	}
 
@@ -7892,9 +8081,11 @@ void ufshcd_remove(struct ufs_hba *hba)
 	ufshcd_disable_intr(hba, hba->intr_mask);
 	ufshcd_hba_stop(hba, true);
 
+	ufshcd_exit_io_burst(hba);
 	ufshcd_exit_clk_gating(hba);
 	if (ufshcd_is_clkscaling_supported(hba))
 		device_remove_file(hba->dev, &hba->clk_scaling.enable_attr);
+	ufshcd_crypto_destroy_keyslot_manager(hba);
 	ufshcd_hba_exit(hba);
 }
 EXPORT_SYMBOL_GPL(ufshcd_remove);
@@ -8003,6 +8194,11 @@ int ufshcd_init(struct ufs_hba *hba, void __iomem *mmio_base, unsigned int irq)
 	/* Read capabilities registers */
 	ufshcd_hba_capabilities(hba);
 
+	/* Inline encryption is optional, go on without it if it fails */
+	err = ufshcd_hba_init_crypto(hba);
+	if (err)
+		dev_err(hba->dev, "crypto setup failed %d\n", err);
+
 	/* Get UFS version supported by the controller */
 	hba->ufs_version = ufshcd_get_ufs_version(hba);
 
@@ -8061,7 +8257,11 @@ int ufshcd_init(struct ufs_hba *hba, void __iomem *mmio_base, unsigned int irq)
 	/* Initialize device management tag acquire wait queue */
 	init_waitqueue_head(&hba->dev_cmd.tag_wq);
 
+	/* Initialize lock of outstanding_reqs and the transfer doorbell */
+	spin_lock_init(&hba->outstanding_lock);
+
 	ufshcd_init_clk_gating(hba);
+	ufshcd_init_io_burst(hba);
 
 	/*
 	 * In order to avoid any spurious interrupt immediately after
@@ -8108,6 +8308,8 @@ int ufshcd_init(struct ufs_hba *hba, void __iomem *mmio_base, unsigned int irq)
 			  ufshcd_clk_scaling_suspend_work);
 		INIT_WORK(&hba->clk_scaling.resume_work,
 			  ufshcd_clk_scaling_resume_work);
+		INIT_WORK(&hba->clk_scaling.boost_work,
+			  ufshcd_clk_scaling_boost_work);
 
 		snprintf(wq_name, sizeof(wq_name), "ufs_clkscaling_%d",
 			 host->host_no);
@@ -8153,6 +8355,7 @@ int ufshcd_init(struct ufs_hba *hba, void __iomem *mmio_base, unsigned int irq)
 out_remove_scsi_host:
 	scsi_remove_host(hba->host);
 exit_gating:
+	ufshcd_exit_io_burst(hba);
 	ufshcd_exit_clk_gating(hba);
 out_disable:
 	hba->is_irq_enabled = false;
@@ -168,6 +168,10 @@ struct ufs_pm_lvl_states {
  * @issue_time_stamp: time stamp for debug purposes
  * @compl_time_stamp: time stamp for statistics
  * @req_abort_skip: skip request abort task flag
+ * @crypto_enable: whether the controller en/decrypts the data inline
+ * @crypto_key_slot: the keyslot of the key, if @crypto_enable
+ * @data_unit_num: the data unit number of the first data unit, if
+ *		   @crypto_enable
  */
 struct ufshcd_lrb {
 	struct utp_transfer_req_desc *utr_descriptor_ptr;
@@ -193,6 +197,12 @@ struct ufshcd_lrb {
 	ktime_t compl_time_stamp;
 
 	bool req_abort_skip;
+
+#ifdef CONFIG_SCSI_UFS_CRYPTO
+	bool crypto_enable;
+	u8 crypto_key_slot;
+	u64 data_unit_num;
+#endif
 };
 
 /**
@@ -365,6 +375,25 @@ struct ufs_clk_gating {
 	struct workqueue_struct *clk_gating_workq;
 };
 
+/**
+ * struct ufs_io_burst - foreground read burst hint
+ * @window_ms: expected duration of a burst in ms, 0 disables the hint
+ * @start: start (in jiffies) of the current or last burst
+ * @end: end (in jiffies) of the current or last burst
+ * @window_attr: sysfs attribute to control window_ms
+ *
+ * A foreground read issued while more synchronous requests are queued
+ * behind it starts a burst. Clocks are scaled up right away instead of at
+ * the next devfreq poll, and they are not gated, nor the link put in
+ * hibern8, before the end of the burst.
+ */
+struct ufs_io_burst {
+	unsigned int window_ms;
+	unsigned long start;
+	unsigned long end;
+	struct device_attribute window_attr;
+};
+
 struct ufs_saved_pwr_info {
 	struct ufs_pa_layer_attr info;
 	bool is_valid;
@@ -384,6 +413,7 @@ struct ufs_saved_pwr_info {
  * @workq: workqueue to schedule devfreq suspend/resume work
  * @suspend_work: worker to suspend devfreq
  * @resume_work: worker to resume devfreq
+ * @boost_work: worker to scale up ahead of devfreq when a read burst starts
  * @is_allowed: tracks if scaling is currently allowed or not
  * @is_busy_started: tracks if busy period has started or not
  * @is_suspended: tracks if devfreq is suspended or not
@@ -398,6 +428,7 @@ struct ufs_clk_scaling {
 	struct workqueue_struct *workq;
 	struct work_struct suspend_work;
 	struct work_struct resume_work;
+	struct work_struct boost_work;
 	bool is_allowed;
 	bool is_busy_started;
 	bool is_suspended;
@@ -462,6 +493,8 @@ struct ufs_stats {
  * @lrb_in_use: lrb in use
  * @outstanding_tasks: Bits representing outstanding task requests
  * @outstanding_reqs: Bits representing outstanding transfer requests
+ * @outstanding_lock: Protects @outstanding_reqs and the transfer request
+ *	doorbell, so that commands are issued and completed without host_lock
  * @capabilities: UFS Controller Capabilities
  * @nutrs: Transfer Request Queue depth supported by controller
  * @nutmrs: Task Management Queue depth supported by controller
@@ -541,6 +574,7 @@ struct ufs_hba {
 
 	unsigned long outstanding_tasks;
 	unsigned long outstanding_reqs;
+	spinlock_t outstanding_lock;
 
 	u32 capabilities;
 	int nutrs;
@@ -691,9 +725,16 @@ struct ufs_hba {
 	 * the performance of ongoing read/write operations.
 	 */
 #define UFSHCD_CAP_KEEP_AUTO_BKOPS_ENABLED_EXCEPT_SUSPEND (1 << 5)
+	/*
+	 * This capability allows the host controller to en/decrypt data
+	 * inline, set when the controller advertises standard UFSHCI crypto
+	 * support and its keyslot manager was set up.
+	 */
+#define UFSHCD_CAP_CRYPTO (1 << 6)
 
 	struct devfreq *devfreq;
 	struct ufs_clk_scaling clk_scaling;
+	struct ufs_io_burst io_burst;
 	bool is_sys_suspended;
 
 	enum bkops_status urgent_bkops_lvl;
@@ -702,6 +743,16 @@ struct ufs_hba {
 	struct rw_semaphore clk_scaling_lock;
 	struct ufs_desc_size desc_size;
 	atomic_t scsi_block_reqs_cnt;
+
+#ifdef CONFIG_SCSI_UFS_CRYPTO
+	/* Crypto capabilities and configuration, see ufshcd-crypto.c */
+	union ufs_crypto_capabilities crypto_capabilities;
+	union ufs_crypto_cap_entry *crypto_cap_array;
+	u32 crypto_cfg_register;
+	union ufs_crypto_cfg_entry *crypto_cfgs;
+	spinlock_t crypto_cfg_lock;
+	struct keyslot_manager *ksm;
+#endif
 };
 
 /* Returns true if clocks can be gated. Otherwise false */
@@ -15,15 +15,19 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/falloc.h>
+#include <linux/interval_tree.h>
 #include <linux/miscdevice.h>
 #include <linux/security.h>
 #include <linux/mm.h>
 #include <linux/mman.h>
+#include <linux/mount.h>
+#include <linux/huge_mm.h>
 #include <linux/uaccess.h>
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
 #include <linux/shmem_fs.h>
+#include <linux/wait.h>
 #include "ashmem.h"
 
 #define ASHMEM_NAME_PREFIX "dev/ashmem/"
@@ -33,10 +37,11 @@
 /**
  * struct ashmem_area - The anonymous shared memory area
  * @name:		The optional name in /proc/pid/maps
- * @unpinned_list:	The list of all ashmem areas
+ * @unpinned:		Interval tree of the area's unpinned ranges
  * @file:		The shmem-based backing file
  * @size:		The size of the mapping, in bytes
  * @prot_mask:		The allowed protection bits, as vm_flags
+ * @huge:		Back the area with transparent huge pages if possible
  *
  * The lifecycle of this structure is from our parent file's open() until
  * its release(). It is also protected by 'ashmem_mutex'
@@ -45,33 +50,37 @@
  */
 struct ashmem_area {
 	char name[ASHMEM_FULL_NAME_LEN];
-	struct list_head unpinned_list;
+	struct rb_root_cached unpinned;
 	struct file *file;
 	size_t size;
 	unsigned long prot_mask;
+	bool huge;
 };
 
 /**
  * struct ashmem_range - A range of unpinned/evictable pages
  * @lru:	         The entry in the LRU list
- * @unpinned:	         The entry in its area's unpinned list
+ * @unpinned:	         The entry in its area's unpinned tree, spanning
+ *			 the starting page up to the ending page (inclusive)
  * @asma:	         The associated anonymous shared memory area.
- * @pgstart:	         The starting page (inclusive)
- * @pgend:	         The ending page (inclusive)
  * @purged:	         The purge status (ASHMEM_NOT or ASHMEM_WAS_PURGED)
  *
- * The lifecycle of this structure is from unpin to pin.
+ * The ranges of an area never overlap, so the tree is also sorted by
+ * ending page. The lifecycle of this structure is from unpin to pin.
  * It is protected by 'ashmem_mutex'
  */
 struct ashmem_range {
 	struct list_head lru;
-	struct list_head unpinned;
+	struct interval_tree_node unpinned;
 	struct ashmem_area *asma;
-	size_t pgstart;
-	size_t pgend;
 	unsigned int purged;
 };
 
+#define range_pgstart(range)	((range)->unpinned.start)
+#define range_pgend(range)	((range)->unpinned.last)
+#define to_ashmem_range(node)	container_of(node, struct ashmem_range, \
+					     unpinned)
+
 /* LRU list of unpinned pages, protected by ashmem_mutex */
 static LIST_HEAD(ashmem_lru_list);
 
@@ -89,12 +98,26 @@ static unsigned long lru_count;
  */
 static DEFINE_MUTEX(ashmem_mutex);
 
+/*
+ * The shrinker drops ashmem_mutex while punching holes, pin and unpin
+ * wait here until no purge is in flight so they see its final result.
+ */
+static atomic_t ashmem_shrink_inflight = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(ashmem_shrink_wait);
+
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
+/*
+ * Private tmpfs mount with huge=within_size, backing areas that asked for
+ * ASHMEM_SET_HUGE. NULL if huge pages are unavailable, in which case such
+ * areas quietly use the regular shmem mount.
+ */
+static struct vfsmount *ashmem_huge_mnt __read_mostly;
+
 static inline unsigned long range_size(struct ashmem_range *range)
 {
-	return range->pgend - range->pgstart + 1;
+	return range_pgend(range) - range_pgstart(range) + 1;
 }
 
 static inline bool range_on_lru(struct ashmem_range *range)
@@ -105,30 +128,13 @@ static inline bool range_on_lru(struct ashmem_range *range)
 static inline bool page_range_subsumes_range(struct ashmem_range *range,
 					     size_t start, size_t end)
 {
-	return (range->pgstart >= start) && (range->pgend <= end);
+	return (range_pgstart(range) >= start) && (range_pgend(range) <= end);
 }
 
 static inline bool page_range_subsumed_by_range(struct ashmem_range *range,
 						size_t start, size_t end)
 {
-	return (range->pgstart <= start) && (range->pgend >= end);
-}
-
-static inline bool page_in_range(struct ashmem_range *range, size_t page)
-{
-	return (range->pgstart <= page) && (range->pgend >= page);
-}
-
-static inline bool page_range_in_range(struct ashmem_range *range,
-				       size_t start, size_t end)
-{
-	return page_in_range(range, start) || page_in_range(range, end) ||
-		page_range_subsumes_range(range, start, end);
-}
-
-static inline bool range_before_page(struct ashmem_range *range, size_t page)
-{
-	return range->pgend < page;
+	return (range_pgstart(range) <= start) && (range_pgend(range) >= end);
 }
 
 #define PROT_MASK		(PROT_EXEC | PROT_READ | PROT_WRITE)
@@ -162,7 +168,6 @@ static inline void lru_del(struct ashmem_range *range)
 /**
  * range_alloc() - Allocates and initializes a new ashmem_range structure
  * @asma:	   The associated ashmem_area
- * @prev_range:	   The previous ashmem_range in the sorted asma->unpinned list
  * @purged:	   Initial purge status (ASMEM_NOT_PURGED or ASHMEM_WAS_PURGED)
  * @start:	   The starting page (inclusive)
  * @end:	   The ending page (inclusive)
@@ -171,8 +176,7 @@ static inline void lru_del(struct ashmem_range *range)
  *
  * Return: 0 if successful, or -ENOMEM if there is an error
  */
-static int range_alloc(struct ashmem_area *asma,
-		       struct ashmem_range *prev_range, unsigned int purged,
+static int range_alloc(struct ashmem_area *asma, unsigned int purged,
 		       size_t start, size_t end)
 {
 	struct ashmem_range *range;
@@ -182,11 +186,11 @@ static int range_alloc(struct ashmem_area *asma,
 		return -ENOMEM;
 
 	range->asma = asma;
-	range->pgstart = start;
-	range->pgend = end;
+	range_pgstart(range) = start;
+	range_pgend(range) = end;
 	range->purged = purged;
 
-	list_add_tail(&range->unpinned, &prev_range->unpinned);
+	interval_tree_insert(&range->unpinned, &asma->unpinned);
 
 	if (range_on_lru(range))
 		lru_add(range);
@@ -200,7 +204,7 @@ static int range_alloc(struct ashmem_area *asma,
  */
 static void range_del(struct ashmem_range *range)
 {
-	list_del(&range->unpinned);
+	interval_tree_remove(&range->unpinned, &range->asma->unpinned);
 	if (range_on_lru(range))
 		lru_del(range);
 	kmem_cache_free(ashmem_range_cachep, range);
@@ -223,8 +227,11 @@ static inline void range_shrink(struct ashmem_range *range,
 {
 	size_t pre = range_size(range);
 
-	range->pgstart = start;
-	range->pgend = end;
+	/* the tree is augmented on the bounds, so take the node out first */
+	interval_tree_remove(&range->unpinned, &range->asma->unpinned);
+	range_pgstart(range) = start;
+	range_pgend(range) = end;
+	interval_tree_insert(&range->unpinned, &range->asma->unpinned);
 
 	if (range_on_lru(range))
 		lru_count -= pre - range_size(range);
@@ -253,7 +260,7 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	if (!asma)
 		return -ENOMEM;
 
-	INIT_LIST_HEAD(&asma->unpinned_list);
+	asma->unpinned = RB_ROOT_CACHED;
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
 	file->private_data = asma;
@@ -272,11 +279,11 @@ static int ashmem_open(struct inode *inode, struct file *file)
 static int ashmem_release(struct inode *ignored, struct file *file)
 {
 	struct ashmem_area *asma = file->private_data;
-	struct ashmem_range *range, *next;
+	struct interval_tree_node *node;
 
 	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
-		range_del(range);
+	while ((node = interval_tree_iter_first(&asma->unpinned, 0, ULONG_MAX)))
+		range_del(to_ashmem_range(node));
 	mutex_unlock(&ashmem_mutex);
 
 	if (asma->file)
@@ -388,7 +395,13 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 			name = asma->name;
 
 		/* ... and allocate the backing shmem file */
-		vmfile = shmem_file_setup(name, asma->size, vma->vm_flags);
+		if (asma->huge && ashmem_huge_mnt)
+			vmfile = shmem_file_setup_with_mnt(ashmem_huge_mnt, name,
+							   asma->size,
+							   vma->vm_flags);
+		else
+			vmfile = shmem_file_setup(name, asma->size,
+						  vma->vm_flags);
 		if (IS_ERR(vmfile)) {
 			ret = PTR_ERR(vmfile);
 			goto out;
@@ -421,6 +434,87 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Huge areas want a PMD aligned address so that the shmem fault path can
+ * map whole huge pages. This mirrors shmem_get_unmapped_area(), which we
+ * cannot call as the ashmem file is not a shmem file.
+ */
+static unsigned long ashmem_get_unmapped_area(struct file *file,
+					      unsigned long uaddr,
+					      unsigned long len,
+					      unsigned long pgoff,
+					      unsigned long flags)
+{
+	struct ashmem_area *asma = file->private_data;
+	unsigned long (*get_area)(struct file *, unsigned long, unsigned long,
+				  unsigned long, unsigned long);
+	unsigned long addr, offset, inflated_len, inflated_addr;
+	unsigned long inflated_offset;
+
+	get_area = current->mm->get_unmapped_area;
+	addr = get_area(file, uaddr, len, pgoff, flags);
+
+	if (!READ_ONCE(asma->huge) || !ashmem_huge_mnt)
+		return addr;
+	if (IS_ERR_VALUE(addr) || (addr & ~PAGE_MASK))
+		return addr;
+	if ((flags & MAP_FIXED) || len < HPAGE_PMD_SIZE)
+		return addr;
+
+	offset = (pgoff << PAGE_SHIFT) & (HPAGE_PMD_SIZE - 1);
+	if ((addr & (HPAGE_PMD_SIZE - 1)) == offset)
+		return addr;
+
+	inflated_len = len + HPAGE_PMD_SIZE - PAGE_SIZE;
+	if (inflated_len > TASK_SIZE || inflated_len < len)
+		return addr;
+
+	inflated_addr = get_area(NULL, uaddr, inflated_len, 0, flags);
+	if (IS_ERR_VALUE(inflated_addr) || (inflated_addr & ~PAGE_MASK))
+		return addr;
+
+	inflated_offset = inflated_addr & (HPAGE_PMD_SIZE - 1);
+	inflated_addr += offset - inflated_offset;
+	if (inflated_offset > offset)
+		inflated_addr += HPAGE_PMD_SIZE;
+
+	if (inflated_addr > TASK_SIZE - len)
+		return addr;
+
+	return inflated_addr;
+}
+
+static void __init ashmem_huge_init(void)
+{
+	struct file_system_type *type;
+	struct vfsmount *mnt;
+	char options[] = "huge=within_size";
+
+	if (!has_transparent_hugepage())
+		return;
+
+	type = get_fs_type("tmpfs");
+	if (!type)
+		return;
+
+	mnt = kern_mount_data(type, options);
+	put_filesystem(type);
+	if (IS_ERR(mnt)) {
+		pr_warn("no huge page backing: %ld\n", PTR_ERR(mnt));
+		return;
+	}
+
+	ashmem_huge_mnt = mnt;
+}
+#else
+#define ashmem_get_unmapped_area	NULL
+
+static inline void ashmem_huge_init(void)
+{
+}
+#endif
+
 /*
  * ashmem_shrink - our cache shrinker, called from mm/vmscan.c
  *
@@ -434,11 +528,15 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
  * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
  * pages freed.
+ *
+ * ashmem_mutex is dropped around each hole punch, so unrelated areas are not
+ * stalled behind the filesystem. The range is taken off the LRU and marked
+ * purged before that, and a file reference keeps the backing store alive in
+ * case the area is released meanwhile.
  */
 static unsigned long
 ashmem_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 {
-	struct ashmem_range *range, *next;
 	unsigned long freed = 0;
 
 	/* We might recurse into filesystem code, so bail out if necessary */
@@ -448,21 +546,33 @@ ashmem_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 	if (!mutex_trylock(&ashmem_mutex))
 		return -1;
 
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE;
+	while (!list_empty(&ashmem_lru_list)) {
+		struct ashmem_range *range =
+			list_first_entry(&ashmem_lru_list, typeof(*range), lru);
+		loff_t start = range_pgstart(range) * PAGE_SIZE;
+		loff_t end = (range_pgend(range) + 1) * PAGE_SIZE;
+		struct file *f = range->asma->file;
 
-		range->asma->file->f_op->fallocate(range->asma->file,
-				FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
-				start, end - start);
+		get_file(f);
+		atomic_inc(&ashmem_shrink_inflight);
 		range->purged = ASHMEM_WAS_PURGED;
 		lru_del(range);
 
 		freed += range_size(range);
+		mutex_unlock(&ashmem_mutex);
+		f->f_op->fallocate(f,
+				   FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				   start, end - start);
+		fput(f);
+		if (atomic_dec_and_test(&ashmem_shrink_inflight))
+			wake_up_all(&ashmem_shrink_wait);
+		if (!mutex_trylock(&ashmem_mutex))
+			goto out;
 		if (--sc->nr_to_scan <= 0)
 			break;
 	}
 	mutex_unlock(&ashmem_mutex);
+out:
 	return freed;
 }
 
@@ -584,13 +694,15 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
-	struct ashmem_range *range, *next;
+	struct interval_tree_node *node, *next;
+	struct ashmem_range *range;
 	int ret = ASHMEM_NOT_PURGED;
 
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* moved past last applicable page; we can short circuit */
-		if (range_before_page(range, pgstart))
-			break;
+	node = interval_tree_iter_first(&asma->unpinned, pgstart, pgend);
+	for (; node; node = next) {
+		/* ranges moved out of [pgstart, pgend] are not revisited */
+		next = interval_tree_iter_next(node, pgstart, pgend);
+		range = to_ashmem_range(node);
 
 		/*
 		 * The user can ask us to pin pages that span multiple ranges,
@@ -607,38 +719,34 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 		 *    so we have to update one side of the range and then
 		 *    create a new range for the other side.
 		 */
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret |= range->purged;
-
-			/* Case #1: Easy. Just nuke the whole thing. */
-			if (page_range_subsumes_range(range, pgstart, pgend)) {
-				range_del(range);
-				continue;
-			}
-
-			/* Case #2: We overlap from the start, so adjust it */
-			if (range->pgstart >= pgstart) {
-				range_shrink(range, pgend + 1, range->pgend);
-				continue;
-			}
-
-			/* Case #3: We overlap from the rear, so adjust it */
-			if (range->pgend <= pgend) {
-				range_shrink(range, range->pgstart,
-					     pgstart - 1);
-				continue;
-			}
-
-			/*
-			 * Case #4: We eat a chunk out of the middle. A bit
-			 * more complicated, we allocate a new range for the
-			 * second half and adjust the first chunk's endpoint.
-			 */
-			range_alloc(asma, range, range->purged,
-				    pgend + 1, range->pgend);
-			range_shrink(range, range->pgstart, pgstart - 1);
-			break;
+		ret |= range->purged;
+
+		/* Case #1: Easy. Just nuke the whole thing. */
+		if (page_range_subsumes_range(range, pgstart, pgend)) {
+			range_del(range);
+			continue;
+		}
+
+		/* Case #2: We overlap from the start, so adjust it */
+		if (range_pgstart(range) >= pgstart) {
+			range_shrink(range, pgend + 1, range_pgend(range));
+			continue;
 		}
+
+		/* Case #3: We overlap from the rear, so adjust it */
+		if (range_pgend(range) <= pgend) {
+			range_shrink(range, range_pgstart(range), pgstart - 1);
+			continue;
+		}
+
+		/*
+		 * Case #4: We eat a chunk out of the middle. A bit
+		 * more complicated, we allocate a new range for the
+		 * second half and adjust the first chunk's endpoint.
+		 */
+		range_alloc(asma, range->purged, pgend + 1, range_pgend(range));
+		range_shrink(range, range_pgstart(range), pgstart - 1);
+		break;
 	}
 
 	return ret;
@@ -651,31 +759,32 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
-	struct ashmem_range *range, *next;
+	struct interval_tree_node *node, *next;
+	struct ashmem_range *range;
 	unsigned int purged = ASHMEM_NOT_PURGED;
+	size_t start = pgstart, end = pgend;
 
-restart:
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* short circuit: this is our insertion point */
-		if (range_before_page(range, pgstart))
-			break;
+	/*
+	 * The user can ask us to unpin pages that are already entirely
+	 * or partially unpinned. We handle those two cases here. Ranges
+	 * never overlap each other, so merging the ones that overlap the
+	 * request cannot make the result overlap any further range.
+	 */
+	node = interval_tree_iter_first(&asma->unpinned, pgstart, pgend);
+	for (; node; node = next) {
+		next = interval_tree_iter_next(node, pgstart, pgend);
+		range = to_ashmem_range(node);
 
-		/*
-		 * The user can ask us to unpin pages that are already entirely
-		 * or partially pinned. We handle those two cases here.
-		 */
 		if (page_range_subsumed_by_range(range, pgstart, pgend))
 			return 0;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			pgstart = min(range->pgstart, pgstart);
-			pgend = max(range->pgend, pgend);
-			purged |= range->purged;
-			range_del(range);
-			goto restart;
-		}
+
+		start = min_t(size_t, range_pgstart(range), start);
+		end = max_t(size_t, range_pgend(range), end);
+		purged |= range->purged;
+		range_del(range);
 	}
 
-	return range_alloc(asma, range, purged, pgstart, pgend);
+	return range_alloc(asma, purged, start, end);
 }
 
 /*
@@ -687,19 +796,10 @@ static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
 {
-	struct ashmem_range *range;
-	int ret = ASHMEM_IS_PINNED;
+	if (interval_tree_iter_first(&asma->unpinned, pgstart, pgend))
+		return ASHMEM_IS_UNPINNED;
 
-	list_for_each_entry(range, &asma->unpinned_list, unpinned) {
-		if (range_before_page(range, pgstart))
-			break;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret = ASHMEM_IS_UNPINNED;
-			break;
-		}
-	}
-
-	return ret;
+	return ASHMEM_IS_PINNED;
 }
 
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
@@ -713,6 +813,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		return -EFAULT;
 
 	mutex_lock(&ashmem_mutex);
+	wait_event(ashmem_shrink_wait, !atomic_read(&ashmem_shrink_inflight));
 
 	if (!asma->file)
 		goto out_unlock;
@@ -781,6 +882,19 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case ASHMEM_GET_PROT_MASK:
 		ret = asma->prot_mask;
 		break;
+	case ASHMEM_SET_HUGE:
+		ret = -EINVAL;
+		mutex_lock(&ashmem_mutex);
+		if (!asma->file) {
+			ret = 0;
+			WRITE_ONCE(asma->huge, !!arg);
+		}
+		mutex_unlock(&ashmem_mutex);
+		break;
+	case ASHMEM_GET_HUGE:
+		/* report whether huge backing is actually in effect */
+		ret = asma->huge && ashmem_huge_mnt;
+		break;
 	case ASHMEM_PIN:
 	case ASHMEM_UNPIN:
 	case ASHMEM_GET_PIN_STATUS:
@@ -842,6 +956,7 @@ static const struct file_operations ashmem_fops = {
 	.read_iter = ashmem_read_iter,
 	.llseek = ashmem_llseek,
 	.mmap = ashmem_mmap,
+	.get_unmapped_area = ashmem_get_unmapped_area,
 	.unlocked_ioctl = ashmem_ioctl,
 #ifdef CONFIG_COMPAT
 	.compat_ioctl = compat_ashmem_ioctl,
@@ -877,6 +992,8 @@ static int __init ashmem_init(void)
 		goto out_free1;
 	}
 
+	ashmem_huge_init();
+
 	ret = misc_register(&ashmem_misc);
 	if (ret) {
 		pr_err("failed to register misc device!\n");
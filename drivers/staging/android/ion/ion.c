@@ -195,10 +195,19 @@ static void free_duped_table(struct sg_table *table)
 	kfree(table);
 }
 
+/*
+ * The DMA mapping of an attachment is kept across unmap/map cycles as
+ * long as the direction does not change, so that importers mapping the
+ * buffer for every frame do not pay for IOMMU map/unmap each time. Only
+ * the cache maintenance that the real unmap/map would do is performed.
+ * @mapped and @dir are protected by the buffer lock.
+ */
 struct ion_dma_buf_attachment {
 	struct device *dev;
 	struct sg_table *table;
 	struct list_head list;
+	bool mapped;
+	enum dma_data_direction dir;
 };
 
 static int ion_dma_buf_attach(struct dma_buf *dmabuf,
@@ -240,6 +249,10 @@ static void ion_dma_buf_detatch(struct dma_buf *dmabuf,
 	mutex_lock(&buffer->lock);
 	list_del(&a->list);
 	mutex_unlock(&buffer->lock);
+	/* the CPU already owns the buffer since the last unmap */
+	if (a->mapped)
+		dma_unmap_sg_attrs(a->dev, a->table->sgl, a->table->nents,
+				   a->dir, DMA_ATTR_SKIP_CPU_SYNC);
 	free_duped_table(a->table);
 
 	kfree(a);
@@ -249,13 +262,33 @@ static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 					enum dma_data_direction direction)
 {
 	struct ion_dma_buf_attachment *a = attachment->priv;
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
 	struct sg_table *table;
 
 	table = a->table;
 
+	mutex_lock(&buffer->lock);
+	if (a->mapped && a->dir == direction) {
+		dma_sync_sg_for_device(a->dev, table->sgl, table->nents,
+				       direction);
+		goto unlock;
+	}
+
+	if (a->mapped) {
+		dma_unmap_sg_attrs(a->dev, table->sgl, table->nents, a->dir,
+				   DMA_ATTR_SKIP_CPU_SYNC);
+		a->mapped = false;
+	}
+
 	if (!dma_map_sg(attachment->dev, table->sgl, table->nents,
-			direction))
-		return ERR_PTR(-ENOMEM);
+			direction)) {
+		table = ERR_PTR(-ENOMEM);
+		goto unlock;
+	}
+	a->mapped = true;
+	a->dir = direction;
+unlock:
+	mutex_unlock(&buffer->lock);
 
 	return table;
 }
@@ -264,7 +297,13 @@ static void ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
 			      struct sg_table *table,
 			      enum dma_data_direction direction)
 {
-	dma_unmap_sg(attachment->dev, table->sgl, table->nents, direction);
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+
+	/* keep the mapping, hand the buffer back to the CPU */
+	mutex_lock(&buffer->lock);
+	dma_sync_sg_for_cpu(attachment->dev, table->sgl, table->nents,
+			    direction);
+	mutex_unlock(&buffer->lock);
 }
 
 static int ion_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
@@ -335,6 +374,8 @@ static int ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 
 	mutex_lock(&buffer->lock);
 	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
 		dma_sync_sg_for_cpu(a->dev, a->table->sgl, a->table->nents,
 				    direction);
 	}
@@ -358,6 +399,8 @@ static int ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 
 	mutex_lock(&buffer->lock);
 	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
 		dma_sync_sg_for_device(a->dev, a->table->sgl, a->table->nents,
 				       direction);
 	}
@@ -366,6 +409,96 @@ static int ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 	return 0;
 }
 
+/*
+ * Sync the entries of a mapped attachment which back @length bytes at
+ * @offset.  The range is clipped on the CPU side of the table: behind an
+ * IOMMU the DMA segments are merged, and only the start of each can be
+ * translated back, while the sg sync ops maintain the cache by sg_phys().
+ */
+static void ion_sgl_sync_range(struct device *dev, struct sg_table *table,
+			       unsigned long offset, unsigned long length,
+			       enum dma_data_direction dir, bool for_cpu)
+{
+	struct scatterlist *sg, *first = NULL;
+	unsigned int i, nents = 0;
+
+	for_each_sg(table->sgl, sg, table->orig_nents, i) {
+		if (offset >= sg->length) {
+			offset -= sg->length;
+			continue;
+		}
+
+		if (!first)
+			first = sg;
+		nents++;
+
+		if (length <= sg->length - offset)
+			break;
+		length -= sg->length - offset;
+		offset = 0;
+	}
+
+	if (!first)
+		return;
+
+	if (for_cpu)
+		dma_sync_sg_for_cpu(dev, first, nents, dir);
+	else
+		dma_sync_sg_for_device(dev, first, nents, dir);
+}
+
+static int ion_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
+						enum dma_data_direction dir,
+						unsigned long offset,
+						unsigned long len)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+	struct ion_dma_buf_attachment *a;
+	void *vaddr;
+	int ret = 0;
+
+	mutex_lock(&buffer->lock);
+	if (buffer->heap->ops->map_kernel) {
+		vaddr = ion_buffer_kmap_get(buffer);
+		if (IS_ERR(vaddr)) {
+			ret = PTR_ERR(vaddr);
+			goto unlock;
+		}
+	}
+
+	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
+		ion_sgl_sync_range(a->dev, a->table, offset, len, dir, true);
+	}
+
+unlock:
+	mutex_unlock(&buffer->lock);
+	return ret;
+}
+
+static int ion_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
+					      enum dma_data_direction dir,
+					      unsigned long offset,
+					      unsigned long len)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+	struct ion_dma_buf_attachment *a;
+
+	mutex_lock(&buffer->lock);
+	if (buffer->heap->ops->map_kernel)
+		ion_buffer_kmap_put(buffer);
+
+	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
+		ion_sgl_sync_range(a->dev, a->table, offset, len, dir, false);
+	}
+	mutex_unlock(&buffer->lock);
+
+	return 0;
+}
+
 static const struct dma_buf_ops dma_buf_ops = {
 	.map_dma_buf = ion_map_dma_buf,
 	.unmap_dma_buf = ion_unmap_dma_buf,
@@ -375,6 +508,8 @@ static const struct dma_buf_ops dma_buf_ops = {
 	.detach = ion_dma_buf_detatch,
 	.begin_cpu_access = ion_dma_buf_begin_cpu_access,
 	.end_cpu_access = ion_dma_buf_end_cpu_access,
+	.begin_cpu_access_partial = ion_dma_buf_begin_cpu_access_partial,
+	.end_cpu_access_partial = ion_dma_buf_end_cpu_access_partial,
 	.map = ion_dma_buf_kmap,
 	.unmap = ion_dma_buf_kunmap,
 };
@@ -13,6 +13,7 @@
 #include <linux/kref.h>
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
+#include <linux/percpu.h>
 #include <linux/rbtree.h>
 #include <linux/sched.h>
 #include <linux/shrinker.h>
@@ -283,6 +284,22 @@ size_t ion_heap_freelist_size(struct ion_heap *heap);
  * many systems
  */
 
+/* Upper bound on the items held in one CPU's pool magazine */
+#define ION_PAGE_POOL_MAG_MAX		16
+
+/**
+ * struct ion_page_pool_mag - per-cpu cache in front of a pool's lists
+ * @lock:		protects the magazine; only contended while the
+ *			shrinker drains it
+ * @count:		number of items in @pages
+ * @pages:		cached items
+ */
+struct ion_page_pool_mag {
+	spinlock_t lock;
+	unsigned int count;
+	struct page *pages[ION_PAGE_POOL_MAG_MAX];
+};
+
 /**
  * struct ion_page_pool - pagepool struct
  * @high_count:		number of highmem items in the pool
@@ -294,6 +311,12 @@ size_t ion_heap_freelist_size(struct ion_heap *heap);
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
+ * @last_shrink:	jiffies of the last shrinker scan, background refill
+ *			holds off for a while after it
+ * @mag_size:		capacity of each per-cpu magazine, 0 if the pool
+ *			has no magazines
+ * @mags:		per-cpu magazines, which serve most allocations and
+ *			frees without taking @mutex
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -309,6 +332,9 @@ struct ion_page_pool {
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	unsigned long last_shrink;
+	unsigned int mag_size;
+	struct ion_page_pool_mag __percpu *mags;
 };
 
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
@@ -326,6 +352,25 @@ void ion_page_pool_free(struct ion_page_pool *pool, struct page *page);
 int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 			 int nr_to_scan);
 
+/**
+ * ion_page_pool_count - number of items in the pool
+ * @pool:		the pool
+ */
+int ion_page_pool_count(struct ion_page_pool *pool);
+
+/**
+ * ion_page_pool_fill - allocate pages into the pool from the background
+ * @pool:		the pool
+ * @nr_items:		number of items the pool should hold
+ *
+ * Allocations neither enter direct reclaim nor retry, and filling stops
+ * early while the shrinker is reclaiming from the pool, so that refill
+ * gives way under memory pressure.
+ *
+ * returns the number of items added
+ */
+int ion_page_pool_fill(struct ion_page_pool *pool, int nr_items);
+
 long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 
 int ion_query_heaps(struct ion_heap_query *query);
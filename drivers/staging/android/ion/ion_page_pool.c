@@ -5,12 +5,28 @@
  * Copyright (C) 2011 Google, Inc.
  */
 
+#include <linux/jiffies.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 
 #include "ion.h"
 
+/* How long background refill backs off after the shrinker ran */
+#define ION_PAGE_POOL_SHRINK_BACKOFF	(5 * HZ)
+
+/*
+ * Bytes one CPU's magazine may hold. Pools whose items are bigger than
+ * this (order 8 with 4K pages) get no magazines at all.
+ */
+#define ION_PAGE_POOL_MAG_BYTES		SZ_256K
+
+/* Items moved between a magazine and the pool lists at once */
+#define ION_PAGE_POOL_MAG_BATCH(pool)	DIV_ROUND_UP((pool)->mag_size, 2)
+
 static inline struct page *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
 {
 	return alloc_pages(pool->gfp_mask, pool->order);
@@ -58,19 +74,113 @@ static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 	return page;
 }
 
+static void ion_page_pool_mag_account(struct ion_page_pool *pool,
+				      struct page *page, int sign)
+{
+	mod_node_page_state(page_pgdat(page), NR_INDIRECTLY_RECLAIMABLE_BYTES,
+			    sign * (1 << (PAGE_SHIFT + pool->order)));
+}
+
+static struct page *ion_page_pool_mag_pop(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_mag *mag;
+	struct page *page = NULL;
+
+	mag = get_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	if (mag->count)
+		page = mag->pages[--mag->count];
+	spin_unlock(&mag->lock);
+	put_cpu_ptr(pool->mags);
+
+	if (page)
+		ion_page_pool_mag_account(pool, page, -1);
+	return page;
+}
+
+/*
+ * Stash @nr items in this CPU's magazine. Returns how many of them did
+ * not fit; those are left at the start of @pages.
+ */
+static int ion_page_pool_mag_push(struct ion_page_pool *pool,
+				  struct page **pages, int nr)
+{
+	struct ion_page_pool_mag *mag;
+	struct page *page;
+
+	mag = get_cpu_ptr(pool->mags);
+	spin_lock(&mag->lock);
+	while (nr && mag->count < pool->mag_size) {
+		page = pages[--nr];
+		mag->pages[mag->count++] = page;
+		ion_page_pool_mag_account(pool, page, 1);
+	}
+	spin_unlock(&mag->lock);
+	put_cpu_ptr(pool->mags);
+
+	return nr;
+}
+
+/* Take up to @nr items out of @mag, from its oldest end */
+static int ion_page_pool_mag_take(struct ion_page_pool *pool,
+				  struct ion_page_pool_mag *mag,
+				  struct page **pages, int nr)
+{
+	int i;
+
+	spin_lock(&mag->lock);
+	nr = min_t(int, nr, mag->count);
+	for (i = 0; i < nr; i++)
+		pages[i] = mag->pages[i];
+	mag->count -= nr;
+	memmove(mag->pages, mag->pages + nr, mag->count * sizeof(*pages));
+	spin_unlock(&mag->lock);
+
+	for (i = 0; i < nr; i++)
+		ion_page_pool_mag_account(pool, pages[i], -1);
+	return nr;
+}
+
+static struct page *ion_page_pool_remove_any(struct ion_page_pool *pool)
+{
+	if (pool->high_count)
+		return ion_page_pool_remove(pool, true);
+	if (pool->low_count)
+		return ion_page_pool_remove(pool, false);
+	return NULL;
+}
+
 struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
 {
+	struct page *pages[ION_PAGE_POOL_MAG_MAX];
 	struct page *page = NULL;
+	int nr = 0;
 
 	BUG_ON(!pool);
 
+	if (pool->mags) {
+		page = ion_page_pool_mag_pop(pool);
+		if (page)
+			return page;
+	}
+
 	mutex_lock(&pool->mutex);
-	if (pool->high_count)
-		page = ion_page_pool_remove(pool, true);
-	else if (pool->low_count)
-		page = ion_page_pool_remove(pool, false);
+	page = ion_page_pool_remove_any(pool);
+	/* refill the magazine while we hold the lock anyway */
+	while (page && pool->mags && nr < ION_PAGE_POOL_MAG_BATCH(pool)) {
+		pages[nr] = ion_page_pool_remove_any(pool);
+		if (!pages[nr])
+			break;
+		nr++;
+	}
 	mutex_unlock(&pool->mutex);
 
+	if (nr) {
+		nr = ion_page_pool_mag_push(pool, pages, nr);
+		while (nr--)
+			ion_page_pool_add(pool, pages[nr]);
+	}
+
 	if (!page)
 		page = ion_page_pool_alloc_pages(pool);
 
@@ -79,14 +189,60 @@ struct page *ion_page_pool_alloc(struct ion_page_pool *pool)
 
 void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
 {
+	struct page *pages[ION_PAGE_POOL_MAG_MAX];
+	int nr;
+
 	BUG_ON(pool->order != compound_order(page));
 
+	if (pool->mags && !ion_page_pool_mag_push(pool, &page, 1))
+		return;
+
 	ion_page_pool_add(pool, page);
+
+	/* magazine full: make room for the next frees */
+	if (pool->mags) {
+		nr = ion_page_pool_mag_take(pool, raw_cpu_ptr(pool->mags),
+					    pages,
+					    ION_PAGE_POOL_MAG_BATCH(pool));
+		while (nr--)
+			ion_page_pool_add(pool, pages[nr]);
+	}
+}
+
+/* Move every magazine's items back to the pool lists */
+static void ion_page_pool_drain_mags(struct ion_page_pool *pool)
+{
+	struct page *pages[ION_PAGE_POOL_MAG_MAX];
+	int cpu, nr;
+
+	if (!pool->mags)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		nr = ion_page_pool_mag_take(pool, per_cpu_ptr(pool->mags, cpu),
+					    pages, ION_PAGE_POOL_MAG_MAX);
+		while (nr--)
+			ion_page_pool_add(pool, pages[nr]);
+	}
+}
+
+static int ion_page_pool_mag_count(struct ion_page_pool *pool)
+{
+	int cpu, count = 0;
+
+	if (!pool->mags)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu_ptr(pool->mags, cpu)->count);
+
+	return count;
 }
 
 static int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 {
-	int count = pool->low_count;
+	/* magazine items are counted whatever zone they come from */
+	int count = pool->low_count + ion_page_pool_mag_count(pool);
 
 	if (high)
 		count += pool->high_count;
@@ -108,6 +264,9 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	if (nr_to_scan == 0)
 		return ion_page_pool_total(pool, high);
 
+	WRITE_ONCE(pool->last_shrink, jiffies);
+	ion_page_pool_drain_mags(pool);
+
 	while (freed < nr_to_scan) {
 		struct page *page;
 
@@ -128,9 +287,47 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	return freed;
 }
 
+int ion_page_pool_count(struct ion_page_pool *pool)
+{
+	int count;
+
+	mutex_lock(&pool->mutex);
+	count = pool->high_count + pool->low_count;
+	mutex_unlock(&pool->mutex);
+
+	return count + ion_page_pool_mag_count(pool);
+}
+
+int ion_page_pool_fill(struct ion_page_pool *pool, int nr_items)
+{
+	gfp_t gfp_mask = (pool->gfp_mask | __GFP_NORETRY | __GFP_NOWARN) &
+			 ~__GFP_DIRECT_RECLAIM;
+	int added = 0;
+	int count = ion_page_pool_count(pool);
+
+	while (count + added < nr_items) {
+		struct page *page;
+
+		if (time_before(jiffies, READ_ONCE(pool->last_shrink) +
+				ION_PAGE_POOL_SHRINK_BACKOFF))
+			break;
+
+		page = alloc_pages(gfp_mask, pool->order);
+		if (!page)
+			break;
+
+		ion_page_pool_add(pool, page);
+		added++;
+		cond_resched();
+	}
+
+	return added;
+}
+
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 {
 	struct ion_page_pool *pool = kmalloc(sizeof(*pool), GFP_KERNEL);
+	int cpu;
 
 	if (!pool)
 		return NULL;
@@ -142,11 +339,30 @@ struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 	pool->order = order;
 	mutex_init(&pool->mutex);
 	plist_node_init(&pool->list, order);
+	pool->last_shrink = jiffies - ION_PAGE_POOL_SHRINK_BACKOFF;
+
+	pool->mag_size = min_t(unsigned long, ION_PAGE_POOL_MAG_MAX,
+			       ION_PAGE_POOL_MAG_BYTES >> (PAGE_SHIFT + order));
+	pool->mags = NULL;
+	if (pool->mag_size) {
+		/* without magazines the pool still works, just slower */
+		pool->mags = alloc_percpu(struct ion_page_pool_mag);
+		if (pool->mags) {
+			for_each_possible_cpu(cpu) {
+				struct ion_page_pool_mag *mag;
+
+				mag = per_cpu_ptr(pool->mags, cpu);
+				spin_lock_init(&mag->lock);
+				mag->count = 0;
+			}
+		}
+	}
 
 	return pool;
 }
 
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	free_percpu(pool->mags);
 	kfree(pool);
 }
@@ -8,12 +8,17 @@
 #include <asm/page.h>
 #include <linux/dma-mapping.h>
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/highmem.h>
+#include <linux/kthread.h>
 #include <linux/mm.h>
+#include <linux/moduleparam.h>
 #include <linux/scatterlist.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <uapi/linux/sched/types.h>
 #include "ion.h"
 
 #define NUM_ORDERS ARRAY_SIZE(orders)
@@ -23,6 +28,15 @@ static gfp_t high_order_gfp_flags = (GFP_HIGHUSER | __GFP_ZERO | __GFP_NOWARN |
 static gfp_t low_order_gfp_flags  = GFP_HIGHUSER | __GFP_ZERO;
 static const unsigned int orders[] = {8, 4, 0};
 
+/*
+ * Number of items, per order in the orders[] sequence, that the refill
+ * thread keeps in each pool. A pool is refilled once an allocation takes
+ * it below half of its watermark; 0 disables background refill.
+ */
+static unsigned int pool_watermark[NUM_ORDERS];
+module_param_array(pool_watermark, uint, NULL, 0644);
+MODULE_PARM_DESC(pool_watermark, "Pre-zeroed pool items kept per order");
+
 static int order_to_index(unsigned int order)
 {
 	int i;
@@ -42,15 +56,30 @@ static inline unsigned int order_to_size(int order)
 struct ion_system_heap {
 	struct ion_heap heap;
 	struct ion_page_pool *pools[NUM_ORDERS];
+	struct task_struct *refill_task;
+	wait_queue_head_t refill_wait;
+	bool refill_pending;
 };
 
 static struct page *alloc_buffer_page(struct ion_system_heap *heap,
 				      struct ion_buffer *buffer,
 				      unsigned long order)
 {
-	struct ion_page_pool *pool = heap->pools[order_to_index(order)];
+	int index = order_to_index(order);
+	struct ion_page_pool *pool = heap->pools[index];
+	unsigned int watermark = READ_ONCE(pool_watermark[index]);
+	struct page *page;
+
+	page = ion_page_pool_alloc(pool);
 
-	return ion_page_pool_alloc(pool);
+	if (heap->refill_task && watermark &&
+	    ion_page_pool_count(pool) < watermark / 2 &&
+	    !READ_ONCE(heap->refill_pending)) {
+		WRITE_ONCE(heap->refill_pending, true);
+		wake_up(&heap->refill_wait);
+	}
+
+	return page;
 }
 
 static void free_buffer_page(struct ion_system_heap *heap,
@@ -203,6 +232,35 @@ static int ion_system_heap_shrink(struct ion_heap *heap, gfp_t gfp_mask,
 	return nr_total;
 }
 
+/*
+ * Keep the pools topped up with zeroed pages, so that allocation bursts
+ * neither zero nor reclaim in the allocating task's context. The pools'
+ * gfp masks carry __GFP_ZERO, and pages freed back into them are zeroed
+ * by ion_system_heap_free().
+ */
+static int ion_system_heap_refill(void *data)
+{
+	struct ion_system_heap *sys_heap = data;
+	int i;
+
+	while (true) {
+		wait_event_freezable(sys_heap->refill_wait,
+				     READ_ONCE(sys_heap->refill_pending));
+		WRITE_ONCE(sys_heap->refill_pending, false);
+
+		/* larger orders first, they are the hardest to get later */
+		for (i = 0; i < NUM_ORDERS; i++) {
+			unsigned int watermark = READ_ONCE(pool_watermark[i]);
+
+			if (watermark)
+				ion_page_pool_fill(sys_heap->pools[i],
+						   watermark);
+		}
+	}
+
+	return 0;
+}
+
 static struct ion_heap_ops system_heap_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
@@ -224,6 +282,8 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 	for (i = 0; i < NUM_ORDERS; i++) {
 		pool = sys_heap->pools[i];
 
+		seq_printf(s, "order %u refill watermark %u\n",
+			   pool->order, READ_ONCE(pool_watermark[i]));
 		seq_printf(s, "%d order %u highmem pages %lu total\n",
 			   pool->high_count, pool->order,
 			   (PAGE_SIZE << pool->order) * pool->high_count);
@@ -281,6 +341,19 @@ static struct ion_heap *__ion_system_heap_create(void)
 	if (ion_system_heap_create_pools(heap->pools))
 		goto free_heap;
 
+	init_waitqueue_head(&heap->refill_wait);
+	heap->refill_task = kthread_run(ion_system_heap_refill, heap,
+					"ion_pool_refill");
+	if (IS_ERR(heap->refill_task)) {
+		/* allocation still works, just without background refill */
+		pr_err("%s: creating pool refill thread failed\n", __func__);
+		heap->refill_task = NULL;
+	} else {
+		struct sched_param param = { .sched_priority = 0 };
+
+		sched_setscheduler(heap->refill_task, SCHED_IDLE, &param);
+	}
+
 	heap->heap.debug_show = ion_system_heap_debug_show;
 	return &heap->heap;
 
@@ -41,5 +41,8 @@ struct ashmem_pin {
 #define ASHMEM_UNPIN		_IOW(__ASHMEMIOC, 8, struct ashmem_pin)
 #define ASHMEM_GET_PIN_STATUS	_IO(__ASHMEMIOC, 9)
 #define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
+/* request (arg != 0) transparent huge pages for the backing store */
+#define ASHMEM_SET_HUGE		_IO(__ASHMEMIOC, 12)
+#define ASHMEM_GET_HUGE		_IO(__ASHMEMIOC, 13)
 
 #endif	/* _UAPI_LINUX_ASHMEM_H */
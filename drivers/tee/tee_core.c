@@ -57,6 +57,7 @@ static int tee_open(struct inode *inode, struct file *filp)
 	kref_init(&ctx->refcount);
 	ctx->teedev = teedev;
 	INIT_LIST_HEAD(&ctx->list_shm);
+	INIT_LIST_HEAD(&ctx->list_shm_cache);
 	filp->private_data = ctx;
 	rc = teedev->desc->ops->open(ctx);
 	if (rc)
@@ -96,6 +97,7 @@ void teedev_ctx_put(struct tee_context *ctx)
 
 static void teedev_close_context(struct tee_context *ctx)
 {
+	tee_shm_flush_cache(ctx);
 	tee_device_put(ctx->teedev);
 	teedev_ctx_put(ctx);
 }
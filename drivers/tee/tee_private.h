@@ -69,6 +69,7 @@ struct tee_device {
 int tee_shm_init(void);
 
 int tee_shm_get_fd(struct tee_shm *shm);
+void tee_shm_flush_cache(struct tee_context *ctx);
 
 bool tee_device_get(struct tee_device *teedev);
 void tee_device_put(struct tee_device *teedev);
@@ -16,20 +16,23 @@
 #include <linux/fdtable.h>
 #include <linux/idr.h>
 #include <linux/sched.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/tee_drv.h>
 #include "tee_private.h"
 
-static void tee_shm_release(struct tee_shm *shm)
+/*
+ * Registered shared memory freed by a context is kept registered, up to
+ * these limits, so that registering the same pages again doesn't cost a
+ * round trip to the secure world.
+ */
+#define TEE_SHM_CACHE_ENTRIES	16
+#define TEE_SHM_CACHE_PAGES	(SZ_8M >> PAGE_SHIFT)
+
+static void tee_shm_destroy(struct tee_shm *shm)
 {
 	struct tee_device *teedev = shm->teedev;
 
-	mutex_lock(&teedev->mutex);
-	idr_remove(&teedev->idr, shm->id);
-	if (shm->ctx)
-		list_del(&shm->link);
-	mutex_unlock(&teedev->mutex);
-
 	if (shm->flags & TEE_SHM_POOL) {
 		struct tee_shm_pool_mgr *poolm;
 
@@ -61,6 +64,103 @@ static void tee_shm_release(struct tee_shm *shm)
 	tee_device_put(teedev);
 }
 
+/*
+ * Moves the registered @shm to the cache of its context, pushing the
+ * oldest entries out to @destroy if over the limits.  @shm itself goes to
+ * @destroy if it can't be kept.  Called with teedev->mutex held.
+ */
+static void tee_shm_cache_add(struct tee_shm *shm, struct list_head *destroy)
+{
+	struct tee_context *ctx = shm->ctx;
+	struct tee_shm *old;
+
+	if (ctx->shm_cache_closed || ctx->releasing ||
+	    shm->num_pages > TEE_SHM_CACHE_PAGES) {
+		list_add(&shm->link, destroy);
+		return;
+	}
+
+	shm->dmabuf = NULL;
+	list_add(&shm->link, &ctx->list_shm_cache);
+	ctx->shm_cache_entries++;
+	ctx->shm_cache_pages += shm->num_pages;
+
+	while (ctx->shm_cache_entries > TEE_SHM_CACHE_ENTRIES ||
+	       ctx->shm_cache_pages > TEE_SHM_CACHE_PAGES) {
+		old = list_last_entry(&ctx->list_shm_cache, struct tee_shm,
+				      link);
+		list_move(&old->link, destroy);
+		ctx->shm_cache_entries--;
+		ctx->shm_cache_pages -= old->num_pages;
+	}
+}
+
+/*
+ * Takes the entry registering the same pages as @new out of the cache of
+ * @ctx, if any.  Called with teedev->mutex held.
+ */
+static struct tee_shm *tee_shm_cache_get(struct tee_context *ctx,
+					 struct tee_shm *new)
+{
+	struct tee_shm *shm;
+
+	list_for_each_entry(shm, &ctx->list_shm_cache, link) {
+		if (shm->offset != new->offset || shm->size != new->size ||
+		    shm->num_pages != new->num_pages ||
+		    memcmp(shm->pages, new->pages,
+			   new->num_pages * sizeof(*new->pages)))
+			continue;
+
+		list_del(&shm->link);
+		ctx->shm_cache_entries--;
+		ctx->shm_cache_pages -= shm->num_pages;
+		return shm;
+	}
+
+	return NULL;
+}
+
+/**
+ * tee_shm_flush_cache() - Unregister the shared memory cached by a context
+ * @ctx:	Context being closed
+ */
+void tee_shm_flush_cache(struct tee_context *ctx)
+{
+	struct tee_device *teedev = ctx->teedev;
+	struct tee_shm *shm, *tmp;
+	LIST_HEAD(destroy);
+
+	mutex_lock(&teedev->mutex);
+	ctx->shm_cache_closed = true;
+	list_splice_init(&ctx->list_shm_cache, &destroy);
+	ctx->shm_cache_entries = 0;
+	ctx->shm_cache_pages = 0;
+	mutex_unlock(&teedev->mutex);
+
+	list_for_each_entry_safe(shm, tmp, &destroy, link)
+		tee_shm_destroy(shm);
+}
+
+static void tee_shm_release(struct tee_shm *shm)
+{
+	struct tee_device *teedev = shm->teedev;
+	struct tee_shm *tmp;
+	LIST_HEAD(destroy);
+
+	mutex_lock(&teedev->mutex);
+	idr_remove(&teedev->idr, shm->id);
+	if (shm->ctx)
+		list_del(&shm->link);
+	if ((shm->flags & TEE_SHM_REGISTER) && shm->ctx)
+		tee_shm_cache_add(shm, &destroy);
+	else
+		list_add(&shm->link, &destroy);
+	mutex_unlock(&teedev->mutex);
+
+	list_for_each_entry_safe(shm, tmp, &destroy, link)
+		tee_shm_destroy(shm);
+}
+
 static struct sg_table *tee_shm_op_map_dma_buf(struct dma_buf_attachment
 			*attach, enum dma_data_direction dir)
 {
@@ -233,7 +333,8 @@ struct tee_shm *tee_shm_register(struct tee_context *ctx, unsigned long addr,
 {
 	struct tee_device *teedev = ctx->teedev;
 	const u32 req_flags = TEE_SHM_DMA_BUF | TEE_SHM_USER_MAPPED;
-	struct tee_shm *shm;
+	struct tee_shm *shm, *cached;
+	bool registered = false;
 	void *ret;
 	int rc;
 	int num_pages;
@@ -283,6 +384,26 @@ struct tee_shm *tee_shm_register(struct tee_context *ctx, unsigned long addr,
 		goto err;
 	}
 
+	mutex_lock(&teedev->mutex);
+	cached = tee_shm_cache_get(ctx, shm);
+	mutex_unlock(&teedev->mutex);
+
+	if (cached) {
+		size_t n;
+
+		/* Its registration, pins and references are taken over */
+		for (n = 0; n < shm->num_pages; n++)
+			put_page(shm->pages[n]);
+		kfree(shm->pages);
+		kfree(shm);
+		teedev_ctx_put(ctx);
+		tee_device_put(teedev);
+
+		shm = cached;
+		shm->id = -1;
+		registered = true;
+	}
+
 	mutex_lock(&teedev->mutex);
 	shm->id = idr_alloc(&teedev->idr, shm, 1, 0, GFP_KERNEL);
 	mutex_unlock(&teedev->mutex);
@@ -292,11 +413,14 @@ struct tee_shm *tee_shm_register(struct tee_context *ctx, unsigned long addr,
 		goto err;
 	}
 
-	rc = teedev->desc->ops->shm_register(ctx, shm, shm->pages,
-					     shm->num_pages, start);
-	if (rc) {
-		ret = ERR_PTR(rc);
-		goto err;
+	if (!registered) {
+		rc = teedev->desc->ops->shm_register(ctx, shm, shm->pages,
+						     shm->num_pages, start);
+		if (rc) {
+			ret = ERR_PTR(rc);
+			goto err;
+		}
+		registered = true;
 	}
 
 	if (flags & TEE_SHM_DMA_BUF) {
@@ -310,7 +434,6 @@ struct tee_shm *tee_shm_register(struct tee_context *ctx, unsigned long addr,
 		shm->dmabuf = dma_buf_export(&exp_info);
 		if (IS_ERR(shm->dmabuf)) {
 			ret = ERR_CAST(shm->dmabuf);
-			teedev->desc->ops->shm_unregister(ctx, shm);
 			goto err;
 		}
 	}
@@ -324,6 +447,8 @@ struct tee_shm *tee_shm_register(struct tee_context *ctx, unsigned long addr,
 	if (shm) {
 		size_t n;
 
+		if (registered)
+			teedev->desc->ops->shm_unregister(ctx, shm);
 		if (shm->id >= 0) {
 			mutex_lock(&teedev->mutex);
 			idr_remove(&teedev->idr, shm->id);
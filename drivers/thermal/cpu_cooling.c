@@ -32,6 +32,7 @@
 #include <linux/cpu.h>
 #include <linux/cpu_cooling.h>
 #include <linux/energy_model.h>
+#include <linux/sort.h>
 
 #include <trace/events/thermal.h>
 
@@ -59,6 +60,16 @@ struct time_in_idle {
 	u64 timestamp;
 };
 
+/**
+ * struct cooling_state - cached translation of a cooling state
+ * @frequency: frequency the CPUs are clipped to in this state, in kHz
+ * @power: power of one CPU at @frequency, in mW, 0 without Energy Model
+ */
+struct cooling_state {
+	unsigned int frequency;
+	u32 power;
+};
+
 /**
  * struct cpufreq_cooling_device - data for cooling device with cpufreq
  * @id: unique integer value corresponding to each cpufreq_cooling_device
@@ -71,6 +82,7 @@ struct time_in_idle {
  * @max_level: maximum cooling level. One less than total number of valid
  *	cpufreq frequencies.
  * @em: Reference on the Energy Model of the device
+ * @states: per cooling state frequency and power, from 0 to @max_level
  * @cdev: thermal_cooling_device pointer to keep track of the
  *	registered cooling device.
  * @policy: cpufreq policy.
@@ -87,6 +99,7 @@ struct cpufreq_cooling_device {
 	unsigned int clipped_freq;
 	unsigned int max_level;
 	struct em_perf_domain *em;
+	struct cooling_state *states;
 	struct thermal_cooling_device *cdev;
 	struct cpufreq_policy *policy;
 	struct list_head node;
@@ -293,25 +306,63 @@ static int cpufreq_get_cur_state(struct thermal_cooling_device *cdev,
 static unsigned int get_state_freq(struct cpufreq_cooling_device *cpufreq_cdev,
 			      unsigned long state)
 {
-	struct cpufreq_policy *policy;
-	unsigned long idx;
+	return cpufreq_cdev->states[state].frequency;
+}
+
+static int cmp_freq_desc(const void *a, const void *b)
+{
+	const struct cooling_state *sa = a, *sb = b;
+
+	if (sa->frequency == sb->frequency)
+		return 0;
+
+	return sa->frequency < sb->frequency ? 1 : -1;
+}
+
+/*
+ * Translate all the cooling states once and for all, from the Energy Model
+ * table if available, otherwise from the valid CPUFreq table entries.
+ */
+static int init_cooling_states(struct cpufreq_cooling_device *cpufreq_cdev)
+{
+	struct cpufreq_policy *policy = cpufreq_cdev->policy;
+	struct cpufreq_frequency_table *pos;
+	struct cooling_state *states;
+	unsigned int i = 0;
+
+	states = kcalloc(cpufreq_cdev->max_level + 1, sizeof(*states),
+			 GFP_KERNEL);
+	if (!states)
+		return -ENOMEM;
 
 #ifdef CONFIG_ENERGY_MODEL
-	/* Use the Energy Model table if available */
 	if (cpufreq_cdev->em) {
-		idx = cpufreq_cdev->max_level - state;
-		return cpufreq_cdev->em->table[idx].frequency;
+		struct em_cap_state *table = cpufreq_cdev->em->table;
+
+		for (i = 0; i <= cpufreq_cdev->max_level; i++) {
+			struct em_cap_state *cs;
+
+			cs = &table[cpufreq_cdev->max_level - i];
+			states[i].frequency = cs->frequency;
+			states[i].power = cs->power;
+		}
+		goto done;
 	}
 #endif
 
-	/* Otherwise, fallback on the CPUFreq table */
-	policy = cpufreq_cdev->policy;
-	if (policy->freq_table_sorted == CPUFREQ_TABLE_SORTED_ASCENDING)
-		idx = cpufreq_cdev->max_level - state;
-	else
-		idx = state;
+	cpufreq_for_each_valid_entry(pos, policy->freq_table) {
+		if (i > cpufreq_cdev->max_level)
+			break;
+		states[i++].frequency = pos->frequency;
+	}
+	sort(states, i, sizeof(*states), cmp_freq_desc, NULL);
 
-	return policy->freq_table[idx].frequency;
+#ifdef CONFIG_ENERGY_MODEL
+done:
+#endif
+	cpufreq_cdev->states = states;
+
+	return 0;
 }
 
 /**
@@ -328,7 +379,8 @@ static int cpufreq_set_cur_state(struct thermal_cooling_device *cdev,
 				 unsigned long state)
 {
 	struct cpufreq_cooling_device *cpufreq_cdev = cdev->devdata;
-	unsigned int clip_freq;
+	struct cpufreq_policy *policy = cpufreq_cdev->policy;
+	unsigned int clip_freq, old_clip_freq;
 
 	/* Request state should be less than max_level */
 	if (WARN_ON(state > cpufreq_cdev->max_level))
@@ -339,10 +391,23 @@ static int cpufreq_set_cur_state(struct thermal_cooling_device *cdev,
 		return 0;
 
 	clip_freq = get_state_freq(cpufreq_cdev, state);
+	old_clip_freq = cpufreq_cdev->clipped_freq;
 	cpufreq_cdev->cpufreq_state = state;
 	cpufreq_cdev->clipped_freq = clip_freq;
 
-	cpufreq_update_policy(cpufreq_cdev->policy->cpu);
+	/*
+	 * Tightening the clip only lowers policy->max, which does not need
+	 * the whole policy to be re-evaluated.  Relaxing it only matters if
+	 * the old clip was what limited policy->max.
+	 */
+	if (clip_freq < old_clip_freq) {
+		if (cpufreq_lower_max_freq(policy, clip_freq))
+			return 0;
+	} else if (old_clip_freq > READ_ONCE(policy->max)) {
+		return 0;
+	}
+
+	cpufreq_update_policy(policy->cpu);
 
 	return 0;
 }
@@ -438,7 +503,7 @@ static int cpufreq_state2power(struct thermal_cooling_device *cdev,
 			       struct thermal_zone_device *tz,
 			       unsigned long state, u32 *power)
 {
-	unsigned int freq, num_cpus, idx;
+	unsigned int num_cpus;
 	struct cpufreq_cooling_device *cpufreq_cdev = cdev->devdata;
 
 	/* Request state should be less than max_level */
@@ -447,9 +512,7 @@ static int cpufreq_state2power(struct thermal_cooling_device *cdev,
 
 	num_cpus = cpumask_weight(cpufreq_cdev->policy->cpus);
 
-	idx = cpufreq_cdev->max_level - state;
-	freq = cpufreq_cdev->em->table[idx].frequency;
-	*power = cpu_freq_to_power(cpufreq_cdev, freq) * num_cpus;
+	*power = cpufreq_cdev->states[state].power * num_cpus;
 
 	return 0;
 }
@@ -589,10 +652,16 @@ __cpufreq_cooling_register(struct device_node *np,
 #endif
 		cooling_ops = &cpufreq_cooling_ops;
 
+	ret = init_cooling_states(cpufreq_cdev);
+	if (ret) {
+		cdev = ERR_PTR(ret);
+		goto free_idle_time;
+	}
+
 	ret = ida_simple_get(&cpufreq_ida, 0, 0, GFP_KERNEL);
 	if (ret < 0) {
 		cdev = ERR_PTR(ret);
-		goto free_idle_time;
+		goto free_states;
 	}
 	cpufreq_cdev->id = ret;
 
@@ -621,6 +690,8 @@ __cpufreq_cooling_register(struct device_node *np,
 
 remove_ida:
 	ida_simple_remove(&cpufreq_ida, cpufreq_cdev->id);
+free_states:
+	kfree(cpufreq_cdev->states);
 free_idle_time:
 	kfree(cpufreq_cdev->idle_time);
 free_cdev:
@@ -719,6 +790,7 @@ void cpufreq_cooling_unregister(struct thermal_cooling_device *cdev)
 
 	thermal_cooling_device_unregister(cpufreq_cdev->cdev);
 	ida_simple_remove(&cpufreq_ida, cpufreq_cdev->id);
+	kfree(cpufreq_cdev->states);
 	kfree(cpufreq_cdev->idle_time);
 	kfree(cpufreq_cdev);
 }
@@ -174,6 +174,7 @@ static void estimate_pid_constants(struct thermal_zone_device *tz,
 /**
  * pid_controller() - PID controller
  * @tz:	thermal zone we are operating in
+ * @temp:	the temperature to control, see power_allocator_temp()
  * @control_temp:	the target temperature in millicelsius
  * @max_allocatable_power:	maximum allocatable power for this thermal zone
  *
@@ -190,7 +191,7 @@ static void estimate_pid_constants(struct thermal_zone_device *tz,
  * Return: The power budget for the next period.
  */
 static u32 pid_controller(struct thermal_zone_device *tz,
-			  int control_temp,
+			  int temp, int control_temp,
 			  u32 max_allocatable_power)
 {
 	s64 p, i, d, power_range;
@@ -209,7 +210,7 @@ static u32 pid_controller(struct thermal_zone_device *tz,
 				       true);
 	}
 
-	err = control_temp - tz->temperature;
+	err = control_temp - temp;
 	err = int_to_frac(err);
 
 	/* Calculate the proportional term */
@@ -329,6 +330,90 @@ static void divvy_up_power(u32 *req_power, u32 *max_power, int num_actors,
 					extra_power) / capped_extra_power;
 }
 
+/**
+ * divvy_up_power_by_weight() - divvy the allocated power by actor priority
+ * @req_power:	each actor's requested power
+ * @max_power:	each actor's maximum available power
+ * @weight:	each actor's weight, overwritten by the function
+ * @num_actors:	size of the arrays
+ * @power_range:	total allocated power
+ * @granted_power:	output array: each actor's granted power
+ * @extra_actor_power:	temporary storage, as for divvy_up_power()
+ *
+ * Predictive mode alternative to divvy_up_power(): the actors with the
+ * heaviest weight get their request first, and the next weights only
+ * share what is left, proportionally to their requests.  Giving the big
+ * CPU clusters a heavier weight than the little ones thus caps the
+ * background work running on the little CPUs before the foreground work.
+ * Whatever is left once all the requests are granted is re-divvied based
+ * on how far the actors are from their maximums.
+ */
+static void divvy_up_power_by_weight(u32 *req_power, u32 *max_power,
+				     int *weight, int num_actors,
+				     u32 power_range, u32 *granted_power,
+				     u32 *extra_actor_power)
+{
+	u32 power_left = power_range, capped_extra_power = 0;
+	int i, level;
+
+	for (;;) {
+		u32 level_req_power = 0;
+
+		level = -1;
+		for (i = 0; i < num_actors; i++)
+			level = max(level, weight[i]);
+		if (level < 0)
+			break;
+
+		for (i = 0; i < num_actors; i++)
+			if (weight[i] == level)
+				level_req_power += min(req_power[i],
+						       max_power[i]);
+
+		for (i = 0; i < num_actors; i++) {
+			u32 req;
+
+			if (weight[i] != level)
+				continue;
+
+			req = min(req_power[i], max_power[i]);
+			if (level_req_power > power_left)
+				req = DIV_ROUND_CLOSEST_ULL((u64)req *
+							    power_left,
+							    level_req_power);
+			granted_power[i] = req;
+			extra_actor_power[i] = max_power[i] - req;
+			capped_extra_power += extra_actor_power[i];
+			/* served */
+			weight[i] = -1;
+		}
+
+		power_left -= min(level_req_power, power_left);
+	}
+
+	power_left = min(power_left, capped_extra_power);
+	if (power_left)
+		for (i = 0; i < num_actors; i++)
+			granted_power[i] += ((u64)extra_actor_power[i] *
+					power_left) / capped_extra_power;
+}
+
+/*
+ * The temperature to control for: the current one, or in predictive mode
+ * the one expected by the next polling if the zone keeps heating up at
+ * the same rate, so that the budget shrinks before the overshoot.
+ */
+static int power_allocator_temp(struct thermal_zone_device *tz)
+{
+	int rise = tz->temperature - tz->last_temperature;
+
+	if (!tz->tzp->predictive || rise <= 0 ||
+	    tz->last_temperature == THERMAL_TEMP_INVALID)
+		return tz->temperature;
+
+	return tz->temperature + rise;
+}
+
 static int allocate_power(struct thermal_zone_device *tz,
 			  int control_temp)
 {
@@ -338,6 +423,7 @@ static int allocate_power(struct thermal_zone_device *tz,
 	u32 *weighted_req_power;
 	u32 total_req_power, max_allocatable_power, total_weighted_req_power;
 	u32 total_granted_power, power_range;
+	int *actor_weight;
 	int i, num_actors, total_weight, ret = 0;
 	int trip_max_desired_temperature = params->trip_max_desired_temperature;
 
@@ -359,17 +445,18 @@ static int allocate_power(struct thermal_zone_device *tz,
 	}
 
 	/*
-	 * We need to allocate five arrays of the same size:
-	 * req_power, max_power, granted_power, extra_actor_power and
-	 * weighted_req_power.  They are going to be needed until this
-	 * function returns.  Allocate them all in one go to simplify
-	 * the allocation and deallocation logic.
+	 * We need to allocate six arrays of the same size:
+	 * req_power, max_power, granted_power, extra_actor_power,
+	 * weighted_req_power and actor_weight.  They are going to be
+	 * needed until this function returns.  Allocate them all in one
+	 * go to simplify the allocation and deallocation logic.
 	 */
 	BUILD_BUG_ON(sizeof(*req_power) != sizeof(*max_power));
 	BUILD_BUG_ON(sizeof(*req_power) != sizeof(*granted_power));
 	BUILD_BUG_ON(sizeof(*req_power) != sizeof(*extra_actor_power));
 	BUILD_BUG_ON(sizeof(*req_power) != sizeof(*weighted_req_power));
-	req_power = kcalloc(num_actors * 5, sizeof(*req_power), GFP_KERNEL);
+	BUILD_BUG_ON(sizeof(*req_power) != sizeof(*actor_weight));
+	req_power = kcalloc(num_actors * 6, sizeof(*req_power), GFP_KERNEL);
 	if (!req_power) {
 		ret = -ENOMEM;
 		goto unlock;
@@ -379,6 +466,7 @@ static int allocate_power(struct thermal_zone_device *tz,
 	granted_power = &req_power[2 * num_actors];
 	extra_actor_power = &req_power[3 * num_actors];
 	weighted_req_power = &req_power[4 * num_actors];
+	actor_weight = (int *)&req_power[5 * num_actors];
 
 	i = 0;
 	total_weighted_req_power = 0;
@@ -404,6 +492,7 @@ static int allocate_power(struct thermal_zone_device *tz,
 			weight = instance->weight;
 
 		weighted_req_power[i] = frac_to_int(weight * req_power[i]);
+		actor_weight[i] = max(weight, 0);
 
 		if (power_actor_get_max_power(cdev, tz, &max_power[i]))
 			continue;
@@ -415,11 +504,17 @@ static int allocate_power(struct thermal_zone_device *tz,
 		i++;
 	}
 
-	power_range = pid_controller(tz, control_temp, max_allocatable_power);
+	power_range = pid_controller(tz, power_allocator_temp(tz),
+				     control_temp, max_allocatable_power);
 
-	divvy_up_power(weighted_req_power, max_power, num_actors,
-		       total_weighted_req_power, power_range, granted_power,
-		       extra_actor_power);
+	if (tz->tzp->predictive)
+		divvy_up_power_by_weight(req_power, max_power, actor_weight,
+					 num_actors, power_range,
+					 granted_power, extra_actor_power);
+	else
+		divvy_up_power(weighted_req_power, max_power, num_actors,
+			       total_weighted_req_power, power_range,
+			       granted_power, extra_actor_power);
 
 	total_granted_power = 0;
 	i = 0;
@@ -624,7 +719,7 @@ static int power_allocator_throttle(struct thermal_zone_device *tz, int trip)
 
 	ret = tz->ops->get_trip_temp(tz, params->trip_switch_on,
 				     &switch_on_temp);
-	if (!ret && (tz->temperature < switch_on_temp)) {
+	if (!ret && (power_allocator_temp(tz) < switch_on_temp)) {
 		tz->passive = 0;
 		reset_pid_controller(params);
 		allow_maximum_power(tz);
@@ -348,6 +348,36 @@ sustainable_power_store(struct device *dev, struct device_attribute *devattr,
 	return count;
 }
 
+static ssize_t
+predictive_show(struct device *dev, struct device_attribute *devattr,
+		char *buf)
+{
+	struct thermal_zone_device *tz = to_thermal_zone(dev);
+
+	if (tz->tzp)
+		return sprintf(buf, "%d\n", tz->tzp->predictive);
+	else
+		return -EIO;
+}
+
+static ssize_t
+predictive_store(struct device *dev, struct device_attribute *devattr,
+		 const char *buf, size_t count)
+{
+	struct thermal_zone_device *tz = to_thermal_zone(dev);
+	bool predictive;
+
+	if (!tz->tzp)
+		return -EIO;
+
+	if (kstrtobool(buf, &predictive))
+		return -EINVAL;
+
+	tz->tzp->predictive = predictive;
+
+	return count;
+}
+
 #define create_s32_tzp_attr(name)					\
 	static ssize_t							\
 	name##_show(struct device *dev, struct device_attribute *devattr, \
@@ -399,6 +429,7 @@ static DEVICE_ATTR_RO(temp);
 static DEVICE_ATTR_RW(policy);
 static DEVICE_ATTR_RO(available_policies);
 static DEVICE_ATTR_RW(sustainable_power);
+static DEVICE_ATTR_RW(predictive);
 
 /* These thermal zone device attributes are created based on conditions */
 static DEVICE_ATTR_RW(mode);
@@ -419,6 +450,7 @@ static struct attribute *thermal_zone_dev_attrs[] = {
 	&dev_attr_k_i.attr,
 	&dev_attr_k_d.attr,
 	&dev_attr_integral_cutoff.attr,
+	&dev_attr_predictive.attr,
 	&dev_attr_slope.attr,
 	&dev_attr_offset.attr,
 	NULL,
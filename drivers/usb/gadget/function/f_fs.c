@@ -16,6 +16,7 @@
 
 #include <linux/blkdev.h>
 #include <linux/pagemap.h>
+#include <linux/scatterlist.h>
 #include <linux/export.h>
 #include <linux/hid.h>
 #include <linux/module.h>
@@ -213,6 +214,12 @@ struct ffs_io_data {
 	const void *to_free;
 	char *buf;
 
+	/* User pages the request works on in place, see ffs_epfile_pin() */
+	bool use_sg;
+	struct sg_table sgt;
+	struct page **pages;
+	unsigned int n_pages;
+
 	struct mm_struct *mm;
 	struct work_struct work;
 
@@ -749,6 +756,100 @@ static ssize_t ffs_copy_to_iter(void *data, int data_len, struct iov_iter *iter)
 	return ret;
 }
 
+/*
+ * Transfers at least this large from or to a single user buffer are done
+ * in place when the UDC takes scatter-gather requests: the user pages are
+ * pinned and handed to the controller instead of being bounced through a
+ * kmalloc()'ed buffer.  Below it the copy is cheaper than the pinning.
+ */
+#define FFS_ZEROCOPY_MIN_LEN	(16 * 1024)
+
+static bool ffs_epfile_can_pin(struct usb_gadget *gadget,
+			       struct ffs_io_data *io_data, ssize_t data_len)
+{
+	struct iov_iter *iter = &io_data->data;
+
+	if (!gadget->sg_supported || data_len < FFS_ZEROCOPY_MIN_LEN)
+		return false;
+
+	/*
+	 * A single segment keeps the pages one run for the sg table, and an
+	 * OUT transfer can not overflow the user buffer only if its size is
+	 * already aligned to the max packet size.
+	 */
+	return iter_is_iovec(iter) && iter->nr_segs == 1 &&
+	       data_len == iov_iter_count(iter);
+}
+
+static void ffs_epfile_put_pages(struct ffs_io_data *io_data, bool dirty)
+{
+	unsigned int i;
+
+	for (i = 0; i < io_data->n_pages; i++) {
+		if (dirty)
+			set_page_dirty_lock(io_data->pages[i]);
+		put_page(io_data->pages[i]);
+	}
+	kvfree(io_data->pages);
+	io_data->pages = NULL;
+	io_data->n_pages = 0;
+}
+
+static int ffs_epfile_pin(struct ffs_io_data *io_data, size_t len)
+{
+	size_t start;
+	ssize_t got;
+	int ret;
+
+	got = iov_iter_get_pages_alloc(&io_data->data, &io_data->pages, len,
+				       &start);
+	if (got < 0)
+		return got;
+
+	io_data->n_pages = DIV_ROUND_UP(start + got, PAGE_SIZE);
+	if (got != len) {
+		ret = -EFAULT;
+		goto err_put;
+	}
+
+	ret = sg_alloc_table_from_pages(&io_data->sgt, io_data->pages,
+					io_data->n_pages, start, len,
+					GFP_KERNEL);
+	if (ret)
+		goto err_put;
+
+	iov_iter_advance(&io_data->data, len);
+	io_data->use_sg = true;
+	return 0;
+
+err_put:
+	ffs_epfile_put_pages(io_data, false);
+	return ret;
+}
+
+static void ffs_epfile_unpin(struct ffs_io_data *io_data)
+{
+	sg_free_table(&io_data->sgt);
+	ffs_epfile_put_pages(io_data, io_data->read);
+	io_data->use_sg = false;
+}
+
+static void ffs_epfile_set_buf(struct usb_request *req,
+			       struct ffs_io_data *io_data, char *data,
+			       ssize_t data_len)
+{
+	if (io_data->use_sg) {
+		req->buf = NULL;
+		req->sg = io_data->sgt.sgl;
+		req->num_sgs = io_data->sgt.nents;
+	} else {
+		req->buf = data;
+		req->sg = NULL;
+		req->num_sgs = 0;
+	}
+	req->length = data_len;
+}
+
 static void ffs_user_copy_worker(struct work_struct *work)
 {
 	struct ffs_io_data *io_data = container_of(work, struct ffs_io_data,
@@ -757,7 +858,9 @@ static void ffs_user_copy_worker(struct work_struct *work)
 					 io_data->req->actual;
 	bool kiocb_has_eventfd = io_data->kiocb->ki_flags & IOCB_EVENTFD;
 
-	if (io_data->read && ret > 0) {
+	if (io_data->use_sg) {
+		ffs_epfile_unpin(io_data);
+	} else if (io_data->read && ret > 0) {
 		mm_segment_t oldfs = get_fs();
 
 		set_fs(USER_DS);
@@ -881,6 +984,7 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 	struct ffs_ep *ep;
 	char *data = NULL;
 	ssize_t ret, data_len = -EINVAL;
+	bool pinned = false;
 	int halt;
 
 	/* Are we still active? */
@@ -948,15 +1052,20 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 			data_len = usb_ep_align_maybe(gadget, ep->ep, data_len);
 		spin_unlock_irq(&epfile->ffs->eps_lock);
 
-		data = kmalloc(data_len, GFP_KERNEL);
-		if (unlikely(!data)) {
-			ret = -ENOMEM;
-			goto error_mutex;
-		}
-		if (!io_data->read &&
-		    !copy_from_iter_full(data, data_len, &io_data->data)) {
-			ret = -EFAULT;
-			goto error_mutex;
+		if (ffs_epfile_can_pin(gadget, io_data, data_len))
+			pinned = !ffs_epfile_pin(io_data, data_len);
+		if (!pinned) {
+			data = kmalloc(data_len, GFP_KERNEL);
+			if (unlikely(!data)) {
+				ret = -ENOMEM;
+				goto error_mutex;
+			}
+			if (!io_data->read &&
+			    !copy_from_iter_full(data, data_len,
+						 &io_data->data)) {
+				ret = -EFAULT;
+				goto error_mutex;
+			}
 		}
 	}
 
@@ -988,8 +1097,7 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 		bool interrupted = false;
 
 		req = ep->req;
-		req->buf      = data;
-		req->length   = data_len;
+		ffs_epfile_set_buf(req, io_data, data, data_len);
 
 		req->context  = &done;
 		req->complete = ffs_epfile_io_complete;
@@ -1013,7 +1121,7 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 
 		if (interrupted)
 			ret = -EINTR;
-		else if (io_data->read && ep->status > 0)
+		else if (io_data->read && ep->status > 0 && !pinned)
 			ret = __ffs_epfile_read_data(epfile, data, ep->status,
 						     &io_data->data);
 		else
@@ -1022,8 +1130,7 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 	} else if (!(req = usb_ep_alloc_request(ep->ep, GFP_ATOMIC))) {
 		ret = -ENOMEM;
 	} else {
-		req->buf      = data;
-		req->length   = data_len;
+		ffs_epfile_set_buf(req, io_data, data, data_len);
 
 		io_data->buf = data;
 		io_data->ep = ep->ep;
@@ -1041,10 +1148,11 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 
 		ret = -EIOCBQUEUED;
 		/*
-		 * Do not kfree the buffer in this function.  It will be freed
-		 * by ffs_user_copy_worker.
+		 * Do not kfree the buffer or unpin the user pages in this
+		 * function.  It is done by ffs_user_copy_worker.
 		 */
 		data = NULL;
+		pinned = false;
 	}
 
 error_lock:
@@ -1052,6 +1160,8 @@ static ssize_t ffs_epfile_io(struct file *file, struct ffs_io_data *io_data)
 error_mutex:
 	mutex_unlock(&epfile->mutex);
 error:
+	if (pinned)
+		ffs_epfile_unpin(io_data);
 	kfree(data);
 	return ret;
 }
@@ -1109,6 +1219,7 @@ static ssize_t ffs_epfile_write_iter(struct kiocb *kiocb, struct iov_iter *from)
 	}
 
 	p->read = false;
+	p->use_sg = false;
 	p->kiocb = kiocb;
 	p->data = *from;
 	p->mm = current->mm;
@@ -1145,6 +1256,7 @@ static ssize_t ffs_epfile_read_iter(struct kiocb *kiocb, struct iov_iter *to)
 	}
 
 	p->read = true;
+	p->use_sg = false;
 	p->kiocb = kiocb;
 	if (p->aio) {
 		p->to_free = dup_iter(&p->data, to, GFP_KERNEL);
@@ -75,6 +75,7 @@ struct f_ncm {
 	bool				timer_force_tx;
 	struct hrtimer			task_timer;
 	bool				timer_stopping;
+	u32				tx_timeout_ns;
 };
 
 static inline struct f_ncm *func_to_ncm(struct usb_function *f)
@@ -113,8 +114,14 @@ static inline unsigned ncm_bitrate(struct usb_gadget *g)
  */
 #define TX_MAX_NUM_DPE		32
 
-/* Delay for the transmit to wait before sending an unfilled NTB frame. */
+/* Delay for the transmit to wait before sending an unfilled NTB frame.
+ * It starts at the longest, is halved each time an NTB goes out because
+ * of it, and doubled back each time one goes out full: light traffic is
+ * not held back waiting for datagrams that don't come, while a busy link
+ * still gets full NTBs.
+ */
 #define TX_TIMEOUT_NSECS	300000
+#define TX_TIMEOUT_MIN_NSECS	20000
 
 #define FORMATS_SUPPORTED	(USB_CDC_NCM_NTB16_SUPPORTED |	\
 				 USB_CDC_NCM_NTB32_SUPPORTED)
@@ -925,6 +932,7 @@ static int ncm_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 			if (IS_ERR(net))
 				return PTR_ERR(net);
 			ncm->netdev = net;
+			ncm->tx_timeout_ns = TX_TIMEOUT_NSECS;
 			ncm->timer_stopping = false;
 		}
 
@@ -1056,6 +1064,8 @@ static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 			skb2 = package_for_tx(ncm);
 			if (!skb2)
 				goto err;
+			ncm->tx_timeout_ns = min_t(u32, ncm->tx_timeout_ns * 2,
+						   TX_TIMEOUT_NSECS);
 		}
 
 		if (!ncm->skb_tx_data) {
@@ -1101,7 +1111,7 @@ static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 		}
 
 		/* Delay the timer. */
-		hrtimer_start(&ncm->task_timer, TX_TIMEOUT_NSECS,
+		hrtimer_start(&ncm->task_timer, ncm->tx_timeout_ns,
 			      HRTIMER_MODE_REL_SOFT);
 
 		/* Add the datagram position entries */
@@ -1128,6 +1138,8 @@ static struct sk_buff *ncm_wrap_ntb(struct gether *port,
 		skb2 = package_for_tx(ncm);
 		if (!skb2)
 			goto err;
+		ncm->tx_timeout_ns = max_t(u32, ncm->tx_timeout_ns / 2,
+					   TX_TIMEOUT_MIN_NSECS);
 	}
 
 	return skb2;
@@ -64,6 +64,10 @@ struct eth_dev {
 
 	struct sk_buff_head	rx_frames;
 
+	/* frames received in rx_complete(), handed up by eth_poll() */
+	struct sk_buff_head	rx_done;
+	struct napi_struct	napi;
+
 	unsigned		qmult;
 
 	unsigned		header_len;
@@ -296,10 +300,11 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 			/* no buffer copies needed, unless hardware can't
 			 * use skb buffers.
 			 */
-			status = netif_rx(skb2);
+			skb_queue_tail(&dev->rx_done, skb2);
 next_frame:
 			skb2 = skb_dequeue(&dev->rx_frames);
 		}
+		napi_schedule(&dev->napi);
 		break;
 
 	/* software-driven interface shutdown */
@@ -340,6 +345,35 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 		rx_submit(dev, req, GFP_ATOMIC);
 }
 
+/*
+ * Hand the frames of the completed requests up in one pass: through GRO,
+ * so that the segments of a TCP stream are merged before the stack sees
+ * them, or as one list when GRO is turned off.
+ */
+static int eth_poll(struct napi_struct *napi, int budget)
+{
+	struct eth_dev	*dev = container_of(napi, struct eth_dev, napi);
+	struct sk_buff	*skb;
+	LIST_HEAD(rx_list);
+	int		work = 0;
+
+	while (work < budget && (skb = skb_dequeue(&dev->rx_done))) {
+		if (dev->net->features & NETIF_F_GRO)
+			napi_gro_receive(napi, skb);
+		else
+			list_add_tail(&skb->list, &rx_list);
+		work++;
+	}
+	netif_receive_skb_list(&rx_list);
+
+	/* rx_complete() may have queued more after the last dequeue */
+	if (work < budget && napi_complete_done(napi, work) &&
+	    !skb_queue_empty(&dev->rx_done))
+		napi_schedule(napi);
+
+	return work;
+}
+
 static int prealloc(struct list_head *list, struct usb_ep *ep, unsigned n)
 {
 	unsigned		i;
@@ -623,6 +657,7 @@ static int eth_open(struct net_device *net)
 	struct gether	*link;
 
 	DBG(dev, "%s\n", __func__);
+	napi_enable(&dev->napi);
 	if (netif_carrier_ok(dev->net))
 		eth_start(dev, GFP_KERNEL);
 
@@ -681,6 +716,9 @@ static int eth_stop(struct net_device *net)
 	}
 	spin_unlock_irqrestore(&dev->lock, flags);
 
+	napi_disable(&dev->napi);
+	skb_queue_purge(&dev->rx_done);
+
 	return 0;
 }
 
@@ -762,9 +800,11 @@ struct eth_dev *gether_setup_name(struct usb_gadget *g,
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
 	skb_queue_head_init(&dev->rx_frames);
+	skb_queue_head_init(&dev->rx_done);
 
 	/* network device setup */
 	dev->net = net;
+	netif_napi_add(net, &dev->napi, eth_poll, NAPI_POLL_WEIGHT);
 	dev->qmult = qmult;
 	snprintf(net->name, sizeof(net->name), "%s%%d", netname);
 
@@ -828,9 +868,11 @@ struct net_device *gether_setup_name_default(const char *netname)
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
 	skb_queue_head_init(&dev->rx_frames);
+	skb_queue_head_init(&dev->rx_done);
 
 	/* network device setup */
 	dev->net = net;
+	netif_napi_add(net, &dev->napi, eth_poll, NAPI_POLL_WEIGHT);
 	dev->qmult = QMULT_DEFAULT;
 	snprintf(net->name, sizeof(net->name), "%s%%d", netname);
 
@@ -1023,6 +1065,7 @@ void gether_cleanup(struct eth_dev *dev)
 
 	unregister_netdev(dev->net);
 	flush_work(&dev->work);
+	skb_queue_purge(&dev->rx_done);
 	free_netdev(dev->net);
 }
 EXPORT_SYMBOL_GPL(gether_cleanup);
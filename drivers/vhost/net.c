@@ -460,7 +460,7 @@ static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
 		preempt_disable();
 		endtime = busy_clock() + vq->busyloop_timeout;
 		while (vhost_can_busy_poll(endtime)) {
-			if (vhost_has_work(vq->dev)) {
+			if (vhost_vq_has_work(vq)) {
 				*busyloop_intr = true;
 				break;
 			}
@@ -788,7 +788,7 @@ static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk,
 		endtime = busy_clock() + tvq->busyloop_timeout;
 
 		while (vhost_can_busy_poll(endtime)) {
-			if (vhost_has_work(&net->dev)) {
+			if (vhost_vq_has_work(rvq)) {
 				*busyloop_intr = true;
 				break;
 			}
@@ -1116,9 +1116,13 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX,
 		       UIO_MAXIOV + VHOST_NET_BATCH);
+	/* TX and RX only share the tx vq mutex, taken by RX busy polling */
+	dev->vq_workers = true;
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 
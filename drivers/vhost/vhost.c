@@ -42,6 +42,11 @@ static int max_iotlb_entries = 2048;
 module_param(max_iotlb_entries, int, 0444);
 MODULE_PARM_DESC(max_iotlb_entries,
 	"Maximum number of iotlb entries. (default: 2048)");
+static ushort max_workers = 1;
+module_param(max_workers, ushort, 0644);
+MODULE_PARM_DESC(max_workers,
+	"Maximum number of worker threads of a device, its virtqueues being "
+	"spread over them. (default: 1)");
 
 enum {
 	VHOST_MEMORY_F_LOG = 0x1,
@@ -187,12 +192,14 @@ EXPORT_SYMBOL_GPL(vhost_work_init);
 
 /* Init poll structure */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     __poll_t mask, struct vhost_dev *dev)
+		     __poll_t mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = vq;
 	poll->wqh = NULL;
 
 	vhost_work_init(&poll->work, fn);
@@ -232,17 +239,37 @@ void vhost_poll_stop(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_stop);
 
-void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+static void vhost_worker_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
+{
+	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
+		/* We can only add the work to the list after we're
+		 * sure it was not in the list.
+		 * test_and_set_bit() implies a memory barrier.
+		 */
+		llist_add(&work->node, &worker->work_list);
+		wake_up_process(worker->task);
+	}
+}
+
+static void vhost_worker_flush(struct vhost_worker *worker)
 {
 	struct vhost_flush_struct flush;
 
-	if (dev->worker) {
-		init_completion(&flush.wait_event);
-		vhost_work_init(&flush.work, vhost_flush_work);
+	init_completion(&flush.wait_event);
+	vhost_work_init(&flush.work, vhost_flush_work);
 
-		vhost_work_queue(dev, &flush.work);
-		wait_for_completion(&flush.wait_event);
-	}
+	vhost_worker_queue(worker, &flush.work);
+	wait_for_completion(&flush.wait_event);
+}
+
+/* @work may have been queued to any of the workers, flush them all */
+void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
+{
+	int i;
+
+	for (i = 0; i < dev->nworkers; i++)
+		vhost_worker_flush(&dev->workers[i]);
 }
 EXPORT_SYMBOL_GPL(vhost_work_flush);
 
@@ -256,30 +283,48 @@ EXPORT_SYMBOL_GPL(vhost_poll_flush);
 
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 {
-	if (!dev->worker)
+	if (!dev->workers)
 		return;
 
-	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
-		/* We can only add the work to the list after we're
-		 * sure it was not in the list.
-		 * test_and_set_bit() implies a memory barrier.
-		 */
-		llist_add(&work->node, &dev->work_list);
-		wake_up_process(dev->worker);
-	}
+	vhost_worker_queue(&dev->workers[0], work);
 }
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work)
+{
+	if (!vq->worker)
+		return;
+
+	vhost_worker_queue(vq->worker, work);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_work_queue);
+
 /* A lockless hint for busy polling code to exit the loop */
 bool vhost_has_work(struct vhost_dev *dev)
 {
-	return !llist_empty(&dev->work_list);
+	int i;
+
+	for (i = 0; i < dev->nworkers; i++) {
+		if (!llist_empty(&dev->workers[i].work_list))
+			return true;
+	}
+	return false;
 }
 EXPORT_SYMBOL_GPL(vhost_has_work);
 
+/* Same, for the works run by the worker of @vq */
+bool vhost_vq_has_work(struct vhost_virtqueue *vq)
+{
+	return vq->worker && !llist_empty(&vq->worker->work_list);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	if (poll->vq)
+		vhost_vq_work_queue(poll->vq, &poll->work);
+	else
+		vhost_work_queue(poll->dev, &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_queue);
 
@@ -308,6 +353,7 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->used = NULL;
 	vq->last_avail_idx = 0;
 	vq->avail_idx = 0;
+	vq->avail_heads_num = 0;
 	vq->last_used_idx = 0;
 	vq->signalled_used = 0;
 	vq->signalled_used_valid = false;
@@ -332,7 +378,8 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work, *work_next;
 	struct llist_node *node;
 	mm_segment_t oldfs = get_fs();
@@ -349,7 +396,7 @@ static int vhost_worker(void *data)
 			break;
 		}
 
-		node = llist_del_all(&dev->work_list);
+		node = llist_del_all(&worker->work_list);
 		if (!node)
 			schedule();
 
@@ -426,9 +473,10 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->umem = NULL;
 	dev->iotlb = NULL;
 	dev->mm = NULL;
-	dev->worker = NULL;
+	dev->workers = NULL;
+	dev->nworkers = 0;
+	dev->vq_workers = false;
 	dev->iov_limit = iov_limit;
-	init_llist_head(&dev->work_list);
 	init_waitqueue_head(&dev->wait);
 	INIT_LIST_HEAD(&dev->read_list);
 	INIT_LIST_HEAD(&dev->pending_list);
@@ -441,11 +489,12 @@ void vhost_dev_init(struct vhost_dev *dev,
 		vq->indirect = NULL;
 		vq->heads = NULL;
 		vq->dev = dev;
+		vq->worker = NULL;
 		mutex_init(&vq->mutex);
 		vhost_vq_reset(dev, vq);
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
-					EPOLLIN, dev);
+					EPOLLIN, dev, vq);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -475,12 +524,74 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 static int vhost_attach_cgroups(struct vhost_dev *dev)
 {
 	struct vhost_attach_cgroups_struct attach;
+	int i;
 
 	attach.owner = current;
-	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
-	return attach.ret;
+	for (i = 0; i < dev->nworkers; i++) {
+		vhost_work_init(&attach.work, vhost_attach_cgroups_work);
+		vhost_worker_queue(&dev->workers[i], &attach.work);
+		vhost_worker_flush(&dev->workers[i]);
+		if (attach.ret)
+			return attach.ret;
+	}
+	return 0;
+}
+
+static void vhost_workers_stop(struct vhost_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i]->worker = NULL;
+	for (i = 0; i < dev->nworkers; i++) {
+		WARN_ON(!llist_empty(&dev->workers[i].work_list));
+		kthread_stop(dev->workers[i].task);
+	}
+	kfree(dev->workers);
+	dev->workers = NULL;
+	dev->nworkers = 0;
+}
+
+/* A device whose driver set vq_workers gets up to max_workers workers, the
+ * virtqueues being spread over them; the first one is also given the works
+ * of the device itself.  The workers are named vhost-<owner pid>[-<n>], for
+ * their CPU affinity to be set from user space.
+ */
+static int vhost_workers_start(struct vhost_dev *dev)
+{
+	struct vhost_worker *worker;
+	struct task_struct *task;
+	int i, n = 1;
+
+	if (dev->vq_workers)
+		n = clamp_t(int, READ_ONCE(max_workers), 1, max(dev->nvqs, 1));
+
+	dev->workers = kcalloc(n, sizeof(*dev->workers), GFP_KERNEL);
+	if (!dev->workers)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		worker = &dev->workers[i];
+		worker->dev = dev;
+		init_llist_head(&worker->work_list);
+		if (!i)
+			task = kthread_create(vhost_worker, worker, "vhost-%d",
+					      current->pid);
+		else
+			task = kthread_create(vhost_worker, worker,
+					      "vhost-%d-%d", current->pid, i);
+		if (IS_ERR(task)) {
+			vhost_workers_stop(dev);
+			return PTR_ERR(task);
+		}
+		worker->task = task;
+		dev->nworkers++;
+		wake_up_process(task);	/* avoid contributing to loadavg */
+	}
+
+	for (i = 0; i < dev->nvqs; ++i)
+		dev->vqs[i]->worker = &dev->workers[i % n];
+	return 0;
 }
 
 /* Caller should have device mutex */
@@ -493,7 +604,6 @@ EXPORT_SYMBOL_GPL(vhost_dev_has_owner);
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
 	int err;
 
 	/* Is there an owner already? */
@@ -504,14 +614,9 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
-	if (IS_ERR(worker)) {
-		err = PTR_ERR(worker);
+	err = vhost_workers_start(dev);
+	if (err)
 		goto err_worker;
-	}
-
-	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
 
 	err = vhost_attach_cgroups(dev);
 	if (err)
@@ -523,8 +628,7 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	return 0;
 err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+	vhost_workers_stop(dev);
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -636,11 +740,8 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 	dev->iotlb = NULL;
 	vhost_clear_msg(dev);
 	wake_up_interruptible_poll(&dev->wait, EPOLLIN | EPOLLRDNORM);
-	WARN_ON(!llist_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
+	if (dev->workers)
+		vhost_workers_stop(dev);
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -1570,6 +1671,9 @@ long vhost_vring_ioctl(struct vhost_dev *d, unsigned int ioctl, void __user *arg
 		r = -ENOIOCTLCMD;
 	}
 
+	/* The ring, its size or our place in it may have changed */
+	vq->avail_heads_num = 0;
+
 	if (pollstop && vq->handle_kick)
 		vhost_poll_stop(&vq->poll);
 
@@ -2070,6 +2174,42 @@ static int get_indirect(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+/* Read the head at avail index @idx, which the guest exposed already.
+ * Without an IOTLB, the heads following it that the guest exposed too
+ * are read along, up to VHOST_AVAIL_BATCH of them: a burst of packets
+ * then costs one user copy for its heads rather than one access each.
+ * The guest may not rewrite an entry it exposed, and a stale one would
+ * still go through the checks of a head.
+ */
+static int vhost_get_avail_head(struct vhost_virtqueue *vq, u16 idx,
+				__virtio16 *head)
+{
+	u16 off = idx - vq->avail_heads_idx;
+	unsigned int ring_idx, n;
+
+	if (vq->iotlb)
+		return vhost_get_avail(vq, *head,
+				       &vq->avail->ring[idx & (vq->num - 1)]);
+
+	if (off < vq->avail_heads_num) {
+		*head = vq->avail_heads[off];
+		return 0;
+	}
+
+	ring_idx = idx & (vq->num - 1);
+	n = min3((unsigned int)(u16)(vq->avail_idx - idx),
+		 vq->num - ring_idx, (unsigned int)VHOST_AVAIL_BATCH);
+	if (__copy_from_user(vq->avail_heads, &vq->avail->ring[ring_idx],
+			     n * sizeof(*head))) {
+		vq->avail_heads_num = 0;
+		return -EFAULT;
+	}
+	vq->avail_heads_idx = idx;
+	vq->avail_heads_num = n;
+	*head = vq->avail_heads[0];
+	return 0;
+}
+
 /* This looks in the virtqueue and for the first available buffer, and converts
  * it to an iovec for convenient access.  Since descriptors consist of some
  * number of output then some number of input descriptors, it's actually two
@@ -2121,8 +2261,7 @@ int vhost_get_vq_desc(struct vhost_virtqueue *vq,
 
 	/* Grab the next descriptor number they're advertising, and increment
 	 * the index we've seen. */
-	if (unlikely(vhost_get_avail(vq, ring_head,
-		     &vq->avail->ring[last_avail_idx & (vq->num - 1)]))) {
+	if (unlikely(vhost_get_avail_head(vq, last_avail_idx, &ring_head))) {
 		vq_err(vq, "Failed to read head: idx %d address %p\n",
 		       last_avail_idx,
 		       &vq->avail->ring[last_avail_idx % vq->num]);
@@ -231,6 +231,10 @@ static int virtio_dev_probe(struct device *_d)
 	for (i = VIRTIO_TRANSPORT_F_START; i < VIRTIO_TRANSPORT_F_END; i++)
 		if (device_features & (1ULL << i))
 			__virtio_set_bit(dev, i);
+	/* Older headers end the transport range before the packed ring bit */
+	if (VIRTIO_F_RING_PACKED >= VIRTIO_TRANSPORT_F_END &&
+	    (device_features & (1ULL << VIRTIO_F_RING_PACKED)))
+		__virtio_set_bit(dev, VIRTIO_F_RING_PACKED);
 
 	if (drv->validate) {
 		err = drv->validate(dev);
@@ -93,6 +93,37 @@ void fscrypt_pullback_bio_page(struct page **page, bool restore)
 }
 EXPORT_SYMBOL(fscrypt_pullback_bio_page);
 
+/* The block layer encrypts the zeroes, so just write ZERO_PAGE() */
+static int fscrypt_zeroout_range_inline_crypt(const struct inode *inode,
+					      pgoff_t lblk, sector_t pblk,
+					      unsigned int len)
+{
+	struct bio *bio;
+	int ret, err = 0;
+
+	while (len--) {
+		bio = bio_alloc(GFP_NOFS, 1);
+		fscrypt_set_bio_crypt_ctx(bio, inode, lblk, GFP_NOFS);
+		bio_set_dev(bio, inode->i_sb->s_bdev);
+		bio->bi_iter.bi_sector =
+			pblk << (inode->i_sb->s_blocksize_bits - 9);
+		bio_set_op_attrs(bio, REQ_OP_WRITE, 0);
+		ret = bio_add_page(bio, ZERO_PAGE(0),
+				   inode->i_sb->s_blocksize, 0);
+		if (WARN_ON(ret != inode->i_sb->s_blocksize)) {
+			bio_put(bio);
+			return -EIO;
+		}
+		err = submit_bio_wait(bio);
+		bio_put(bio);
+		if (err)
+			return err;
+		lblk++;
+		pblk++;
+	}
+	return 0;
+}
+
 int fscrypt_zeroout_range(const struct inode *inode, pgoff_t lblk,
 				sector_t pblk, unsigned int len)
 {
@@ -103,6 +134,10 @@ int fscrypt_zeroout_range(const struct inode *inode, pgoff_t lblk,
 
 	BUG_ON(inode->i_sb->s_blocksize != PAGE_SIZE);
 
+	if (fscrypt_inode_uses_inline_crypto(inode))
+		return fscrypt_zeroout_range_inline_crypt(inode, lblk, pblk,
+							  len);
+
 	ctx = fscrypt_get_ctx(inode, GFP_NOFS);
 	if (IS_ERR(ctx))
 		return PTR_ERR(ctx);
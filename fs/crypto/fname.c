@@ -13,9 +13,115 @@
 
 #include <linux/scatterlist.h>
 #include <linux/ratelimit.h>
+#include <linux/jhash.h>
 #include <crypto/skcipher.h>
 #include "fscrypt_private.h"
 
+/*
+ * Listing a directory decrypts all of its names, and listing it again
+ * decrypts them all over.  Each directory keeps the names it decrypted
+ * last in a direct mapped cache keyed by ciphertext, so that repeated
+ * readdirs of a directory copy its names instead of decrypting them.
+ * The cache goes away with the directory's key.
+ */
+#define FSCRYPT_NAME_CACHE_BITS		8
+#define FSCRYPT_NAME_CACHE_SLOTS	(1 << FSCRYPT_NAME_CACHE_BITS)
+
+struct fscrypt_name_cache_entry {
+	u32 clen;
+	u32 plen;
+	u8 names[];	/* ciphertext, then plaintext */
+};
+
+struct fscrypt_name_cache {
+	spinlock_t lock;
+	struct fscrypt_name_cache_entry *slot[FSCRYPT_NAME_CACHE_SLOTS];
+};
+
+static struct fscrypt_name_cache_entry **
+fscrypt_name_cache_slot(struct fscrypt_name_cache *nc,
+			const struct fscrypt_str *iname)
+{
+	u32 hash = jhash(iname->name, iname->len, 0);
+
+	return &nc->slot[hash >> (32 - FSCRYPT_NAME_CACHE_BITS)];
+}
+
+static bool fscrypt_name_cache_lookup(struct fscrypt_info *ci,
+				      const struct fscrypt_str *iname,
+				      struct fscrypt_str *oname)
+{
+	struct fscrypt_name_cache *nc = READ_ONCE(ci->ci_name_cache);
+	struct fscrypt_name_cache_entry *ne;
+	bool found = false;
+
+	if (!nc)
+		return false;
+
+	spin_lock(&nc->lock);
+	ne = *fscrypt_name_cache_slot(nc, iname);
+	if (ne && ne->clen == iname->len &&
+	    !memcmp(ne->names, iname->name, iname->len)) {
+		memcpy(oname->name, ne->names + ne->clen, ne->plen);
+		oname->len = ne->plen;
+		found = true;
+	}
+	spin_unlock(&nc->lock);
+	return found;
+}
+
+static void fscrypt_name_cache_insert(struct inode *dir,
+				      const struct fscrypt_str *iname,
+				      const struct fscrypt_str *oname)
+{
+	struct fscrypt_info *ci = dir->i_crypt_info;
+	struct fscrypt_name_cache *nc = READ_ONCE(ci->ci_name_cache);
+	struct fscrypt_name_cache_entry *ne, **slot;
+
+	if (!S_ISDIR(dir->i_mode))
+		return;
+
+	if (!nc) {
+		nc = kzalloc(sizeof(*nc), GFP_NOFS | __GFP_NOWARN);
+		if (!nc)
+			return;
+		spin_lock_init(&nc->lock);
+		if (cmpxchg(&ci->ci_name_cache, NULL, nc) != NULL) {
+			kfree(nc);
+			nc = ci->ci_name_cache;
+		}
+	}
+
+	ne = kmalloc(sizeof(*ne) + iname->len + oname->len,
+		     GFP_NOFS | __GFP_NOWARN);
+	if (!ne)
+		return;
+	ne->clen = iname->len;
+	ne->plen = oname->len;
+	memcpy(ne->names, iname->name, iname->len);
+	memcpy(ne->names + ne->clen, oname->name, oname->len);
+
+	spin_lock(&nc->lock);
+	slot = fscrypt_name_cache_slot(nc, iname);
+	swap(*slot, ne);
+	spin_unlock(&nc->lock);
+	kzfree(ne);
+}
+
+void fscrypt_free_name_cache(struct fscrypt_info *ci)
+{
+	struct fscrypt_name_cache *nc = ci->ci_name_cache;
+	int i;
+
+	if (!nc)
+		return;
+
+	for (i = 0; i < FSCRYPT_NAME_CACHE_SLOTS; i++)
+		kzfree(nc->slot[i]);
+	kfree(nc);
+	ci->ci_name_cache = NULL;
+}
+
 static inline bool fscrypt_is_dot_dotdot(const struct qstr *str)
 {
 	if (str->len == 1 && str->name[0] == '.')
@@ -100,6 +206,9 @@ static int fname_decrypt(struct inode *inode,
 	union fscrypt_iv iv;
 	int res;
 
+	if (fscrypt_name_cache_lookup(ci, iname, oname))
+		return 0;
+
 	/* Allocate request */
 	req = skcipher_request_alloc(tfm, GFP_NOFS);
 	if (!req)
@@ -125,6 +234,7 @@ static int fname_decrypt(struct inode *inode,
 	}
 
 	oname->len = strnlen(oname->name, iname->len);
+	fscrypt_name_cache_insert(inode, iname, oname);
 	return 0;
 }
 
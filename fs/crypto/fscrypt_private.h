@@ -15,6 +15,7 @@
 #define __FS_HAS_ENCRYPTION 1
 #include <linux/fscrypt.h>
 #include <crypto/hash.h>
+#include <linux/bio-crypt-ctx.h>
 
 /* Encryption parameters */
 #define FS_KEY_DERIVATION_NONCE_SIZE	16
@@ -81,6 +82,21 @@ struct fscrypt_info {
 	 */
 	struct fscrypt_master_key *ci_master_key;
 
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+	/*
+	 * If non-NULL, the block layer en/decrypts the contents of the inode
+	 * with this key. ci_ctfm is still set up, for the reads of single
+	 * blocks through buffer_heads, which bypass inline encryption.
+	 */
+	struct blk_crypto_key *ci_inline_key;
+#endif
+
+	/*
+	 * Directories only: the names decrypted last, keyed by ciphertext.
+	 * Allocated on the first decryption of a name.
+	 */
+	struct fscrypt_name_cache *ci_name_cache;
+
 	/* fields from the fscrypt_context */
 	u8 ci_data_mode;
 	u8 ci_filename_mode;
@@ -158,6 +174,7 @@ extern int fname_encrypt(struct inode *inode, const struct qstr *iname,
 extern bool fscrypt_fname_encrypted_size(const struct inode *inode,
 					 u32 orig_len, u32 max_len,
 					 u32 *encrypted_len_ret);
+extern void fscrypt_free_name_cache(struct fscrypt_info *ci);
 
 /* keyinfo.c */
 
@@ -168,8 +185,41 @@ struct fscrypt_mode {
 	int ivsize;
 	bool logged_impl_name;
 	bool needs_essiv;
+	enum blk_crypto_mode_num blk_crypto_mode;
 };
 
 extern void __exit fscrypt_essiv_cleanup(void);
 
+/* inline_crypt.c */
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+extern bool fscrypt_select_inline_crypt(const struct fscrypt_info *ci,
+					const struct fscrypt_mode *mode,
+					const struct inode *inode);
+extern int fscrypt_prepare_inline_crypt_key(struct fscrypt_info *ci,
+					    const u8 *raw_key,
+					    const struct inode *inode);
+extern void fscrypt_free_inline_crypt_key(struct fscrypt_info *ci,
+					  const struct inode *inode);
+#else
+static inline bool fscrypt_select_inline_crypt(const struct fscrypt_info *ci,
+					       const struct fscrypt_mode *mode,
+					       const struct inode *inode)
+{
+	return false;
+}
+
+static inline int fscrypt_prepare_inline_crypt_key(struct fscrypt_info *ci,
+						   const u8 *raw_key,
+						   const struct inode *inode)
+{
+	WARN_ON(1);
+	return -EOPNOTSUPP;
+}
+
+static inline void fscrypt_free_inline_crypt_key(struct fscrypt_info *ci,
+						 const struct inode *inode)
+{
+}
+#endif
+
 #endif /* _FSCRYPT_PRIVATE_H */
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Inline encryption support for fscrypt
+ *
+ * When the filesystem is mounted with inline encryption enabled and the
+ * block device supports the contents encryption mode of a file, the key of
+ * the file is also handed to the block layer. The filesystem then attaches
+ * an encryption context to the bios of the file and the storage controller
+ * does the en/decryption, with the logical block number as the IV, exactly
+ * like the CPU would. The on-disk format is unchanged, so the data of the
+ * buffer_heads the filesystem reads without a context can still be
+ * decrypted by the CPU.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/buffer_head.h>
+#include "fscrypt_private.h"
+
+static struct request_queue *fscrypt_inline_queue(const struct inode *inode)
+{
+	return bdev_get_queue(inode->i_sb->s_bdev);
+}
+
+/* Should the contents of @inode be en/decrypted by the block device? */
+bool fscrypt_select_inline_crypt(const struct fscrypt_info *ci,
+				 const struct fscrypt_mode *mode,
+				 const struct inode *inode)
+{
+	struct super_block *sb = inode->i_sb;
+
+	if (!S_ISREG(inode->i_mode) || !(sb->s_flags & SB_INLINECRYPT))
+		return false;
+
+	/* The IVs of these policies aren't plain logical block numbers */
+	if ((ci->ci_flags & FS_POLICY_FLAG_DIRECT_KEY) || mode->needs_essiv)
+		return false;
+
+	if (mode->blk_crypto_mode == BLK_ENCRYPTION_MODE_INVALID || !sb->s_bdev)
+		return false;
+
+	return blk_crypto_mode_supported(fscrypt_inline_queue(inode),
+					 mode->blk_crypto_mode,
+					 sb->s_blocksize);
+}
+
+int fscrypt_prepare_inline_crypt_key(struct fscrypt_info *ci,
+				     const u8 *raw_key,
+				     const struct inode *inode)
+{
+	struct blk_crypto_key *blk_key;
+	int err;
+
+	blk_key = kzalloc(sizeof(*blk_key), GFP_NOFS);
+	if (!blk_key)
+		return -ENOMEM;
+
+	err = blk_crypto_init_key(blk_key, raw_key, ci->ci_mode->keysize,
+				  ci->ci_mode->blk_crypto_mode,
+				  inode->i_sb->s_blocksize);
+	if (err) {
+		fscrypt_err(inode->i_sb,
+			    "error %d initializing inline encryption key for inode %lu",
+			    err, inode->i_ino);
+		kzfree(blk_key);
+		return err;
+	}
+
+	if (unlikely(!ci->ci_mode->logged_impl_name)) {
+		ci->ci_mode->logged_impl_name = true;
+		pr_info("fscrypt: %s using blk-crypto (inline encryption)\n",
+			ci->ci_mode->friendly_name);
+	}
+
+	ci->ci_inline_key = blk_key;
+	return 0;
+}
+
+void fscrypt_free_inline_crypt_key(struct fscrypt_info *ci,
+				   const struct inode *inode)
+{
+	int err;
+
+	if (!ci->ci_inline_key)
+		return;
+
+	/* No bio can be using the key anymore, drop it from the keyslots */
+	err = blk_crypto_evict_key(fscrypt_inline_queue(inode),
+				   ci->ci_inline_key);
+	if (err)
+		fscrypt_warn(inode->i_sb,
+			     "error %d evicting inline encryption key of inode %lu",
+			     err, inode->i_ino);
+	kzfree(ci->ci_inline_key);
+	ci->ci_inline_key = NULL;
+}
+
+/**
+ * fscrypt_inode_uses_inline_crypto - test whether the block layer
+ *				      en/decrypts the contents of an inode
+ * @inode: the inode, whose key must be set up
+ */
+bool fscrypt_inode_uses_inline_crypto(const struct inode *inode)
+{
+	return IS_ENCRYPTED(inode) && S_ISREG(inode->i_mode) &&
+	       inode->i_crypt_info && inode->i_crypt_info->ci_inline_key;
+}
+EXPORT_SYMBOL(fscrypt_inode_uses_inline_crypto);
+
+/**
+ * fscrypt_inode_uses_fs_layer_crypto - test whether the filesystem has to
+ *					en/decrypt the contents of an inode
+ * @inode: the inode, whose key must be set up
+ */
+bool fscrypt_inode_uses_fs_layer_crypto(const struct inode *inode)
+{
+	return IS_ENCRYPTED(inode) && S_ISREG(inode->i_mode) &&
+	       !fscrypt_inode_uses_inline_crypto(inode);
+}
+EXPORT_SYMBOL(fscrypt_inode_uses_fs_layer_crypto);
+
+/**
+ * fscrypt_set_bio_crypt_ctx - attach the encryption context of an inode
+ * @bio: the bio, which doesn't have any pages yet
+ * @inode: the inode the data of @bio belongs to
+ * @first_lblk: logical block number of the first block of @bio
+ * @gfp_mask: memory allocation flags, must allow direct reclaim
+ *
+ * Does nothing unless @inode uses inline encryption.
+ */
+void fscrypt_set_bio_crypt_ctx(struct bio *bio, const struct inode *inode,
+			       u64 first_lblk, gfp_t gfp_mask)
+{
+	if (!fscrypt_inode_uses_inline_crypto(inode))
+		return;
+
+	bio_crypt_set_ctx(bio, inode->i_crypt_info->ci_inline_key,
+			  first_lblk, gfp_mask);
+}
+EXPORT_SYMBOL(fscrypt_set_bio_crypt_ctx);
+
+/* The inode and logical block number of the data of a buffer_head */
+static bool bh_get_inode_and_lblk_num(const struct buffer_head *bh,
+				      const struct inode **inode_ret,
+				      u64 *lblk_num_ret)
+{
+	struct page *page = bh->b_page;
+	const struct address_space *mapping;
+	const struct inode *inode;
+
+	/* Pages outside of the page cache, e.g. journal copies, have no file */
+	mapping = page_mapping(page);
+	if (!mapping)
+		return false;
+	inode = mapping->host;
+
+	*inode_ret = inode;
+	*lblk_num_ret = ((u64)page->index << (PAGE_SHIFT - inode->i_blkbits)) +
+			(bh_offset(bh) >> inode->i_blkbits);
+	return true;
+}
+
+/**
+ * fscrypt_set_bio_crypt_ctx_bh - fscrypt_set_bio_crypt_ctx() for a
+ *				  buffer_head
+ * @bio: the bio, which doesn't have any pages yet
+ * @first_bh: the first buffer_head of the data of @bio
+ * @gfp_mask: memory allocation flags, must allow direct reclaim
+ */
+void fscrypt_set_bio_crypt_ctx_bh(struct bio *bio,
+				  const struct buffer_head *first_bh,
+				  gfp_t gfp_mask)
+{
+	const struct inode *inode;
+	u64 first_lblk;
+
+	if (bh_get_inode_and_lblk_num(first_bh, &inode, &first_lblk))
+		fscrypt_set_bio_crypt_ctx(bio, inode, first_lblk, gfp_mask);
+}
+EXPORT_SYMBOL(fscrypt_set_bio_crypt_ctx_bh);
+
+/**
+ * fscrypt_mergeable_bio - test whether data can be added to a bio
+ * @bio: the bio being built up
+ * @inode: the inode of the next data
+ * @next_lblk: logical block number of the next data
+ *
+ * The block layer only merges bios with the same key and contiguous data
+ * unit numbers, and so does a filesystem building a bio.
+ */
+bool fscrypt_mergeable_bio(struct bio *bio, const struct inode *inode,
+			   u64 next_lblk)
+{
+	const struct bio_crypt_ctx *bc = bio->bi_crypt_context;
+
+	if (!bc)
+		return !fscrypt_inode_uses_inline_crypto(inode);
+	if (!fscrypt_inode_uses_inline_crypto(inode) ||
+	    bc->bc_key != inode->i_crypt_info->ci_inline_key)
+		return false;
+
+	return bc->bc_dun + (bio->bi_iter.bi_size >> inode->i_blkbits) ==
+	       next_lblk;
+}
+EXPORT_SYMBOL(fscrypt_mergeable_bio);
+
+/**
+ * fscrypt_mergeable_bio_bh - fscrypt_mergeable_bio() for a buffer_head
+ * @bio: the bio being built up
+ * @next_bh: the next buffer_head of data
+ */
+bool fscrypt_mergeable_bio_bh(struct bio *bio,
+			      const struct buffer_head *next_bh)
+{
+	const struct inode *inode;
+	u64 next_lblk;
+
+	if (!bh_get_inode_and_lblk_num(next_bh, &inode, &next_lblk))
+		return !bio->bi_crypt_context;
+
+	return fscrypt_mergeable_bio(bio, inode, next_lblk);
+}
+EXPORT_SYMBOL(fscrypt_mergeable_bio_bh);
@@ -11,6 +11,7 @@
  * Ext4 extents status tree core functions.
  */
 #include <linux/list_sort.h>
+#include <linux/hash.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include "ext4.h"
@@ -295,34 +296,41 @@ void ext4_es_find_delayed_extent_range(struct inode *inode,
 	trace_ext4_es_find_delayed_extent_range_exit(inode, es);
 }
 
+static struct ext4_es_lru *ext4_es_lru(struct inode *inode)
+{
+	return &EXT4_SB(inode->i_sb)->s_es_lru[hash_long(inode->i_ino,
+							 EXT4_ES_LRU_BITS)];
+}
+
 static void ext4_es_list_add(struct inode *inode)
 {
 	struct ext4_inode_info *ei = EXT4_I(inode);
-	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_es_lru *lru;
 
 	if (!list_empty(&ei->i_es_list))
 		return;
 
-	spin_lock(&sbi->s_es_lock);
+	lru = ext4_es_lru(inode);
+	spin_lock(&lru->lock);
 	if (list_empty(&ei->i_es_list)) {
-		list_add_tail(&ei->i_es_list, &sbi->s_es_list);
-		sbi->s_es_nr_inode++;
+		list_add_tail(&ei->i_es_list, &lru->list);
+		lru->nr_inode++;
 	}
-	spin_unlock(&sbi->s_es_lock);
+	spin_unlock(&lru->lock);
 }
 
 static void ext4_es_list_del(struct inode *inode)
 {
 	struct ext4_inode_info *ei = EXT4_I(inode);
-	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_es_lru *lru = ext4_es_lru(inode);
 
-	spin_lock(&sbi->s_es_lock);
+	spin_lock(&lru->lock);
 	if (!list_empty(&ei->i_es_list)) {
 		list_del_init(&ei->i_es_list);
-		sbi->s_es_nr_inode--;
-		WARN_ON_ONCE(sbi->s_es_nr_inode < 0);
+		lru->nr_inode--;
+		WARN_ON_ONCE(lru->nr_inode < 0);
 	}
-	spin_unlock(&sbi->s_es_lock);
+	spin_unlock(&lru->lock);
 }
 
 static struct extent_status *
@@ -969,32 +977,27 @@ int ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
 	return err;
 }
 
-static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
-		       struct ext4_inode_info *locked_ei)
+/*
+ * Reclaim extents from the inodes of one LRU, walking each inode at most
+ * once. Returns the number of extents reclaimed.
+ */
+static int __es_shrink_lru(struct ext4_es_lru *lru, int *nr_to_scan,
+			   struct ext4_inode_info *locked_ei, int retried,
+			   int *nr_skipped)
 {
 	struct ext4_inode_info *ei;
-	struct ext4_es_stats *es_stats;
-	ktime_t start_time;
-	u64 scan_time;
 	int nr_to_walk;
 	int nr_shrunk = 0;
-	int retried = 0, nr_skipped = 0;
 
-	es_stats = &sbi->s_es_stats;
-	start_time = ktime_get();
-
-retry:
-	spin_lock(&sbi->s_es_lock);
-	nr_to_walk = sbi->s_es_nr_inode;
+	spin_lock(&lru->lock);
+	nr_to_walk = lru->nr_inode;
 	while (nr_to_walk-- > 0) {
-		if (list_empty(&sbi->s_es_list)) {
-			spin_unlock(&sbi->s_es_lock);
-			goto out;
-		}
-		ei = list_first_entry(&sbi->s_es_list, struct ext4_inode_info,
+		if (list_empty(&lru->list))
+			break;
+		ei = list_first_entry(&lru->list, struct ext4_inode_info,
 				      i_es_list);
 		/* Move the inode to the tail */
-		list_move_tail(&ei->i_es_list, &sbi->s_es_list);
+		list_move_tail(&ei->i_es_list, &lru->list);
 
 		/*
 		 * Normally we try hard to avoid shrinking precached inodes,
@@ -1002,28 +1005,58 @@ static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
 		 */
 		if (!retried && ext4_test_inode_state(&ei->vfs_inode,
 						EXT4_STATE_EXT_PRECACHED)) {
-			nr_skipped++;
+			(*nr_skipped)++;
 			continue;
 		}
 
 		if (ei == locked_ei || !write_trylock(&ei->i_es_lock)) {
-			nr_skipped++;
+			(*nr_skipped)++;
 			continue;
 		}
 		/*
 		 * Now we hold i_es_lock which protects us from inode reclaim
 		 * freeing inode under us
 		 */
-		spin_unlock(&sbi->s_es_lock);
+		spin_unlock(&lru->lock);
 
-		nr_shrunk += es_reclaim_extents(ei, &nr_to_scan);
+		nr_shrunk += es_reclaim_extents(ei, nr_to_scan);
 		write_unlock(&ei->i_es_lock);
 
-		if (nr_to_scan <= 0)
+		if (*nr_to_scan <= 0)
+			return nr_shrunk;
+		spin_lock(&lru->lock);
+	}
+	spin_unlock(&lru->lock);
+	return nr_shrunk;
+}
+
+static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
+		       struct ext4_inode_info *locked_ei)
+{
+	struct ext4_es_stats *es_stats;
+	ktime_t start_time;
+	u64 scan_time;
+	unsigned int start, i, bucket;
+	int nr_shrunk = 0;
+	int retried = 0, nr_skipped = 0;
+
+	es_stats = &sbi->s_es_stats;
+	start_time = ktime_get();
+
+retry:
+	/* Continue after the LRU the last scan stopped in */
+	start = READ_ONCE(sbi->s_es_lru_next);
+	for (i = 0; i < EXT4_ES_LRU_BUCKETS; i++) {
+		bucket = (start + i) % EXT4_ES_LRU_BUCKETS;
+		nr_shrunk += __es_shrink_lru(&sbi->s_es_lru[bucket],
+					     &nr_to_scan, locked_ei, retried,
+					     &nr_skipped);
+		if (nr_to_scan <= 0) {
+			WRITE_ONCE(sbi->s_es_lru_next,
+				   (bucket + 1) % EXT4_ES_LRU_BUCKETS);
 			goto out;
-		spin_lock(&sbi->s_es_lock);
+		}
 	}
-	spin_unlock(&sbi->s_es_lock);
 
 	/*
 	 * If we skipped any inodes, and we weren't able to make any
@@ -1093,22 +1126,30 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 {
 	struct ext4_sb_info *sbi = EXT4_SB((struct super_block *) seq->private);
 	struct ext4_es_stats *es_stats = &sbi->s_es_stats;
-	struct ext4_inode_info *ei, *max = NULL;
+	struct ext4_inode_info *ei;
 	unsigned int inode_cnt = 0;
+	unsigned long max_ino = 0;
+	unsigned int max_all_nr = 0, max_shk_nr = 0;
+	int i;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
 
 	/* here we just find an inode that has the max nr. of objects */
-	spin_lock(&sbi->s_es_lock);
-	list_for_each_entry(ei, &sbi->s_es_list, i_es_list) {
-		inode_cnt++;
-		if (max && max->i_es_all_nr < ei->i_es_all_nr)
-			max = ei;
-		else if (!max)
-			max = ei;
+	for (i = 0; i < EXT4_ES_LRU_BUCKETS; i++) {
+		struct ext4_es_lru *lru = &sbi->s_es_lru[i];
+
+		spin_lock(&lru->lock);
+		list_for_each_entry(ei, &lru->list, i_es_list) {
+			/* The inode may go once the lock is dropped */
+			if (!inode_cnt++ || max_all_nr < ei->i_es_all_nr) {
+				max_ino = ei->vfs_inode.i_ino;
+				max_all_nr = ei->i_es_all_nr;
+				max_shk_nr = ei->i_es_shk_nr;
+			}
+		}
+		spin_unlock(&lru->lock);
 	}
-	spin_unlock(&sbi->s_es_lock);
 
 	seq_printf(seq, "stats:\n  %lld objects\n  %lld reclaimable objects\n",
 		   percpu_counter_sum_positive(&es_stats->es_stats_all_cnt),
@@ -1126,7 +1167,7 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 		seq_printf(seq,
 		    "maximum:\n  %lu inode (%u objects, %u reclaimable)\n"
 		    "  %llu us max scan time\n",
-		    max->vfs_inode.i_ino, max->i_es_all_nr, max->i_es_shk_nr,
+		    max_ino, max_all_nr, max_shk_nr,
 		    div_u64(es_stats->es_stats_max_scan_time, 1000));
 
 	return 0;
@@ -1134,13 +1175,16 @@ int ext4_seq_es_shrinker_info_show(struct seq_file *seq, void *v)
 
 int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
 {
-	int err;
+	int err, i;
 
 	/* Make sure we have enough bits for physical block number */
 	BUILD_BUG_ON(ES_SHIFT < 48);
-	INIT_LIST_HEAD(&sbi->s_es_list);
-	sbi->s_es_nr_inode = 0;
-	spin_lock_init(&sbi->s_es_lock);
+	for (i = 0; i < EXT4_ES_LRU_BUCKETS; i++) {
+		INIT_LIST_HEAD(&sbi->s_es_lru[i].list);
+		sbi->s_es_lru[i].nr_inode = 0;
+		spin_lock_init(&sbi->s_es_lru[i].lock);
+	}
+	sbi->s_es_lru_next = 0;
 	sbi->s_es_stats.es_stats_shrunk = 0;
 	sbi->s_es_stats.es_stats_cache_hits = 0;
 	sbi->s_es_stats.es_stats_cache_misses = 0;
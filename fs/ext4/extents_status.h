@@ -68,6 +68,20 @@ struct ext4_es_tree {
 	struct extent_status *cache_es;	/* recently accessed extent */
 };
 
+/*
+ * Inodes with reclaimable extents are spread over LRU lists by inode
+ * number, so that neither adding them nor shrinking holds one lock over
+ * all of them.
+ */
+#define EXT4_ES_LRU_BITS	4
+#define EXT4_ES_LRU_BUCKETS	(1 << EXT4_ES_LRU_BITS)
+
+struct ext4_es_lru {
+	spinlock_t lock ____cacheline_aligned_in_smp;
+	struct list_head list;	/* inodes with reclaimable extents */
+	long nr_inode;
+};
+
 struct ext4_es_stats {
 	unsigned long es_stats_shrunk;
 	unsigned long es_stats_cache_hits;
@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits of inodes for fsync
+ *
+ * fsync normally waits for the commit of the running transaction, which
+ * writes out every metadata block anyone changed since the last commit.
+ * When all an inode had changed in that transaction are fields of its own,
+ * e.g. its size within allocated blocks or its timestamps, its raw inode is
+ * written to the fast commit blocks of the journal instead: one block with
+ * one flush, not a whole transaction.
+ *
+ * Any change which also needs other metadata, block allocation, extent
+ * tree, xattr block, link count, orphan list or directory changes, makes
+ * the inode ineligible until the transaction commits; fsync then falls back
+ * to waiting for the commit.
+ *
+ * A fast commit is only made while the transactions before the running one
+ * are all committed. After a crash, recovery replays the transactions, then
+ * the fast commits made while the first uncommitted transaction was
+ * running by copying their raw inodes back to the inode tables.
+ */
+
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/crc32.h>
+#include <linux/slab.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+
+#define EXT4_FC_MAGIC		0xec4fc001
+
+/* On-disk format of a fast commit block */
+struct ext4_fc_inode_block {
+	__le32	fc_magic;
+	__le32	fc_tid;		/* transaction running at the fast commit */
+	__le32	fc_off;		/* index among the fast commit blocks */
+	__le32	fc_ino;
+	__le16	fc_inode_size;
+	__le16	fc_reserved;
+	__le32	fc_crc;		/* of the fields above and of the inode */
+	__u8	fc_inode[0];	/* raw inode */
+};
+
+static u32 ext4_fc_csum(struct super_block *sb,
+			struct ext4_fc_inode_block *fcb, unsigned int size)
+{
+	u32 crc;
+
+	crc = crc32_le(~0, EXT4_SB(sb)->s_es->s_uuid,
+		       sizeof(EXT4_SB(sb)->s_es->s_uuid));
+	crc = crc32_le(crc, (u8 *)fcb,
+		       offsetof(struct ext4_fc_inode_block, fc_crc));
+	return crc32_le(crc, fcb->fc_inode, size);
+}
+
+/* @inode needs the full commit of the running transaction of @handle */
+void ext4_fc_mark_ineligible(handle_t *handle, struct inode *inode)
+{
+	if (ext4_handle_valid(handle))
+		WRITE_ONCE(EXT4_I(inode)->i_fc_ineligible_tid,
+			   handle->h_transaction->t_tid);
+}
+
+static int ext4_fc_write_block(journal_t *journal, unsigned int off,
+			       struct ext4_fc_inode_block *fcb,
+			       unsigned int len)
+{
+	struct buffer_head *bh;
+	int flags = REQ_SYNC;
+	int err;
+
+	bh = jbd2_fc_get_buf(journal, off);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+
+	/* The data the inode refers to must be stable first */
+	if (journal->j_flags & JBD2_BARRIER) {
+		flags |= REQ_PREFLUSH | REQ_FUA;
+		if (journal->j_fs_dev != journal->j_dev) {
+			err = blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS,
+						 NULL);
+			if (err)
+				goto out;
+		}
+	}
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, bh->b_size);
+	memcpy(bh->b_data, fcb, len);
+	set_buffer_uptodate(bh);
+	clear_buffer_dirty(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(REQ_OP_WRITE, flags, bh);
+	wait_on_buffer(bh);
+	err = buffer_uptodate(bh) ? 0 : -EIO;
+out:
+	brelse(bh);
+	return err;
+}
+
+/**
+ * ext4_fc_commit() - make the changes of an inode durable by a fast commit
+ * @inode: the inode to fsync, whose data has been written back
+ * @commit_tid: the transaction holding its latest changes
+ *
+ * Returns -EAGAIN when the inode can't be fast committed, in which case
+ * the transaction has to be committed instead.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	journal_t *journal = sbi->s_journal;
+	unsigned int size = EXT4_INODE_SIZE(sb);
+	struct ext4_fc_inode_block *fcb;
+	struct ext4_iloc iloc;
+	bool running, committing;
+	tid_t committing_tid = 0;
+	int err;
+
+	if (!jbd2_has_feature_inode_fc(journal) ||
+	    !S_ISREG(inode->i_mode) || inode->i_ino < EXT4_FIRST_INO(sb) ||
+	    sizeof(*fcb) + size > sb->s_blocksize ||
+	    READ_ONCE(ei->i_fc_ineligible_tid) == commit_tid)
+		return -EAGAIN;
+
+	fcb = kzalloc(sizeof(*fcb) + size, GFP_NOFS);
+	if (!fcb)
+		return -EAGAIN;
+
+	mutex_lock(&sbi->s_fc_lock);
+	do {
+		read_lock(&journal->j_state_lock);
+		running = journal->j_running_transaction &&
+			journal->j_running_transaction->t_tid == commit_tid;
+		committing = journal->j_committing_transaction;
+		if (committing)
+			committing_tid =
+				journal->j_committing_transaction->t_tid;
+		read_unlock(&journal->j_state_lock);
+		if (!running) {
+			err = -EAGAIN;
+			goto out;
+		}
+		/* Replay mustn't depend on a transaction that may abort */
+		if (committing)
+			jbd2_log_wait_commit(journal, committing_tid);
+	} while (committing);
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		goto out;
+	spin_lock(&ei->i_raw_lock);
+	/* Ineligible changes are noted before they reach the raw inode */
+	if (ei->i_fc_ineligible_tid == commit_tid)
+		err = -EAGAIN;
+	else
+		memcpy(fcb->fc_inode, ext4_raw_inode(&iloc), size);
+	spin_unlock(&ei->i_raw_lock);
+	brelse(iloc.bh);
+	if (err)
+		goto out;
+
+	/* Fast commits of committed transactions are obsolete */
+	if (sbi->s_fc_tid != commit_tid) {
+		sbi->s_fc_tid = commit_tid;
+		sbi->s_fc_off = 0;
+	}
+
+	fcb->fc_magic = cpu_to_le32(EXT4_FC_MAGIC);
+	fcb->fc_tid = cpu_to_le32(commit_tid);
+	fcb->fc_off = cpu_to_le32(sbi->s_fc_off);
+	fcb->fc_ino = cpu_to_le32(inode->i_ino);
+	fcb->fc_inode_size = cpu_to_le16(size);
+	fcb->fc_crc = cpu_to_le32(ext4_fc_csum(sb, fcb, size));
+
+	err = ext4_fc_write_block(journal, sbi->s_fc_off, fcb,
+				  sizeof(*fcb) + size);
+	if (err == -ENOSPC)
+		err = -EAGAIN;
+	if (!err)
+		sbi->s_fc_off++;
+out:
+	mutex_unlock(&sbi->s_fc_lock);
+	kfree(fcb);
+	return err;
+}
+
+/*
+ * jbd2 recovery callback, see j_fc_replay_callback. The fast commits of
+ * @expected_tid are in order from the first fast commit block on, so later
+ * ones of an inode replace the earlier ones.
+ */
+int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+		   unsigned int off, tid_t expected_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_inode_block *fcb = (void *)bh->b_data;
+	unsigned int size = le16_to_cpu(fcb->fc_inode_size);
+	int inodes_per_block = sbi->s_inodes_per_block;
+	struct ext4_group_desc *gdp;
+	struct buffer_head *ibh;
+	unsigned long ino, inode_offset;
+	ext4_fsblk_t block;
+
+	if (fcb->fc_magic != cpu_to_le32(EXT4_FC_MAGIC) ||
+	    le32_to_cpu(fcb->fc_tid) != expected_tid ||
+	    le32_to_cpu(fcb->fc_off) != off ||
+	    size != EXT4_INODE_SIZE(sb) || sizeof(*fcb) + size > bh->b_size ||
+	    le32_to_cpu(fcb->fc_crc) != ext4_fc_csum(sb, fcb, size))
+		return 0;
+
+	ino = le32_to_cpu(fcb->fc_ino);
+	if (ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(sbi->s_es->s_inodes_count)) {
+		ext4_msg(sb, KERN_ERR, "fast commit of invalid inode %lu",
+			 ino);
+		return -EFSCORRUPTED;
+	}
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EFSCORRUPTED;
+	inode_offset = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	block = ext4_inode_table(sb, gdp) + inode_offset / inodes_per_block;
+
+	ibh = sb_bread(sb, block);
+	if (!ibh)
+		return -EIO;
+	lock_buffer(ibh);
+	memcpy(ibh->b_data + (inode_offset % inodes_per_block) * size,
+	       fcb->fc_inode, size);
+	unlock_buffer(ibh);
+	mark_buffer_dirty(ibh);
+	brelse(ibh);
+
+	jbd_debug(1, "ext4: replayed fast commit %u of inode %lu\n", off, ino);
+	return 1;
+}
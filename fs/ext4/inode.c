@@ -5027,6 +5027,8 @@ struct inode *__ext4_iget(struct super_block *sb, unsigned long ino,
 		read_unlock(&journal->j_state_lock);
 		ei->i_sync_tid = tid;
 		ei->i_datasync_tid = tid;
+		/* Earlier updates in @tid may not have been checked */
+		ei->i_fc_ineligible_tid = tid;
 	}
 
 	if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE) {
@@ -5247,6 +5249,28 @@ static void ext4_update_other_inodes_time(struct super_block *sb,
  *
  * The caller must have write access to iloc->bh.
  */
+/*
+ * Does the update of @raw_inode change more than what a fast commit of the
+ * inode alone can make durable? Called with i_raw_lock held.
+ */
+static bool ext4_fc_update_ineligible(struct inode *inode,
+				      struct ext4_inode *raw_inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	if (ext4_test_inode_state(inode, EXT4_STATE_NEW))
+		return true;
+	if (le16_to_cpu(raw_inode->i_links_count) != inode->i_nlink ||
+	    le32_to_cpu(raw_inode->i_dtime) != ei->i_dtime ||
+	    le32_to_cpu(raw_inode->i_flags) != (ei->i_flags & 0xFFFFFFFF) ||
+	    le32_to_cpu(raw_inode->i_file_acl_lo) != (u32)ei->i_file_acl ||
+	    ext4_inode_blocks(raw_inode, ei) != inode->i_blocks)
+		return true;
+	/* Extent tree or block map root, or inline data */
+	return !S_ISCHR(inode->i_mode) && !S_ISBLK(inode->i_mode) &&
+	       memcmp(raw_inode->i_block, ei->i_data, sizeof(ei->i_data));
+}
+
 static int ext4_do_update_inode(handle_t *handle,
 				struct inode *inode,
 				struct ext4_iloc *iloc)
@@ -5263,6 +5287,10 @@ static int ext4_do_update_inode(handle_t *handle,
 
 	spin_lock(&ei->i_raw_lock);
 
+	if (test_opt(sb, FAST_COMMIT) &&
+	    ext4_fc_update_ineligible(inode, raw_inode))
+		ext4_fc_mark_ineligible(handle, inode);
+
 	/* For fields not tracked in the in-memory inode,
 	 * initialise them to zero for new inodes. */
 	if (ext4_test_inode_state(inode, EXT4_STATE_NEW))
@@ -5377,6 +5405,7 @@ static int ext4_do_update_inode(handle_t *handle,
 			goto out_brelse;
 		ext4_update_dynamic_rev(sb);
 		ext4_set_feature_large_file(sb);
+		ext4_fc_mark_ineligible(handle, inode);
 		ext4_handle_sync(handle);
 		err = ext4_handle_dirty_super(handle, sb);
 	}
@@ -77,6 +77,18 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * pick the groups of the first two passes from the lists of groups sorted
+ * by free extent sizes instead of scanning all of them, unless there are
+ * only a few groups. We can tune the same via
+ * /sys/fs/ext4/<partition>/mb_optimize_scan
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+#define MB_DEFAULT_LINEAR_SCAN_THRESHOLD	16
+
+/* number of orders of buddies, which is also that of group lists */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
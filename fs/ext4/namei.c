@@ -1488,6 +1488,201 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 	return ret;
 }
 
+/*
+ * Lookup cache of the hash index of htree directories
+ *
+ * Every lookup that misses the dcache in an htree directory reads the
+ * index blocks from the root down to the leaf for the hash of the name.
+ * The first lookup instead flattens the leaf level of the index into an
+ * array of (start hash, leaf block) sorted by hash, which later lookups
+ * binary search, so they only read the leaf blocks. Index updates drop
+ * the array. Lookups hold the directory's i_rwsem shared and updates hold
+ * it exclusive, so lookups can only race each other installing it.
+ */
+#define EXT4_DX_CACHE_MAX_ENTRIES	65536
+
+struct ext4_dx_cache {
+	int hash_version;
+	unsigned int count;
+	struct {
+		u32 hash;
+		ext4_lblk_t block;
+	} map[0];
+};
+
+static int ext4_dx_cache_fill(struct inode *dir, struct ext4_dx_cache *cache,
+			      unsigned int capacity, struct dx_entry *entries,
+			      u32 start_hash, unsigned int levels)
+{
+	ext4_lblk_t nblocks = dir->i_size >> EXT4_BLOCK_SIZE_BITS(dir->i_sb);
+	unsigned int count = dx_get_count(entries);
+	struct dx_entry *node_entries;
+	struct buffer_head *bh;
+	ext4_lblk_t block;
+	unsigned int i;
+	u32 hash;
+	int err;
+
+	if (!count || count > dx_get_limit(entries))
+		return -EFSCORRUPTED;
+
+	for (i = 0; i < count; i++) {
+		/* The first entry starts where the parent's entry does */
+		hash = i ? dx_get_hash(entries + i) : start_hash;
+		block = dx_get_block(entries + i);
+		if (!block || block >= nblocks)
+			return -EFSCORRUPTED;
+		if (!levels) {
+			if (cache->count == capacity)
+				return -E2BIG;
+			if (cache->count &&
+			    hash < cache->map[cache->count - 1].hash)
+				return -EFSCORRUPTED;
+			cache->map[cache->count].hash = hash;
+			cache->map[cache->count].block = block;
+			cache->count++;
+			continue;
+		}
+
+		bh = ext4_read_dirblock(dir, block, INDEX);
+		if (IS_ERR(bh))
+			return PTR_ERR(bh);
+		node_entries = ((struct dx_node *) bh->b_data)->entries;
+		if (dx_get_limit(node_entries) != dx_node_limit(dir))
+			err = -EFSCORRUPTED;
+		else
+			err = ext4_dx_cache_fill(dir, cache, capacity,
+						 node_entries, hash,
+						 levels - 1);
+		brelse(bh);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+/* Returns the lookup cache of @dir, building it if needed, or NULL */
+static struct ext4_dx_cache *ext4_dx_cache_get(struct inode *dir)
+{
+	struct ext4_inode_info *ei = EXT4_I(dir);
+	struct ext4_dx_cache *cache = READ_ONCE(ei->i_dx_cache);
+	ext4_lblk_t nblocks;
+	unsigned int capacity;
+	struct buffer_head *bh;
+	struct dx_root *root;
+	struct dx_entry *entries;
+	int err = -EFSCORRUPTED;
+
+	if (cache || ext4_test_inode_state(dir, EXT4_STATE_DX_NOCACHE))
+		return cache;
+
+	nblocks = dir->i_size >> EXT4_BLOCK_SIZE_BITS(dir->i_sb);
+	capacity = min_t(ext4_lblk_t, nblocks, EXT4_DX_CACHE_MAX_ENTRIES);
+
+	bh = ext4_read_dirblock(dir, 0, INDEX);
+	if (IS_ERR(bh))
+		return NULL;
+	/* dx_probe() warns about what isn't valid here */
+	root = (struct dx_root *) bh->b_data;
+	if ((root->info.hash_version != DX_HASH_TEA &&
+	     root->info.hash_version != DX_HASH_HALF_MD4 &&
+	     root->info.hash_version != DX_HASH_LEGACY) ||
+	    (root->info.unused_flags & 1) ||
+	    root->info.indirect_levels >= ext4_dir_htree_level(dir->i_sb))
+		goto out;
+	entries = (struct dx_entry *)(((char *)&root->info) +
+				      root->info.info_length);
+	if (dx_get_limit(entries) != dx_root_limit(dir,
+						   root->info.info_length))
+		goto out;
+
+	err = -ENOMEM;
+	cache = kvmalloc(sizeof(*cache) + capacity * sizeof(cache->map[0]),
+			 GFP_KERNEL);
+	if (!cache)
+		goto out;
+	cache->hash_version = root->info.hash_version;
+	if (cache->hash_version <= DX_HASH_TEA)
+		cache->hash_version += EXT4_SB(dir->i_sb)->s_hash_unsigned;
+	cache->count = 0;
+	err = ext4_dx_cache_fill(dir, cache, capacity, entries, 0,
+				 root->info.indirect_levels);
+	if (err) {
+		kvfree(cache);
+		cache = NULL;
+		goto out;
+	}
+
+	if (cmpxchg(&ei->i_dx_cache, NULL, cache)) {
+		kvfree(cache);
+		cache = READ_ONCE(ei->i_dx_cache);
+	}
+out:
+	brelse(bh);
+	/* Don't rebuild it on every lookup if it can't be built */
+	if (err == -E2BIG || err == -EFSCORRUPTED)
+		ext4_set_inode_state(dir, EXT4_STATE_DX_NOCACHE);
+	return cache;
+}
+
+/* To be called with i_rwsem of @dir held exclusive, or on eviction */
+void ext4_dx_cache_invalidate(struct inode *dir)
+{
+	struct ext4_inode_info *ei = EXT4_I(dir);
+
+	if (ei->i_dx_cache) {
+		kvfree(ei->i_dx_cache);
+		ei->i_dx_cache = NULL;
+	}
+}
+
+static struct buffer_head *ext4_dx_cache_find_entry(struct inode *dir,
+			struct ext4_dx_cache *cache,
+			struct ext4_filename *fname,
+			struct ext4_dir_entry_2 **res_dir)
+{
+	struct dx_hash_info *hinfo = &fname->hinfo;
+	struct buffer_head *bh;
+	unsigned int p, q, m;
+	ext4_lblk_t block;
+	int retval;
+
+	hinfo->hash_version = cache->hash_version;
+	hinfo->seed = EXT4_SB(dir->i_sb)->s_hash_seed;
+	if (fname_name(fname))
+		ext4fs_dirhash(fname_name(fname), fname_len(fname), hinfo);
+
+	/* The last leaf starting at or below the hash, as in dx_probe() */
+	p = 1;
+	q = cache->count;
+	while (p < q) {
+		m = p + (q - p) / 2;
+		if (cache->map[m].hash > hinfo->hash)
+			q = m;
+		else
+			p = m + 1;
+	}
+	p--;
+
+	do {
+		block = cache->map[p].block;
+		bh = ext4_read_dirblock(dir, block, DIRENT);
+		if (IS_ERR(bh))
+			return bh;
+		retval = search_dirblock(bh, dir, fname,
+				block << EXT4_BLOCK_SIZE_BITS(dir->i_sb),
+				res_dir);
+		if (retval == 1)
+			return bh;
+		brelse(bh);
+		if (retval == -1)
+			return ERR_PTR(ERR_BAD_DX_DIR);
+		/* Hash collisions continue in the next leaf */
+	} while (++p < cache->count &&
+		 (cache->map[p].hash & ~1) == hinfo->hash);
+	return NULL;
+}
+
 static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 			struct ext4_filename *fname,
 			struct ext4_dir_entry_2 **res_dir)
@@ -1498,9 +1693,14 @@ static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 	ext4_lblk_t block;
 	int retval;
 
+	struct ext4_dx_cache *cache;
 #ifdef CONFIG_EXT4_FS_ENCRYPTION
 	*res_dir = NULL;
 #endif
+	cache = ext4_dx_cache_get(dir);
+	if (cache)
+		return ext4_dx_cache_find_entry(dir, cache, fname, res_dir);
+
 	frame = dx_probe(fname, dir, NULL, frames);
 	if (IS_ERR(frame))
 		return (struct buffer_head *) frame;
@@ -1923,6 +2123,7 @@ static int make_indexed_dir(handle_t *handle, struct ext4_filename *fname,
 
 	blocksize =  dir->i_sb->s_blocksize;
 	dxtrace(printk(KERN_DEBUG "Creating index: inode %lu\n", dir->i_ino));
+	ext4_dx_cache_invalidate(dir);
 	BUFFER_TRACE(bh, "get_write_access");
 	retval = ext4_journal_get_write_access(handle, bh);
 	if (retval) {
@@ -2157,6 +2358,8 @@ static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
 		goto cleanup;
 
 	err = 0;
+	/* The index changes from here on */
+	ext4_dx_cache_invalidate(dir);
 	/* Block full, should compress but for now just split */
 	dxtrace(printk(KERN_DEBUG "using %u of %u node entries\n",
 		       dx_get_count(entries), dx_get_limit(entries)));
@@ -2763,6 +2966,7 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	 */
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		return 0;
+	ext4_fc_mark_ineligible(handle, inode);
 
 	/*
 	 * Orphan handling is only valid for files with data blocks
@@ -2844,6 +3048,7 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 	/* Do this quick check before taking global s_orphan_lock. */
 	if (list_empty(&ei->i_orphan))
 		return 0;
+	ext4_fc_mark_ineligible(handle, inode);
 
 	if (handle) {
 		/* Grab inode buffer early before taking global s_orphan_lock */
@@ -3557,6 +3762,11 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
+	/* The new name is only durable with the directory blocks */
+	ext4_fc_mark_ineligible(handle, old.inode);
+	if (new.inode)
+		ext4_fc_mark_ineligible(handle, new.inode);
+
 	if (S_ISDIR(old.inode->i_mode)) {
 		if (new.inode) {
 			retval = -ENOTEMPTY;
@@ -2321,6 +2321,7 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 		return -ERANGE;
 
 	ext4_write_lock_xattr(inode, &no_expand);
+	ext4_fc_mark_ineligible(handle, inode);
 
 	/* Check journal credits under write lock. */
 	if (ext4_handle_valid(handle)) {
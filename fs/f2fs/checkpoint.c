@@ -22,6 +22,7 @@
 
 static struct kmem_cache *ino_entry_slab;
 struct kmem_cache *f2fs_inode_entry_slab;
+static struct workqueue_struct *f2fs_cp_flush_wq;
 
 void f2fs_stop_checkpoint(struct f2fs_sb_info *sbi, bool end_io)
 {
@@ -1065,6 +1066,143 @@ int f2fs_sync_inode_meta(struct f2fs_sb_info *sbi)
 	return 0;
 }
 
+/*
+ * The dirty dentry pages and inode metadata flushed by a checkpoint are
+ * spread over up to cp_flush_threads threads: the checkpointing one and
+ * workers, each taking the next inode of the list that no other one holds.
+ */
+struct cp_flush_control {
+	struct f2fs_sb_info *sbi;
+	enum inode_type type;		/* DIR_INODE or DIRTY_META */
+	atomic_t budget;		/* # of inodes left to flush */
+	int err;
+};
+
+struct cp_flush_work {
+	struct work_struct work;
+	struct cp_flush_control *ctl;
+};
+
+static struct inode *__grab_flush_inode(struct f2fs_sb_info *sbi,
+						enum inode_type type)
+{
+	struct list_head *head = &sbi->inode_list[type];
+	struct f2fs_inode_info *fi;
+	struct inode *inode = NULL;
+	struct list_head *pos;
+
+	spin_lock(&sbi->inode_lock[type]);
+	list_for_each(pos, head) {
+		if (type == DIRTY_META)
+			fi = list_entry(pos, struct f2fs_inode_info,
+							gdirty_list);
+		else
+			fi = list_entry(pos, struct f2fs_inode_info,
+							dirty_list);
+
+		if (is_inode_flag_set(&fi->vfs_inode, FI_CP_FLUSHING))
+			continue;
+		inode = igrab(&fi->vfs_inode);
+		if (inode) {
+			set_inode_flag(inode, FI_CP_FLUSHING);
+			break;
+		}
+	}
+	spin_unlock(&sbi->inode_lock[type]);
+	return inode;
+}
+
+static void __cp_flush_inodes(struct cp_flush_control *ctl)
+{
+	struct f2fs_sb_info *sbi = ctl->sbi;
+	struct inode *inode;
+
+	while (atomic_dec_return(&ctl->budget) >= 0) {
+		if (unlikely(f2fs_cp_error(sbi))) {
+			WRITE_ONCE(ctl->err, -EIO);
+			return;
+		}
+
+		inode = __grab_flush_inode(sbi, ctl->type);
+		if (!inode)
+			return;
+
+		if (ctl->type == DIR_INODE) {
+			F2FS_I(inode)->cp_task = current;
+			filemap_fdatawrite(inode->i_mapping);
+			F2FS_I(inode)->cp_task = NULL;
+		} else {
+			sync_inode_metadata(inode, 0);
+
+			/* it's on eviction */
+			if (is_inode_flag_set(inode, FI_DIRTY_INODE))
+				f2fs_update_inode_page(inode);
+		}
+
+		clear_inode_flag(inode, FI_CP_FLUSHING);
+		iput(inode);
+		cond_resched();
+	}
+}
+
+static void f2fs_cp_flush_work(struct work_struct *work)
+{
+	struct cp_flush_work *cfw = container_of(work,
+					struct cp_flush_work, work);
+
+	__cp_flush_inodes(cfw->ctl);
+}
+
+static int f2fs_cp_flush_inodes(struct f2fs_sb_info *sbi,
+						enum inode_type type)
+{
+	struct cp_flush_work works[MAX_CP_FLUSH_THREADS - 1];
+	struct cp_flush_control ctl = {
+		.sbi = sbi,
+		.type = type,
+		.err = 0,
+	};
+	unsigned int nr_works;
+	s64 budget = INT_MAX;
+	int i;
+
+	nr_works = min_t(unsigned int, sbi->cp_flush_threads,
+					MAX_CP_FLUSH_THREADS) - 1;
+	if (!nr_works) {
+		if (type == DIR_INODE)
+			return f2fs_sync_dirty_inodes(sbi, DIR_INODE);
+		return f2fs_sync_inode_meta(sbi);
+	}
+
+	if (type == DIR_INODE)
+		trace_f2fs_sync_dirty_inodes_enter(sbi->sb, true,
+				get_pages(sbi, F2FS_DIRTY_DENTS));
+	else
+		budget = min_t(s64, budget, get_pages(sbi, F2FS_DIRTY_IMETA));
+	atomic_set(&ctl.budget, budget);
+
+	for (i = 0; i < nr_works; i++) {
+		INIT_WORK_ONSTACK(&works[i].work, f2fs_cp_flush_work);
+		works[i].ctl = &ctl;
+		queue_work(f2fs_cp_flush_wq, &works[i].work);
+	}
+
+	__cp_flush_inodes(&ctl);
+
+	for (i = 0; i < nr_works; i++) {
+		flush_work(&works[i].work);
+		destroy_work_on_stack(&works[i].work);
+	}
+
+	if (type == DIR_INODE) {
+		/* submit what the flushers merged, pending on freed inodes */
+		f2fs_submit_merged_write(sbi, DATA);
+		trace_f2fs_sync_dirty_inodes_exit(sbi->sb, true,
+				get_pages(sbi, F2FS_DIRTY_DENTS));
+	}
+	return ctl.err;
+}
+
 static void __prepare_cp_block(struct f2fs_sb_info *sbi)
 {
 	struct f2fs_checkpoint *ckpt = F2FS_CKPT(sbi);
@@ -1104,7 +1242,9 @@ static int block_operations(struct f2fs_sb_info *sbi)
 		.for_reclaim = 0,
 	};
 	struct blk_plug plug;
-	int err = 0, cnt = 0;
+	s64 flush_time[NR_CP_FLUSH] = { 0 };
+	ktime_t start;
+	int err = 0, cnt = 0, i;
 
 	blk_start_plug(&plug);
 
@@ -1137,7 +1277,10 @@ static int block_operations(struct f2fs_sb_info *sbi)
 	/* write all the dirty dentry pages */
 	if (get_pages(sbi, F2FS_DIRTY_DENTS)) {
 		f2fs_unlock_all(sbi);
-		err = f2fs_sync_dirty_inodes(sbi, DIR_INODE);
+		start = ktime_get();
+		err = f2fs_cp_flush_inodes(sbi, DIR_INODE);
+		flush_time[CP_FLUSH_DENTS] +=
+				ktime_ms_delta(ktime_get(), start);
 		if (err)
 			goto out;
 		cond_resched();
@@ -1159,7 +1302,10 @@ static int block_operations(struct f2fs_sb_info *sbi)
 	if (get_pages(sbi, F2FS_DIRTY_IMETA)) {
 		up_write(&sbi->node_change);
 		f2fs_unlock_all(sbi);
-		err = f2fs_sync_inode_meta(sbi);
+		start = ktime_get();
+		err = f2fs_cp_flush_inodes(sbi, DIRTY_META);
+		flush_time[CP_FLUSH_IMETA] +=
+				ktime_ms_delta(ktime_get(), start);
 		if (err)
 			goto out;
 		cond_resched();
@@ -1171,9 +1317,12 @@ static int block_operations(struct f2fs_sb_info *sbi)
 
 	if (get_pages(sbi, F2FS_DIRTY_NODES)) {
 		up_write(&sbi->node_write);
+		start = ktime_get();
 		atomic_inc(&sbi->wb_sync_req[NODE]);
 		err = f2fs_sync_node_pages(sbi, &wbc, false, FS_CP_NODE_IO);
 		atomic_dec(&sbi->wb_sync_req[NODE]);
+		flush_time[CP_FLUSH_NODES] +=
+				ktime_ms_delta(ktime_get(), start);
 		if (err) {
 			up_write(&sbi->node_change);
 			f2fs_unlock_all(sbi);
@@ -1191,6 +1340,8 @@ static int block_operations(struct f2fs_sb_info *sbi)
 	up_write(&sbi->node_change);
 out:
 	blk_finish_plug(&plug);
+	for (i = 0; i < NR_CP_FLUSH; i++)
+		stat_set_cp_flush_time(F2FS_STAT(sbi), i, flush_time[i]);
 	return err;
 }
 
@@ -1603,15 +1754,24 @@ int __init f2fs_create_checkpoint_caches(void)
 		return -ENOMEM;
 	f2fs_inode_entry_slab = f2fs_kmem_cache_create("f2fs_inode_entry",
 			sizeof(struct inode_entry));
-	if (!f2fs_inode_entry_slab) {
-		kmem_cache_destroy(ino_entry_slab);
-		return -ENOMEM;
-	}
+	if (!f2fs_inode_entry_slab)
+		goto free_ino_entry;
+	f2fs_cp_flush_wq = alloc_workqueue("f2fs_cp_flush",
+			WQ_UNBOUND | WQ_MEM_RECLAIM, MAX_CP_FLUSH_THREADS);
+	if (!f2fs_cp_flush_wq)
+		goto free_inode_entry;
 	return 0;
+
+free_inode_entry:
+	kmem_cache_destroy(f2fs_inode_entry_slab);
+free_ino_entry:
+	kmem_cache_destroy(ino_entry_slab);
+	return -ENOMEM;
 }
 
 void f2fs_destroy_checkpoint_caches(void)
 {
+	destroy_workqueue(f2fs_cp_flush_wq);
 	kmem_cache_destroy(ino_entry_slab);
 	kmem_cache_destroy(f2fs_inode_entry_slab);
 }
@@ -0,0 +1,977 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fs/f2fs/compress.c
+ *
+ * Compression of the data of regular files, per cluster of pages.
+ *
+ * A cluster is a power-of-2 number of consecutive pages, aligned in the
+ * file. It is compressed as a whole on writeback, and stored as such if that
+ * saves at least one block: its first block address is then COMPRESS_ADDR,
+ * the next ones point to the compressed data, which starts with a struct
+ * compress_data header, and the remaining ones are NEW_ADDR. Clusters that
+ * don't compress keep their pages in their own blocks, as in other files.
+ */
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+#include <linux/writeback.h>
+#include <linux/vmalloc.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+#include <linux/zstd.h>
+
+#include "f2fs.h"
+#include "node.h"
+#include "segment.h"
+
+#define F2FS_ZSTD_DEFAULT_CLEVEL	1
+/* unused zstd workspaces kept per pool, the others are freed */
+#define F2FS_ZSTD_MAX_IDLE		2
+
+struct f2fs_compress_ops {
+	/* worst-case size of @rlen bytes of compressed data */
+	size_t (*max_clen)(size_t rlen);
+	/* on entry *@dlen is the capacity of @dst, and the data size on exit */
+	int (*compress)(const void *src, size_t slen, void *dst, size_t *dlen);
+	int (*decompress)(const void *src, size_t slen, void *dst,
+							size_t *dlen);
+};
+
+static size_t lzo_max_clen(size_t rlen)
+{
+	return lzo1x_worst_compress(rlen);
+}
+
+static int lzo_compress(const void *src, size_t slen, void *dst, size_t *dlen)
+{
+	void *wrkmem;
+	int ret;
+
+	wrkmem = kvmalloc(LZO1X_MEM_COMPRESS, GFP_NOFS);
+	if (!wrkmem)
+		return -ENOMEM;
+
+	ret = lzo1x_1_compress(src, slen, dst, dlen, wrkmem);
+	kvfree(wrkmem);
+	return ret == LZO_E_OK ? 0 : -EIO;
+}
+
+static int lzo_decompress(const void *src, size_t slen, void *dst,
+							size_t *dlen)
+{
+	return lzo1x_decompress_safe(src, slen, dst, dlen) == LZO_E_OK ?
+								0 : -EIO;
+}
+
+static size_t lz4_max_clen(size_t rlen)
+{
+	return LZ4_compressBound(rlen);
+}
+
+static int lz4_compress(const void *src, size_t slen, void *dst, size_t *dlen)
+{
+	void *wrkmem;
+	int len;
+
+	wrkmem = kvmalloc(LZ4_MEM_COMPRESS, GFP_NOFS);
+	if (!wrkmem)
+		return -ENOMEM;
+
+	len = LZ4_compress_default(src, dst, slen, *dlen, wrkmem);
+	kvfree(wrkmem);
+	if (!len)
+		return -EIO;
+	*dlen = len;
+	return 0;
+}
+
+static int lz4_decompress(const void *src, size_t slen, void *dst,
+							size_t *dlen)
+{
+	int len = LZ4_decompress_safe(src, dst, slen, *dlen);
+
+	if (len < 0)
+		return -EIO;
+	*dlen = len;
+	return 0;
+}
+
+/*
+ * Workspaces of the zstd contexts, kept from one cluster to the next.  The
+ * compression ones are sized per cluster size, so that files with small
+ * clusters don't take workspaces sized for the largest.  Workspaces are
+ * only allocated when first needed.
+ */
+static ZSTD_wsPool *zstd_cpool[MAX_COMPRESS_LOG_SIZE + 1];
+static ZSTD_wsPool *zstd_dpool;
+
+int __init f2fs_init_compress_pools(void)
+{
+	ZSTD_parameters params;
+	int log;
+
+	for (log = MIN_COMPRESS_LOG_SIZE; log <= MAX_COMPRESS_LOG_SIZE; log++) {
+		params = ZSTD_getParams(F2FS_ZSTD_DEFAULT_CLEVEL,
+						PAGE_SIZE << log, 0);
+		zstd_cpool[log] = ZSTD_createWsPool(
+				ZSTD_CCtxWorkspaceBound(params.cParams),
+				F2FS_ZSTD_MAX_IDLE);
+		if (!zstd_cpool[log])
+			goto fail;
+	}
+
+	zstd_dpool = ZSTD_createWsPool(ZSTD_DCtxWorkspaceBound(),
+						F2FS_ZSTD_MAX_IDLE);
+	if (!zstd_dpool)
+		goto fail;
+	return 0;
+fail:
+	f2fs_destroy_compress_pools();
+	return -ENOMEM;
+}
+
+void f2fs_destroy_compress_pools(void)
+{
+	int log;
+
+	ZSTD_freeWsPool(zstd_dpool);
+	zstd_dpool = NULL;
+	for (log = MIN_COMPRESS_LOG_SIZE; log <= MAX_COMPRESS_LOG_SIZE; log++) {
+		ZSTD_freeWsPool(zstd_cpool[log]);
+		zstd_cpool[log] = NULL;
+	}
+}
+
+static size_t zstd_max_clen(size_t rlen)
+{
+	return ZSTD_compressBound(rlen);
+}
+
+static int zstd_compress(const void *src, size_t slen, void *dst, size_t *dlen)
+{
+	int log = order_base_2(DIV_ROUND_UP(slen, PAGE_SIZE));
+	ZSTD_parameters params;
+	ZSTD_wsPool *pool;
+	ZSTD_CCtx *ctx;
+	void *workspace;
+	size_t wsize, len;
+
+	if (WARN_ON_ONCE(log > MAX_COMPRESS_LOG_SIZE))
+		return -EIO;
+	pool = zstd_cpool[max(log, MIN_COMPRESS_LOG_SIZE)];
+
+	params = ZSTD_getParams(F2FS_ZSTD_DEFAULT_CLEVEL, slen, 0);
+	wsize = ZSTD_wsPoolWorkspaceSize(pool);
+	if (WARN_ON_ONCE(ZSTD_CCtxWorkspaceBound(params.cParams) > wsize))
+		return -EIO;
+
+	workspace = ZSTD_getWorkspace(pool, GFP_NOFS);
+	if (!workspace)
+		return -ENOMEM;
+
+	ctx = ZSTD_initCCtx(workspace, wsize);
+	if (!ctx) {
+		ZSTD_putWorkspace(pool, workspace);
+		return -EIO;
+	}
+
+	len = ZSTD_compressCCtx(ctx, dst, *dlen, src, slen, params);
+	ZSTD_putWorkspace(pool, workspace);
+	if (ZSTD_isError(len))
+		return -EIO;
+	*dlen = len;
+	return 0;
+}
+
+static int zstd_decompress(const void *src, size_t slen, void *dst,
+							size_t *dlen)
+{
+	ZSTD_DCtx *ctx;
+	void *workspace;
+	size_t len;
+
+	workspace = ZSTD_getWorkspace(zstd_dpool, GFP_NOFS);
+	if (!workspace)
+		return -ENOMEM;
+
+	ctx = ZSTD_initDCtx(workspace, ZSTD_wsPoolWorkspaceSize(zstd_dpool));
+	if (!ctx) {
+		ZSTD_putWorkspace(zstd_dpool, workspace);
+		return -EIO;
+	}
+
+	len = ZSTD_decompressDCtx(ctx, dst, *dlen, src, slen);
+	ZSTD_putWorkspace(zstd_dpool, workspace);
+	if (ZSTD_isError(len))
+		return -EIO;
+	*dlen = len;
+	return 0;
+}
+
+static const struct f2fs_compress_ops f2fs_cops[COMPRESS_MAX] = {
+	[COMPRESS_LZO] = {
+		.max_clen	= lzo_max_clen,
+		.compress	= lzo_compress,
+		.decompress	= lzo_decompress,
+	},
+	[COMPRESS_LZ4] = {
+		.max_clen	= lz4_max_clen,
+		.compress	= lz4_compress,
+		.decompress	= lz4_decompress,
+	},
+	[COMPRESS_ZSTD] = {
+		.max_clen	= zstd_max_clen,
+		.compress	= zstd_compress,
+		.decompress	= zstd_decompress,
+	},
+};
+
+static inline const struct f2fs_compress_ops *compress_ops(struct inode *inode)
+{
+	return &f2fs_cops[F2FS_I(inode)->i_compress_algorithm];
+}
+
+static inline pgoff_t start_idx_of_cluster(struct inode *inode,
+							pgoff_t cluster_idx)
+{
+	return cluster_idx << F2FS_I(inode)->i_log_cluster_size;
+}
+
+/*
+ * Compressed pages are written along with the pages of their cluster, which
+ * are kept under writeback until the last of them completes.
+ */
+struct compress_io_ctx {
+	struct inode *inode;
+	struct page **rpages;		/* pages of the cluster */
+	unsigned int nr_rpages;
+	struct page **cpages;		/* pages of compressed data */
+	unsigned int nr_cpages;
+	atomic_t pending_pages;		/* # of cpages under writeback */
+};
+
+/*
+ * Compressed pages are unmapped pages pointing to their compress_io_ctx,
+ * and flagged with PG_private_2 to tell them from bounce pages.
+ */
+bool f2fs_is_compressed_page(struct page *page)
+{
+	return !page->mapping && PagePrivate2(page);
+}
+
+/* Is @cpage written for @inode, or along with @page? */
+bool f2fs_compressed_page_match(struct page *cpage, struct inode *inode,
+							struct page *page)
+{
+	struct compress_io_ctx *cic =
+			(struct compress_io_ctx *)page_private(cpage);
+	int i;
+
+	if (inode && inode == cic->inode)
+		return true;
+	if (!page)
+		return false;
+	for (i = 0; i < cic->nr_rpages; i++)
+		if (page == cic->rpages[i])
+			return true;
+	return false;
+}
+
+static void free_compress_io_ctx(struct compress_io_ctx *cic)
+{
+	int i;
+
+	for (i = 0; i < cic->nr_cpages; i++) {
+		if (!cic->cpages[i])
+			continue;
+		set_page_private(cic->cpages[i], 0);
+		ClearPagePrivate2(cic->cpages[i]);
+		__free_page(cic->cpages[i]);
+	}
+	kfree(cic->cpages);
+	kfree(cic->rpages);
+	kfree(cic);
+}
+
+void f2fs_compress_write_end_io(struct bio *bio, struct page *page)
+{
+	struct compress_io_ctx *cic =
+			(struct compress_io_ctx *)page_private(page);
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cic->inode);
+	int i;
+
+	if (unlikely(bio->bi_status))
+		mapping_set_error(cic->inode->i_mapping, -EIO);
+
+	dec_page_count(sbi, F2FS_WB_DATA);
+
+	if (atomic_dec_return(&cic->pending_pages))
+		return;
+
+	for (i = 0; i < cic->nr_rpages; i++) {
+		clear_cold_data(cic->rpages[i]);
+		end_page_writeback(cic->rpages[i]);
+	}
+	free_compress_io_ctx(cic);
+}
+
+void f2fs_init_cluster_cache(struct f2fs_cluster_cache *cc)
+{
+	cc->cluster_idx = ULONG_MAX;
+	cc->compressed = false;
+	cc->rlen = 0;
+	cc->rbuf = NULL;
+}
+
+void f2fs_destroy_cluster_cache(struct f2fs_cluster_cache *cc)
+{
+	kvfree(cc->rbuf);
+	cc->rbuf = NULL;
+	cc->cluster_idx = ULONG_MAX;
+}
+
+/* Read @nr blocks of compressed data and wait for them */
+static int read_compressed_blocks(struct inode *inode, block_t *blkaddr,
+				struct page **cpages, unsigned int nr)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int i = 0, j;
+	struct bio *bio;
+	int err;
+
+	while (i < nr) {
+		bio = f2fs_bio_alloc(sbi, nr - i, true);
+		f2fs_target_device(sbi, blkaddr[i], bio);
+		bio_set_op_attrs(bio, REQ_OP_READ, REQ_SYNC);
+
+		for (j = i; j < nr; j++) {
+			if (j > i && (blkaddr[j] != blkaddr[j - 1] + 1 ||
+				f2fs_target_device_index(sbi, blkaddr[j]) !=
+				f2fs_target_device_index(sbi, blkaddr[i])))
+				break;
+
+			/* wait for GCed blocks written via META_MAPPING */
+			f2fs_wait_on_block_writeback(inode, blkaddr[j]);
+
+			if (bio_add_page(bio, cpages[j], PAGE_SIZE, 0) <
+								PAGE_SIZE)
+				break;
+		}
+
+		err = submit_bio_wait(bio);
+		bio_put(bio);
+		if (err)
+			return err;
+		i = j;
+	}
+	return 0;
+}
+
+/* Look up cluster @cluster_idx and decompress it to @cc if compressed */
+static int load_cluster(struct inode *inode, struct f2fs_cluster_cache *cc,
+							pgoff_t cluster_idx)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	size_t rsize = (size_t)cluster_size << PAGE_SHIFT;
+	struct dnode_of_data dn;
+	struct page **cpages = NULL;
+	block_t *blkaddr = NULL;
+	struct compress_data *cd;
+	unsigned int nr_cpages = 0, i;
+	size_t clen;
+	int err;
+
+	cc->cluster_idx = ULONG_MAX;
+	cc->compressed = false;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = f2fs_get_dnode_of_data(&dn,
+			start_idx_of_cluster(inode, cluster_idx), LOOKUP_NODE);
+	if (err == -ENOENT)
+		goto out_raw;
+	if (err)
+		return err;
+
+	if (dn.data_blkaddr != COMPRESS_ADDR) {
+		f2fs_put_dnode(&dn);
+		goto out_raw;
+	}
+
+	blkaddr = kcalloc(cluster_size, sizeof(block_t), GFP_NOFS);
+	cpages = kcalloc(cluster_size, sizeof(struct page *), GFP_NOFS);
+	if (!blkaddr || !cpages) {
+		f2fs_put_dnode(&dn);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 1; i < cluster_size; i++) {
+		block_t addr = datablock_addr(dn.inode, dn.node_page,
+						dn.ofs_in_node + i);
+
+		if (!__is_valid_data_blkaddr(addr))
+			break;
+		if (!f2fs_is_valid_blkaddr(sbi, addr, DATA_GENERIC)) {
+			f2fs_put_dnode(&dn);
+			err = -EFAULT;
+			goto out;
+		}
+		blkaddr[nr_cpages++] = addr;
+	}
+	f2fs_put_dnode(&dn);
+
+	if (!nr_cpages) {
+		err = -EFAULT;
+		goto out;
+	}
+
+	for (i = 0; i < nr_cpages; i++) {
+		cpages[i] = alloc_page(GFP_NOFS);
+		if (!cpages[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	err = read_compressed_blocks(inode, blkaddr, cpages, nr_cpages);
+	if (err)
+		goto out;
+
+	if (!cc->rbuf) {
+		cc->rbuf = kvmalloc(rsize, GFP_NOFS);
+		if (!cc->rbuf) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	cd = vmap(cpages, nr_cpages, VM_MAP, PAGE_KERNEL);
+	if (!cd) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	clen = le32_to_cpu(cd->clen);
+	if (clen > ((size_t)nr_cpages << PAGE_SHIFT) - COMPRESS_HEADER_SIZE) {
+		err = -EFAULT;
+	} else {
+		cc->rlen = rsize;
+		err = compress_ops(inode)->decompress(cd->cdata, clen,
+							cc->rbuf, &cc->rlen);
+	}
+	vunmap(cd);
+	if (err) {
+		f2fs_msg(sbi->sb, KERN_ERR,
+			"%s: ino=%lx cluster=%lu is corrupted, err=%d",
+			__func__, inode->i_ino, cluster_idx, err);
+		goto out;
+	}
+
+	cc->compressed = true;
+	cc->cluster_idx = cluster_idx;
+out:
+	if (cpages)
+		for (i = 0; i < nr_cpages; i++)
+			if (cpages[i])
+				__free_page(cpages[i]);
+	kfree(cpages);
+	kfree(blkaddr);
+	return err;
+out_raw:
+	cc->cluster_idx = cluster_idx;
+	return 0;
+}
+
+/*
+ * Fill locked @page from its cluster if that one is compressed, decompressing
+ * it unless it is the one held in @cc. Returns 1 if the cluster isn't, in
+ * which case the page has to be read from its own block.
+ */
+int f2fs_read_cluster_page(struct inode *inode, struct f2fs_cluster_cache *cc,
+							struct page *page)
+{
+	pgoff_t cluster_idx = page->index >> F2FS_I(inode)->i_log_cluster_size;
+	loff_t i_size = i_size_read(inode);
+	size_t ofs;
+	void *kaddr;
+	int err;
+
+	if (cc->cluster_idx != cluster_idx) {
+		err = load_cluster(inode, cc, cluster_idx);
+		if (err)
+			return err;
+	}
+
+	if (!cc->compressed)
+		return 1;
+
+	ofs = (size_t)(page->index - start_idx_of_cluster(inode, cluster_idx))
+								<< PAGE_SHIFT;
+	kaddr = kmap_atomic(page);
+	if (ofs < cc->rlen) {
+		size_t len = min_t(size_t, PAGE_SIZE, cc->rlen - ofs);
+
+		memcpy(kaddr, cc->rbuf + ofs, len);
+		memset(kaddr + len, 0, PAGE_SIZE - len);
+	} else {
+		memset(kaddr, 0, PAGE_SIZE);
+	}
+
+	/* the cluster may still hold data truncated before a power cut */
+	if ((loff_t)(page->index + 1) << PAGE_SHIFT > i_size) {
+		loff_t pos = (loff_t)page->index << PAGE_SHIFT;
+
+		ofs = i_size > pos ? i_size - pos : 0;
+		memset(kaddr + ofs, 0, PAGE_SIZE - ofs);
+	}
+	kunmap_atomic(kaddr);
+	flush_dcache_page(page);
+
+	SetPageUptodate(page);
+	return 0;
+}
+
+int f2fs_read_compressed_page(struct inode *inode, struct page *page)
+{
+	struct f2fs_cluster_cache cc;
+	int err;
+
+	f2fs_init_cluster_cache(&cc);
+	err = f2fs_read_cluster_page(inode, &cc, page);
+	f2fs_destroy_cluster_cache(&cc);
+	return err;
+}
+
+/*
+ * Get the locked and uptodate page @index of a cluster being written. The
+ * pages before the one under writeback are only trylocked, as their writers
+ * lock the following pages of their cluster.
+ */
+static struct page *get_cluster_page(struct inode *inode, pgoff_t index,
+								bool nowait)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct page *page;
+
+	if (nowait) {
+		page = find_get_page(mapping, index);
+		if (page && !trylock_page(page)) {
+			put_page(page);
+			return ERR_PTR(-EAGAIN);
+		}
+		if (page && page->mapping == mapping && PageUptodate(page))
+			return page;
+		f2fs_put_page(page, 1);
+	}
+
+	page = f2fs_get_lock_data_page(inode, index, true);
+	if (!IS_ERR(page) || PTR_ERR(page) != -ENOENT)
+		return page;
+
+	/* a hole in the cluster */
+	page = f2fs_grab_cache_page(mapping, index, true);
+	if (!page)
+		return ERR_PTR(-ENOMEM);
+	if (!PageUptodate(page)) {
+		zero_user_segment(page, 0, PAGE_SIZE);
+		SetPageUptodate(page);
+	}
+	return page;
+}
+
+/* Compress the pages of @cic, returns the number of compressed pages */
+static int compress_cluster(struct compress_io_ctx *cic)
+{
+	struct inode *inode = cic->inode;
+	const struct f2fs_compress_ops *cops = compress_ops(inode);
+	size_t rlen = (size_t)cic->nr_rpages << PAGE_SHIFT;
+	size_t max_len = rlen - PAGE_SIZE;
+	struct compress_data *cd;
+	void *rbuf, *kaddr;
+	size_t clen;
+	int nr_cpages, i, err;
+
+	cd = kvmalloc(COMPRESS_HEADER_SIZE + cops->max_clen(rlen), GFP_NOFS);
+	if (!cd)
+		return -ENOMEM;
+
+	rbuf = vmap(cic->rpages, cic->nr_rpages, VM_MAP, PAGE_KERNEL);
+	if (!rbuf) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	clen = cops->max_clen(rlen);
+	err = cops->compress(rbuf, rlen, cd->cdata, &clen);
+	vunmap(rbuf);
+	if (err)
+		goto out;
+
+	/* the data has to save one block at least */
+	if (clen + COMPRESS_HEADER_SIZE > max_len) {
+		err = -EAGAIN;
+		goto out;
+	}
+
+	cd->clen = cpu_to_le32(clen);
+	memset(cd->reserved, 0, sizeof(cd->reserved));
+
+	nr_cpages = DIV_ROUND_UP(clen + COMPRESS_HEADER_SIZE, PAGE_SIZE);
+	for (i = 0; i < nr_cpages; i++) {
+		size_t ofs = (size_t)i << PAGE_SHIFT;
+		size_t len = min_t(size_t, PAGE_SIZE,
+				clen + COMPRESS_HEADER_SIZE - ofs);
+
+		cic->cpages[i] = alloc_page(GFP_NOFS);
+		if (!cic->cpages[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+		cic->nr_cpages++;
+
+		kaddr = kmap_atomic(cic->cpages[i]);
+		memcpy(kaddr, (char *)cd + ofs, len);
+		memset(kaddr + len, 0, PAGE_SIZE - len);
+		kunmap_atomic(kaddr);
+	}
+	err = nr_cpages;
+out:
+	kvfree(cd);
+	return err;
+}
+
+/*
+ * Write the compressed pages of @cic to the blocks following COMPRESS_ADDR
+ * and drop the blocks left over, all within the direct node locked in @dn.
+ */
+static void write_compressed_blocks(struct compress_io_ctx *cic,
+			struct f2fs_io_info *fio, struct dnode_of_data *dn,
+			unsigned int version)
+{
+	struct inode *inode = cic->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	unsigned int ofs = dn->ofs_in_node;
+	int i, nr_free = 0;
+
+	atomic_set(&cic->pending_pages, cic->nr_cpages);
+
+	for (i = 0; i < cluster_size; i++) {
+		block_t blkaddr;
+
+		dn->ofs_in_node = ofs + i;
+		blkaddr = datablock_addr(dn->inode, dn->node_page,
+							dn->ofs_in_node);
+
+		if (i == 0) {
+			if (__is_valid_data_blkaddr(blkaddr))
+				f2fs_invalidate_blocks(sbi, blkaddr);
+			f2fs_update_data_blkaddr(dn, COMPRESS_ADDR);
+		} else if (i <= cic->nr_cpages) {
+			struct f2fs_io_info cfio = *fio;
+			struct page *cpage = cic->cpages[i - 1];
+
+			set_page_private(cpage, (unsigned long)cic);
+			SetPagePrivate2(cpage);
+
+			dn->data_blkaddr = blkaddr;
+			cfio.page = cic->rpages[i - 1];
+			cfio.encrypted_page = cpage;
+			cfio.old_blkaddr = blkaddr;
+			cfio.version = version;
+			f2fs_outplace_write_data(dn, &cfio);
+			fio->submitted |= cfio.submitted;
+		} else if (blkaddr != NULL_ADDR) {
+			if (__is_valid_data_blkaddr(blkaddr))
+				f2fs_invalidate_blocks(sbi, blkaddr);
+			if (i < cic->nr_rpages) {
+				if (blkaddr != NEW_ADDR)
+					f2fs_update_data_blkaddr(dn, NEW_ADDR);
+			} else {
+				f2fs_update_data_blkaddr(dn, NULL_ADDR);
+				nr_free++;
+			}
+		}
+	}
+	dn->ofs_in_node = ofs;
+
+	if (nr_free)
+		dec_valid_block_count(sbi, inode, nr_free);
+}
+
+/*
+ * Turn a compressed cluster back into one block per page: the pages below
+ * EOF get a block to be written to, the other blocks are dropped.
+ */
+static int decompress_cluster_blocks(struct compress_io_ctx *cic,
+						struct dnode_of_data *dn)
+{
+	struct inode *inode = cic->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	unsigned int ofs = dn->ofs_in_node;
+	int i, nr_free = 0, err = 0;
+
+	for (i = 0; i < cluster_size; i++) {
+		block_t blkaddr;
+
+		dn->ofs_in_node = ofs + i;
+		blkaddr = datablock_addr(dn->inode, dn->node_page,
+							dn->ofs_in_node);
+
+		if (i < cic->nr_rpages) {
+			if (blkaddr == COMPRESS_ADDR) {
+				f2fs_update_data_blkaddr(dn, NEW_ADDR);
+			} else if (blkaddr == NULL_ADDR) {
+				dn->data_blkaddr = NULL_ADDR;
+				err = f2fs_reserve_new_block(dn);
+				if (err)
+					break;
+			}
+		} else if (blkaddr != NULL_ADDR) {
+			if (__is_valid_data_blkaddr(blkaddr))
+				f2fs_invalidate_blocks(sbi, blkaddr);
+			f2fs_update_data_blkaddr(dn, NULL_ADDR);
+			nr_free++;
+		}
+	}
+	dn->ofs_in_node = ofs;
+
+	if (nr_free)
+		dec_valid_block_count(sbi, inode, nr_free);
+	return err;
+}
+
+/* Reserve the blocks a compressed cluster of @nr_cpages pages needs */
+static int reserve_compressed_blocks(struct dnode_of_data *dn,
+						unsigned int nr_cpages)
+{
+	unsigned int ofs = dn->ofs_in_node;
+	int i, err = 0;
+
+	for (i = 0; i <= nr_cpages; i++) {
+		dn->ofs_in_node = ofs + i;
+		dn->data_blkaddr = datablock_addr(dn->inode, dn->node_page,
+							dn->ofs_in_node);
+		if (dn->data_blkaddr != NULL_ADDR)
+			continue;
+		err = f2fs_reserve_new_block(dn);
+		if (err)
+			break;
+	}
+	dn->ofs_in_node = ofs;
+	return err;
+}
+
+/*
+ * Write back the cluster of @fio->page, which the caller has locked and
+ * cleaned, along with the other pages of the cluster below EOF: compressed
+ * if that saves space, else its dirty pages in their own blocks, or all its
+ * pages if the cluster was compressed.
+ */
+int f2fs_write_cluster(struct f2fs_io_info *fio, loff_t *psize)
+{
+	struct page *page = fio->page;
+	struct inode *inode = page->mapping->host;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	pgoff_t start = round_down(page->index, cluster_size);
+	loff_t i_size = i_size_read(inode);
+	pgoff_t end_index = DIV_ROUND_UP(i_size, PAGE_SIZE);
+	unsigned int offset = i_size & (PAGE_SIZE - 1);
+	struct compress_io_ctx *cic;
+	struct dnode_of_data dn;
+	struct node_info ni;
+	unsigned long *dirty;
+	unsigned int prev_cpages = 0;
+	bool compressed = false;
+	int nr_cpages, i, err;
+
+	cic = kzalloc(sizeof(struct compress_io_ctx), GFP_NOFS);
+	if (!cic)
+		return -ENOMEM;
+	cic->inode = inode;
+	cic->nr_rpages = min_t(pgoff_t, cluster_size, end_index - start);
+	cic->rpages = kcalloc(cic->nr_rpages, sizeof(struct page *), GFP_NOFS);
+	cic->cpages = kcalloc(cic->nr_rpages, sizeof(struct page *), GFP_NOFS);
+	dirty = kcalloc(BITS_TO_LONGS(cluster_size), sizeof(unsigned long),
+								GFP_NOFS);
+	if (!cic->rpages || !cic->cpages || !dirty) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	for (i = 0; i < cic->nr_rpages; i++) {
+		struct page *rpage;
+
+		if (start + i == page->index) {
+			cic->rpages[i] = page;
+			__set_bit(i, dirty);
+			continue;
+		}
+
+		rpage = get_cluster_page(inode, start + i,
+						start + i < page->index);
+		if (IS_ERR(rpage)) {
+			err = PTR_ERR(rpage);
+			goto out_put_pages;
+		}
+		cic->rpages[i] = rpage;
+
+		f2fs_wait_on_page_writeback(rpage, DATA, true, true);
+		if (PageDirty(rpage))
+			__set_bit(i, dirty);
+		if (start + i + 1 == end_index && offset)
+			zero_user_segment(rpage, offset, PAGE_SIZE);
+	}
+
+	/* a cluster failing to compress, e.g. for memory, is written raw */
+	nr_cpages = -EAGAIN;
+	if (cic->nr_rpages > 1)
+		nr_cpages = compress_cluster(cic);
+
+	f2fs_lock_op(sbi);
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = f2fs_get_dnode_of_data(&dn, start, ALLOC_NODE);
+	if (err)
+		goto out_unlock_op;
+
+	err = f2fs_get_node_info(sbi, dn.nid, &ni);
+	if (err)
+		goto out_put_dnode;
+
+	if (dn.data_blkaddr == COMPRESS_ADDR) {
+		compressed = true;
+		for (i = 1; i < cluster_size; i++) {
+			block_t blkaddr = datablock_addr(dn.inode,
+					dn.node_page, dn.ofs_in_node + i);
+
+			if (!__is_valid_data_blkaddr(blkaddr))
+				break;
+			prev_cpages++;
+		}
+	}
+
+	if (nr_cpages > 0) {
+		err = reserve_compressed_blocks(&dn, nr_cpages);
+		if (err)
+			goto out_put_dnode;
+	} else if (compressed) {
+		err = decompress_cluster_blocks(cic, &dn);
+		if (err)
+			goto out_put_dnode;
+	}
+
+	/* from now on the cluster is written, whether compressed or not */
+	for (i = 0; i < cic->nr_rpages; i++) {
+		struct page *rpage = cic->rpages[i];
+
+		if (rpage != page && clear_page_dirty_for_io(rpage))
+			inode_dec_dirty_pages(inode);
+		if (nr_cpages > 0) {
+			set_page_writeback(rpage);
+			ClearPageError(rpage);
+		}
+	}
+
+	if (nr_cpages > 0) {
+		write_compressed_blocks(cic, fio, &dn, ni.version);
+		f2fs_put_dnode(&dn);
+		f2fs_unlock_op(sbi);
+
+		f2fs_i_compr_blocks_update(inode, prev_cpages, false);
+		f2fs_i_compr_blocks_update(inode, nr_cpages, true);
+		stat_inc_compr_write(sbi, cic->nr_rpages, nr_cpages);
+		set_inode_flag(inode, FI_APPEND_WRITE);
+
+		/* writeback keeps the pages around until the ctx is freed */
+		for (i = 0; i < cic->nr_rpages; i++)
+			if (cic->rpages[i] != page)
+				f2fs_put_page(cic->rpages[i], 1);
+		*psize = (loff_t)(start + cic->nr_rpages) << PAGE_SHIFT;
+		kfree(dirty);
+		/* the ctx is freed once its pages are written */
+		return 0;
+	}
+
+	f2fs_put_dnode(&dn);
+	f2fs_i_compr_blocks_update(inode, prev_cpages, false);
+
+	for (i = 0; i < cic->nr_rpages; i++) {
+		struct f2fs_io_info rfio = *fio;
+		int ret;
+
+		if (!compressed && !test_bit(i, dirty))
+			continue;
+
+		rfio.page = cic->rpages[i];
+		rfio.old_blkaddr = NULL_ADDR;
+		rfio.need_lock = LOCK_DONE;
+		ret = f2fs_do_write_data_page(&rfio);
+		fio->submitted |= rfio.submitted;
+		if (ret && rfio.page == page)
+			err = ret;
+		else if (ret)
+			set_page_dirty(rfio.page);
+	}
+	f2fs_unlock_op(sbi);
+
+	if (!err)
+		*psize = (loff_t)(start + cic->nr_rpages) << PAGE_SHIFT;
+	goto out_put_pages;
+
+out_put_dnode:
+	f2fs_put_dnode(&dn);
+out_unlock_op:
+	f2fs_unlock_op(sbi);
+out_put_pages:
+	for (i = 0; i < cic->nr_rpages; i++)
+		if (cic->rpages[i] && cic->rpages[i] != page)
+			f2fs_put_page(cic->rpages[i], 1);
+out_free:
+	for (i = 0; i < cic->nr_cpages; i++)
+		__free_page(cic->cpages[i]);
+	kfree(dirty);
+	kfree(cic->cpages);
+	kfree(cic->rpages);
+	kfree(cic);
+	return err;
+}
+
+/*
+ * The pages of a compressed cluster cut by a truncation to @index have to be
+ * compressed again without the ones dropped, so they are dirtied here and the
+ * blocks of the cluster are kept until then. Returns 1 in that case.
+ */
+int f2fs_truncate_partial_cluster(struct inode *inode, pgoff_t index)
+{
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	pgoff_t start = round_down(index, cluster_size);
+	struct dnode_of_data dn;
+	pgoff_t i;
+	int err;
+
+	if (index == start)
+		return 0;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = f2fs_get_dnode_of_data(&dn, start, LOOKUP_NODE);
+	if (err)
+		return err == -ENOENT ? 0 : err;
+	f2fs_put_dnode(&dn);
+
+	if (dn.data_blkaddr != COMPRESS_ADDR)
+		return 0;
+
+	for (i = start; i < index; i++) {
+		struct page *page = f2fs_get_lock_data_page(inode, i, true);
+
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+		f2fs_wait_on_page_writeback(page, DATA, true, true);
+		set_page_dirty(page);
+		f2fs_put_page(page, 1);
+	}
+	return 1;
+}
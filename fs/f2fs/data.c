@@ -195,6 +195,11 @@ static void f2fs_write_end_io(struct bio *bio)
 			continue;
 		}
 
+		if (f2fs_is_compressed_page(page)) {
+			f2fs_compress_write_end_io(bio, page);
+			continue;
+		}
+
 		fscrypt_pullback_bio_page(&page, true);
 
 		if (unlikely(bio->bi_status)) {
@@ -392,6 +397,13 @@ static bool __has_merged_page(struct f2fs_bio_info *io, struct inode *inode,
 
 	bio_for_each_segment_all(bvec, io->bio, i) {
 
+		if (f2fs_is_compressed_page(bvec->bv_page)) {
+			if (f2fs_compressed_page_match(bvec->bv_page,
+							inode, page))
+				return true;
+			continue;
+		}
+
 		if (bvec->bv_page->mapping)
 			target = bvec->bv_page;
 		else
@@ -762,6 +774,20 @@ struct page *f2fs_get_read_data_page(struct inode *inode, pgoff_t index,
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 
+	if (f2fs_compressed_file(inode)) {
+		if (PageUptodate(page)) {
+			unlock_page(page);
+			return page;
+		}
+		err = f2fs_read_compressed_page(inode, page);
+		if (err < 0)
+			goto put_err;
+		if (!err) {
+			unlock_page(page);
+			return page;
+		}
+	}
+
 	if (f2fs_lookup_extent_cache(inode, index, &ei)) {
 		dn.data_blkaddr = ei.blk + index - ei.fofs;
 		goto got_it;
@@ -1036,6 +1062,37 @@ void __do_map_lock(struct f2fs_sb_info *sbi, int flag, bool lock)
 	}
 }
 
+/*
+ * Besides precaching, the extents found by plain reads are cached as well,
+ * so that rereading hot files, e.g. the dex, oat and so files of an app
+ * started again, doesn't need to read their node pages again.
+ */
+static void __cache_mapped_extent(struct dnode_of_data *dn,
+				struct f2fs_map_blocks *map,
+				unsigned int start_pgofs, int create, int flag)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dn->inode);
+	unsigned int ofs;
+
+	if (!(map->m_flags & F2FS_MAP_MAPPED))
+		return;
+
+	if (flag != F2FS_GET_BLOCK_PRECACHE) {
+		if (create || flag != F2FS_GET_BLOCK_DEFAULT)
+			return;
+		if (!sbi->read_extent_min_len ||
+				map->m_len < sbi->read_extent_min_len)
+			return;
+		/* caching a larger extent updates the inode */
+		if (f2fs_readonly(sbi->sb))
+			return;
+	}
+
+	ofs = start_pgofs - map->m_lblk;
+	f2fs_update_extent_cache_range(dn, start_pgofs, map->m_pblk + ofs,
+							map->m_len - ofs);
+}
+
 /*
  * f2fs_map_blocks() now supported readahead/bmap/rw direct_IO with
  * f2fs_map_blocks structure.
@@ -1226,15 +1283,7 @@ int f2fs_map_blocks(struct inode *inode, struct f2fs_map_blocks *map,
 	else if (dn.ofs_in_node < end_offset)
 		goto next_block;
 
-	if (flag == F2FS_GET_BLOCK_PRECACHE) {
-		if (map->m_flags & F2FS_MAP_MAPPED) {
-			unsigned int ofs = start_pgofs - map->m_lblk;
-
-			f2fs_update_extent_cache_range(&dn,
-				start_pgofs, map->m_pblk + ofs,
-				map->m_len - ofs);
-		}
-	}
+	__cache_mapped_extent(&dn, map, start_pgofs, create, flag);
 
 	f2fs_put_dnode(&dn);
 
@@ -1251,17 +1300,9 @@ int f2fs_map_blocks(struct inode *inode, struct f2fs_map_blocks *map,
 		f2fs_wait_on_block_writeback_range(inode,
 						map->m_pblk, map->m_len);
 
-	if (flag == F2FS_GET_BLOCK_PRECACHE) {
-		if (map->m_flags & F2FS_MAP_MAPPED) {
-			unsigned int ofs = start_pgofs - map->m_lblk;
-
-			f2fs_update_extent_cache_range(&dn,
-				start_pgofs, map->m_pblk + ofs,
-				map->m_len - ofs);
-		}
-		if (map->m_next_extent)
-			*map->m_next_extent = pgofs + 1;
-	}
+	__cache_mapped_extent(&dn, map, start_pgofs, create, flag);
+	if (flag == F2FS_GET_BLOCK_PRECACHE && map->m_next_extent)
+		*map->m_next_extent = pgofs + 1;
 	f2fs_put_dnode(&dn);
 unlock_out:
 	if (map->m_may_create) {
@@ -1468,6 +1509,12 @@ int f2fs_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 		goto out;
 	}
 
+	/* the blocks of compressed clusters don't map to the pages */
+	if (f2fs_compressed_file(inode)) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
 	if (f2fs_has_inline_data(inode)) {
 		ret = f2fs_inline_data_fiemap(inode, fieinfo, start, len);
 		if (ret != -EAGAIN)
@@ -1557,6 +1604,8 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 	sector_t last_block_in_file;
 	sector_t block_nr;
 	struct f2fs_map_blocks map;
+	struct f2fs_cluster_cache cc;
+	int ret;
 
 	map.m_pblk = 0;
 	map.m_lblk = 0;
@@ -1567,6 +1616,8 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 	map.m_seg_type = NO_CHECK_TYPE;
 	map.m_may_create = false;
 
+	f2fs_init_cluster_cache(&cc);
+
 	for (; nr_pages; nr_pages--) {
 		if (pages) {
 			page = list_last_entry(pages, struct page, lru);
@@ -1586,6 +1637,17 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 		if (last_block > last_block_in_file)
 			last_block = last_block_in_file;
 
+		/* pages of compressed clusters are filled from their cluster */
+		if (f2fs_compressed_file(inode)) {
+			ret = f2fs_read_cluster_page(inode, &cc, page);
+			if (ret < 0)
+				goto set_error_page;
+			if (!ret) {
+				unlock_page(page);
+				goto next_page;
+			}
+		}
+
 		/*
 		 * Map blocks using the previous result first.
 		 */
@@ -1677,6 +1739,7 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 			put_page(page);
 	}
 	BUG_ON(pages && !list_empty(pages));
+	f2fs_destroy_cluster_cache(&cc);
 	if (bio)
 		__f2fs_submit_read_bio(F2FS_I_SB(inode), bio, DATA);
 	return 0;
@@ -1811,6 +1874,8 @@ bool f2fs_should_update_outplace(struct inode *inode, struct f2fs_io_info *fio)
 		return true;
 	if (f2fs_is_atomic_file(inode))
 		return true;
+	if (f2fs_compressed_file(inode))
+		return true;
 	if (fio) {
 		if (is_cold_data(fio->page))
 			return true;
@@ -2025,7 +2090,9 @@ static int __write_data_page(struct page *page, bool *submitted,
 			goto out;
 	}
 
-	if (err == -EAGAIN) {
+	if (err == -EAGAIN && f2fs_compressed_file(inode)) {
+		err = f2fs_write_cluster(&fio, &psize);
+	} else if (err == -EAGAIN) {
 		err = f2fs_do_write_data_page(&fio);
 		if (err == -EAGAIN) {
 			fio.need_lock = LOCK_REQ;
@@ -2527,6 +2594,15 @@ static int f2fs_write_begin(struct file *file, struct address_space *mapping,
 		return 0;
 	}
 
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_read_compressed_page(inode, page);
+		if (err < 0)
+			goto fail;
+		if (!err)
+			return 0;
+		err = 0;
+	}
+
 	if (blkaddr == NEW_ADDR) {
 		zero_user_segment(page, 0, PAGE_SIZE);
 		SetPageUptodate(page);
@@ -2845,6 +2921,10 @@ static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 	if (f2fs_has_inline_data(inode))
 		return 0;
 
+	/* the blocks of compressed clusters don't hold the pages */
+	if (f2fs_compressed_file(inode))
+		return 0;
+
 	/* make sure allocating whole blocks */
 	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY))
 		filemap_write_and_wait(mapping);
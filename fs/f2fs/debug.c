@@ -87,6 +87,10 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->inline_xattr = atomic_read(&sbi->inline_xattr);
 	si->inline_inode = atomic_read(&sbi->inline_inode);
 	si->inline_dir = atomic_read(&sbi->inline_dir);
+	si->compr_inode = atomic_read(&sbi->compr_inode);
+	si->compr_blocks = atomic64_read(&sbi->compr_blocks);
+	si->compr_written_pages = atomic64_read(&sbi->compr_written_pages);
+	si->compr_written_blocks = atomic64_read(&sbi->compr_written_blocks);
 	si->append = sbi->im[APPEND_INO].ino_num;
 	si->update = sbi->im[UPDATE_INO].ino_num;
 	si->orphans = sbi->im[ORPHAN_INO].ino_num;
@@ -308,6 +312,11 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->inline_inode);
 		seq_printf(s, "  - Inline_dentry Inode: %u\n",
 			   si->inline_dir);
+		seq_printf(s, "  - Compressed Inode: %u, Blocks: %llu\n",
+			   si->compr_inode, si->compr_blocks);
+		seq_printf(s, "  - Compressed Write: %llu pages, "
+			   "%llu blocks\n", si->compr_written_pages,
+			   si->compr_written_blocks);
 		seq_printf(s, "  - Orphan/Append/Update Inode: %u, %u, %u\n",
 			   si->orphans, si->append, si->update);
 		seq_printf(s, "\nMain area: %d segs, %d secs %d zones\n",
@@ -345,6 +354,15 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->prefree_count, si->free_segs, si->free_secs);
 		seq_printf(s, "CP calls: %d (BG: %d)\n",
 				si->cp_count, si->bg_cp_count);
+		seq_printf(s, "  - flush dents : %u ms (total %llu ms)\n",
+				si->cp_flush_time[CP_FLUSH_DENTS],
+				si->cp_flush_total[CP_FLUSH_DENTS]);
+		seq_printf(s, "  - flush imeta : %u ms (total %llu ms)\n",
+				si->cp_flush_time[CP_FLUSH_IMETA],
+				si->cp_flush_total[CP_FLUSH_IMETA]);
+		seq_printf(s, "  - flush nodes : %u ms (total %llu ms)\n",
+				si->cp_flush_time[CP_FLUSH_NODES],
+				si->cp_flush_total[CP_FLUSH_NODES]);
 		seq_printf(s, "  - cp blocks : %u\n", si->meta_count[META_CP]);
 		seq_printf(s, "  - sit blocks : %u\n",
 				si->meta_count[META_SIT]);
@@ -484,6 +502,10 @@ int f2fs_build_stats(struct f2fs_sb_info *sbi)
 	atomic_set(&sbi->inline_xattr, 0);
 	atomic_set(&sbi->inline_inode, 0);
 	atomic_set(&sbi->inline_dir, 0);
+	atomic_set(&sbi->compr_inode, 0);
+	atomic64_set(&sbi->compr_blocks, 0);
+	atomic64_set(&sbi->compr_written_pages, 0);
+	atomic64_set(&sbi->compr_written_blocks, 0);
 	atomic_set(&sbi->inplace_count, 0);
 	for (i = META_CP; i < META_MAX; i++)
 		atomic_set(&sbi->meta_count[i], 0);
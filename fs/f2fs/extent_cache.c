@@ -407,6 +407,8 @@ static bool f2fs_lookup_extent_tree(struct inode *inode, pgoff_t pgofs,
 		stat_inc_rbtree_node_hit(sbi);
 
 	*ei = en->ei;
+	if (!et->referenced)
+		WRITE_ONCE(et->referenced, true);
 	spin_lock(&sbi->extent_lock);
 	if (!list_empty(&en->list)) {
 		list_move_tail(&en->list, &sbi->extent_list);
@@ -645,8 +647,14 @@ unsigned int f2fs_shrink_extent_tree(struct f2fs_sb_info *sbi, int nr_shrink)
 	if (!mutex_trylock(&sbi->extent_tree_lock))
 		goto out;
 
-	/* 1. remove unreferenced extent tree */
+	/*
+	 * 1. remove unreferenced extent tree, except the ones which served
+	 * lookups: the inodes of hot files come back, so leave their extents
+	 * to the LRU below instead of reading node pages again.
+	 */
 	list_for_each_entry_safe(et, next, &sbi->zombie_list, list) {
+		if (et->referenced && atomic_read(&et->node_cnt))
+			continue;
 		if (atomic_read(&et->node_cnt)) {
 			write_lock(&et->lock);
 			node_cnt += __free_extent_tree(sbi, et);
@@ -697,6 +705,21 @@ unsigned int f2fs_shrink_extent_tree(struct f2fs_sb_info *sbi, int nr_shrink)
 	}
 	spin_unlock(&sbi->extent_lock);
 
+	/* 3. remove unreferenced extent tree emptied by the LRU */
+	list_for_each_entry_safe(et, next, &sbi->zombie_list, list) {
+		if (node_cnt + tree_cnt >= nr_shrink)
+			break;
+		if (atomic_read(&et->node_cnt))
+			continue;
+		list_del_init(&et->list);
+		radix_tree_delete(&sbi->extent_tree_root, et->ino);
+		kmem_cache_free(extent_tree_slab, et);
+		atomic_dec(&sbi->total_ext_tree);
+		atomic_dec(&sbi->total_zombie_tree);
+		tree_cnt++;
+		cond_resched();
+	}
+
 unlock_out:
 	mutex_unlock(&sbi->extent_tree_lock);
 out:
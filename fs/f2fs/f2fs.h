@@ -116,6 +116,17 @@ typedef u32 block_t;	/*
 			 */
 typedef u32 nid_t;
 
+/* compress algorithms of the compress_algorithm option and of inodes */
+enum compress_algorithm_type {
+	COMPRESS_LZO,
+	COMPRESS_LZ4,
+	COMPRESS_ZSTD,
+	COMPRESS_MAX,
+};
+
+#define MIN_COMPRESS_LOG_SIZE	2
+#define MAX_COMPRESS_LOG_SIZE	8
+
 struct f2fs_mount_info {
 	unsigned int opt;
 	int write_io_size_bits;		/* Write IO size bits */
@@ -137,6 +148,10 @@ struct f2fs_mount_info {
 	int alloc_mode;			/* segment allocation policy */
 	int fsync_mode;			/* fsync policy */
 	bool test_dummy_encryption;	/* test dummy encryption */
+
+	/* For compression */
+	unsigned char compress_algorithm;	/* algorithm type */
+	unsigned char compress_log_size;	/* cluster log size */
 };
 
 #define F2FS_FEATURE_ENCRYPT		0x0001
@@ -151,6 +166,7 @@ struct f2fs_mount_info {
 #define F2FS_FEATURE_LOST_FOUND		0x0200
 #define F2FS_FEATURE_VERITY		0x0400	/* reserved */
 #define F2FS_FEATURE_SB_CHKSUM		0x0800
+#define F2FS_FEATURE_COMPRESSION	0x2000
 
 #define __F2FS_HAS_FEATURE(raw_super, mask)				\
 	((raw_super->feature & cpu_to_le32(mask)) != 0)
@@ -191,6 +207,16 @@ enum {
 #define DEF_CP_INTERVAL			60	/* 60 secs */
 #define DEF_IDLE_INTERVAL		5	/* 5 secs */
 #define DEF_DISABLE_INTERVAL		5	/* 5 secs */
+#define DEF_CP_FLUSH_THREADS		4	/* flushers of dirty inodes */
+#define MAX_CP_FLUSH_THREADS		8
+
+/* steps of checkpoint flushing, timed in f2fs_stat */
+enum {
+	CP_FLUSH_DENTS,		/* dirty dentry pages */
+	CP_FLUSH_IMETA,		/* dirty inode metadata */
+	CP_FLUSH_NODES,		/* dirty node pages */
+	NR_CP_FLUSH,
+};
 
 struct cp_control {
 	int reason;
@@ -546,6 +572,9 @@ enum {
 /* number of extent info in extent cache we try to shrink */
 #define EXTENT_CACHE_SHRINK_NUMBER	128
 
+/* minimum length of the extents found by reads to cache */
+#define DEF_READ_EXTENT_MIN_LEN	1
+
 struct rb_entry {
 	struct rb_node rb_node;		/* rb node located in rb-tree */
 	unsigned int ofs;		/* start offset of the entry */
@@ -574,6 +603,7 @@ struct extent_tree {
 	rwlock_t lock;			/* protect extent info rb-tree */
 	atomic_t node_cnt;		/* # of extent node in rb-tree*/
 	bool largest_updated;		/* largest extent updated */
+	bool referenced;		/* rb-tree served a lookup */
 };
 
 /*
@@ -693,6 +723,12 @@ struct f2fs_inode_info {
 	int i_inline_xattr_size;	/* inline xattr size */
 	struct timespec64 i_crtime;	/* inode creation time */
 	struct timespec64 i_disk_time[4];/* inode disk times */
+
+	/* for file compress */
+	u64 i_compr_blocks;			/* # of compressed blocks */
+	unsigned char i_compress_algorithm;	/* algorithm type */
+	unsigned char i_log_cluster_size;	/* log of cluster size */
+	unsigned int i_cluster_size;		/* cluster size */
 };
 
 static inline void get_extent_info(struct extent_info *ext,
@@ -1181,6 +1217,7 @@ struct f2fs_sb_info {
 	struct rw_semaphore node_write;		/* locking node writes */
 	struct rw_semaphore node_change;	/* locking node change */
 	wait_queue_head_t cp_wait;
+	unsigned int cp_flush_threads;		/* # of inode flushers in cp */
 	unsigned long last_time[MAX_TIME];	/* to store time in jiffies */
 	long interval_time[MAX_TIME];		/* to store thresholds */
 
@@ -1207,6 +1244,7 @@ struct f2fs_sb_info {
 	struct list_head zombie_list;		/* extent zombie tree list */
 	atomic_t total_zombie_tree;		/* extent zombie tree count */
 	atomic_t total_ext_node;		/* extent info count */
+	unsigned int read_extent_min_len;	/* cache read extents >= this */
 
 	/* basic filesystem units */
 	unsigned int log_sectors_per_block;	/* log2 sectors per block */
@@ -1296,6 +1334,10 @@ struct f2fs_sb_info {
 	unsigned int io_skip_bggc;		/* skip background gc for in-flight IO */
 	unsigned int other_skip_bggc;		/* skip background gc for other reasons */
 	unsigned int ndirty_inode[NR_INODE_TYPE];	/* # of dirty inodes */
+	atomic_t compr_inode;			/* # of compressed inodes */
+	atomic64_t compr_blocks;		/* # of compressed blocks */
+	atomic64_t compr_written_pages;		/* # of pages compressed */
+	atomic64_t compr_written_blocks;	/* # of blocks they took */
 #endif
 	spinlock_t stat_lock;			/* lock for stat operations */
 
@@ -2371,6 +2413,7 @@ enum {
 	FI_PROJ_INHERIT,	/* indicate file inherits projectid */
 	FI_PIN_FILE,		/* indicate file should not be gced */
 	FI_ATOMIC_REVOKE_REQUEST, /* request to drop atomic data */
+	FI_CP_FLUSHING,		/* inode is flushed by a checkpoint thread */
 };
 
 static inline void __mark_inode_dirty_flag(struct inode *inode,
@@ -2536,9 +2579,31 @@ static inline int f2fs_has_inline_xattr(struct inode *inode)
 	return is_inode_flag_set(inode, FI_INLINE_XATTR);
 }
 
+static inline bool f2fs_compressed_file(struct inode *inode)
+{
+	return S_ISREG(inode->i_mode) &&
+		(F2FS_I(inode)->i_flags & F2FS_COMPR_FL);
+}
+
+/*
+ * Clusters of a compressed file never cross node blocks, so the pointers
+ * of the inode and of each direct node are cut down to whole clusters.
+ */
 static inline unsigned int addrs_per_inode(struct inode *inode)
 {
-	return CUR_ADDRS_PER_INODE(inode) - get_inline_xattr_addrs(inode);
+	unsigned int addrs = CUR_ADDRS_PER_INODE(inode) -
+					get_inline_xattr_addrs(inode);
+
+	if (!f2fs_compressed_file(inode))
+		return addrs;
+	return ALIGN_DOWN(addrs, F2FS_I(inode)->i_cluster_size);
+}
+
+static inline unsigned int addrs_per_block(struct inode *inode)
+{
+	if (!f2fs_compressed_file(inode))
+		return DEF_ADDRS_PER_BLOCK;
+	return ALIGN_DOWN(DEF_ADDRS_PER_BLOCK, F2FS_I(inode)->i_cluster_size);
 }
 
 static inline void *inline_xattr_addr(struct inode *inode, struct page *page)
@@ -2692,6 +2757,10 @@ static inline bool f2fs_may_extent_tree(struct inode *inode)
 			is_inode_flag_set(inode, FI_NO_EXTENT))
 		return false;
 
+	/* blocks of compressed clusters don't map to their pages */
+	if (f2fs_compressed_file(inode))
+		return false;
+
 	/*
 	 * for recovered files during mount do not create extents
 	 * if shrinker is not registered.
@@ -2812,7 +2881,8 @@ static inline void verify_blkaddr(struct f2fs_sb_info *sbi,
 
 static inline bool __is_valid_data_blkaddr(block_t blkaddr)
 {
-	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR)
+	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR ||
+					blkaddr == COMPRESS_ADDR)
 		return false;
 	return true;
 }
@@ -3185,6 +3255,9 @@ struct f2fs_stat_info {
 	int nr_discard_cmd;
 	unsigned int undiscard_blks;
 	int inline_xattr, inline_inode, inline_dir, append, update, orphans;
+	int compr_inode;
+	unsigned long long compr_blocks;
+	unsigned long long compr_written_pages, compr_written_blocks;
 	int aw_cnt, max_aw_cnt, vw_cnt, max_vw_cnt;
 	unsigned int valid_count, valid_node_count, valid_inode_count, discard_blks;
 	unsigned int bimodal, avg_vblocks;
@@ -3192,6 +3265,8 @@ struct f2fs_stat_info {
 	int rsvd_segs, overp_segs;
 	int dirty_count, node_pages, meta_pages;
 	int prefree_count, call_count, cp_count, bg_cp_count;
+	unsigned int cp_flush_time[NR_CP_FLUSH];	/* ms, last cp */
+	unsigned long long cp_flush_total[NR_CP_FLUSH];	/* ms, all cps */
 	int tot_segs, node_segs, data_segs, free_segs, free_secs;
 	int bg_node_segs, bg_data_segs;
 	int tot_blks, data_blks, node_blks;
@@ -3215,6 +3290,11 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 
 #define stat_inc_cp_count(si)		((si)->cp_count++)
 #define stat_inc_bg_cp_count(si)	((si)->bg_cp_count++)
+#define stat_set_cp_flush_time(si, type, ms)				\
+	do {								\
+		(si)->cp_flush_time[type] = (ms);			\
+		(si)->cp_flush_total[type] += (ms);			\
+	} while (0)
 #define stat_inc_call_count(si)		((si)->call_count++)
 #define stat_inc_bggc_count(sbi)	((sbi)->bg_gc++)
 #define stat_io_skip_bggc_count(sbi)	((sbi)->io_skip_bggc++)
@@ -3255,6 +3335,25 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 		if (f2fs_has_inline_dentry(inode))			\
 			(atomic_dec(&F2FS_I_SB(inode)->inline_dir));	\
 	} while (0)
+#define stat_inc_compr_inode(inode)					\
+	do {								\
+		if (f2fs_compressed_file(inode))			\
+			(atomic_inc(&F2FS_I_SB(inode)->compr_inode));	\
+	} while (0)
+#define stat_dec_compr_inode(inode)					\
+	do {								\
+		if (f2fs_compressed_file(inode))			\
+			(atomic_dec(&F2FS_I_SB(inode)->compr_inode));	\
+	} while (0)
+#define stat_add_compr_blocks(inode, blocks)				\
+		(atomic64_add(blocks, &F2FS_I_SB(inode)->compr_blocks))
+#define stat_sub_compr_blocks(inode, blocks)				\
+		(atomic64_sub(blocks, &F2FS_I_SB(inode)->compr_blocks))
+#define stat_inc_compr_write(sbi, pages, blocks)			\
+	do {								\
+		atomic64_add(pages, &(sbi)->compr_written_pages);	\
+		atomic64_add(blocks, &(sbi)->compr_written_blocks);	\
+	} while (0)
 #define stat_inc_meta_count(sbi, blkaddr)				\
 	do {								\
 		if (blkaddr < SIT_I(sbi)->sit_base_addr)		\
@@ -3333,6 +3432,7 @@ void f2fs_destroy_root_stats(void);
 #else
 #define stat_inc_cp_count(si)				do { } while (0)
 #define stat_inc_bg_cp_count(si)			do { } while (0)
+#define stat_set_cp_flush_time(si, type, ms)		do { } while (0)
 #define stat_inc_call_count(si)				do { } while (0)
 #define stat_inc_bggc_count(si)				do { } while (0)
 #define stat_io_skip_bggc_count(sbi)			do { } while (0)
@@ -3349,6 +3449,11 @@ void f2fs_destroy_root_stats(void);
 #define stat_dec_inline_inode(inode)			do { } while (0)
 #define stat_inc_inline_dir(inode)			do { } while (0)
 #define stat_dec_inline_dir(inode)			do { } while (0)
+#define stat_inc_compr_inode(inode)			do { } while (0)
+#define stat_dec_compr_inode(inode)			do { } while (0)
+#define stat_add_compr_blocks(inode, blocks)		do { } while (0)
+#define stat_sub_compr_blocks(inode, blocks)		do { } while (0)
+#define stat_inc_compr_write(sbi, pages, blocks)	do { } while (0)
 #define stat_inc_atomic_write(inode)			do { } while (0)
 #define stat_dec_atomic_write(inode)			do { } while (0)
 #define stat_update_max_atomic_write(inode)		do { } while (0)
@@ -3460,6 +3565,81 @@ void f2fs_exit_sysfs(void);
 int f2fs_register_sysfs(struct f2fs_sb_info *sbi);
 void f2fs_unregister_sysfs(struct f2fs_sb_info *sbi);
 
+/*
+ * compress.c
+ */
+#define COMPRESS_DATA_RESERVED_SIZE	5
+struct compress_data {
+	__le32 clen;			/* compressed data size */
+	__le32 reserved[COMPRESS_DATA_RESERVED_SIZE];	/* reserved */
+	u8 cdata[];			/* compressed data */
+};
+
+#define COMPRESS_HEADER_SIZE	(sizeof(struct compress_data))
+
+/* the last decompressed cluster of a file, for reads of several pages */
+struct f2fs_cluster_cache {
+	pgoff_t cluster_idx;		/* cluster in @rbuf, or ULONG_MAX */
+	bool compressed;		/* is that cluster compressed */
+	size_t rlen;			/* length of the data in @rbuf */
+	void *rbuf;			/* decompressed data of the cluster */
+};
+
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+int __init f2fs_init_compress_pools(void);
+void f2fs_destroy_compress_pools(void);
+bool f2fs_is_compressed_page(struct page *page);
+bool f2fs_compressed_page_match(struct page *cpage, struct inode *inode,
+						struct page *page);
+void f2fs_compress_write_end_io(struct bio *bio, struct page *page);
+void f2fs_init_cluster_cache(struct f2fs_cluster_cache *cc);
+void f2fs_destroy_cluster_cache(struct f2fs_cluster_cache *cc);
+int f2fs_read_cluster_page(struct inode *inode, struct f2fs_cluster_cache *cc,
+						struct page *page);
+int f2fs_read_compressed_page(struct inode *inode, struct page *page);
+int f2fs_write_cluster(struct f2fs_io_info *fio, loff_t *psize);
+int f2fs_truncate_partial_cluster(struct inode *inode, pgoff_t index);
+#else
+static inline int f2fs_init_compress_pools(void) { return 0; }
+static inline void f2fs_destroy_compress_pools(void) { }
+static inline bool f2fs_is_compressed_page(struct page *page)
+{
+	return false;
+}
+static inline bool f2fs_compressed_page_match(struct page *cpage,
+				struct inode *inode, struct page *page)
+{
+	return false;
+}
+static inline void f2fs_compress_write_end_io(struct bio *bio,
+						struct page *page) { }
+static inline void f2fs_init_cluster_cache(struct f2fs_cluster_cache *cc)
+{
+}
+static inline void f2fs_destroy_cluster_cache(struct f2fs_cluster_cache *cc)
+{
+}
+static inline int f2fs_read_cluster_page(struct inode *inode,
+			struct f2fs_cluster_cache *cc, struct page *page)
+{
+	return -EOPNOTSUPP;
+}
+static inline int f2fs_read_compressed_page(struct inode *inode,
+						struct page *page)
+{
+	return -EOPNOTSUPP;
+}
+static inline int f2fs_write_cluster(struct f2fs_io_info *fio, loff_t *psize)
+{
+	return -EOPNOTSUPP;
+}
+static inline int f2fs_truncate_partial_cluster(struct inode *inode,
+							pgoff_t index)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
 /*
  * crypto support
  */
@@ -3483,11 +3663,12 @@ static inline void f2fs_set_encrypted_inode(struct inode *inode)
 
 /*
  * Returns true if the reads of the inode's data need to undergo some
- * postprocessing step, like decryption or authenticity verification.
+ * postprocessing step, like decryption, decompression or authenticity
+ * verification.
  */
 static inline bool f2fs_post_read_required(struct inode *inode)
 {
-	return f2fs_encrypted_file(inode);
+	return f2fs_encrypted_file(inode) || f2fs_compressed_file(inode);
 }
 
 #define F2FS_FEATURE_FUNCS(name, flagname) \
@@ -3506,6 +3687,54 @@ F2FS_FEATURE_FUNCS(quota_ino, QUOTA_INO);
 F2FS_FEATURE_FUNCS(inode_crtime, INODE_CRTIME);
 F2FS_FEATURE_FUNCS(lost_found, LOST_FOUND);
 F2FS_FEATURE_FUNCS(sb_chksum, SB_CHKSUM);
+F2FS_FEATURE_FUNCS(compression, COMPRESSION);
+
+static inline bool f2fs_may_compress(struct inode *inode)
+{
+	struct f2fs_inode *ri;
+
+	if (!f2fs_sb_has_compression(F2FS_I_SB(inode)) ||
+			!f2fs_has_extra_attr(inode) ||
+			!F2FS_FITS_IN_INODE(ri, F2FS_I(inode)->i_extra_isize,
+						i_log_cluster_size))
+		return false;
+	if (f2fs_encrypted_inode(inode))
+		return false;
+	if (f2fs_is_atomic_file(inode) || f2fs_is_volatile_file(inode))
+		return false;
+	return S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode);
+}
+
+static inline void set_compress_context(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+
+	F2FS_I(inode)->i_compress_algorithm =
+			F2FS_OPTION(sbi).compress_algorithm;
+	F2FS_I(inode)->i_log_cluster_size =
+			F2FS_OPTION(sbi).compress_log_size;
+	F2FS_I(inode)->i_cluster_size =
+			1 << F2FS_I(inode)->i_log_cluster_size;
+	F2FS_I(inode)->i_flags |= F2FS_COMPR_FL;
+	stat_inc_compr_inode(inode);
+	f2fs_mark_inode_dirty_sync(inode, true);
+}
+
+static inline void f2fs_i_compr_blocks_update(struct inode *inode,
+						u64 blocks, bool add)
+{
+	if (!blocks)
+		return;
+
+	if (add) {
+		F2FS_I(inode)->i_compr_blocks += blocks;
+		stat_add_compr_blocks(inode, blocks);
+	} else {
+		F2FS_I(inode)->i_compr_blocks -= blocks;
+		stat_sub_compr_blocks(inode, blocks);
+	}
+	f2fs_mark_inode_dirty_sync(inode, true);
+}
 
 #ifdef CONFIG_BLK_DEV_ZONED
 static inline int get_blkz_type(struct f2fs_sb_info *sbi,
@@ -506,6 +506,9 @@ void f2fs_truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 	int nr_free = 0, ofs = dn->ofs_in_node, len = count;
 	__le32 *addr;
 	int base = 0;
+	bool compressed_cluster = false;
+	int valid_blocks = 0;
+	int cluster_size = F2FS_I(dn->inode)->i_cluster_size;
 
 	if (IS_INODE(dn->node_page) && f2fs_has_extra_attr(dn->inode))
 		base = get_extra_isize(dn->inode);
@@ -513,9 +516,27 @@ void f2fs_truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 	raw_node = F2FS_NODE(dn->node_page);
 	addr = blkaddr_in_node(raw_node) + base + ofs;
 
+	/*
+	 * Clusters are aligned in the node as in the file, a range starting
+	 * within one is accounted as of the head of that cluster.
+	 */
+	if (f2fs_compressed_file(dn->inode) && (ofs & (cluster_size - 1)))
+		compressed_cluster = le32_to_cpu(*(addr -
+				(ofs & (cluster_size - 1)))) == COMPRESS_ADDR;
+
 	for (; count > 0; count--, addr++, dn->ofs_in_node++) {
 		block_t blkaddr = le32_to_cpu(*addr);
 
+		/* account the compressed blocks freed per cluster */
+		if (f2fs_compressed_file(dn->inode) &&
+				!(dn->ofs_in_node & (cluster_size - 1))) {
+			if (compressed_cluster)
+				f2fs_i_compr_blocks_update(dn->inode,
+							valid_blocks, false);
+			compressed_cluster = (blkaddr == COMPRESS_ADDR);
+			valid_blocks = 0;
+		}
+
 		if (blkaddr == NULL_ADDR)
 			continue;
 
@@ -526,12 +547,18 @@ void f2fs_truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 			!f2fs_is_valid_blkaddr(sbi, blkaddr, DATA_GENERIC))
 			continue;
 
+		if (compressed_cluster && __is_valid_data_blkaddr(blkaddr))
+			valid_blocks++;
+
 		f2fs_invalidate_blocks(sbi, blkaddr);
 		if (dn->ofs_in_node == 0 && IS_INODE(dn->node_page))
 			clear_inode_flag(dn->inode, FI_FIRST_BLOCK_WRITTEN);
 		nr_free++;
 	}
 
+	if (compressed_cluster)
+		f2fs_i_compr_blocks_update(dn->inode, valid_blocks, false);
+
 	if (nr_free) {
 		pgoff_t fofs;
 		/*
@@ -552,7 +579,7 @@ void f2fs_truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 
 void f2fs_truncate_data_blocks(struct dnode_of_data *dn)
 {
-	f2fs_truncate_data_blocks_range(dn, ADDRS_PER_BLOCK);
+	f2fs_truncate_data_blocks_range(dn, ADDRS_PER_BLOCK(dn->inode));
 }
 
 static int truncate_partial_data_page(struct inode *inode, u64 from,
@@ -604,6 +631,19 @@ int f2fs_truncate_blocks(struct inode *inode, u64 from, bool lock,
 
 	free_from = (pgoff_t)F2FS_BLK_ALIGN(from);
 
+	/* a compressed cluster cut by @from is kept to be compressed again */
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_truncate_partial_cluster(inode, free_from);
+		if (err < 0) {
+			trace_f2fs_truncate_blocks_exit(inode, err);
+			return err;
+		}
+		if (err)
+			free_from = round_up(free_from,
+					F2FS_I(inode)->i_cluster_size);
+		err = 0;
+	}
+
 	if (free_from >= sbi->max_file_blocks)
 		goto free_partial;
 
@@ -1011,7 +1051,8 @@ static int __read_out_blkaddrs(struct inode *inode, block_t *blkaddr,
 	} else if (ret == -ENOENT) {
 		if (dn.max_level == 0)
 			return -ENOENT;
-		done = min((pgoff_t)ADDRS_PER_BLOCK - dn.ofs_in_node, len);
+		done = min((pgoff_t)ADDRS_PER_BLOCK(inode) -
+							dn.ofs_in_node, len);
 		blkaddr += done;
 		do_replace += done;
 		goto next;
@@ -1162,7 +1203,7 @@ static int __exchange_data_block(struct inode *src_inode,
 	int ret;
 
 	while (len) {
-		olen = min((pgoff_t)4 * ADDRS_PER_BLOCK, len);
+		olen = min((pgoff_t)4 * ADDRS_PER_BLOCK(src_inode), len);
 
 		src_blkaddr = f2fs_kvzalloc(F2FS_I_SB(src_inode),
 					array_size(olen, sizeof(block_t)),
@@ -1567,6 +1608,12 @@ static long f2fs_fallocate(struct file *file, int mode,
 		(mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE)))
 		return -EOPNOTSUPP;
 
+	/* blocks of compressed clusters can't be dropped or moved alone */
+	if (f2fs_compressed_file(inode) &&
+		(mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_COLLAPSE_RANGE |
+			FALLOC_FL_ZERO_RANGE | FALLOC_FL_INSERT_RANGE)))
+		return -EOPNOTSUPP;
+
 	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE |
 			FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_ZERO_RANGE |
 			FALLOC_FL_INSERT_RANGE))
@@ -1661,6 +1708,7 @@ static int __f2fs_ioc_setflags(struct inode *inode, unsigned int flags)
 {
 	struct f2fs_inode_info *fi = F2FS_I(inode);
 	unsigned int oldflags;
+	int err;
 
 	/* Is it quota file? Do not allow user to mess with it */
 	if (IS_NOQUOTA(inode))
@@ -1674,6 +1722,27 @@ static int __f2fs_ioc_setflags(struct inode *inode, unsigned int flags)
 		if (!capable(CAP_LINUX_IMMUTABLE))
 			return -EPERM;
 
+	/* only the compression of empty files can be switched */
+	if ((flags ^ oldflags) & F2FS_COMPR_FL) {
+		if (!f2fs_sb_has_compression(F2FS_I_SB(inode)))
+			return -EOPNOTSUPP;
+		if (S_ISREG(inode->i_mode) && (i_size_read(inode) ||
+				F2FS_HAS_BLOCKS(inode) ||
+				get_dirty_pages(inode)))
+			return -EINVAL;
+
+		if (oldflags & F2FS_COMPR_FL) {
+			stat_dec_compr_inode(inode);
+		} else {
+			if (!f2fs_may_compress(inode))
+				return -EINVAL;
+			err = f2fs_convert_inline_inode(inode);
+			if (err)
+				return err;
+			set_compress_context(inode);
+		}
+	}
+
 	flags = flags & F2FS_FL_USER_MODIFIABLE;
 	flags |= oldflags & ~F2FS_FL_USER_MODIFIABLE;
 	fi->i_flags = flags;
@@ -1729,7 +1798,7 @@ static int f2fs_ioc_start_atomic_write(struct file *filp)
 	if (!inode_owner_or_capable(inode))
 		return -EACCES;
 
-	if (!S_ISREG(inode->i_mode))
+	if (!S_ISREG(inode->i_mode) || f2fs_compressed_file(inode))
 		return -EINVAL;
 
 	ret = mnt_want_write_file(filp);
@@ -1831,7 +1900,7 @@ static int f2fs_ioc_start_volatile_write(struct file *filp)
 	if (!inode_owner_or_capable(inode))
 		return -EACCES;
 
-	if (!S_ISREG(inode->i_mode))
+	if (!S_ISREG(inode->i_mode) || f2fs_compressed_file(inode))
 		return -EINVAL;
 
 	ret = mnt_want_write_file(filp);
@@ -2363,6 +2432,9 @@ static int f2fs_ioc_defragment(struct file *filp, unsigned long arg)
 	if (!S_ISREG(inode->i_mode) || f2fs_is_atomic_file(inode))
 		return -EINVAL;
 
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	if (f2fs_readonly(sbi->sb))
 		return -EROFS;
 
@@ -2419,6 +2491,9 @@ static int f2fs_move_file_range(struct file *file_in, loff_t pos_in,
 	if (f2fs_encrypted_inode(src) || f2fs_encrypted_inode(dst))
 		return -EOPNOTSUPP;
 
+	if (f2fs_compressed_file(src) || f2fs_compressed_file(dst))
+		return -EOPNOTSUPP;
+
 	if (src == dst) {
 		if (pos_in == pos_out)
 			return 0;
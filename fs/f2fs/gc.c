@@ -20,6 +20,78 @@
 #include "gc.h"
 #include <trace/events/f2fs.h>
 
+/* Sum of the io_ticks of the devices of @sbi, the jiffies they were busy */
+static unsigned long f2fs_io_ticks(struct f2fs_sb_info *sbi)
+{
+	unsigned long ticks = 0;
+	int i;
+
+	if (!sbi->s_ndevs)
+		return part_stat_read(&sbi->sb->s_bdev->bd_disk->part0,
+								io_ticks);
+
+	for (i = 0; i < sbi->s_ndevs; i++)
+		ticks += part_stat_read(&FDEV(i).bdev->bd_disk->part0,
+								io_ticks);
+	return ticks;
+}
+
+/*
+ * Were the devices idle since the last call?  Unlike is_idle(), this also
+ * sees the IO of other partitions and filesystems on the same disks.
+ */
+static bool is_bdev_idle(struct f2fs_sb_info *sbi,
+				struct f2fs_gc_kthread *gc_th)
+{
+	unsigned long ticks = f2fs_io_ticks(sbi);
+	unsigned long busy = ticks - gc_th->last_io_ticks;
+	unsigned long elapsed = jiffies - gc_th->last_io_sample;
+
+	gc_th->last_io_ticks = ticks;
+	gc_th->last_io_sample = jiffies;
+
+	return busy * 100 <= elapsed * GC_IDLE_BUSY_RATIO;
+}
+
+/*
+ * Track how fast free sections are used up, and return true if foreground
+ * GC can be expected to start within forecast_time at that pace, so that
+ * background GC has to make room before writers get stalled.
+ */
+static bool need_gc_ahead(struct f2fs_sb_info *sbi,
+				struct f2fs_gc_kthread *gc_th)
+{
+	unsigned int free_secs = free_sections(sbi);
+	unsigned int limit_secs = reserved_sections(sbi) +
+			get_blocktype_secs(sbi, F2FS_DIRTY_NODES) +
+			2 * get_blocktype_secs(sbi, F2FS_DIRTY_DENTS) +
+			get_blocktype_secs(sbi, F2FS_DIRTY_IMETA);
+	unsigned int elapsed_ms;
+	unsigned int sample = 0;
+	u64 time_left;
+
+	elapsed_ms = jiffies_to_msecs(jiffies - gc_th->last_free_sample);
+	if (elapsed_ms) {
+		/* GC freeing sections meanwhile makes this the net usage */
+		if (free_secs < gc_th->last_free_secs)
+			sample = div_u64((u64)(gc_th->last_free_secs -
+					free_secs) * 1000 * 1000, elapsed_ms);
+		gc_th->free_secs_rate =
+				(gc_th->free_secs_rate * 3 + sample) / 4;
+		gc_th->last_free_secs = free_secs;
+		gc_th->last_free_sample = jiffies;
+	}
+
+	if (!gc_th->forecast_time || !gc_th->free_secs_rate)
+		return false;
+	if (free_secs <= limit_secs)
+		return true;
+
+	time_left = div_u64((u64)(free_secs - limit_secs) * 1000 * 1000,
+						gc_th->free_secs_rate);
+	return time_left < gc_th->forecast_time;
+}
+
 static int gc_thread_func(void *data)
 {
 	struct f2fs_sb_info *sbi = data;
@@ -76,7 +148,7 @@ static int gc_thread_func(void *data)
 		 * invalidated soon after by user update or deletion.
 		 * So, I'd like to wait some time to collect dirty segments.
 		 */
-		if (sbi->gc_mode == GC_URGENT) {
+		if (sbi->gc_mode == GC_URGENT || need_gc_ahead(sbi, gc_th)) {
 			wait_ms = gc_th->urgent_sleep_time;
 			mutex_lock(&sbi->gc_mutex);
 			goto do_gc;
@@ -87,7 +159,7 @@ static int gc_thread_func(void *data)
 			goto next;
 		}
 
-		if (!is_idle(sbi, GC_TIME)) {
+		if (!is_idle(sbi, GC_TIME) || !is_bdev_idle(sbi, gc_th)) {
 			increase_sleep_time(gc_th, &wait_ms);
 			mutex_unlock(&sbi->gc_mutex);
 			stat_io_skip_bggc_count(sbi);
@@ -110,6 +182,10 @@ static int gc_thread_func(void *data)
 
 		/* balancing f2fs's metadata periodically */
 		f2fs_balance_fs_bg(sbi);
+
+		/* don't count our own IO against the idleness of the devices */
+		gc_th->last_io_ticks = f2fs_io_ticks(sbi);
+		gc_th->last_io_sample = jiffies;
 next:
 		sb_end_write(sbi->sb);
 
@@ -133,6 +209,13 @@ int f2fs_start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->min_sleep_time = DEF_GC_THREAD_MIN_SLEEP_TIME;
 	gc_th->max_sleep_time = DEF_GC_THREAD_MAX_SLEEP_TIME;
 	gc_th->no_gc_sleep_time = DEF_GC_THREAD_NOGC_SLEEP_TIME;
+	gc_th->forecast_time = DEF_GC_THREAD_FORECAST_TIME;
+
+	gc_th->last_io_ticks = f2fs_io_ticks(sbi);
+	gc_th->last_io_sample = jiffies;
+	gc_th->last_free_secs = free_sections(sbi);
+	gc_th->last_free_sample = jiffies;
+	gc_th->free_secs_rate = 0;
 
 	gc_th->gc_wake= 0;
 
@@ -296,6 +379,54 @@ static unsigned int count_bits(const unsigned long *addr,
 	return sum;
 }
 
+/*
+ * Pick the cheapest section to clean from the victim buckets, lowest bucket
+ * first.  Greedy selection is done once a bucket yields a candidate, since
+ * all cheaper sections are in the buckets below, while cost-benefit keeps
+ * going up to max_search candidates, the age of a section counting too.
+ */
+static void get_victim_from_buckets(struct f2fs_sb_info *sbi, int gc_type,
+					struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int nsearched = 0;
+	int i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++) {
+		unsigned long *bucket = dirty_i->victim_buckets[i];
+		unsigned int secno;
+
+		for_each_set_bit(secno, bucket, MAIN_SECS(sbi)) {
+			unsigned int segno = GET_SEG_FROM_SEC(sbi, secno);
+			unsigned long cost;
+
+			if (find_next_bit(p->dirty_segmap, segno + p->ofs_unit,
+						segno) >= segno + p->ofs_unit)
+				continue;
+			if (sec_usage_check(sbi, secno))
+				continue;
+			/* Don't touch checkpointed data */
+			if (unlikely(is_sbi_flag_set(sbi, SBI_CP_DISABLED) &&
+					get_ckpt_valid_blocks(sbi, segno)))
+				continue;
+			if (gc_type == BG_GC &&
+					test_bit(secno, dirty_i->victim_secmap))
+				continue;
+
+			cost = get_gc_cost(sbi, segno, p);
+			if (p->min_cost > cost) {
+				p->min_segno = segno;
+				p->min_cost = cost;
+			}
+			if (++nsearched >= p->max_search)
+				return;
+		}
+
+		if (p->gc_mode == GC_GREEDY && p->min_segno != NULL_SEGNO)
+			return;
+	}
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -355,6 +486,11 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	if (p.alloc_mode == LFS) {
+		get_victim_from_buckets(sbi, gc_type, &p);
+		goto got_victim;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -408,6 +544,7 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			break;
 		}
 	}
+got_victim:
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		*result = (p.min_segno / p.ofs_unit) * p.ofs_unit;
@@ -591,7 +728,7 @@ block_t f2fs_start_bidx_of_node(unsigned int node_ofs, struct inode *inode)
 		int dec = (node_ofs - indirect_blks - 3) / (NIDS_PER_BLOCK + 1);
 		bidx = node_ofs - 5 - dec;
 	}
-	return bidx * ADDRS_PER_BLOCK + ADDRS_PER_INODE(inode);
+	return bidx * ADDRS_PER_BLOCK(inode) + ADDRS_PER_INODE(inode);
 }
 
 static bool is_alive(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
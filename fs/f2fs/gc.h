@@ -14,6 +14,11 @@
 #define DEF_GC_THREAD_MIN_SLEEP_TIME	30000	/* milliseconds */
 #define DEF_GC_THREAD_MAX_SLEEP_TIME	60000
 #define DEF_GC_THREAD_NOGC_SLEEP_TIME	300000	/* wait 5 min */
+#define DEF_GC_THREAD_FORECAST_TIME	60000	/* 1 min of free space left */
+#define GC_IDLE_BUSY_RATIO	5	/*
+					 * devices busy less than this
+					 * percentage of the time are idle
+					 */
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
@@ -34,6 +39,17 @@ struct f2fs_gc_kthread {
 
 	/* for changing gc mode */
 	unsigned int gc_wake;
+
+	/* for block layer idleness, from the io_ticks of the devices */
+	unsigned long last_io_ticks;
+	unsigned long last_io_sample;
+
+	/* for forecasting when foreground GC would start */
+	unsigned int forecast_time;	/* hurry if free space is used up
+					 * within this many milliseconds */
+	unsigned int last_free_secs;
+	unsigned long last_free_sample;
+	unsigned int free_secs_rate;	/* milli-sections used per second */
 };
 
 struct gc_inode_list {
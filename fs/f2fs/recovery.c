@@ -234,6 +234,51 @@ static void recover_inline_flags(struct inode *inode, struct f2fs_inode *ri)
 		clear_inode_flag(inode, FI_DATA_EXIST);
 }
 
+/* The cluster layout comes along with F2FS_COMPR_FL, see do_read_inode() */
+static int recover_compress_flags(struct inode *inode, struct f2fs_inode *ri)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	stat_dec_compr_inode(inode);
+	stat_sub_compr_blocks(inode, fi->i_compr_blocks);
+
+	fi->i_flags = le32_to_cpu(ri->i_flags);
+	if (f2fs_has_extra_attr(inode) && f2fs_sb_has_compression(sbi) &&
+			F2FS_FITS_IN_INODE(ri, fi->i_extra_isize,
+						i_log_cluster_size)) {
+		fi->i_compr_blocks = le64_to_cpu(ri->i_compr_blocks);
+		fi->i_compress_algorithm = ri->i_compress_algorithm;
+		fi->i_log_cluster_size = ri->i_log_cluster_size;
+	} else {
+		fi->i_flags &= ~F2FS_COMPR_FL;
+		fi->i_compr_blocks = 0;
+	}
+
+	if ((fi->i_flags & F2FS_COMPR_FL) &&
+			(fi->i_compress_algorithm >= COMPRESS_MAX ||
+			fi->i_log_cluster_size < MIN_COMPRESS_LOG_SIZE ||
+			fi->i_log_cluster_size > MAX_COMPRESS_LOG_SIZE)) {
+		set_sbi_flag(sbi, SBI_NEED_FSCK);
+		f2fs_msg(sbi->sb, KERN_WARNING,
+			"%s: inode (ino=%lx) has unsupported compress "
+			"algorithm: %u or log cluster size: %u, "
+			"run fsck to fix",
+			__func__, inode->i_ino, fi->i_compress_algorithm,
+			fi->i_log_cluster_size);
+		fi->i_flags &= ~F2FS_COMPR_FL;
+		fi->i_compr_blocks = 0;
+		return -EINVAL;
+	}
+
+	if (fi->i_flags & F2FS_COMPR_FL)
+		fi->i_cluster_size = 1 << fi->i_log_cluster_size;
+
+	stat_inc_compr_inode(inode);
+	stat_add_compr_blocks(inode, fi->i_compr_blocks);
+	return 0;
+}
+
 static int recover_inode(struct inode *inode, struct page *page)
 {
 	struct f2fs_inode *raw = F2FS_INODE(page);
@@ -278,7 +323,9 @@ static int recover_inode(struct inode *inode, struct page *page)
 	inode->i_mtime.tv_nsec = le32_to_cpu(raw->i_mtime_nsec);
 
 	F2FS_I(inode)->i_advise = raw->i_advise;
-	F2FS_I(inode)->i_flags = le32_to_cpu(raw->i_flags);
+	err = recover_compress_flags(inode, raw);
+	if (err)
+		return err;
 	f2fs_set_inode_flags(inode);
 	F2FS_I(inode)->i_gc_failures[GC_FAILURE_PIN] =
 				le16_to_cpu(raw->i_gc_failures);
@@ -508,6 +555,7 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 	struct dnode_of_data dn;
 	struct node_info ni;
 	unsigned int start, end;
+	u64 compr_blocks = F2FS_I(inode)->i_compr_blocks;
 	int err = 0, recovered = 0;
 
 	/* step 1: recover xattr */
@@ -579,6 +627,14 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 			continue;
 		}
 
+		/* dest is the head of a compressed cluster, keep it as such */
+		if (dest == COMPRESS_ADDR) {
+			f2fs_truncate_data_blocks_range(&dn, 1);
+			f2fs_reserve_new_block(&dn);
+			f2fs_update_data_blkaddr(&dn, COMPRESS_ADDR);
+			continue;
+		}
+
 		/* dest is valid block, try to recover from src to dest */
 		if (f2fs_is_valid_blkaddr(sbi, dest, META_POR)) {
 
@@ -616,6 +672,14 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 	set_page_dirty(dn.node_page);
 err:
 	f2fs_put_dnode(&dn);
+
+	/*
+	 * The blocks replaced above were compressed or not as in the inode
+	 * recovered by recover_inode(), whose count of them stands.
+	 */
+	if (F2FS_I(inode)->i_compr_blocks < compr_blocks)
+		f2fs_i_compr_blocks_update(inode,
+			compr_blocks - F2FS_I(inode)->i_compr_blocks, true);
 out:
 	f2fs_msg(sbi->sb, KERN_NOTICE,
 		"recover_data: ino = %lx (i_size: %s) recovered = %d, err = %d",
@@ -2059,6 +2059,26 @@ static void __set_sit_entry_type(struct f2fs_sb_info *sbi, int type,
 		__mark_sit_entry_dirty(sbi, segno);
 }
 
+/* Move a section whose valid blocks went from @old to @new between buckets */
+static void update_victim_bucket(struct f2fs_sb_info *sbi, unsigned int segno,
+				unsigned int old, unsigned int new)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+	unsigned int old_bucket = victim_bucket(sbi, old);
+	unsigned int new_bucket = victim_bucket(sbi, new);
+	bool was_in = old && old < BLKS_PER_SEC(sbi);
+	bool is_in = new && new < BLKS_PER_SEC(sbi);
+
+	if (was_in == is_in && old_bucket == new_bucket)
+		return;
+
+	if (was_in)
+		clear_bit(secno, dirty_i->victim_buckets[old_bucket]);
+	if (is_in)
+		set_bit(secno, dirty_i->victim_buckets[new_bucket]);
+}
+
 static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 {
 	struct seg_entry *se;
@@ -2155,6 +2175,9 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 	if (__is_large_section(sbi))
 		get_sec_entry(sbi, segno)->valid_blocks += del;
+
+	new_vblocks = get_valid_blocks(sbi, segno, true);
+	update_victim_bucket(sbi, segno, new_vblocks - del, new_vblocks);
 }
 
 void f2fs_invalidate_blocks(struct f2fs_sb_info *sbi, block_t addr)
@@ -2163,7 +2186,7 @@ void f2fs_invalidate_blocks(struct f2fs_sb_info *sbi, block_t addr)
 	struct sit_info *sit_i = SIT_I(sbi);
 
 	f2fs_bug_on(sbi, addr == NULL_ADDR);
-	if (addr == NEW_ADDR)
+	if (addr == NEW_ADDR || addr == COMPRESS_ADDR)
 		return;
 
 	invalidate_mapping_pages(META_MAPPING(sbi), addr, addr);
@@ -4166,10 +4189,36 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	return 0;
 }
 
+static int init_victim_buckets(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int bitmap_size = f2fs_bitmap_size(MAIN_SECS(sbi));
+	unsigned int secno, valid_blocks;
+	int i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++) {
+		dirty_i->victim_buckets[i] = f2fs_kvzalloc(sbi, bitmap_size,
+								GFP_KERNEL);
+		if (!dirty_i->victim_buckets[i])
+			return -ENOMEM;
+	}
+
+	for (secno = 0; secno < MAIN_SECS(sbi); secno++) {
+		valid_blocks = get_valid_blocks(sbi,
+					GET_SEG_FROM_SEC(sbi, secno), true);
+		if (!valid_blocks || valid_blocks >= BLKS_PER_SEC(sbi))
+			continue;
+		set_bit(secno, dirty_i->victim_buckets[victim_bucket(sbi,
+							valid_blocks)]);
+	}
+	return 0;
+}
+
 static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = f2fs_kzalloc(sbi, sizeof(struct dirty_seglist_info),
@@ -4190,7 +4239,10 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 	}
 
 	init_dirty_segmap(sbi);
-	return init_victim_secmap(sbi);
+	err = init_victim_secmap(sbi);
+	if (err)
+		return err;
+	return init_victim_buckets(sbi);
 }
 
 /*
@@ -4309,6 +4361,15 @@ static void destroy_victim_secmap(struct f2fs_sb_info *sbi)
 	kvfree(dirty_i->victim_secmap);
 }
 
+static void destroy_victim_buckets(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	int i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++)
+		kvfree(dirty_i->victim_buckets[i]);
+}
+
 static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
@@ -4322,6 +4383,7 @@ static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 		discard_dirty_segmap(sbi, i);
 
 	destroy_victim_secmap(sbi);
+	destroy_victim_buckets(sbi);
 	SM_I(sbi)->dirty_info = NULL;
 	kvfree(dirty_i);
 }
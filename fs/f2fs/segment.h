@@ -271,14 +271,30 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * Sections which are neither free nor full are kept in one of these
+ * buckets by their number of valid blocks, so that GC finds the sections
+ * with the fewest valid blocks without scanning the dirty segmap.
+ */
+#define NR_VICTIM_BUCKETS	32
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	/* sections by valid blocks, updated under sentry_lock */
+	unsigned long *victim_buckets[NR_VICTIM_BUCKETS];
 };
 
+static inline unsigned int victim_bucket(struct f2fs_sb_info *sbi,
+						unsigned int valid_blocks)
+{
+	return div_u64((u64)valid_blocks * NR_VICTIM_BUCKETS,
+						BLKS_PER_SEC(sbi));
+}
+
 /* victim selection function for cleaning and SSR */
 struct victim_selection {
 	int (*get_victim)(struct f2fs_sb_info *, unsigned int *,
@@ -503,16 +503,19 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
 	 * Limit the cuse channel to requests that can
 	 * be represented in file->f_cred->user_ns.
 	 */
-	fuse_conn_init(&cc->fc, file->f_cred->user_ns);
+	if (fuse_conn_init(&cc->fc, file->f_cred->user_ns)) {
+		kfree(cc);
+		return -ENOMEM;
+	}
+	cc->fc.release = cuse_fc_release;
 
 	fud = fuse_dev_alloc(&cc->fc);
 	if (!fud) {
-		kfree(cc);
+		fuse_conn_put(&cc->fc);
 		return -ENOMEM;
 	}
 
 	INIT_LIST_HEAD(&cc->list);
-	cc->fc.release = cuse_fc_release;
 
 	cc->fc.initialized = 1;
 	rc = cuse_send_init(cc);
@@ -323,16 +323,86 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_iqueue *fiq)
 {
-	return ++fiq->reqctr;
+	return atomic64_inc_return(&fiq->reqctr);
 }
 
-static void queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
+/*
+ * Queue a request on the input queue of this CPU.  Only the per-CPU lock
+ * is taken; readers are woken through fiq->waitq if any are sleeping.
+ *
+ * Returns false if the connection is gone.
+ */
+static bool queue_request(struct fuse_iqueue *fiq, struct fuse_req *req)
 {
+	struct fuse_iqueue_cpu *iqc;
+	unsigned int cpu = raw_smp_processor_id();
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fiq->pending);
-	wake_up_locked(&fiq->waitq);
+
+	iqc = per_cpu_ptr(fiq->queues, cpu);
+	spin_lock(&iqc->lock);
+	/* Cleared before fuse_abort_conn() empties the queues */
+	if (!READ_ONCE(fiq->connected)) {
+		spin_unlock(&iqc->lock);
+		return false;
+	}
+	req->iq_cpu = cpu;
+	list_add_tail(&req->list, &iqc->pending);
+	spin_unlock(&iqc->lock);
+
+	/* matches barrier in fuse_wait_request() and fuse_dev_poll() */
+	smp_mb();
+	if (waitqueue_active(&fiq->waitq))
+		wake_up(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+	return true;
+}
+
+static bool requests_pending(struct fuse_iqueue *fiq)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (!list_empty(&per_cpu_ptr(fiq->queues, cpu)->pending))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Take the oldest request off the input queue of this CPU, or failing
+ * that off the queue of the next CPU which has one.
+ */
+static struct fuse_req *dequeue_request(struct fuse_iqueue *fiq)
+{
+	unsigned int this_cpu = raw_smp_processor_id();
+	unsigned int cpu = this_cpu;
+
+	do {
+		struct fuse_iqueue_cpu *iqc = per_cpu_ptr(fiq->queues, cpu);
+
+		if (!list_empty(&iqc->pending)) {
+			struct fuse_req *req = NULL;
+
+			spin_lock(&iqc->lock);
+			if (!list_empty(&iqc->pending)) {
+				req = list_first_entry(&iqc->pending,
+						       struct fuse_req, list);
+				clear_bit(FR_PENDING, &req->flags);
+				list_del_init(&req->list);
+			}
+			spin_unlock(&iqc->lock);
+			if (req)
+				return req;
+		}
+
+		cpu = cpumask_next(cpu, cpu_possible_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_possible_mask);
+	} while (cpu != this_cpu);
+
+	return NULL;
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -365,10 +435,9 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->waitq.lock);
 		req->in.h.unique = fuse_get_unique(fiq);
-		queue_request(fiq, req);
-		spin_unlock(&fiq->waitq.lock);
+		/* fiq->connected is cleared after the last flush on abort */
+		WARN_ON_ONCE(!queue_request(fiq, req));
 	}
 }
 
@@ -461,21 +530,24 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 	if (!test_bit(FR_FORCE, &req->flags)) {
 		/* Only fatal signals may interrupt this */
+		struct fuse_iqueue_cpu *iqc;
+
 		err = wait_event_killable(req->waitq,
 					test_bit(FR_FINISHED, &req->flags));
 		if (!err)
 			return;
 
-		spin_lock(&fiq->waitq.lock);
+		iqc = per_cpu_ptr(fiq->queues, req->iq_cpu);
+		spin_lock(&iqc->lock);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
-			spin_unlock(&fiq->waitq.lock);
+			spin_unlock(&iqc->lock);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
 		}
-		spin_unlock(&fiq->waitq.lock);
+		spin_unlock(&iqc->lock);
 	}
 
 	/*
@@ -490,18 +562,14 @@ static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_iqueue *fiq = &fc->iq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->waitq.lock);
-	if (!fiq->connected) {
-		spin_unlock(&fiq->waitq.lock);
+	req->in.h.unique = fuse_get_unique(fiq);
+	/* acquire extra reference, since request is still needed
+	   after request_end() */
+	__fuse_get_request(req);
+	if (!queue_request(fiq, req)) {
+		__fuse_put_request(req);
 		req->out.h.error = -ENOTCONN;
 	} else {
-		req->in.h.unique = fuse_get_unique(fiq);
-		queue_request(fiq, req);
-		/* acquire extra reference, since request is still needed
-		   after request_end() */
-		__fuse_get_request(req);
-		spin_unlock(&fiq->waitq.lock);
-
 		request_wait_answer(fc, req);
 		/* Pairs with smp_wmb() in request_end() */
 		smp_rmb();
@@ -633,12 +701,8 @@ static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 
 	__clear_bit(FR_ISREPLY, &req->flags);
 	req->in.h.unique = unique;
-	spin_lock(&fiq->waitq.lock);
-	if (fiq->connected) {
-		queue_request(fiq, req);
+	if (queue_request(fiq, req))
 		err = 0;
-	}
-	spin_unlock(&fiq->waitq.lock);
 
 	return err;
 }
@@ -1072,8 +1136,41 @@ static int forget_pending(struct fuse_iqueue *fiq)
 
 static int request_pending(struct fuse_iqueue *fiq)
 {
-	return !list_empty(&fiq->pending) || !list_empty(&fiq->interrupts) ||
-		forget_pending(fiq);
+	return !list_empty(&fiq->interrupts) || forget_pending(fiq) ||
+		requests_pending(fiq);
+}
+
+/*
+ * Like wait_event_interruptible_exclusive_locked(), but the condition is
+ * checked after the waiter is on fiq->waitq: requests are queued without
+ * fiq->waitq.lock, and queue_request() only wakes readers it sees waiting.
+ *
+ * Called with fiq->waitq.lock held, returns with it held
+ */
+static int fuse_wait_request(struct fuse_iqueue *fiq)
+{
+	DEFINE_WAIT(wait);
+	int err = 0;
+
+	wait.flags |= WQ_FLAG_EXCLUSIVE;
+	for (;;) {
+		if (list_empty(&wait.entry))
+			__add_wait_queue_entry_tail(&fiq->waitq, &wait);
+		/* matches barrier in queue_request() */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!fiq->connected || request_pending(fiq))
+			break;
+		if (signal_pending(current)) {
+			err = -ERESTARTSYS;
+			break;
+		}
+		spin_unlock(&fiq->waitq.lock);
+		schedule();
+		spin_lock(&fiq->waitq.lock);
+	}
+	__remove_wait_queue(&fiq->waitq, &wait);
+	__set_current_state(TASK_RUNNING);
+	return err;
 }
 
 /*
@@ -1251,14 +1348,24 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	unsigned reqsize;
 
  restart:
+	/*
+	 * Interrupts and forgets go first; without any, a request is taken
+	 * without fiq->waitq.lock.  A racy check is fine, it only affects
+	 * which of them is read first.
+	 */
+	if (list_empty(&fiq->interrupts) && !forget_pending(fiq)) {
+		req = dequeue_request(fiq);
+		if (req)
+			goto found;
+	}
+
 	spin_lock(&fiq->waitq.lock);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fiq->connected &&
 	    !request_pending(fiq))
 		goto err_unlock;
 
-	err = wait_event_interruptible_exclusive_locked(fiq->waitq,
-				!fiq->connected || request_pending(fiq));
+	err = fuse_wait_request(fiq);
 	if (err)
 		goto err_unlock;
 
@@ -1274,18 +1381,20 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	}
 
 	if (forget_pending(fiq)) {
-		if (list_empty(&fiq->pending) || fiq->forget_batch-- > 0)
+		if (!requests_pending(fiq) || fiq->forget_batch-- > 0)
 			return fuse_read_forget(fc, fiq, cs, nbytes);
 
 		if (fiq->forget_batch <= -8)
 			fiq->forget_batch = 16;
 	}
-
-	req = list_entry(fiq->pending.next, struct fuse_req, list);
-	clear_bit(FR_PENDING, &req->flags);
-	list_del_init(&req->list);
 	spin_unlock(&fiq->waitq.lock);
 
+	/* Another reader may have taken it */
+	req = dequeue_request(fiq);
+	if (!req)
+		goto restart;
+
+ found:
 	in = &req->in;
 	reqsize = in->h.len;
 
@@ -1688,7 +1797,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		num = file_size - outarg->offset;
 
 	num_pages = (num + offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
-	num_pages = min(num_pages, FUSE_MAX_PAGES_PER_REQ);
+	num_pages = min_t(unsigned int, num_pages, fc->max_pages);
 
 	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
@@ -2053,6 +2162,8 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 
 	fiq = &fud->fc->iq;
 	poll_wait(file, &fiq->waitq, wait);
+	/* matches barrier in queue_request() */
+	smp_mb();
 
 	spin_lock(&fiq->waitq.lock);
 	if (!fiq->connected)
@@ -2123,6 +2234,7 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 		struct fuse_dev *fud;
 		struct fuse_req *req, *next;
 		LIST_HEAD(to_end);
+		int cpu;
 
 		fc->connected = 0;
 		fc->blocked = 0;
@@ -2152,9 +2264,16 @@ void fuse_abort_conn(struct fuse_conn *fc, bool is_abort)
 
 		spin_lock(&fiq->waitq.lock);
 		fiq->connected = 0;
-		list_for_each_entry(req, &fiq->pending, list)
-			clear_bit(FR_PENDING, &req->flags);
-		list_splice_tail_init(&fiq->pending, &to_end);
+		for_each_possible_cpu(cpu) {
+			struct fuse_iqueue_cpu *iqc;
+
+			iqc = per_cpu_ptr(fiq->queues, cpu);
+			spin_lock(&iqc->lock);
+			list_for_each_entry(req, &iqc->pending, list)
+				clear_bit(FR_PENDING, &req->flags);
+			list_splice_tail_init(&iqc->pending, &to_end);
+			spin_unlock(&iqc->lock);
+		}
 		while (forget_pending(fiq))
 			kfree(dequeue_forget(fiq, 1, NULL));
 		wake_up_all_locked(&fiq->waitq);
@@ -2265,6 +2384,17 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN) {
+		struct fuse_passthrough_out pto;
+		struct fuse_dev *fud = fuse_get_dev(file);
+
+		err = -EFAULT;
+		if (!copy_from_user(&pto, (void __user *) arg, sizeof(pto))) {
+			err = -EINVAL;
+			/* Not for CUSE, which shares this handler */
+			if (fud && file->f_op == &fuse_dev_operations)
+				err = fuse_passthrough_open(fud, &pto);
+		}
 	}
 	return err;
 }
@@ -27,9 +27,15 @@
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
 #include <linux/user_namespace.h>
+#include <linux/idr.h>
+#include <linux/percpu.h>
+#include <linux/cred.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single read request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Maximum of max_pages received in init_out */
+#define FUSE_MAX_MAX_PAGES 1024
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -43,6 +49,43 @@
 /** Number of page pointers embedded in fuse_req */
 #define FUSE_REQ_INLINE_PAGES 1
 
+/*
+ * Passthrough of file I/O, not part of the protocol headers yet.  The
+ * daemon registers a backing file with FUSE_DEV_IOC_PASSTHROUGH_OPEN and
+ * returns the id it got in the padding of fuse_open_out; non-zero means
+ * read, write and mmap of the opened file go to the backing file.
+ */
+#ifndef FUSE_PASSTHROUGH
+#define FUSE_PASSTHROUGH	(1 << 31)
+
+struct fuse_passthrough_out {
+	uint32_t	fd;
+	uint32_t	flags;	/* must be zero */
+};
+
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN \
+	_IOW(FUSE_DEV_IOC_MAGIC, 126, struct fuse_passthrough_out)
+#endif
+
+/*
+ * Request size negotiation of protocol 7.28: with FUSE_MAX_PAGES set in
+ * the INIT reply, its max_pages, the first 16 bits of what 7.27 calls
+ * unused[0], bounds the pages of one request.
+ */
+#ifndef FUSE_MAX_PAGES
+#define FUSE_MAX_PAGES		(1 << 22)
+
+static inline u16 fuse_init_out_max_pages(struct fuse_init_out *arg)
+{
+	return *(u16 *)arg->unused;
+}
+#else
+static inline u16 fuse_init_out_max_pages(struct fuse_init_out *arg)
+{
+	return arg->max_pages;
+}
+#endif
+
 /** List of active connections */
 extern struct list_head fuse_conn_list;
 
@@ -122,6 +165,15 @@ enum {
 
 struct fuse_conn;
 
+/** Backing file of a passthrough open */
+struct fuse_passthrough {
+	/** File on the lower filesystem, or NULL */
+	struct file *filp;
+
+	/** Credentials of the daemon which registered it */
+	const struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -156,6 +208,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** I/O goes straight to this file if set */
+	struct fuse_passthrough passthrough;
 };
 
 /** One input argument of a request */
@@ -308,6 +363,9 @@ struct fuse_req {
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
+	/** CPU whose input queue the request was queued on */
+	unsigned int iq_cpu;
+
 	/** refcount */
 	refcount_t count;
 
@@ -384,6 +442,20 @@ struct fuse_req {
 	struct file *stolen_file;
 };
 
+/*
+ * Requests are queued on the input queue of the submitting CPU, so that
+ * submitters on different CPUs don't contend on one lock.  Readers take
+ * requests from the queue of their own CPU first and steal from the others
+ * when it is empty.
+ */
+struct fuse_iqueue_cpu {
+	/** Lock protecting pending */
+	spinlock_t lock;
+
+	/** The list of pending requests */
+	struct list_head pending;
+} ____cacheline_aligned_in_smp;
+
 struct fuse_iqueue {
 	/** Connection established */
 	unsigned connected;
@@ -392,10 +464,10 @@ struct fuse_iqueue {
 	wait_queue_head_t waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Per-CPU lists of pending requests */
+	struct fuse_iqueue_cpu __percpu *queues;
 
 	/** Pending interrupts */
 	struct list_head interrupts;
@@ -476,6 +548,9 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages that can be used in a single request */
+	unsigned int max_pages;
+
 	/** Input queue */
 	struct fuse_iqueue iq;
 
@@ -637,6 +712,9 @@ struct fuse_conn {
 	/** Allow other than the mounter user to access the filesystem ? */
 	unsigned allow_other:1;
 
+	/** Can opens pass file I/O through to a backing file? */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -658,6 +736,12 @@ struct fuse_conn {
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
+	/** Backing files registered, but not yet claimed by an open */
+	struct idr passthrough_req;
+
+	/** Protects passthrough_req */
+	spinlock_t passthrough_req_lock;
+
 	/** Reserved request for the DESTROY message */
 	struct fuse_req *destroy_req;
 
@@ -881,7 +965,7 @@ struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc, struct user_namespace *user_ns);
+int fuse_conn_init(struct fuse_conn *fc, struct user_namespace *user_ns);
 
 /**
  * Release reference to fuse_conn
@@ -992,4 +1076,16 @@ struct posix_acl;
 struct posix_acl *fuse_get_acl(struct inode *inode, int type);
 int fuse_set_acl(struct inode *inode, struct posix_acl *acl, int type);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_dev *fud,
+			  struct fuse_passthrough_out *pto);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+void fuse_passthrough_free_reqs(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb,
+				    struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
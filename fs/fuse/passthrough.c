@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+  FUSE: Filesystem in Userspace
+
+  Passthrough of file I/O to a backing file on a lower filesystem.  A
+  daemon which would only forward reads and writes of a file to a file of
+  its own hands that file over at open, and read, write and mmap then go
+  to it without a round trip to userspace.  Everything else, flush, fsync,
+  setattr and release included, still goes to the daemon.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/idr.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+/**
+ * fuse_passthrough_open() - register the backing file of an open to come
+ * @fud: fuse device the daemon issued FUSE_DEV_IOC_PASSTHROUGH_OPEN on
+ * @pto: the file descriptor of the backing file
+ *
+ * Returns the id to reply to the open with, or a negative errno.
+ */
+int fuse_passthrough_open(struct fuse_dev *fud,
+			  struct fuse_passthrough_out *pto)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_passthrough *passthrough;
+	struct file *passthrough_filp;
+	int res;
+
+	if (!fc->passthrough)
+		return -EPERM;
+	if (pto->flags)
+		return -EINVAL;
+
+	passthrough_filp = fget(pto->fd);
+	if (!passthrough_filp)
+		return -EBADF;
+
+	res = -EBADF;
+	if (!passthrough_filp->f_op->read_iter ||
+	    !passthrough_filp->f_op->write_iter)
+		goto out_fput;
+
+	/* Neither another fuse mount nor anything stacked too deep */
+	res = -EINVAL;
+	if (file_inode(passthrough_filp)->i_sb->s_stack_depth >=
+	    FILESYSTEM_MAX_STACK_DEPTH)
+		goto out_fput;
+
+	res = -ENOMEM;
+	passthrough = kmalloc(sizeof(*passthrough), GFP_KERNEL);
+	if (!passthrough)
+		goto out_fput;
+	passthrough->filp = passthrough_filp;
+	passthrough->cred = get_current_cred();
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->passthrough_req_lock);
+	res = idr_alloc(&fc->passthrough_req, passthrough, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->passthrough_req_lock);
+	idr_preload_end();
+	if (res > 0)
+		return res;
+
+	put_cred(passthrough->cred);
+	kfree(passthrough);
+out_fput:
+	fput(passthrough_filp);
+	return res;
+}
+
+/*
+ * Claim the backing file the daemon's reply to an open names.  An unknown
+ * id leaves the file on the regular I/O path.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg)
+{
+	struct fuse_passthrough *passthrough;
+	int id = openarg->padding;
+
+	if (!fc->passthrough || id <= 0)
+		return;
+
+	spin_lock(&fc->passthrough_req_lock);
+	passthrough = idr_remove(&fc->passthrough_req, id);
+	spin_unlock(&fc->passthrough_req_lock);
+	if (!passthrough)
+		return;
+
+	ff->passthrough = *passthrough;
+	kfree(passthrough);
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough)
+{
+	if (passthrough->filp) {
+		fput(passthrough->filp);
+		passthrough->filp = NULL;
+	}
+	if (passthrough->cred) {
+		put_cred(passthrough->cred);
+		passthrough->cred = NULL;
+	}
+}
+
+static int fuse_passthrough_free_req(int id, void *p, void *data)
+{
+	struct fuse_passthrough *passthrough = p;
+
+	fuse_passthrough_release(passthrough);
+	kfree(passthrough);
+	return 0;
+}
+
+/* Drop the backing files no open claimed */
+void fuse_passthrough_free_reqs(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_req, NULL);
+	idr_destroy(&fc->passthrough_req);
+}
+
+static rwf_t fuse_iocb_to_rwf(struct kiocb *iocb)
+{
+	int ifl = iocb->ki_flags;
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *passthrough_filp = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = vfs_iter_read(passthrough_filp, to, &iocb->ki_pos,
+			    fuse_iocb_to_rwf(iocb));
+	revert_creds(old_cred);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb,
+				    struct iov_iter *from)
+{
+	struct file *fuse_filp = iocb->ki_filp;
+	struct fuse_file *ff = fuse_filp->private_data;
+	struct inode *fuse_inode = file_inode(fuse_filp);
+	struct file *passthrough_filp = ff->passthrough.filp;
+	struct inode *passthrough_inode = file_inode(passthrough_filp);
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	inode_lock(fuse_inode);
+	if (iocb->ki_flags & IOCB_APPEND)
+		iocb->ki_pos = i_size_read(passthrough_inode);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	file_start_write(passthrough_filp);
+	ret = vfs_iter_write(passthrough_filp, from, &iocb->ki_pos,
+			     fuse_iocb_to_rwf(iocb));
+	file_end_write(passthrough_filp);
+	revert_creds(old_cred);
+
+	if (ret > 0)
+		fuse_write_update_size(fuse_inode, iocb->ki_pos);
+	/* The daemon is asked for the new times when they're needed */
+	fuse_invalidate_attr(fuse_inode);
+	inode_unlock(fuse_inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *passthrough_filp = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!passthrough_filp->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(passthrough_filp);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* Drop reference count from new vm_file value */
+		fput(passthrough_filp);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	return ret;
+}
@@ -187,11 +187,12 @@ static int journal_wait_on_commit_record(journal_t *journal,
  * use writepages() because with dealyed allocation we may be doing
  * block allocation in writepages().
  */
-static int journal_submit_inode_data_buffers(struct address_space *mapping)
+static int journal_submit_inode_data_buffers(struct address_space *mapping,
+		enum writeback_sync_modes sync_mode)
 {
 	int ret;
 	struct writeback_control wbc = {
-		.sync_mode =  WB_SYNC_ALL,
+		.sync_mode =  sync_mode,
 		.nr_to_write = mapping->nrpages * 2,
 		.range_start = 0,
 		.range_end = i_size_read(mapping->host),
@@ -230,7 +231,7 @@ static int journal_submit_data_buffers(journal_t *journal,
 		 * only allocated blocks here.
 		 */
 		trace_jbd2_submit_inode_data(jinode->i_vfs_inode);
-		err = journal_submit_inode_data_buffers(mapping);
+		err = journal_submit_inode_data_buffers(mapping, WB_SYNC_ALL);
 		if (!ret)
 			ret = err;
 		spin_lock(&journal->j_list_lock);
@@ -243,6 +244,76 @@ static int journal_submit_data_buffers(journal_t *journal,
 	return ret;
 }
 
+/*
+ * Start writing out the data of the running transaction while the commit
+ * record of the committing one is in flight, so that less is left to write
+ * and wait on when it commits. Its metadata can't be logged yet, it's only
+ * refiled to it once this commit is done.
+ *
+ * Only the commit thread commits the running transaction, so it can't go
+ * away under us. Inodes can be added to its list while we write, which is
+ * fine as they are added at the head.
+ */
+static void journal_start_next_data_writeback(journal_t *journal)
+{
+	transaction_t *transaction;
+	struct jbd2_inode *jinode;
+	struct address_space *mapping;
+
+	read_lock(&journal->j_state_lock);
+	transaction = journal->j_running_transaction;
+	read_unlock(&journal->j_state_lock);
+	if (!transaction)
+		return;
+
+	spin_lock(&journal->j_list_lock);
+	list_for_each_entry(jinode, &transaction->t_inode_list, i_list) {
+		if (!(jinode->i_flags & JI_WRITE_DATA))
+			continue;
+		mapping = jinode->i_vfs_inode->i_mapping;
+		if (!mapping_tagged(mapping, PAGECACHE_TAG_DIRTY))
+			continue;
+		jinode->i_flags |= JI_COMMIT_RUNNING;
+		spin_unlock(&journal->j_list_lock);
+		journal_submit_inode_data_buffers(mapping, WB_SYNC_NONE);
+		spin_lock(&journal->j_list_lock);
+		jinode->i_flags &= ~JI_COMMIT_RUNNING;
+		smp_mb();
+		wake_up_bit(&jinode->i_flags, __JI_COMMIT_RUNNING);
+	}
+	spin_unlock(&journal->j_list_lock);
+}
+
+static void journal_account_commit_time(journal_t *journal, u64 commit_time,
+					u64 commit_record_time)
+{
+	int bucket = 0;
+	u64 limit = 64 * NSEC_PER_USEC;
+
+	/*
+	 * weight the commit time higher than the average time so we don't
+	 * react too strongly to vast changes in the commit time
+	 */
+	if (likely(journal->j_average_commit_time))
+		journal->j_average_commit_time = (commit_time +
+				journal->j_average_commit_time*3) / 4;
+	else
+		journal->j_average_commit_time = commit_time;
+	if (likely(journal->j_average_commit_record_time))
+		journal->j_average_commit_record_time = (commit_record_time +
+				journal->j_average_commit_record_time*3) / 4;
+	else
+		journal->j_average_commit_record_time = commit_record_time;
+
+	if (commit_time > journal->j_max_commit_time)
+		journal->j_max_commit_time = commit_time;
+	while (bucket < JBD2_COMMIT_HIST_BUCKETS - 1 && commit_time >= limit) {
+		bucket++;
+		limit *= 4;
+	}
+	journal->j_commit_time_hist[bucket]++;
+}
+
 /*
  * Wait for data submitted for writeout, refile inodes to proper
  * transaction if needed.
@@ -352,8 +423,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	int flags;
 	int err;
 	unsigned long long blocknr;
-	ktime_t start_time;
-	u64 commit_time;
+	ktime_t start_time, record_start_time;
+	u64 commit_time, commit_record_time;
 	char *tagp = NULL;
 	journal_block_tag_t *tag = NULL;
 	int space_left = 0;
@@ -765,6 +836,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
 
 	/* Done it all: now write the commit record asynchronously. */
+	record_start_time = ktime_get();
 	if (jbd2_has_feature_async_commit(journal)) {
 		err = journal_submit_commit_record(journal, commit_transaction,
 						 &cbh, crc32_sum);
@@ -857,17 +929,27 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	write_unlock(&journal->j_state_lock);
 
 	if (!jbd2_has_feature_async_commit(journal)) {
+		record_start_time = ktime_get();
 		err = journal_submit_commit_record(journal, commit_transaction,
 						&cbh, crc32_sum);
 		if (err)
 			__jbd2_journal_abort_hard(journal);
 	}
-	if (cbh)
+	if (cbh) {
+		ktime_t wb_start_time = ktime_get();
+
+		journal_start_next_data_writeback(journal);
+		/* Data writeback, leave it out of commit_record_time */
+		record_start_time = ktime_add(record_start_time,
+				ktime_sub(ktime_get(), wb_start_time));
 		err = journal_wait_on_commit_record(journal, cbh);
+	}
 	if (jbd2_has_feature_async_commit(journal) &&
 	    journal->j_flags & JBD2_BARRIER) {
 		blkdev_issue_flush(journal->j_dev, GFP_NOFS, NULL);
 	}
+	commit_record_time = ktime_to_ns(ktime_sub(ktime_get(),
+						   record_start_time));
 
 	if (err)
 		jbd2_journal_abort(journal, err);
@@ -1077,16 +1159,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
 	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
-
-	/*
-	 * weight the commit time higher than the average time so we don't
-	 * react too strongly to vast changes in the commit time
-	 */
-	if (likely(journal->j_average_commit_time))
-		journal->j_average_commit_time = (commit_time +
-				journal->j_average_commit_time*3) / 4;
-	else
-		journal->j_average_commit_time = commit_time;
+	journal_account_commit_time(journal, commit_time, commit_record_time);
 
 	write_unlock(&journal->j_state_lock);
 
@@ -77,6 +77,8 @@ EXPORT_SYMBOL(jbd2_journal_init_inode);
 EXPORT_SYMBOL(jbd2_journal_check_used_features);
 EXPORT_SYMBOL(jbd2_journal_check_available_features);
 EXPORT_SYMBOL(jbd2_journal_set_features);
+EXPORT_SYMBOL(jbd2_fc_init);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
 EXPORT_SYMBOL(jbd2_journal_load);
 EXPORT_SYMBOL(jbd2_journal_destroy);
 EXPORT_SYMBOL(jbd2_journal_abort);
@@ -832,6 +834,33 @@ int jbd2_journal_bmap(journal_t *journal, unsigned long blocknr,
 	return err;
 }
 
+/**
+ * jbd2_fc_get_buf() - get the buffer of a fast commit block
+ * @journal: Journal to act on.
+ * @off: Index of the block among the fast commit blocks.
+ *
+ * The buffer isn't read, fast commit blocks are written by the filesystem
+ * with contents of its own. Returns an ERR_PTR() on failure.
+ */
+struct buffer_head *jbd2_fc_get_buf(journal_t *journal, unsigned int off)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	int err;
+
+	if (off >= journal->j_fc_last - journal->j_fc_first)
+		return ERR_PTR(-ENOSPC);
+
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + off, &pblock);
+	if (err)
+		return ERR_PTR(err);
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return ERR_PTR(-ENOMEM);
+	return bh;
+}
+
 /*
  * We play buffer_head aliasing tricks to write data/metadata blocks to
  * the journal without copying their contents, but for journal
@@ -1006,6 +1035,8 @@ static void *jbd2_seq_info_next(struct seq_file *seq, void *v, loff_t *pos)
 static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 {
 	struct jbd2_stats_proc_session *s = seq->private;
+	unsigned long limit;
+	int i;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
@@ -1031,12 +1062,24 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    jiffies_to_msecs(s->stats->run.rs_logging / s->stats->ts_tid));
 	seq_printf(seq, "  %lluus average transaction commit time\n",
 		   div_u64(s->journal->j_average_commit_time, 1000));
+	seq_printf(seq, "  %lluus average commit record time\n",
+		   div_u64(s->journal->j_average_commit_record_time, 1000));
 	seq_printf(seq, "  %lu handles per transaction\n",
 	    s->stats->run.rs_handle_count / s->stats->ts_tid);
 	seq_printf(seq, "  %lu blocks per transaction\n",
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	seq_printf(seq, "  %lluus longest transaction commit time\n",
+		   div_u64(s->journal->j_max_commit_time, 1000));
+	seq_puts(seq, "  commit time histogram:\n");
+	for (i = 0, limit = 64; i < JBD2_COMMIT_HIST_BUCKETS; i++, limit *= 4) {
+		if (i < JBD2_COMMIT_HIST_BUCKETS - 1)
+			seq_printf(seq, "    < %luus: ", limit);
+		else
+			seq_printf(seq, "    >= %luus: ", limit / 4);
+		seq_printf(seq, "%lu\n", s->journal->j_commit_time_hist[i]);
+	}
 	return 0;
 }
 
@@ -1299,13 +1342,29 @@ static void journal_fail_superblock (journal_t *journal)
  * subsequent use.
  */
 
+/*
+ * The fast commit blocks, if any, are at the end of the journal, past the
+ * blocks used for transactions.
+ */
+static void journal_set_fc_layout(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_last = journal->j_fc_last;
+	if (jbd2_has_feature_inode_fc(journal))
+		journal->j_last -= be32_to_cpu(sb->s_num_inode_fc_blks);
+	journal->j_fc_first = journal->j_last;
+}
+
 static int journal_reset(journal_t *journal)
 {
 	journal_superblock_t *sb = journal->j_superblock;
 	unsigned long long first, last;
 
+	journal_set_fc_layout(journal);
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = journal->j_last;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1635,9 +1694,18 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail_sequence = be32_to_cpu(sb->s_sequence);
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
-	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	journal_set_fc_layout(journal);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (jbd2_has_feature_inode_fc(journal) &&
+	    (!sb->s_num_inode_fc_blks ||
+	     be32_to_cpu(sb->s_num_inode_fc_blks) + JBD2_MIN_JOURNAL_BLOCKS >
+	     journal->j_fc_last - journal->j_first)) {
+		printk(KERN_ERR "JBD2: Invalid number of fast commit blocks "
+		       "%u\n", be32_to_cpu(sb->s_num_inode_fc_blks));
+		return -EFSCORRUPTED;
+	}
+
 	return 0;
 }
 
@@ -1960,6 +2028,47 @@ void jbd2_journal_clear_features(journal_t *journal, unsigned long compat,
 }
 EXPORT_SYMBOL(jbd2_journal_clear_features);
 
+/**
+ * int jbd2_fc_init() - Reserve fast commit blocks in a journal
+ * @journal: Journal to act on.
+ * @num_fc_blks: Number of blocks to reserve.
+ *
+ * Sets the fast commit feature and takes its blocks from the end of the
+ * journal. Only to be called on a freshly loaded and thus empty journal,
+ * the superblock is written right away so that recovery wraps the log
+ * where it's wrapped from now on.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int ret;
+
+	if (jbd2_has_feature_inode_fc(journal))
+		return 0;
+
+	if (journal->j_running_transaction ||
+	    journal->j_head != journal->j_tail)
+		return -EBUSY;
+	if (!num_fc_blks || num_fc_blks + JBD2_MIN_JOURNAL_BLOCKS >
+			    journal->j_last - journal->j_first)
+		return -ENOSPC;
+	if (!jbd2_journal_set_features(journal, 0, 0,
+				       JBD2_FEATURE_INCOMPAT_INODE_FC))
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	sb->s_num_inode_fc_blks = cpu_to_be32(num_fc_blks);
+	journal_set_fc_layout(journal);
+	journal->j_free = journal->j_last - journal->j_first;
+	journal->j_head = journal->j_tail = journal->j_first;
+	write_unlock(&journal->j_state_lock);
+
+	mutex_lock_io(&journal->j_checkpoint_mutex);
+	ret = jbd2_write_superblock(journal, REQ_SYNC | REQ_FUA);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+	return ret;
+}
+
 /**
  * int jbd2_journal_flush () - Flush journal
  * @journal: Journal to act on.
@@ -229,6 +229,37 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Hand the fast commit blocks to the filesystem, which replays the ones
+ * made while @expected_tid, the first transaction that didn't commit, was
+ * running. The log restarts past that transaction, so they are never
+ * replayed twice.
+ */
+static int fc_do_one_pass(journal_t *journal, tid_t expected_tid)
+{
+	struct buffer_head *bh;
+	unsigned int off;
+	int err = 0;
+
+	if (!jbd2_has_feature_inode_fc(journal) ||
+	    !journal->j_fc_replay_callback)
+		return 0;
+
+	for (off = 0; journal->j_fc_first + off < journal->j_fc_last; off++) {
+		err = jread(&bh, journal, journal->j_fc_first + off);
+		if (err)
+			break;
+		err = journal->j_fc_replay_callback(journal, bh, off,
+						    expected_tid);
+		brelse(bh);
+		if (err <= 0)
+			break;
+	}
+	jbd_debug(1, "JBD2: fast commit recovery, %u blocks, status %d\n",
+		  off, err);
+	return err < 0 ? err : 0;
+}
+
 /**
  * jbd2_journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -254,14 +285,23 @@ int jbd2_journal_recover(journal_t *journal)
 	/*
 	 * The journal superblock's s_start field (the current log head)
 	 * is always zero if, and only if, the journal was cleanly
-	 * unmounted.
+	 * unmounted.  Fast commits made after the log was emptied may still
+	 * have to be replayed, under the transaction that was running then.
 	 */
 
 	if (!sb->s_start) {
 		jbd_debug(1, "No recovery required, last transaction %d\n",
 			  be32_to_cpu(sb->s_sequence));
 		journal->j_transaction_sequence = be32_to_cpu(sb->s_sequence) + 1;
-		return 0;
+		if (!jbd2_has_feature_inode_fc(journal))
+			return 0;
+		err = fc_do_one_pass(journal, be32_to_cpu(sb->s_sequence));
+		if (!err)
+			err = sync_blockdev(journal->j_fs_dev);
+		if (!err && (journal->j_flags & JBD2_BARRIER))
+			err = blkdev_issue_flush(journal->j_fs_dev, GFP_KERNEL,
+						 NULL);
+		return err;
 	}
 
 	err = do_one_pass(journal, &info, PASS_SCAN);
@@ -269,6 +309,8 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err)
+		err = fc_do_one_pass(journal, info.end_transaction);
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
@@ -25,10 +25,26 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	old = FANOTIFY_E(old_fsn);
 	new = FANOTIFY_E(new_fsn);
 
-	if (old_fsn->inode == new_fsn->inode && old->tgid == new->tgid &&
-	    old->path.mnt == new->path.mnt &&
-	    old->path.dentry == new->path.dentry)
-		return true;
+	if (old_fsn->inode != new_fsn->inode || old->tgid != new->tgid ||
+	    old->fh_type != new->fh_type || old->fh_len != new->fh_len)
+		return false;
+
+	if (fanotify_event_has_path(old)) {
+		return old->path.mnt == new->path.mnt &&
+			old->path.dentry == new->path.dentry;
+	} else if (fanotify_event_has_fid(old)) {
+		/*
+		 * Merge the entry events of a directory, but not those about
+		 * subdirectories with those about other entries, or a mask of
+		 * FAN_CREATE | FAN_DELETE | FAN_ONDIR could be a mkdir and an
+		 * unlink as well as a create and an rmdir.
+		 */
+		return (old_fsn->mask & FS_ISDIR) ==
+			(new_fsn->mask & FS_ISDIR) &&
+			fanotify_fid_equal(&old->fid, &new->fid, old->fh_len);
+	}
+
+	/* Do not merge events if we failed to encode fid */
 	return false;
 }
 
@@ -89,26 +105,44 @@ static int fanotify_get_response(struct fsnotify_group *group,
 	return ret;
 }
 
-static bool fanotify_should_send_event(struct fsnotify_iter_info *iter_info,
+static struct inode *fanotify_data_inode(const void *data, int data_type)
+{
+	if (data_type == FSNOTIFY_EVENT_PATH)
+		return d_inode(((const struct path *)data)->dentry);
+	else if (data_type == FSNOTIFY_EVENT_INODE)
+		return (struct inode *)data;
+	return NULL;
+}
+
+static bool fanotify_should_send_event(struct fsnotify_group *group,
+				       struct fsnotify_iter_info *iter_info,
 				       u32 event_mask, const void *data,
 				       int data_type)
 {
 	__u32 marks_mask = 0, marks_ignored_mask = 0;
 	const struct path *path = data;
 	struct fsnotify_mark *mark;
+	bool ondir;
 	int type;
 
 	pr_debug("%s: report_mask=%x mask=%x data=%p data_type=%d\n",
 		 __func__, iter_info->report_mask, event_mask, data, data_type);
 
-	/* if we don't have enough info to send an event to userspace say no */
-	if (data_type != FSNOTIFY_EVENT_PATH)
-		return false;
+	if (!FAN_GROUP_FLAG(group, FAN_REPORT_FID)) {
+		/* without a path there is no fd to send userspace */
+		if (data_type != FSNOTIFY_EVENT_PATH)
+			return false;
 
-	/* sorry, fanotify only gives a damn about files and dirs */
-	if (!d_is_reg(path->dentry) &&
-	    !d_can_lookup(path->dentry))
-		return false;
+		/* sorry, fanotify only gives a damn about files and dirs */
+		if (!d_is_reg(path->dentry) &&
+		    !d_can_lookup(path->dentry))
+			return false;
+
+		ondir = d_is_dir(path->dentry);
+	} else {
+		/* Set by fanotify_handle_event() for all directories */
+		ondir = event_mask & FS_ISDIR;
+	}
 
 	fsnotify_foreach_obj_type(type) {
 		if (!fsnotify_iter_should_report_type(iter_info, type))
@@ -127,22 +161,85 @@ static bool fanotify_should_send_event(struct fsnotify_iter_info *iter_info,
 		marks_ignored_mask |= mark->ignored_mask;
 	}
 
-	if (d_is_dir(path->dentry) &&
-	    !(marks_mask & FS_ISDIR & ~marks_ignored_mask))
+	if (ondir && !(marks_mask & FS_ISDIR & ~marks_ignored_mask))
 		return false;
 
-	if (event_mask & FAN_ALL_OUTGOING_EVENTS & marks_mask &
+	if (event_mask & FANOTIFY_OUTGOING_EVENTS & marks_mask &
 				 ~marks_ignored_mask)
 		return true;
 
 	return false;
 }
 
+static int fanotify_encode_fid(struct fanotify_event_info *event,
+			       struct inode *inode, gfp_t gfp,
+			       __kernel_fsid_t *fsid)
+{
+	struct fanotify_fid *fid = &event->fid;
+	int dwords = 0, bytes;
+	int err, type;
+
+	fid->ext_fh = NULL;
+	err = -ENOENT;
+	type = exportfs_encode_inode_fh(inode, NULL, &dwords, NULL);
+	if (!dwords)
+		goto out_err;
+
+	bytes = dwords << 2;
+	err = -EINVAL;
+	if (bytes > U8_MAX)
+		goto out_err;
+	if (bytes > FANOTIFY_INLINE_FH_LEN) {
+		/* Treat failure to allocate fh as failure to allocate event */
+		err = -ENOMEM;
+		fid->ext_fh = kmalloc(bytes, gfp);
+		if (!fid->ext_fh)
+			goto out_err;
+	}
+
+	type = exportfs_encode_inode_fh(inode, fanotify_fid_fh(fid, bytes),
+					&dwords, NULL);
+	err = -EINVAL;
+	if (!type || type == FILEID_INVALID || bytes != dwords << 2)
+		goto out_free;
+
+	fid->fsid = *fsid;
+	event->fh_len = bytes;
+
+	return type;
+
+out_free:
+	if (bytes > FANOTIFY_INLINE_FH_LEN)
+		kfree(fid->ext_fh);
+out_err:
+	pr_warn_ratelimited("fanotify: failed to encode fid (fsid=%x.%x, type=%d, bytes=%d, err=%i)\n",
+			    fsid->val[0], fsid->val[1], type, dwords << 2,
+			    err);
+	fid->fsid.val[0] = fid->fsid.val[1] = 0;
+	event->fh_len = 0;
+
+	return FILEID_INVALID;
+}
+
+/*
+ * The inode to identify the event by with FAN_REPORT_FID: the directory for
+ * the events about its entries, the object itself for the other events.
+ */
+static struct inode *fanotify_fid_inode(struct inode *to_tell, u32 event_mask,
+					const void *data, int data_type)
+{
+	if (event_mask & ALL_FSNOTIFY_DIRENT_EVENTS)
+		return to_tell;
+	return fanotify_data_inode(data, data_type);
+}
+
 struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 						 struct inode *inode, u32 mask,
-						 const struct path *path)
+						 const void *data, int data_type,
+						 __kernel_fsid_t *fsid)
 {
 	struct fanotify_event_info *event = NULL;
+	struct inode *id = fanotify_fid_inode(inode, mask, data, data_type);
 	gfp_t gfp = GFP_KERNEL_ACCOUNT;
 
 	/*
@@ -172,10 +269,16 @@ struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 init: __maybe_unused
 	fsnotify_init_event(&event->fse, inode, mask);
 	event->tgid = get_pid(task_tgid(current));
-	if (path) {
-		event->path = *path;
+	event->fh_len = 0;
+	if (id && FAN_GROUP_FLAG(group, FAN_REPORT_FID)) {
+		/* Report the event without a file identifier on encode error */
+		event->fh_type = fanotify_encode_fid(event, id, gfp, fsid);
+	} else if (data_type == FSNOTIFY_EVENT_PATH) {
+		event->fh_type = FILEID_ROOT;
+		event->path = *((const struct path *)data);
 		path_get(&event->path);
 	} else {
+		event->fh_type = FILEID_ROOT;
 		event->path.mnt = NULL;
 		event->path.dentry = NULL;
 	}
@@ -184,6 +287,24 @@ init: __maybe_unused
 	return event;
 }
 
+/* The fsid of the object, as remembered by the marks reporting the event */
+static __kernel_fsid_t fanotify_get_fsid(struct fsnotify_iter_info *iter_info)
+{
+	__kernel_fsid_t fsid = {};
+	int type;
+
+	fsnotify_foreach_obj_type(type) {
+		if (!fsnotify_iter_should_report_type(iter_info, type))
+			continue;
+
+		fsid = FANOTIFY_MARK(iter_info->marks[type])->fsid;
+		if (fsid.val[0] || fsid.val[1])
+			break;
+	}
+
+	return fsid;
+}
+
 static int fanotify_handle_event(struct fsnotify_group *group,
 				 struct inode *inode,
 				 u32 mask, const void *data, int data_type,
@@ -193,19 +314,40 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	int ret = 0;
 	struct fanotify_event_info *event;
 	struct fsnotify_event *fsn_event;
+	__kernel_fsid_t fsid = {};
 
 	BUILD_BUG_ON(FAN_ACCESS != FS_ACCESS);
 	BUILD_BUG_ON(FAN_MODIFY != FS_MODIFY);
+	BUILD_BUG_ON(FAN_ATTRIB != FS_ATTRIB);
 	BUILD_BUG_ON(FAN_CLOSE_NOWRITE != FS_CLOSE_NOWRITE);
 	BUILD_BUG_ON(FAN_CLOSE_WRITE != FS_CLOSE_WRITE);
 	BUILD_BUG_ON(FAN_OPEN != FS_OPEN);
+	BUILD_BUG_ON(FAN_MOVED_TO != FS_MOVED_TO);
+	BUILD_BUG_ON(FAN_MOVED_FROM != FS_MOVED_FROM);
+	BUILD_BUG_ON(FAN_CREATE != FS_CREATE);
+	BUILD_BUG_ON(FAN_DELETE != FS_DELETE);
+	BUILD_BUG_ON(FAN_DELETE_SELF != FS_DELETE_SELF);
+	BUILD_BUG_ON(FAN_MOVE_SELF != FS_MOVE_SELF);
 	BUILD_BUG_ON(FAN_EVENT_ON_CHILD != FS_EVENT_ON_CHILD);
 	BUILD_BUG_ON(FAN_Q_OVERFLOW != FS_Q_OVERFLOW);
 	BUILD_BUG_ON(FAN_OPEN_PERM != FS_OPEN_PERM);
 	BUILD_BUG_ON(FAN_ACCESS_PERM != FS_ACCESS_PERM);
 	BUILD_BUG_ON(FAN_ONDIR != FS_ISDIR);
 
-	if (!fanotify_should_send_event(iter_info, mask, data, data_type))
+	if (FAN_GROUP_FLAG(group, FAN_REPORT_FID)) {
+		struct inode *obj = fanotify_data_inode(data, data_type);
+
+		/*
+		 * Not all hooks flag the events on directories, and the inode
+		 * of a removed entry may already be gone, so FS_ISDIR is set
+		 * here from what is known.
+		 */
+		if (obj && S_ISDIR(obj->i_mode))
+			mask |= FS_ISDIR;
+	}
+
+	if (!fanotify_should_send_event(group, iter_info, mask, data,
+					data_type))
 		return 0;
 
 	pr_debug("%s: group=%p inode=%p mask=%x\n", __func__, group, inode,
@@ -220,7 +362,11 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 			return 0;
 	}
 
-	event = fanotify_alloc_event(group, inode, mask, data);
+	if (FAN_GROUP_FLAG(group, FAN_REPORT_FID))
+		fsid = fanotify_get_fsid(iter_info);
+
+	event = fanotify_alloc_event(group, inode, mask, data, data_type,
+				     &fsid);
 	ret = -ENOMEM;
 	if (unlikely(!event)) {
 		/*
@@ -267,7 +413,10 @@ static void fanotify_free_event(struct fsnotify_event *fsn_event)
 	struct fanotify_event_info *event;
 
 	event = FANOTIFY_E(fsn_event);
-	path_put(&event->path);
+	if (fanotify_event_has_path(event))
+		path_put(&event->path);
+	else if (fanotify_event_has_ext_fh(event))
+		kfree(event->fid.ext_fh);
 	put_pid(event->tgid);
 	if (fanotify_is_perm_event(fsn_event->mask)) {
 		kmem_cache_free(fanotify_perm_event_cachep,
@@ -279,7 +428,7 @@ static void fanotify_free_event(struct fsnotify_event *fsn_event)
 
 static void fanotify_free_mark(struct fsnotify_mark *fsn_mark)
 {
-	kmem_cache_free(fanotify_mark_cache, fsn_mark);
+	kmem_cache_free(fanotify_mark_cache, FANOTIFY_MARK(fsn_mark));
 }
 
 const struct fsnotify_ops fanotify_fsnotify_ops = {
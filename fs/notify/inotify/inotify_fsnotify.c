@@ -55,13 +55,54 @@ static bool event_compare(struct fsnotify_event *old_fsn,
 	return false;
 }
 
+/*
+ * How far back in the queue a repeated event may be merged.  Repeated
+ * modify and access events of many files written at once interleave in
+ * the queue, so they're merged with the last one of the same file, not
+ * only with the last event queued.
+ */
+#define INOTIFY_MERGE_DEPTH	128
+#define INOTIFY_MERGE_MASK	(IN_MODIFY | IN_ACCESS)
+
+/*
+ * Check if 2 events are for the same file of the same watch.
+ */
+static bool event_same_file(struct fsnotify_event *old_fsn,
+			    struct fsnotify_event *new_fsn)
+{
+	struct inotify_event_info *old, *new;
+
+	old = INOTIFY_E(old_fsn);
+	new = INOTIFY_E(new_fsn);
+	return (old_fsn->inode == new_fsn->inode) &&
+	       (old->name_len == new->name_len) &&
+	       (!old->name_len || !strcmp(old->name, new->name));
+}
+
 static int inotify_merge(struct list_head *list,
 			  struct fsnotify_event *event)
 {
 	struct fsnotify_event *last_event;
+	int depth = 0;
 
 	last_event = list_entry(list->prev, struct fsnotify_event, list);
-	return event_compare(last_event, event);
+	if (event_compare(last_event, event))
+		return 1;
+	if (event->mask & ~(INOTIFY_MERGE_MASK | IN_ISDIR))
+		return 0;
+
+	/*
+	 * Any other event of the same file in between, or the removal of
+	 * a watch, keeps the order of the events of that file as it is.
+	 */
+	list_for_each_entry_reverse(last_event, list, list) {
+		if (++depth > INOTIFY_MERGE_DEPTH ||
+		    last_event->mask & FS_IN_IGNORED)
+			break;
+		if (event_same_file(last_event, event))
+			return last_event->mask == event->mask;
+	}
+	return 0;
 }
 
 int inotify_handle_event(struct fsnotify_group *group,
@@ -20,6 +20,7 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 {
 	int err;
 	bool full_copy_up = false;
+	int copy_up_flags = O_WRONLY;
 	struct dentry *upperdentry;
 	const struct cred *old_cred;
 
@@ -40,12 +41,15 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 
 		/* Truncate should trigger data copy up as well */
 		full_copy_up = true;
+		/* ... but no data needs copying to be truncated away */
+		if (!attr->ia_size)
+			copy_up_flags |= O_TRUNC;
 	}
 
 	if (!full_copy_up)
 		err = ovl_copy_up(dentry);
 	else
-		err = ovl_copy_up_with_data(dentry);
+		err = ovl_copy_up_flags(dentry, copy_up_flags);
 	if (!err) {
 		struct inode *winode = NULL;
 
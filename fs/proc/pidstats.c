@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * /proc/pidstats: the stat and statm of many processes in one read
+ *
+ * Monitoring agents otherwise open, read and parse /proc/<pid>/stat and
+ * statm of every process for every sample.  A read from offset 0 of
+ * /proc/pidstats builds a snapshot of fixed size binary records, see
+ * include/uapi/linux/pidstats.h, of all the processes visible through
+ * the proc mount, or of those selected with PIDSTATS_IOC_SET_PIDS or
+ * PIDSTATS_IOC_SET_CGROUP.  Only fields world readable in stat and
+ * statm are reported, and processes hidden by hidepid are skipped.
+ */
+#include <linux/cgroup.h>
+#include <linux/fs.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/pid_namespace.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/sched/cputime.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/stat.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <uapi/linux/pidstats.h>
+
+#include "internal.h"
+
+/**
+ * struct pidstats_file - state of an open pidstats file
+ * @lock: serializes the readers of the file
+ * @pids: sorted pids to report, or NULL to report all processes
+ * @nr_pids: number of @pids
+ * @cgrp: only report the processes in this cgroup, if set
+ * @buf: snapshot being read, built when reading from offset 0
+ * @len: size of @buf
+ */
+struct pidstats_file {
+	struct mutex lock;
+	pid_t *pids;
+	unsigned int nr_pids;
+	struct cgroup *cgrp;
+	void *buf;
+	size_t len;
+};
+
+static void pidstats_fill(struct pidstats_record *rec,
+			  struct pid_namespace *ns, struct task_struct *task)
+{
+	unsigned long shared = 0, text = 0, data = 0, resident = 0;
+	u64 utime = 0, stime = 0;
+	struct mm_struct *mm;
+	unsigned long flags;
+
+	rec->pid = task_tgid_nr_ns(task, ns);
+	rec->state = task_state_to_char(task);
+	rec->nice = task_nice(task);
+	rec->start_time = task->real_start_time;
+
+	if (lock_task_sighand(task, &flags)) {
+		struct signal_struct *sig = task->signal;
+		struct task_struct *t = task;
+
+		rec->num_threads = get_nr_threads(task);
+		rec->min_flt = sig->min_flt;
+		rec->maj_flt = sig->maj_flt;
+		do {
+			rec->min_flt += t->min_flt;
+			rec->maj_flt += t->maj_flt;
+		} while_each_thread(task, t);
+		thread_group_cputime_adjusted(task, &utime, &stime);
+		rec->ppid = task_tgid_nr_ns(task->real_parent, ns);
+
+		unlock_task_sighand(task, &flags);
+	}
+	rec->utime = utime;
+	rec->stime = stime;
+
+	mm = get_task_mm(task);
+	if (mm) {
+		rec->vsize = task_vsize(mm);
+		rec->size = task_statm(mm, &shared, &text, &data, &resident);
+		rec->resident = resident;
+		rec->shared = shared;
+		rec->text = text;
+		rec->data = data;
+		mmput(mm);
+	}
+}
+
+/* The next process to report, with a reference held, from *nr on */
+static struct task_struct *pidstats_next(struct pidstats_file *f,
+					 struct pid_namespace *ns,
+					 unsigned int *idx, pid_t *nr)
+{
+	struct task_struct *task;
+	struct pid *pid;
+
+	rcu_read_lock();
+	for (;;) {
+		if (f->pids) {
+			if (*idx >= f->nr_pids)
+				break;
+			*nr = f->pids[(*idx)++];
+			pid = find_pid_ns(*nr, ns);
+		} else {
+			pid = find_ge_pid(*nr, ns);
+			if (!pid)
+				break;
+			*nr = pid_nr_ns(pid, ns) + 1;
+		}
+
+		task = pid ? pid_task(pid, PIDTYPE_PID) : NULL;
+		if (!task || !has_group_leader_pid(task))
+			continue;
+		if (f->cgrp && !task_under_cgroup_hierarchy(task, f->cgrp))
+			continue;
+		if (!has_pid_permissions(ns, task, HIDEPID_INVISIBLE))
+			continue;
+
+		get_task_struct(task);
+		rcu_read_unlock();
+		return task;
+	}
+	rcu_read_unlock();
+
+	return NULL;
+}
+
+static int pidstats_snapshot(struct pidstats_file *f,
+			     struct pid_namespace *ns)
+{
+	struct pidstats_header *hdr;
+	struct task_struct *task;
+	unsigned int nr_records = 0, max_records, idx = 0;
+	pid_t nr = 1;
+	void *buf;
+
+	/* Leave some room for the processes created meanwhile */
+	max_records = (f->pids ? f->nr_pids : nr_processes()) + 16;
+	buf = kvzalloc(sizeof(*hdr) + max_records *
+		       sizeof(struct pidstats_record), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	while ((task = pidstats_next(f, ns, &idx, &nr))) {
+		if (nr_records == max_records) {
+			void *bigger;
+
+			bigger = kvzalloc(sizeof(*hdr) + 2 * max_records *
+					  sizeof(struct pidstats_record),
+					  GFP_KERNEL);
+			if (!bigger) {
+				put_task_struct(task);
+				kvfree(buf);
+				return -ENOMEM;
+			}
+			memcpy(bigger, buf, sizeof(*hdr) + max_records *
+			       sizeof(struct pidstats_record));
+			kvfree(buf);
+			buf = bigger;
+			max_records *= 2;
+		}
+
+		pidstats_fill((struct pidstats_record *)(buf + sizeof(*hdr)) +
+			      nr_records++, ns, task);
+		put_task_struct(task);
+		cond_resched();
+	}
+
+	hdr = buf;
+	hdr->version = PIDSTATS_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->record_size = sizeof(struct pidstats_record);
+	hdr->nr_records = nr_records;
+	hdr->page_size = PAGE_SIZE;
+
+	f->buf = buf;
+	f->len = sizeof(*hdr) + nr_records * sizeof(struct pidstats_record);
+
+	return 0;
+}
+
+static int pidstats_open(struct inode *inode, struct file *file)
+{
+	struct pidstats_file *f;
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		return -ENOMEM;
+
+	mutex_init(&f->lock);
+	file->private_data = f;
+
+	return 0;
+}
+
+static ssize_t pidstats_read(struct file *file, char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	struct pidstats_file *f = file->private_data;
+	ssize_t ret;
+
+	mutex_lock(&f->lock);
+	if (*ppos == 0) {
+		kvfree(f->buf);
+		f->buf = NULL;
+		f->len = 0;
+		ret = pidstats_snapshot(f, proc_pid_ns(file_inode(file)));
+		if (ret)
+			goto unlock;
+	}
+	ret = simple_read_from_buffer(ubuf, count, ppos, f->buf, f->len);
+unlock:
+	mutex_unlock(&f->lock);
+
+	return ret;
+}
+
+static int pidstats_cmp(const void *a, const void *b)
+{
+	pid_t l = *(const pid_t *)a, r = *(const pid_t *)b;
+
+	return l < r ? -1 : l > r;
+}
+
+static long pidstats_set_pids(struct pidstats_file *f, void __user *arg)
+{
+	struct pidstats_pids p;
+	pid_t *pids = NULL;
+
+	if (copy_from_user(&p, arg, sizeof(p)))
+		return -EFAULT;
+	if (p.pad || p.nr > PIDSTATS_MAX_PIDS)
+		return -EINVAL;
+
+	if (p.nr) {
+		pids = memdup_user(u64_to_user_ptr(p.pids),
+				   p.nr * sizeof(*pids));
+		if (IS_ERR(pids))
+			return PTR_ERR(pids);
+		/* Records come in ascending pid order */
+		sort(pids, p.nr, sizeof(*pids), pidstats_cmp, NULL);
+	}
+
+	mutex_lock(&f->lock);
+	kfree(f->pids);
+	f->pids = pids;
+	f->nr_pids = p.nr;
+	mutex_unlock(&f->lock);
+
+	return 0;
+}
+
+static long pidstats_set_cgroup(struct pidstats_file *f, void __user *arg)
+{
+	struct cgroup *cgrp = NULL;
+	int fd;
+
+	if (get_user(fd, (int __user *)arg))
+		return -EFAULT;
+
+	if (fd >= 0) {
+#ifdef CONFIG_CGROUPS
+		cgrp = cgroup_get_from_fd(fd);
+		if (IS_ERR(cgrp))
+			return PTR_ERR(cgrp);
+#else
+		return -EOPNOTSUPP;
+#endif
+	}
+
+	mutex_lock(&f->lock);
+	swap(f->cgrp, cgrp);
+	mutex_unlock(&f->lock);
+
+#ifdef CONFIG_CGROUPS
+	if (cgrp)
+		cgroup_put(cgrp);
+#endif
+	return 0;
+}
+
+static long pidstats_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct pidstats_file *f = file->private_data;
+
+	switch (cmd) {
+	case PIDSTATS_IOC_SET_PIDS:
+		return pidstats_set_pids(f, (void __user *)arg);
+	case PIDSTATS_IOC_SET_CGROUP:
+		return pidstats_set_cgroup(f, (void __user *)arg);
+	}
+
+	return -ENOTTY;
+}
+
+static int pidstats_release(struct inode *inode, struct file *file)
+{
+	struct pidstats_file *f = file->private_data;
+
+#ifdef CONFIG_CGROUPS
+	if (f->cgrp)
+		cgroup_put(f->cgrp);
+#endif
+	kfree(f->pids);
+	kvfree(f->buf);
+	kfree(f);
+
+	return 0;
+}
+
+static const struct file_operations proc_pidstats_operations = {
+	.open		= pidstats_open,
+	.read		= pidstats_read,
+	.unlocked_ioctl	= pidstats_ioctl,
+	.compat_ioctl	= pidstats_ioctl,
+	.llseek		= default_llseek,
+	.release	= pidstats_release,
+};
+
+static int __init proc_pidstats_init(void)
+{
+	proc_create("pidstats", 0444, NULL, &proc_pidstats_operations);
+	return 0;
+}
+fs_initcall(proc_pidstats_init);
@@ -867,6 +867,56 @@ static int show_smap(struct seq_file *m, void *v)
 	return 0;
 }
 
+/*
+ * The rollup of the last read of an smaps_rollup file, and the mm counters
+ * it was gathered at.  A reread finding the counters unchanged reuses it
+ * rather than walking all the page tables again.  Referenced and the Pss
+ * of shared pages may change without the counters changing, so it is used
+ * for SMAPS_ROLLUP_MAX_AGE at most, and only with
+ * CONFIG_PROC_SMAPS_ROLLUP_CACHE.
+ */
+#define SMAPS_ROLLUP_MAX_AGE	(10 * HZ)
+
+struct smaps_rollup_cache {
+	unsigned long counters[NR_MM_COUNTERS];
+	unsigned long total_vm;
+	int map_count;
+	unsigned long expires;
+	unsigned long last_vma_end;
+	struct mem_size_stats mss;
+};
+
+static bool smaps_rollup_cache_valid(struct mm_struct *mm,
+				     struct smaps_rollup_cache *cache)
+{
+	int i;
+
+	if (time_after(jiffies, cache->expires) ||
+	    cache->map_count != mm->map_count ||
+	    cache->total_vm != mm->total_vm)
+		return false;
+	for (i = 0; i < NR_MM_COUNTERS; i++)
+		if (cache->counters[i] != get_mm_counter(mm, i))
+			return false;
+	return true;
+}
+
+static void smaps_rollup_cache_fill(struct mm_struct *mm,
+				    struct smaps_rollup_cache *cache,
+				    const struct mem_size_stats *mss,
+				    unsigned long last_vma_end)
+{
+	int i;
+
+	for (i = 0; i < NR_MM_COUNTERS; i++)
+		cache->counters[i] = get_mm_counter(mm, i);
+	cache->total_vm = mm->total_vm;
+	cache->map_count = mm->map_count;
+	cache->expires = jiffies + SMAPS_ROLLUP_MAX_AGE;
+	cache->last_vma_end = last_vma_end;
+	cache->mss = *mss;
+}
+
 static int show_smaps_rollup(struct seq_file *m, void *v)
 {
 	struct proc_maps_private *priv = m->private;
@@ -891,11 +941,28 @@ static int show_smaps_rollup(struct seq_file *m, void *v)
 	down_read(&mm->mmap_sem);
 	hold_task_mempolicy(priv);
 
+	if (IS_ENABLED(CONFIG_PROC_SMAPS_ROLLUP_CACHE) && priv->rollup &&
+	    smaps_rollup_cache_valid(mm, priv->rollup)) {
+		mss = priv->rollup->mss;
+		last_vma_end = priv->rollup->last_vma_end;
+		goto show;
+	}
+
 	for (vma = priv->mm->mmap; vma; vma = vma->vm_next) {
 		smap_gather_stats(vma, &mss);
 		last_vma_end = vma->vm_end;
 	}
 
+	if (IS_ENABLED(CONFIG_PROC_SMAPS_ROLLUP_CACHE)) {
+		if (!priv->rollup)
+			priv->rollup = kmalloc(sizeof(*priv->rollup),
+					       GFP_KERNEL_ACCOUNT);
+		if (priv->rollup)
+			smaps_rollup_cache_fill(mm, priv->rollup, &mss,
+						last_vma_end);
+	}
+
+show:
 	show_vma_header_prefix(m, priv->mm->mmap->vm_start,
 			       last_vma_end, 0, 0, 0, 0);
 	seq_pad(m, ' ');
@@ -964,6 +1031,7 @@ static int smaps_rollup_release(struct inode *inode, struct file *file)
 	if (priv->mm)
 		mmdrop(priv->mm);
 
+	kfree(priv->rollup);
 	kfree(priv);
 	return single_release(inode, file);
 }
@@ -103,6 +103,8 @@ static int sdcardfs_d_revalidate(struct dentry *dentry, unsigned int flags)
 	if (!err)
 		goto out;
 
+	revalidate_derived_permission(parent_dentry, dentry);
+
 	/* If our top's inode is gone, we may be out of date */
 	inode = igrab(d_inode(dentry));
 	if (inode) {
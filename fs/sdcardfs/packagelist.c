@@ -20,6 +20,8 @@
 
 #include "sdcardfs.h"
 #include <linux/hashtable.h>
+#include <linux/rhashtable.h>
+#include <linux/jhash.h>
 #include <linux/ctype.h>
 #include <linux/delay.h>
 #include <linux/radix-tree.h>
@@ -32,19 +34,34 @@
 #include <linux/configfs.h>
 
 struct hashtable_entry {
-	struct hlist_node hlist;
+	union {
+		struct hlist_node hlist;	/* ext_to_groupid */
+		struct rhash_head rhash;	/* package_to_appid */
+		struct rhlist_head rhlist;	/* package_to_userid */
+	};
 	struct hlist_node dlist; /* for deletion cleanup */
 	struct qstr key;
 	atomic_t value;
 };
 
-static DEFINE_HASHTABLE(package_to_appid, 8);
-static DEFINE_HASHTABLE(package_to_userid, 8);
+/* Package tables grow with the number of installed packages. Keys are
+ * qstrs hashed with package_name_hash(), so lookups don't rehash.
+ */
+static struct rhashtable package_to_appid;
+static struct rhltable package_to_userid;
 static DEFINE_HASHTABLE(ext_to_groupid, 8);
 
 
 static struct kmem_cache *hashtable_entry_cachep;
 
+/* Generations of the package list: per bucket of package names, and one
+ * for changes to all packages of a user. Package directories note their
+ * sum when they look themselves up, see revalidate_derived_permission().
+ */
+#define PKG_GEN_BITS	8
+static atomic_t pkg_generation[1 << PKG_GEN_BITS];
+static atomic_t all_pkg_generation;
+
 static unsigned int full_name_case_hash(const void *salt, const unsigned char *name, unsigned int len)
 {
 	unsigned long hash = init_name_hash(salt);
@@ -68,31 +85,87 @@ static inline int qstr_copy(const struct qstr *src, struct qstr *dest)
 	return !!dest->name;
 }
 
+unsigned int package_name_hash(const struct qstr *name)
+{
+	return full_name_case_hash(0, name->name, name->len);
+}
+
+static u32 package_key_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct qstr *key = data;
+
+	return jhash_1word(key->hash, seed);
+}
+
+static u32 package_obj_hashfn(const void *data, u32 len, u32 seed)
+{
+	const struct hashtable_entry *entry = data;
+
+	return jhash_1word(entry->key.hash, seed);
+}
+
+static int package_obj_cmpfn(struct rhashtable_compare_arg *arg,
+		const void *obj)
+{
+	const struct hashtable_entry *entry = obj;
+
+	return !qstr_case_eq(arg->key, &entry->key);
+}
+
+static const struct rhashtable_params package_to_appid_params = {
+	.head_offset		= offsetof(struct hashtable_entry, rhash),
+	.hashfn			= package_key_hashfn,
+	.obj_hashfn		= package_obj_hashfn,
+	.obj_cmpfn		= package_obj_cmpfn,
+	.automatic_shrinking	= true,
+};
+
+static const struct rhashtable_params package_to_userid_params = {
+	.head_offset		= offsetof(struct hashtable_entry, rhlist),
+	.hashfn			= package_key_hashfn,
+	.obj_hashfn		= package_obj_hashfn,
+	.obj_cmpfn		= package_obj_cmpfn,
+	.automatic_shrinking	= true,
+};
 
-static appid_t __get_appid(const struct qstr *key)
+
+/* key->hash must be package_name_hash(key) */
+appid_t get_appid(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
-	appid_t ret_id;
+	appid_t ret_id = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			ret_id = atomic_read(&hash_cur->value);
-			rcu_read_unlock();
-			return ret_id;
-		}
-	}
+	hash_cur = rhashtable_lookup(&package_to_appid, key,
+			package_to_appid_params);
+	if (hash_cur)
+		ret_id = atomic_read(&hash_cur->value);
 	rcu_read_unlock();
-	return 0;
+	return ret_id;
 }
 
-appid_t get_appid(const char *key)
+static atomic_t *pkg_generation_bucket(unsigned int hash)
 {
-	struct qstr q;
+	return &pkg_generation[hash_32(hash, PKG_GEN_BITS)];
+}
 
-	qstr_init(&q, key);
-	return __get_appid(&q);
+static void pkg_generation_inc(atomic_t *gen)
+{
+	/* Pairs with smp_rmb() in get_pkg_generation() */
+	smp_mb__before_atomic();
+	atomic_inc(gen);
+}
+
+/* hash is package_name_hash() of the package */
+unsigned int get_pkg_generation(unsigned int hash)
+{
+	unsigned int gen;
+
+	gen = atomic_read(&all_pkg_generation) +
+			atomic_read(pkg_generation_bucket(hash));
+	/* Read before the entries we derive from */
+	smp_rmb();
+	return gen;
 }
 
 static appid_t __get_ext_gid(const struct qstr *key)
@@ -121,28 +194,24 @@ appid_t get_ext_gid(const char *key)
 	return __get_ext_gid(&q);
 }
 
-static appid_t __is_excluded(const struct qstr *app_name, userid_t user)
+/* app_name->hash must be package_name_hash(app_name) */
+appid_t is_excluded(const struct qstr *app_name, userid_t user)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = app_name->hash;
+	struct rhlist_head *list, *pos;
+	appid_t ret = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == user &&
-				qstr_case_eq(app_name, &hash_cur->key)) {
-			rcu_read_unlock();
-			return 1;
+	list = rhltable_lookup(&package_to_userid, app_name,
+			package_to_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, rhlist) {
+		if (atomic_read(&hash_cur->value) == user) {
+			ret = 1;
+			break;
 		}
 	}
 	rcu_read_unlock();
-	return 0;
-}
-
-appid_t is_excluded(const char *key, userid_t user)
-{
-	struct qstr q;
-	qstr_init(&q, key);
-	return __is_excluded(&q, user);
+	return ret;
 }
 
 /* Kernel has already enforced everything we returned through
@@ -193,23 +262,32 @@ static struct hashtable_entry *alloc_hashtable_entry(const struct qstr *key,
 	return ret;
 }
 
+static void free_hashtable_entry(struct hashtable_entry *entry)
+{
+	kfree(entry->key.name);
+	kmem_cache_free(hashtable_entry_cachep, entry);
+}
+
 static int insert_packagelist_appid_entry_locked(const struct qstr *key, appid_t value)
 {
 	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			atomic_set(&hash_cur->value, value);
-			return 0;
-		}
+	hash_cur = rhashtable_lookup_fast(&package_to_appid, key,
+			package_to_appid_params);
+	if (hash_cur) {
+		atomic_set(&hash_cur->value, value);
+		return 0;
 	}
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_appid, &new_entry->hlist, hash);
-	return 0;
+	err = rhashtable_insert_fast(&package_to_appid, &new_entry->rhash,
+			package_to_appid_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
 }
 
 static int insert_ext_gid_entry_locked(const struct qstr *key, appid_t value)
@@ -232,61 +310,36 @@ static int insert_ext_gid_entry_locked(const struct qstr *key, appid_t value)
 
 static int insert_userid_exclude_entry_locked(const struct qstr *key, userid_t value)
 {
-	struct hashtable_entry *hash_cur;
 	struct hashtable_entry *new_entry;
-	unsigned int hash = key->hash;
+	int err;
 
 	/* Only insert if not already present */
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (atomic_read(&hash_cur->value) == value &&
-				qstr_case_eq(key, &hash_cur->key))
-			return 0;
-	}
+	if (is_excluded(key, value))
+		return 0;
 	new_entry = alloc_hashtable_entry(key, value);
 	if (!new_entry)
 		return -ENOMEM;
-	hash_add_rcu(package_to_userid, &new_entry->hlist, hash);
-	return 0;
+	err = rhltable_insert(&package_to_userid, &new_entry->rhlist,
+			package_to_userid_params);
+	if (err)
+		free_hashtable_entry(new_entry);
+	return err;
 }
 
+/* Package directories of key get rederived when next revalidated */
 static void fixup_all_perms_name(const struct qstr *key)
 {
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_NAME,
-		.name = QSTR_INIT(key->name, key->len),
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
+	pkg_generation_inc(pkg_generation_bucket(key->hash));
 }
 
 static void fixup_all_perms_name_userid(const struct qstr *key, userid_t userid)
 {
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_NAME | BY_USERID,
-		.name = QSTR_INIT(key->name, key->len),
-		.userid = userid,
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
+	pkg_generation_inc(pkg_generation_bucket(key->hash));
 }
 
 static void fixup_all_perms_userid(userid_t userid)
 {
-	struct sdcardfs_sb_info *sbinfo;
-	struct limit_search limit = {
-		.flags = BY_USERID,
-		.userid = userid,
-	};
-	list_for_each_entry(sbinfo, &sdcardfs_super_list, list) {
-		if (sbinfo_has_sdcard_magic(sbinfo))
-			fixup_perms_recursive(sbinfo->sb->s_root, &limit);
-	}
+	pkg_generation_inc(&all_pkg_generation);
 }
 
 static int insert_packagelist_entry(const struct qstr *key, appid_t value)
@@ -326,31 +379,29 @@ static int insert_userid_exclude_entry(const struct qstr *key, userid_t value)
 	return err;
 }
 
-static void free_hashtable_entry(struct hashtable_entry *entry)
-{
-	kfree(entry->key.name);
-	kmem_cache_free(hashtable_entry_cachep, entry);
-}
-
 static void remove_packagelist_entry_locked(const struct qstr *key)
 {
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
+	struct rhlist_head *list, *pos;
 	struct hlist_node *h_t;
 	HLIST_HEAD(free_list);
 
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-		}
-	}
-	hash_for_each_possible_rcu(package_to_appid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key)) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
-			break;
-		}
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key,
+			package_to_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, rhlist)
+		hlist_add_head(&hash_cur->dlist, &free_list);
+	rcu_read_unlock();
+	hlist_for_each_entry(hash_cur, &free_list, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->rhlist,
+				package_to_userid_params);
+
+	hash_cur = rhashtable_lookup_fast(&package_to_appid, key,
+			package_to_appid_params);
+	if (hash_cur) {
+		rhashtable_remove_fast(&package_to_appid, &hash_cur->rhash,
+				package_to_appid_params);
+		hlist_add_head(&hash_cur->dlist, &free_list);
 	}
 	synchronize_rcu();
 	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
@@ -390,16 +441,28 @@ static void remove_ext_gid_entry(const struct qstr *key, gid_t group)
 static void remove_userid_all_entry_locked(userid_t userid)
 {
 	struct hashtable_entry *hash_cur;
+	struct rhashtable_iter iter;
 	struct hlist_node *h_t;
 	HLIST_HEAD(free_list);
-	int i;
 
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		if (atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			hlist_add_head(&hash_cur->dlist, &free_list);
+	rhltable_walk_enter(&package_to_userid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur)) {
+			/* Resized under us, entries may be seen twice */
+			if (PTR_ERR(hash_cur) == -EAGAIN)
+				continue;
+			break;
 		}
+		if (atomic_read(&hash_cur->value) == userid &&
+				hlist_unhashed(&hash_cur->dlist))
+			hlist_add_head(&hash_cur->dlist, &free_list);
 	}
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
+	hlist_for_each_entry(hash_cur, &free_list, dlist)
+		rhltable_remove(&package_to_userid, &hash_cur->rhlist,
+				package_to_userid_params);
 	synchronize_rcu();
 	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist) {
 		free_hashtable_entry(hash_cur);
@@ -416,18 +479,25 @@ static void remove_userid_all_entry(userid_t userid)
 
 static void remove_userid_exclude_entry_locked(const struct qstr *key, userid_t userid)
 {
-	struct hashtable_entry *hash_cur;
-	unsigned int hash = key->hash;
+	struct hashtable_entry *hash_cur, *found = NULL;
+	struct rhlist_head *list, *pos;
 
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(key, &hash_cur->key) &&
-				atomic_read(&hash_cur->value) == userid) {
-			hash_del_rcu(&hash_cur->hlist);
-			synchronize_rcu();
-			free_hashtable_entry(hash_cur);
+	rcu_read_lock();
+	list = rhltable_lookup(&package_to_userid, key,
+			package_to_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, rhlist) {
+		if (atomic_read(&hash_cur->value) == userid) {
+			found = hash_cur;
 			break;
 		}
 	}
+	rcu_read_unlock();
+	if (found) {
+		rhltable_remove(&package_to_userid, &found->rhlist,
+				package_to_userid_params);
+		synchronize_rcu();
+		free_hashtable_entry(found);
+	}
 }
 
 static void remove_userid_exclude_entry(const struct qstr *key, userid_t userid)
@@ -438,25 +508,19 @@ static void remove_userid_exclude_entry(const struct qstr *key, userid_t userid)
 	mutex_unlock(&sdcardfs_super_list_lock);
 }
 
-static void packagelist_destroy(void)
+static void packagelist_free_entry(void *ptr, void *arg)
 {
-	struct hashtable_entry *hash_cur;
-	struct hlist_node *h_t;
-	HLIST_HEAD(free_list);
-	int i;
+	free_hashtable_entry(ptr);
+}
 
+static void packagelist_destroy(void)
+{
 	mutex_lock(&sdcardfs_super_list_lock);
-	hash_for_each_rcu(package_to_appid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
-	}
-	hash_for_each_rcu(package_to_userid, i, hash_cur, hlist) {
-		hash_del_rcu(&hash_cur->hlist);
-		hlist_add_head(&hash_cur->dlist, &free_list);
-	}
-	synchronize_rcu();
-	hlist_for_each_entry_safe(hash_cur, h_t, &free_list, dlist)
-		free_hashtable_entry(hash_cur);
+	/* No more lookups, sdcardfs is unregistered */
+	rhashtable_free_and_destroy(&package_to_appid,
+			packagelist_free_entry, NULL);
+	rhltable_free_and_destroy(&package_to_userid,
+			packagelist_free_entry, NULL);
 	mutex_unlock(&sdcardfs_super_list_lock);
 	pr_info("sdcardfs: destroyed packagelist pkgld\n");
 }
@@ -498,7 +562,7 @@ static inline struct package_details *to_package_details(struct config_item *ite
 
 static ssize_t package_details_appid_show(struct config_item *item, char *page)
 {
-	return scnprintf(page, PAGE_SIZE, "%u\n", __get_appid(&to_package_details(item)->name));
+	return scnprintf(page, PAGE_SIZE, "%u\n", get_appid(&to_package_details(item)->name));
 }
 
 static ssize_t package_details_appid_store(struct config_item *item,
@@ -524,15 +588,15 @@ static ssize_t package_details_excluded_userids_show(struct config_item *item,
 {
 	struct package_details *package_details = to_package_details(item);
 	struct hashtable_entry *hash_cur;
-	unsigned int hash = package_details->name.hash;
+	struct rhlist_head *list, *pos;
 	int count = 0;
 
 	rcu_read_lock();
-	hash_for_each_possible_rcu(package_to_userid, hash_cur, hlist, hash) {
-		if (qstr_case_eq(&package_details->name, &hash_cur->key))
-			count += scnprintf(page + count, PAGE_SIZE - count,
-					"%d ", atomic_read(&hash_cur->value));
-	}
+	list = rhltable_lookup(&package_to_userid, &package_details->name,
+			package_to_userid_params);
+	rhl_for_each_entry_rcu(hash_cur, pos, list, rhlist)
+		count += scnprintf(page + count, PAGE_SIZE - count,
+				"%d ", atomic_read(&hash_cur->value));
 	rcu_read_unlock();
 	if (count)
 		count--;
@@ -751,22 +815,27 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 {
 	struct hashtable_entry *hash_cur_app;
 	struct hashtable_entry *hash_cur_user;
-	int i;
+	struct rhlist_head *list, *pos;
+	struct rhashtable_iter iter;
 	int count = 0, written = 0;
 	const char errormsg[] = "<truncated>\n";
-	unsigned int hash;
 
-	rcu_read_lock();
-	hash_for_each_rcu(package_to_appid, i, hash_cur_app, hlist) {
+	rhashtable_walk_enter(&package_to_appid, &iter);
+	rhashtable_walk_start(&iter);
+	while ((hash_cur_app = rhashtable_walk_next(&iter))) {
+		if (IS_ERR(hash_cur_app)) {
+			if (PTR_ERR(hash_cur_app) == -EAGAIN)
+				continue;
+			break;
+		}
 		written = scnprintf(page + count, PAGE_SIZE - sizeof(errormsg) - count, "%s %d\n",
 					hash_cur_app->key.name, atomic_read(&hash_cur_app->value));
-		hash = hash_cur_app->key.hash;
-		hash_for_each_possible_rcu(package_to_userid, hash_cur_user, hlist, hash) {
-			if (qstr_case_eq(&hash_cur_app->key, &hash_cur_user->key)) {
-				written += scnprintf(page + count + written - 1,
-					PAGE_SIZE - sizeof(errormsg) - count - written + 1,
-					" %d\n", atomic_read(&hash_cur_user->value)) - 1;
-			}
+		list = rhltable_lookup(&package_to_userid, &hash_cur_app->key,
+				package_to_userid_params);
+		rhl_for_each_entry_rcu(hash_cur_user, pos, list, rhlist) {
+			written += scnprintf(page + count + written - 1,
+				PAGE_SIZE - sizeof(errormsg) - count - written + 1,
+				" %d\n", atomic_read(&hash_cur_user->value)) - 1;
 		}
 		if (count + written == PAGE_SIZE - sizeof(errormsg) - 1) {
 			count += scnprintf(page + count, PAGE_SIZE - count, errormsg);
@@ -774,7 +843,8 @@ static ssize_t packages_list_show(struct config_item *item, char *page)
 		}
 		count += written;
 	}
-	rcu_read_unlock();
+	rhashtable_walk_stop(&iter);
+	rhashtable_walk_exit(&iter);
 
 	return count;
 }
@@ -862,6 +932,8 @@ static void configfs_sdcardfs_exit(void)
 
 int packagelist_init(void)
 {
+	int err;
+
 	hashtable_entry_cachep =
 		kmem_cache_create("packagelist_hashtable_entry",
 					sizeof(struct hashtable_entry), 0, 0, NULL);
@@ -870,8 +942,22 @@ int packagelist_init(void)
 		return -ENOMEM;
 	}
 
+	err = rhashtable_init(&package_to_appid, &package_to_appid_params);
+	if (err)
+		goto out_cache;
+	err = rhltable_init(&package_to_userid, &package_to_userid_params);
+	if (err)
+		goto out_appid;
+
 	configfs_sdcardfs_init();
 	return 0;
+
+out_appid:
+	rhashtable_destroy(&package_to_appid);
+out_cache:
+	kmem_cache_destroy(hashtable_entry_cachep);
+	pr_err("sdcardfs: failed creating package tables\n");
+	return err;
 }
 
 void packagelist_exit(void)
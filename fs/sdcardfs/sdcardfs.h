@@ -168,6 +168,11 @@ struct sdcardfs_inode_data {
 	bool under_android;
 	bool under_cache;
 	bool under_obb;
+
+	/* package list generation a package directory was derived at */
+	unsigned int pkg_gen;
+	/* package_name_hash() of its name */
+	unsigned int pkg_hash;
 };
 
 /* sdcardfs inode data in memory */
@@ -488,27 +493,22 @@ extern struct mutex sdcardfs_super_list_lock;
 extern struct list_head sdcardfs_super_list;
 
 /* for packagelist.c */
-extern appid_t get_appid(const char *app_name);
+extern unsigned int package_name_hash(const struct qstr *name);
+extern appid_t get_appid(const struct qstr *app_name);
 extern appid_t get_ext_gid(const char *app_name);
-extern appid_t is_excluded(const char *app_name, userid_t userid);
+extern appid_t is_excluded(const struct qstr *app_name, userid_t userid);
+extern unsigned int get_pkg_generation(unsigned int hash);
 extern int check_caller_access_to_name(struct inode *parent_node, const struct qstr *name);
 extern int packagelist_init(void);
 extern void packagelist_exit(void);
 
 /* for derived_perm.c */
-#define BY_NAME		(1 << 0)
-#define BY_USERID	(1 << 1)
-struct limit_search {
-	unsigned int flags;
-	struct qstr name;
-	userid_t userid;
-};
-
 extern void setup_derived_state(struct inode *inode, perm_t perm,
 			userid_t userid, uid_t uid);
 extern void get_derived_permission(struct dentry *parent, struct dentry *dentry);
 extern void get_derived_permission_new(struct dentry *parent, struct dentry *dentry, const struct qstr *name);
-extern void fixup_perms_recursive(struct dentry *dentry, struct limit_search *limit);
+extern void revalidate_derived_permission(struct dentry *parent,
+			struct dentry *dentry);
 
 extern void update_derived_permission_lock(struct dentry *dentry);
 void fixup_lower_ownership(struct dentry *dentry, const char *name);
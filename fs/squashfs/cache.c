@@ -42,6 +42,11 @@
  * have been packed with it, these because of locality-of-reference may be read
  * in the near future. Temporarily caching them ensures they are available for
  * near future access without requiring an additional read and decompress.
+ *
+ * A cache may grow on misses from the number of entries it was created
+ * with up to a maximum, when many readers share a larger working set than
+ * its initial entries hold.  Entries it grew by are freed again by the
+ * superblock shrinker once idle.
  */
 
 #include <linux/fs.h>
@@ -58,6 +63,9 @@
 #include "squashfs.h"
 #include "page_actor.h"
 
+static int squashfs_cache_entry_init(struct squashfs_cache *,
+	struct squashfs_cache_entry *, gfp_t);
+
 /*
  * Look-up block in cache, and increment usage count.  If not in cache, read
  * and decompress it from disk.
@@ -65,7 +73,7 @@
 struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 	struct squashfs_cache *cache, u64 block, int length)
 {
-	int i, n;
+	int i, n, grown = 0;
 	struct squashfs_cache_entry *entry;
 
 	spin_lock(&cache->lock);
@@ -81,13 +89,47 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 
 		if (n == cache->entries) {
 			/*
-			 * Block not in cache, if all cache entries are used
-			 * go to sleep waiting for one to become available.
+			 * Block not in cache, grow the cache by an entry for
+			 * it if it may grow.  One entry is added at a time,
+			 * and growing gives way to reclaim.
+			 */
+			if (cache->entries < cache->max_entries &&
+					!cache->growing && !grown) {
+				int err;
+
+				cache->growing = 1;
+				grown = 1;
+				spin_unlock(&cache->lock);
+				err = squashfs_cache_entry_init(cache,
+					&cache->entry[cache->entries],
+					GFP_KERNEL | __GFP_NORETRY |
+					__GFP_NOWARN);
+				spin_lock(&cache->lock);
+				cache->growing = 0;
+				if (!err) {
+					cache->entries++;
+					cache->unused++;
+				}
+				/*
+				 * Waiters which found the cache growing slept
+				 * on it, let them try to grow it in turn.
+				 */
+				if (cache->num_waiters)
+					wake_up(&cache->wait_queue);
+				continue;
+			}
+
+			/*
+			 * If all cache entries are used go to sleep waiting
+			 * for one to become available, or for the cache to be
+			 * free to grow if it hasn't grown for us yet.
 			 */
 			if (cache->unused == 0) {
 				cache->num_waiters++;
 				spin_unlock(&cache->lock);
-				wait_event(cache->wait_queue, cache->unused);
+				wait_event(cache->wait_queue, cache->unused ||
+					(!grown && !cache->growing &&
+					cache->entries < cache->max_entries));
 				spin_lock(&cache->lock);
 				cache->num_waiters--;
 				continue;
@@ -106,6 +148,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			cache->next_blk = (i + 1) % cache->entries;
+			cache->misses++;
 			entry = &cache->entry[i];
 
 			/*
@@ -154,6 +197,7 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		if (entry->refcount == 0)
 			cache->unused--;
 		entry->refcount++;
+		cache->hits++;
 
 		/*
 		 * If the entry is currently being filled in by another process
@@ -204,24 +248,130 @@ void squashfs_cache_put(struct squashfs_cache_entry *entry)
 	spin_unlock(&cache->lock);
 }
 
+/*
+ * Free the buffers of a cache entry, leaving it empty.
+ */
+static void squashfs_cache_entry_free(struct squashfs_cache_entry *entry)
+{
+	int j;
+
+	if (entry->data) {
+		for (j = 0; j < entry->cache->pages; j++)
+			kfree(entry->data[j]);
+		kfree(entry->data);
+	}
+	kfree(entry->actor);
+
+	entry->data = NULL;
+	entry->actor = NULL;
+	entry->block = SQUASHFS_INVALID_BLK;
+}
+
+
+/*
+ * Allocate the buffers of an empty cache entry.  To avoid vmalloc
+ * fragmentation issues each entry is allocated as a sequence of kmalloced
+ * PAGE_SIZE buffers.
+ */
+static int squashfs_cache_entry_init(struct squashfs_cache *cache,
+	struct squashfs_cache_entry *entry, gfp_t gfp)
+{
+	int j;
+
+	entry->block = SQUASHFS_INVALID_BLK;
+	entry->data = kcalloc(cache->pages, sizeof(void *), gfp);
+	if (entry->data == NULL)
+		goto failed;
+
+	for (j = 0; j < cache->pages; j++) {
+		entry->data[j] = kmalloc(PAGE_SIZE, gfp);
+		if (entry->data[j] == NULL)
+			goto failed;
+	}
+
+	entry->actor = squashfs_page_actor_init(entry->data, cache->pages, 0);
+	if (entry->actor == NULL)
+		goto failed;
+
+	return 0;
+
+failed:
+	squashfs_cache_entry_free(entry);
+	return -ENOMEM;
+}
+
+
+/*
+ * Number of idle entries the shrinker could free.
+ */
+int squashfs_cache_count(struct squashfs_cache *cache)
+{
+	int i, count = 0;
+
+	if (cache == NULL)
+		return 0;
+
+	spin_lock(&cache->lock);
+	for (i = cache->entries - 1; i >= cache->min_entries; i--) {
+		if (cache->entry[i].refcount)
+			break;
+		count++;
+	}
+	spin_unlock(&cache->lock);
+
+	return count;
+}
+
+
+/*
+ * Free up to nr idle entries the cache grew by, from the last one down
+ * so that the entries in use stay the first ones.
+ */
+int squashfs_cache_shrink(struct squashfs_cache *cache, int nr)
+{
+	int freed = 0;
+
+	if (cache == NULL)
+		return 0;
+
+	spin_lock(&cache->lock);
+	/* An entry being added is past cache->entries, wait for it */
+	while (!cache->growing && freed < nr &&
+			cache->entries > cache->min_entries) {
+		struct squashfs_cache_entry *entry =
+			&cache->entry[cache->entries - 1];
+
+		if (entry->refcount)
+			break;
+
+		squashfs_cache_entry_free(entry);
+		cache->entries--;
+		cache->unused--;
+		freed++;
+	}
+
+	if (cache->curr_blk >= cache->entries)
+		cache->curr_blk = 0;
+	if (cache->next_blk >= cache->entries)
+		cache->next_blk = 0;
+	spin_unlock(&cache->lock);
+
+	return freed;
+}
+
+
 /*
  * Delete cache reclaiming all kmalloced buffers.
  */
 void squashfs_cache_delete(struct squashfs_cache *cache)
 {
-	int i, j;
+	int i;
 
 	if (cache == NULL)
 		return;
 
-	for (i = 0; i < cache->entries; i++) {
-		if (cache->entry[i].data) {
-			for (j = 0; j < cache->pages; j++)
-				kfree(cache->entry[i].data[j]);
-			kfree(cache->entry[i].data);
-		}
-		kfree(cache->entry[i].actor);
-	}
+	for (i = 0; i < cache->entries; i++)
+		squashfs_cache_entry_free(&cache->entry[i]);
 
 	kfree(cache->entry);
 	kfree(cache);
@@ -230,13 +380,12 @@ void squashfs_cache_delete(struct squashfs_cache *cache)
 
 /*
  * Initialise cache allocating the specified number of entries, each of
- * size block_size.  To avoid vmalloc fragmentation issues each entry
- * is allocated as a sequence of kmalloced PAGE_SIZE buffers.
+ * size block_size.  The cache may grow to max_entries entries.
  */
 struct squashfs_cache *squashfs_cache_init(char *name, int entries,
-	int block_size)
+	int max_entries, int block_size)
 {
-	int i, j;
+	int i;
 	struct squashfs_cache *cache = kzalloc(sizeof(*cache), GFP_KERNEL);
 
 	if (cache == NULL) {
@@ -244,7 +393,9 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 		return NULL;
 	}
 
-	cache->entry = kcalloc(entries, sizeof(*(cache->entry)), GFP_KERNEL);
+	max_entries = max(entries, max_entries);
+	cache->entry = kcalloc(max_entries, sizeof(*(cache->entry)),
+		GFP_KERNEL);
 	if (cache->entry == NULL) {
 		ERROR("Failed to allocate %s cache\n", name);
 		goto cleanup;
@@ -252,8 +403,10 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 
 	cache->curr_blk = 0;
 	cache->next_blk = 0;
-	cache->unused = entries;
-	cache->entries = entries;
+	cache->unused = 0;
+	cache->entries = 0;
+	cache->min_entries = entries;
+	cache->max_entries = max_entries;
 	cache->block_size = block_size;
 	cache->pages = block_size >> PAGE_SHIFT;
 	cache->pages = cache->pages ? cache->pages : 1;
@@ -262,32 +415,20 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	spin_lock_init(&cache->lock);
 	init_waitqueue_head(&cache->wait_queue);
 
-	for (i = 0; i < entries; i++) {
-		struct squashfs_cache_entry *entry = &cache->entry[i];
-
+	for (i = 0; i < max_entries; i++) {
 		init_waitqueue_head(&cache->entry[i].wait_queue);
-		entry->cache = cache;
-		entry->block = SQUASHFS_INVALID_BLK;
-		entry->data = kcalloc(cache->pages, sizeof(void *), GFP_KERNEL);
-		if (entry->data == NULL) {
-			ERROR("Failed to allocate %s cache entry\n", name);
-			goto cleanup;
-		}
-
-		for (j = 0; j < cache->pages; j++) {
-			entry->data[j] = kmalloc(PAGE_SIZE, GFP_KERNEL);
-			if (entry->data[j] == NULL) {
-				ERROR("Failed to allocate %s buffer\n", name);
-				goto cleanup;
-			}
-		}
+		cache->entry[i].cache = cache;
+		cache->entry[i].block = SQUASHFS_INVALID_BLK;
+	}
 
-		entry->actor = squashfs_page_actor_init(entry->data,
-						cache->pages, 0);
-		if (entry->actor == NULL) {
+	for (i = 0; i < entries; i++) {
+		if (squashfs_cache_entry_init(cache, &cache->entry[i],
+				GFP_KERNEL)) {
 			ERROR("Failed to allocate %s cache entry\n", name);
 			goto cleanup;
 		}
+		cache->entries++;
+		cache->unused++;
 	}
 
 	return cache;
@@ -38,6 +38,10 @@
  * Larger files use multiple slots, with 1.75 TiB files using all 8 slots.
  * The index cache is designed to be memory efficient, and by default uses
  * 16 KiB.
+ *
+ * Readahead issues the reads of all the datablocks in the readahead window
+ * at once, then decompresses each of them in a work item of its own.  With
+ * more than one decompressor the datablocks decompress in parallel.
  */
 
 #include <linux/fs.h>
@@ -47,6 +51,9 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/mm_inline.h>
+#include <linux/buffer_head.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -391,6 +398,36 @@ void squashfs_fill_page(struct page *page, struct squashfs_cache_entry *buffer,
 		SetPageError(page);
 }
 
+/*
+ * Copy a datablock read through the datablock cache into the pages of it
+ * readahead holds locked.  Page n of the block is page[n], NULL pages
+ * are skipped.
+ */
+int squashfs_fill_block_pages(struct inode *inode, struct page **page,
+	int pages, u64 block, int bsize, int expected)
+{
+	struct squashfs_cache_entry *buffer = squashfs_get_datablock(
+		inode->i_sb, block, bsize);
+	int res = buffer->error, n, offset;
+
+	if (res) {
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+		goto out;
+	}
+
+	for (n = 0, offset = 0; n < pages; n++, offset += PAGE_SIZE) {
+		int avail = clamp_t(int, expected - offset, 0, PAGE_SIZE);
+
+		if (page[n])
+			squashfs_fill_page(page[n], buffer, offset, avail);
+	}
+
+out:
+	squashfs_cache_put(buffer);
+	return res;
+}
+
 /* Copy data into page cache  */
 void squashfs_copy_cache(struct page *page, struct squashfs_cache_entry *buffer,
 	int bytes, int offset)
@@ -508,6 +545,151 @@ static int squashfs_readpage(struct file *file, struct page *page)
 }
 
 
+struct squashfs_readahead {
+	struct work_struct	work;
+	struct inode		*inode;
+	u64			block;
+	int			bsize;
+	int			expected;
+	int			pages;
+	struct page		*page[];
+};
+
+static void squashfs_readahead_work(struct work_struct *work)
+{
+	struct squashfs_readahead *ra = container_of(work,
+		struct squashfs_readahead, work);
+	int i, res;
+
+	res = squashfs_readahead_block(ra->inode, ra->page, ra->pages,
+		ra->block, ra->bsize, ra->expected);
+
+	for (i = 0; i < ra->pages; i++) {
+		if (ra->page[i] == NULL)
+			continue;
+		if (res < 0)
+			SetPageError(ra->page[i]);
+		unlock_page(ra->page[i]);
+		put_page(ra->page[i]);
+	}
+
+	iput(ra->inode);
+	kfree(ra);
+}
+
+/*
+ * Start reading the datablock @index, of which readahead holds the locked
+ * pages in @page.  The pages are unlocked and released once the datablock
+ * is decompressed, or right away when it isn't worth a work item.
+ */
+static void squashfs_readahead_start(struct file *file, struct inode *inode,
+	int index, struct page **page, int pages)
+{
+	struct super_block *sb = inode->i_sb;
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	int expected = index == file_end ?
+			(i_size_read(inode) & (msblk->block_size - 1)) :
+			 msblk->block_size;
+	struct squashfs_readahead *ra = NULL;
+	u64 block = 0, cur, end;
+	int i, bsize = 0;
+
+	if (index < file_end || squashfs_i(inode)->fragment_block ==
+					SQUASHFS_INVALID_BLK) {
+		bsize = read_blocklist(inode, index, &block);
+		if (bsize > 0)
+			ra = kmalloc(struct_size(ra, page, pages), GFP_KERNEL);
+	}
+
+	/* Sparse and fragment blocks, and errors, are left to readpage */
+	if (ra == NULL) {
+		for (i = 0; i < pages; i++) {
+			if (page[i] == NULL)
+				continue;
+			squashfs_readpage(file, page[i]);
+			put_page(page[i]);
+		}
+		return;
+	}
+
+	ihold(inode);
+	ra->inode = inode;
+	ra->block = block;
+	ra->bsize = bsize;
+	ra->expected = expected;
+	ra->pages = pages;
+	memcpy(ra->page, page, pages * sizeof(*page));
+	INIT_WORK(&ra->work, squashfs_readahead_work);
+
+	/* Submit the read now, the work waits for it in squashfs_read_data */
+	cur = block >> msblk->devblksize_log2;
+	end = (block + SQUASHFS_COMPRESSED_SIZE_BLOCK(bsize) - 1) >>
+		msblk->devblksize_log2;
+	if (block + SQUASHFS_COMPRESSED_SIZE_BLOCK(bsize) <= msblk->bytes_used)
+		for (; cur <= end; cur++)
+			sb_breadahead(sb, cur);
+
+	queue_work(msblk->read_wq, &ra->work);
+}
+
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned int nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	int mask = (1 << shift) - 1;
+	int file_end = (i_size_read(inode) - 1) >> PAGE_SHIFT;
+	int index = -1, count = 0;
+	struct page **page;
+
+	page = kcalloc(mask + 1, sizeof(*page), GFP_KERNEL);
+	if (page == NULL)
+		return -ENOMEM;
+
+	/* Pages come in ascending order, gather them by datablock */
+	while (!list_empty(pages)) {
+		struct page *p = lru_to_page(pages);
+
+		list_del(&p->lru);
+		if (add_to_page_cache_lru(p, mapping, p->index,
+				readahead_gfp_mask(mapping))) {
+			put_page(p);
+			continue;
+		}
+
+		if (p->index > file_end) {
+			/* Beyond the end of the file, readpage zeroes it */
+			squashfs_readpage(file, p);
+			put_page(p);
+			continue;
+		}
+
+		if ((p->index >> shift) != index) {
+			if (count)
+				squashfs_readahead_start(file, inode, index,
+					page, min_t(int, mask,
+					file_end - (index << shift)) + 1);
+			memset(page, 0, (mask + 1) * sizeof(*page));
+			count = 0;
+			index = p->index >> shift;
+		}
+
+		page[p->index & mask] = p;
+		count++;
+	}
+
+	if (count)
+		squashfs_readahead_start(file, inode, index, page,
+			min_t(int, mask, file_end - (index << shift)) + 1);
+
+	kfree(page);
+	return 0;
+}
+
+
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
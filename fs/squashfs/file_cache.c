@@ -36,3 +36,11 @@ int squashfs_readpage_block(struct page *page, u64 block, int bsize, int expecte
 	squashfs_cache_put(buffer);
 	return res;
 }
+
+/* Read a datablock for readahead and memcopy it into its pages */
+int squashfs_readahead_block(struct inode *inode, struct page **page,
+	int pages, u64 block, int bsize, int expected)
+{
+	return squashfs_fill_block_pages(inode, page, pages, block, bsize,
+		expected);
+}
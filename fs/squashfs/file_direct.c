@@ -143,6 +143,49 @@ int squashfs_readpage_block(struct page *target_page, u64 block, int bsize,
 }
 
 
+/*
+ * Read a datablock for readahead directly into its pages, unless
+ * readahead doesn't hold all of them
+ */
+int squashfs_readahead_block(struct inode *inode, struct page **page,
+	int pages, u64 block, int bsize, int expected)
+{
+	struct squashfs_page_actor *actor;
+	void *pageaddr;
+	int i, bytes, res;
+
+	for (i = 0; i < pages; i++)
+		if (page[i] == NULL)
+			return squashfs_fill_block_pages(inode, page, pages,
+				block, bsize, expected);
+
+	actor = squashfs_page_actor_init_special(page, pages, 0);
+	if (actor == NULL)
+		return -ENOMEM;
+
+	res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+	kfree(actor);
+	if (res < 0)
+		return res;
+	if (res != expected)
+		return -EIO;
+
+	/* Last page may have trailing bytes not filled */
+	bytes = res % PAGE_SIZE;
+	if (bytes) {
+		pageaddr = kmap_atomic(page[pages - 1]);
+		memset(pageaddr + bytes, 0, PAGE_SIZE - bytes);
+		kunmap_atomic(pageaddr);
+	}
+
+	for (i = 0; i < pages; i++) {
+		flush_dcache_page(page[i]);
+		SetPageUptodate(page[i]);
+	}
+
+	return 0;
+}
+
 static int squashfs_read_cache(struct page *target_page, u64 block, int bsize,
 	int pages, struct page **page, int bytes)
 {
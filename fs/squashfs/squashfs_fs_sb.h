@@ -23,11 +23,19 @@
  * squashfs_fs_sb.h
  */
 
+#include <linux/kobject.h>
+#include <linux/completion.h>
+
 #include "squashfs_fs.h"
 
 struct squashfs_cache {
 	char			*name;
 	int			entries;
+	int			min_entries;
+	int			max_entries;
+	int			growing;
+	unsigned long		hits;
+	unsigned long		misses;
 	int			curr_blk;
 	int			next_blk;
 	int			num_waiters;
@@ -67,6 +75,7 @@ struct squashfs_sb_info {
 	struct mutex				meta_index_mutex;
 	struct meta_index			*meta_index;
 	struct squashfs_stream			*stream;
+	struct workqueue_struct			*read_wq;
 	__le64					*inode_lookup_table;
 	u64					inode_table;
 	u64					directory_table;
@@ -77,5 +86,7 @@ struct squashfs_sb_info {
 	unsigned int				inodes;
 	unsigned int				fragments;
 	int					xattr_ids;
+	struct kobject				kobj;
+	struct completion			kobj_unregister;
 };
 #endif
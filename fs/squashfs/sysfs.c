@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * sysfs.c
+ */
+
+/*
+ * This file implements /sys/fs/squashfs/<dev>/, which reports how well the
+ * caches of decompressed blocks do: for each of the metadata, fragment and
+ * data caches the number of entries it has, and the number of lookups
+ * which found the block in it (hits) and which had to read and decompress
+ * the block (misses).
+ */
+
+#include <linux/fs.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/completion.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs.h"
+
+enum {
+	attr_cache_entries,
+	attr_cache_hits,
+	attr_cache_misses,
+};
+
+struct squashfs_attr {
+	struct attribute attr;
+	int cache_offset;
+	int stat;
+};
+
+#define SQUASHFS_CACHE_ATTR(_name, _cache, _stat)			\
+static struct squashfs_attr squashfs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0444 },		\
+	.cache_offset = offsetof(struct squashfs_sb_info, _cache),	\
+	.stat = attr_cache_##_stat,					\
+}
+
+SQUASHFS_CACHE_ATTR(metadata_cache_entries, block_cache, entries);
+SQUASHFS_CACHE_ATTR(metadata_cache_hits, block_cache, hits);
+SQUASHFS_CACHE_ATTR(metadata_cache_misses, block_cache, misses);
+SQUASHFS_CACHE_ATTR(fragment_cache_entries, fragment_cache, entries);
+SQUASHFS_CACHE_ATTR(fragment_cache_hits, fragment_cache, hits);
+SQUASHFS_CACHE_ATTR(fragment_cache_misses, fragment_cache, misses);
+SQUASHFS_CACHE_ATTR(data_cache_entries, read_page, entries);
+SQUASHFS_CACHE_ATTR(data_cache_hits, read_page, hits);
+SQUASHFS_CACHE_ATTR(data_cache_misses, read_page, misses);
+
+static struct attribute *squashfs_attrs[] = {
+	&squashfs_attr_metadata_cache_entries.attr,
+	&squashfs_attr_metadata_cache_hits.attr,
+	&squashfs_attr_metadata_cache_misses.attr,
+	&squashfs_attr_fragment_cache_entries.attr,
+	&squashfs_attr_fragment_cache_hits.attr,
+	&squashfs_attr_fragment_cache_misses.attr,
+	&squashfs_attr_data_cache_entries.attr,
+	&squashfs_attr_data_cache_hits.attr,
+	&squashfs_attr_data_cache_misses.attr,
+	NULL,
+};
+
+static struct kset *squashfs_kset;
+
+static ssize_t squashfs_attr_show(struct kobject *kobj,
+	struct attribute *attr, char *buf)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, kobj);
+	struct squashfs_attr *a = container_of(attr, struct squashfs_attr,
+		attr);
+	struct squashfs_cache *cache = *(struct squashfs_cache **)
+		((char *)msblk + a->cache_offset);
+	unsigned long val = 0;
+
+	/* Filesystems without fragments have no fragment cache */
+	if (cache) {
+		spin_lock(&cache->lock);
+		switch (a->stat) {
+		case attr_cache_entries:
+			val = cache->entries;
+			break;
+		case attr_cache_hits:
+			val = cache->hits;
+			break;
+		case attr_cache_misses:
+			val = cache->misses;
+			break;
+		}
+		spin_unlock(&cache->lock);
+	}
+
+	return snprintf(buf, PAGE_SIZE, "%lu\n", val);
+}
+
+static void squashfs_sb_release(struct kobject *kobj)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, kobj);
+
+	complete(&msblk->kobj_unregister);
+}
+
+static const struct sysfs_ops squashfs_attr_ops = {
+	.show	= squashfs_attr_show,
+};
+
+static struct kobj_type squashfs_sb_ktype = {
+	.default_attrs	= squashfs_attrs,
+	.sysfs_ops	= &squashfs_attr_ops,
+	.release	= squashfs_sb_release,
+};
+
+int squashfs_sysfs_register(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int err;
+
+	msblk->kobj.kset = squashfs_kset;
+	init_completion(&msblk->kobj_unregister);
+	err = kobject_init_and_add(&msblk->kobj, &squashfs_sb_ktype, NULL,
+		"%s", sb->s_id);
+	if (err) {
+		kobject_put(&msblk->kobj);
+		wait_for_completion(&msblk->kobj_unregister);
+	}
+
+	return err;
+}
+
+void squashfs_sysfs_unregister(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	kobject_del(&msblk->kobj);
+	kobject_put(&msblk->kobj);
+	wait_for_completion(&msblk->kobj_unregister);
+}
+
+int __init squashfs_sysfs_init(void)
+{
+	squashfs_kset = kset_create_and_add("squashfs", NULL, fs_kobj);
+
+	return squashfs_kset ? 0 : -ENOMEM;
+}
+
+void squashfs_sysfs_exit(void)
+{
+	kset_unregister(squashfs_kset);
+}
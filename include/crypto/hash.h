@@ -166,6 +166,12 @@ struct shash_desc {
  * @export: see struct ahash_alg
  * @import: see struct ahash_alg
  * @setkey: see struct ahash_alg
+ * @finup_mb: **[optional]** Like @finup, for @num_msgs messages of the same
+ *	      length all starting from the state of @desc, which is left as it
+ *	      is. Implementations hash the messages interleaved, to make use of
+ *	      the execution units one message alone leaves idle. Only called
+ *	      with 2 to @mb_max_msgs messages.
+ * @mb_max_msgs: How many messages @finup_mb can take at most, or 0 without it
  * @digestsize: see struct ahash_alg
  * @statesize: see struct ahash_alg
  * @descsize: Size of the operational state for the message digest. This state
@@ -186,6 +192,10 @@ struct shash_alg {
 	int (*import)(struct shash_desc *desc, const void *in);
 	int (*setkey)(struct crypto_shash *tfm, const u8 *key,
 		      unsigned int keylen);
+	int (*finup_mb)(struct shash_desc *desc, const u8 * const data[],
+			unsigned int len, u8 * const outs[],
+			unsigned int num_msgs);
+	unsigned int mb_max_msgs;
 
 	unsigned int descsize;
 
@@ -939,4 +949,62 @@ static inline void shash_desc_zero(struct shash_desc *desc)
 			 sizeof(*desc) + crypto_shash_descsize(desc->tfm));
 }
 
+/**
+ * crypto_shash_mb_max_msgs() - most messages hashed together
+ * @tfm: hash transformation object
+ *
+ * Return: the number of messages the algorithm hashes together at most, 1
+ *	   when it hashes them one after the other
+ */
+static inline unsigned int crypto_shash_mb_max_msgs(struct crypto_shash *tfm)
+{
+	return max(crypto_shash_alg(tfm)->mb_max_msgs, 1U);
+}
+
+/**
+ * crypto_shash_finup_mb() - calculate message digests of several buffers
+ * @desc: operational state handle, the state all messages start from. It is
+ *	  left as it is.
+ * @data: the @num_msgs messages
+ * @len: the length of each message
+ * @outs: the output buffers of the message digests
+ * @num_msgs: number of messages, see crypto_shash_mb_max_msgs()
+ *
+ * This is crypto_shash_finup() from the state in @desc for each message.
+ * Users hashing many independent messages of the same length, such as the
+ * blocks of a Merkle tree, get them hashed interleaved by @num_msgs up to
+ * crypto_shash_mb_max_msgs() when the algorithm supports it.
+ *
+ * Return: 0 if the message digest creation was successful; < 0 if an error
+ *	   occurred
+ */
+static inline int crypto_shash_finup_mb(struct shash_desc *desc,
+					const u8 * const data[],
+					unsigned int len, u8 * const outs[],
+					unsigned int num_msgs)
+{
+	struct crypto_shash *tfm = desc->tfm;
+	struct shash_alg *alg = crypto_shash_alg(tfm);
+	unsigned int i;
+	int err;
+
+	if (num_msgs > 1 && num_msgs <= alg->mb_max_msgs &&
+	    !crypto_shash_alignmask(tfm))
+		return alg->finup_mb(desc, data, len, outs, num_msgs);
+
+	for (i = 0; i < num_msgs; i++) {
+		SHASH_DESC_ON_STACK(d, tfm);
+
+		d->tfm = tfm;
+		d->flags = desc->flags;
+		memcpy(shash_desc_ctx(d), shash_desc_ctx(desc),
+		       crypto_shash_descsize(tfm));
+		err = crypto_shash_finup(d, data[i], len, outs[i]);
+		shash_desc_zero(d);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
 #endif	/* _CRYPTO_HASH_H */
@@ -29,6 +29,9 @@
 
 #define MAX_WAIT_SCHED_ENTITY_Q_EMPTY msecs_to_jiffies(1000)
 
+/* Most dependencies of a job gathered for a single wakeup */
+#define DRM_SCHED_DEP_BATCH	8
+
 struct drm_gpu_scheduler;
 struct drm_sched_rq;
 
@@ -63,10 +66,17 @@ enum drm_sched_priority {
  * @dependency: the dependency fence of the job which is on the top
  *              of the job queue.
  * @cb: callback for the dependency fence above.
+ * @deps: dependency fences of the job on top of the job queue, gathered
+ *        to be waited for at once.
+ * @num_deps: number of fences in @deps.
  * @guilty: points to ctx's guilty.
  * @fini_status: contains the exit status in case the process was signalled.
  * @last_scheduled: points to the finished fence of the last scheduled job.
  * @last_user: last group leader pushing a job into the entity.
+ * @vruntime: the GPU time charged to the entity, scaled by the weight of
+ *            its priority.
+ * @avg_runtime: moving average of the time its jobs took, in ns.
+ * @last_served: jiffies the entity last had a job run or became ready.
  *
  * Entities will emit jobs in order to their corresponding hardware
  * ring, and the scheduler will alternate between entities based on
@@ -84,9 +94,15 @@ struct drm_sched_entity {
 
 	struct dma_fence		*dependency;
 	struct dma_fence_cb		cb;
+	struct dma_fence		*deps[DRM_SCHED_DEP_BATCH];
+	unsigned int			num_deps;
 	atomic_t			*guilty;
 	struct dma_fence                *last_scheduled;
 	struct task_struct		*last_user;
+
+	u64				vruntime;
+	u64				avg_runtime;
+	unsigned long			last_served;
 };
 
 /**
@@ -211,7 +227,10 @@ struct drm_sched_backend_ops {
 	/**
          * @dependency: Called when the scheduler is considering scheduling
          * this job next, to get another struct dma_fence for this job to
-	 * block on.  Once it returns NULL, run_job() may be called.
+	 * block on.  Once it returns NULL, run_job() may be called.  With
+	 * &drm_gpu_scheduler.batch_deps set, it may be called again before
+	 * the fence it returned has signaled, as up to DRM_SCHED_DEP_BATCH
+	 * fences are gathered and waited for at once.
 	 */
 	struct dma_fence *(*dependency)(struct drm_sched_job *sched_job,
 					struct drm_sched_entity *s_entity);
@@ -252,11 +271,15 @@ struct drm_sched_backend_ops {
  *                 finished.
  * @hw_rq_count: the number of jobs currently in the hardware queue.
  * @job_id_count: used to assign unique id to the each job.
+ * @min_vruntime: the least time charged to the entities, that idle
+ *                entities are brought up to when they get jobs.
  * @thread: the kthread on which the scheduler which run.
  * @ring_mirror_list: the list of jobs which are currently in the job queue.
  * @job_list_lock: lock to protect the ring_mirror_list.
  * @hang_limit: once the hangs by a job crosses this limit then it is marked
  *              guilty and it will be considered for scheduling further.
+ * @batch_deps: set by drivers whose dependency() hands out each fence once,
+ *              so that it can be called again before the fence signaled.
  *
  * One scheduler is implemented for each hardware ring.
  */
@@ -270,10 +293,12 @@ struct drm_gpu_scheduler {
 	wait_queue_head_t		job_scheduled;
 	atomic_t			hw_rq_count;
 	atomic64_t			job_id_count;
+	atomic64_t			min_vruntime;
 	struct task_struct		*thread;
 	struct list_head		ring_mirror_list;
 	spinlock_t			job_list_lock;
 	int				hang_limit;
+	bool				batch_deps;
 };
 
 int drm_sched_init(struct drm_gpu_scheduler *sched,
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Inline encryption context of bios
+ *
+ * A bio carrying an inline encryption context has its data encrypted (for
+ * writes) or decrypted (for reads) by the storage controller, with the key
+ * and data unit number of the context, instead of by the CPU.
+ */
+#ifndef __LINUX_BIO_CRYPT_CTX_H
+#define __LINUX_BIO_CRYPT_CTX_H
+
+#include <linux/blk_types.h>
+
+enum blk_crypto_mode_num {
+	BLK_ENCRYPTION_MODE_INVALID,
+	BLK_ENCRYPTION_MODE_AES_256_XTS,
+	BLK_ENCRYPTION_MODE_MAX,
+};
+
+#define BLK_CRYPTO_MAX_KEY_SIZE		64
+
+/**
+ * struct blk_crypto_key - an inline encryption key
+ * @raw: the raw bytes of the key
+ * @size: size of @raw in bytes
+ * @crypto_mode: encryption algorithm the key is for
+ * @data_unit_size: the data unit size, the IV being the data unit number
+ * @data_unit_size_bits: log2 of @data_unit_size
+ */
+struct blk_crypto_key {
+	u8 raw[BLK_CRYPTO_MAX_KEY_SIZE];
+	unsigned int size;
+	enum blk_crypto_mode_num crypto_mode;
+	unsigned int data_unit_size;
+	unsigned int data_unit_size_bits;
+};
+
+struct request_queue;
+
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+
+/**
+ * struct bio_crypt_ctx - inline encryption context of a bio
+ * @bc_key: key to en/decrypt the data of the bio with, owned by the caller
+ *	    which must keep it alive until the bio is freed
+ * @bc_dun: data unit number of the first data unit of the bio
+ * @bc_ksm: keyslot manager owning @bc_keyslot
+ * @bc_keyslot: keyslot @bc_key is programmed in, or -1 until the bio is
+ *		submitted to a queue
+ */
+struct bio_crypt_ctx {
+	const struct blk_crypto_key *bc_key;
+	u64 bc_dun;
+	struct keyslot_manager *bc_ksm;
+	int bc_keyslot;
+};
+
+static inline bool bio_has_crypt_ctx(struct bio *bio)
+{
+	return bio->bi_crypt_context;
+}
+
+int blk_crypto_init_key(struct blk_crypto_key *key, const u8 *raw_key,
+			unsigned int raw_key_size,
+			enum blk_crypto_mode_num crypto_mode,
+			unsigned int data_unit_size);
+bool blk_crypto_mode_supported(struct request_queue *q,
+			       enum blk_crypto_mode_num crypto_mode,
+			       unsigned int data_unit_size);
+int blk_crypto_evict_key(struct request_queue *q,
+			 const struct blk_crypto_key *key);
+
+void bio_crypt_set_ctx(struct bio *bio, const struct blk_crypto_key *key,
+		       u64 dun, gfp_t gfp_mask);
+void bio_crypt_free_ctx(struct bio *bio);
+int bio_crypt_clone(struct bio *dst, struct bio *src, gfp_t gfp_mask);
+void bio_crypt_advance(struct bio *bio, unsigned int bytes);
+bool bio_crypt_ctx_compatible(struct bio *b1, struct bio *b2);
+bool bio_crypt_ctx_mergeable(struct bio *b1, unsigned int b1_bytes,
+			     struct bio *b2);
+
+#else /* CONFIG_BLK_INLINE_ENCRYPTION */
+
+static inline bool bio_has_crypt_ctx(struct bio *bio)
+{
+	return false;
+}
+
+static inline bool blk_crypto_mode_supported(struct request_queue *q,
+					     enum blk_crypto_mode_num mode,
+					     unsigned int data_unit_size)
+{
+	return false;
+}
+
+static inline void bio_crypt_free_ctx(struct bio *bio)
+{
+}
+
+static inline int bio_crypt_clone(struct bio *dst, struct bio *src,
+				  gfp_t gfp_mask)
+{
+	return 0;
+}
+
+static inline void bio_crypt_advance(struct bio *bio, unsigned int bytes)
+{
+}
+
+static inline bool bio_crypt_ctx_compatible(struct bio *b1, struct bio *b2)
+{
+	return true;
+}
+
+static inline bool bio_crypt_ctx_mergeable(struct bio *b1,
+					   unsigned int b1_bytes,
+					   struct bio *b2)
+{
+	return true;
+}
+
+#endif /* CONFIG_BLK_INLINE_ENCRYPTION */
+
+#endif /* __LINUX_BIO_CRYPT_CTX_H */
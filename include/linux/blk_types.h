@@ -13,6 +13,7 @@
 struct bio_set;
 struct bio;
 struct bio_integrity_payload;
+struct bio_crypt_ctx;
 struct page;
 struct block_device;
 struct io_context;
@@ -187,6 +188,9 @@ struct bio {
 		struct bio_integrity_payload *bi_integrity; /* data integrity */
 #endif
 	};
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+	struct bio_crypt_ctx	*bi_crypt_context;	/* inline encryption */
+#endif
 
 	unsigned short		bi_vcnt;	/* how many bio_vec's */
 
@@ -38,6 +38,7 @@ struct request;
 struct sg_io_hdr;
 struct bsg_job;
 struct blkcg_gq;
+struct keyslot_manager;
 struct blk_flush_queue;
 struct pr_ops;
 struct rq_qos;
@@ -559,6 +560,11 @@ struct request_queue {
 
 	struct blk_queue_tag	*queue_tags;
 
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+	/* Inline crypto capabilities, set by the driver */
+	struct keyslot_manager	*ksm;
+#endif
+
 	unsigned int		nr_sorted;
 	unsigned int		in_flight[2];
 
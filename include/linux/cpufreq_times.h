@@ -18,6 +18,7 @@
 
 #include <linux/cpufreq.h>
 #include <linux/pid.h>
+#include <uapi/linux/cpufreq_times.h>
 
 #ifdef CONFIG_CPU_FREQ_TIMES
 void cpufreq_task_times_init(struct task_struct *p);
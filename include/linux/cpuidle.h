@@ -29,10 +29,18 @@ struct cpuidle_driver;
  * CPUIDLE DEVICE INTERFACE *
  ****************************/
 
+/* log2 buckets of us, the last one also counts all longer residencies */
+#define CPUIDLE_RESIDENCY_HIST_BUCKETS	24
+
 struct cpuidle_state_usage {
 	unsigned long long	disable;
 	unsigned long long	usage;
 	unsigned long long	time; /* in US */
+	unsigned long long	above; /* times it was too deep */
+	unsigned long long	below; /* times it was too shallow */
+#ifdef CONFIG_CPU_IDLE_RESIDENCY_HIST
+	unsigned long long	residency_hist[CPUIDLE_RESIDENCY_HIST_BUCKETS];
+#endif
 #ifdef CONFIG_SUSPEND
 	unsigned long long	s2idle_usage;
 	unsigned long long	s2idle_time; /* in US */
@@ -25,6 +25,7 @@
 #define DEVFREQ_GOV_POWERSAVE		"powersave"
 #define DEVFREQ_GOV_USERSPACE		"userspace"
 #define DEVFREQ_GOV_PASSIVE		"passive"
+#define DEVFREQ_GOV_MEMSTALL		"memstall"
 
 /* DEVFREQ notifier interface */
 #define DEVFREQ_TRANSITION_NOTIFIER	(0)
@@ -279,6 +280,36 @@ struct devfreq_passive_data {
 };
 #endif
 
+#if IS_ENABLED(CONFIG_DEVFREQ_GOV_MEMSTALL)
+struct devfreq_memstall_cpu;
+
+/**
+ * struct devfreq_memstall_data - void *data fed to struct devfreq
+ *	and devfreq_add_device
+ * @upthreshold:	Same as for struct devfreq_simple_ondemand_data.
+ * @downdifferential:	Same as for struct devfreq_simple_ondemand_data.
+ * @stall_upthreshold:	Share of the CPU cycles stalled on memory, in %,
+ *			from which the maximum frequency is used. Below it,
+ *			the frequency is at least the same share of it.
+ *			Specify 0 to use the default. Valid value = 0 to 100.
+ * @stall_event:	Raw PMU event counting the memory stall cycles.
+ *			Specify 0 to use the generic backend stall cycles.
+ * @cpus:		For the memstall governor's internal use.
+ *
+ * Unlike the simple ondemand governor, the memstall governor needs this
+ * data, even if all fields are left to 0.
+ */
+struct devfreq_memstall_data {
+	unsigned int upthreshold;
+	unsigned int downdifferential;
+	unsigned int stall_upthreshold;
+	u64 stall_event;
+
+	/* For memstall governor's internal use. Don't need to set them */
+	struct devfreq_memstall_cpu __percpu *cpus;
+};
+#endif
+
 #else /* !CONFIG_PM_DEVFREQ */
 static inline struct devfreq *devfreq_add_device(struct device *dev,
 					  struct devfreq_dev_profile *profile,
@@ -205,6 +205,46 @@ struct dma_buf_ops {
 	 * to be restarted.
 	 */
 	int (*end_cpu_access)(struct dma_buf *, enum dma_data_direction);
+
+	/**
+	 * @begin_cpu_access_partial:
+	 *
+	 * This is called from dma_buf_begin_cpu_access_partial() and works
+	 * like @begin_cpu_access, except that coherency only needs to be
+	 * established for the @len bytes at @offset, which the dma-buf core
+	 * has checked to lie within the buffer.
+	 *
+	 * This callback is optional. Without it @begin_cpu_access is called
+	 * for the whole buffer instead.
+	 *
+	 * Returns:
+	 *
+	 * 0 on success or a negative error code on failure, as for
+	 * @begin_cpu_access.
+	 */
+	int (*begin_cpu_access_partial)(struct dma_buf *dmabuf,
+					enum dma_data_direction dir,
+					unsigned long offset,
+					unsigned long len);
+
+	/**
+	 * @end_cpu_access_partial:
+	 *
+	 * This is called from dma_buf_end_cpu_access_partial() and is the
+	 * ranged counterpart of @end_cpu_access.
+	 *
+	 * This callback is optional. Without it @end_cpu_access is called
+	 * for the whole buffer instead.
+	 *
+	 * Returns:
+	 *
+	 * 0 on success or a negative error code on failure, as for
+	 * @end_cpu_access.
+	 */
+	int (*end_cpu_access_partial)(struct dma_buf *dmabuf,
+				      enum dma_data_direction dir,
+				      unsigned long offset,
+				      unsigned long len);
 	void *(*map)(struct dma_buf *, unsigned long);
 	void (*unmap)(struct dma_buf *, unsigned long, void *);
 
@@ -267,6 +307,7 @@ struct dma_buf_ops {
  * @poll: for userspace poll support
  * @cb_excl: for userspace poll support
  * @cb_shared: for userspace poll support
+ * @proc_seq: last /proc/<pid>/dmabuf walk that counted this buffer
  *
  * This represents a shared buffer, created by calling dma_buf_export(). The
  * userspace representation is a normal file descriptor, which can be created by
@@ -300,6 +341,8 @@ struct dma_buf {
 
 		__poll_t active;
 	} cb_excl, cb_shared;
+
+	u64 proc_seq;
 };
 
 /**
@@ -392,6 +435,12 @@ int dma_buf_begin_cpu_access(struct dma_buf *dma_buf,
 			     enum dma_data_direction dir);
 int dma_buf_end_cpu_access(struct dma_buf *dma_buf,
 			   enum dma_data_direction dir);
+int dma_buf_begin_cpu_access_partial(struct dma_buf *dma_buf,
+				     enum dma_data_direction dir,
+				     unsigned long offset, unsigned long len);
+int dma_buf_end_cpu_access_partial(struct dma_buf *dma_buf,
+				   enum dma_data_direction dir,
+				   unsigned long offset, unsigned long len);
 void *dma_buf_kmap(struct dma_buf *, unsigned long);
 void dma_buf_kunmap(struct dma_buf *, unsigned long, void *);
 
@@ -399,4 +448,14 @@ int dma_buf_mmap(struct dma_buf *, struct vm_area_struct *,
 		 unsigned long);
 void *dma_buf_vmap(struct dma_buf *);
 void dma_buf_vunmap(struct dma_buf *, void *vaddr);
+
+struct pid;
+struct pid_namespace;
+struct seq_file;
+struct task_struct;
+
+#ifdef CONFIG_DMA_SHARED_BUFFER
+int proc_dmabuf_show(struct seq_file *m, struct pid_namespace *ns,
+		     struct pid *pid, struct task_struct *task);
+#endif
 #endif /* __DMA_BUF_H__ */
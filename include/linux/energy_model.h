@@ -27,6 +27,11 @@ struct em_cap_state {
  * em_perf_domain - Performance domain
  * @table:		List of capacity states, in ascending order
  * @nr_cap_states:	Number of capacity states
+ * @idle_power:		Optional power drawn by the domain as a whole, on top
+ *			of the active power of its CPUs, whenever it is awake
+ *			rather than in its deepest idle state, in milli-watts
+ * @wakeup_energy:	Optional energy of waking the domain from its deepest
+ *			idle state and letting it go back to it, in micro-joules
  * @cpus:		Cpumask covering the CPUs of the domain
  *
  * A "performance domain" represents a group of CPUs whose performance is
@@ -37,11 +42,20 @@ struct em_cap_state {
 struct em_perf_domain {
 	struct em_cap_state *table;
 	int nr_cap_states;
+	unsigned long idle_power;
+	unsigned long wakeup_energy;
 	unsigned long cpus[0];
 };
 
 #define EM_CPU_MAX_POWER 0xFFFF
 
+/*
+ * The wake-up energy of a domain is accounted as if it was woken up once per
+ * EM_WAKEUP_PERIOD_MS, about a display frame, which is the typical period of
+ * the short tasks that should not wake a sleeping domain.
+ */
+#define EM_WAKEUP_PERIOD_MS 16
+
 struct em_data_callback {
 	/**
 	 * active_power() - Provide power at the next capacity state of a CPU
@@ -66,6 +80,8 @@ struct em_data_callback {
 struct em_perf_domain *em_cpu_get(int cpu);
 int em_register_perf_domain(cpumask_t *span, unsigned int nr_states,
 						struct em_data_callback *cb);
+int em_pd_set_idle_cost(struct em_perf_domain *pd, unsigned long idle_power,
+			unsigned long wakeup_energy);
 
 /**
  * em_pd_energy() - Estimates the energy consumed by the CPUs of a perf. domain
@@ -111,9 +127,9 @@ static inline unsigned long em_pd_energy(struct em_perf_domain *pd,
 	 *   cs->cap = --------------------                          (1)
 	 *                 cpu_max_freq
 	 *
-	 * So, ignoring the costs of idle states (which are not available in
-	 * the EM), the energy consumed by this CPU at that capacity state is
-	 * estimated as:
+	 * So, ignoring the costs of idle states (see em_pd_wake_energy() for
+	 * those of the whole domain), the energy consumed by this CPU at that
+	 * capacity state is estimated as:
 	 *
 	 *             cs->power * cpu_util
 	 *   cpu_nrg = --------------------                          (2)
@@ -148,6 +164,37 @@ static inline unsigned long em_pd_energy(struct em_perf_domain *pd,
 	return cs->cost * sum_util / scale_cpu;
 }
 
+/**
+ * em_pd_wake_energy() - Estimates the cost of waking a sleeping perf. domain
+ * @pd		: performance domain for which energy has to be estimated
+ * @util	: utilization that would wake the domain up
+ *
+ * Return: the energy consumed by the domain being awake while @util runs and
+ * by the wake-up itself, in the same unit as em_pd_energy(), or 0 if the Energy
+ * Model of the domain has no idle costs.
+ */
+static inline unsigned long em_pd_wake_energy(struct em_perf_domain *pd,
+					      unsigned long util)
+{
+	unsigned long idle_power = READ_ONCE(pd->idle_power);
+	unsigned long wakeup_energy = READ_ONCE(pd->wakeup_energy);
+	unsigned long scale_cpu;
+	int cpu;
+
+	if (!idle_power && !wakeup_energy)
+		return 0;
+
+	/*
+	 * The domain stays awake for about the busy time of @util, and the
+	 * wake-up energy (uJ) spread over its period (ms) is in mW.
+	 */
+	cpu = cpumask_first(to_cpumask(pd->cpus));
+	scale_cpu = arch_scale_cpu_capacity(NULL, cpu);
+
+	return idle_power * min(util, scale_cpu) / scale_cpu +
+	       wakeup_energy / EM_WAKEUP_PERIOD_MS;
+}
+
 /**
  * em_pd_nr_cap_states() - Get the number of capacity states of a perf. domain
  * @pd		: performance domain for which this must be done
@@ -169,6 +216,11 @@ static inline int em_register_perf_domain(cpumask_t *span,
 {
 	return -EINVAL;
 }
+static inline int em_pd_set_idle_cost(struct em_perf_domain *pd,
+			unsigned long idle_power, unsigned long wakeup_energy)
+{
+	return -EINVAL;
+}
 static inline struct em_perf_domain *em_cpu_get(int cpu)
 {
 	return NULL;
@@ -178,6 +230,11 @@ static inline unsigned long em_pd_energy(struct em_perf_domain *pd,
 {
 	return 0;
 }
+static inline unsigned long em_pd_wake_energy(struct em_perf_domain *pd,
+					      unsigned long util)
+{
+	return 0;
+}
 static inline int em_pd_nr_cap_states(struct em_perf_domain *pd)
 {
 	return 0;
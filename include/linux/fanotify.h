@@ -4,6 +4,66 @@
 
 #include <uapi/linux/fanotify.h>
 
+/*
+ * Events on the inode itself and on the entries of a directory, reported
+ * with FAN_REPORT_FID only, as there is no path to open a fd with.
+ */
+#define FAN_ATTRIB		0x00000004	/* Metadata changed */
+#define FAN_MOVED_FROM		0x00000040	/* File was moved from X */
+#define FAN_MOVED_TO		0x00000080	/* File was moved to Y */
+#define FAN_CREATE		0x00000100	/* Subfile was created */
+#define FAN_DELETE		0x00000200	/* Subfile was deleted */
+#define FAN_DELETE_SELF		0x00000400	/* Self was deleted */
+#define FAN_MOVE_SELF		0x00000800	/* Self was moved */
+
+#define FAN_MOVE		(FAN_MOVED_FROM | FAN_MOVED_TO)
+
+/* Report the fsid and file handle of the object instead of a fd */
+#define FAN_REPORT_FID		0x00000200
+
+#define FAN_MARK_INODE		0x00000000
+#define FAN_MARK_FILESYSTEM	0x00000100
+
+#define FAN_EVENT_INFO_TYPE_FID	1
+
+/* Variable length info record following event metadata */
+struct fanotify_event_info_header {
+	__u8 info_type;
+	__u8 pad;
+	__u16 len;
+};
+
+/* Unique file identifier info record */
+struct fanotify_event_info_fid {
+	struct fanotify_event_info_header hdr;
+	__kernel_fsid_t fsid;
+	/*
+	 * Following is an opaque struct file_handle that can be passed as
+	 * an argument to open_by_handle_at(2).
+	 */
+	unsigned char handle[0];
+};
+
+#define FAN_GROUP_FLAG(group, flag) \
+	((group)->fanotify_data.flags & (flag))
+
+#define FANOTIFY_INIT_FLAGS	(FAN_ALL_INIT_FLAGS | FAN_REPORT_FID)
+
+#define FANOTIFY_MARK_TYPE_BITS	(FAN_MARK_INODE | FAN_MARK_MOUNT | \
+				 FAN_MARK_FILESYSTEM)
+
+#define FANOTIFY_MARK_FLAGS	(FAN_ALL_MARK_FLAGS | FAN_MARK_FILESYSTEM)
+
+/* Events that require a fid to be reported, as they carry no path */
+#define FANOTIFY_INODE_EVENTS	(FAN_ATTRIB | FAN_MOVE | FAN_CREATE | \
+				 FAN_DELETE | FAN_DELETE_SELF | \
+				 FAN_MOVE_SELF)
+
+#define FANOTIFY_EVENTS		(FAN_ALL_EVENTS | FANOTIFY_INODE_EVENTS)
+
+#define FANOTIFY_OUTGOING_EVENTS	(FAN_ALL_OUTGOING_EVENTS | \
+					 FANOTIFY_INODE_EVENTS)
+
 /* not valid from userspace, only kernel internal */
-#define FAN_MARK_ONDIR		0x00000100
+#define FAN_MARK_ONDIR		0x80000000
 #endif /* _LINUX_FANOTIFY_H */
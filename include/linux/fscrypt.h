@@ -20,6 +20,7 @@
 
 struct fscrypt_ctx;
 struct fscrypt_info;
+struct buffer_head;
 
 struct fscrypt_str {
 	unsigned char *name;
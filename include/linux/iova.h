@@ -27,7 +27,7 @@ struct iova {
 struct iova_magazine;
 struct iova_cpu_rcache;
 
-#define IOVA_RANGE_CACHE_MAX_SIZE 6	/* log of max cached IOVA range size (in pages) */
+#define IOVA_RANGE_CACHE_MAX_SIZE 10	/* log of max cached IOVA range size (in pages) */
 #define MAX_GLOBAL_MAGS 32	/* magazines per bin */
 
 struct iova_rcache {
@@ -37,6 +37,14 @@ struct iova_rcache {
 	struct iova_cpu_rcache __percpu *cpu_rcaches;
 };
 
+/* Allocator statistics of a domain, see iova_domain_stats() */
+struct iova_stats {
+	unsigned long rcache_hits;	/* allocations served by the rcaches */
+	unsigned long rbtree_allocs;	/* allocations searched in the rbtree */
+	unsigned long rbtree_fails;	/* searches which found no free range */
+	unsigned long rbtree_frees;	/* ranges given back to the rbtree */
+};
+
 struct iova_domain;
 
 /* Call-Back from IOVA code into IOMMU drivers */
@@ -75,7 +83,9 @@ struct iova_domain {
 	unsigned long	granule;	/* pfn granularity for this domain */
 	unsigned long	start_pfn;	/* Lower limit for this domain */
 	unsigned long	dma_32bit_pfn;
+	unsigned long	max32_alloc_size; /* Size of last failed allocation */
 	struct iova	anchor;		/* rbtree lookup anchor */
+	struct iova_stats stats;	/* counted under iova_rbtree_lock */
 	struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];	/* IOVA range caches */
 
 	iova_flush_cb	flush_cb;	/* Call-Back function to flush IOMMU
@@ -163,6 +173,7 @@ void put_iova_domain(struct iova_domain *iovad);
 struct iova *split_and_remove_iova(struct iova_domain *iovad,
 	struct iova *iova, unsigned long pfn_lo, unsigned long pfn_hi);
 void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad);
+void iova_domain_stats(struct iova_domain *iovad, struct iova_stats *stats);
 #else
 static inline int iova_cache_get(void)
 {
@@ -265,6 +276,12 @@ static inline void free_cpu_cached_iovas(unsigned int cpu,
 					 struct iova_domain *iovad)
 {
 }
+
+static inline void iova_domain_stats(struct iova_domain *iovad,
+				     struct iova_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
 #endif
 
 #endif
@@ -265,7 +265,10 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__u32	s_padding[41];
+/* 0x00F8 */
+	__be32	s_num_inode_fc_blks;	/* Nr of inode fast commit blocks */
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +294,8 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+/* Vendor bit, kept clear of the range upstream allocates from */
+#define JBD2_FEATURE_INCOMPAT_INODE_FC		0x80000000
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +306,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_INODE_FC)
 
 #ifdef __KERNEL__
 
@@ -740,6 +746,9 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/* Buckets of the commit time histogram, the first up to 64us, then x4 */
+#define JBD2_COMMIT_HIST_BUCKETS	8
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -902,6 +911,22 @@ struct journal_s
 	 */
 	unsigned long		j_last;
 
+	/**
+	 * @j_fc_first:
+	 *
+	 * The block number of the first fast commit block in the journal,
+	 * which are past @j_last.
+	 */
+	unsigned long		j_fc_first;
+
+	/**
+	 * @j_fc_last:
+	 *
+	 * The block number one beyond the last fast commit block in the
+	 * journal.
+	 */
+	unsigned long		j_fc_last;
+
 	/**
 	 * @j_dev: Device where we store the journal.
 	 */
@@ -1068,6 +1093,28 @@ struct journal_s
 	 */
 	u64			j_average_commit_time;
 
+	/**
+	 * @j_average_commit_record_time:
+	 *
+	 * The average amount of time in nanoseconds it takes to write the
+	 * commit record, including the cache flush. [j_state_lock]
+	 */
+	u64			j_average_commit_record_time;
+
+	/**
+	 * @j_max_commit_time:
+	 *
+	 * The longest commit in nanoseconds. [j_state_lock]
+	 */
+	u64			j_max_commit_time;
+
+	/**
+	 * @j_commit_time_hist:
+	 *
+	 * Number of commits per commit time bucket. [j_state_lock]
+	 */
+	unsigned long		j_commit_time_hist[JBD2_COMMIT_HIST_BUCKETS];
+
 	/**
 	 * @j_min_batch_time:
 	 *
@@ -1092,6 +1139,21 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/**
+	 * @j_fc_replay_callback:
+	 *
+	 * Called during recovery for each fast commit block in turn, after
+	 * the transactions were replayed, with the ID of the first
+	 * transaction which didn't commit; fast commits made while it was
+	 * running are to be replayed. Returns 1 to be called for the next
+	 * block, 0 once a block isn't part of those fast commits, or a
+	 * negative error code.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							unsigned int off,
+							tid_t expected_tid);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1221,6 +1283,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(inode_fc,		INODE_FC)
 
 /*
  * Journal flag definitions
@@ -1395,6 +1458,9 @@ extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
 extern int	   jbd2_journal_clear_err  (journal_t *);
 extern int	   jbd2_journal_bmap(journal_t *, unsigned long, unsigned long long *);
+extern int	   jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks);
+extern struct buffer_head *jbd2_fc_get_buf(journal_t *journal,
+					   unsigned int off);
 extern int	   jbd2_journal_force_commit(journal_t *);
 extern int	   jbd2_journal_force_commit_nested(journal_t *);
 extern int	   jbd2_journal_inode_add_write(handle_t *handle, struct jbd2_inode *inode);
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Lightweight lock contention profiler
+ *
+ * Records how long the slow paths of mutexes, rwsems and queued spinlocks
+ * wait, as histograms per call site, without lockdep.  It is off by default
+ * and turned on at runtime through <debugfs>/lock_contention/enable, so it
+ * costs a patched out branch per slow path until then.
+ */
+#ifndef __LINUX_LOCK_CONTENTION_H
+#define __LINUX_LOCK_CONTENTION_H
+
+#include <linux/jump_label.h>
+#include <linux/sched/clock.h>
+
+enum lock_contention_type {
+	LOCK_CONTENTION_MUTEX,
+	LOCK_CONTENTION_RWSEM_READ,
+	LOCK_CONTENTION_RWSEM_WRITE,
+	LOCK_CONTENTION_SPINLOCK,
+	LOCK_CONTENTION_NR_TYPES,
+};
+
+DECLARE_STATIC_KEY_FALSE(lock_contention_key);
+
+void __lock_contention_end(u64 start, unsigned long ip,
+			   enum lock_contention_type type);
+
+/*
+ * Returns the time a slow path started waiting at, to be given back to
+ * lock_contention_end(), or 0 when profiling is off.
+ */
+static __always_inline u64 lock_contention_begin(void)
+{
+	if (static_branch_unlikely(&lock_contention_key))
+		return local_clock() ?: 1;
+	return 0;
+}
+
+/*
+ * Called once the waiter holds the lock; waits given up on a signal are
+ * not recorded.  @ip is a return address on the stack of the waiter, from
+ * where its call site is looked for.
+ */
+static __always_inline void lock_contention_end(u64 start, unsigned long ip,
+						enum lock_contention_type type)
+{
+	if (unlikely(start))
+		__lock_contention_end(start, ip, type);
+}
+
+#endif /* __LINUX_LOCK_CONTENTION_H */
@@ -179,9 +179,20 @@ struct netlink_callback {
 	u16			family;
 	u16			min_dump_alloc;
 	unsigned int		prev_seq, seq;
-	long			args[6];
+	/* State kept between the dump() calls of a dump: either the
+	 * historic array, or a private struct cast over ctx, see
+	 * NL_ASSERT_DUMP_CTX_FITS().
+	 */
+	union {
+		u8		ctx[48];
+		long		args[6];
+	};
 };
 
+#define NL_ASSERT_DUMP_CTX_FITS(type_name)				\
+	BUILD_BUG_ON(sizeof(type_name) >				\
+		     FIELD_SIZEOF(struct netlink_callback, ctx))
+
 struct netlink_notify {
 	struct net *net;
 	u32 portid;
@@ -68,6 +68,7 @@ struct wakeup_source {
 	unsigned long		relax_count;
 	unsigned long		expire_count;
 	unsigned long		wakeup_count;
+	u64			id;
 	bool			active:1;
 	bool			autosleep_enabled:1;
 };
@@ -42,6 +42,12 @@ struct tee_shm_pool;
  * struct tee_context - driver specific context on file pointer data
  * @teedev:	pointer to this drivers struct tee_device
  * @list_shm:	List of shared memory object owned by this context
+ * @list_shm_cache: Registered shared memory freed by this context, kept
+ *		registered for tee_shm_register() to reuse
+ * @shm_cache_entries: Number of entries in @list_shm_cache
+ * @shm_cache_pages: Number of pages pinned by @list_shm_cache
+ * @shm_cache_closed: Set once the context is closed, @list_shm_cache is
+ *		not filled anymore
  * @data:	driver specific context data, managed by the driver
  * @refcount:	reference counter for this structure
  * @releasing:  flag that indicates if context is being released right now.
@@ -51,6 +57,10 @@ struct tee_shm_pool;
 struct tee_context {
 	struct tee_device *teedev;
 	struct list_head list_shm;
+	struct list_head list_shm_cache;
+	size_t shm_cache_entries;
+	size_t shm_cache_pages;
+	bool shm_cache_closed;
 	void *data;
 	struct kref refcount;
 	bool releasing;
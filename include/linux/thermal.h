@@ -317,6 +317,13 @@ struct thermal_zone_params {
 	/* threshold below which the error is no longer accumulated */
 	s32 integral_cutoff;
 
+	/*
+	 * power_allocator: control for the temperature expected at the next
+	 * polling and grant the power to the heaviest weighted cooling
+	 * devices first
+	 */
+	bool predictive;
+
 	/*
 	 * @slope:	slope of a linear temperature adjustment curve.
 	 * 		Used by thermal zone drivers.
@@ -8,6 +8,10 @@
 #include <linux/virtio_byteorder.h>
 #include <uapi/linux/virtio_config.h>
 
+#ifndef VIRTIO_F_RING_PACKED
+#define VIRTIO_F_RING_PACKED		34
+#endif
+
 struct irq_affinity;
 
 /**
@@ -6,6 +6,41 @@
 #include <linux/irqreturn.h>
 #include <uapi/linux/virtio_ring.h>
 
+/* For uapi/linux/virtio_ring.h versions lacking the packed ring layout */
+#ifndef VRING_PACKED_DESC_F_AVAIL
+/* Mark a descriptor as available or used, in the packed ring. */
+#define VRING_PACKED_DESC_F_AVAIL	7
+#define VRING_PACKED_DESC_F_USED	15
+
+/* Enable events, in the packed ring. */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0x0
+/* Disable events, in the packed ring. */
+#define VRING_PACKED_EVENT_FLAG_DISABLE	0x1
+/* Enable events for a specific descriptor, in the packed ring. */
+#define VRING_PACKED_EVENT_FLAG_DESC	0x2
+
+/* Wrap counter bit shift in the event suppression off_wrap field. */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
+struct vring_packed_desc_event {
+	/* Descriptor Ring Change Event Offset/Wrap Counter. */
+	__le16 off_wrap;
+	/* Descriptor Ring Change Event Flags. */
+	__le16 flags;
+};
+
+struct vring_packed_desc {
+	/* Buffer Address. */
+	__le64 addr;
+	/* Buffer Length. */
+	__le32 len;
+	/* Buffer ID. */
+	__le16 id;
+	/* The flags depending on descriptor type. */
+	__le16 flags;
+};
+#endif
+
 /*
  * Barriers in virtio are tricky.  Non-SMP virtio guests can't assume
  * they're not on an SMP host system, so they need to assume real
@@ -376,7 +376,8 @@ typedef struct ZSTD_CDict_s ZSTD_CDict;
  *
  * When compressing multiple messages / blocks with the same dictionary it is
  * recommended to load it just once. The ZSTD_CDict merely references the
- * dictBuffer, so it must outlive the returned ZSTD_CDict.
+ * dictBuffer, so it must outlive the returned ZSTD_CDict. It is only read
+ * once initialized, so it may be shared by contexts compressing concurrently.
  *
  * Return:         The digested dictionary emplaced into workspace.
  */
@@ -431,7 +432,9 @@ typedef struct ZSTD_DDict_s ZSTD_DDict;
  *
  * When decompressing multiple messages / blocks with the same dictionary it is
  * recommended to load it just once. The ZSTD_DDict merely references the
- * dictBuffer, so it must outlive the returned ZSTD_DDict.
+ * dictBuffer, so it must outlive the returned ZSTD_DDict. It is only read
+ * once initialized, so it may be shared by contexts decompressing
+ * concurrently.
  *
  * Return:         The digested dictionary emplaced into workspace.
  */
@@ -458,6 +461,64 @@ size_t ZSTD_decompress_usingDDict(ZSTD_DCtx *dctx, void *dst,
 	size_t dstCapacity, const void *src, size_t srcSize,
 	const ZSTD_DDict *ddict);
 
+/*-**************************
+ * Workspace pools
+ ***************************/
+
+/**
+ * struct ZSTD_wsPool - a pool of workspaces of the same size
+ *
+ * Keeps the workspaces of contexts which are done with, for the next
+ * contexts of the same parameters to be initialized in, instead of
+ * allocating a workspace for every call. A typical user sizes the pool
+ * for the largest parameters it compresses with, and shares a digested
+ * dictionary between the contexts taking their workspaces from it.
+ */
+typedef struct ZSTD_wsPool_s ZSTD_wsPool;
+
+/**
+ * ZSTD_createWsPool() - create a pool of workspaces
+ * @workspaceSize: The size of the workspaces, for example
+ *                 ZSTD_CCtxWorkspaceBound() or ZSTD_DCtxWorkspaceBound().
+ * @maxIdle:       How many unused workspaces the pool keeps at most, usually
+ *                 the number of contexts expected to be used concurrently.
+ *
+ * Return:         The pool, or NULL if it could not be allocated.
+ */
+ZSTD_wsPool *ZSTD_createWsPool(size_t workspaceSize, unsigned int maxIdle);
+
+/**
+ * ZSTD_freeWsPool() - free a pool and its unused workspaces
+ * @pool: The pool. All of its workspaces must have been given back to it.
+ */
+void ZSTD_freeWsPool(ZSTD_wsPool *pool);
+
+/**
+ * ZSTD_wsPoolWorkspaceSize() - the size of the workspaces of a pool
+ * @pool: The pool.
+ *
+ * Return: The size to give along with its workspaces to ZSTD_initCCtx(),
+ *         ZSTD_initDCtx() and the like.
+ */
+size_t ZSTD_wsPoolWorkspaceSize(const ZSTD_wsPool *pool);
+
+/**
+ * ZSTD_getWorkspace() - take a workspace from a pool
+ * @pool: The pool.
+ * @gfp:  The flags to allocate a new workspace with, if none is unused.
+ *
+ * Return: The workspace, or NULL if it could not be allocated.
+ */
+void *ZSTD_getWorkspace(ZSTD_wsPool *pool, gfp_t gfp);
+
+/**
+ * ZSTD_putWorkspace() - give a workspace back to its pool
+ * @pool:      The pool the workspace was taken from.
+ * @workspace: The workspace. Whatever was initialized in it must not be
+ *             used anymore.
+ */
+void ZSTD_putWorkspace(ZSTD_wsPool *pool, void *workspace);
+
 
 /*-**************************
  * Streaming
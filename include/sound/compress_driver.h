@@ -28,6 +28,8 @@ struct snd_compr_ops;
  * @buffer_size: size of the above buffer
  * @fragment_size: size of buffer fragment in bytes
  * @fragments: number of such fragments
+ * @avail_min: bytes that must be free before poll reports playback writable
+ * @no_wake_mode: don't wake up sleepers on fragment elapsed
  * @total_bytes_available: cumulative number of bytes made available in
  *	the ring buffer
  * @total_bytes_transferred: cumulative bytes transferred by offload DSP
@@ -41,6 +43,8 @@ struct snd_compr_runtime {
 	u64 buffer_size;
 	u32 fragment_size;
 	u32 fragments;
+	u32 avail_min;
+	bool no_wake_mode;
 	u64 total_bytes_available;
 	u64 total_bytes_transferred;
 	wait_queue_head_t sleep;
@@ -57,6 +61,10 @@ struct snd_compr_runtime {
  * @direction: stream direction, playback/recording
  * @metadata_set: metadata set flag, true when set
  * @next_track: has userspace signal next track transition, true when set
+ * @mmap_buffer: set by the driver's open for playback streams whose ring
+ *	buffer the core allocates, to have it allocated with vmalloc so that
+ *	userspace can mmap it. The buffer is then not physically contiguous,
+ *	so the driver must not hand it to the DSP by physical address
  * @private_data: pointer to DSP private data
  */
 struct snd_compr_stream {
@@ -68,6 +76,7 @@ struct snd_compr_stream {
 	enum snd_compr_direction direction;
 	bool metadata_set;
 	bool next_track;
+	bool mmap_buffer;
 	void *private_data;
 };
 
@@ -163,7 +172,8 @@ int snd_compress_new(struct snd_card *card, int device,
  */
 static inline void snd_compr_fragment_elapsed(struct snd_compr_stream *stream)
 {
-	wake_up(&stream->runtime->sleep);
+	if (!stream->runtime->no_wake_mode)
+		wake_up(&stream->runtime->sleep);
 }
 
 static inline void snd_compr_drain_notify(struct snd_compr_stream *stream)
@@ -36,6 +36,7 @@ enum {
 	BINDER_TYPE_FD		= B_PACK_CHARS('f', 'd', '*', B_TYPE_LARGE),
 	BINDER_TYPE_FDA		= B_PACK_CHARS('f', 'd', 'a', B_TYPE_LARGE),
 	BINDER_TYPE_PTR		= B_PACK_CHARS('p', 't', '*', B_TYPE_LARGE),
+	BINDER_TYPE_DMABUF	= B_PACK_CHARS('d', 'b', '*', B_TYPE_LARGE),
 };
 
 /**
@@ -215,6 +216,36 @@ struct binder_fd_array_object {
 	binder_size_t			parent_offset;
 };
 
+/* struct binder_dmabuf_object - object describing a range of a dma-buf
+ * @hdr:		common header structure
+ * @flags:		BINDER_DMABUF_FLAG_* flags
+ * @fd:			dma-buf file descriptor
+ * @pad:		padding to ensure correct alignment
+ * @offset:		page-aligned start of the range in the dma-buf
+ * @length:		length of the range
+ * @buffer:		address of the range in the receiver
+ *
+ * A binder_dmabuf_object passes a range of a dma-buf without copying its
+ * contents through the binder buffer. The driver installs the dma-buf
+ * as a new @fd in the receiver, like a binder_fd_object, and when the
+ * transaction is delivered maps the range into the receiver's address
+ * space and stores its address in @buffer, or 0 if it could not be
+ * mapped. The receiver owns both the fd and the mapping.
+ */
+struct binder_dmabuf_object {
+	struct binder_object_header	hdr;
+	__u32				flags;
+	__u32				fd;
+	__u32				pad;
+	binder_size_t			offset;
+	binder_size_t			length;
+	binder_uintptr_t		buffer;
+};
+
+enum {
+	BINDER_DMABUF_FLAG_WRITE = 0x01,	/* map the range writable */
+};
+
 /*
  * On 64-bit platforms where user code may run in 32-bits the driver must
  * translate the buffer (and local binder) addresses appropriately.
@@ -264,6 +295,22 @@ struct binder_node_info_for_ref {
 	__u32            reserved3;
 };
 
+enum binder_alloc_policy_flags {
+	/* back the hot window with physically contiguous pages if possible */
+	BINDER_ALLOC_POLICY_HIGH_ORDER	= 0x01,
+};
+
+/*
+ * Use with BINDER_SET_ALLOC_POLICY. The first @hot_size bytes of the
+ * mmap'd buffer space are populated up front and never reclaimed by the
+ * binder shrinker. @hot_size can only grow.
+ */
+struct binder_alloc_policy {
+	__u64 hot_size;
+	__u32 flags;
+	__u32 reserved;
+};
+
 #define BINDER_WRITE_READ		_IOWR('b', 1, struct binder_write_read)
 #define BINDER_SET_IDLE_TIMEOUT		_IOW('b', 3, __s64)
 #define BINDER_SET_MAX_THREADS		_IOW('b', 5, __u32)
@@ -274,6 +321,7 @@ struct binder_node_info_for_ref {
 #define BINDER_GET_NODE_DEBUG_INFO	_IOWR('b', 11, struct binder_node_debug_info)
 #define BINDER_GET_NODE_INFO_FOR_REF	_IOWR('b', 12, struct binder_node_info_for_ref)
 #define BINDER_SET_CONTEXT_MGR_EXT	_IOW('b', 13, struct flat_binder_object)
+#define BINDER_SET_ALLOC_POLICY		_IOW('b', 14, struct binder_alloc_policy)
 
 /*
  * NOTE: Two special error codes you should check for when calling
@@ -342,6 +390,16 @@ struct binder_transaction_data_sg {
 	binder_size_t buffers_size;
 };
 
+/*
+ * Header of BC_TRANSACTION_BATCH. It is followed in the write buffer by
+ * @count struct binder_transaction_data_sg entries; all but the last one
+ * must be TF_ONE_WAY.
+ */
+struct binder_transaction_batch {
+	__u32 count;
+	__u32 reserved;
+};
+
 struct binder_ptr_cookie {
 	binder_uintptr_t ptr;
 	binder_uintptr_t cookie;
@@ -537,6 +595,12 @@ enum binder_driver_command_protocol {
 	/*
 	 * binder_transaction_data_sg: the sent command.
 	 */
+
+	BC_TRANSACTION_BATCH = _IOW('c', 19, struct binder_transaction_batch),
+	/*
+	 * binder_transaction_batch: header, followed by
+	 * binder_transaction_batch.count binder_transaction_data_sg.
+	 */
 };
 
 #endif /* _UAPI_LINUX_BINDER_H */
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Binary per-UID time in state export of /proc/uid_time_in_state_bin
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _UAPI_LINUX_CPUFREQ_TIMES_H
+#define _UAPI_LINUX_CPUFREQ_TIMES_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define UID_TIMES_VERSION	1
+
+/**
+ * struct uid_times_header - head of a /proc/uid_time_in_state_bin snapshot
+ * @version:		UID_TIMES_VERSION
+ * @header_size:	size of this header, the frequency table follows it
+ * @record_size:	size of each record, including the times arrays
+ * @nr_freqs:		number of __u32 frequencies (kHz) following the header,
+ *			and of time_in_state entries of each record
+ * @nr_cpus:		number of possible CPUs, and of entries of each of the
+ *			active and policy concurrent times arrays of a record
+ * @nr_records:		number of records following the frequency table
+ * @generation:		generation of this snapshot, pass it to
+ *			UID_TIMES_IOC_SET_SINCE to only get the UIDs updated
+ *			after this snapshot was started the next time
+ * @since:		only UIDs updated since that generation are included
+ *
+ * The frequency table is followed by @nr_records records, each made of a
+ * struct uid_times_record then, all in ns, @nr_freqs time in state values,
+ * @nr_cpus concurrent active times and @nr_cpus concurrent policy times,
+ * with the same meaning as in the text files.
+ */
+struct uid_times_header {
+	__u32	version;
+	__u32	header_size;
+	__u32	record_size;
+	__u32	nr_freqs;
+	__u32	nr_cpus;
+	__u32	nr_records;
+	__u64	generation;
+	__u64	since;
+};
+
+/**
+ * struct uid_times_record - fixed part of a UID record
+ * @uid:	the UID
+ * @pad:	padding for 64-bit alignment, always zero
+ */
+struct uid_times_record {
+	__u32	uid;
+	__u32	pad;
+};
+
+/* only report the UIDs updated since the given generation from now on */
+#define UID_TIMES_IOC_SET_SINCE	_IOW('t', 1, __u64)
+
+#endif /* _UAPI_LINUX_CPUFREQ_TIMES_H */
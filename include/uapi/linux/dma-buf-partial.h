@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Ranged CPU access synchronisation for dma-buf
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#ifndef _DMA_BUF_PARTIAL_UAPI_H_
+#define _DMA_BUF_PARTIAL_UAPI_H_
+
+#include <linux/types.h>
+
+/**
+ * struct dma_buf_sync_partial - argument of DMA_BUF_IOCTL_SYNC_PARTIAL
+ * @flags:	DMA_BUF_SYNC_* flags, as for DMA_BUF_IOCTL_SYNC
+ * @offset:	start of the range the CPU accesses, in bytes
+ * @len:	length of that range in bytes, must not be 0
+ *
+ * Like DMA_BUF_IOCTL_SYNC, but only the given range of the buffer is
+ * made coherent. Exporters without ranged support sync the whole buffer.
+ */
+struct dma_buf_sync_partial {
+	__u64 flags;
+	__u64 offset;
+	__u64 len;
+};
+
+#define DMA_BUF_IOCTL_SYNC_PARTIAL	_IOW('b', 8, struct dma_buf_sync_partial)
+
+#endif
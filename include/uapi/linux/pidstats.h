@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Binary per-process stat and statm export of /proc/pidstats
+ */
+
+#ifndef _UAPI_LINUX_PIDSTATS_H
+#define _UAPI_LINUX_PIDSTATS_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define PIDSTATS_VERSION	1
+
+/**
+ * struct pidstats_header - head of a /proc/pidstats snapshot
+ * @version:		PIDSTATS_VERSION
+ * @header_size:	size of this header, the records follow it
+ * @record_size:	size of each record
+ * @nr_records:		number of records following the header
+ * @page_size:		unit of the statm sizes of the records
+ * @pad:		always zero
+ *
+ * The header is followed by @nr_records struct pidstats_record, one per
+ * process, in ascending pid order.  Records may grow at their end in later
+ * versions, so step through them by @record_size.
+ */
+struct pidstats_header {
+	__u32	version;
+	__u32	header_size;
+	__u32	record_size;
+	__u32	nr_records;
+	__u32	page_size;
+	__u32	pad;
+};
+
+/**
+ * struct pidstats_record - stat and statm of a process
+ * @pid:		process id, as in the pid namespace of the proc mount
+ * @ppid:		parent process id
+ * @state:		task state, the letter of field 3 of /proc/<pid>/stat
+ * @nice:		nice value
+ * @num_threads:	number of threads
+ * @pad:		always zero
+ * @utime:		user time of all the threads, in ns
+ * @stime:		system time of all the threads, in ns
+ * @start_time:		time the process started after boot, in ns
+ * @min_flt:		minor faults of all the threads
+ * @maj_flt:		major faults of all the threads
+ * @vsize:		virtual memory size, in bytes
+ * @size:		total program size, in pages, as statm
+ * @resident:		resident set size, in pages, as statm
+ * @shared:		resident file backed and shmem pages, as statm
+ * @text:		text (code) size, in pages, as statm
+ * @data:		data and stack size, in pages, as statm
+ */
+struct pidstats_record {
+	__s32	pid;
+	__s32	ppid;
+	__u32	state;
+	__s32	nice;
+	__u32	num_threads;
+	__u32	pad;
+	__u64	utime;
+	__u64	stime;
+	__u64	start_time;
+	__u64	min_flt;
+	__u64	maj_flt;
+	__u64	vsize;
+	__u64	size;
+	__u64	resident;
+	__u64	shared;
+	__u64	text;
+	__u64	data;
+};
+
+/**
+ * struct pidstats_pids - processes to report
+ * @nr:		number of pids in the array, 0 to report all processes
+ * @pad:	must be zero
+ * @pids:	user pointer to an array of @nr __s32 pids
+ */
+struct pidstats_pids {
+	__u32	nr;
+	__u32	pad;
+	__u64	pids;
+};
+
+#define PIDSTATS_MAX_PIDS	65536
+
+/* only report the processes of the given pids from now on */
+#define PIDSTATS_IOC_SET_PIDS	_IOW(0xA7, 1, struct pidstats_pids)
+/*
+ * only report the processes whose main thread is in the cgroup2 directory
+ * of the given fd, or in one of its descendants, from now on; -1 to report
+ * all of them
+ */
+#define PIDSTATS_IOC_SET_CGROUP	_IOW(0xA7, 2, __s32)
+
+#endif /* _UAPI_LINUX_PIDSTATS_H */
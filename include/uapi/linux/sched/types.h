@@ -9,6 +9,53 @@ struct sched_param {
 };
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
+
+/*
+ * sched_flags for the utilization clamps, following the SCHED_FLAG_*
+ * values of <linux/sched.h>.
+ */
+#define SCHED_FLAG_UTIL_CLAMP_MIN	0x20
+#define SCHED_FLAG_UTIL_CLAMP_MAX	0x40
+
+#define SCHED_FLAG_UTIL_CLAMP	(SCHED_FLAG_UTIL_CLAMP_MIN | \
+				 SCHED_FLAG_UTIL_CLAMP_MAX)
+
+/* Place the task on an idle CPU at wake-up rather than the cheapest one */
+#define SCHED_FLAG_LATENCY_SENSITIVE	0x80
+
+/*
+ * Per-CPU PELT snapshot, one per page of /proc/sched_pelt, CPU n being at
+ * page offset n.
+ *
+ * The kernel updates a snapshot in place: @seq is odd while an update is in
+ * progress. Readers must load @seq, wait for it to be even, issue a read
+ * barrier, copy the fields, issue a read barrier and retry if @seq changed.
+ *
+ * All the utilization and capacity values are in SCHED_CAPACITY_SCALE
+ * units; @last_update_time is the rq task clock, in ns, of the last PELT
+ * update of the CFS run queue.
+ */
+struct sched_pelt_snapshot {
+	__u32 seq;
+	__u32 cpu;
+	__u64 last_update_time;
+
+	__u32 util_avg;
+	__u32 util_est;
+	__u32 rt_util_avg;
+	__u32 dl_util_avg;
+	__u32 irq_util_avg;
+
+	__u32 nr_running;
+	__u32 cfs_nr_running;
+	__u32 rt_nr_running;
+	__u32 dl_nr_running;
+
+	__u32 capacity;
+	__u32 capacity_orig;
+	__u32 __reserved;
+};
 
 /*
  * Extended scheduling parameters data structure.
@@ -53,6 +100,28 @@ struct sched_param {
  * As of now, the SCHED_DEADLINE policy (sched_dl scheduling class) is the
  * only user of this new interface. More information about the algorithm
  * available in the scheduling class file or in Documentation/.
+ *
+ * Task Utilization Attributes
+ * ===========================
+ *
+ * A subset of sched_attr attributes allows to describe a so-called
+ * utilization clamp on a task. When requested with the
+ * SCHED_FLAG_UTIL_CLAMP_{MIN,MAX} flags, they are applied to tasks of the
+ * FAIR and RT classes:
+ *
+ *  @sched_util_min	represents the minimum utilization
+ *  @sched_util_max	represents the maximum utilization
+ *
+ * Utilization is a value in the range [0..SCHED_CAPACITY_SCALE]. It
+ * represents the percentage of CPU time used by a task when running at the
+ * maximum frequency on the highest capacity CPU of the system. For example,
+ * a 20% utilization task is a task running for 2ms every 10ms at maximum
+ * frequency.
+ *
+ * A task with a min utilization value bigger than 0 is more likely scheduled
+ * on a CPU with a capacity big enough to fit the specified value.
+ * A task with a max utilization value smaller than 1024 is more likely
+ * scheduled on a CPU with no more capacity than the specified value.
  */
 struct sched_attr {
 	__u32 size;
@@ -70,6 +139,10 @@ struct sched_attr {
 	__u64 sched_runtime;
 	__u64 sched_deadline;
 	__u64 sched_period;
+
+	/* Utilization hints */
+	__u32 sched_util_min;
+	__u32 sched_util_max;
 };
 
 #endif /* _UAPI_LINUX_SCHED_TYPES_H */
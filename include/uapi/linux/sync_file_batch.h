@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Batched merge and wait for sync_file
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _UAPI_LINUX_SYNC_FILE_BATCH_H
+#define _UAPI_LINUX_SYNC_FILE_BATCH_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* maximum number of fds accepted by one batched ioctl */
+#define SYNC_BATCH_MAX_FDS	256
+
+/**
+ * struct sync_merge_batch_data - data passed to SYNC_IOC_MERGE_BATCH
+ * @name:	name of new fence
+ * @fds:	pointer to an array of @num_fds __s32 sync_file fds
+ * @num_fds:	number of fds in @fds
+ * @fence:	returns the fd of the new fence to userspace
+ * @flags:	merge_batch flags, must be 0
+ * @pad:	padding for 64-bit alignment, should always be zero
+ */
+struct sync_merge_batch_data {
+	char	name[32];
+	__u64	fds;
+	__u32	num_fds;
+	__s32	fence;
+	__u32	flags;
+	__u32	pad;
+};
+
+/* return as soon as any of the fences signals */
+#define SYNC_WAIT_ANY	(1 << 0)
+
+/**
+ * struct sync_wait_data - data passed to SYNC_IOC_WAIT
+ * @fds:	pointer to an array of @num_fds __s32 sync_file fds
+ * @num_fds:	number of fds in @fds
+ * @flags:	SYNC_WAIT_* flags
+ * @timeout_ns:	relative timeout in nanoseconds, negative waits forever
+ * @index:	with SYNC_WAIT_ANY, returns which fence signaled: 0 for the
+ *		sync_file the ioctl was issued on, i + 1 for @fds[i]
+ * @pad:	padding for 64-bit alignment, should always be zero
+ */
+struct sync_wait_data {
+	__u64	fds;
+	__u32	num_fds;
+	__u32	flags;
+	__s64	timeout_ns;
+	__u32	index;
+	__u32	pad;
+};
+
+/**
+ * DOC: SYNC_IOC_MERGE_BATCH - merge many fences at once
+ *
+ * Takes a struct sync_merge_batch_data and creates a new fence holding
+ * the fences of the sync_file the ioctl is issued on and of every fd in
+ * @fds. The new fence's fd is returned in @fence. This is the N-way
+ * version of SYNC_IOC_MERGE.
+ */
+#define SYNC_IOC_MERGE_BATCH	_IOWR('>', 6, struct sync_merge_batch_data)
+
+/**
+ * DOC: SYNC_IOC_WAIT - wait on many fences at once
+ *
+ * Takes a struct sync_wait_data and waits until the sync_file the ioctl
+ * is issued on and every fd in @fds have signaled, or until any of them
+ * has if SYNC_WAIT_ANY is set. Fails with ETIME if @timeout_ns elapses
+ * first.
+ */
+#define SYNC_IOC_WAIT		_IOWR('>', 7, struct sync_wait_data)
+
+#endif /* _UAPI_LINUX_SYNC_FILE_BATCH_H */
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Memory mapped per-cpu ring buffers of trace_pipe_raw
+ */
+
+#ifndef _UAPI_TRACE_MMAP_H_
+#define _UAPI_TRACE_MMAP_H_
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - first page of a mapped per-cpu ring buffer
+ * @meta_page_size:	size of this meta page
+ * @meta_struct_len:	size of this structure
+ * @subbuf_size:	size of each sub-buffer, header included
+ * @nr_subbufs:		number of sub-buffers mapped after the meta page
+ * @reader.lost_events:	events lost before the first one of @reader.read
+ * @reader.id:		sub-buffer the reader is on, mapped at offset
+ *			meta_page_size + id * subbuf_size
+ * @reader.read:	offset in the sub-buffer data of the first event
+ *			handed over by the last TRACE_MMAP_IOCTL_GET_READER
+ * @reader.commit:	offset in the sub-buffer data past the last of them
+ * @flags:		always zero
+ * @entries:		events in the ring buffer
+ * @overrun:		events overwritten by the writer
+ * @read:		events consumed
+ *
+ * Each sub-buffer starts with a 64-bit time stamp and a 64-bit commit,
+ * followed by its data, as a page read from trace_pipe_raw does.  The
+ * events from @reader.read to @reader.commit of the data of sub-buffer
+ * @reader.id are consumed once handed over, and stay in place until the
+ * next TRACE_MMAP_IOCTL_GET_READER.
+ */
+struct trace_buffer_meta {
+	__u32	meta_page_size;
+	__u32	meta_struct_len;
+
+	__u32	subbuf_size;
+	__u32	nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+		__u32	commit;
+		__u32	pad;
+	} reader;
+
+	__u64	flags;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+/*
+ * hand the unread events of the ring buffer over to the reader, updating
+ * the reader fields of the meta page; waits for events to come unless the
+ * file is O_NONBLOCK
+ */
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('R', 0x20)
+
+#endif /* _UAPI_TRACE_MMAP_H_ */
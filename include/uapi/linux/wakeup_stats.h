@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Binary wakeup source statistics of debugfs wakeup_sources_top
+ */
+
+#ifndef _UAPI_LINUX_WAKEUP_STATS_H
+#define _UAPI_LINUX_WAKEUP_STATS_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define WAKEUP_STATS_VERSION	1
+#define WAKEUP_STATS_NAME_LEN	48
+
+/**
+ * struct wakeup_stats_header - head of a wakeup_sources_top snapshot
+ * @version:		WAKEUP_STATS_VERSION
+ * @header_size:	size of this header, the records follow it
+ * @record_size:	size of each record
+ * @nr_records:		number of records following the header
+ * @since_ns:		monotonic time of the previous snapshot of the file, 0
+ *			for the first one
+ * @now_ns:		monotonic time of this snapshot
+ */
+struct wakeup_stats_header {
+	__u32	version;
+	__u32	header_size;
+	__u32	record_size;
+	__u32	nr_records;
+	__u64	since_ns;
+	__u64	now_ns;
+};
+
+/**
+ * struct wakeup_source_stats - statistics of a wakeup source
+ * @name:		name of the wakeup source, truncated and NUL terminated
+ * @id:			unique identifier of the wakeup source
+ * @active_time_ns:	time it has been active since the previous snapshot
+ * @total_time_ns:	total time it has been active
+ * @max_time_ns:	longest time it has been active at once
+ * @last_change_ns:	monotonic time of its last activation or deactivation
+ * @prevent_sleep_time_ns: total time it has kept autosleep from suspending
+ * @active_count:	number of activations
+ * @event_count:	number of wakeup events signaled
+ * @wakeup_count:	number of times it aborted a suspend
+ * @expire_count:	number of times its timeout expired
+ * @active:		1 if it is active in the snapshot
+ * @pad:		always zero
+ *
+ * Records are sorted by decreasing @active_time_ns, and only the sources
+ * active since the previous snapshot are reported.
+ */
+struct wakeup_source_stats {
+	char	name[WAKEUP_STATS_NAME_LEN];
+	__u64	id;
+	__u64	active_time_ns;
+	__u64	total_time_ns;
+	__u64	max_time_ns;
+	__u64	last_change_ns;
+	__u64	prevent_sleep_time_ns;
+	__u64	active_count;
+	__u64	event_count;
+	__u64	wakeup_count;
+	__u64	expire_count;
+	__u32	active;
+	__u32	pad;
+};
+
+/* report at most that many wakeup sources per snapshot, 16 by default */
+#define WAKEUP_STATS_IOC_SET_TOP_N	_IOW('W', 0xa0, __u32)
+
+#endif /* _UAPI_LINUX_WAKEUP_STATS_H */
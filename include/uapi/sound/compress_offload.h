@@ -31,7 +31,7 @@
 #include <sound/compress_params.h>
 
 
-#define SNDRV_COMPRESS_VERSION SNDRV_PROTOCOL_VERSION(0, 1, 2)
+#define SNDRV_COMPRESS_VERSION SNDRV_PROTOCOL_VERSION(0, 1, 3)
 /**
  * struct snd_compressed_buffer - compressed buffer
  * @fragment_size: size of buffer fragment in bytes
@@ -154,6 +154,10 @@ struct snd_compr_metadata {
  * SNDRV_COMPRESS_TSTAMP: get the current timestamp value
  * SNDRV_COMPRESS_AVAIL: get the current buffer avail value.
  * This also queries the tstamp properties
+ * SNDRV_COMPRESS_SET_AVAIL_MIN: set how many bytes must be free in the ring
+ * buffer before poll reports a playback stream writable, a fragment by default
+ * SNDRV_COMPRESS_COMMIT: hand bytes written to the mmapped ring buffer of a
+ * playback stream over to the DSP, like a write() of them would
  * SNDRV_COMPRESS_PAUSE: Pause the running stream
  * SNDRV_COMPRESS_RESUME: resume a paused stream
  * SNDRV_COMPRESS_START: Start a stream
@@ -174,6 +178,8 @@ struct snd_compr_metadata {
 						 struct snd_compr_metadata)
 #define SNDRV_COMPRESS_TSTAMP		_IOR('C', 0x20, struct snd_compr_tstamp)
 #define SNDRV_COMPRESS_AVAIL		_IOR('C', 0x21, struct snd_compr_avail)
+#define SNDRV_COMPRESS_SET_AVAIL_MIN	_IOW('C', 0x22, __u32)
+#define SNDRV_COMPRESS_COMMIT		_IOW('C', 0x23, __u32)
 #define SNDRV_COMPRESS_PAUSE		_IO('C', 0x30)
 #define SNDRV_COMPRESS_RESUME		_IO('C', 0x31)
 #define SNDRV_COMPRESS_START		_IO('C', 0x32)
@@ -38,10 +38,34 @@
 #include <linux/sched/wake_q.h>
 #include <linux/sched/signal.h>
 #include <linux/sched/user.h>
+#include <linux/security.h>
 
 #include <net/sock.h>
 #include "util.h"
 
+#ifndef MQ_RECV_BATCH
+/**
+ * struct mq_recv_batch - receive several messages with one call
+ * @msgs: user buffer of @nr buffers of @stride bytes each
+ * @lens: user array of @nr __u32, for the lengths of the messages
+ * @prios: user array of @nr __u32 for their priorities, or 0
+ * @stride: size of each buffer, at least the mq_msgsize of the queue
+ * @nr: most messages to receive
+ */
+struct mq_recv_batch {
+	__u64	msgs;
+	__u64	lens;
+	__u64	prios;
+	__u32	stride;
+	__u32	nr;
+};
+
+#define MQ_RECV_BATCH	_IOWR(0xB5, 1, struct mq_recv_batch)
+#endif
+
+/* Most messages taken off the queue at once by MQ_RECV_BATCH */
+#define MQ_RECV_BATCH_MAX	32
+
 #define MQUEUE_MAGIC	0x19800202
 #define DIRENT_SIZE	20
 #define FILENT_SIZE	80
@@ -85,6 +109,15 @@ struct mqueue_inode_info {
 	struct ext_wait_queue e_wait_q[2];
 
 	unsigned long qsize; /* size of queue in memory (sum of all msgs) */
+
+	/*
+	 * Messages received from a queue whose mq_msgsize fits a single
+	 * msg_msg are kept for reuse by the next senders, up to mq_maxmsg
+	 * of them, the number already accounted to the user by the queue.
+	 */
+	spinlock_t slot_lock;
+	struct list_head free_slots;
+	unsigned int nr_free_slots;
 };
 
 static const struct inode_operations mqueue_dir_inode_operations;
@@ -212,6 +245,75 @@ static inline struct msg_msg *msg_get(struct mqueue_inode_info *info)
 	return msg;
 }
 
+static inline bool mq_use_slots(struct mqueue_inode_info *info)
+{
+	return sizeof(struct msg_msg) + info->attr.mq_msgsize <= PAGE_SIZE;
+}
+
+/* load_msg(), reusing a message slot of the queue if possible */
+static struct msg_msg *mq_load_msg(struct mqueue_inode_info *info,
+				   const void __user *src, size_t len)
+{
+	struct msg_msg *msg;
+	int err;
+
+	if (!mq_use_slots(info))
+		return load_msg(src, len);
+
+	spin_lock(&info->slot_lock);
+	msg = list_first_entry_or_null(&info->free_slots, struct msg_msg,
+				       m_list);
+	if (msg) {
+		list_del(&msg->m_list);
+		info->nr_free_slots--;
+	}
+	spin_unlock(&info->slot_lock);
+
+	if (!msg) {
+		/* room for the largest message, for the slot to be reused */
+		msg = kmalloc(sizeof(*msg) + info->attr.mq_msgsize,
+			      GFP_KERNEL_ACCOUNT);
+		if (!msg)
+			return ERR_PTR(-ENOMEM);
+		msg->next = NULL;
+		msg->security = NULL;
+	}
+
+	err = -EFAULT;
+	if (copy_from_user(msg + 1, src, len))
+		goto out_err;
+
+	err = security_msg_msg_alloc(msg);
+	if (err)
+		goto out_err;
+
+	return msg;
+
+out_err:
+	free_msg(msg);
+	return ERR_PTR(err);
+}
+
+/* free_msg(), keeping the message slot for reuse if there's room */
+static void mq_free_msg(struct mqueue_inode_info *info, struct msg_msg *msg)
+{
+	if (mq_use_slots(info)) {
+		security_msg_msg_free(msg);
+		msg->security = NULL;
+
+		spin_lock(&info->slot_lock);
+		if (info->nr_free_slots < info->attr.mq_maxmsg) {
+			list_add(&msg->m_list, &info->free_slots);
+			info->nr_free_slots++;
+			msg = NULL;
+		}
+		spin_unlock(&info->slot_lock);
+	}
+
+	if (msg)
+		free_msg(msg);
+}
+
 static struct inode *mqueue_get_inode(struct super_block *sb,
 		struct ipc_namespace *ipc_ns, umode_t mode,
 		struct mq_attr *attr)
@@ -248,6 +350,9 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 		info->user = NULL;	/* set when all is ok */
 		info->msg_tree = RB_ROOT;
 		info->node_cache = NULL;
+		spin_lock_init(&info->slot_lock);
+		INIT_LIST_HEAD(&info->free_slots);
+		info->nr_free_slots = 0;
 		memset(&info->attr, 0, sizeof(info->attr));
 		info->attr.mq_maxmsg = min(ipc_ns->mq_msg_max,
 					   ipc_ns->mq_msg_default);
@@ -406,6 +511,12 @@ static void mqueue_evict_inode(struct inode *inode)
 	kfree(info->node_cache);
 	spin_unlock(&info->lock);
 
+	while ((msg = list_first_entry_or_null(&info->free_slots,
+					       struct msg_msg, m_list))) {
+		list_del(&msg->m_list);
+		free_msg(msg);
+	}
+
 	/* Total amount of bytes accounted for the mqueue */
 	mq_treesize = info->attr.mq_maxmsg * sizeof(struct msg_msg) +
 		min_t(unsigned int, info->attr.mq_maxmsg, MQ_PRIO_MAX) *
@@ -957,7 +1068,7 @@ static int do_mq_timedsend(mqd_t mqdes, const char __user *u_msg_ptr,
 
 	/* First try to allocate memory, before doing anything with
 	 * existing queues. */
-	msg_ptr = load_msg(u_msg_ptr, msg_len);
+	msg_ptr = mq_load_msg(info, u_msg_ptr, msg_len);
 	if (IS_ERR(msg_ptr)) {
 		ret = PTR_ERR(msg_ptr);
 		goto out_fput;
@@ -1017,7 +1128,7 @@ static int do_mq_timedsend(mqd_t mqdes, const char __user *u_msg_ptr,
 	wake_up_q(&wake_q);
 out_free:
 	if (ret)
-		free_msg(msg_ptr);
+		mq_free_msg(info, msg_ptr);
 out_fput:
 	fdput(f);
 out:
@@ -1118,7 +1229,7 @@ static int do_mq_timedreceive(mqd_t mqdes, char __user *u_msg_ptr,
 			store_msg(u_msg_ptr, msg_ptr, msg_ptr->m_ts)) {
 			ret = -EFAULT;
 		}
-		free_msg(msg_ptr);
+		mq_free_msg(info, msg_ptr);
 	}
 out_fput:
 	fdput(f);
@@ -1126,6 +1237,101 @@ static int do_mq_timedreceive(mqd_t mqdes, char __user *u_msg_ptr,
 	return ret;
 }
 
+/*
+ * MQ_RECV_BATCH: takes up to @nr messages off the queue under a single
+ * hold of its lock, waiting for the first one unless O_NONBLOCK is set.
+ * Returns the number of messages received.
+ */
+static long mq_recv_batch(struct file *filp, struct mq_recv_batch __user *arg)
+{
+	struct inode *inode = file_inode(filp);
+	struct mqueue_inode_info *info = MQUEUE_I(inode);
+	struct msg_msg *msgs[MQ_RECV_BATCH_MAX];
+	struct posix_msg_tree_node *new_leaf = NULL;
+	struct ext_wait_queue wait;
+	struct mq_recv_batch batch;
+	unsigned int i, nr = 0;
+	char __user *buf;
+	long ret;
+
+	if (unlikely(!(filp->f_mode & FMODE_READ)))
+		return -EBADF;
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+	if (!batch.nr)
+		return -EINVAL;
+	if (batch.stride < info->attr.mq_msgsize)
+		return -EMSGSIZE;
+	batch.nr = min_t(unsigned int, batch.nr, MQ_RECV_BATCH_MAX);
+
+	audit_file(filp);
+
+	/* Like do_mq_timedreceive(), for pipelined_receive() to use */
+	if (!info->node_cache)
+		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+
+	spin_lock(&info->lock);
+
+	if (!info->node_cache && new_leaf) {
+		INIT_LIST_HEAD(&new_leaf->msg_list);
+		info->node_cache = new_leaf;
+	} else {
+		kfree(new_leaf);
+	}
+
+	if (info->attr.mq_curmsgs == 0) {
+		if (filp->f_flags & O_NONBLOCK) {
+			spin_unlock(&info->lock);
+			return -EAGAIN;
+		}
+		wait.task = current;
+		wait.state = STATE_NONE;
+		ret = wq_sleep(info, RECV, NULL, &wait);
+		if (ret)
+			return ret;
+		msgs[nr++] = wait.msg;
+	} else {
+		DEFINE_WAKE_Q(wake_q);
+
+		while (nr < batch.nr && info->attr.mq_curmsgs) {
+			msgs[nr++] = msg_get(info);
+			/* There is now free space in queue. */
+			pipelined_receive(&wake_q, info);
+		}
+
+		inode->i_atime = inode->i_mtime = inode->i_ctime =
+				current_time(inode);
+		spin_unlock(&info->lock);
+		wake_up_q(&wake_q);
+	}
+
+	ret = nr;
+	buf = u64_to_user_ptr(batch.msgs);
+	for (i = 0; i < nr; i++) {
+		u32 __user *lens = u64_to_user_ptr(batch.lens);
+		u32 __user *prios = u64_to_user_ptr(batch.prios);
+		struct msg_msg *msg = msgs[i];
+
+		if (store_msg(buf + (size_t)i * batch.stride, msg, msg->m_ts) ||
+		    put_user(msg->m_ts, lens + i) ||
+		    (prios && put_user(msg->m_type, prios + i)))
+			ret = -EFAULT;
+		mq_free_msg(info, msg);
+	}
+
+	return ret;
+}
+
+static long mqueue_ioctl_file(struct file *filp, unsigned int cmd,
+			      unsigned long arg)
+{
+	switch (cmd) {
+	case MQ_RECV_BATCH:
+		return mq_recv_batch(filp, (void __user *)arg);
+	}
+	return -ENOTTY;
+}
+
 SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 		size_t, msg_len, unsigned int, msg_prio,
 		const struct __kernel_timespec __user *, u_abs_timeout)
@@ -1512,6 +1718,8 @@ static const struct file_operations mqueue_file_operations = {
 	.flush = mqueue_flush_file,
 	.poll = mqueue_poll_file,
 	.read = mqueue_read_file,
+	.unlocked_ioctl = mqueue_ioctl_file,
+	.compat_ioctl = mqueue_ioctl_file,
 	.llseek = default_llseek,
 };
 
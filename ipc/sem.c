@@ -357,6 +357,75 @@ static void complexmode_tryleave(struct sem_array *sma)
 }
 
 #define SEM_GLOBAL_LOCK	(-1)
+#define SEM_MULTI_LOCK	(-2)
+
+/*
+ * Most semaphores a complex operation may lock one by one, bounded by the
+ * lockdep subclasses needed to take them nested.
+ */
+#define SEM_MULTI_LOCKS	8
+
+/* Next semaphore of @sops in ascending order after @prev, or -1 */
+static int sem_multi_next(struct sembuf *sops, int nsops, int prev)
+{
+	int i, next = -1;
+
+	for (i = 0; i < nsops; i++) {
+		int num = sops[i].sem_num;
+
+		if (num > prev && (next < 0 || num < next))
+			next = num;
+	}
+	return next;
+}
+
+static void sem_unlock_multi(struct sem_array *sma, struct sembuf *sops,
+			     int nsops)
+{
+	int num = -1;
+
+	while ((num = sem_multi_next(sops, nsops, num)) >= 0)
+		spin_unlock(&sma->sems[num].lock);
+}
+
+/*
+ * A complex operation that doesn't have to sleep touches only the
+ * semaphores of its sops, and their per-semaphore queues as long as no
+ * complex operation is sleeping.  So, like a simple operation, it can run
+ * under the locks of these semaphores only, taken in ascending order,
+ * and operations on other semaphores of the array aren't held up.
+ */
+static bool sem_lock_multi(struct sem_array *sma, struct sembuf *sops,
+			   int nsops)
+{
+	int num = -1, subclass = 0;
+
+	if (nsops > SEM_MULTI_LOCKS || sma->use_global_lock)
+		return false;
+
+	while ((num = sem_multi_next(sops, nsops, num)) >= 0) {
+		int idx = array_index_nospec(num, sma->sem_nsems);
+
+		spin_lock_nested(&sma->sems[idx].lock, subclass++);
+	}
+
+	/* pairs with smp_store_release(), as for a simple operation */
+	if (!smp_load_acquire(&sma->use_global_lock))
+		return true;
+
+	sem_unlock_multi(sma, sops, nsops);
+	return false;
+}
+
+static int sem_lock_global(struct sem_array *sma)
+{
+	ipc_lock_object(&sma->sem_perm);
+
+	/* Prevent parallel simple ops */
+	complexmode_enter(sma);
+	return SEM_GLOBAL_LOCK;
+}
+
 /*
  * If the request contains only one semaphore operation, and there are
  * no complex transactions pending, lock only the semaphore involved.
@@ -371,12 +440,12 @@ static inline int sem_lock(struct sem_array *sma, struct sembuf *sops,
 	int idx;
 
 	if (nsops != 1) {
-		/* Complex operation - acquire a full lock */
-		ipc_lock_object(&sma->sem_perm);
+		/* Complex operation - try the locks of its semaphores */
+		if (nsops > 1 && sem_lock_multi(sma, sops, nsops))
+			return SEM_MULTI_LOCK;
 
-		/* Prevent parallel simple ops */
-		complexmode_enter(sma);
-		return SEM_GLOBAL_LOCK;
+		/* acquire a full lock */
+		return sem_lock_global(sma);
 	}
 
 	/*
@@ -447,6 +516,15 @@ static inline void sem_unlock(struct sem_array *sma, int locknum)
 	}
 }
 
+static inline void sem_unlock_sops(struct sem_array *sma, int locknum,
+				   struct sembuf *sops, int nsops)
+{
+	if (locknum == SEM_MULTI_LOCK)
+		sem_unlock_multi(sma, sops, nsops);
+	else
+		sem_unlock(sma, locknum);
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rwsem
  * is not held.
@@ -2070,6 +2148,18 @@ static long do_semtimedop(int semid, struct sembuf __user *tsops,
 	queue.dupsop = dupsop;
 
 	error = perform_atomic_semop(sma, &queue);
+	if (error > 0 && locknum == SEM_MULTI_LOCK) {
+		/* Complex operations sleep under the global lock */
+		sem_unlock_multi(sma, sops, nsops);
+		locknum = sem_lock_global(sma);
+
+		error = -EIDRM;
+		if (!ipc_valid_object(&sma->sem_perm) ||
+		    (un && un->semid == -1))
+			goto out_unlock_free;
+
+		error = perform_atomic_semop(sma, &queue);
+	}
 	if (error == 0) { /* non-blocking succesfull path */
 		DEFINE_WAKE_Q(wake_q);
 
@@ -2082,7 +2172,7 @@ static long do_semtimedop(int semid, struct sembuf __user *tsops,
 		else
 			set_semotime(sma, sops);
 
-		sem_unlock(sma, locknum);
+		sem_unlock_sops(sma, locknum, sops, nsops);
 		rcu_read_unlock();
 		wake_up_q(&wake_q);
 
@@ -2185,7 +2275,7 @@ static long do_semtimedop(int semid, struct sembuf __user *tsops,
 	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma, locknum);
+	sem_unlock_sops(sma, locknum, sops, nsops);
 	rcu_read_unlock();
 out_free:
 	if (sops != fast_sops)
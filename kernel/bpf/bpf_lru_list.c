@@ -399,6 +399,51 @@ __local_list_pop_pending(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
 	return NULL;
 }
 
+/* Take a free node, or one which isn't referenced from the tail of the
+ * inactive list, off the list of another CPU.  Lists are only tried, and
+ * only one is locked at a time, so CPUs stealing from each other neither
+ * wait for nor deadlock with each other.
+ */
+static struct bpf_lru_node *bpf_percpu_lru_steal(struct bpf_lru *lru,
+						 struct bpf_lru_list *l,
+						 int cpu)
+{
+	struct bpf_lru_node *node = NULL;
+	struct bpf_lru_list *steal_l;
+	struct list_head *free_list;
+	int steal, first_steal;
+	unsigned long flags;
+
+	first_steal = l->next_steal;
+	steal = first_steal;
+	do {
+		if (steal == cpu)
+			goto next;
+
+		steal_l = per_cpu_ptr(lru->percpu_lru, steal);
+		if (!raw_spin_trylock_irqsave(&steal_l->lock, flags))
+			goto next;
+
+		free_list = &steal_l->lists[BPF_LRU_LIST_T_FREE];
+		if (list_empty(free_list))
+			__bpf_lru_list_shrink_inactive(lru, steal_l, 1,
+						       free_list,
+						       BPF_LRU_LIST_T_FREE);
+		node = list_first_entry_or_null(free_list,
+						struct bpf_lru_node, list);
+		if (node)
+			list_del(&node->list);
+
+		raw_spin_unlock_irqrestore(&steal_l->lock, flags);
+next:
+		steal = get_next_cpu(steal);
+	} while (!node && steal != first_steal);
+
+	l->next_steal = steal;
+
+	return node;
+}
+
 static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 						    u32 hash)
 {
@@ -415,6 +460,22 @@ static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 	__bpf_lru_list_rotate(lru, l);
 
 	free_list = &l->lists[BPF_LRU_LIST_T_FREE];
+	if (list_empty(free_list) && lru->steal &&
+	    !__bpf_lru_list_shrink_inactive(lru, l, PERCPU_FREE_TARGET,
+					    free_list, BPF_LRU_LIST_T_FREE)) {
+		/* Nothing to evict here without ignoring the ref bit, see
+		 * whether another CPU has.  The node is on no list and in
+		 * no htab bucket while it changes hands.
+		 */
+		raw_spin_unlock_irqrestore(&l->lock, flags);
+		node = bpf_percpu_lru_steal(lru, l, cpu);
+		raw_spin_lock_irqsave(&l->lock, flags);
+		if (node) {
+			node->cpu = cpu;
+			list_add(&node->list, free_list);
+		}
+	}
+
 	if (list_empty(free_list))
 		__bpf_lru_list_shrink(lru, l, PERCPU_FREE_TARGET, free_list,
 				      BPF_LRU_LIST_T_FREE);
@@ -645,8 +706,9 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *del_arg)
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool steal,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *del_arg)
 {
 	int cpu;
 
@@ -660,6 +722,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 
 			l = per_cpu_ptr(lru->percpu_lru, cpu);
 			bpf_lru_list_init(l);
+			l->next_steal = get_next_cpu(cpu);
 		}
 		lru->nr_scans = PERCPU_NR_SCANS;
 	} else {
@@ -681,6 +744,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	}
 
 	lru->percpu = percpu;
+	lru->steal = percpu && steal;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
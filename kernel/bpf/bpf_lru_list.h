@@ -35,6 +35,8 @@ struct bpf_lru_list {
 	unsigned int counts[NR_BPF_LRU_LIST_COUNT];
 	/* The next inacitve list rotation starts from here */
 	struct list_head *next_inactive_rotation;
+	/* The next steal of a percpu list that steals starts from here */
+	u16 next_steal;
 
 	raw_spinlock_t lock ____cacheline_aligned_in_smp;
 };
@@ -62,6 +64,7 @@ struct bpf_lru {
 	unsigned int hash_offset;
 	unsigned int nr_scans;
 	bool percpu;
+	bool steal;
 };
 
 static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
@@ -73,8 +76,9 @@ static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
 		node->ref = 1;
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *delete_arg);
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool steal,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *delete_arg);
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems);
 void bpf_lru_destroy(struct bpf_lru *lru);
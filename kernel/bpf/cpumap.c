@@ -22,12 +22,13 @@
 #include <net/xdp.h>
 
 #include <linux/sched.h>
+#include <linux/prefetch.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
 #include <linux/capability.h>
 #include <trace/events/xdp.h>
 
-#include <linux/netdevice.h>   /* netif_receive_skb_core */
+#include <linux/netdevice.h>   /* napi_gro_receive */
 #include <linux/etherdevice.h> /* eth_type_trans */
 
 /* General idea: XDP packets getting XDP redirected to another CPU,
@@ -38,6 +39,7 @@
  */
 
 #define CPU_MAP_BULK_SIZE 8  /* 8 == one cacheline on 64-bit archs */
+#define CPUMAP_BATCH 8
 struct xdp_bulk_queue {
 	void *q[CPU_MAP_BULK_SIZE];
 	unsigned int count;
@@ -47,7 +49,10 @@ struct xdp_bulk_queue {
 struct bpf_cpu_map_entry {
 	u32 cpu;    /* kthread CPU and map index */
 	int map_id; /* Back reference to map */
-	u32 qsize;  /* Queue size placeholder for map lookup */
+
+	/* Queue size and prog id placeholder for map lookup */
+	struct bpf_cpumap_val value;
+	struct bpf_prog *prog;
 
 	/* XDP can run multiple RX-ring queues, need __percpu enqueue store */
 	struct xdp_bulk_queue __percpu *bulkq;
@@ -57,6 +62,10 @@ struct bpf_cpu_map_entry {
 	struct task_struct *kthread;
 	struct work_struct kthread_stop_wq;
 
+	/* GRO context of the kthread, never scheduled as a real NAPI */
+	struct napi_struct napi;
+	struct net_device napi_dev;
+
 	atomic_t refcnt; /* Control when this struct can be free'ed */
 	struct rcu_head rcu;
 };
@@ -88,7 +97,9 @@ static struct bpf_map *cpu_map_alloc(union bpf_attr *attr)
 
 	/* check sanity of attributes */
 	if (attr->max_entries == 0 || attr->key_size != 4 ||
-	    attr->value_size != 4 || attr->map_flags & ~BPF_F_NUMA_NODE)
+	    (attr->value_size != offsetofend(struct bpf_cpumap_val, qsize) &&
+	     attr->value_size != sizeof(struct bpf_cpumap_val)) ||
+	    attr->map_flags & ~BPF_F_NUMA_NODE)
 		return ERR_PTR(-EINVAL);
 
 	cmap = kzalloc(sizeof(*cmap), GFP_USER);
@@ -229,14 +240,82 @@ static void put_cpu_map_entry(struct bpf_cpu_map_entry *rcpu)
 		__cpu_map_ring_cleanup(rcpu->queue);
 		ptr_ring_cleanup(rcpu->queue, NULL);
 		kfree(rcpu->queue);
+		if (rcpu->prog)
+			bpf_prog_put(rcpu->prog);
 		kfree(rcpu);
 	}
 }
 
+/* Runs the remote XDP program of the entry over the frames, and packs
+ * those it passed at the start of the array.
+ */
+static int cpu_map_bpf_prog_run(struct bpf_cpu_map_entry *rcpu,
+				void **frames, int n, unsigned int *drops)
+{
+	struct xdp_rxq_info rxq = {};
+	struct xdp_buff xdp;
+	int i, nframes = 0;
+
+	rcu_read_lock();
+	xdp.rxq = &rxq;
+
+	for (i = 0; i < n; i++) {
+		struct xdp_frame *xdpf = frames[i];
+		struct net_device *dev_rx = xdpf->dev_rx;
+		u32 act;
+
+		rxq.dev = dev_rx;
+		rxq.mem = xdpf->mem;
+
+		/* The frame sits at the start of its own headroom */
+		xdp.data_hard_start = xdpf;
+		xdp.data = xdpf->data;
+		xdp.data_end = xdpf->data + xdpf->len;
+		xdp.data_meta = xdpf->data - xdpf->metasize;
+
+		act = bpf_prog_run_xdp(rcpu->prog, &xdp);
+		switch (act) {
+		case XDP_PASS:
+			xdpf = convert_to_xdp_frame(&xdp);
+			if (unlikely(!xdpf)) {
+				xdp_return_buff(&xdp);
+				(*drops)++;
+				break;
+			}
+			xdpf->dev_rx = dev_rx;
+			frames[nframes++] = xdpf;
+			break;
+		default:
+			bpf_warn_invalid_xdp_action(act);
+			/* fallthrough */
+		case XDP_ABORTED:
+			trace_xdp_exception(dev_rx, rcpu->prog, act);
+			/* fallthrough */
+		case XDP_DROP:
+			xdp_return_frame(xdpf);
+			(*drops)++;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return nframes;
+}
+
+static int cpu_map_napi_poll(struct napi_struct *napi, int budget)
+{
+	return 0;
+}
+
 static int cpu_map_kthread_run(void *data)
 {
 	struct bpf_cpu_map_entry *rcpu = data;
 
+	/* Keep the GRO context out of the busy poll NAPI hash */
+	__set_bit(NAPI_STATE_NO_BUSY_POLL, &rcpu->napi.state);
+	netif_napi_add(&rcpu->napi_dev, &rcpu->napi, cpu_map_napi_poll,
+		       NAPI_POLL_WEIGHT);
+
 	set_current_state(TASK_INTERRUPTIBLE);
 
 	/* When kthread gives stop order, then rcpu have been disconnected
@@ -245,8 +324,9 @@ static int cpu_map_kthread_run(void *data)
 	 * kthread_stop signal until queue is empty.
 	 */
 	while (!kthread_should_stop() || !__ptr_ring_empty(rcpu->queue)) {
-		unsigned int processed = 0, drops = 0, sched = 0;
-		struct xdp_frame *xdpf;
+		unsigned int drops = 0, sched = 0;
+		void *frames[CPUMAP_BATCH];
+		int i, n, nframes;
 
 		/* Release CPU reschedule checks */
 		if (__ptr_ring_empty(rcpu->queue)) {
@@ -262,56 +342,74 @@ static int cpu_map_kthread_run(void *data)
 			sched = cond_resched();
 		}
 
-		/* Process packets in rcpu->queue */
-		local_bh_disable();
 		/*
 		 * The bpf_cpu_map_entry is single consumer, with this
 		 * kthread CPU pinned. Lockless access to ptr_ring
 		 * consume side valid as no-resize allowed of queue.
 		 */
-		while ((xdpf = __ptr_ring_consume(rcpu->queue))) {
+		n = __ptr_ring_consume_batched(rcpu->queue, frames,
+					       CPUMAP_BATCH);
+
+		/* Bring the frames in while the previous ones are handled */
+		for (i = 0; i < n; i++)
+			prefetchw(frames[i]);
+
+		/* Process packets in rcpu->queue */
+		local_bh_disable();
+		nframes = rcpu->prog ?
+			cpu_map_bpf_prog_run(rcpu, frames, n, &drops) : n;
+
+		for (i = 0; i < nframes; i++) {
+			struct xdp_frame *xdpf = frames[i];
 			struct sk_buff *skb;
-			int ret;
 
 			skb = cpu_map_build_skb(rcpu, xdpf);
 			if (!skb) {
 				xdp_return_frame(xdpf);
+				drops++;
 				continue;
 			}
 
-			/* Inject into network stack */
-			ret = netif_receive_skb_core(skb);
-			if (ret == NET_RX_DROP)
+			/* Inject into network stack, merging TCP flows */
+			if (napi_gro_receive(&rcpu->napi, skb) == GRO_DROP)
 				drops++;
-
-			/* Limit BH-disable period */
-			if (++processed == 8)
-				break;
 		}
+		/* Nothing is held back in GRO past one batch */
+		napi_gro_flush(&rcpu->napi, false);
+
 		/* Feedback loop via tracepoint */
-		trace_xdp_cpumap_kthread(rcpu->map_id, processed, drops, sched);
+		trace_xdp_cpumap_kthread(rcpu->map_id, n, drops, sched);
 
 		local_bh_enable(); /* resched point, may call do_softirq() */
 	}
 	__set_current_state(TASK_RUNNING);
 
+	netif_napi_del(&rcpu->napi);
 	put_cpu_map_entry(rcpu);
 	return 0;
 }
 
-static struct bpf_cpu_map_entry *__cpu_map_entry_alloc(u32 qsize, u32 cpu,
-						       int map_id)
+static struct bpf_cpu_map_entry *
+__cpu_map_entry_alloc(struct bpf_cpumap_val *value, u32 cpu, int map_id)
 {
 	gfp_t gfp = GFP_KERNEL | __GFP_NOWARN;
 	struct bpf_cpu_map_entry *rcpu;
+	struct bpf_prog *prog = NULL;
 	int numa, err;
 
+	if (value->bpf_prog.fd > 0) {
+		prog = bpf_prog_get_type(value->bpf_prog.fd,
+					 BPF_PROG_TYPE_XDP);
+		if (IS_ERR(prog))
+			return ERR_CAST(prog);
+	}
+
 	/* Have map->numa_node, but choose node of redirect target CPU */
 	numa = cpu_to_node(cpu);
 
 	rcpu = kzalloc_node(sizeof(*rcpu), gfp, numa);
 	if (!rcpu)
-		return NULL;
+		goto put_prog;
 
 	/* Alloc percpu bulkq */
 	rcpu->bulkq = __alloc_percpu_gfp(sizeof(*rcpu->bulkq),
@@ -324,13 +422,16 @@ static struct bpf_cpu_map_entry *__cpu_map_entry_alloc(u32 qsize, u32 cpu,
 	if (!rcpu->queue)
 		goto free_bulkq;
 
-	err = ptr_ring_init(rcpu->queue, qsize, gfp);
+	err = ptr_ring_init(rcpu->queue, value->qsize, gfp);
 	if (err)
 		goto free_queue;
 
 	rcpu->cpu    = cpu;
 	rcpu->map_id = map_id;
-	rcpu->qsize  = qsize;
+	rcpu->value.qsize = value->qsize;
+	if (prog)
+		rcpu->value.bpf_prog.id = prog->aux->id;
+	init_dummy_netdev(&rcpu->napi_dev);
 
 	/* Setup kthread */
 	rcpu->kthread = kthread_create_on_node(cpu_map_kthread_run, rcpu, numa,
@@ -340,6 +441,7 @@ static struct bpf_cpu_map_entry *__cpu_map_entry_alloc(u32 qsize, u32 cpu,
 
 	get_cpu_map_entry(rcpu); /* 1-refcnt for being in cmap->cpu_map[] */
 	get_cpu_map_entry(rcpu); /* 1-refcnt for kthread */
+	rcpu->prog = prog;
 
 	/* Make sure kthread runs on a single CPU */
 	kthread_bind(rcpu->kthread, cpu);
@@ -355,7 +457,10 @@ static struct bpf_cpu_map_entry *__cpu_map_entry_alloc(u32 qsize, u32 cpu,
 	free_percpu(rcpu->bulkq);
 free_rcu:
 	kfree(rcpu);
-	return NULL;
+put_prog:
+	if (prog)
+		bpf_prog_put(prog);
+	return ERR_PTR(-ENOMEM);
 }
 
 static void __cpu_map_entry_free(struct rcu_head *rcu)
@@ -433,10 +538,14 @@ static int cpu_map_update_elem(struct bpf_map *map, void *key, void *value,
 	struct bpf_cpu_map *cmap = container_of(map, struct bpf_cpu_map, map);
 	struct bpf_cpu_map_entry *rcpu;
 
+	struct bpf_cpumap_val cpumap_value = {};
 	/* Array index key correspond to CPU number */
 	u32 key_cpu = *(u32 *)key;
-	/* Value is the queue size */
-	u32 qsize = *(u32 *)value;
+	u32 qsize;
+
+	/* Value is the queue size, optionally followed by a prog fd */
+	memcpy(&cpumap_value, value, map->value_size);
+	qsize = cpumap_value.qsize;
 
 	if (unlikely(map_flags > BPF_EXIST))
 		return -EINVAL;
@@ -455,9 +564,9 @@ static int cpu_map_update_elem(struct bpf_map *map, void *key, void *value,
 		rcpu = NULL; /* Same as deleting */
 	} else {
 		/* Updating qsize cause re-allocation of bpf_cpu_map_entry */
-		rcpu = __cpu_map_entry_alloc(qsize, key_cpu, map->id);
-		if (!rcpu)
-			return -ENOMEM;
+		rcpu = __cpu_map_entry_alloc(&cpumap_value, key_cpu, map->id);
+		if (IS_ERR(rcpu))
+			return PTR_ERR(rcpu);
 	}
 	rcu_read_lock();
 	__cpu_map_entry_replace(cmap, key_cpu, rcpu);
@@ -530,7 +639,7 @@ static void *cpu_map_lookup_elem(struct bpf_map *map, void *key)
 	struct bpf_cpu_map_entry *rcpu =
 		__cpu_map_lookup_elem(map, *(u32 *)key);
 
-	return rcpu ? &rcpu->qsize : NULL;
+	return rcpu ? &rcpu->value : NULL;
 }
 
 static int cpu_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
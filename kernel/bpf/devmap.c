@@ -64,17 +64,29 @@ struct xdp_bulk_queue {
 
 struct bpf_dtab_netdev {
 	struct net_device *dev; /* must be first member, due to tracepoint */
+	struct hlist_node index_hlist;
 	struct bpf_dtab *dtab;
 	unsigned int bit;
+	u32 idx; /* key of a DEVMAP_HASH entry */
 	struct xdp_bulk_queue __percpu *bulkq;
 	struct rcu_head rcu;
 };
 
+/* A DEVMAP_HASH keeps its entries in the slots of netdev_map too, so that
+ * the flush, tear down and unregister paths work on both map types.  The
+ * slot of an entry is its bit, the key only indexes the hash buckets.
+ */
 struct bpf_dtab {
 	struct bpf_map map;
 	struct bpf_dtab_netdev **netdev_map;
 	unsigned long __percpu *flush_needed;
 	struct list_head list;
+
+	/* these are only used for DEVMAP_HASH type maps */
+	struct hlist_head *dev_index_head;
+	spinlock_t index_lock;
+	unsigned int items;
+	u32 n_buckets;
 };
 
 static DEFINE_SPINLOCK(dev_map_lock);
@@ -105,9 +117,16 @@ static struct bpf_map *dev_map_alloc(union bpf_attr *attr)
 
 	bpf_map_init_from_attr(&dtab->map, attr);
 
+	if (attr->map_type == BPF_MAP_TYPE_DEVMAP_HASH) {
+		if (attr->max_entries > (1U << 31))
+			goto free_dtab;
+		dtab->n_buckets = roundup_pow_of_two(dtab->map.max_entries);
+	}
+
 	/* make sure page count doesn't overflow */
 	cost = (u64) dtab->map.max_entries * sizeof(struct bpf_dtab_netdev *);
 	cost += dev_map_bitmap_size(attr) * num_possible_cpus();
+	cost += (u64) dtab->n_buckets * sizeof(struct hlist_head);
 	if (cost >= U32_MAX - PAGE_SIZE)
 		goto free_dtab;
 
@@ -133,11 +152,27 @@ static struct bpf_map *dev_map_alloc(union bpf_attr *attr)
 	if (!dtab->netdev_map)
 		goto free_dtab;
 
+	if (dtab->n_buckets) {
+		size_t size = dtab->n_buckets * sizeof(struct hlist_head);
+		u32 i;
+
+		dtab->dev_index_head = bpf_map_area_alloc(size,
+							  dtab->map.numa_node);
+		if (!dtab->dev_index_head)
+			goto free_netdev_map;
+
+		for (i = 0; i < dtab->n_buckets; i++)
+			INIT_HLIST_HEAD(&dtab->dev_index_head[i]);
+		spin_lock_init(&dtab->index_lock);
+	}
+
 	spin_lock(&dev_map_lock);
 	list_add_tail_rcu(&dtab->list, &dev_map_list);
 	spin_unlock(&dev_map_lock);
 
 	return &dtab->map;
+free_netdev_map:
+	bpf_map_area_free(dtab->netdev_map);
 free_dtab:
 	free_percpu(dtab->flush_needed);
 	kfree(dtab);
@@ -188,6 +223,7 @@ static void dev_map_free(struct bpf_map *map)
 	}
 
 	free_percpu(dtab->flush_needed);
+	bpf_map_area_free(dtab->dev_index_head);
 	bpf_map_area_free(dtab->netdev_map);
 	kfree(dtab);
 }
@@ -209,14 +245,87 @@ static int dev_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	return 0;
 }
 
+static inline struct hlist_head *dev_map_index_hash(struct bpf_dtab *dtab,
+						    u32 idx)
+{
+	return &dtab->dev_index_head[idx & (dtab->n_buckets - 1)];
+}
+
+static struct bpf_dtab_netdev *__dev_map_hash_lookup_elem(struct bpf_map *map,
+							   u32 key)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct hlist_head *head = dev_map_index_hash(dtab, key);
+	struct bpf_dtab_netdev *dev;
+
+	hlist_for_each_entry_rcu(dev, head, index_hlist)
+		if (dev->idx == key)
+			return dev;
+
+	return NULL;
+}
+
+static int dev_map_hash_get_next_key(struct bpf_map *map, void *key,
+				     void *next_key)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct bpf_dtab_netdev *dev, *next_dev;
+	struct hlist_head *head;
+	u32 *next = next_key;
+	u32 idx, i = 0;
+
+	if (!key)
+		goto find_first;
+
+	idx = *(u32 *)key;
+
+	dev = __dev_map_hash_lookup_elem(map, idx);
+	if (!dev)
+		goto find_first;
+
+	next_dev = hlist_entry_safe(rcu_dereference_raw(hlist_next_rcu(&dev->index_hlist)),
+				    struct bpf_dtab_netdev, index_hlist);
+	if (next_dev) {
+		*next = next_dev->idx;
+		return 0;
+	}
+
+	i = (idx & (dtab->n_buckets - 1)) + 1;
+
+find_first:
+	for (; i < dtab->n_buckets; i++) {
+		head = &dtab->dev_index_head[i];
+		next_dev = hlist_entry_safe(rcu_dereference_raw(hlist_first_rcu(head)),
+					    struct bpf_dtab_netdev,
+					    index_hlist);
+		if (next_dev) {
+			*next = next_dev->idx;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
 void __dev_map_insert_ctx(struct bpf_map *map, u32 bit)
 {
 	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
 	unsigned long *bitmap = this_cpu_ptr(dtab->flush_needed);
 
+	/* The key of a hash entry is not its bit, dev_map_enqueue() and
+	 * dev_map_enqueue_multi() set that one.
+	 */
+	if (map->map_type == BPF_MAP_TYPE_DEVMAP_HASH)
+		return;
+
 	__set_bit(bit, bitmap);
 }
 
+static void dev_map_mark_flush(struct bpf_dtab_netdev *obj)
+{
+	__set_bit(obj->bit, this_cpu_ptr(obj->dtab->flush_needed));
+}
+
 static int bq_xmit_all(struct bpf_dtab_netdev *obj,
 		       struct xdp_bulk_queue *bq, u32 flags,
 		       bool in_napi_ctx)
@@ -304,6 +413,9 @@ struct bpf_dtab_netdev *__dev_map_lookup_elem(struct bpf_map *map, u32 key)
 	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
 	struct bpf_dtab_netdev *obj;
 
+	if (map->map_type == BPF_MAP_TYPE_DEVMAP_HASH)
+		return __dev_map_hash_lookup_elem(map, key);
+
 	if (key >= map->max_entries)
 		return NULL;
 
@@ -352,9 +464,88 @@ int dev_map_enqueue(struct bpf_dtab_netdev *dst, struct xdp_buff *xdp,
 	if (unlikely(!xdpf))
 		return -EOVERFLOW;
 
+	dev_map_mark_flush(dst);
 	return bq_enqueue(dst, xdpf, dev_rx);
 }
 
+static bool dev_map_is_valid_dst(struct bpf_dtab_netdev *dst,
+				 struct net_device *dev_rx, unsigned int len,
+				 bool exclude_ingress)
+{
+	if (!dst)
+		return false;
+	if (exclude_ingress && dst->dev->ifindex == dev_rx->ifindex)
+		return false;
+
+	return !xdp_ok_fwd_dev(dst->dev, len);
+}
+
+/* Copy of a frame, as a page of its own, for each extra broadcast target */
+static struct xdp_frame *dev_map_clone_frame(struct xdp_frame *xdpf)
+{
+	unsigned int headroom = xdpf->headroom + sizeof(*xdpf);
+	unsigned int totalsize = headroom + xdpf->len;
+	struct xdp_frame *nxdpf;
+	struct page *page;
+
+	if (unlikely(totalsize > PAGE_SIZE))
+		return NULL;
+
+	page = dev_alloc_page();
+	if (!page)
+		return NULL;
+
+	nxdpf = page_address(page);
+	memcpy(nxdpf, xdpf, totalsize);
+	nxdpf->data = (void *)nxdpf + headroom;
+	nxdpf->mem.type = MEM_TYPE_PAGE_ORDER0;
+	nxdpf->mem.id = 0;
+
+	return nxdpf;
+}
+
+/* BPF_F_BROADCAST: queue the frame to every device of the map, to be sent
+ * in the bulk flush at the end of the NAPI poll like single redirects.
+ * Every target but the last gets a copy.
+ */
+int dev_map_enqueue_multi(struct xdp_buff *xdp, struct net_device *dev_rx,
+			  struct bpf_map *map, bool exclude_ingress)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	unsigned int len = xdp->data_end - xdp->data;
+	struct bpf_dtab_netdev *dst, *last = NULL;
+	struct xdp_frame *xdpf, *nxdpf;
+	u32 i;
+
+	xdpf = convert_to_xdp_frame(xdp);
+	if (unlikely(!xdpf))
+		return -EOVERFLOW;
+
+	for (i = 0; i < map->max_entries; i++) {
+		dst = READ_ONCE(dtab->netdev_map[i]);
+		if (!dev_map_is_valid_dst(dst, dev_rx, len, exclude_ingress) ||
+		    !dst->dev->netdev_ops->ndo_xdp_xmit)
+			continue;
+
+		if (last) {
+			nxdpf = dev_map_clone_frame(xdpf);
+			if (unlikely(!nxdpf))
+				return -ENOMEM;
+			dev_map_mark_flush(last);
+			bq_enqueue(last, nxdpf, dev_rx);
+		}
+		last = dst;
+	}
+
+	if (!last) {
+		xdp_return_frame_rx_napi(xdpf);
+		return 0;
+	}
+
+	dev_map_mark_flush(last);
+	return bq_enqueue(last, xdpf, dev_rx);
+}
+
 int dev_map_generic_redirect(struct bpf_dtab_netdev *dst, struct sk_buff *skb,
 			     struct bpf_prog *xdp_prog)
 {
@@ -369,6 +560,39 @@ int dev_map_generic_redirect(struct bpf_dtab_netdev *dst, struct sk_buff *skb,
 	return 0;
 }
 
+/* BPF_F_BROADCAST for generic XDP, every target but the last gets a clone */
+int dev_map_redirect_multi(struct net_device *dev, struct sk_buff *skb,
+			   struct bpf_prog *xdp_prog, struct bpf_map *map,
+			   bool exclude_ingress)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct bpf_dtab_netdev *dst, *last = NULL;
+	struct sk_buff *nskb;
+	u32 i;
+
+	for (i = 0; i < map->max_entries; i++) {
+		dst = READ_ONCE(dtab->netdev_map[i]);
+		if (!dev_map_is_valid_dst(dst, dev, skb->len, exclude_ingress))
+			continue;
+
+		if (last) {
+			nskb = skb_clone(skb, GFP_ATOMIC);
+			if (unlikely(!nskb))
+				return -ENOMEM;
+			if (dev_map_generic_redirect(last, nskb, xdp_prog))
+				kfree_skb(nskb);
+		}
+		last = dst;
+	}
+
+	if (!last) {
+		consume_skb(skb);
+		return 0;
+	}
+
+	return dev_map_generic_redirect(last, skb, xdp_prog);
+}
+
 static void *dev_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_dtab_netdev *obj = __dev_map_lookup_elem(map, *(u32 *)key);
@@ -377,6 +601,15 @@ static void *dev_map_lookup_elem(struct bpf_map *map, void *key)
 	return dev ? &dev->ifindex : NULL;
 }
 
+static void *dev_map_hash_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_dtab_netdev *obj = __dev_map_hash_lookup_elem(map,
+								*(u32 *)key);
+	struct net_device *dev = obj ? obj->dev : NULL;
+
+	return dev ? &dev->ifindex : NULL;
+}
+
 static void dev_map_flush_old(struct bpf_dtab_netdev *dev)
 {
 	if (dev->dev->netdev_ops->ndo_xdp_xmit) {
@@ -429,12 +662,67 @@ static int dev_map_delete_elem(struct bpf_map *map, void *key)
 	return 0;
 }
 
+static int dev_map_hash_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct bpf_dtab_netdev *old_dev;
+	int k = *(u32 *)key;
+	unsigned long flags;
+	int ret = -ENOENT;
+
+	spin_lock_irqsave(&dtab->index_lock, flags);
+
+	old_dev = __dev_map_hash_lookup_elem(map, k);
+	if (old_dev) {
+		dtab->items--;
+		hlist_del_init_rcu(&old_dev->index_hlist);
+		xchg(&dtab->netdev_map[old_dev->bit], NULL);
+		call_rcu(&old_dev->rcu, __dev_map_entry_free);
+		ret = 0;
+	}
+	spin_unlock_irqrestore(&dtab->index_lock, flags);
+
+	return ret;
+}
+
+static struct bpf_dtab_netdev *__dev_map_alloc_node(struct net *net,
+						    struct bpf_dtab *dtab,
+						    u32 ifindex,
+						    unsigned int bit)
+{
+	gfp_t gfp = GFP_ATOMIC | __GFP_NOWARN;
+	struct bpf_dtab_netdev *dev;
+
+	dev = kmalloc_node(sizeof(*dev), gfp, dtab->map.numa_node);
+	if (!dev)
+		return ERR_PTR(-ENOMEM);
+
+	dev->bulkq = __alloc_percpu_gfp(sizeof(*dev->bulkq),
+					sizeof(void *), gfp);
+	if (!dev->bulkq) {
+		kfree(dev);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	dev->dev = dev_get_by_index(net, ifindex);
+	if (!dev->dev) {
+		free_percpu(dev->bulkq);
+		kfree(dev);
+		return ERR_PTR(-EINVAL);
+	}
+
+	INIT_HLIST_NODE(&dev->index_hlist);
+	dev->bit = bit;
+	dev->dtab = dtab;
+
+	return dev;
+}
+
 static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 				u64 map_flags)
 {
 	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
 	struct net *net = current->nsproxy->net_ns;
-	gfp_t gfp = GFP_ATOMIC | __GFP_NOWARN;
 	struct bpf_dtab_netdev *dev, *old_dev;
 	u32 i = *(u32 *)key;
 	u32 ifindex = *(u32 *)value;
@@ -449,26 +737,9 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 	if (!ifindex) {
 		dev = NULL;
 	} else {
-		dev = kmalloc_node(sizeof(*dev), gfp, map->numa_node);
-		if (!dev)
-			return -ENOMEM;
-
-		dev->bulkq = __alloc_percpu_gfp(sizeof(*dev->bulkq),
-						sizeof(void *), gfp);
-		if (!dev->bulkq) {
-			kfree(dev);
-			return -ENOMEM;
-		}
-
-		dev->dev = dev_get_by_index(net, ifindex);
-		if (!dev->dev) {
-			free_percpu(dev->bulkq);
-			kfree(dev);
-			return -EINVAL;
-		}
-
-		dev->bit = i;
-		dev->dtab = dtab;
+		dev = __dev_map_alloc_node(net, dtab, ifindex, i);
+		if (IS_ERR(dev))
+			return PTR_ERR(dev);
 	}
 
 	/* Use call_rcu() here to ensure rcu critical sections have completed
@@ -482,6 +753,67 @@ static int dev_map_update_elem(struct bpf_map *map, void *key, void *value,
 	return 0;
 }
 
+static int dev_map_hash_update_elem(struct bpf_map *map, void *key,
+				    void *value, u64 map_flags)
+{
+	struct bpf_dtab *dtab = container_of(map, struct bpf_dtab, map);
+	struct net *net = current->nsproxy->net_ns;
+	struct bpf_dtab_netdev *dev, *old_dev;
+	u32 ifindex = *(u32 *)value;
+	u32 idx = *(u32 *)key;
+	unsigned long flags;
+	unsigned int bit;
+	int err = -EEXIST;
+
+	if (unlikely(map_flags > BPF_EXIST || !ifindex))
+		return -EINVAL;
+
+	/* The slot is picked under the lock, fixed up below */
+	dev = __dev_map_alloc_node(net, dtab, ifindex, 0);
+	if (IS_ERR(dev))
+		return PTR_ERR(dev);
+
+	spin_lock_irqsave(&dtab->index_lock, flags);
+
+	old_dev = __dev_map_hash_lookup_elem(map, idx);
+	if (old_dev && (map_flags & BPF_NOEXIST))
+		goto out_err;
+
+	if (old_dev) {
+		bit = old_dev->bit;
+		hlist_del_rcu(&old_dev->index_hlist);
+	} else {
+		err = -ENOENT;
+		if (map_flags == BPF_EXIST)
+			goto out_err;
+		err = -E2BIG;
+		if (dtab->items >= dtab->map.max_entries)
+			goto out_err;
+		for (bit = 0; READ_ONCE(dtab->netdev_map[bit]); bit++)
+			;
+		dtab->items++;
+	}
+
+	dev->bit = bit;
+	dev->idx = idx;
+	hlist_add_head_rcu(&dev->index_hlist, dev_map_index_hash(dtab, idx));
+	xchg(&dtab->netdev_map[bit], dev);
+
+	spin_unlock_irqrestore(&dtab->index_lock, flags);
+
+	if (old_dev)
+		call_rcu(&old_dev->rcu, __dev_map_entry_free);
+
+	return 0;
+
+out_err:
+	spin_unlock_irqrestore(&dtab->index_lock, flags);
+	free_percpu(dev->bulkq);
+	dev_put(dev->dev);
+	kfree(dev);
+	return err;
+}
+
 const struct bpf_map_ops dev_map_ops = {
 	.map_alloc = dev_map_alloc,
 	.map_free = dev_map_free,
@@ -492,6 +824,32 @@ const struct bpf_map_ops dev_map_ops = {
 	.map_check_btf = map_check_no_btf,
 };
 
+const struct bpf_map_ops dev_map_hash_ops = {
+	.map_alloc = dev_map_alloc,
+	.map_free = dev_map_free,
+	.map_get_next_key = dev_map_hash_get_next_key,
+	.map_lookup_elem = dev_map_hash_lookup_elem,
+	.map_update_elem = dev_map_hash_update_elem,
+	.map_delete_elem = dev_map_hash_delete_elem,
+	.map_check_btf = map_check_no_btf,
+};
+
+/* Unlink a hash entry of a device going away, unless it was replaced */
+static void dev_map_hash_remove(struct bpf_dtab *dtab,
+				struct bpf_dtab_netdev *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dtab->index_lock, flags);
+	if (READ_ONCE(dtab->netdev_map[dev->bit]) == dev) {
+		dtab->items--;
+		hlist_del_init_rcu(&dev->index_hlist);
+		xchg(&dtab->netdev_map[dev->bit], NULL);
+		call_rcu(&dev->rcu, __dev_map_entry_free);
+	}
+	spin_unlock_irqrestore(&dtab->index_lock, flags);
+}
+
 static int dev_map_notification(struct notifier_block *notifier,
 				ulong event, void *ptr)
 {
@@ -515,6 +873,11 @@ static int dev_map_notification(struct notifier_block *notifier,
 				if (!dev ||
 				    dev->dev->ifindex != netdev->ifindex)
 					continue;
+				if (dtab->map.map_type ==
+				    BPF_MAP_TYPE_DEVMAP_HASH) {
+					dev_map_hash_remove(dtab, dev);
+					continue;
+				}
 				odev = cmpxchg(&dtab->netdev_map[i], dev, NULL);
 				if (dev == odev)
 					call_rcu(&dev->rcu,
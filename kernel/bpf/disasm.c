@@ -16,9 +16,12 @@
 #include "disasm.h"
 
 #define __BPF_FUNC_STR_FN(x) [BPF_FUNC_ ## x] = __stringify(bpf_ ## x)
+#define __BPF_FUNC_STR_FIXED_FN(x, id) __BPF_FUNC_STR_FN(x)
 static const char * const func_id_str[] = {
 	__BPF_FUNC_MAPPER(__BPF_FUNC_STR_FN)
+	__BPF_FUNC_MAPPER_FIXED(__BPF_FUNC_STR_FIXED_FN)
 };
+#undef __BPF_FUNC_STR_FIXED_FN
 #undef __BPF_FUNC_STR_FN
 
 static const char *__func_get_name(const struct bpf_insn_cbs *cbs,
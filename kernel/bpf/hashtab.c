@@ -14,6 +14,7 @@
 #include <linux/btf.h>
 #include <linux/jhash.h>
 #include <linux/filter.h>
+#include <linux/irq_work.h>
 #include <linux/rculist_nulls.h>
 #include <linux/random.h>
 #include <uapi/linux/btf.h>
@@ -23,16 +24,33 @@
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_RDONLY | BPF_F_WRONLY)
+	 BPF_F_RDONLY | BPF_F_WRONLY | BPF_F_RESIZABLE |		\
+	 BPF_F_SHARDED_LRU)
+
+/* buckets a BPF_F_RESIZABLE map starts with */
+#define HTAB_MIN_BUCKETS	32
 
 struct bucket {
 	struct hlist_nulls_head head;
 	raw_spinlock_t lock;
 };
 
+/* A BPF_F_RESIZABLE map grows by doubling its bucket table.  While it's
+ * being resized, future_tbl of the current table points to the next one,
+ * and the elements are moved one by one from the tail of each bucket of
+ * the current table to the head of a bucket of the next, so that a lookup
+ * which walks the current table and then the next finds every element.
+ * New elements go to the next table right away.
+ */
+struct bucket_table {
+	struct bucket_table __rcu *future_tbl;
+	u32 n_buckets;	/* number of hash buckets */
+	struct bucket buckets[0];
+};
+
 struct bpf_htab {
 	struct bpf_map map;
-	struct bucket *buckets;
+	struct bucket_table __rcu *tbl;
 	void *elems;
 	union {
 		struct pcpu_freelist freelist;
@@ -40,9 +58,20 @@ struct bpf_htab {
 	};
 	struct htab_elem *__percpu *extra_elems;
 	atomic_t count;	/* number of elements in this hashtable */
-	u32 n_buckets;	/* number of hash buckets */
+	u32 n_buckets;	/* number of hash buckets when fully grown */
 	u32 elem_size;	/* size of each element in bytes */
 	u32 hashrnd;
+	struct irq_work resize_irq_work;
+	struct work_struct resize_work;
+};
+
+/* The buckets of the current table and, while resizing, of the next one
+ * an element goes to
+ */
+struct htab_lock {
+	struct bucket *b;
+	struct bucket *nb;
+	unsigned long flags;
 };
 
 /* each htab element is struct htab_elem + key + value */
@@ -66,6 +95,8 @@ struct htab_elem {
 };
 
 static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
+static void htab_resize_work(struct work_struct *work);
+static void htab_resize_irq_work(struct irq_work *work);
 
 static bool htab_is_lru(const struct bpf_htab *htab)
 {
@@ -84,6 +115,19 @@ static bool htab_is_prealloc(const struct bpf_htab *htab)
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
+static bool htab_is_resizable(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_RESIZABLE;
+}
+
+/* The table is only replaced by htab_resize(), a grace period before the
+ * previous one is freed
+ */
+static inline struct bucket_table *htab_tbl(const struct bpf_htab *htab)
+{
+	return rcu_dereference_raw(htab->tbl);
+}
+
 static inline void htab_elem_set_ptr(struct htab_elem *l, u32 key_size,
 				     void __percpu *pptr)
 {
@@ -170,7 +214,9 @@ static int prealloc_init(struct bpf_htab *htab)
 skip_percpu_elems:
 	if (htab_is_lru(htab))
 		err = bpf_lru_init(&htab->lru,
-				   htab->map.map_flags & BPF_F_NO_COMMON_LRU,
+				   htab->map.map_flags & (BPF_F_NO_COMMON_LRU |
+							  BPF_F_SHARDED_LRU),
+				   htab->map.map_flags & BPF_F_SHARDED_LRU,
 				   offsetof(struct htab_elem, hash) -
 				   offsetof(struct htab_elem, lru_node),
 				   htab_lru_map_delete_node,
@@ -240,10 +286,13 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	/* percpu_lru means each cpu has its own LRU list.
 	 * it is different from BPF_MAP_TYPE_PERCPU_HASH where
 	 * the map's value itself is percpu.  percpu_lru has
-	 * nothing to do with the map's value.
+	 * nothing to do with the map's value.  A sharded LRU is a percpu_lru
+	 * whose lists steal nodes from each other.
 	 */
-	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
+	bool percpu_lru = (attr->map_flags & (BPF_F_NO_COMMON_LRU |
+					      BPF_F_SHARDED_LRU));
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	bool resizable = (attr->map_flags & BPF_F_RESIZABLE);
 	int numa_node = bpf_map_attr_numa_node(attr);
 
 	BUILD_BUG_ON(offsetof(struct htab_elem, htab) !=
@@ -264,9 +313,17 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	if (!lru && percpu_lru)
 		return -EINVAL;
 
+	if ((attr->map_flags & BPF_F_NO_COMMON_LRU) &&
+	    (attr->map_flags & BPF_F_SHARDED_LRU))
+		return -EINVAL;
+
 	if (lru && !prealloc)
 		return -ENOTSUPP;
 
+	/* preallocated elements would take more than all the buckets */
+	if (resizable && (lru || prealloc))
+		return -EINVAL;
+
 	if (numa_node != NUMA_NO_NODE && (percpu || percpu_lru))
 		return -EINVAL;
 
@@ -295,6 +352,27 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	return 0;
 }
 
+static struct bucket_table *htab_tbl_alloc(struct bpf_htab *htab,
+					   u32 n_buckets)
+{
+	struct bucket_table *tbl;
+	u32 i;
+
+	tbl = bpf_map_area_alloc(sizeof(*tbl) +
+				 (u64) n_buckets * sizeof(struct bucket),
+				 htab->map.numa_node);
+	if (!tbl)
+		return NULL;
+
+	tbl->n_buckets = n_buckets;
+	for (i = 0; i < n_buckets; i++) {
+		INIT_HLIST_NULLS_HEAD(&tbl->buckets[i].head, i);
+		raw_spin_lock_init(&tbl->buckets[i].lock);
+	}
+
+	return tbl;
+}
+
 static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 {
 	bool percpu = (attr->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
@@ -304,12 +382,16 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	/* percpu_lru means each cpu has its own LRU list.
 	 * it is different from BPF_MAP_TYPE_PERCPU_HASH where
 	 * the map's value itself is percpu.  percpu_lru has
-	 * nothing to do with the map's value.
+	 * nothing to do with the map's value.  A sharded LRU is a percpu_lru
+	 * whose lists steal nodes from each other.
 	 */
-	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
+	bool percpu_lru = (attr->map_flags & (BPF_F_NO_COMMON_LRU |
+					      BPF_F_SHARDED_LRU));
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	struct bucket_table *tbl;
 	struct bpf_htab *htab;
-	int err, i;
+	u32 n_buckets;
+	int err;
 	u64 cost;
 
 	htab = kzalloc(sizeof(*htab), GFP_USER);
@@ -343,9 +425,10 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	err = -E2BIG;
 	/* prevent zero size kmalloc and check for u32 overflow */
 	if (htab->n_buckets == 0 ||
-	    htab->n_buckets > U32_MAX / sizeof(struct bucket))
+	    htab->n_buckets > (U32_MAX - sizeof(*tbl)) / sizeof(struct bucket))
 		goto free_htab;
 
+	/* a resizable map is charged for all the buckets it may grow to */
 	cost = (u64) htab->n_buckets * sizeof(struct bucket) +
 	       (u64) htab->elem_size * htab->map.max_entries;
 
@@ -366,18 +449,19 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	if (err)
 		goto free_htab;
 
+	n_buckets = htab->n_buckets;
+	if (htab_is_resizable(htab))
+		n_buckets = min_t(u32, n_buckets, HTAB_MIN_BUCKETS);
+
 	err = -ENOMEM;
-	htab->buckets = bpf_map_area_alloc(htab->n_buckets *
-					   sizeof(struct bucket),
-					   htab->map.numa_node);
-	if (!htab->buckets)
+	tbl = htab_tbl_alloc(htab, n_buckets);
+	if (!tbl)
 		goto free_htab;
+	RCU_INIT_POINTER(htab->tbl, tbl);
+	init_irq_work(&htab->resize_irq_work, htab_resize_irq_work);
+	INIT_WORK(&htab->resize_work, htab_resize_work);
 
 	htab->hashrnd = get_random_int();
-	for (i = 0; i < htab->n_buckets; i++) {
-		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head, i);
-		raw_spin_lock_init(&htab->buckets[i].lock);
-	}
 
 	if (prealloc) {
 		err = prealloc_init(htab);
@@ -399,7 +483,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 free_prealloc:
 	prealloc_destroy(htab);
 free_buckets:
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(tbl);
 free_htab:
 	kfree(htab);
 	return ERR_PTR(err);
@@ -410,14 +494,16 @@ static inline u32 htab_map_hash(const void *key, u32 key_len, u32 hashrnd)
 	return jhash(key, key_len, hashrnd);
 }
 
-static inline struct bucket *__select_bucket(struct bpf_htab *htab, u32 hash)
+static inline struct bucket *__select_bucket(struct bucket_table *tbl,
+					     u32 hash)
 {
-	return &htab->buckets[hash & (htab->n_buckets - 1)];
+	return &tbl->buckets[hash & (tbl->n_buckets - 1)];
 }
 
-static inline struct hlist_nulls_head *select_bucket(struct bpf_htab *htab, u32 hash)
+static inline struct hlist_nulls_head *select_bucket(struct bucket_table *tbl,
+						     u32 hash)
 {
-	return &__select_bucket(htab, hash)->head;
+	return &__select_bucket(tbl, hash)->head;
 }
 
 /* this lookup function can only be called with bucket lock taken */
@@ -456,6 +542,142 @@ static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
 	return NULL;
 }
 
+/* bpf_map_update_elem() can be called in_irq() */
+static void htab_lock_bucket(struct bpf_htab *htab, u32 hash,
+			     struct htab_lock *lk)
+{
+	struct bucket_table *tbl = htab_tbl(htab), *ntbl;
+
+	lk->b = __select_bucket(tbl, hash);
+	raw_spin_lock_irqsave(&lk->b->lock, lk->flags);
+
+	/* htab_resize() moves the elements of a bucket with its lock held */
+	ntbl = rcu_dereference_raw(tbl->future_tbl);
+	lk->nb = NULL;
+	if (unlikely(ntbl)) {
+		lk->nb = __select_bucket(ntbl, hash);
+		raw_spin_lock_nested(&lk->nb->lock, SINGLE_DEPTH_NESTING);
+	}
+}
+
+static void htab_unlock_bucket(struct htab_lock *lk)
+{
+	if (unlikely(lk->nb))
+		raw_spin_unlock(&lk->nb->lock);
+	raw_spin_unlock_irqrestore(&lk->b->lock, lk->flags);
+}
+
+/* the head new elements are added to */
+static struct hlist_nulls_head *htab_lock_head(struct htab_lock *lk)
+{
+	return lk->nb ? &lk->nb->head : &lk->b->head;
+}
+
+static struct htab_elem *lookup_elem_locked(struct htab_lock *lk, u32 hash,
+					    void *key, u32 key_size)
+{
+	struct htab_elem *l;
+
+	l = lookup_elem_raw(&lk->b->head, hash, key, key_size);
+	if (!l && lk->nb)
+		l = lookup_elem_raw(&lk->nb->head, hash, key, key_size);
+
+	return l;
+}
+
+/* Move the elements of bucket @b, locked, to their buckets in @ntbl.
+ * The last element is always the one moved: it is linked to the head
+ * of its new bucket before it is unlinked from @b, so a lookup walking
+ * @b either reaches it or finds @b without it, and then walks @ntbl.
+ */
+static void htab_move_bucket(struct bucket *b, struct bucket_table *ntbl)
+{
+	struct hlist_nulls_node *n, **pprev, *next;
+	struct htab_elem *l;
+	struct bucket *nb;
+
+	while (!hlist_nulls_empty(&b->head)) {
+		for (n = b->head.first; !is_a_nulls(n->next); n = n->next)
+			;
+		pprev = n->pprev;
+		next = n->next;
+
+		l = container_of(n, struct htab_elem, hash_node);
+		nb = __select_bucket(ntbl, l->hash);
+		raw_spin_lock_nested(&nb->lock, SINGLE_DEPTH_NESTING);
+		hlist_nulls_add_head_rcu(n, &nb->head);
+		raw_spin_unlock(&nb->lock);
+
+		rcu_assign_pointer(*pprev, next);
+	}
+}
+
+static void htab_resize(struct bpf_htab *htab)
+{
+	struct bucket_table *tbl = rcu_dereference_protected(htab->tbl, 1);
+	struct bucket_table *ntbl;
+	unsigned long flags;
+	u32 i;
+
+	if (tbl->n_buckets >= htab->n_buckets ||
+	    atomic_read(&htab->count) <= tbl->n_buckets)
+		return;
+
+	ntbl = htab_tbl_alloc(htab, tbl->n_buckets * 2);
+	if (!ntbl)
+		return;
+
+	/* From now on, updates lock the buckets of both tables */
+	rcu_assign_pointer(tbl->future_tbl, ntbl);
+
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct bucket *b = &tbl->buckets[i];
+
+		raw_spin_lock_irqsave(&b->lock, flags);
+		htab_move_bucket(b, ntbl);
+		raw_spin_unlock_irqrestore(&b->lock, flags);
+		cond_resched();
+	}
+
+	rcu_assign_pointer(htab->tbl, ntbl);
+
+	/* Wait for the lookups and updates still using the old table, which
+	 * also keeps the next resize from starting under them
+	 */
+	synchronize_rcu();
+	bpf_map_area_free(tbl);
+}
+
+static void htab_resize_work(struct work_struct *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_work);
+
+	htab_resize(htab);
+}
+
+/* Updates may come from programs running in any context, NMI included,
+ * where the resize can't be queued directly
+ */
+static void htab_resize_irq_work(struct irq_work *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_irq_work);
+
+	queue_work(system_unbound_wq, &htab->resize_work);
+}
+
+/* Called after an element was added to a BPF_F_RESIZABLE map */
+static void htab_grow_check(struct bpf_htab *htab)
+{
+	struct bucket_table *tbl = htab_tbl(htab);
+
+	/* grow at a load factor of 1 */
+	if (atomic_read(&htab->count) > tbl->n_buckets &&
+	    tbl->n_buckets < htab->n_buckets)
+		irq_work_queue(&htab->resize_irq_work);
+}
+
 /* Called from syscall or from eBPF program directly, so
  * arguments have to match bpf_map_lookup_elem() exactly.
  * The return value is adjusted by BPF instructions
@@ -465,6 +687,7 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_nulls_head *head;
+	struct bucket_table *tbl;
 	struct htab_elem *l;
 	u32 hash, key_size;
 
@@ -475,9 +698,19 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
+	tbl = rcu_dereference(htab->tbl);
+again:
+	head = select_bucket(tbl, hash);
+
+	l = lookup_nulls_elem_raw(head, hash, key, key_size, tbl->n_buckets);
 
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	if (!l && htab_is_resizable(htab)) {
+		/* see the next table if the element was moved there */
+		smp_rmb();
+		tbl = rcu_dereference(tbl->future_tbl);
+		if (unlikely(tbl))
+			goto again;
+	}
 
 	return l;
 }
@@ -568,7 +801,7 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	struct bucket *b;
 
 	tgt_l = container_of(node, struct htab_elem, lru_node);
-	b = __select_bucket(htab, tgt_l->hash);
+	b = __select_bucket(htab_tbl(htab), tgt_l->hash);
 	head = &b->head;
 
 	raw_spin_lock_irqsave(&b->lock, flags);
@@ -588,6 +821,7 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct bucket_table *tbl = rcu_dereference(htab->tbl);
 	struct hlist_nulls_head *head;
 	struct htab_elem *l, *next_l;
 	u32 hash, key_size;
@@ -602,10 +836,12 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
+	head = select_bucket(tbl, hash);
 
-	/* lookup the key */
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	/* lookup the key, a walk racing with a resize may miss or repeat
+	 * keys like one racing with deletes may restart
+	 */
+	l = lookup_nulls_elem_raw(head, hash, key, key_size, tbl->n_buckets);
 
 	if (!l)
 		goto find_first_elem;
@@ -621,13 +857,13 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	}
 
 	/* no more elements in this hash list, go to the next bucket */
-	i = hash & (htab->n_buckets - 1);
+	i = hash & (tbl->n_buckets - 1);
 	i++;
 
 find_first_elem:
 	/* iterate over buckets */
-	for (; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	for (; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		/* pick first element in the bucket */
 		next_l = hlist_nulls_entry_safe(rcu_dereference_raw(hlist_nulls_first_rcu(head)),
@@ -813,9 +1049,7 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct htab_elem *l_new = NULL, *l_old;
-	struct hlist_nulls_head *head;
-	unsigned long flags;
-	struct bucket *b;
+	struct htab_lock lk;
 	u32 key_size, hash;
 	int ret;
 
@@ -829,13 +1063,9 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	/* bpf_map_update_elem() can be called in_irq() */
-	raw_spin_lock_irqsave(&b->lock, flags);
+	htab_lock_bucket(htab, hash, &lk);
 
-	l_old = lookup_elem_raw(head, hash, key, key_size);
+	l_old = lookup_elem_locked(&lk, hash, key, key_size);
 
 	ret = check_flags(htab, l_old, map_flags);
 	if (ret)
@@ -852,7 +1082,7 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 	/* add new element to the head of the list, so that
 	 * concurrent search will find it before old elem
 	 */
-	hlist_nulls_add_head_rcu(&l_new->hash_node, head);
+	hlist_nulls_add_head_rcu(&l_new->hash_node, htab_lock_head(&lk));
 	if (l_old) {
 		hlist_nulls_del_rcu(&l_old->hash_node);
 		if (!htab_is_prealloc(htab))
@@ -860,7 +1090,9 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 	}
 	ret = 0;
 err:
-	raw_spin_unlock_irqrestore(&b->lock, flags);
+	htab_unlock_bucket(&lk);
+	if (!ret && !l_old && htab_is_resizable(htab))
+		htab_grow_check(htab);
 	return ret;
 }
 
@@ -885,7 +1117,7 @@ static int htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
+	b = __select_bucket(htab_tbl(htab), hash);
 	head = &b->head;
 
 	/* For LRU, we need to alloc before taking bucket's
@@ -934,9 +1166,7 @@ static int __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct htab_elem *l_new = NULL, *l_old;
-	struct hlist_nulls_head *head;
-	unsigned long flags;
-	struct bucket *b;
+	struct htab_lock lk;
 	u32 key_size, hash;
 	int ret;
 
@@ -950,13 +1180,9 @@ static int __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
-	/* bpf_map_update_elem() can be called in_irq() */
-	raw_spin_lock_irqsave(&b->lock, flags);
+	htab_lock_bucket(htab, hash, &lk);
 
-	l_old = lookup_elem_raw(head, hash, key, key_size);
+	l_old = lookup_elem_locked(&lk, hash, key, key_size);
 
 	ret = check_flags(htab, l_old, map_flags);
 	if (ret)
@@ -973,11 +1199,14 @@ static int __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 			ret = PTR_ERR(l_new);
 			goto err;
 		}
-		hlist_nulls_add_head_rcu(&l_new->hash_node, head);
+		hlist_nulls_add_head_rcu(&l_new->hash_node,
+					 htab_lock_head(&lk));
 	}
 	ret = 0;
 err:
-	raw_spin_unlock_irqrestore(&b->lock, flags);
+	htab_unlock_bucket(&lk);
+	if (!ret && !l_old && htab_is_resizable(htab))
+		htab_grow_check(htab);
 	return ret;
 }
 
@@ -1003,7 +1232,7 @@ static int __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
+	b = __select_bucket(htab_tbl(htab), hash);
 	head = &b->head;
 
 	/* For LRU, we need to alloc before taking bucket's
@@ -1063,10 +1292,8 @@ static int htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 static int htab_map_delete_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
-	struct hlist_nulls_head *head;
-	struct bucket *b;
+	struct htab_lock lk;
 	struct htab_elem *l;
-	unsigned long flags;
 	u32 hash, key_size;
 	int ret = -ENOENT;
 
@@ -1075,12 +1302,10 @@ static int htab_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
-	head = &b->head;
 
-	raw_spin_lock_irqsave(&b->lock, flags);
+	htab_lock_bucket(htab, hash, &lk);
 
-	l = lookup_elem_raw(head, hash, key, key_size);
+	l = lookup_elem_locked(&lk, hash, key, key_size);
 
 	if (l) {
 		hlist_nulls_del_rcu(&l->hash_node);
@@ -1088,7 +1313,7 @@ static int htab_map_delete_elem(struct bpf_map *map, void *key)
 		ret = 0;
 	}
 
-	raw_spin_unlock_irqrestore(&b->lock, flags);
+	htab_unlock_bucket(&lk);
 	return ret;
 }
 
@@ -1107,7 +1332,7 @@ static int htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
+	b = __select_bucket(htab_tbl(htab), hash);
 	head = &b->head;
 
 	raw_spin_lock_irqsave(&b->lock, flags);
@@ -1127,10 +1352,11 @@ static int htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 
 static void delete_all_elements(struct bpf_htab *htab)
 {
+	struct bucket_table *tbl = htab_tbl(htab);
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1153,6 +1379,10 @@ static void htab_map_free(struct bpf_map *map)
 	 */
 	synchronize_rcu();
 
+	/* no update can queue a resize anymore, wait for the one queued */
+	irq_work_sync(&htab->resize_irq_work);
+	cancel_work_sync(&htab->resize_work);
+
 	/* some of free_htab_elem() callbacks for elements of this map may
 	 * not have executed. Wait for them.
 	 */
@@ -1163,10 +1393,166 @@ static void htab_map_free(struct bpf_map *map)
 		prealloc_destroy(htab);
 
 	free_percpu(htab->extra_elems);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(htab_tbl(htab));
 	kfree(htab);
 }
 
+/* The batch is read with the bucket locks held: keep programs attached by
+ * kprobes from running into them on this cpu, as the syscall paths of the
+ * single element operations do.
+ */
+static void htab_batch_begin(void)
+{
+	preempt_disable();
+	__this_cpu_inc(bpf_prog_active);
+	rcu_read_lock();
+}
+
+static void htab_batch_end(void)
+{
+	rcu_read_unlock();
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable();
+}
+
+/* Batched lookup bucket by bucket, the batch is the index of the next
+ * bucket.  The elements of a bucket are copied out together, -ENOSPC is
+ * returned if count leaves no room even for the first bucket.  A batch
+ * resumed over a resize may return some elements twice, but none is
+ * missed.
+ */
+static int htab_map_lookup_batch(struct bpf_map *map,
+				 const union bpf_attr *attr,
+				 union bpf_attr __user *uattr)
+{
+	void __user *uobatch = u64_to_user_ptr(attr->batch.out_batch);
+	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
+	void __user *uvalues = u64_to_user_ptr(attr->batch.values);
+	void __user *ukeys = u64_to_user_ptr(attr->batch.keys);
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	u32 batch = 0, max_count, key_size, value_size, pcpu_size;
+	u32 bucket_cnt, bucket_size = 8, total = 0;
+	bool percpu = htab_is_percpu(htab);
+	void *keys, *values, *dst_key, *dst_val;
+	struct hlist_nulls_node *n;
+	struct bucket_table *tbl;
+	unsigned long flags;
+	struct htab_elem *l;
+	struct bucket *b;
+	int ret = 0;
+
+	if (attr->batch.elem_flags || attr->batch.flags)
+		return -EINVAL;
+
+	max_count = attr->batch.count;
+	if (!max_count)
+		return 0;
+
+	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+
+	key_size = map->key_size;
+	pcpu_size = round_up(map->value_size, 8);
+	value_size = percpu ? pcpu_size * num_possible_cpus() :
+		     map->value_size;
+
+alloc:
+	keys = kvmalloc_array(bucket_size, key_size, GFP_USER | __GFP_NOWARN);
+	values = kvmalloc_array(bucket_size, value_size,
+				GFP_USER | __GFP_NOWARN);
+	if (!keys || !values) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	while (total < max_count) {
+again:
+		htab_batch_begin();
+		tbl = rcu_dereference(htab->tbl);
+		if (batch >= tbl->n_buckets) {
+			htab_batch_end();
+			ret = -ENOENT;
+			break;
+		}
+
+		b = &tbl->buckets[batch];
+		raw_spin_lock_irqsave(&b->lock, flags);
+
+		if (unlikely(rcu_access_pointer(tbl->future_tbl))) {
+			/* some elements may be in the next table already */
+			raw_spin_unlock_irqrestore(&b->lock, flags);
+			htab_batch_end();
+			flush_work(&htab->resize_work);
+			goto again;
+		}
+
+		bucket_cnt = 0;
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node)
+			bucket_cnt++;
+
+		if (bucket_cnt > max_count - total ||
+		    bucket_cnt > bucket_size) {
+			raw_spin_unlock_irqrestore(&b->lock, flags);
+			htab_batch_end();
+			if (bucket_cnt > max_count - total) {
+				if (!total)
+					ret = -ENOSPC;
+				break;
+			}
+			bucket_size = bucket_cnt;
+			kvfree(keys);
+			kvfree(values);
+			goto alloc;
+		}
+
+		dst_key = keys;
+		dst_val = values;
+		hlist_nulls_for_each_entry(l, n, &b->head, hash_node) {
+			memcpy(dst_key, l->key, key_size);
+			if (percpu) {
+				void __percpu *pptr;
+				int off = 0, cpu;
+
+				pptr = htab_elem_get_ptr(l, key_size);
+				for_each_possible_cpu(cpu) {
+					bpf_long_memcpy(dst_val + off,
+							per_cpu_ptr(pptr, cpu),
+							pcpu_size);
+					off += pcpu_size;
+				}
+			} else {
+				memcpy(dst_val, l->key + round_up(key_size, 8),
+				       value_size);
+			}
+			dst_key += key_size;
+			dst_val += value_size;
+		}
+
+		raw_spin_unlock_irqrestore(&b->lock, flags);
+		htab_batch_end();
+
+		if (copy_to_user(ukeys + total * key_size, keys,
+				 bucket_cnt * key_size) ||
+		    copy_to_user(uvalues + total * value_size, values,
+				 bucket_cnt * value_size)) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		total += bucket_cnt;
+		batch++;
+		cond_resched();
+	}
+
+	if (copy_to_user(&uattr->batch.count, &total, sizeof(total)) ||
+	    copy_to_user(uobatch, &batch, sizeof(batch)))
+		ret = -EFAULT;
+out:
+	kvfree(keys);
+	kvfree(values);
+	return ret;
+}
+
 static void htab_map_seq_show_elem(struct bpf_map *map, void *key,
 				   struct seq_file *m)
 {
@@ -1198,6 +1584,9 @@ const struct bpf_map_ops htab_map_ops = {
 	.map_delete_elem = htab_map_delete_elem,
 	.map_gen_lookup = htab_map_gen_lookup,
 	.map_seq_show_elem = htab_map_seq_show_elem,
+	.map_lookup_batch = htab_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_map_ops = {
@@ -1210,6 +1599,9 @@ const struct bpf_map_ops htab_lru_map_ops = {
 	.map_delete_elem = htab_lru_map_delete_elem,
 	.map_gen_lookup = htab_lru_map_gen_lookup,
 	.map_seq_show_elem = htab_map_seq_show_elem,
+	.map_lookup_batch = htab_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 /* Called from eBPF program */
@@ -1293,6 +1685,9 @@ const struct bpf_map_ops htab_percpu_map_ops = {
 	.map_lookup_elem = htab_percpu_map_lookup_elem,
 	.map_update_elem = htab_percpu_map_update_elem,
 	.map_delete_elem = htab_map_delete_elem,
+	.map_lookup_batch = htab_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 const struct bpf_map_ops htab_lru_percpu_map_ops = {
@@ -1303,6 +1698,9 @@ const struct bpf_map_ops htab_lru_percpu_map_ops = {
 	.map_lookup_elem = htab_lru_percpu_map_lookup_elem,
 	.map_update_elem = htab_lru_percpu_map_update_elem,
 	.map_delete_elem = htab_lru_map_delete_elem,
+	.map_lookup_batch = htab_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
 };
 
 static int fd_htab_map_alloc_check(union bpf_attr *attr)
@@ -1317,11 +1715,17 @@ static void fd_htab_map_free(struct bpf_map *map)
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_nulls_node *n;
 	struct hlist_nulls_head *head;
+	struct bucket_table *tbl;
 	struct htab_elem *l;
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	/* only the syscall updates these maps, so only wait for a resize */
+	irq_work_sync(&htab->resize_irq_work);
+	cancel_work_sync(&htab->resize_work);
+
+	tbl = htab_tbl(htab);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
 			void *ptr = fd_htab_map_get_ptr(map, l);
@@ -12,9 +12,13 @@
 #include <linux/bpf.h>
 #include <linux/btf.h>
 #include <linux/err.h>
+#include <linux/irq_work.h>
+#include <linux/bitmap.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/ipv6.h>
 #include <uapi/linux/btf.h>
 
@@ -22,6 +26,7 @@
 #define LPM_TREE_NODE_FLAG_IM BIT(0)
 
 struct lpm_trie_node;
+struct lpm_mb_table;
 
 struct lpm_trie_node {
 	struct rcu_head rcu;
@@ -38,6 +43,10 @@ struct lpm_trie {
 	size_t				max_prefixlen;
 	size_t				data_size;
 	raw_spinlock_t			lock;
+	struct lpm_mb_table __rcu	*mb;
+	unsigned long			gen;
+	struct delayed_work		rebuild_work;
+	struct irq_work			rebuild_kick;
 };
 
 /* This trie implements a longest prefix match algorithm that can be used to
@@ -187,12 +196,384 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
+/* BPF_F_LPM_MULTIBIT tries keep a lookup table next to the binary trie.  It
+ * is built from the trie in a work item a little after updates, and lookups
+ * of full length keys use it for as long as no update came since.
+ *
+ * Each table node consumes one byte of the key, in the manner of poptrie:
+ * bit i of @vector is set if slot i leads to a child node, and the children
+ * are stored in slot order from @child_base on.  All the other slots are
+ * leaves, whose values have been pushed down from the shorter prefixes, and
+ * consecutive slots with the same value share it: bit i of @leafvec is set
+ * where a new value starts, and the values are stored from @leaf_base on.
+ * So a lookup takes one node per key byte up to the first leaf, and the
+ * popcount of a bitmap prefix gives the index of the next node or value.
+ */
+#define LPM_MB_STRIDE		8
+#define LPM_MB_SLOTS		(1 << LPM_MB_STRIDE)
+#define LPM_MB_REBUILD_DELAY	(HZ / 10)
+
+struct lpm_mb_node {
+	DECLARE_BITMAP(vector, LPM_MB_SLOTS);
+	DECLARE_BITMAP(leafvec, LPM_MB_SLOTS);
+	u32 child_base;
+	u32 leaf_base;
+};
+
+struct lpm_mb_table {
+	unsigned long gen;
+	struct lpm_mb_node *nodes;
+	void **leaves;
+};
+
+static void *lpm_mb_lookup(const struct lpm_mb_table *tbl, const u8 *data)
+{
+	const struct lpm_mb_node *node = tbl->nodes;
+	unsigned int i;
+
+	/* the last byte of the key never leads to a child */
+	for (;; data++) {
+		i = *data;
+		if (!test_bit(i, node->vector))
+			break;
+		node = &tbl->nodes[node->child_base +
+				   bitmap_weight(node->vector, i)];
+	}
+
+	return tbl->leaves[node->leaf_base +
+			   bitmap_weight(node->leafvec, i + 1) - 1];
+}
+
+/* A prefix of the trie, copied out as the trie may change while it's read */
+struct lpm_mb_entry {
+	void *value;
+	u32 prefixlen;
+	u32 data_size;
+	u8 data[0];
+};
+
+/* Positions of the prefixes a table node is built from, in the entries */
+struct lpm_mb_work {
+	u32 lo;
+	u32 hi;
+	u32 depth;
+	void *dflt;
+};
+
+static struct lpm_mb_entry *lpm_mb_entry(void *entries, size_t entry_size,
+					 u32 i)
+{
+	return entries + (size_t)i * entry_size;
+}
+
+static int lpm_mb_entry_cmp(const void *a, const void *b)
+{
+	const struct lpm_mb_entry *ea = a, *eb = b;
+
+	return memcmp(ea->data, eb->data, ea->data_size);
+}
+
+static int lpm_mb_grow(void **array, u32 *cap, u32 nr, size_t size)
+{
+	void *bigger;
+
+	if (nr < *cap)
+		return 0;
+
+	bigger = kvmalloc_array(*cap * 2, size, GFP_KERNEL);
+	if (!bigger)
+		return -ENOMEM;
+	memcpy(bigger, *array, nr * size);
+	kvfree(*array);
+	*array = bigger;
+	*cap *= 2;
+
+	return 0;
+}
+
+static void lpm_mb_table_free(struct lpm_mb_table *tbl)
+{
+	if (!tbl)
+		return;
+	kvfree(tbl->nodes);
+	kvfree(tbl->leaves);
+	kfree(tbl);
+}
+
+/* Copy the prefixes of the trie out, or return -EAGAIN if it grew meanwhile */
+static int lpm_mb_collect(struct lpm_trie *trie, void *entries,
+			  size_t entry_size, u32 max, u32 *nr)
+{
+	struct lpm_trie_node **stack, *node, *child[2];
+	struct lpm_mb_entry *e;
+	int sp = 0, err = 0;
+
+	/* prefix lengths grow going down, which bounds the pending nodes */
+	stack = kmalloc_array(trie->max_prefixlen + 2, sizeof(*stack),
+			      GFP_KERNEL);
+	if (!stack)
+		return -ENOMEM;
+
+	*nr = 0;
+	rcu_read_lock();
+	node = rcu_dereference(trie->root);
+	if (node)
+		stack[sp++] = node;
+	while (sp) {
+		node = stack[--sp];
+		if (!(node->flags & LPM_TREE_NODE_FLAG_IM)) {
+			if (*nr == max) {
+				err = -EAGAIN;
+				break;
+			}
+			e = lpm_mb_entry(entries, entry_size, (*nr)++);
+			e->value = node->data + trie->data_size;
+			e->prefixlen = node->prefixlen;
+			e->data_size = trie->data_size;
+			memcpy(e->data, node->data, trie->data_size);
+		}
+		child[0] = rcu_dereference(node->child[0]);
+		child[1] = rcu_dereference(node->child[1]);
+		if (child[1])
+			stack[sp++] = child[1];
+		if (child[0])
+			stack[sp++] = child[0];
+	}
+	rcu_read_unlock();
+
+	kfree(stack);
+	return err;
+}
+
+/* Build the table nodes breadth first, so that the children of each node
+ * are next to each other.  @entries are sorted, so the prefixes under a
+ * node are a range of them, and so are those under each of its slots.
+ */
+static struct lpm_mb_table *lpm_mb_build(void *entries, size_t entry_size,
+					 u32 nr_entries)
+{
+	u32 nr_nodes = 1, nr_leaves = 0, node_cap = 64, work_cap = 64;
+	u32 leaf_cap = 256;
+	struct lpm_mb_work *work = NULL;
+	struct lpm_mb_table *tbl;
+	struct lpm_mb_node node;
+	struct lpm_mb_entry *e;
+	void **slots = NULL;
+	u32 n, i, j, l, s;
+	bool have_leaf;
+	void *last;
+
+	tbl = kzalloc(sizeof(*tbl), GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+	tbl->nodes = kvmalloc_array(node_cap, sizeof(*tbl->nodes), GFP_KERNEL);
+	tbl->leaves = kvmalloc_array(leaf_cap, sizeof(*tbl->leaves),
+				     GFP_KERNEL);
+	work = kvmalloc_array(work_cap, sizeof(*work), GFP_KERNEL);
+	slots = kmalloc_array(LPM_MB_SLOTS, sizeof(*slots), GFP_KERNEL);
+	if (!tbl->nodes || !tbl->leaves || !work || !slots)
+		goto err;
+
+	work[0].lo = 0;
+	work[0].hi = nr_entries;
+	work[0].depth = 0;
+	work[0].dflt = NULL;
+	/* the other prefixes end in a slot, but /0 only matches by default */
+	for (i = 0; i < nr_entries; i++) {
+		e = lpm_mb_entry(entries, entry_size, i);
+		if (!e->prefixlen)
+			work[0].dflt = e->value;
+	}
+
+	for (n = 0; n < nr_nodes; n++) {
+		struct lpm_mb_work w = work[n];
+		u32 plen = w.depth * LPM_MB_STRIDE;
+
+		/* leaf push the prefixes ending in this node, shorter first */
+		for (s = 0; s < LPM_MB_SLOTS; s++)
+			slots[s] = w.dflt;
+		for (l = 1; l <= LPM_MB_STRIDE; l++) {
+			for (i = w.lo; i < w.hi; i++) {
+				e = lpm_mb_entry(entries, entry_size, i);
+				if (e->prefixlen != plen + l)
+					continue;
+				s = e->data[w.depth] &
+				    (0xff << (LPM_MB_STRIDE - l)) & 0xff;
+				for (j = 0; j < 1U << (LPM_MB_STRIDE - l); j++)
+					slots[s + j] = e->value;
+			}
+		}
+
+		memset(&node, 0, sizeof(node));
+		node.child_base = nr_nodes;
+		for (i = w.lo; i < w.hi; i = j) {
+			e = lpm_mb_entry(entries, entry_size, i);
+			j = i + 1;
+			if (e->prefixlen <= plen + LPM_MB_STRIDE)
+				continue;
+
+			s = e->data[w.depth];
+			while (j < w.hi &&
+			       lpm_mb_entry(entries, entry_size,
+					    j)->data[w.depth] == s)
+				j++;
+
+			if (lpm_mb_grow((void **)&tbl->nodes, &node_cap,
+					nr_nodes, sizeof(*tbl->nodes)) ||
+			    lpm_mb_grow((void **)&work, &work_cap, nr_nodes,
+					sizeof(*work)))
+				goto err;
+			__set_bit(s, node.vector);
+			work[nr_nodes].lo = i;
+			work[nr_nodes].hi = j;
+			work[nr_nodes].depth = w.depth + 1;
+			work[nr_nodes].dflt = slots[s];
+			nr_nodes++;
+		}
+
+		node.leaf_base = nr_leaves;
+		have_leaf = false;
+		last = NULL;
+		for (s = 0; s < LPM_MB_SLOTS; s++) {
+			if (test_bit(s, node.vector))
+				continue;
+			if (have_leaf && slots[s] == last)
+				continue;
+			if (lpm_mb_grow((void **)&tbl->leaves, &leaf_cap,
+					nr_leaves, sizeof(*tbl->leaves)))
+				goto err;
+			__set_bit(s, node.leafvec);
+			tbl->leaves[nr_leaves++] = slots[s];
+			last = slots[s];
+			have_leaf = true;
+		}
+
+		tbl->nodes[n] = node;
+	}
+
+	kfree(slots);
+	kvfree(work);
+	return tbl;
+err:
+	kfree(slots);
+	kvfree(work);
+	lpm_mb_table_free(tbl);
+	return NULL;
+}
+
+static void trie_mb_rebuild(struct work_struct *work)
+{
+	struct lpm_trie *trie = container_of(to_delayed_work(work),
+					     struct lpm_trie, rebuild_work);
+	struct lpm_mb_table *tbl, *old;
+	size_t entry_size;
+	unsigned long gen, irq_flags;
+	void *entries;
+	u32 max, nr;
+	int err;
+
+	entry_size = round_up(sizeof(struct lpm_mb_entry) + trie->data_size,
+			      sizeof(void *));
+	/* an update in progress queues a rebuild once it's done */
+	gen = smp_load_acquire(&trie->gen);
+	if (gen & 1)
+		return;
+	/* some room for the prefixes added meanwhile */
+	max = READ_ONCE(trie->n_entries) + 64;
+
+	entries = kvmalloc_array(max, entry_size, GFP_KERNEL);
+	if (!entries)
+		return;
+
+	err = lpm_mb_collect(trie, entries, entry_size, max, &nr);
+	if (err) {
+		kvfree(entries);
+		/* a trie that grew also queued another rebuild */
+		return;
+	}
+
+	sort(entries, nr, entry_size, lpm_mb_entry_cmp, NULL);
+	tbl = lpm_mb_build(entries, entry_size, nr);
+	kvfree(entries);
+	if (!tbl)
+		return;
+	tbl->gen = gen;
+
+	/* A table built while the trie changed is never used, as its gen is
+	 * behind, and the change queued a rebuild of its own.
+	 */
+	raw_spin_lock_irqsave(&trie->lock, irq_flags);
+	old = rcu_dereference_protected(trie->mb,
+					lockdep_is_held(&trie->lock));
+	rcu_assign_pointer(trie->mb, tbl);
+	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+	if (old) {
+		synchronize_rcu();
+		lpm_mb_table_free(old);
+	}
+}
+
+/* Called with trie->lock held around changes of the trie.  gen is odd while
+ * the trie changes, so a rebuild only starts from a trie no update is in
+ * the middle of, and a table is only used while gen is what it was built
+ * at.
+ */
+static void trie_mb_write_begin(struct lpm_trie *trie)
+{
+	if (!(trie->map.map_flags & BPF_F_LPM_MULTIBIT))
+		return;
+
+	WRITE_ONCE(trie->gen, trie->gen + 1);
+	/* order the odd gen before the changes a rebuild may read */
+	smp_wmb();
+}
+
+static void trie_mb_write_end(struct lpm_trie *trie)
+{
+	if (!(trie->map.map_flags & BPF_F_LPM_MULTIBIT))
+		return;
+
+	/* pairs with the smp_load_acquire() of trie_mb_rebuild() */
+	smp_store_release(&trie->gen, trie->gen + 1);
+}
+
+static void trie_mb_queue(struct lpm_trie *trie)
+{
+	/* updates within the delay are folded into one rebuild */
+	queue_delayed_work(system_unbound_wq, &trie->rebuild_work,
+			   LPM_MB_REBUILD_DELAY);
+}
+
+static void trie_mb_kick(struct irq_work *work)
+{
+	trie_mb_queue(container_of(work, struct lpm_trie, rebuild_kick));
+}
+
+static void trie_mb_schedule(struct lpm_trie *trie)
+{
+	if (!(trie->map.map_flags & BPF_F_LPM_MULTIBIT))
+		return;
+
+	/* programs attached to perf events update the trie from NMI */
+	if (in_nmi())
+		irq_work_queue(&trie->rebuild_kick);
+	else
+		trie_mb_queue(trie);
+}
+
 /* Called from syscall or from eBPF program */
 static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node *node, *found = NULL;
 	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_mb_table *tbl;
+
+	tbl = rcu_dereference(trie->mb);
+	if (tbl && key->prefixlen == trie->max_prefixlen &&
+	    tbl->gen == READ_ONCE(trie->gen))
+		return lpm_mb_lookup(tbl, key->data);
 
 	/* Start walking the trie from the root node ... */
 
@@ -280,6 +661,7 @@ static int trie_update_elem(struct bpf_map *map,
 		return -EINVAL;
 
 	raw_spin_lock_irqsave(&trie->lock, irq_flags);
+	trie_mb_write_begin(trie);
 
 	/* Allocate and fill a new node */
 
@@ -386,7 +768,9 @@ static int trie_update_elem(struct bpf_map *map,
 		kfree(im_node);
 	}
 
+	trie_mb_write_end(trie);
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
+	trie_mb_schedule(trie);
 
 	return ret;
 }
@@ -407,6 +791,7 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 		return -EINVAL;
 
 	raw_spin_lock_irqsave(&trie->lock, irq_flags);
+	trie_mb_write_begin(trie);
 
 	/* Walk the tree looking for an exact key/length match and keeping
 	 * track of the path we traverse.  We will need to know the node
@@ -481,7 +866,9 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 	kfree_rcu(node, rcu);
 
 out:
+	trie_mb_write_end(trie);
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
+	trie_mb_schedule(trie);
 
 	return ret;
 }
@@ -498,7 +885,8 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 #define LPM_KEY_SIZE_MIN	LPM_KEY_SIZE(LPM_DATA_SIZE_MIN)
 
 #define LPM_CREATE_FLAG_MASK	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE |	\
-				 BPF_F_RDONLY | BPF_F_WRONLY)
+				 BPF_F_RDONLY | BPF_F_WRONLY |		\
+				 BPF_F_LPM_MULTIBIT)
 
 static struct bpf_map *trie_alloc(union bpf_attr *attr)
 {
@@ -531,6 +919,11 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 
 	cost_per_node = sizeof(struct lpm_trie_node) +
 			attr->value_size + trie->data_size;
+	/* each prefix adds at most a table node and a few leaves per byte */
+	if (attr->map_flags & BPF_F_LPM_MULTIBIT)
+		cost_per_node += trie->data_size *
+				 (sizeof(struct lpm_mb_node) +
+				  3 * sizeof(void *));
 	cost += (u64) attr->max_entries * cost_per_node;
 	if (cost >= U32_MAX - PAGE_SIZE) {
 		ret = -E2BIG;
@@ -544,6 +937,8 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 		goto out_err;
 
 	raw_spin_lock_init(&trie->lock);
+	INIT_DELAYED_WORK(&trie->rebuild_work, trie_mb_rebuild);
+	init_irq_work(&trie->rebuild_kick, trie_mb_kick);
 
 	return &trie->map;
 out_err:
@@ -562,6 +957,11 @@ static void trie_free(struct bpf_map *map)
 	 */
 	synchronize_rcu();
 
+	/* no update can queue a rebuild anymore */
+	irq_work_sync(&trie->rebuild_kick);
+	cancel_delayed_work_sync(&trie->rebuild_work);
+	lpm_mb_table_free(rcu_dereference_protected(trie->mb, 1));
+
 	/* Always start at the root and walk down to a node that has no
 	 * children. Then free that node, nullify its reference in the parent
 	 * and start over.
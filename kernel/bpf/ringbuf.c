@@ -0,0 +1,404 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * A ring buffer shared by all CPUs.  Programs on any CPU copy records into it
+ * with bpf_ringbuf_output(), and a single consumer mmap()s it and reads the
+ * records in the order they were reserved, which per-CPU perf buffers can't
+ * offer.  The consumer sleeps in poll()/epoll_wait() on the map fd, and is
+ * only woken up when it has caught up with the producers, so a busy ring
+ * doesn't cost a wakeup per record.
+ */
+#include <linux/bpf.h>
+#include <linux/err.h>
+#include <linux/irq_work.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE)
+
+/* pages before the consumer page, which userspace can't map */
+#define RINGBUF_PGOFF \
+	(offsetof(struct bpf_ringbuf, consumer_pos) >> PAGE_SHIFT)
+/* consumer and producer pages */
+#define RINGBUF_POS_PAGES 2
+
+#define RINGBUF_MAX_RECORD_SZ (UINT_MAX / 4)
+
+struct bpf_ringbuf {
+	wait_queue_head_t waitq;
+	struct irq_work work;
+	u64 mask;
+	struct page **pages;
+	int nr_pages;
+	raw_spinlock_t lock ____cacheline_aligned_in_smp;
+	/* The consumer position is on a page of its own, which userspace
+	 * maps writable to advance it, while the producer position and the
+	 * data can only be mapped read-only.
+	 */
+	unsigned long consumer_pos __aligned(PAGE_SIZE);
+	unsigned long producer_pos __aligned(PAGE_SIZE);
+	char data[] __aligned(PAGE_SIZE);
+};
+
+struct bpf_ringbuf_map {
+	struct bpf_map map;
+	struct bpf_ringbuf *rb;
+};
+
+/* 8 byte header in front of each record */
+struct bpf_ringbuf_hdr {
+	u32 len;
+	u32 pad;
+};
+
+static struct bpf_ringbuf *bpf_ringbuf_area_alloc(size_t data_sz,
+						  int numa_node)
+{
+	const gfp_t flags = GFP_KERNEL | __GFP_RETRY_MAYFAIL | __GFP_NOWARN |
+			    __GFP_ZERO;
+	int nr_meta_pages = RINGBUF_PGOFF + RINGBUF_POS_PAGES;
+	int nr_data_pages = data_sz >> PAGE_SHIFT;
+	int nr_pages = nr_meta_pages + nr_data_pages;
+	struct page **pages, *page;
+	struct bpf_ringbuf *rb;
+	int i;
+
+	/* The data pages are mapped twice in a row, so that a record which
+	 * wraps around the end of the ring is still contiguous in memory,
+	 * both for the producers here and for the consumer's mmap().
+	 */
+	pages = kvmalloc_array(nr_meta_pages + 2 * nr_data_pages,
+			       sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return NULL;
+
+	for (i = 0; i < nr_pages; i++) {
+		page = alloc_pages_node(numa_node, flags, 0);
+		if (!page) {
+			nr_pages = i;
+			goto err_free_pages;
+		}
+		pages[i] = page;
+		if (i >= nr_meta_pages)
+			pages[nr_data_pages + i] = page;
+	}
+
+	rb = vmap(pages, nr_meta_pages + 2 * nr_data_pages,
+		  VM_ALLOC | VM_USERMAP, PAGE_KERNEL);
+	if (rb) {
+		rb->pages = pages;
+		rb->nr_pages = nr_pages;
+		return rb;
+	}
+
+err_free_pages:
+	for (i = 0; i < nr_pages; i++)
+		__free_page(pages[i]);
+	kvfree(pages);
+	return NULL;
+}
+
+static void bpf_ringbuf_notify(struct irq_work *work)
+{
+	struct bpf_ringbuf *rb = container_of(work, struct bpf_ringbuf, work);
+
+	wake_up_all(&rb->waitq);
+}
+
+static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
+{
+	struct page **pages = rb->pages;
+	int i, nr_pages = rb->nr_pages;
+
+	irq_work_sync(&rb->work);
+	vunmap(rb);
+	for (i = 0; i < nr_pages; i++)
+		__free_page(pages[i]);
+	kvfree(pages);
+}
+
+static int ringbuf_map_alloc_check(union bpf_attr *attr)
+{
+	if (attr->map_flags & ~RINGBUF_CREATE_FLAG_MASK)
+		return -EINVAL;
+
+	/* max_entries is the size of the ring, in bytes */
+	if (attr->key_size || attr->value_size ||
+	    !is_power_of_2(attr->max_entries) ||
+	    !PAGE_ALIGNED(attr->max_entries))
+		return -EINVAL;
+
+	return 0;
+}
+
+static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
+{
+	int numa_node = bpf_map_attr_numa_node(attr);
+	struct bpf_ringbuf_map *rb_map;
+	struct bpf_ringbuf *rb;
+	u64 cost;
+	int err;
+
+	/* the header's length leaves no room for bigger rings */
+	if ((u64)attr->max_entries > RINGBUF_MAX_RECORD_SZ)
+		return ERR_PTR(-E2BIG);
+
+	cost = sizeof(*rb_map) + sizeof(struct bpf_ringbuf) +
+	       attr->max_entries +
+	       (u64)(RINGBUF_PGOFF + RINGBUF_POS_PAGES +
+		     2 * (attr->max_entries >> PAGE_SHIFT)) *
+	       sizeof(struct page *);
+	cost = round_up(cost, PAGE_SIZE) >> PAGE_SHIFT;
+	if (cost >= U32_MAX - PAGE_SIZE)
+		return ERR_PTR(-E2BIG);
+
+	err = bpf_map_precharge_memlock(cost);
+	if (err)
+		return ERR_PTR(err);
+
+	rb_map = kzalloc(sizeof(*rb_map), GFP_USER);
+	if (!rb_map)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rb_map->map, attr);
+	rb_map->map.pages = cost;
+
+	rb = bpf_ringbuf_area_alloc(attr->max_entries, numa_node);
+	if (!rb) {
+		kfree(rb_map);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	init_waitqueue_head(&rb->waitq);
+	init_irq_work(&rb->work, bpf_ringbuf_notify);
+	raw_spin_lock_init(&rb->lock);
+	rb->mask = attr->max_entries - 1;
+	rb_map->rb = rb;
+
+	return &rb_map->map;
+}
+
+static void ringbuf_map_free(struct bpf_map *map)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	/* Wait for outstanding programs to complete */
+	synchronize_rcu();
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	bpf_ringbuf_free(rb_map->rb);
+	kfree(rb_map);
+}
+
+/* Records are only written by programs and read through mmap() */
+static void *ringbuf_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	return NULL;
+}
+
+static int ringbuf_map_update_elem(struct bpf_map *map, void *key,
+				   void *value, u64 flags)
+{
+	return -ENOTSUPP;
+}
+
+static int ringbuf_map_delete_elem(struct bpf_map *map, void *key)
+{
+	return -ENOTSUPP;
+}
+
+static int ringbuf_map_get_next_key(struct bpf_map *map, void *key,
+				    void *next_key)
+{
+	return -ENOTSUPP;
+}
+
+/* Page 0 of the mapping is the consumer page, the producer page and the
+ * data, twice, follow it.  Only the consumer page can be mapped writable,
+ * and nothing past the second copy of the data at all.
+ */
+static int ringbuf_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
+{
+	struct bpf_ringbuf_map *rb_map;
+	unsigned long nr_pages, nr_data_pages;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+
+	nr_data_pages = rb_map->rb->nr_pages - RINGBUF_PGOFF -
+			RINGBUF_POS_PAGES;
+	nr_pages = RINGBUF_POS_PAGES + 2 * nr_data_pages;
+	if (vma->vm_pgoff >= nr_pages ||
+	    vma_pages(vma) > nr_pages - vma->vm_pgoff)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE) {
+		/* only the consumer position can be written */
+		if (vma->vm_pgoff != 0 ||
+		    vma->vm_end - vma->vm_start != PAGE_SIZE)
+			return -EPERM;
+	} else {
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	return remap_vmalloc_range(vma, rb_map->rb,
+				   vma->vm_pgoff + RINGBUF_PGOFF);
+}
+
+static unsigned long ringbuf_avail_data_sz(struct bpf_ringbuf *rb)
+{
+	unsigned long cons_pos, prod_pos;
+
+	cons_pos = smp_load_acquire(&rb->consumer_pos);
+	prod_pos = smp_load_acquire(&rb->producer_pos);
+	return prod_pos - cons_pos;
+}
+
+static __poll_t ringbuf_map_poll(struct bpf_map *map, struct file *filp,
+				 struct poll_table_struct *pts)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	poll_wait(filp, &rb_map->rb->waitq, pts);
+
+	if (ringbuf_avail_data_sz(rb_map->rb))
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+const struct bpf_map_ops ringbuf_map_ops = {
+	.map_alloc_check = ringbuf_map_alloc_check,
+	.map_alloc = ringbuf_map_alloc,
+	.map_free = ringbuf_map_free,
+	.map_mmap = ringbuf_map_mmap,
+	.map_poll = ringbuf_map_poll,
+	.map_lookup_elem = ringbuf_map_lookup_elem,
+	.map_update_elem = ringbuf_map_update_elem,
+	.map_delete_elem = ringbuf_map_delete_elem,
+	.map_get_next_key = ringbuf_map_get_next_key,
+};
+
+/* Producers only serialize on moving producer_pos forward; the record is
+ * filled in and committed afterwards without the lock, so a consumer may
+ * find a busy record ahead of committed ones and has to wait for it.
+ */
+static void *bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
+{
+	unsigned long cons_pos, prod_pos, new_prod_pos, flags;
+	struct bpf_ringbuf_hdr *hdr;
+	u32 len;
+
+	if (unlikely(size > RINGBUF_MAX_RECORD_SZ))
+		return NULL;
+
+	len = round_up(size + BPF_RINGBUF_HDR_SZ, 8);
+	cons_pos = smp_load_acquire(&rb->consumer_pos);
+
+	/* an NMI may have interrupted a producer on this CPU */
+	if (in_nmi()) {
+		if (!raw_spin_trylock_irqsave(&rb->lock, flags))
+			return NULL;
+	} else {
+		raw_spin_lock_irqsave(&rb->lock, flags);
+	}
+
+	prod_pos = rb->producer_pos;
+	new_prod_pos = prod_pos + len;
+
+	/* the producers can't get a whole ring ahead of the consumer */
+	if (new_prod_pos - cons_pos > rb->mask) {
+		raw_spin_unlock_irqrestore(&rb->lock, flags);
+		return NULL;
+	}
+
+	hdr = (void *)rb->data + (prod_pos & rb->mask);
+	hdr->len = size | BPF_RINGBUF_BUSY_BIT;
+	hdr->pad = 0;
+
+	/* pairs with the consumer's load-acquire of producer_pos */
+	smp_store_release(&rb->producer_pos, new_prod_pos);
+
+	raw_spin_unlock_irqrestore(&rb->lock, flags);
+
+	return (void *)hdr + BPF_RINGBUF_HDR_SZ;
+}
+
+static void bpf_ringbuf_commit(struct bpf_ringbuf *rb, void *sample,
+			       u64 flags)
+{
+	unsigned long rec_pos, cons_pos;
+	struct bpf_ringbuf_hdr *hdr;
+
+	hdr = sample - BPF_RINGBUF_HDR_SZ;
+	/* publishes the record, ordered after the writes of its data */
+	xchg(&hdr->len, hdr->len & ~BPF_RINGBUF_BUSY_BIT);
+
+	/* The consumer only sleeps once it has read everything before this
+	 * record, so there is nobody to wake up otherwise.
+	 */
+	rec_pos = (void *)hdr - (void *)rb->data;
+	cons_pos = smp_load_acquire(&rb->consumer_pos) & rb->mask;
+
+	if (flags & BPF_RB_FORCE_WAKEUP)
+		irq_work_queue(&rb->work);
+	else if (cons_pos == rec_pos && !(flags & BPF_RB_NO_WAKEUP))
+		irq_work_queue(&rb->work);
+}
+
+BPF_CALL_4(bpf_ringbuf_output, struct bpf_map *, map, void *, data, u64, size,
+	   u64, flags)
+{
+	struct bpf_ringbuf_map *rb_map;
+	void *rec;
+
+	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
+		return -EINVAL;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	rec = bpf_ringbuf_reserve(rb_map->rb, size);
+	if (!rec)
+		return -EAGAIN;
+
+	memcpy(rec, data, size);
+	bpf_ringbuf_commit(rb_map->rb, rec, flags);
+	return 0;
+}
+
+const struct bpf_func_proto bpf_ringbuf_output_proto = {
+	.func		= bpf_ringbuf_output,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_PTR_TO_MEM,
+	.arg3_type	= ARG_CONST_SIZE_OR_ZERO,
+	.arg4_type	= ARG_ANYTHING,
+};
+
+BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
+{
+	struct bpf_ringbuf *rb;
+
+	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+
+	switch (flags) {
+	case BPF_RB_AVAIL_DATA:
+		return ringbuf_avail_data_sz(rb);
+	case BPF_RB_RING_SIZE:
+		return rb->mask + 1;
+	case BPF_RB_CONS_POS:
+		return smp_load_acquire(&rb->consumer_pos);
+	case BPF_RB_PROD_POS:
+		return smp_load_acquire(&rb->producer_pos);
+	default:
+		return 0;
+	}
+}
+
+const struct bpf_func_proto bpf_ringbuf_query_proto = {
+	.func		= bpf_ringbuf_query,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_ANYTHING,
+};
@@ -1302,7 +1302,6 @@ static int smap_do_ingress(struct smap_psock *psock, struct sk_buff *skb)
 	r->sg_end = num_sg == MAX_SKB_FRAGS ? 0 : num_sg;
 	r->skb = skb;
 	list_add_tail(&r->list, &psock->ingress);
-	sk->sk_data_ready(sk);
 	return copied;
 }
 
@@ -1383,13 +1382,28 @@ static void smap_data_ready(struct sock *sk)
 	rcu_read_unlock();
 }
 
+/* Put back the skbs of a batch not sent yet, ahead of those queued since */
+static void smap_tx_requeue(struct smap_psock *psock,
+			    struct sk_buff_head *batch)
+{
+	spin_lock_bh(&psock->rxqueue.lock);
+	skb_queue_splice(batch, &psock->rxqueue);
+	spin_unlock_bh(&psock->rxqueue.lock);
+}
+
+/* Redirected skbs are taken off rxqueue a batch at a time, and the reader is
+ * woken a single time for all the messages queued to the ingress list.
+ */
 static void smap_tx_work(struct work_struct *w)
 {
 	struct smap_psock *psock;
+	struct sk_buff_head batch;
+	bool ingress = false;
 	struct sk_buff *skb;
 	int rem, off, n;
 
 	psock = container_of(w, struct smap_psock, tx_work);
+	__skb_queue_head_init(&batch);
 
 	/* lock sock to avoid losing sk_socket at some point during loop */
 	lock_sock(psock->sock);
@@ -1401,7 +1415,12 @@ static void smap_tx_work(struct work_struct *w)
 		goto start;
 	}
 
-	while ((skb = skb_dequeue(&psock->rxqueue))) {
+next_batch:
+	spin_lock_bh(&psock->rxqueue.lock);
+	skb_queue_splice_init(&psock->rxqueue, &batch);
+	spin_unlock_bh(&psock->rxqueue.lock);
+
+	while ((skb = __skb_dequeue(&batch))) {
 		__u32 flags;
 
 		rem = skb->len;
@@ -1410,11 +1429,13 @@ static void smap_tx_work(struct work_struct *w)
 		flags = (TCP_SKB_CB(skb)->bpf.flags) & BPF_F_INGRESS;
 		do {
 			if (likely(psock->sock->sk_socket)) {
-				if (flags)
+				if (flags) {
 					n = smap_do_ingress(psock, skb);
-				else
+					ingress |= n > 0;
+				} else {
 					n = skb_send_sock_locked(psock->sock,
 								 skb, off, rem);
+				}
 			} else {
 				n = -EINVAL;
 			}
@@ -1440,7 +1461,13 @@ static void smap_tx_work(struct work_struct *w)
 		if (!flags)
 			kfree_skb(skb);
 	}
+	if (!skb_queue_empty(&psock->rxqueue))
+		goto next_batch;
 out:
+	if (!skb_queue_empty(&batch))
+		smap_tx_requeue(psock, &batch);
+	if (ingress)
+		psock->sock->sk_data_ready(psock->sock);
 	release_sock(psock->sock);
 }
 
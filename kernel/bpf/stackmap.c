@@ -12,6 +12,7 @@
 #include <linux/elf.h>
 #include <linux/pagemap.h>
 #include <linux/irq_work.h>
+#include <linux/hash.h>
 #include "percpu_freelist.h"
 
 #define STACK_CREATE_FLAG_MASK					\
@@ -48,7 +49,30 @@ static void do_up_read(struct irq_work *entry)
 	work->sem = NULL;
 }
 
-static DEFINE_PER_CPU(struct stack_map_irq_work, up_read_work);
+/* up_read()s an nmi on a cpu can leave pending before falling back to ips */
+#define STACK_MAP_UP_READ_WORKS 4
+
+static DEFINE_PER_CPU(struct stack_map_irq_work [STACK_MAP_UP_READ_WORKS],
+		      up_read_work);
+
+/*
+ * Build IDs of the ELF files seen last, so that the frames of a stack don't
+ * each need the first page of their file and an ELF parse.  Entries are
+ * read and written from nmi too: each one has its own sequence count, odd
+ * while it's being written, and a writer finding it odd leaves it alone.
+ */
+#define BUILD_ID_CACHE_BITS 9
+
+struct build_id_cache_entry {
+	unsigned int seq;
+	const struct inode *inode;
+	unsigned long ino;
+	u32 generation;
+	struct timespec64 mtime;
+	unsigned char build_id[BPF_BUILD_ID_SIZE];
+};
+
+static struct build_id_cache_entry build_id_cache[1 << BUILD_ID_CACHE_BITS];
 
 static inline bool stack_map_use_build_id(struct bpf_map *map)
 {
@@ -245,10 +269,64 @@ static int stack_map_get_build_id_64(void *page_addr,
 	return -EINVAL;
 }
 
+/* A freed inode's memory may be reused for another file, or the file be
+ * rewritten, so more than the pointer has to match.
+ */
+static bool build_id_cache_match(const struct build_id_cache_entry *e,
+				 const struct inode *inode)
+{
+	return e->inode == inode && e->ino == inode->i_ino &&
+	       e->generation == inode->i_generation &&
+	       timespec64_equal(&e->mtime, &inode->i_mtime);
+}
+
+static bool build_id_cache_lookup(const struct inode *inode,
+				  unsigned char *build_id)
+{
+	struct build_id_cache_entry *e;
+	unsigned int seq;
+	bool hit;
+
+	e = &build_id_cache[hash_ptr(inode, BUILD_ID_CACHE_BITS)];
+	seq = READ_ONCE(e->seq);
+	if (seq & 1)
+		return false;
+	smp_rmb();
+
+	hit = build_id_cache_match(e, inode);
+	if (hit)
+		memcpy(build_id, e->build_id, BPF_BUILD_ID_SIZE);
+
+	smp_rmb();
+	return hit && READ_ONCE(e->seq) == seq;
+}
+
+static void build_id_cache_store(const struct inode *inode,
+				 const unsigned char *build_id)
+{
+	struct build_id_cache_entry *e;
+	unsigned int seq;
+
+	e = &build_id_cache[hash_ptr(inode, BUILD_ID_CACHE_BITS)];
+	seq = READ_ONCE(e->seq);
+	/* cmpxchg() orders the odd count before the writes below */
+	if ((seq & 1) || cmpxchg(&e->seq, seq, seq + 1) != seq)
+		return;
+
+	e->inode = inode;
+	e->ino = inode->i_ino;
+	e->generation = inode->i_generation;
+	e->mtime = inode->i_mtime;
+	memcpy(e->build_id, build_id, BPF_BUILD_ID_SIZE);
+
+	smp_store_release(&e->seq, seq + 2);
+}
+
 /* Parse build ID of ELF file mapped to vma */
 static int stack_map_get_build_id(struct vm_area_struct *vma,
 				  unsigned char *build_id)
 {
+	struct inode *inode;
 	Elf32_Ehdr *ehdr;
 	struct page *page;
 	void *page_addr;
@@ -258,6 +336,10 @@ static int stack_map_get_build_id(struct vm_area_struct *vma,
 	if (!vma->vm_file)
 		return -EINVAL;
 
+	inode = file_inode(vma->vm_file);
+	if (build_id_cache_lookup(inode, build_id))
+		return 0;
+
 	page = find_get_page(vma->vm_file->f_mapping, 0);
 	if (!page)
 		return -EFAULT;	/* page not mapped */
@@ -281,20 +363,34 @@ static int stack_map_get_build_id(struct vm_area_struct *vma,
 out:
 	kunmap_atomic(page_addr);
 	put_page(page);
+	if (!ret)
+		build_id_cache_store(inode, build_id);
 	return ret;
 }
 
+static struct stack_map_irq_work *stack_map_up_read_work(void)
+{
+	struct stack_map_irq_work *works = *this_cpu_ptr(&up_read_work);
+	int i;
+
+	for (i = 0; i < STACK_MAP_UP_READ_WORKS; i++)
+		if (!(works[i].irq_work.flags & IRQ_WORK_BUSY))
+			return &works[i];
+
+	return NULL;
+}
+
 static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 					  u64 *ips, u32 trace_nr, bool user)
 {
 	int i;
-	struct vm_area_struct *vma;
+	struct vm_area_struct *vma, *prev_vma = NULL;
 	bool irq_work_busy = false;
 	struct stack_map_irq_work *work = NULL;
 
 	if (in_nmi()) {
-		work = this_cpu_ptr(&up_read_work);
-		if (work->irq_work.flags & IRQ_WORK_BUSY)
+		work = stack_map_up_read_work();
+		if (!work)
 			/* cannot queue more up_read, fallback */
 			irq_work_busy = true;
 	}
@@ -302,8 +398,8 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 	/*
 	 * We cannot do up_read() in nmi context. To do build_id lookup
 	 * in nmi context, we need to run up_read() in irq_work. We use
-	 * a percpu variable to do the irq_work. If the irq_work is
-	 * already used by another lookup, we fall back to report ips.
+	 * a few percpu irq_works for that. If all of them are already
+	 * used by other lookups, we fall back to report ips.
 	 *
 	 * Same fallback is used for kernel stack (!user) on a stackmap
 	 * with build_id.
@@ -320,17 +416,29 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 	}
 
 	for (i = 0; i < trace_nr; i++) {
+		/* the frames of a stack often are in the same file */
+		if (prev_vma && ips[i] >= prev_vma->vm_start &&
+		    ips[i] < prev_vma->vm_end) {
+			vma = prev_vma;
+			memcpy(id_offs[i].build_id, id_offs[i - 1].build_id,
+			       BPF_BUILD_ID_SIZE);
+			goto build_id_valid;
+		}
 		vma = find_vma(current->mm, ips[i]);
-		if (!vma || stack_map_get_build_id(vma, id_offs[i].build_id)) {
+		if (!vma || ips[i] < vma->vm_start ||
+		    stack_map_get_build_id(vma, id_offs[i].build_id)) {
 			/* per entry fall back to ips */
 			id_offs[i].status = BPF_STACK_BUILD_ID_IP;
 			id_offs[i].ip = ips[i];
 			memset(id_offs[i].build_id, 0, BPF_BUILD_ID_SIZE);
+			prev_vma = NULL;
 			continue;
 		}
+build_id_valid:
 		id_offs[i].offset = (vma->vm_pgoff << PAGE_SHIFT) + ips[i]
 			- vma->vm_start;
 		id_offs[i].status = BPF_STACK_BUILD_ID_VALID;
+		prev_vma = vma;
 	}
 
 	if (!work) {
@@ -618,12 +726,13 @@ const struct bpf_map_ops stack_map_ops = {
 
 static int __init stack_map_init(void)
 {
-	int cpu;
-	struct stack_map_irq_work *work;
+	int cpu, i;
+	struct stack_map_irq_work *works;
 
 	for_each_possible_cpu(cpu) {
-		work = per_cpu_ptr(&up_read_work, cpu);
-		init_irq_work(&work->irq_work, do_up_read);
+		works = *per_cpu_ptr(&up_read_work, cpu);
+		for (i = 0; i < STACK_MAP_UP_READ_WORKS; i++)
+			init_irq_work(&works[i].irq_work, do_up_read);
 	}
 	return 0;
 }
@@ -212,10 +212,16 @@ int cgroup_migrate(struct task_struct *leader, bool threadgroup,
 
 int cgroup_attach_task(struct cgroup *dst_cgrp, struct task_struct *leader,
 		       bool threadgroup);
+int cgroup_attach_tasks(struct cgroup *dst_cgrp, struct task_struct **leaders,
+			int nr, bool threadgroup);
 struct task_struct *cgroup_procs_write_start(char *buf, bool threadgroup)
 	__acquires(&cgroup_threadgroup_rwsem);
+int cgroup_procs_write_start_list(const pid_t *pids, int nr_pids,
+				  bool threadgroup, struct task_struct **tasks);
 void cgroup_procs_write_finish(struct task_struct *task)
 	__releases(&cgroup_threadgroup_rwsem);
+void cgroup_procs_write_finish_list(struct task_struct **tasks, int nr)
+	__releases(&cgroup_threadgroup_rwsem);
 
 void cgroup_lock_and_drain_offline(struct cgroup *cgrp);
 
@@ -515,23 +515,43 @@ static int cgroup_pidlist_show(struct seq_file *s, void *v)
 	return 0;
 }
 
-static ssize_t __cgroup1_procs_write(struct kernfs_open_file *of,
-				     char *buf, size_t nbytes, loff_t off,
-				     bool threadgroup)
+/* Parse the whitespace separated pids of @buf into a new array */
+static int cgroup1_parse_pids(char *buf, pid_t **pidsp)
 {
-	struct cgroup *cgrp;
-	struct task_struct *task;
-	const struct cred *cred, *tcred;
-	ssize_t ret;
+	char *p, *tok;
+	pid_t *pids;
+	int max = 0, nr = 0;
+
+	for (p = skip_spaces(buf); *p; p = skip_spaces(p)) {
+		max++;
+		while (*p && !isspace(*p))
+			p++;
+	}
+	if (!max)
+		return -EINVAL;
 
-	cgrp = cgroup_kn_lock_live(of->kn, false);
-	if (!cgrp)
-		return -ENODEV;
+	pids = kmalloc_array(max, sizeof(*pids), GFP_KERNEL);
+	if (!pids)
+		return -ENOMEM;
 
-	task = cgroup_procs_write_start(buf, threadgroup);
-	ret = PTR_ERR_OR_ZERO(task);
-	if (ret)
-		goto out_unlock;
+	while ((tok = strsep(&buf, " \t\n"))) {
+		if (!*tok)
+			continue;
+		if (kstrtoint(tok, 0, &pids[nr]) || pids[nr] < 0) {
+			kfree(pids);
+			return -EINVAL;
+		}
+		nr++;
+	}
+
+	*pidsp = pids;
+	return nr;
+}
+
+static int cgroup1_may_attach(struct task_struct *task)
+{
+	const struct cred *cred, *tcred;
+	int ret = 0;
 
 	/*
 	 * Even if we're attaching all tasks in the thread group, we only
@@ -545,15 +565,86 @@ static ssize_t __cgroup1_procs_write(struct kernfs_open_file *of,
 	    !ns_capable(tcred->user_ns, CAP_SYS_NICE))
 		ret = -EACCES;
 	put_cred(tcred);
+
+	return ret;
+}
+
+/*
+ * The v1 memory and cpuset controllers expect a single leader per
+ * migration: memcg moves the charges of one mm only, and cpuset takes the
+ * source cpuset of the mm from the first task of the set.
+ */
+static bool cgroup1_attach_one_by_one(struct cgroup_root *root)
+{
+	u16 mask = 0;
+
+#ifdef CONFIG_MEMCG
+	mask |= (u16)1 << memory_cgrp_id;
+#endif
+#ifdef CONFIG_CPUSETS
+	mask |= (u16)1 << cpuset_cgrp_id;
+#endif
+	return root->subsys_mask & mask;
+}
+
+/*
+ * Several pids may be written at once, separated by whitespace, and all of
+ * them are then moved together, taking cgroup_threadgroup_rwsem once and
+ * going through the ->attach() callbacks once.  This is much cheaper than
+ * a write per pid when moving the threads of an app to another group.
+ * Hierarchies with memory or cpuset still take the rwsem once, but move
+ * one pid at a time, and stop at the first one that fails.
+ */
+static ssize_t __cgroup1_procs_write(struct kernfs_open_file *of,
+				     char *buf, size_t nbytes, loff_t off,
+				     bool threadgroup)
+{
+	struct cgroup *cgrp;
+	struct task_struct **tasks;
+	pid_t *pids;
+	int nr, i;
+	ssize_t ret;
+
+	nr = cgroup1_parse_pids(buf, &pids);
+	if (nr < 0)
+		return nr;
+
+	tasks = kcalloc(nr, sizeof(*tasks), GFP_KERNEL);
+	if (!tasks) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	cgrp = cgroup_kn_lock_live(of->kn, false);
+	if (!cgrp) {
+		ret = -ENODEV;
+		goto out_free;
+	}
+
+	nr = cgroup_procs_write_start_list(pids, nr, threadgroup, tasks);
+	ret = min(nr, 0);
+	if (ret)
+		goto out_unlock;
+
+	for (i = 0; i < nr && !ret; i++)
+		ret = cgroup1_may_attach(tasks[i]);
 	if (ret)
 		goto out_finish;
 
-	ret = cgroup_attach_task(cgrp, task, threadgroup);
+	if (cgroup1_attach_one_by_one(cgrp->root)) {
+		for (i = 0; i < nr && !ret; i++)
+			ret = cgroup_attach_task(cgrp, tasks[i], threadgroup);
+	} else {
+		ret = cgroup_attach_tasks(cgrp, tasks, nr, threadgroup);
+	}
 
 out_finish:
-	cgroup_procs_write_finish(task);
+	cgroup_procs_write_finish_list(tasks, nr);
 out_unlock:
 	cgroup_kn_unlock(of->kn);
+out_free:
+	kfree(tasks);
+	kfree(pids);
 
 	return ret ?: nbytes;
 }
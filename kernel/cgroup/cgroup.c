@@ -2560,6 +2560,20 @@ int cgroup_migrate_prepare_dst(struct cgroup_mgctx *mgctx)
 	return -ENOMEM;
 }
 
+/* Call with css_set_lock and rcu_read_lock held */
+static void cgroup_migrate_add_leader(struct task_struct *leader,
+				      bool threadgroup,
+				      struct cgroup_mgctx *mgctx)
+{
+	struct task_struct *task = leader;
+
+	do {
+		cgroup_migrate_add_task(task, mgctx);
+		if (!threadgroup)
+			break;
+	} while_each_thread(leader, task);
+}
+
 /**
  * cgroup_migrate - migrate a process or task to a cgroup
  * @leader: the leader of the process or the task to migrate
@@ -2581,8 +2595,6 @@ int cgroup_migrate_prepare_dst(struct cgroup_mgctx *mgctx)
 int cgroup_migrate(struct task_struct *leader, bool threadgroup,
 		   struct cgroup_mgctx *mgctx)
 {
-	struct task_struct *task;
-
 	/*
 	 * Prevent freeing of tasks while we take a snapshot. Tasks that are
 	 * already PF_EXITING could be freed from underneath us unless we
@@ -2590,12 +2602,7 @@ int cgroup_migrate(struct task_struct *leader, bool threadgroup,
 	 */
 	spin_lock_irq(&css_set_lock);
 	rcu_read_lock();
-	task = leader;
-	do {
-		cgroup_migrate_add_task(task, mgctx);
-		if (!threadgroup)
-			break;
-	} while_each_thread(leader, task);
+	cgroup_migrate_add_leader(leader, threadgroup, mgctx);
 	rcu_read_unlock();
 	spin_unlock_irq(&css_set_lock);
 
@@ -2603,19 +2610,25 @@ int cgroup_migrate(struct task_struct *leader, bool threadgroup,
 }
 
 /**
- * cgroup_attach_task - attach a task or a whole threadgroup to a cgroup
+ * cgroup_attach_tasks - attach several tasks or threadgroups to a cgroup
  * @dst_cgrp: the cgroup to attach to
- * @leader: the task or the leader of the threadgroup to be attached
- * @threadgroup: attach the whole threadgroup?
+ * @leaders: the tasks or the leaders of the threadgroups to be attached
+ * @nr: the number of entries of @leaders, which must all be different
+ * @threadgroup: attach the whole threadgroups?
+ *
+ * All of @leaders are migrated together, with a single pass through the
+ * ->can_attach() and ->attach() callbacks of the controllers.  On error,
+ * none of them is migrated; otherwise all of their tasks are, but those
+ * already exiting.
  *
  * Call holding cgroup_mutex and cgroup_threadgroup_rwsem.
  */
-int cgroup_attach_task(struct cgroup *dst_cgrp, struct task_struct *leader,
-		       bool threadgroup)
+int cgroup_attach_tasks(struct cgroup *dst_cgrp, struct task_struct **leaders,
+			int nr, bool threadgroup)
 {
 	DEFINE_CGROUP_MGCTX(mgctx);
 	struct task_struct *task;
-	int ret;
+	int i, ret;
 
 	ret = cgroup_migrate_vet_dst(dst_cgrp);
 	if (ret)
@@ -2624,46 +2637,65 @@ int cgroup_attach_task(struct cgroup *dst_cgrp, struct task_struct *leader,
 	/* look up all src csets */
 	spin_lock_irq(&css_set_lock);
 	rcu_read_lock();
-	task = leader;
-	do {
-		cgroup_migrate_add_src(task_css_set(task), dst_cgrp, &mgctx);
-		if (!threadgroup)
-			break;
-	} while_each_thread(leader, task);
+	for (i = 0; i < nr; i++) {
+		task = leaders[i];
+		do {
+			cgroup_migrate_add_src(task_css_set(task), dst_cgrp,
+					       &mgctx);
+			if (!threadgroup)
+				break;
+		} while_each_thread(leaders[i], task);
+	}
 	rcu_read_unlock();
 	spin_unlock_irq(&css_set_lock);
 
 	/* prepare dst csets and commit */
 	ret = cgroup_migrate_prepare_dst(&mgctx);
-	if (!ret)
-		ret = cgroup_migrate(leader, threadgroup, &mgctx);
+	if (!ret) {
+		spin_lock_irq(&css_set_lock);
+		rcu_read_lock();
+		for (i = 0; i < nr; i++)
+			cgroup_migrate_add_leader(leaders[i], threadgroup,
+						  &mgctx);
+		rcu_read_unlock();
+		spin_unlock_irq(&css_set_lock);
+
+		ret = cgroup_migrate_execute(&mgctx);
+	}
 
 	cgroup_migrate_finish(&mgctx);
 
 	if (!ret)
-		TRACE_CGROUP_PATH(attach_task, dst_cgrp, leader, threadgroup);
+		for (i = 0; i < nr; i++)
+			TRACE_CGROUP_PATH(attach_task, dst_cgrp, leaders[i],
+					  threadgroup);
 
 	return ret;
 }
 
-struct task_struct *cgroup_procs_write_start(char *buf, bool threadgroup)
-	__acquires(&cgroup_threadgroup_rwsem)
+/**
+ * cgroup_attach_task - attach a task or a whole threadgroup to a cgroup
+ * @dst_cgrp: the cgroup to attach to
+ * @leader: the task or the leader of the threadgroup to be attached
+ * @threadgroup: attach the whole threadgroup?
+ *
+ * Call holding cgroup_mutex and cgroup_threadgroup_rwsem.
+ */
+int cgroup_attach_task(struct cgroup *dst_cgrp, struct task_struct *leader,
+		       bool threadgroup)
 {
-	struct task_struct *tsk;
-	pid_t pid;
-
-	if (kstrtoint(strstrip(buf), 0, &pid) || pid < 0)
-		return ERR_PTR(-EINVAL);
+	return cgroup_attach_tasks(dst_cgrp, &leader, 1, threadgroup);
+}
 
-	percpu_down_write(&cgroup_threadgroup_rwsem);
+/* Call with rcu_read_lock held */
+static struct task_struct *cgroup_procs_find_task(pid_t pid, bool threadgroup)
+{
+	struct task_struct *tsk;
 
-	rcu_read_lock();
 	if (pid) {
 		tsk = find_task_by_vpid(pid);
-		if (!tsk) {
-			tsk = ERR_PTR(-ESRCH);
-			goto out_unlock_threadgroup;
-		}
+		if (!tsk)
+			return ERR_PTR(-ESRCH);
 	} else {
 		tsk = current;
 	}
@@ -2677,29 +2709,98 @@ struct task_struct *cgroup_procs_write_start(char *buf, bool threadgroup)
 	 * become trapped in a cpuset, or RT kthread may be born in a
 	 * cgroup with no rt_runtime allocated.  Just say no.
 	 */
-	if (tsk->no_cgroup_migration || (tsk->flags & PF_NO_SETAFFINITY)) {
-		tsk = ERR_PTR(-EINVAL);
-		goto out_unlock_threadgroup;
-	}
+	if (tsk->no_cgroup_migration || (tsk->flags & PF_NO_SETAFFINITY))
+		return ERR_PTR(-EINVAL);
 
-	get_task_struct(tsk);
-	goto out_unlock_rcu;
+	return tsk;
+}
 
-out_unlock_threadgroup:
-	percpu_up_write(&cgroup_threadgroup_rwsem);
-out_unlock_rcu:
+struct task_struct *cgroup_procs_write_start(char *buf, bool threadgroup)
+	__acquires(&cgroup_threadgroup_rwsem)
+{
+	struct task_struct *tsk;
+	pid_t pid;
+
+	if (kstrtoint(strstrip(buf), 0, &pid) || pid < 0)
+		return ERR_PTR(-EINVAL);
+
+	percpu_down_write(&cgroup_threadgroup_rwsem);
+
+	rcu_read_lock();
+	tsk = cgroup_procs_find_task(pid, threadgroup);
+	if (IS_ERR(tsk))
+		percpu_up_write(&cgroup_threadgroup_rwsem);
+	else
+		get_task_struct(tsk);
 	rcu_read_unlock();
+
 	return tsk;
 }
 
+/**
+ * cgroup_procs_write_start_list - look up the tasks of several pids
+ * @pids: the pids, 0 meaning current
+ * @nr_pids: the number of entries of @pids
+ * @threadgroup: look up the threadgroup leaders of the pids?
+ * @tasks: where to put the tasks, with room for @nr_pids of them
+ *
+ * Like cgroup_procs_write_start(), but for several pids under a single
+ * acquisition of cgroup_threadgroup_rwsem, which is what makes moving
+ * many tasks at once cheap.  A task is only put in @tasks once, however
+ * many of its pids there are.
+ *
+ * Returns the number of tasks with cgroup_threadgroup_rwsem held, to be
+ * released with cgroup_procs_write_finish_list(), or -errno without.
+ */
+int cgroup_procs_write_start_list(const pid_t *pids, int nr_pids,
+				  bool threadgroup, struct task_struct **tasks)
+{
+	int i, j, nr = 0;
+
+	percpu_down_write(&cgroup_threadgroup_rwsem);
+
+	rcu_read_lock();
+	for (i = 0; i < nr_pids; i++) {
+		struct task_struct *tsk;
+
+		tsk = cgroup_procs_find_task(pids[i], threadgroup);
+		if (IS_ERR(tsk)) {
+			rcu_read_unlock();
+			while (nr--)
+				put_task_struct(tasks[nr]);
+			percpu_up_write(&cgroup_threadgroup_rwsem);
+			return PTR_ERR(tsk);
+		}
+
+		for (j = 0; j < nr; j++)
+			if (tasks[j] == tsk)
+				break;
+		if (j < nr)
+			continue;
+
+		get_task_struct(tsk);
+		tasks[nr++] = tsk;
+	}
+	rcu_read_unlock();
+
+	return nr;
+}
+
 void cgroup_procs_write_finish(struct task_struct *task)
 	__releases(&cgroup_threadgroup_rwsem)
+{
+	cgroup_procs_write_finish_list(&task, 1);
+}
+
+void cgroup_procs_write_finish_list(struct task_struct **tasks, int nr)
+	__releases(&cgroup_threadgroup_rwsem)
 {
 	struct cgroup_subsys *ss;
 	int ssid;
 
-	/* release reference from cgroup_procs_write_start() */
-	put_task_struct(task);
+	/* release references from cgroup_procs_write_start{,_list}() */
+	while (nr--)
+		put_task_struct(tasks[nr]);
 
 	percpu_up_write(&cgroup_threadgroup_rwsem);
 	for_each_subsys(ss, ssid)
@@ -176,6 +176,7 @@ typedef enum {
 	CS_SCHED_LOAD_BALANCE,
 	CS_SPREAD_PAGE,
 	CS_SPREAD_SLAB,
+	CS_TIMER_COALESCE,
 } cpuset_flagbits_t;
 
 /* convenient tests for these bits */
@@ -219,6 +220,11 @@ static inline int is_spread_slab(const struct cpuset *cs)
 	return test_bit(CS_SPREAD_SLAB, &cs->flags);
 }
 
+static inline int is_timer_coalesce(const struct cpuset *cs)
+{
+	return test_bit(CS_TIMER_COALESCE, &cs->flags);
+}
+
 static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_ONLINE) | (1 << CS_CPU_EXCLUSIVE) |
 		  (1 << CS_MEM_EXCLUSIVE)),
@@ -385,7 +391,8 @@ static void guarantee_online_mems(struct cpuset *cs, nodemask_t *pmask)
 }
 
 /*
- * update task's spread flag if cpuset's page/slab spread flag is set
+ * update task's spread flag if cpuset's page/slab spread flag is set,
+ * and its timer coalescing flag if the cpuset's one is
  *
  * Call with callback_lock or cpuset_mutex held.
  */
@@ -401,6 +408,11 @@ static void cpuset_update_task_spread_flag(struct cpuset *cs,
 		task_set_spread_slab(tsk);
 	else
 		task_clear_spread_slab(tsk);
+
+	if (is_timer_coalesce(cs))
+		task_set_timer_coalesce(tsk);
+	else
+		task_clear_timer_coalesce(tsk);
 }
 
 /*
@@ -1339,7 +1351,9 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 				is_sched_load_balance(trialcs));
 
 	spread_flag_changed = ((is_spread_slab(cs) != is_spread_slab(trialcs))
-			|| (is_spread_page(cs) != is_spread_page(trialcs)));
+			|| (is_spread_page(cs) != is_spread_page(trialcs))
+			|| (is_timer_coalesce(cs) !=
+			    is_timer_coalesce(trialcs)));
 
 	spin_lock_irq(&callback_lock);
 	cs->flags = trialcs->flags;
@@ -1605,6 +1619,7 @@ typedef enum {
 	FILE_MEMORY_PRESSURE,
 	FILE_SPREAD_PAGE,
 	FILE_SPREAD_SLAB,
+	FILE_TIMER_COALESCE,
 } cpuset_filetype_t;
 
 static int cpuset_write_u64(struct cgroup_subsys_state *css, struct cftype *cft,
@@ -1645,6 +1660,9 @@ static int cpuset_write_u64(struct cgroup_subsys_state *css, struct cftype *cft,
 	case FILE_SPREAD_SLAB:
 		retval = update_flag(CS_SPREAD_SLAB, cs, val);
 		break;
+	case FILE_TIMER_COALESCE:
+		retval = update_flag(CS_TIMER_COALESCE, cs, val);
+		break;
 	default:
 		retval = -EINVAL;
 		break;
@@ -1804,6 +1822,8 @@ static u64 cpuset_read_u64(struct cgroup_subsys_state *css, struct cftype *cft)
 		return is_spread_page(cs);
 	case FILE_SPREAD_SLAB:
 		return is_spread_slab(cs);
+	case FILE_TIMER_COALESCE:
+		return is_timer_coalesce(cs);
 	default:
 		BUG();
 	}
@@ -1923,6 +1943,13 @@ static struct cftype files[] = {
 		.private = FILE_SPREAD_SLAB,
 	},
 
+	{
+		.name = "timer_coalesce",
+		.read_u64 = cpuset_read_u64,
+		.write_u64 = cpuset_write_u64,
+		.private = FILE_TIMER_COALESCE,
+	},
+
 	{
 		.name = "memory_pressure_enabled",
 		.flags = CFTYPE_ONLY_ON_ROOT,
@@ -1994,6 +2021,8 @@ static int cpuset_css_online(struct cgroup_subsys_state *css)
 		set_bit(CS_SPREAD_PAGE, &cs->flags);
 	if (is_spread_slab(parent))
 		set_bit(CS_SPREAD_SLAB, &cs->flags);
+	if (is_timer_coalesce(parent))
+		set_bit(CS_TIMER_COALESCE, &cs->flags);
 
 	cpuset_inc();
 
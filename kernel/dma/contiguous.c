@@ -23,6 +23,12 @@
 #include <linux/sizes.h>
 #include <linux/dma-contiguous.h>
 #include <linux/cma.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
 
 #ifdef CONFIG_CMA_SIZE_MBYTES
 #define CMA_SIZE_MBYTES CONFIG_CMA_SIZE_MBYTES
@@ -177,6 +183,222 @@ int __init dma_contiguous_reserve_area(phys_addr_t size, phys_addr_t base,
 	return 0;
 }
 
+/*
+ * Pre-allocated memory.  A cma_alloc() migrates the movable pages out of
+ * the range it picks in the context of the caller, which can take a long
+ * time on a loaded system.  With cma_prefill=<size>, a worker keeps a run
+ * of up to that size allocated from each area in use, once allocations
+ * from it have been quiet for a while, and dma_alloc_from_contiguous()
+ * hands out pages from the run without migrating anything.  When an
+ * allocation doesn't fit the run, the run is given back before falling
+ * back to cma_alloc(), so it never makes an allocation fail.  The pages
+ * of the run are only migrated, not zeroed: callers clear them as they
+ * would after cma_alloc().
+ *
+ * Allocation latency is accounted for each area either way.
+ */
+#define CMA_PREFILL_DELAY	HZ
+
+struct cma_prefill {
+	struct cma *cma;
+	struct mutex lock;		/* protects all below, never held
+					 * across cma_alloc() */
+	struct page *pages;		/* pre-allocated run, or NULL */
+	unsigned long count;		/* pages in the run */
+	struct delayed_work work;
+
+	unsigned long allocs;		/* allocations ... */
+	unsigned long fast_allocs;	/* ... of which served by the run */
+	unsigned long failed_allocs;
+	u64 total_ns, max_ns;
+};
+
+static struct cma_prefill cma_prefills[MAX_CMA_AREAS];
+static unsigned int cma_prefill_areas;
+static DEFINE_MUTEX(cma_prefill_mutex);
+static unsigned long cma_prefill_pages;
+
+static int __init early_cma_prefill(char *p)
+{
+	cma_prefill_pages = memparse(p, &p) >> PAGE_SHIFT;
+	return 0;
+}
+early_param("cma_prefill", early_cma_prefill);
+
+/* Detach the run, for the caller to release once it dropped the lock */
+static struct page *cma_prefill_detach(struct cma_prefill *prefill,
+				       unsigned long *count)
+{
+	struct page *pages = prefill->pages;
+
+	*count = prefill->count;
+	prefill->pages = NULL;
+	prefill->count = 0;
+	return pages;
+}
+
+static void cma_prefill_work(struct work_struct *work)
+{
+	struct cma_prefill *prefill = container_of(to_delayed_work(work),
+						   struct cma_prefill, work);
+	struct page *pages;
+	unsigned long count;
+
+	mutex_lock(&prefill->lock);
+	if (prefill->count >= cma_prefill_pages) {
+		mutex_unlock(&prefill->lock);
+		return;
+	}
+	pages = cma_prefill_detach(prefill, &count);
+	mutex_unlock(&prefill->lock);
+
+	/* a fresh run likely reuses the leftover and grows from it */
+	if (pages)
+		cma_release(prefill->cma, pages, count);
+	pages = cma_alloc(prefill->cma, cma_prefill_pages, 0, true);
+	if (!pages)
+		return;
+
+	mutex_lock(&prefill->lock);
+	if (!prefill->pages) {
+		prefill->pages = pages;
+		prefill->count = cma_prefill_pages;
+		pages = NULL;
+	}
+	mutex_unlock(&prefill->lock);
+
+	/* refilled by another run of the work meanwhile */
+	if (pages)
+		cma_release(prefill->cma, pages, cma_prefill_pages);
+}
+
+static struct cma_prefill *cma_prefill_get(struct cma *cma)
+{
+	struct cma_prefill *prefill = NULL;
+	unsigned int i;
+
+	if (!cma || !cma_prefill_pages)
+		return NULL;
+
+	mutex_lock(&cma_prefill_mutex);
+	for (i = 0; i < cma_prefill_areas; i++)
+		if (cma_prefills[i].cma == cma)
+			prefill = &cma_prefills[i];
+	if (!prefill && cma_prefill_areas < ARRAY_SIZE(cma_prefills)) {
+		prefill = &cma_prefills[cma_prefill_areas];
+		prefill->cma = cma;
+		mutex_init(&prefill->lock);
+		INIT_DELAYED_WORK(&prefill->work, cma_prefill_work);
+		cma_prefill_areas++;
+	}
+	mutex_unlock(&cma_prefill_mutex);
+
+	return prefill;
+}
+
+/* Take @count pages aligned to @align from the run, if they fit */
+static struct page *cma_prefill_take(struct cma_prefill *prefill,
+				     size_t count, unsigned int align)
+{
+	unsigned long pfn, start, skip;
+
+	if (!prefill->pages)
+		return NULL;
+
+	pfn = page_to_pfn(prefill->pages);
+	start = ALIGN(pfn, 1UL << align);
+	skip = start - pfn;
+	if (skip + count > prefill->count)
+		return NULL;
+
+	/* the unaligned head goes back to the area */
+	if (skip)
+		cma_release(prefill->cma, prefill->pages, skip);
+
+	prefill->count -= skip + count;
+	prefill->pages = prefill->count ? pfn_to_page(start + count) : NULL;
+	return pfn_to_page(start);
+}
+
+static struct page *cma_prefill_alloc(struct cma *cma, size_t count,
+				      unsigned int align, bool no_warn)
+{
+	struct cma_prefill *prefill = cma_prefill_get(cma);
+	struct page *page, *run = NULL;
+	unsigned long run_count;
+	bool fast;
+	u64 start, ns;
+
+	if (!prefill)
+		return cma_alloc(cma, count, align, no_warn);
+
+	start = ktime_get_ns();
+	mutex_lock(&prefill->lock);
+	page = cma_prefill_take(prefill, count, align);
+	fast = page;
+	if (!fast)
+		run = cma_prefill_detach(prefill, &run_count);
+	mutex_unlock(&prefill->lock);
+
+	if (!fast) {
+		/* the leftover run is likely in the way */
+		if (run)
+			cma_release(cma, run, run_count);
+		page = cma_alloc(cma, count, align, no_warn);
+	}
+	ns = ktime_get_ns() - start;
+
+	mutex_lock(&prefill->lock);
+	prefill->allocs++;
+	if (fast)
+		prefill->fast_allocs++;
+	if (!page)
+		prefill->failed_allocs++;
+	prefill->total_ns += ns;
+	prefill->max_ns = max(prefill->max_ns, ns);
+	mutex_unlock(&prefill->lock);
+
+	mod_delayed_work(system_unbound_wq, &prefill->work, CMA_PREFILL_DELAY);
+
+	return page;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int cma_prefill_show(struct seq_file *s, void *unused)
+{
+	unsigned int i;
+
+	seq_puts(s, "area allocs fast failed avg_us max_us prefilled_pages\n");
+	mutex_lock(&cma_prefill_mutex);
+	for (i = 0; i < cma_prefill_areas; i++) {
+		struct cma_prefill *prefill = &cma_prefills[i];
+
+		mutex_lock(&prefill->lock);
+		seq_printf(s, "%s %lu %lu %lu %llu %llu %lu\n",
+			   cma_get_name(prefill->cma), prefill->allocs,
+			   prefill->fast_allocs, prefill->failed_allocs,
+			   prefill->allocs ?
+			   div64_u64(prefill->total_ns, prefill->allocs) /
+			   NSEC_PER_USEC : 0,
+			   div64_u64(prefill->max_ns, NSEC_PER_USEC),
+			   prefill->count);
+		mutex_unlock(&prefill->lock);
+	}
+	mutex_unlock(&cma_prefill_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(cma_prefill);
+
+static int __init cma_prefill_debugfs_init(void)
+{
+	debugfs_create_file("dma_contiguous", 0444, NULL, NULL,
+			    &cma_prefill_fops);
+	return 0;
+}
+late_initcall(cma_prefill_debugfs_init);
+#endif
+
 /**
  * dma_alloc_from_contiguous() - allocate pages from contiguous area
  * @dev:   Pointer to device for which the allocation is performed.
@@ -195,7 +417,7 @@ struct page *dma_alloc_from_contiguous(struct device *dev, size_t count,
 	if (align > CONFIG_CMA_ALIGNMENT)
 		align = CONFIG_CMA_ALIGNMENT;
 
-	return cma_alloc(dev_get_cma_area(dev), count, align, no_warn);
+	return cma_prefill_alloc(dev_get_cma_area(dev), count, align, no_warn);
 }
 
 /**
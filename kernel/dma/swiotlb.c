@@ -84,7 +84,24 @@ static phys_addr_t io_tlb_overflow_buffer;
  * each index
  */
 static unsigned int *io_tlb_list;
-static unsigned int io_tlb_index;
+
+/*
+ * The slabs are split into up to one area per possible CPU, each a run of
+ * whole IO_TLB_SEGSIZE segments.  Free entries are never merged across a
+ * segment boundary, so each area can be searched and updated under a lock
+ * of its own, and a CPU starts looking for slots in its own area.
+ */
+#define IO_TLB_MAX_AREAS	64
+
+struct io_tlb_area {
+	spinlock_t lock;		/* protects the entries of the area */
+	unsigned int start, end;	/* slab range of the area */
+	unsigned int index;		/* where to start the next search */
+};
+
+static struct io_tlb_area io_tlb_areas[IO_TLB_MAX_AREAS];
+static unsigned int io_tlb_nareas;
+static unsigned long io_tlb_area_nslabs;
 
 /*
  * Max segment that we can provide which (if pages are contingous) will
@@ -99,11 +116,6 @@ unsigned int max_segment;
 #define INVALID_PHYS_ADDR (~(phys_addr_t)0)
 static phys_addr_t *io_tlb_orig_addr;
 
-/*
- * Protect the above data structures in the map and unmap calls
- */
-static DEFINE_SPINLOCK(io_tlb_lock);
-
 static int late_alloc;
 
 static int __init
@@ -201,6 +213,33 @@ void __init swiotlb_update_mem_attributes(void)
 	memset(vaddr, 0, bytes);
 }
 
+static void swiotlb_init_areas(unsigned long nslabs)
+{
+	unsigned long nsegs = max(nslabs / IO_TLB_SEGSIZE, 1UL);
+	unsigned int i;
+
+	io_tlb_nareas = min3(nsegs, (unsigned long)num_possible_cpus(),
+			     (unsigned long)IO_TLB_MAX_AREAS);
+	io_tlb_area_nslabs = nsegs / io_tlb_nareas * IO_TLB_SEGSIZE;
+
+	for (i = 0; i < io_tlb_nareas; i++) {
+		struct io_tlb_area *area = &io_tlb_areas[i];
+
+		spin_lock_init(&area->lock);
+		area->start = i * io_tlb_area_nslabs;
+		/* the last area also takes any slabs left over */
+		area->end = i == io_tlb_nareas - 1 ? nslabs :
+			    area->start + io_tlb_area_nslabs;
+		area->index = area->start;
+	}
+}
+
+static struct io_tlb_area *swiotlb_area_of(unsigned int index)
+{
+	return &io_tlb_areas[min_t(unsigned long, index / io_tlb_area_nslabs,
+				   io_tlb_nareas - 1)];
+}
+
 int __init swiotlb_init_with_tbl(char *tlb, unsigned long nslabs, int verbose)
 {
 	void *v_overflow_buffer;
@@ -238,7 +277,7 @@ int __init swiotlb_init_with_tbl(char *tlb, unsigned long nslabs, int verbose)
 		io_tlb_list[i] = IO_TLB_SEGSIZE - OFFSET(i, IO_TLB_SEGSIZE);
 		io_tlb_orig_addr[i] = INVALID_PHYS_ADDR;
 	}
-	io_tlb_index = 0;
+	swiotlb_init_areas(io_tlb_nslabs);
 
 	if (verbose)
 		swiotlb_print_info();
@@ -375,7 +414,7 @@ swiotlb_late_init_with_tbl(char *tlb, unsigned long nslabs)
 		io_tlb_list[i] = IO_TLB_SEGSIZE - OFFSET(i, IO_TLB_SEGSIZE);
 		io_tlb_orig_addr[i] = INVALID_PHYS_ADDR;
 	}
-	io_tlb_index = 0;
+	swiotlb_init_areas(io_tlb_nslabs);
 
 	swiotlb_print_info();
 
@@ -474,16 +513,78 @@ static void swiotlb_bounce(phys_addr_t orig_addr, phys_addr_t tlb_addr,
 	}
 }
 
+/*
+ * Find 'nslots' contiguous free entries in 'area' which don't cross the
+ * segment boundary of the device, take them and return the index of the
+ * first, or -1 if there are none.
+ */
+static int swiotlb_area_find_slots(struct io_tlb_area *area,
+				   unsigned int nslots, unsigned int stride,
+				   unsigned long offset_slots,
+				   unsigned long max_slots)
+{
+	unsigned int index, wrap;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&area->lock, flags);
+	index = ALIGN(area->index, stride);
+	if (index >= area->end)
+		index = area->start;
+	wrap = index;
+
+	do {
+		while (iommu_is_span_boundary(index, nslots, offset_slots,
+					      max_slots)) {
+			index += stride;
+			if (index >= area->end)
+				index = area->start;
+			if (index == wrap)
+				goto not_found;
+		}
+
+		/*
+		 * If we find a slot that indicates we have 'nslots' number of
+		 * contiguous buffers, we allocate the buffers from that slot
+		 * and mark the entries as '0' indicating unavailable.
+		 */
+		if (io_tlb_list[index] >= nslots) {
+			int count = 0;
+
+			for (i = index; i < (int) (index + nslots); i++)
+				io_tlb_list[i] = 0;
+			for (i = index - 1; (OFFSET(i, IO_TLB_SEGSIZE) != IO_TLB_SEGSIZE - 1) && io_tlb_list[i]; i--)
+				io_tlb_list[i] = ++count;
+
+			/*
+			 * Update the indices to avoid searching in the next
+			 * round.
+			 */
+			area->index = ((index + nslots) < area->end
+				       ? (index + nslots) : area->start);
+
+			spin_unlock_irqrestore(&area->lock, flags);
+			return index;
+		}
+		index += stride;
+		if (index >= area->end)
+			index = area->start;
+	} while (index != wrap);
+
+not_found:
+	spin_unlock_irqrestore(&area->lock, flags);
+	return -1;
+}
+
 phys_addr_t swiotlb_tbl_map_single(struct device *hwdev,
 				   dma_addr_t tbl_dma_addr,
 				   phys_addr_t orig_addr, size_t size,
 				   enum dma_data_direction dir,
 				   unsigned long attrs)
 {
-	unsigned long flags;
 	phys_addr_t tlb_addr;
-	unsigned int nslots, stride, index, wrap;
-	int i;
+	unsigned int nslots, stride, area, n;
+	int i, index;
 	unsigned long mask;
 	unsigned long offset_slots;
 	unsigned long max_slots;
@@ -522,59 +623,25 @@ phys_addr_t swiotlb_tbl_map_single(struct device *hwdev,
 
 	/*
 	 * Find suitable number of IO TLB entries size that will fit this
-	 * request and allocate a buffer from that IO TLB pool.
+	 * request and allocate a buffer from that IO TLB pool, starting
+	 * with the area of this CPU.
 	 */
-	spin_lock_irqsave(&io_tlb_lock, flags);
-	index = ALIGN(io_tlb_index, stride);
-	if (index >= io_tlb_nslabs)
-		index = 0;
-	wrap = index;
-
-	do {
-		while (iommu_is_span_boundary(index, nslots, offset_slots,
-					      max_slots)) {
-			index += stride;
-			if (index >= io_tlb_nslabs)
-				index = 0;
-			if (index == wrap)
-				goto not_found;
-		}
-
-		/*
-		 * If we find a slot that indicates we have 'nslots' number of
-		 * contiguous buffers, we allocate the buffers from that slot
-		 * and mark the entries as '0' indicating unavailable.
-		 */
-		if (io_tlb_list[index] >= nslots) {
-			int count = 0;
-
-			for (i = index; i < (int) (index + nslots); i++)
-				io_tlb_list[i] = 0;
-			for (i = index - 1; (OFFSET(i, IO_TLB_SEGSIZE) != IO_TLB_SEGSIZE - 1) && io_tlb_list[i]; i--)
-				io_tlb_list[i] = ++count;
-			tlb_addr = io_tlb_start + (index << IO_TLB_SHIFT);
-
-			/*
-			 * Update the indices to avoid searching in the next
-			 * round.
-			 */
-			io_tlb_index = ((index + nslots) < io_tlb_nslabs
-					? (index + nslots) : 0);
-
+	area = raw_smp_processor_id() % io_tlb_nareas;
+	for (n = 0; n < io_tlb_nareas; n++) {
+		index = swiotlb_area_find_slots(&io_tlb_areas[area], nslots,
+						stride, offset_slots,
+						max_slots);
+		if (index >= 0)
 			goto found;
-		}
-		index += stride;
-		if (index >= io_tlb_nslabs)
-			index = 0;
-	} while (index != wrap);
+		if (++area == io_tlb_nareas)
+			area = 0;
+	}
 
-not_found:
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
 	if (!(attrs & DMA_ATTR_NO_WARN) && printk_ratelimit())
 		dev_warn(hwdev, "swiotlb buffer is full (sz: %zd bytes)\n", size);
 	return SWIOTLB_MAP_ERROR;
 found:
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
+	tlb_addr = io_tlb_start + ((phys_addr_t)index << IO_TLB_SHIFT);
 
 	/*
 	 * Save away the mapping from the original address to the DMA address.
@@ -621,6 +688,7 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	int i, count, nslots = ALIGN(size, 1 << IO_TLB_SHIFT) >> IO_TLB_SHIFT;
 	int index = (tlb_addr - io_tlb_start) >> IO_TLB_SHIFT;
 	phys_addr_t orig_addr = io_tlb_orig_addr[index];
+	struct io_tlb_area *area = swiotlb_area_of(index);
 
 	/*
 	 * First, sync the memory before unmapping the entry
@@ -636,7 +704,7 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	 * While returning the entries to the free list, we merge the entries
 	 * with slots below and above the pool being returned.
 	 */
-	spin_lock_irqsave(&io_tlb_lock, flags);
+	spin_lock_irqsave(&area->lock, flags);
 	{
 		count = ((index + nslots) < ALIGN(index + 1, IO_TLB_SEGSIZE) ?
 			 io_tlb_list[index + nslots] : 0);
@@ -655,7 +723,7 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 		for (i = index - 1; (OFFSET(i, IO_TLB_SEGSIZE) != IO_TLB_SEGSIZE -1) && io_tlb_list[i]; i--)
 			io_tlb_list[i] = ++count;
 	}
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
+	spin_unlock_irqrestore(&area->lock, flags);
 }
 
 void swiotlb_tbl_sync_single(struct device *hwdev, phys_addr_t tlb_addr,
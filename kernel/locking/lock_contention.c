@@ -0,0 +1,312 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Lightweight lock contention profiler
+ *
+ * Each CPU keeps a small open addressed hash table of call sites, a call
+ * site being the first LC_SITE_DEPTH return addresses on the stack of the
+ * waiter outside of the locking and scheduler code.  Entries are only
+ * claimed and updated by their own CPU with interrupts off, so no lock is
+ * needed; a reader summing the tables of all CPUs may see an update half
+ * done, which is fine for statistics.
+ *
+ * <debugfs>/lock_contention/
+ *   enable	- write 1 to start profiling, 0 to stop it
+ *   stats	- one line per call site and lock type: the number of waits,
+ *		  their total and maximum in microseconds, a log2 histogram of
+ *		  them in microseconds and the call site.  Writing to it
+ *		  clears the tables.
+ */
+#include <linux/debugfs.h>
+#include <linux/hardirq.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/lock_contention.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/sched/debug.h>
+#include <linux/seq_file.h>
+#include <linux/stacktrace.h>
+
+#define LC_HASH_BITS	7
+#define LC_MERGED_BITS	(LC_HASH_BITS + 3)
+#define LC_PROBES	8
+#define LC_SITE_DEPTH	4
+#define LC_STACK_DEPTH	16
+#define LC_NR_BUCKETS	16
+
+struct lc_entry {
+	unsigned long	site[LC_SITE_DEPTH];
+	unsigned int	type;
+	unsigned int	hist[LC_NR_BUCKETS];
+	u64		count;
+	u64		total_ns;
+	u64		max_ns;
+};
+
+struct lc_table {
+	unsigned long	dropped;
+	struct lc_entry	entries[1 << LC_HASH_BITS];
+};
+
+static const char * const lc_type_names[LOCK_CONTENTION_NR_TYPES] = {
+	[LOCK_CONTENTION_MUTEX]		= "mutex",
+	[LOCK_CONTENTION_RWSEM_READ]	= "rwsem-r",
+	[LOCK_CONTENTION_RWSEM_WRITE]	= "rwsem-w",
+	[LOCK_CONTENTION_SPINLOCK]	= "spinlock",
+};
+
+DEFINE_STATIC_KEY_FALSE(lock_contention_key);
+
+/* Allocated when first enabled, and kept from then on */
+static struct lc_table __percpu *lc_tables;
+static DEFINE_MUTEX(lc_mutex);
+
+static void lc_get_site(unsigned long ip, unsigned long *site)
+{
+#ifdef CONFIG_STACKTRACE
+	unsigned long entries[LC_STACK_DEPTH];
+	struct stack_trace trace = {
+		.entries	= entries,
+		.max_entries	= LC_STACK_DEPTH,
+	};
+	unsigned int i, n = 0;
+
+	save_stack_trace(&trace);
+
+	/* Frames below @ip are the profiler's and the slow path's own */
+	for (i = 0; i < trace.nr_entries; i++)
+		if (entries[i] == ip)
+			break;
+
+	for (; i < trace.nr_entries && n < LC_SITE_DEPTH; i++) {
+		unsigned long addr = entries[i];
+
+		if (addr == ULONG_MAX)
+			break;
+		if (in_sched_functions(addr))
+			continue;
+		site[n++] = addr;
+	}
+	if (n)
+		return;
+#endif
+	site[0] = ip;
+}
+
+static unsigned int lc_hash(const unsigned long *site, unsigned int type,
+			    unsigned int bits)
+{
+	unsigned long h = type;
+	int i;
+
+	for (i = 0; i < LC_SITE_DEPTH; i++)
+		h = h * 31 + site[i];
+	return hash_long(h, bits);
+}
+
+/* Finds the entry of @site and @type in @entries, claiming a free one */
+static struct lc_entry *lc_find(struct lc_entry *entries, unsigned int bits,
+				const unsigned long *site, unsigned int type)
+{
+	unsigned int mask = (1U << bits) - 1;
+	unsigned int i, idx = lc_hash(site, type, bits);
+
+	for (i = 0; i < LC_PROBES; i++, idx = (idx + 1) & mask) {
+		struct lc_entry *e = &entries[idx];
+
+		if (!e->count) {
+			memcpy(e->site, site, sizeof(e->site));
+			e->type = type;
+			return e;
+		}
+		if (e->type == type && !memcmp(e->site, site, sizeof(e->site)))
+			return e;
+	}
+	return NULL;
+}
+
+void __lock_contention_end(u64 start, unsigned long ip,
+			   enum lock_contention_type type)
+{
+	u64 ns = local_clock() - start;
+	unsigned long site[LC_SITE_DEPTH] = { };
+	struct lc_table *table;
+	struct lc_entry *e;
+	unsigned long flags;
+	unsigned int bucket;
+
+	if (in_nmi())
+		return;
+
+	lc_get_site(ip, site);
+	bucket = min_t(unsigned int, fls64(div_u64(ns, NSEC_PER_USEC)),
+		       LC_NR_BUCKETS - 1);
+
+	/* Checked again with irqs off, for lc_stats_write() to wait on */
+	local_irq_save(flags);
+	if (!static_branch_unlikely(&lock_contention_key))
+		goto out;
+
+	table = this_cpu_ptr(lc_tables);
+	e = lc_find(table->entries, LC_HASH_BITS, site, type);
+	if (e) {
+		e->hist[bucket]++;
+		e->total_ns += ns;
+		if (ns > e->max_ns)
+			e->max_ns = ns;
+		e->count++;
+	} else {
+		table->dropped++;
+	}
+out:
+	local_irq_restore(flags);
+}
+
+static int lc_enable_get(void *data, u64 *val)
+{
+	*val = static_key_enabled(&lock_contention_key);
+	return 0;
+}
+
+static int lc_enable_set(void *data, u64 val)
+{
+	int ret = 0;
+
+	mutex_lock(&lc_mutex);
+	if (val && !lc_tables) {
+		lc_tables = alloc_percpu(struct lc_table);
+		if (!lc_tables)
+			ret = -ENOMEM;
+	}
+	if (!ret) {
+		if (val)
+			static_branch_enable(&lock_contention_key);
+		else
+			static_branch_disable(&lock_contention_key);
+	}
+	mutex_unlock(&lc_mutex);
+
+	return ret;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(lc_enable_fops, lc_enable_get, lc_enable_set,
+			 "%llu\n");
+
+static void lc_show_entry(struct seq_file *m, struct lc_entry *e)
+{
+	int i;
+
+	seq_printf(m, "%-8s %10llu %12llu %10llu", lc_type_names[e->type],
+		   e->count, div_u64(e->total_ns, NSEC_PER_USEC),
+		   div_u64(e->max_ns, NSEC_PER_USEC));
+	for (i = 0; i < LC_NR_BUCKETS; i++)
+		seq_printf(m, " %u", e->hist[i]);
+	for (i = 0; i < LC_SITE_DEPTH && e->site[i]; i++)
+		seq_printf(m, "%s%pS", i ? " <- " : " ", (void *)e->site[i]);
+	seq_putc(m, '\n');
+}
+
+static int lc_stats_show(struct seq_file *m, void *v)
+{
+	struct lc_entry *merged;
+	unsigned long dropped = 0;
+	int cpu, i, j;
+
+	mutex_lock(&lc_mutex);
+	if (!lc_tables)
+		goto out;
+
+	merged = kvcalloc(1 << LC_MERGED_BITS, sizeof(*merged), GFP_KERNEL);
+	if (!merged) {
+		mutex_unlock(&lc_mutex);
+		return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct lc_table *table = per_cpu_ptr(lc_tables, cpu);
+
+		dropped += READ_ONCE(table->dropped);
+		for (i = 0; i < ARRAY_SIZE(table->entries); i++) {
+			struct lc_entry *e = &table->entries[i], *d;
+			u64 count = READ_ONCE(e->count);
+
+			if (!count)
+				continue;
+			d = lc_find(merged, LC_MERGED_BITS, e->site, e->type);
+			if (!d) {
+				dropped += count;
+				continue;
+			}
+			d->count += count;
+			d->total_ns += e->total_ns;
+			d->max_ns = max(d->max_ns, e->max_ns);
+			for (j = 0; j < LC_NR_BUCKETS; j++)
+				d->hist[j] += e->hist[j];
+		}
+	}
+
+	seq_puts(m, "# type count total_us max_us, waits of <1us 1us 2us ... >=16ms, call site\n");
+	for (i = 0; i < 1 << LC_MERGED_BITS; i++)
+		if (merged[i].count)
+			lc_show_entry(m, &merged[i]);
+	seq_printf(m, "# dropped %lu\n", dropped);
+
+	kvfree(merged);
+out:
+	mutex_unlock(&lc_mutex);
+	return 0;
+}
+
+static int lc_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lc_stats_show, NULL);
+}
+
+static ssize_t lc_stats_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	bool enabled;
+	int cpu;
+
+	mutex_lock(&lc_mutex);
+	if (lc_tables) {
+		/* Let the updates of the tables in flight finish first */
+		enabled = static_key_enabled(&lock_contention_key);
+		static_branch_disable(&lock_contention_key);
+		synchronize_sched();
+
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(lc_tables, cpu), 0,
+			       sizeof(struct lc_table));
+
+		if (enabled)
+			static_branch_enable(&lock_contention_key);
+	}
+	mutex_unlock(&lc_mutex);
+
+	return count;
+}
+
+static const struct file_operations lc_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= lc_stats_open,
+	.read		= seq_read,
+	.write		= lc_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init lock_contention_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("lock_contention", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file_unsafe("enable", 0600, dir, NULL, &lc_enable_fops);
+	debugfs_create_file("stats", 0600, dir, NULL, &lc_stats_fops);
+	return 0;
+}
+late_initcall(lock_contention_init);
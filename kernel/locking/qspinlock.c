@@ -29,6 +29,7 @@
 #include <linux/hardirq.h>
 #include <linux/mutex.h>
 #include <linux/prefetch.h>
+#include <linux/lock_contention.h>
 #include <asm/byteorder.h>
 #include <asm/qspinlock.h>
 
@@ -309,6 +310,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 {
 	struct mcs_spinlock *prev, *next, *node;
 	u32 old, tail;
+	u64 start;
 	int idx;
 
 	BUILD_BUG_ON(CONFIG_NR_CPUS >= (1U << _Q_TAIL_CPU_BITS));
@@ -384,6 +386,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 queue:
 	qstat_inc(qstat_lock_slowpath, true);
 pv_queue:
+	start = lock_contention_begin();
 	node = this_cpu_ptr(&mcs_nodes[0]);
 	idx = node->count++;
 	tail = encode_tail(smp_processor_id(), idx);
@@ -515,6 +518,7 @@ void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
 	 * release the node
 	 */
 	__this_cpu_dec(mcs_nodes[0].count);
+	lock_contention_end(start, _RET_IP_, LOCK_CONTENTION_SPINLOCK);
 }
 EXPORT_SYMBOL(queued_spin_lock_slowpath);
 
@@ -17,7 +17,10 @@
 #include <linux/sched/rt.h>
 #include <linux/sched/wake_q.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/clock.h>
+#include <linux/sched/topology.h>
 #include <linux/osq_lock.h>
+#include <linux/lock_contention.h>
 
 #include "rwsem.h"
 
@@ -235,6 +238,7 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
 	struct rwsem_waiter waiter;
 	DEFINE_WAKE_Q(wake_q);
+	u64 start = lock_contention_begin();
 
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_READ;
@@ -277,6 +281,7 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 	}
 
 	__set_current_state(TASK_RUNNING);
+	lock_contention_end(start, _RET_IP_, LOCK_CONTENTION_RWSEM_READ);
 	return sem;
 out_nolock:
 	list_del(&waiter.list);
@@ -363,6 +368,45 @@ static inline bool owner_on_cpu(struct task_struct *owner)
 	return owner->on_cpu && !vcpu_is_preempted(task_cpu(owner));
 }
 
+/*
+ * Spinning on an owner running on a CPU of lower capacity than ours, a
+ * little core on big.LITTLE, lasts longer and burns more energy than
+ * the sleep and wakeup it saves.  Such spins are bounded by a budget,
+ * scaled down by the capacity of the owner's CPU relative to ours, and
+ * learnt on each CPU from how such spins end: it grows when the owner
+ * released the lock within it, and halves when the owner didn't.
+ */
+#define RWSEM_SLOW_SPIN_MIN_NS	(2 * NSEC_PER_USEC)
+#define RWSEM_SLOW_SPIN_MAX_NS	(100 * NSEC_PER_USEC)
+
+static DEFINE_PER_CPU(unsigned int, rwsem_slow_spin_ns) =
+	RWSEM_SLOW_SPIN_MAX_NS / 4;
+
+/* Time to spin on @owner for, or 0 for as long as it is running */
+static inline u64 rwsem_spin_budget(struct task_struct *owner)
+{
+	unsigned long cap = arch_scale_cpu_capacity(NULL, smp_processor_id());
+	unsigned long owner_cap = arch_scale_cpu_capacity(NULL,
+							  task_cpu(owner));
+
+	if (owner_cap >= cap)
+		return 0;
+
+	return div_u64((u64)this_cpu_read(rwsem_slow_spin_ns) * owner_cap,
+		       cap);
+}
+
+static inline void rwsem_slow_spin_update(bool released)
+{
+	unsigned int ns = this_cpu_read(rwsem_slow_spin_ns);
+
+	if (released)
+		ns = min_t(unsigned int, ns + ns / 4, RWSEM_SLOW_SPIN_MAX_NS);
+	else
+		ns = max_t(unsigned int, ns / 2, RWSEM_SLOW_SPIN_MIN_NS);
+	this_cpu_write(rwsem_slow_spin_ns, ns);
+}
+
 static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 {
 	struct task_struct *owner;
@@ -389,11 +433,19 @@ static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
 {
 	struct task_struct *owner = READ_ONCE(sem->owner);
+	u64 deadline = 0;
 
 	if (!is_rwsem_owner_spinnable(owner))
 		return false;
 
 	rcu_read_lock();
+	if (owner) {
+		u64 budget = rwsem_spin_budget(owner);
+
+		if (budget)
+			deadline = local_clock() + budget;
+	}
+
 	while (owner && (READ_ONCE(sem->owner) == owner)) {
 		/*
 		 * Ensure we emit the owner->on_cpu, dereference _after_
@@ -412,10 +464,20 @@ static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
 			return false;
 		}
 
+		/* and when the owner on a slower cpu holds it for too long */
+		if (deadline && local_clock() > deadline) {
+			rcu_read_unlock();
+			rwsem_slow_spin_update(false);
+			return false;
+		}
+
 		cpu_relax();
 	}
 	rcu_read_unlock();
 
+	if (deadline)
+		rwsem_slow_spin_update(true);
+
 	/*
 	 * If there is a new owner or the owner is not set, we continue
 	 * spinning.
@@ -506,13 +568,17 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	struct rwsem_waiter waiter;
 	struct rw_semaphore *ret = sem;
 	DEFINE_WAKE_Q(wake_q);
+	u64 start = lock_contention_begin();
 
 	/* undo write bias from down_write operation, stop active locking */
 	count = atomic_long_sub_return(RWSEM_ACTIVE_WRITE_BIAS, &sem->count);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem)) {
+		lock_contention_end(start, _RET_IP_,
+				    LOCK_CONTENTION_RWSEM_WRITE);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -579,6 +645,7 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	__set_current_state(TASK_RUNNING);
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	lock_contention_end(start, _RET_IP_, LOCK_CONTENTION_RWSEM_WRITE);
 
 	return ret;
 
@@ -61,6 +61,8 @@ static void em_debug_create_pd(struct em_perf_domain *pd, int cpu)
 	d = debugfs_create_dir(name, rootdir);
 
 	debugfs_create_file("cpus", 0444, d, pd->cpus, &em_debug_cpus_fops);
+	debugfs_create_ulong("idle_power", 0444, d, &pd->idle_power);
+	debugfs_create_ulong("wakeup_energy", 0444, d, &pd->wakeup_energy);
 
 	/* Create a sub-directory for each capacity state */
 	for (i = 0; i < pd->nr_cap_states; i++)
@@ -256,3 +258,33 @@ int em_register_perf_domain(cpumask_t *span, unsigned int nr_states,
 	return ret;
 }
 EXPORT_SYMBOL_GPL(em_register_perf_domain);
+
+/**
+ * em_pd_set_idle_cost() - Add the idle costs of a domain to the Energy Model
+ * @pd			: performance domain to update
+ * @idle_power		: power of the awake domain on top of its CPUs, in mW
+ * @wakeup_energy	: energy of a wake-up of the domain, in uJ
+ *
+ * Optional for the drivers registering performance domains. These costs let
+ * EAS avoid waking up a sleeping domain when another one is already running.
+ *
+ * Return 0 on success
+ */
+int em_pd_set_idle_cost(struct em_perf_domain *pd, unsigned long idle_power,
+			unsigned long wakeup_energy)
+{
+	if (!pd || idle_power > EM_CPU_MAX_POWER)
+		return -EINVAL;
+
+	mutex_lock(&em_pd_mutex);
+	WRITE_ONCE(pd->idle_power, idle_power);
+	WRITE_ONCE(pd->wakeup_energy, wakeup_energy);
+	mutex_unlock(&em_pd_mutex);
+
+	pr_debug("pd%d: idle power %lu mW, wake-up energy %lu uJ\n",
+		 cpumask_first(to_cpumask(pd->cpus)), idle_power,
+		 wakeup_energy);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(em_pd_set_idle_cost);
@@ -41,6 +41,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
 #include <linux/sched/clock.h>
@@ -1889,6 +1890,25 @@ int vprintk_store(int facility, int level,
 			  dict, dictlen, text, text_len);
 }
 
+/*
+ * Once printk_kthread runs, it prints the messages to the consoles instead
+ * of the tasks calling printk(), which could otherwise be held up for as
+ * long as a slow console takes to print the messages of all CPUs.  It is
+ * left to the callers again for oopses and from halt or reboot on, when
+ * the thread may never get to run.
+ */
+static bool printk_offload = true;
+module_param_named(offload, printk_offload, bool, S_IRUGO | S_IWUSR);
+
+static struct task_struct *printk_kthread;
+static bool printk_kthread_pending;
+
+static bool printk_offload_console(void)
+{
+	return printk_offload && READ_ONCE(printk_kthread) &&
+	       !oops_in_progress && system_state == SYSTEM_RUNNING;
+}
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1911,7 +1931,10 @@ asmlinkage int vprintk_emit(int facility, int level,
 	logbuf_unlock_irqrestore(flags);
 
 	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	if (!in_sched && printk_offload_console()) {
+		/* Woken up from irq_work, as we may hold rq->lock here */
+		defer_console_output();
+	} else if (!in_sched) {
 		/*
 		 * Disable preemption to avoid being preempted while holding
 		 * console_sem which would prevent anyone from printing to
@@ -2877,9 +2900,13 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
-		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		if (printk_offload_console()) {
+			WRITE_ONCE(printk_kthread_pending, true);
+			wake_up_process(printk_kthread);
+		} else if (console_trylock()) {
+			/* Otherwise someone else is doing the printing */
 			console_unlock();
+		}
 	}
 
 	if (pending & PRINTK_PENDING_WAKEUP)
@@ -2891,6 +2918,38 @@ static DEFINE_PER_CPU(struct irq_work, wake_up_klogd_work) = {
 	.flags = IRQ_WORK_LAZY,
 };
 
+static int printk_kthread_func(void *data)
+{
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!xchg(&printk_kthread_pending, false)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		/* console_lock() lets console_unlock() reschedule as it goes */
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(task)) {
+		pr_warn("failed to start printk thread, printing from callers\n");
+		return PTR_ERR(task);
+	}
+	WRITE_ONCE(printk_kthread, task);
+	return 0;
+}
+late_initcall(printk_kthread_init);
+
 void wake_up_klogd(void)
 {
 	preempt_disable();
@@ -36,6 +36,20 @@ void rcu_cblist_init(struct rcu_cblist *rclp)
 	rclp->len_lazy = 0;
 }
 
+/*
+ * Enqueue an rcu_head structure onto the specified callback list,
+ * counting it as lazy if so specified.
+ */
+void rcu_cblist_enqueue(struct rcu_cblist *rclp, struct rcu_head *rhp,
+			bool lazy)
+{
+	*rclp->tail = rhp;
+	rclp->tail = &rhp->next;
+	WRITE_ONCE(rclp->len, rclp->len + 1);
+	if (lazy)
+		rclp->len_lazy++;
+}
+
 /*
  * Dequeue the oldest rcu_head structure from the specified callback
  * list.  This function assumes that the callback is non-lazy, but
@@ -293,6 +307,19 @@ void rcu_segcblist_insert_pend_cbs(struct rcu_segcblist *rsclp,
 	rclp->tail = &rclp->head;
 }
 
+/*
+ * Move all callbacks from the specified rcu_cblist, along with their
+ * counts, to the end of the specified rcu_segcblist, where they wait for
+ * a grace period just like newly enqueued callbacks.
+ */
+void rcu_segcblist_enqueue_cblist(struct rcu_segcblist *rsclp,
+				  struct rcu_cblist *rclp)
+{
+	rcu_segcblist_insert_count(rsclp, rclp);
+	smp_mb(); /* Ensure counts are updated before callbacks are enqueued. */
+	rcu_segcblist_insert_pend_cbs(rsclp, rclp);
+}
+
 /*
  * Advance the callbacks in the specified rcu_segcblist structure based
  * on the current value passed in for the grace-period counter.
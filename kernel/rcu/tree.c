@@ -501,6 +501,20 @@ module_param(blimit, long, 0444);
 module_param(qhimark, long, 0444);
 module_param(qlowmark, long, 0444);
 
+/*
+ * Lazy callbacks wait on a per-CPU list, without asking for a grace
+ * period, until this many are queued there, non-lazy callbacks need one
+ * anyway, this many jiffies go by, or memory runs low.  A lazy_qhimark of
+ * zero makes lazy callbacks wait for a grace period right away.
+ */
+#define DEFAULT_RCU_LAZY_QHIMARK 1000
+static long lazy_qhimark = DEFAULT_RCU_LAZY_QHIMARK;
+static ulong jiffies_till_lazy_flush = 10 * HZ;
+static atomic_long_t rcu_lazy_count;	/* Lazy CBs waiting on all CPUs. */
+
+module_param(lazy_qhimark, long, 0644);
+module_param(jiffies_till_lazy_flush, ulong, 0644);
+
 static ulong jiffies_till_first_fqs = ULONG_MAX;
 static ulong jiffies_till_next_fqs = ULONG_MAX;
 static bool rcu_kick_kthreads;
@@ -2950,16 +2964,124 @@ static void rcu_leak_callback(struct rcu_head *rhp)
 {
 }
 
+/*
+ * Move the lazy callbacks of the specified CPU to its callback list, to
+ * wait for a grace period.  Interrupts must be disabled, and the CPU must
+ * be the current one or offline.
+ */
+static void rcu_lazy_flush(struct rcu_data *rdp)
+{
+	long n = rdp->lazy_cbs.len;
+
+	lockdep_assert_irqs_disabled();
+	if (!n)
+		return;
+	rcu_segcblist_enqueue_cblist(&rdp->cblist, &rdp->lazy_cbs);
+	atomic_long_sub(n, &rcu_lazy_count);
+	del_timer(&rdp->lazy_timer);
+}
+
+/*
+ * Queue a lazy callback on the current CPU, and flush the lazy callbacks
+ * should there be too many.  Returns true if they were flushed.
+ */
+static bool rcu_lazy_enqueue(struct rcu_data *rdp, struct rcu_head *head,
+			     bool kfree_cb)
+{
+	rcu_cblist_enqueue(&rdp->lazy_cbs, head, kfree_cb);
+	atomic_long_inc(&rcu_lazy_count);
+	if (rdp->lazy_cbs.len >= READ_ONCE(lazy_qhimark)) {
+		rcu_lazy_flush(rdp);
+		return true;
+	}
+	if (rdp->lazy_cbs.len == 1)
+		mod_timer(&rdp->lazy_timer,
+			  jiffies + READ_ONCE(jiffies_till_lazy_flush));
+	return false;
+}
+
+/* The lazy callbacks of a CPU waited long enough, flush them. */
+static void rcu_lazy_timer(struct timer_list *t)
+{
+	struct rcu_data *rdp = from_timer(rdp, t, lazy_timer);
+	unsigned long flags;
+
+	local_irq_save(flags);
+	/* If the CPU went offline, its callbacks went along already. */
+	if (rdp->cpu == smp_processor_id()) {
+		rcu_lazy_flush(rdp);
+		invoke_rcu_core();
+	}
+	local_irq_restore(flags);
+}
+
+/* Flush the lazy callbacks of the current CPU, for all flavors. */
+static void rcu_lazy_flush_cpu(void *unused)
+{
+	struct rcu_state *rsp;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	for_each_rcu_flavor(rsp)
+		rcu_lazy_flush(this_cpu_ptr(rsp->rda));
+	invoke_rcu_core();
+	local_irq_restore(flags);
+}
+
+static bool rcu_lazy_cpu_has_cbs(int cpu, void *unused)
+{
+	struct rcu_state *rsp;
+
+	for_each_rcu_flavor(rsp)
+		if (READ_ONCE(per_cpu_ptr(rsp->rda, cpu)->lazy_cbs.len))
+			return true;
+	return false;
+}
+
+static unsigned long
+rcu_lazy_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	long count = atomic_long_read(&rcu_lazy_count);
+
+	return count > 0 ? count : SHRINK_EMPTY;
+}
+
+/*
+ * Memory runs low, so have all lazy callbacks wait for a grace period,
+ * after which they free what they hold.
+ */
+static unsigned long
+rcu_lazy_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	long count = atomic_long_read(&rcu_lazy_count);
+
+	if (count <= 0)
+		return SHRINK_STOP;
+	on_each_cpu_cond(rcu_lazy_cpu_has_cbs, rcu_lazy_flush_cpu, NULL,
+			 false, GFP_NOWAIT);
+	return count;
+}
+
+static struct shrinker rcu_lazy_shrinker = {
+	.count_objects = rcu_lazy_shrink_count,
+	.scan_objects = rcu_lazy_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 /*
  * Helper function for call_rcu() and friends.  The cpu argument will
  * normally be -1, indicating "currently running CPU".  It may specify
  * a CPU only if that CPU is a no-CBs CPU.  Currently, only _rcu_barrier()
- * is expected to specify a CPU.
+ * is expected to specify a CPU.  The lazy argument lets the callback wait
+ * for a grace period to be needed anyway, see call_rcu_lazy(); only those
+ * from kfree_rcu() are counted as lazy in the callback lists, though.
  */
 static void
 __call_rcu(struct rcu_head *head, rcu_callback_t func,
 	   struct rcu_state *rsp, int cpu, bool lazy)
 {
+	bool kfree_cb = __is_kfree_rcu_offset((unsigned long)func);
+	bool deferred = false;
 	unsigned long flags;
 	struct rcu_data *rdp;
 
@@ -2990,7 +3112,7 @@ __call_rcu(struct rcu_head *head, rcu_callback_t func,
 			rdp = per_cpu_ptr(rsp->rda, cpu);
 		if (likely(rdp->mynode)) {
 			/* Post-boot, so this should be for a no-CBs CPU. */
-			offline = !__call_rcu_nocb(rdp, head, lazy, flags);
+			offline = !__call_rcu_nocb(rdp, head, kfree_cb, flags);
 			WARN_ON_ONCE(offline);
 			/* Offline CPU, _call_rcu() illegal, leak callback.  */
 			local_irq_restore(flags);
@@ -3005,11 +3127,19 @@ __call_rcu(struct rcu_head *head, rcu_callback_t func,
 		if (rcu_segcblist_empty(&rdp->cblist))
 			rcu_segcblist_init(&rdp->cblist);
 	}
-	rcu_segcblist_enqueue(&rdp->cblist, head, lazy);
-	if (!lazy)
+	if (lazy && READ_ONCE(lazy_qhimark) > 0 &&
+	    READ_ONCE(rcu_scheduler_fully_active)) {
+		/* Lazy callback, so no grace period needed yet. */
+		deferred = !rcu_lazy_enqueue(rdp, head, kfree_cb);
+	} else {
+		/* A grace period is needed, so lazy callbacks can come too. */
+		rcu_lazy_flush(rdp);
+		rcu_segcblist_enqueue(&rdp->cblist, head, kfree_cb);
+	}
+	if (!kfree_cb)
 		rcu_idle_count_callbacks_posted();
 
-	if (__is_kfree_rcu_offset((unsigned long)func))
+	if (kfree_cb)
 		trace_rcu_kfree_callback(rsp->name, head, (unsigned long)func,
 					 rcu_segcblist_n_lazy_cbs(&rdp->cblist),
 					 rcu_segcblist_n_cbs(&rdp->cblist));
@@ -3019,7 +3149,8 @@ __call_rcu(struct rcu_head *head, rcu_callback_t func,
 				   rcu_segcblist_n_cbs(&rdp->cblist));
 
 	/* Go handle any RCU core processing required. */
-	__call_rcu_core(rsp, rdp, head, flags);
+	if (!deferred)
+		__call_rcu_core(rsp, rdp, head, flags);
 	local_irq_restore(flags);
 }
 
@@ -3079,10 +3210,8 @@ EXPORT_SYMBOL_GPL(call_rcu_bh);
 
 /*
  * Queue an RCU callback for lazy invocation after a grace period.
- * This will likely be later named something like "call_rcu_lazy()",
- * but this change will require some way of tagging the lazy RCU
- * callbacks in the list of pending callbacks. Until then, this
- * function may only be called from __kfree_rcu().
+ * This function may only be called from __kfree_rcu(), other lazy
+ * callbacks use call_rcu_lazy().
  */
 void kfree_call_rcu(struct rcu_head *head,
 		    rcu_callback_t func)
@@ -3091,6 +3220,24 @@ void kfree_call_rcu(struct rcu_head *head,
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
+/**
+ * call_rcu_lazy() - Queue an RCU callback for lazy invocation.
+ * @head: structure to be used for queueing the RCU updates.
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * Like call_rcu(), but for callbacks that merely free memory, and so
+ * have no need to be invoked promptly.  Rather than asking for a grace
+ * period right away, which would keep an idle system from staying idle,
+ * the callback waits until enough lazy callbacks are queued on this CPU,
+ * a non-lazy callback asks for a grace period anyway, some seconds go by,
+ * or memory runs low.  rcu_barrier() still waits for lazy callbacks.
+ */
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	__call_rcu(head, func, rcu_state_p, -1, 1);
+}
+EXPORT_SYMBOL_GPL(call_rcu_lazy);
+
 /*
  * Because a context switch is a grace period for RCU-sched and RCU-bh,
  * any blocking grace-period wait automatically implies a grace period
@@ -3395,6 +3542,7 @@ static void rcu_barrier_func(void *type)
 	struct rcu_data *rdp = raw_cpu_ptr(rsp->rda);
 
 	_rcu_barrier_trace(rsp, TPS("IRQ"), -1, rsp->barrier_sequence);
+	rcu_lazy_flush(rdp);
 	rdp->barrier_head.func = rcu_barrier_callback;
 	debug_rcu_head_queue(&rdp->barrier_head);
 	if (rcu_segcblist_entrain(&rdp->cblist, &rdp->barrier_head, 0)) {
@@ -3465,7 +3613,8 @@ static void _rcu_barrier(struct rcu_state *rsp)
 				__call_rcu(&rdp->barrier_head,
 					   rcu_barrier_callback, rsp, cpu, 0);
 			}
-		} else if (rcu_segcblist_n_cbs(&rdp->cblist)) {
+		} else if (rcu_segcblist_n_cbs(&rdp->cblist) ||
+			   READ_ONCE(rdp->lazy_cbs.len)) {
 			_rcu_barrier_trace(rsp, TPS("OnlineQ"), cpu,
 					   rsp->barrier_sequence);
 			smp_call_function_single(cpu, rcu_barrier_func, rsp, 1);
@@ -3559,6 +3708,8 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	rdp->rcu_onl_gp_flags = RCU_GP_CLEANED;
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_cblist_init(&rdp->lazy_cbs);
+	timer_setup(&rdp->lazy_timer, rcu_lazy_timer, TIMER_PINNED);
 	rcu_boot_init_nocb_percpu_data(rdp);
 }
 
@@ -3825,10 +3976,17 @@ static void rcu_migrate_callbacks(int cpu, struct rcu_state *rsp)
 	struct rcu_node *rnp_root = rcu_get_root(rdp->rsp);
 	bool needwake;
 
-	if (rcu_is_nocb_cpu(cpu) || rcu_segcblist_empty(&rdp->cblist))
+	if (rcu_is_nocb_cpu(cpu))
 		return;  /* No callbacks to migrate. */
 
 	local_irq_save(flags);
+	/* Lazy callbacks go along with the others. */
+	rcu_lazy_flush(rdp);
+	if (rcu_segcblist_empty(&rdp->cblist)) {
+		local_irq_restore(flags);
+		return;  /* No callbacks to migrate. */
+	}
+
 	my_rdp = this_cpu_ptr(rsp->rda);
 	if (rcu_nocb_adopt_orphan_cbs(my_rdp, rdp, flags)) {
 		local_irq_restore(flags);
@@ -3932,6 +4090,7 @@ static int __init rcu_spawn_gp_kthread(void)
 	}
 	rcu_spawn_nocb_kthreads();
 	rcu_spawn_boost_kthreads();
+	WARN_ON(register_shrinker(&rcu_lazy_shrinker));
 	return 0;
 }
 early_initcall(rcu_spawn_gp_kthread);
@@ -211,6 +211,8 @@ struct rcu_data {
 	unsigned long	n_force_qs_snap;
 					/* did other CPU force QS recently? */
 	long		blimit;		/* Upper limit on a processed batch */
+	struct rcu_cblist lazy_cbs;	/* Lazy CBs not yet waiting for a GP. */
+	struct timer_list lazy_timer;	/* Bound lazy CBs' wait for a GP. */
 
 	/* 3) dynticks interface. */
 	struct rcu_dynticks *dynticks;	/* Shared per-CPU dynticks state. */
@@ -241,6 +243,7 @@ struct rcu_data {
 	struct task_struct *nocb_kthread;
 	raw_spinlock_t nocb_lock;	/* Guard following pair of fields. */
 	int nocb_defer_wakeup;		/* Defer wakeup of nocb_kthread. */
+	long nocb_defer_qlen;		/* ->nocb_q_count when deferred. */
 	struct timer_list nocb_timer;	/* Enforce finite deferral. */
 
 	/* The following fields are used by the leader, hence own cacheline. */
@@ -1861,6 +1861,7 @@ static void increment_cpu_stall_ticks(void)
  * queued are more aggressive about entering dyntick-idle mode.
  */
 
+static void do_nocb_deferred_wakeup_common(struct rcu_data *rdp);
 
 /* Parse the boot-time rcu_nocb_mask CPU list from the kernel parameters. */
 static int __init rcu_nocb_setup(char *str)
@@ -1878,6 +1879,16 @@ static int __init parse_rcu_nocb_poll(char *arg)
 }
 early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
 
+/*
+ * Outstanding callbacks beyond which a no-CBs CPU is considered busy:
+ * queueing onto its empty list then defers waking the leader for up to
+ * a jiffy, or until this many more callbacks show up, so that a busy CPU
+ * wakes its leader once per batch rather than once per grace period.
+ * Zero to always wake the leader right away.
+ */
+static int rcu_nocb_batch = 32;
+module_param(rcu_nocb_batch, int, 0644);
+
 /*
  * Wake up any no-CBs CPUs' kthreads that were waiting on the just-ended
  * grace period.
@@ -2043,14 +2054,19 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 	}
 	len = atomic_long_read(&rdp->nocb_q_count);
 	if (old_rhpp == &rdp->nocb_head) {
-		if (!irqs_disabled_flags(flags)) {
+		rdp->nocb_defer_qlen = len;
+		if (irqs_disabled_flags(flags)) {
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE,
+					       TPS("WakeEmptyIsDeferred"));
+		} else if (rcu_nocb_batch > 0 && len > rcu_nocb_batch) {
+			/* ... if queue was empty on a busy CPU, batch ... */
+			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE,
+					       TPS("WakeEmptyIsBatched"));
+		} else {
 			/* ... if queue was empty ... */
 			wake_nocb_leader(rdp, false);
 			trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
 					    TPS("WakeEmpty"));
-		} else {
-			wake_nocb_leader_defer(rdp, RCU_NOCB_WAKE,
-					       TPS("WakeEmptyIsDeferred"));
 		}
 		rdp->qlen_last_fqs_check = 0;
 	} else if (len > rdp->qlen_last_fqs_check + qhimark) {
@@ -2064,6 +2080,13 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 					       TPS("WakeOvfIsDeferred"));
 		}
 		rdp->qlen_last_fqs_check = LONG_MAX / 2;
+	} else if (rcu_nocb_batch > 0 && !irqs_disabled_flags(flags) &&
+		   READ_ONCE(rdp->nocb_defer_wakeup) == RCU_NOCB_WAKE &&
+		   len >= rdp->nocb_defer_qlen + rcu_nocb_batch) {
+		/* ... or if a full batch gathered. */
+		do_nocb_deferred_wakeup_common(rdp);
+		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu,
+				    TPS("WakeBatch"));
 	} else {
 		trace_rcu_nocb_wake(rdp->rsp->name, rdp->cpu, TPS("WakeNot"));
 	}
@@ -2514,6 +2537,11 @@ static void rcu_spawn_all_nocb_kthreads(int cpu)
 static void __init rcu_spawn_nocb_kthreads(void)
 {
 	int cpu;
+	struct rcu_state *rsp;
+
+	/* The CPU topology is known by now, so group by cluster. */
+	for_each_rcu_flavor(rsp)
+		rcu_organize_nocb_kthreads(rsp);
 
 	for_each_online_cpu(cpu)
 		rcu_spawn_all_nocb_kthreads(cpu);
@@ -2524,16 +2552,22 @@ static int rcu_nocb_leader_stride = -1;
 module_param(rcu_nocb_leader_stride, int, 0444);
 
 /*
- * Initialize leader-follower relationships for all no-CBs CPU.
+ * Initialize leader-follower relationships for all no-CBs CPU.  Groups
+ * are made of the CPUs of a leader stride, but never span two clusters,
+ * so that the leader of a group of big CPUs doesn't have to wake little
+ * ones and vice versa.  This is called once at boot, before the CPU
+ * topology is known, and again before the kthreads are spawned.
  */
 static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 {
 	int cpu;
+	int other;
 	int ls = rcu_nocb_leader_stride;
-	int nl = 0;  /* Next leader. */
+	int nl;  /* Next leader. */
+	unsigned long flags;
 	struct rcu_data *rdp;
-	struct rcu_data *rdp_leader = NULL;  /* Suppress misguided gcc warn. */
-	struct rcu_data *rdp_prev = NULL;
+	struct rcu_data *rdp_other;
+	struct rcu_data *rdp_prev;
 
 	if (!cpumask_available(rcu_nocb_mask))
 		return;
@@ -2542,25 +2576,44 @@ static void __init rcu_organize_nocb_kthreads(struct rcu_state *rsp)
 		rcu_nocb_leader_stride = ls;
 	}
 
+	/* Only the boot CPU is up, keep its callbacks away meanwhile. */
+	local_irq_save(flags);
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		rdp->nocb_leader = NULL;
+		rdp->nocb_next_follower = NULL;
+	}
+
 	/*
-	 * Each pass through this loop sets up one rcu_data structure.
-	 * Should the corresponding CPU come online in the future, then
-	 * we will spawn the needed set of rcu_nocb_kthread() kthreads.
+	 * Each pass through this loop sets up one group, led by the first
+	 * CPU not yet grouped.  Should the corresponding CPUs come online
+	 * in the future, then we will spawn the needed set of
+	 * rcu_nocb_kthread() kthreads.
 	 */
 	for_each_cpu(cpu, rcu_nocb_mask) {
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (rdp->cpu >= nl) {
-			/* New leader, set up for followers & next leader. */
-			nl = DIV_ROUND_UP(rdp->cpu + 1, ls) * ls;
-			rdp->nocb_leader = rdp;
-			rdp_leader = rdp;
-		} else {
-			/* Another follower, link to previous leader. */
-			rdp->nocb_leader = rdp_leader;
-			rdp_prev->nocb_next_follower = rdp;
-		}
+		if (rdp->nocb_leader)
+			continue;  /* Follower of an earlier leader. */
+
+		/* New leader, set up for followers & next leader. */
+		nl = DIV_ROUND_UP(cpu + 1, ls) * ls;
+		rdp->nocb_leader = rdp;
 		rdp_prev = rdp;
+		for (other = cpumask_next(cpu, rcu_nocb_mask);
+		     other < nl && other < nr_cpu_ids;
+		     other = cpumask_next(other, rcu_nocb_mask)) {
+			if (topology_physical_package_id(other) !=
+			    topology_physical_package_id(cpu))
+				continue;
+
+			/* Another follower, link to this leader. */
+			rdp_other = per_cpu_ptr(rsp->rda, other);
+			rdp_other->nocb_leader = rdp;
+			rdp_prev->nocb_next_follower = rdp_other;
+			rdp_prev = rdp_other;
+		}
 	}
+	local_irq_restore(flags);
 }
 
 /* Prevent __call_rcu() from enqueuing callbacks on no-CBs CPUs */
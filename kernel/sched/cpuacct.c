@@ -24,12 +24,29 @@ struct cpuacct_usage {
 	u64	usages[CPUACCT_STAT_NSTATS];
 };
 
+/* usage and user/system stat of a group, see cpuacct_flush() */
+struct cpuacct_snap {
+	struct cpuacct_usage	usage;
+	struct cpuacct_usage	stat;
+};
+
 /* track CPU usage of a group of tasks and its child groups */
 struct cpuacct {
 	struct cgroup_subsys_state	css;
 	/* cpuusage holds pointer to a u64-type object on every CPU */
 	struct cpuacct_usage __percpu	*cpuusage;
 	struct kernel_cpustat __percpu	*cpustat;
+
+	/*
+	 * Reading the group sums over the CPUs in @updated only, those
+	 * charged since the last read, into @total.  @snap keeps what each
+	 * CPU had when it was last summed.  Not used for the root group,
+	 * whose stats are charged from outside of this file.
+	 */
+	cpumask_var_t			updated;
+	struct cpuacct_snap __percpu	*snap;
+	struct cpuacct_snap		total;
+	struct mutex			flush_mutex;
 };
 
 static inline struct cpuacct *css_ca(struct cgroup_subsys_state *css)
@@ -75,8 +92,21 @@ cpuacct_css_alloc(struct cgroup_subsys_state *parent_css)
 	if (!ca->cpustat)
 		goto out_free_cpuusage;
 
+	ca->snap = alloc_percpu(struct cpuacct_snap);
+	if (!ca->snap)
+		goto out_free_cpustat;
+
+	if (!zalloc_cpumask_var(&ca->updated, GFP_KERNEL))
+		goto out_free_snap;
+
+	mutex_init(&ca->flush_mutex);
+
 	return &ca->css;
 
+out_free_snap:
+	free_percpu(ca->snap);
+out_free_cpustat:
+	free_percpu(ca->cpustat);
 out_free_cpuusage:
 	free_percpu(ca->cpuusage);
 out_free_ca:
@@ -90,6 +120,8 @@ static void cpuacct_css_free(struct cgroup_subsys_state *css)
 {
 	struct cpuacct *ca = css_ca(css);
 
+	free_cpumask_var(ca->updated);
+	free_percpu(ca->snap);
 	free_percpu(ca->cpustat);
 	free_percpu(ca->cpuusage);
 	kfree(ca);
@@ -151,6 +183,61 @@ static void cpuacct_cpuusage_write(struct cpuacct *ca, int cpu, u64 val)
 #endif
 }
 
+static void cpuacct_cpustat_read(struct cpuacct *ca, int cpu, u64 *val)
+{
+	u64 *cpustat = per_cpu_ptr(ca->cpustat, cpu)->cpustat;
+
+	val[CPUACCT_STAT_USER]   = cpustat[CPUTIME_USER] +
+				   cpustat[CPUTIME_NICE];
+	val[CPUACCT_STAT_SYSTEM] = cpustat[CPUTIME_SYSTEM] +
+				   cpustat[CPUTIME_IRQ] +
+				   cpustat[CPUTIME_SOFTIRQ];
+}
+
+/*
+ * Mark @cpu as charged for @ca.  Paired with the barrier in
+ * cpuacct_flush(): either it sees the charge, or we see the bit cleared
+ * and set it again.
+ */
+static inline void cpuacct_updated(struct cpuacct *ca, int cpu)
+{
+	if (ca == &root_cpuacct)
+		return;
+
+	smp_mb();
+	if (!cpumask_test_cpu(cpu, ca->updated))
+		cpumask_set_cpu(cpu, ca->updated);
+}
+
+/* Add to the totals of @ca what the CPUs charged for it since last time */
+static void cpuacct_flush(struct cpuacct *ca)
+{
+	int cpu, i;
+
+	lockdep_assert_held(&ca->flush_mutex);
+
+	for_each_cpu(cpu, ca->updated) {
+		struct cpuacct_snap *snap = per_cpu_ptr(ca->snap, cpu);
+		u64 stat[CPUACCT_STAT_NSTATS];
+
+		cpumask_clear_cpu(cpu, ca->updated);
+		smp_mb__after_atomic();
+
+		cpuacct_cpustat_read(ca, cpu, stat);
+		for (i = 0; i < CPUACCT_STAT_NSTATS; i++) {
+			u64 usage = cpuacct_cpuusage_read(ca, cpu, i);
+
+			ca->total.usage.usages[i] += usage -
+						     snap->usage.usages[i];
+			snap->usage.usages[i] = usage;
+
+			ca->total.stat.usages[i] += stat[i] -
+						    snap->stat.usages[i];
+			snap->stat.usages[i] = stat[i];
+		}
+	}
+}
+
 /* Return total CPU usage (in nanoseconds) of a group */
 static u64 __cpuusage_read(struct cgroup_subsys_state *css,
 			   enum cpuacct_stat_index index)
@@ -159,8 +246,18 @@ static u64 __cpuusage_read(struct cgroup_subsys_state *css,
 	u64 totalcpuusage = 0;
 	int i;
 
-	for_each_possible_cpu(i)
-		totalcpuusage += cpuacct_cpuusage_read(ca, i, index);
+	if (ca == &root_cpuacct) {
+		for_each_possible_cpu(i)
+			totalcpuusage += cpuacct_cpuusage_read(ca, i, index);
+		return totalcpuusage;
+	}
+
+	mutex_lock(&ca->flush_mutex);
+	cpuacct_flush(ca);
+	for (i = 0; i < CPUACCT_STAT_NSTATS; i++)
+		if (index == CPUACCT_STAT_NSTATS || index == i)
+			totalcpuusage += ca->total.usage.usages[i];
+	mutex_unlock(&ca->flush_mutex);
 
 	return totalcpuusage;
 }
@@ -194,8 +291,20 @@ static int cpuusage_write(struct cgroup_subsys_state *css, struct cftype *cft,
 	if (val)
 		return -EINVAL;
 
-	for_each_possible_cpu(cpu)
+	if (ca == &root_cpuacct) {
+		for_each_possible_cpu(cpu)
+			cpuacct_cpuusage_write(ca, cpu, 0);
+		return 0;
+	}
+
+	mutex_lock(&ca->flush_mutex);
+	for_each_possible_cpu(cpu) {
 		cpuacct_cpuusage_write(ca, cpu, 0);
+		memset(&per_cpu_ptr(ca->snap, cpu)->usage, 0,
+		       sizeof(struct cpuacct_usage));
+	}
+	memset(&ca->total.usage, 0, sizeof(ca->total.usage));
+	mutex_unlock(&ca->flush_mutex);
 
 	return 0;
 }
@@ -269,19 +378,24 @@ static int cpuacct_all_seq_show(struct seq_file *m, void *V)
 static int cpuacct_stats_show(struct seq_file *sf, void *v)
 {
 	struct cpuacct *ca = css_ca(seq_css(sf));
-	s64 val[CPUACCT_STAT_NSTATS];
+	u64 val[CPUACCT_STAT_NSTATS];
 	int cpu;
 	int stat;
 
 	memset(val, 0, sizeof(val));
-	for_each_possible_cpu(cpu) {
-		u64 *cpustat = per_cpu_ptr(ca->cpustat, cpu)->cpustat;
+	if (ca == &root_cpuacct) {
+		for_each_possible_cpu(cpu) {
+			u64 cpustat[CPUACCT_STAT_NSTATS];
 
-		val[CPUACCT_STAT_USER]   += cpustat[CPUTIME_USER];
-		val[CPUACCT_STAT_USER]   += cpustat[CPUTIME_NICE];
-		val[CPUACCT_STAT_SYSTEM] += cpustat[CPUTIME_SYSTEM];
-		val[CPUACCT_STAT_SYSTEM] += cpustat[CPUTIME_IRQ];
-		val[CPUACCT_STAT_SYSTEM] += cpustat[CPUTIME_SOFTIRQ];
+			cpuacct_cpustat_read(ca, cpu, cpustat);
+			for (stat = 0; stat < CPUACCT_STAT_NSTATS; stat++)
+				val[stat] += cpustat[stat];
+		}
+	} else {
+		mutex_lock(&ca->flush_mutex);
+		cpuacct_flush(ca);
+		memcpy(val, ca->total.stat.usages, sizeof(val));
+		mutex_unlock(&ca->flush_mutex);
 	}
 
 	for (stat = 0; stat < CPUACCT_STAT_NSTATS; stat++) {
@@ -340,14 +454,17 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 	struct cpuacct *ca;
 	int index = CPUACCT_STAT_SYSTEM;
 	struct pt_regs *regs = task_pt_regs(tsk);
+	int cpu = smp_processor_id();
 
 	if (regs && user_mode(regs))
 		index = CPUACCT_STAT_USER;
 
 	rcu_read_lock();
 
-	for (ca = task_ca(tsk); ca; ca = parent_ca(ca))
+	for (ca = task_ca(tsk); ca; ca = parent_ca(ca)) {
 		this_cpu_ptr(ca->cpuusage)->usages[index] += cputime;
+		cpuacct_updated(ca, cpu);
+	}
 
 	rcu_read_unlock();
 }
@@ -360,10 +477,13 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 void cpuacct_account_field(struct task_struct *tsk, int index, u64 val)
 {
 	struct cpuacct *ca;
+	int cpu = smp_processor_id();
 
 	rcu_read_lock();
-	for (ca = task_ca(tsk); ca != &root_cpuacct; ca = parent_ca(ca))
+	for (ca = task_ca(tsk); ca != &root_cpuacct; ca = parent_ca(ca)) {
 		this_cpu_ptr(ca->cpustat)->cpustat[index] += val;
+		cpuacct_updated(ca, cpu);
+	}
 	rcu_read_unlock();
 }
 
@@ -29,6 +29,7 @@ struct sugov_policy {
 	struct list_head	tunables_hook;
 
 	raw_spinlock_t		update_lock;	/* For shared policies */
+	u64			last_eval_time;	/* For shared policies */
 	u64			last_freq_update_time;
 	s64			min_rate_limit_ns;
 	s64			up_rate_delay_ns;
@@ -45,6 +46,8 @@ struct sugov_policy {
 	bool			work_in_progress;
 
 	bool			need_freq_update;
+	/* A waking task asked to skip the up rate limit: */
+	bool			demand_ramp;
 };
 
 struct sugov_cpu {
@@ -97,6 +100,9 @@ static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
 	if (unlikely(sg_policy->need_freq_update))
 		return true;
 
+	if (sg_policy->demand_ramp)
+		return true;
+
 	/* No need to recalculate next freq for min_rate_limit_us
 	 * at least. However we might still decide to further rate
 	 * limit once frequency change direction is decided, according
@@ -114,7 +120,7 @@ static bool sugov_up_down_rate_limit(struct sugov_policy *sg_policy, u64 time,
 
 	delta_ns = time - sg_policy->last_freq_update_time;
 
-	if (next_freq > sg_policy->next_freq &&
+	if (next_freq > sg_policy->next_freq && !sg_policy->demand_ramp &&
 	    delta_ns < sg_policy->up_rate_delay_ns)
 			return true;
 
@@ -128,10 +134,15 @@ static bool sugov_up_down_rate_limit(struct sugov_policy *sg_policy, u64 time,
 static bool sugov_update_next_freq(struct sugov_policy *sg_policy, u64 time,
 				   unsigned int next_freq)
 {
+	bool rate_limited;
+
+	rate_limited = sugov_up_down_rate_limit(sg_policy, time, next_freq);
+	sg_policy->demand_ramp = false;
+
 	if (sg_policy->next_freq == next_freq)
 		return false;
 
-	if (sugov_up_down_rate_limit(sg_policy, time, next_freq))
+	if (rate_limited)
 		return false;
 
 	sg_policy->next_freq = next_freq;
@@ -313,6 +324,8 @@ static unsigned long sugov_get_util(struct sugov_cpu *sg_cpu)
 	sg_cpu->max = max;
 	sg_cpu->bw_dl = cpu_bw_dl(rq);
 
+	util = uclamp_rq_util_with(rq, util, NULL);
+
 	return schedutil_freq_util(sg_cpu->cpu, util, max, FREQUENCY_UTIL);
 }
 
@@ -486,6 +499,9 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 
 	ignore_dl_rate_limit(sg_cpu, sg_policy);
 
+	if (flags & SCHED_CPUFREQ_DEMAND)
+		sg_policy->demand_ramp = true;
+
 	if (!sugov_should_update_freq(sg_policy, time))
 		return;
 
@@ -520,6 +536,28 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 	}
 }
 
+/**
+ * sugov_claim_update() - Elect the CPU evaluating a shared policy.
+ * @sg_policy: the shared policy
+ * @time: the update time from the caller
+ *
+ * All the CPUs of a shared policy call into schedutil from their scheduler
+ * tick and enqueue/dequeue paths, but the policy only needs to aggregate their
+ * utilization once per rate limit interval. The first caller of an interval
+ * wins a cmpxchg on the time of the last evaluation and takes the policy lock,
+ * the other ones return without touching it: their utilization is read from
+ * their rq by the next evaluation anyway.
+ */
+static bool sugov_claim_update(struct sugov_policy *sg_policy, u64 time)
+{
+	u64 last = READ_ONCE(sg_policy->last_eval_time);
+
+	if ((s64)(time - last) < READ_ONCE(sg_policy->min_rate_limit_ns))
+		return false;
+
+	return cmpxchg64(&sg_policy->last_eval_time, last, time) == last;
+}
+
 static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
 {
 	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
@@ -551,6 +589,22 @@ sugov_update_shared(struct update_util_data *hook, u64 time, unsigned int flags)
 	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
 	unsigned int next_f;
 
+	/*
+	 * Requests which only carry a utilization change do not need the
+	 * lock unless they are elected to evaluate the policy, which only
+	 * CPUs able to act on the result can be. IO boosts, demand ramps,
+	 * DL bandwidth increases and limits changes still take the slow
+	 * path, as they have to be acted upon right away.
+	 */
+	if (!(flags & (SCHED_CPUFREQ_IOWAIT | SCHED_CPUFREQ_DEMAND)) &&
+	    !READ_ONCE(sg_cpu->iowait_boost) &&
+	    !READ_ONCE(sg_policy->need_freq_update) &&
+	    cpu_bw_dl(cpu_rq(sg_cpu->cpu)) <= READ_ONCE(sg_cpu->bw_dl) &&
+	    ((sg_policy->policy->fast_switch_enabled &&
+	      !cpufreq_this_cpu_can_update(sg_policy->policy)) ||
+	     !sugov_claim_update(sg_policy, time)))
+		return;
+
 	raw_spin_lock(&sg_policy->update_lock);
 
 	sugov_iowait_boost(sg_cpu, time, flags);
@@ -558,6 +612,9 @@ sugov_update_shared(struct update_util_data *hook, u64 time, unsigned int flags)
 
 	ignore_dl_rate_limit(sg_cpu, sg_policy);
 
+	if (flags & SCHED_CPUFREQ_DEMAND)
+		sg_policy->demand_ramp = true;
+
 	if (sugov_should_update_freq(sg_policy, time)) {
 		next_f = sugov_next_freq_shared(sg_cpu, time);
 
@@ -904,6 +961,7 @@ static int sugov_start(struct cpufreq_policy *policy)
 	sg_policy->down_rate_delay_ns =
 		sg_policy->tunables->down_rate_limit_us * NSEC_PER_USEC;
 	update_min_rate_limit_ns(sg_policy);
+	sg_policy->last_eval_time		= 0;
 	sg_policy->last_freq_update_time	= 0;
 	sg_policy->next_freq			= 0;
 	sg_policy->work_in_progress		= false;
@@ -180,6 +180,240 @@ void dl_change_utilization(struct task_struct *p, u64 new_bw)
 	__add_rq_bw(new_bw, &rq->dl);
 }
 
+#ifdef CONFIG_DL_GROUP_POOL
+void init_dl_pool(struct dl_pool *pool)
+{
+	raw_spin_lock_init(&pool->lock);
+	pool->period = global_rt_period();
+}
+
+/*
+ * Unprivileged tasks can only become SCHED_DEADLINE inside a group with a
+ * bandwidth pool.
+ */
+bool dl_pool_allowed(struct task_struct *p)
+{
+	bool ret;
+
+	rcu_read_lock();
+	ret = READ_ONCE(task_group(p)->dl_pool.bw) != 0;
+	rcu_read_unlock();
+
+	return ret;
+}
+
+int sched_group_set_dl_pool(struct task_group *tg, u64 runtime_us,
+			    u64 period_us)
+{
+	struct dl_pool *pool = &tg->dl_pool;
+	u64 runtime, period, bw = 0;
+	unsigned long flags;
+	int ret = 0;
+
+	if (tg == &root_task_group)
+		return -EINVAL;
+
+	if (!period_us || period_us > U64_MAX / NSEC_PER_USEC ||
+	    runtime_us > period_us)
+		return -EINVAL;
+
+	period = period_us * NSEC_PER_USEC;
+	runtime = runtime_us * NSEC_PER_USEC;
+	if (runtime)
+		bw = to_ratio(period, runtime);
+
+	raw_spin_lock_irqsave(&pool->lock, flags);
+	/* Shrinking below what the members already use is not possible */
+	if (pool->total_bw > bw) {
+		ret = -EBUSY;
+	} else {
+		pool->runtime = runtime;
+		pool->period = period;
+		WRITE_ONCE(pool->bw, bw);
+	}
+	raw_spin_unlock_irqrestore(&pool->lock, flags);
+
+	return ret;
+}
+
+/*
+ * Lock the pool @p is or will be accounted to when its bandwidth becomes
+ * @new_bw, and check the pool has room for it. The pool is returned in
+ * @poolp, NULL if @p neither is nor becomes a pool member.
+ */
+static int dl_pool_lock(struct task_struct *p, u64 new_bw,
+			struct dl_pool **poolp)
+{
+	struct dl_pool *pool = p->dl.dl_pool;
+	u64 old_bw = pool ? p->dl.dl_bw : 0;
+
+	*poolp = NULL;
+
+	if (!pool && new_bw)
+		pool = &task_group(p)->dl_pool;
+	if (!pool)
+		return 0;
+
+	raw_spin_lock(&pool->lock);
+	if (!p->dl.dl_pool && !pool->bw) {
+		raw_spin_unlock(&pool->lock);
+		return 0;
+	}
+
+	if (pool->total_bw - old_bw + new_bw > pool->bw) {
+		raw_spin_unlock(&pool->lock);
+		return -EBUSY;
+	}
+
+	*poolp = pool;
+	return 0;
+}
+
+static void dl_pool_unlock(struct task_struct *p, struct dl_pool *pool,
+			   u64 new_bw, bool admitted)
+{
+	struct dl_pool *old_pool = p->dl.dl_pool;
+
+	if (!pool)
+		return;
+
+	if (admitted) {
+		pool->total_bw -= old_pool ? p->dl.dl_bw : 0;
+		pool->total_bw += new_bw;
+		p->dl.dl_pool = new_bw ? pool : NULL;
+	}
+	raw_spin_unlock(&pool->lock);
+
+	/* Members pin their group, so that p->dl.dl_pool stays valid */
+	if (!old_pool && p->dl.dl_pool)
+		css_get(&container_of(pool, struct task_group, dl_pool)->css);
+	else if (old_pool && !p->dl.dl_pool)
+		css_put(&container_of(pool, struct task_group, dl_pool)->css);
+}
+
+/* Called when the bandwidth of a dead task is released */
+static void dl_pool_leave(struct task_struct *p)
+{
+	struct dl_pool *pool = p->dl.dl_pool;
+
+	if (!pool)
+		return;
+
+	raw_spin_lock(&pool->lock);
+	dl_pool_unlock(p, pool, 0, true);
+}
+
+/*
+ * A member blocking before its deadline with runtime left lends that
+ * runtime to the other members of its pool. It can be consumed until the
+ * earliest deadline of the donors, the bandwidth of which is kept active
+ * by task_non_contending() until then. What is left of it is taken back by
+ * dl_pool_restore() if the member wakes up again before its deadline.
+ */
+static void dl_pool_donate(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	struct dl_pool *pool = dl_se->dl_pool;
+	u64 now = rq_clock(rq);
+
+	if (!pool || dl_se->runtime <= 0 || dl_se->dl_throttled ||
+	    !dl_time_before(now, dl_se->deadline))
+		return;
+
+	raw_spin_lock(&pool->lock);
+	if (!pool->slack || !dl_time_before(now, pool->slack_expires)) {
+		pool->slack = 0;
+		pool->slack_expires = dl_se->deadline;
+	} else if (dl_time_before(dl_se->deadline, pool->slack_expires)) {
+		pool->slack_expires = dl_se->deadline;
+	}
+	pool->slack += dl_se->runtime;
+	raw_spin_unlock(&pool->lock);
+
+	dl_se->dl_donated = dl_se->runtime;
+	dl_se->runtime = 0;
+}
+
+/*
+ * A member waking up before its deadline takes back the runtime it lent
+ * when blocking, as far as the other members did not consume it. Past its
+ * deadline, it is replenished anyway.
+ */
+static void dl_pool_restore(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	struct dl_pool *pool = dl_se->dl_pool;
+	u64 now = rq_clock(rq);
+	u64 amount;
+
+	if (!pool || !dl_se->dl_donated)
+		return;
+
+	if (dl_time_before(now, dl_se->deadline)) {
+		raw_spin_lock(&pool->lock);
+		if (pool->slack && dl_time_before(now, pool->slack_expires)) {
+			amount = min(pool->slack, dl_se->dl_donated);
+			pool->slack -= amount;
+			dl_se->runtime += amount;
+		}
+		raw_spin_unlock(&pool->lock);
+	}
+
+	dl_se->dl_donated = 0;
+}
+
+/*
+ * A member which depleted its runtime takes what it can from the slack of
+ * its pool. Return true if it can keep running.
+ */
+static bool dl_pool_reclaim(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	struct dl_pool *pool = dl_se->dl_pool;
+	u64 now = rq_clock(rq);
+	u64 amount;
+
+	if (!pool || !READ_ONCE(pool->slack))
+		return false;
+
+	raw_spin_lock(&pool->lock);
+	if (pool->slack && dl_time_before(now, pool->slack_expires)) {
+		amount = min(pool->slack, pool->slack_expires - now);
+		pool->slack -= amount;
+		dl_se->runtime += amount;
+	}
+	raw_spin_unlock(&pool->lock);
+
+	return dl_se->runtime > 0;
+}
+#else
+static inline int dl_pool_lock(struct task_struct *p, u64 new_bw,
+			       struct dl_pool **poolp)
+{
+	*poolp = NULL;
+	return 0;
+}
+
+static inline void dl_pool_unlock(struct task_struct *p, struct dl_pool *pool,
+				  u64 new_bw, bool admitted)
+{
+}
+
+static inline void dl_pool_leave(struct task_struct *p)
+{
+}
+
+static inline void dl_pool_donate(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+}
+
+static inline void dl_pool_restore(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+}
+
+static inline bool dl_pool_reclaim(struct rq *rq, struct sched_dl_entity *dl_se)
+{
+	return false;
+}
+#endif /* CONFIG_DL_GROUP_POOL */
+
 /*
  * The utilization of a task cannot be immediately removed from
  * the rq active utilization (running_bw) when the task blocks.
@@ -277,6 +511,7 @@ static void task_non_contending(struct task_struct *p)
 
 			if (p->state == TASK_DEAD)
 				sub_rq_bw(&p->dl, &rq->dl);
+			dl_pool_leave(p);
 			raw_spin_lock(&dl_b->lock);
 			__dl_sub(dl_b, p->dl.dl_bw, dl_bw_cpus(task_cpu(p)));
 			__dl_clear_params(p);
@@ -1205,7 +1440,8 @@ static void update_curr_dl(struct rq *rq)
 	dl_se->runtime -= scaled_delta_exec;
 
 throttle:
-	if (dl_runtime_exceeded(dl_se) || dl_se->dl_yielded) {
+	if (dl_se->dl_yielded ||
+	    (dl_runtime_exceeded(dl_se) && !dl_pool_reclaim(rq, dl_se))) {
 		dl_se->dl_throttled = 1;
 
 		/* If requested, inform the user about runtime overruns. */
@@ -1270,6 +1506,7 @@ static enum hrtimer_restart inactive_task_timer(struct hrtimer *timer)
 			dl_se->dl_non_contending = 0;
 		}
 
+		dl_pool_leave(p);
 		raw_spin_lock(&dl_b->lock);
 		__dl_sub(dl_b, p->dl.dl_bw, dl_bw_cpus(task_cpu(p)));
 		raw_spin_unlock(&dl_b->lock);
@@ -1473,6 +1710,9 @@ static void enqueue_task_dl(struct rq *rq, struct task_struct *p, int flags)
 	if (!p->dl.dl_throttled && !dl_is_implicit(&p->dl))
 		dl_check_constrained_dl(&p->dl);
 
+	if (flags & ENQUEUE_WAKEUP)
+		dl_pool_restore(rq, &p->dl);
+
 	if (p->on_rq == TASK_ON_RQ_MIGRATING || flags & ENQUEUE_RESTORE) {
 		add_rq_bw(&p->dl, &rq->dl);
 		add_running_bw(&p->dl, &rq->dl);
@@ -1528,8 +1768,10 @@ static void dequeue_task_dl(struct rq *rq, struct task_struct *p, int flags)
 	 * (the task moves from "active contending" to "active non contending"
 	 * or "inactive")
 	 */
-	if (flags & DEQUEUE_SLEEP)
+	if (flags & DEQUEUE_SLEEP) {
+		dl_pool_donate(rq, &p->dl);
 		task_non_contending(p);
+	}
 }
 
 /*
@@ -2520,6 +2762,7 @@ int sched_dl_overflow(struct task_struct *p, int policy,
 	u64 period = attr->sched_period ?: attr->sched_deadline;
 	u64 runtime = attr->sched_runtime;
 	u64 new_bw = dl_policy(policy) ? to_ratio(period, runtime) : 0;
+	struct dl_pool *pool;
 	int cpus, err = -1;
 
 	if (attr->sched_flags & SCHED_FLAG_SUGOV)
@@ -2529,6 +2772,13 @@ int sched_dl_overflow(struct task_struct *p, int policy,
 	if (new_bw == p->dl.dl_bw && task_has_dl_policy(p))
 		return 0;
 
+	/*
+	 * Tasks of a group with a bandwidth pool must also fit in the pool,
+	 * which is only updated once the root domain admitted them too.
+	 */
+	if (dl_pool_lock(p, new_bw, &pool))
+		return -1;
+
 	/*
 	 * Either if a task, enters, leave, or stays -deadline but changes
 	 * its parameters, we may need to update accordingly the total
@@ -2565,6 +2815,8 @@ int sched_dl_overflow(struct task_struct *p, int policy,
 	}
 	raw_spin_unlock(&dl_b->lock);
 
+	dl_pool_unlock(p, pool, new_bw, !err);
+
 	return err;
 }
 
@@ -5188,6 +5188,17 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (p->in_iowait)
 		cpufreq_update_util(rq, SCHED_CPUFREQ_IOWAIT);
 
+	/*
+	 * PELT needs tens of milliseconds to ramp back up after a sleep,
+	 * while util_est remembers what the task needed on its last
+	 * activation and is already part of the rq utilization. When the
+	 * two are far apart, ask schedutil to follow util_est right away.
+	 */
+	if ((flags & ENQUEUE_WAKEUP) && sched_feat(UTIL_EST) &&
+	    sched_feat(SUGOV_DEMAND_RAMP) &&
+	    _task_util_est(p) * 1024 > task_util(p) * capacity_margin)
+		cpufreq_update_util(rq, SCHED_CPUFREQ_DEMAND);
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -5883,7 +5894,7 @@ boosted_task_util(struct task_struct *task)
 
 	trace_sched_boost_task(task, util, margin);
 
-	return util + margin;
+	return uclamp_task_util(task, util + margin);
 }
 
 static unsigned long cpu_util_without(int cpu, struct task_struct *p);
@@ -6271,6 +6282,51 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
 
 #endif /* CONFIG_SCHED_SMT */
 
+/*
+ * Keep the idle CPU mask of the LLC domain of @cpu up to date; called by the
+ * idle task on entry to and exit from the idle loop.
+ */
+void update_idle_cpumask(int cpu, bool idle)
+{
+	struct sched_domain_shared *sds;
+
+	if (!sched_feat(SIS_IDLE_MASK))
+		return;
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (sds && cpumask_test_cpu(cpu, sds_idle_cpus(sds)) != idle) {
+		if (idle)
+			cpumask_set_cpu(cpu, sds_idle_cpus(sds));
+		else
+			cpumask_clear_cpu(cpu, sds_idle_cpus(sds));
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Look for an idle CPU in the idle CPU mask of the LLC domain: a couple of
+ * find-next-bit operations instead of a scan of the domain, which makes the
+ * SIS_AVG_CPU and SIS_PROP scan limits unnecessary.
+ */
+static int select_idle_cpu_mask(struct task_struct *p, struct sched_domain *sd,
+				int target)
+{
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
+	int cpu;
+
+	cpumask_and(cpus, sds_idle_cpus(sd->shared), sched_domain_span(sd));
+	cpumask_and(cpus, cpus, &p->cpus_allowed);
+
+	/* The mask can lag an idle exit, check the CPU before using it. */
+	for_each_cpu_wrap(cpu, cpus, target) {
+		if (available_idle_cpu(cpu))
+			return cpu;
+	}
+
+	return -1;
+}
+
 /*
  * Scan the LLC domain for idle CPUs; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
@@ -6284,6 +6340,9 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	s64 delta;
 	int cpu, nr = INT_MAX;
 
+	if (sched_feat(SIS_IDLE_MASK) && sd->shared)
+		return select_idle_cpu_mask(p, sd, target);
+
 	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
 	if (!this_sd)
 		return -1;
@@ -6539,7 +6598,7 @@ static void find_best_target(struct sched_domain *sd, cpumask_t *cpus,
 	unsigned long target_max_spare_cap = 0;
 	unsigned long target_util = ULONG_MAX;
 	bool prefer_idle = schedtune_prefer_idle(p);
-	bool boosted = schedtune_task_boost(p) > 0;
+	bool boosted = schedtune_task_boost(p) > 0 || uclamp_boosted(p);
 	/* Initialise with deepest possible cstate (INT_MAX) */
 	int shallowest_idle_cstate = INT_MAX;
 	struct sched_group *sg;
@@ -6899,42 +6958,99 @@ static unsigned long cpu_util_next(int cpu, struct task_struct *p, int dst_cpu)
 }
 
 /*
- * compute_energy(): Estimates the energy that would be consumed if @p was
- * migrated to @dst_cpu. compute_energy() predicts what will be the utilization
- * landscape of the * CPUs after the task migration, and uses the Energy Model
- * to compute what would be the energy if we decided to actually migrate that
- * task.
+ * struct pd_energy_env - Utilization landscape of a performance domain when
+ * the waking task runs on none of its CPUs.
+ * @max_util:	highest clamped utilization of the CPUs of the domain
+ * @sum_util:	sum of the utilization of the CPUs of the domain
+ * @energy:	energy consumed by the domain with that landscape
+ * @asleep:	all the CPUs of the domain are idle, so running @p there would
+ *		also cost waking the domain up
  */
-static long
-compute_energy(struct task_struct *p, int dst_cpu, struct perf_domain *pd)
+struct pd_energy_env {
+	unsigned long max_util;
+	unsigned long sum_util;
+	unsigned long energy;
+	bool asleep;
+};
+
+/* Utilization driving the energy of @cpu if @p was migrated to @dst_cpu. */
+static inline unsigned long
+cpu_energy_util(int cpu, struct task_struct *p, int dst_cpu)
 {
-	long util, max_util, sum_util, energy = 0;
+	unsigned long util = cpu_util_next(cpu, p, dst_cpu);
+
+	util += cpu_util_rt(cpu_rq(cpu));
+
+	return schedutil_energy_util(cpu, util);
+}
+
+/*
+ * pd_energy_env_init(): Computes the utilization landscape of @pd with @p
+ * removed from its previous CPU and the energy it would consume that way.
+ * This is the only part of the energy estimation that walks all the CPUs of
+ * a domain, and find_energy_efficient_cpu() does it once per wake-up.
+ */
+static void pd_energy_env_init(struct pd_energy_env *env,
+			       struct task_struct *p, struct perf_domain *pd)
+{
+	unsigned long util;
 	int cpu;
 
-	for (; pd; pd = pd->next) {
-		max_util = sum_util = 0;
+	env->max_util = env->sum_util = 0;
+	env->asleep = true;
+
+	/*
+	 * The capacity state of CPUs of the current rd can be driven by CPUs
+	 * of another rd if they belong to the same performance domain. So,
+	 * account for the utilization of these CPUs too by masking pd with
+	 * cpu_online_mask instead of the rd span.
+	 *
+	 * If an entire performance domain is outside of the current rd, it
+	 * will not appear in its pd list and will not be accounted here.
+	 */
+	for_each_cpu_and(cpu, perf_domain_span(pd), cpu_online_mask) {
+		util = cpu_energy_util(cpu, p, -1);
+		env->sum_util += util;
+
+		if (env->asleep && !idle_cpu(cpu))
+			env->asleep = false;
+
 		/*
-		 * The capacity state of CPUs of the current rd can be driven by
-		 * CPUs of another rd if they belong to the same performance
-		 * domain. So, account for the utilization of these CPUs too
-		 * by masking pd with cpu_online_mask instead of the rd span.
-		 *
-		 * If an entire performance domain is outside of the current rd,
-		 * it will not appear in its pd list and will not be accounted
-		 * by compute_energy().
+		 * The OPP of the domain follows the clamped demand of its
+		 * busiest CPU.
 		 */
-		for_each_cpu_and(cpu, perf_domain_span(pd), cpu_online_mask) {
-			util = cpu_util_next(cpu, p, dst_cpu);
-			util += cpu_util_rt(cpu_rq(cpu));
-			util = schedutil_energy_util(cpu, util);
-			max_util = max(util, max_util);
-			sum_util += util;
-		}
-
-		energy += em_pd_energy(pd->em_pd, max_util, sum_util);
+		util = uclamp_rq_util_with(cpu_rq(cpu), util, NULL);
+		env->max_util = max(util, env->max_util);
 	}
 
-	return energy;
+	env->energy = em_pd_energy(pd->em_pd, env->max_util, env->sum_util);
+}
+
+/*
+ * pd_energy_delta(): Estimates the extra energy @pd would consume if @p was
+ * migrated to @dst_cpu, one of its CPUs. The migration only raises the
+ * utilization of @dst_cpu, so the new landscape of the domain follows from
+ * @env in O(1), and the energy of the other domains does not change.
+ */
+static unsigned long pd_energy_delta(struct pd_energy_env *env,
+				     struct task_struct *p, int dst_cpu,
+				     struct perf_domain *pd)
+{
+	unsigned long util, max_util, sum_util, energy, wake_energy = 0;
+
+	util = cpu_energy_util(dst_cpu, p, dst_cpu);
+	sum_util = env->sum_util - cpu_energy_util(dst_cpu, p, -1) + util;
+
+	/* A sleeping domain stays awake about as long as @p runs */
+	if (env->asleep)
+		wake_energy = em_pd_wake_energy(pd->em_pd, util);
+
+	util = uclamp_rq_util_with(cpu_rq(dst_cpu), util, p);
+	max_util = max(util, env->max_util);
+
+	/* The signals may have moved since @env was built */
+	energy = em_pd_energy(pd->em_pd, max_util, sum_util) + wake_energy;
+	return energy > env->energy ? energy - env->energy : 0;
 }
 
 static void select_max_spare_cap_cpus(struct sched_domain *sd, cpumask_t *cpus,
@@ -7017,13 +7133,15 @@ static DEFINE_PER_CPU(cpumask_t, energy_cpus);
 
 static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu, int sync)
 {
-	unsigned long prev_energy = ULONG_MAX, best_energy = ULONG_MAX;
+	unsigned long prev_delta = ULONG_MAX, best_delta = ULONG_MAX;
 	struct root_domain *rd = cpu_rq(smp_processor_id())->rd;
 	int weight, cpu, best_energy_cpu = prev_cpu;
-	unsigned long cur_energy;
+	unsigned long base_energy = 0, cur_delta;
+	struct pd_energy_env env;
 	struct perf_domain *pd;
 	struct sched_domain *sd;
 	cpumask_t *candidates;
+	u64 start = 0;
 
 	if (sysctl_sched_sync_hint_enable && sync) {
 		cpu = smp_processor_id();
@@ -7036,6 +7154,9 @@ static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu, int sy
 	if (!pd || READ_ONCE(rd->overutilized))
 		goto fail;
 
+	if (schedstat_enabled())
+		start = local_clock();
+
 	/*
 	 * Energy-aware wake-up happens on the lowest sched_domain starting
 	 * from sd_asym_cpucapacity spanning over this_cpu and prev_cpu.
@@ -7073,31 +7194,51 @@ static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu, int sy
 	}
 
 	if (cpumask_test_cpu(prev_cpu, &p->cpus_allowed))
-		prev_energy = best_energy = compute_energy(p, prev_cpu, pd);
-	else
-		prev_energy = best_energy = ULONG_MAX;
+		cpumask_set_cpu(prev_cpu, candidates);
 
-	/* Select the best candidate energy-wise. */
-	for_each_cpu(cpu, candidates) {
-		if (cpu == prev_cpu)
-			continue;
-		cur_energy = compute_energy(p, cpu, pd);
-		if (cur_energy < best_energy) {
-			best_energy = cur_energy;
-			best_energy_cpu = cpu;
+	/*
+	 * Select the best candidate energy-wise. All candidates share the
+	 * landscape of the system without @p, so each domain is walked once
+	 * and a candidate only costs the energy delta of its own domain.
+	 */
+	for (; pd; pd = pd->next) {
+		pd_energy_env_init(&env, p, pd);
+		base_energy += env.energy;
+
+		for_each_cpu_and(cpu, candidates, perf_domain_span(pd)) {
+			cur_delta = pd_energy_delta(&env, p, cpu, pd);
+			if (cpu == prev_cpu) {
+				prev_delta = cur_delta;
+				continue;
+			}
+			if (cur_delta < best_delta) {
+				best_delta = cur_delta;
+				best_energy_cpu = cpu;
+			}
 		}
 	}
+
+	/* Candidates have to beat prev_cpu to be selected. */
+	if (prev_delta <= best_delta) {
+		best_delta = prev_delta;
+		best_energy_cpu = prev_cpu;
+	}
 unlock:
 	rcu_read_unlock();
 
+	if (start) {
+		__schedstat_inc(this_rq()->eas_count);
+		__schedstat_add(this_rq()->eas_time, local_clock() - start);
+	}
+
 	/*
 	 * Pick the best CPU if prev_cpu cannot be used, or if it saves at
 	 * least 6% of the energy used by prev_cpu.
 	 */
-	if (prev_energy == ULONG_MAX)
+	if (prev_delta == ULONG_MAX)
 		return best_energy_cpu;
 
-	if ((prev_energy - best_energy) > (prev_energy >> 4))
+	if ((prev_delta - best_delta) > ((base_energy + prev_delta) >> 4))
 		return best_energy_cpu;
 
 	return prev_cpu;
@@ -7134,6 +7275,10 @@ select_task_rq_fair(struct task_struct *p, int prev_cpu, int sd_flag, int wake_f
 		record_wakee(p);
 
 		if (static_branch_unlikely(&sched_energy_present)) {
+			/* Latency sensitive tasks skip the energy model */
+			if (p->sched_latency_sensitive)
+				goto sd_loop;
+
 			if (schedtune_prefer_idle(p) && !sched_feat(EAS_PREFER_IDLE) && !sync)
 				goto sd_loop;
 
@@ -7762,6 +7907,7 @@ enum group_type {
 #define LBF_SOME_PINNED	0x08
 #define LBF_NOHZ_STATS	0x10
 #define LBF_NOHZ_AGAIN	0x20
+#define LBF_ACTIVE_LB	0x40
 
 struct lb_env {
 	struct sched_domain	*sd;
@@ -7944,10 +8090,14 @@ int can_migrate_task(struct task_struct *p, struct lb_env *env)
 
 	/*
 	 * Aggressive migration if:
-	 * 1) destination numa is preferred
-	 * 2) task is cache cold, or
-	 * 3) too many balance attempts have failed.
+	 * 1) active balance
+	 * 2) destination numa is preferred
+	 * 3) task is cache cold, or
+	 * 4) too many balance attempts have failed.
 	 */
+	if (env->flags & LBF_ACTIVE_LB)
+		return 1;
+
 	tsk_cache_hot = migrate_degrades_locality(p, env);
 	if (tsk_cache_hot == -1)
 		tsk_cache_hot = task_hot(p, env);
@@ -8226,6 +8376,7 @@ static void update_blocked_averages(int cpu)
 	if (done)
 		rq->has_blocked_load = 0;
 #endif
+	update_pelt_snapshot(rq);
 	rq_unlock_irqrestore(rq, &rf);
 }
 
@@ -8296,6 +8447,7 @@ static inline void update_blocked_averages(int cpu)
 	if (!cfs_rq_has_blocked(cfs_rq) && !others_have_blocked(rq))
 		rq->has_blocked_load = 0;
 #endif
+	update_pelt_snapshot(rq);
 	rq_unlock_irqrestore(rq, &rf);
 }
 
@@ -9866,8 +10018,11 @@ static int active_load_balance_cpu_stop(void *data)
 			 * for active balancing. Since we have CPU_IDLE, but no
 			 * @dst_grpmask we need to make that test go away with lying
 			 * about DST_PINNED.
+			 *
+			 * The stopper preempted the task we are after, which
+			 * just makes it look cache hot: ignore that.
 			 */
-			.flags		= LBF_DST_PINNED,
+			.flags		= LBF_DST_PINNED | LBF_ACTIVE_LB,
 		};
 
 		schedstat_inc(sd->alb_count);
@@ -10586,6 +10741,70 @@ static __latent_entropy void run_rebalance_domains(struct softirq_action *h)
 	rebalance_domains(this_rq, idle);
 }
 
+/*
+ * misfit_tick_balance(): Push the misfit task running alone on @rq to an idle
+ * CPU of higher capacity.
+ *
+ * The periodic load balancer handles misfit tasks as one more group type: it
+ * has to find the busiest group of the domain first, and only actively
+ * migrates a running task after several failed balance attempts. A CPU
+ * running a single task that does not fit knows better, so it picks the
+ * target itself: the smallest idle CPU the task fits, or else the biggest
+ * idle one, and hands the task over through the CPU stopper.
+ */
+static void misfit_tick_balance(struct rq *rq)
+{
+	int cpu = cpu_of(rq), target = -1, i;
+	unsigned long target_cap = 0, cap;
+	bool fits, target_fits = false;
+	struct sched_domain *sd;
+	struct task_struct *p;
+	unsigned long flags;
+
+	if (!sched_feat(MISFIT_TICK_BALANCE) || !READ_ONCE(rq->misfit_task_load))
+		return;
+
+	raw_spin_lock_irqsave(&rq->lock, flags);
+
+	p = rq->curr;
+	if (rq->nr_running != 1 || rq->active_balance ||
+	    p->sched_class != &fair_sched_class || !rq->misfit_task_load)
+		goto unlock;
+
+	rcu_read_lock();
+	sd = rcu_dereference(per_cpu(sd_asym_cpucapacity, cpu));
+	if (!sd)
+		goto unlock_rcu;
+
+	for_each_cpu_and(i, sched_domain_span(sd), &p->cpus_allowed) {
+		cap = capacity_orig_of(i);
+		if (cap <= capacity_orig_of(cpu) || !available_idle_cpu(i))
+			continue;
+
+		fits = task_fits_capacity(p, capacity_of(i));
+		if (target < 0 ||
+		    (fits && (!target_fits || cap < target_cap)) ||
+		    (!fits && !target_fits && cap > target_cap)) {
+			target = i;
+			target_cap = cap;
+			target_fits = fits;
+		}
+	}
+unlock_rcu:
+	rcu_read_unlock();
+
+	if (target >= 0) {
+		rq->active_balance = 1;
+		rq->push_cpu = target;
+	}
+unlock:
+	raw_spin_unlock_irqrestore(&rq->lock, flags);
+
+	if (target >= 0)
+		stop_one_cpu_nowait(cpu, active_load_balance_cpu_stop, rq,
+				    &rq->active_balance_work);
+}
+
 /*
  * Trigger the SCHED_SOFTIRQ if it is time to do periodic load balancing.
  */
@@ -10595,6 +10814,9 @@ void trigger_load_balance(struct rq *rq)
 	if (unlikely(on_null_domain(rq)))
 		return;
 
+	if (static_branch_unlikely(&sched_asym_cpucapacity))
+		misfit_tick_balance(rq);
+
 	if (time_after_eq(jiffies, rq->next_balance))
 		raise_softirq(SCHED_SOFTIRQ);
 
@@ -11140,6 +11362,10 @@ const struct sched_class fair_sched_class = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	.task_change_group	= task_change_group_fair,
 #endif
+
+#ifdef CONFIG_UCLAMP_TASK
+	.uclamp_enabled		= 1,
+#endif
 };
 
 #ifdef CONFIG_SCHED_DEBUG
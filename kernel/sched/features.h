@@ -58,6 +58,12 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(SIS_AVG_CPU, false)
 SCHED_FEAT(SIS_PROP, true)
 
+/*
+ * Look for an idle CPU of the LLC domain in the idle CPU mask maintained by
+ * the idle loop instead of scanning the domain.
+ */
+SCHED_FEAT(SIS_IDLE_MASK, true)
+
 /*
  * Issue a WARN when we do multiple update_rq_clock() calls
  * in a single rq->lock section. Default disabled because the
@@ -110,6 +116,14 @@ SCHED_FEAT(EAS_PREFER_IDLE, true)
  */
 SCHED_FEAT(SUGOV_RT_MAX_FREQ, false)
 
+/*
+ * Let schedutil ramp up past its up rate limit when a task wakes up with an
+ * estimated utilization well above its decayed PELT utilization, so that the
+ * CPU immediately runs at the frequency the task needed on its last
+ * activation.
+ */
+SCHED_FEAT(SUGOV_DEMAND_RAMP, true)
+
 /*
  * Apply schedtune boost hold to tasks of all sched classes.
  * If enabled, schedtune will hold the boost applied to a CPU
@@ -120,3 +134,10 @@ SCHED_FEAT(SUGOV_RT_MAX_FREQ, false)
  * RT class.
  */
 SCHED_FEAT(SCHEDTUNE_BOOST_HOLD_ALL, false)
+
+/*
+ * On asymmetric CPU capacity systems, let a CPU running a single misfit task
+ * push it from the tick to an idle CPU of higher capacity, instead of waiting
+ * for the periodic load balancer to find it.
+ */
+SCHED_FEAT(MISFIT_TICK_BALANCE, true)
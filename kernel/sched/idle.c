@@ -236,6 +236,7 @@ static void do_idle(void)
 
 	__current_set_polling();
 	tick_nohz_idle_enter();
+	update_idle_cpumask(cpu, true);
 
 	while (!need_resched()) {
 		check_pgt_cache();
@@ -272,6 +273,7 @@ static void do_idle(void)
 	 * This is required because for polling idle loops we will not have had
 	 * an IPI to fold the state for us.
 	 */
+	update_idle_cpumask(cpu, false);
 	preempt_set_need_resched();
 	tick_nohz_idle_exit();
 	__current_clr_polling();
@@ -411,3 +411,119 @@ int update_irq_load_avg(struct rq *rq, u64 running)
 	return ret;
 }
 #endif
+
+#ifdef CONFIG_SCHED_PELT_SNAPSHOT
+/*
+ * One page per CPU, mapped read-only by /proc/sched_pelt users. The writer
+ * is serialized by rq->lock; readers follow the seq protocol documented in
+ * <uapi/linux/sched/types.h>.
+ */
+static DEFINE_PER_CPU(struct sched_pelt_snapshot *, pelt_snapshot);
+static DEFINE_STATIC_KEY_FALSE(sched_pelt_snapshot_enabled);
+
+void update_pelt_snapshot(struct rq *rq)
+{
+	struct sched_pelt_snapshot *snap;
+	int cpu = cpu_of(rq);
+
+	if (!static_branch_unlikely(&sched_pelt_snapshot_enabled))
+		return;
+
+	lockdep_assert_held(&rq->lock);
+
+	snap = per_cpu(pelt_snapshot, cpu);
+
+	WRITE_ONCE(snap->seq, snap->seq + 1);
+	smp_wmb();
+
+	snap->last_update_time = rq->cfs.avg.last_update_time;
+
+	snap->util_avg = READ_ONCE(rq->cfs.avg.util_avg);
+	snap->util_est = READ_ONCE(rq->cfs.avg.util_est.enqueued);
+	snap->rt_util_avg = READ_ONCE(rq->avg_rt.util_avg);
+	snap->dl_util_avg = READ_ONCE(rq->avg_dl.util_avg);
+#ifdef CONFIG_HAVE_SCHED_AVG_IRQ
+	snap->irq_util_avg = READ_ONCE(rq->avg_irq.util_avg);
+#endif
+
+	snap->nr_running = rq->nr_running;
+	snap->cfs_nr_running = rq->cfs.h_nr_running;
+	snap->rt_nr_running = rq->rt.rt_nr_running;
+	snap->dl_nr_running = rq->dl.dl_nr_running;
+
+	snap->capacity = rq->cpu_capacity;
+	snap->capacity_orig = arch_scale_cpu_capacity(NULL, cpu);
+
+	smp_wmb();
+	WRITE_ONCE(snap->seq, snap->seq + 1);
+}
+
+static int sched_pelt_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long cpu = vma->vm_pgoff;
+	unsigned long addr;
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	for (addr = vma->vm_start; addr < vma->vm_end; addr += PAGE_SIZE) {
+		if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+			return -ENXIO;
+
+		ret = vm_insert_page(vma, addr,
+				     virt_to_page(per_cpu(pelt_snapshot, cpu)));
+		if (ret)
+			return ret;
+		cpu++;
+	}
+
+	return 0;
+}
+
+static const struct file_operations sched_pelt_fops = {
+	.mmap		= sched_pelt_mmap,
+	.llseek		= noop_llseek,
+};
+
+static int __init sched_pelt_snapshot_init(void)
+{
+	struct sched_pelt_snapshot *snap;
+	struct page *page;
+	int cpu;
+
+	BUILD_BUG_ON(sizeof(*snap) > PAGE_SIZE);
+
+	for_each_possible_cpu(cpu) {
+		page = alloc_pages_node(cpu_to_node(cpu),
+					GFP_KERNEL | __GFP_ZERO, 0);
+		if (!page)
+			goto free;
+
+		snap = page_address(page);
+		snap->cpu = cpu;
+		snap->capacity_orig = arch_scale_cpu_capacity(NULL, cpu);
+		per_cpu(pelt_snapshot, cpu) = snap;
+	}
+
+	if (!proc_create("sched_pelt", 0444, NULL, &sched_pelt_fops))
+		goto free;
+
+	static_branch_enable(&sched_pelt_snapshot_enabled);
+
+	return 0;
+
+free:
+	for_each_possible_cpu(cpu) {
+		snap = per_cpu(pelt_snapshot, cpu);
+		per_cpu(pelt_snapshot, cpu) = NULL;
+		if (snap)
+			free_page((unsigned long)snap);
+	}
+	return -ENOMEM;
+}
+subsys_initcall(sched_pelt_snapshot_init);
+#endif /* CONFIG_SCHED_PELT_SNAPSHOT */
@@ -69,4 +69,8 @@ update_irq_load_avg(struct rq *rq, u64 running)
 }
 #endif
 
-
+#ifdef CONFIG_SCHED_PELT_SNAPSHOT
+void update_pelt_snapshot(struct rq *rq);
+#else
+static inline void update_pelt_snapshot(struct rq *rq) { }
+#endif
@@ -1644,12 +1644,76 @@ static struct task_struct *pick_highest_pushable_task(struct rq *rq, int cpu)
 
 static DEFINE_PER_CPU(cpumask_var_t, local_cpu_mask);
 
+/*
+ * Verify the fitness of task @p to run on @cpu taking into account the uclamp
+ * settings.
+ *
+ * This check is only important for heterogeneous systems where uclamp_min
+ * value is higher than the capacity of a @cpu. For non-heterogeneous system
+ * this function will always return true.
+ *
+ * The function will return true if the capacity of the @cpu is >= the
+ * uclamp_min and false otherwise.
+ *
+ * Note that uclamp_min will be clamped to uclamp_max if uclamp_min
+ * > uclamp_max.
+ */
+static bool rt_task_fits_capacity(struct task_struct *p, int cpu)
+{
+#ifdef CONFIG_UCLAMP_TASK
+	unsigned int min_cap, max_cap, cpu_cap;
+
+	/* Only heterogeneous systems can benefit from this check */
+	if (!static_branch_unlikely(&sched_asym_cpucapacity))
+		return true;
+
+	min_cap = uclamp_eff_value(p, UCLAMP_MIN);
+	max_cap = uclamp_eff_value(p, UCLAMP_MAX);
+
+	cpu_cap = arch_scale_cpu_capacity(NULL, cpu);
+
+	return cpu_cap >= min(min_cap, max_cap);
+#else
+	return true;
+#endif
+}
+
+/*
+ * Idle CPUs all run at the lowest priority, so waking up the one in the
+ * shallowest idle state gets the task running first. Prefer @cpu, most
+ * likely cache hot, on ties. Return -1 if @lowest_mask has no idle CPU.
+ */
+static int find_shallowest_idle_cpu(struct cpumask *lowest_mask, int cpu)
+{
+	unsigned int exit_latency, min_exit_latency = UINT_MAX;
+	struct cpuidle_state *idle;
+	int i, best_cpu = -1;
+
+	rcu_read_lock();
+	for_each_cpu(i, lowest_mask) {
+		if (!idle_cpu(i))
+			continue;
+
+		idle = idle_get_state(cpu_rq(i));
+		exit_latency = idle ? idle->exit_latency : 0;
+		if (exit_latency < min_exit_latency ||
+		    (exit_latency == min_exit_latency && i == cpu)) {
+			min_exit_latency = exit_latency;
+			best_cpu = i;
+		}
+	}
+	rcu_read_unlock();
+
+	return best_cpu;
+}
+
 static int find_lowest_rq(struct task_struct *task)
 {
 	struct sched_domain *sd;
 	struct cpumask *lowest_mask = this_cpu_cpumask_var_ptr(local_cpu_mask);
 	int this_cpu = smp_processor_id();
 	int cpu      = task_cpu(task);
+	int best_cpu;
 
 	/* Make sure the mask is initialized first */
 	if (unlikely(!lowest_mask))
@@ -1658,9 +1722,22 @@ static int find_lowest_rq(struct task_struct *task)
 	if (task->nr_cpus_allowed == 1)
 		return -1; /* No other targets possible */
 
-	if (!cpupri_find(&task_rq(task)->rd->cpupri, task, lowest_mask))
+	/*
+	 * If we're on asym system ensure we consider the different capacities
+	 * of the CPUs when searching for the lowest_mask.
+	 */
+	if (!cpupri_find_fitness(&task_rq(task)->rd->cpupri, task,
+				 lowest_mask, rt_task_fits_capacity))
 		return -1; /* No targets found */
 
+	/*
+	 * When the lowest priority CPUs are idle, pick the one which will
+	 * run the task first.
+	 */
+	best_cpu = find_shallowest_idle_cpu(lowest_mask, cpu);
+	if (best_cpu != -1)
+		return best_cpu;
+
 	/*
 	 * At this point we have built a mask of CPUs representing the
 	 * lowest priority tasks in the system.  Now we want to elect
@@ -1682,8 +1759,6 @@ static int find_lowest_rq(struct task_struct *task)
 	rcu_read_lock();
 	for_each_domain(cpu, sd) {
 		if (sd->flags & SD_WAKE_AFFINE) {
-			int best_cpu;
-
 			/*
 			 * "this_cpu" is cheaper to preempt than a
 			 * remote processor.
@@ -2409,6 +2484,10 @@ const struct sched_class rt_sched_class = {
 	.switched_to		= switched_to_rt,
 
 	.update_curr		= update_curr_rt,
+
+#ifdef CONFIG_UCLAMP_TASK
+	.uclamp_enabled		= 1,
+#endif
 };
 
 #ifdef CONFIG_RT_GROUP_SCHED
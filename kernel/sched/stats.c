@@ -10,7 +10,84 @@
  * Bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 15
+#define SCHEDSTAT_VERSION 16
+
+#ifdef CONFIG_CGROUP_SCHED_LAT_HIST
+static unsigned int sched_lat_hist_idx(u64 delta)
+{
+	u64 v = delta >> 10;
+	unsigned int msb, idx;
+
+	if (v < (1 << SCHED_LAT_HIST_SUB_BITS))
+		return v;
+
+	msb = fls64(v) - 1;
+	idx = ((msb - SCHED_LAT_HIST_SUB_BITS + 1) << SCHED_LAT_HIST_SUB_BITS) +
+	      ((v >> (msb - SCHED_LAT_HIST_SUB_BITS)) &
+	       ((1 << SCHED_LAT_HIST_SUB_BITS) - 1));
+
+	return min_t(unsigned int, idx, SCHED_LAT_HIST_BUCKETS - 1);
+}
+
+/* Smallest delay, in ns, accounted in bucket @idx */
+static u64 sched_lat_hist_floor(unsigned int idx)
+{
+	unsigned int sub = idx & ((1 << SCHED_LAT_HIST_SUB_BITS) - 1);
+	unsigned int shift = (idx >> SCHED_LAT_HIST_SUB_BITS) - 1;
+
+	if (idx < (1 << SCHED_LAT_HIST_SUB_BITS))
+		return (u64)idx << 10;
+
+	return (u64)((1 << SCHED_LAT_HIST_SUB_BITS) + sub) << (shift + 10);
+}
+
+/*
+ * Account @delta, the time @p waited on its rq, to the histograms of its
+ * task group and of all the ancestor groups but the root one.
+ *
+ * Called with the rq lock held from sched_info_arrive(), on the local CPU.
+ */
+void sched_lat_hist_account(struct task_struct *p, u64 delta, bool wakeup)
+{
+	unsigned int idx = sched_lat_hist_idx(delta);
+	struct task_group *tg;
+
+	for (tg = task_group(p); tg->parent; tg = tg->parent) {
+		struct sched_lat_hist *hist = this_cpu_ptr(tg->lat_hist);
+
+		if (wakeup)
+			hist->wakeup[idx]++;
+		hist->wait[idx]++;
+	}
+}
+
+/*
+ * One "<floor_ns> <count>" line per non empty bucket, in increasing order
+ * of latency.
+ */
+void sched_lat_hist_show(struct seq_file *sf, struct task_group *tg,
+			 bool wakeup)
+{
+	unsigned int idx;
+	u64 count;
+	int cpu;
+
+	for (idx = 0; idx < SCHED_LAT_HIST_BUCKETS; idx++) {
+		count = 0;
+		for_each_possible_cpu(cpu) {
+			struct sched_lat_hist *hist = per_cpu_ptr(tg->lat_hist,
+								  cpu);
+
+			count += wakeup ? READ_ONCE(hist->wakeup[idx]) :
+					  READ_ONCE(hist->wait[idx]);
+		}
+
+		if (count)
+			seq_printf(sf, "%llu %llu\n",
+				   sched_lat_hist_floor(idx), count);
+	}
+}
+#endif /* CONFIG_CGROUP_SCHED_LAT_HIST */
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
@@ -30,12 +107,13 @@ static int show_schedstat(struct seq_file *seq, void *v)
 
 		/* runqueue-specific stats */
 		seq_printf(seq,
-		    "cpu%d %u 0 %u %u %u %u %llu %llu %lu",
+		    "cpu%d %u 0 %u %u %u %u %llu %llu %lu %u %llu",
 		    cpu, rq->yld_count,
 		    rq->sched_count, rq->sched_goidle,
 		    rq->ttwu_count, rq->ttwu_local,
 		    rq->rq_cpu_time,
-		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcount);
+		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcount,
+		    rq->eas_count, rq->eas_time);
 
 		seq_printf(seq, "\n");
 
@@ -89,8 +89,12 @@ static void sched_info_arrive(struct rq *rq, struct task_struct *t)
 {
 	unsigned long long now = rq_clock(rq), delta = 0;
 
-	if (t->sched_info.last_queued)
+	if (t->sched_info.last_queued) {
 		delta = now - t->sched_info.last_queued;
+		if (schedstat_enabled())
+			sched_lat_hist_account(t, delta,
+					       t->sched_info.last_queued_wakeup);
+	}
 	sched_info_reset_dequeued(t);
 	t->sched_info.run_delay += delta;
 	t->sched_info.last_arrival = now;
@@ -104,11 +108,14 @@ static void sched_info_arrive(struct rq *rq, struct task_struct *t)
  * the timestamp if it is already not set.  It's assumed that
  * sched_info_dequeued() will clear that stamp when appropriate.
  */
-static inline void sched_info_queued(struct rq *rq, struct task_struct *t)
+static inline void
+sched_info_queued(struct rq *rq, struct task_struct *t, bool wakeup)
 {
 	if (unlikely(sched_info_on())) {
-		if (!t->sched_info.last_queued)
+		if (!t->sched_info.last_queued) {
 			t->sched_info.last_queued = rq_clock(rq);
+			t->sched_info.last_queued_wakeup = wakeup;
+		}
 	}
 }
 
@@ -127,7 +134,7 @@ static inline void sched_info_depart(struct rq *rq, struct task_struct *t)
 	rq_sched_info_depart(rq, delta);
 
 	if (t->state == TASK_RUNNING)
-		sched_info_queued(rq, t);
+		sched_info_queued(rq, t, false);
 }
 
 /*
@@ -158,7 +165,7 @@ sched_info_switch(struct rq *rq, struct task_struct *prev, struct task_struct *n
 }
 
 #else /* !CONFIG_SCHED_INFO: */
-# define sched_info_queued(rq, t)	do { } while (0)
+# define sched_info_queued(rq, t, w)	do { } while (0)
 # define sched_info_reset_dequeued(t)	do { } while (0)
 # define sched_info_dequeued(rq, t)	do { } while (0)
 # define sched_info_depart(rq, t)	do { } while (0)
@@ -51,6 +51,7 @@
 #include <linux/timer.h>
 #include <linux/freezer.h>
 #include <linux/compat.h>
+#include <linux/moduleparam.h>
 
 #include <linux/uaccess.h>
 
@@ -1725,6 +1726,42 @@ static long __sched hrtimer_nanosleep_restart(struct restart_block *restart)
 	return ret;
 }
 
+/*
+ * nanosleep() of tasks in a cpuset with timer_coalesce set gets at least
+ * coalesce_ns of slack, and expires on the last multiple of coalesce_ns
+ * of its clock within it.  The multiples being the same on all CPUs,
+ * the sleeps of such tasks end together rather than each waking an idle
+ * CPU up on its own.  Only sleeps asked for by user space are coalesced:
+ * the timeouts of kernel code keep their own slack.
+ */
+static unsigned int hrtimer_coalesce_ns __read_mostly = 4 * NSEC_PER_MSEC;
+module_param_named(coalesce_ns, hrtimer_coalesce_ns, uint, 0644);
+
+static u64 hrtimer_coalesce_slack(struct hrtimer *timer, ktime_t tim,
+				  u64 slack, const enum hrtimer_mode mode)
+{
+	unsigned int grid = READ_ONCE(hrtimer_coalesce_ns);
+	ktime_t soft = tim, hard;
+	u32 rem;
+
+	if (!grid || !task_timer_coalesce(current) ||
+	    dl_task(current) || rt_task(current))
+		return slack;
+
+	if (mode & HRTIMER_MODE_REL)
+		soft = ktime_add_safe(tim, timer->base->get_time());
+
+	hard = ktime_add_safe(soft, max_t(u64, slack, grid));
+	if (soft < 0 || hard == KTIME_MAX)
+		return slack;
+
+	div_u64_rem(hard, grid, &rem);
+	if (hard - rem < soft)
+		return slack;
+
+	return hard - rem - soft;
+}
+
 long hrtimer_nanosleep(const struct timespec64 *rqtp,
 		       const enum hrtimer_mode mode, const clockid_t clockid)
 {
@@ -1738,6 +1775,8 @@ long hrtimer_nanosleep(const struct timespec64 *rqtp,
 		slack = 0;
 
 	hrtimer_init_on_stack(&t.timer, clockid, mode);
+	slack = hrtimer_coalesce_slack(&t.timer, timespec64_to_ktime(*rqtp),
+				       slack, mode);
 	hrtimer_set_expires_range_ns(&t.timer, timespec64_to_ktime(*rqtp), slack);
 	ret = do_nanosleep(&t, mode);
 	if (ret != -ERESTART_RESTARTBLOCK)
@@ -24,7 +24,11 @@
 #include <linux/list.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/mm.h>
 
+#include <uapi/linux/trace_mmap.h>
+
+#include <asm/cacheflush.h>
 #include <asm/local.h>
 
 static void update_pages_handler(struct work_struct *work);
@@ -330,6 +334,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* index in the user mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -498,6 +503,12 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mapping of the buffer, see ring_buffer_map() */
+	struct mutex			mapping_lock;
+	unsigned long			*subbuf_ids;	/* data pages by id */
+	struct trace_buffer_meta	*meta_page;
+	int				mapped;
 };
 
 struct ring_buffer {
@@ -1280,6 +1291,7 @@ rb_allocate_cpu_buffer(struct ring_buffer *buffer, long nr_pages, int cpu)
 	init_irq_work(&cpu_buffer->irq_work.work, rb_wake_up_waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.full_waiters);
+	mutex_init(&cpu_buffer->mapping_lock);
 
 	bpage = kzalloc_node(ALIGN(sizeof(*bpage), cache_line_size()),
 			    GFP_KERNEL, cpu_to_node(cpu));
@@ -1713,16 +1725,18 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size,
 
 	size = nr_pages * BUF_PAGE_SIZE;
 
+	/* prevent another thread from changing buffer sizes */
+	mutex_lock(&buffer->mutex);
+
 	/*
 	 * Don't succeed if resizing is disabled, as a reader might be
 	 * manipulating the ring buffer and is expecting a sane state while
-	 * this is true.
+	 * this is true.  A mapping disables it under the mutex.
 	 */
-	if (atomic_read(&buffer->resize_disabled))
+	if (atomic_read(&buffer->resize_disabled)) {
+		mutex_unlock(&buffer->mutex);
 		return -EBUSY;
-
-	/* prevent another thread from changing buffer sizes */
-	mutex_lock(&buffer->mutex);
+	}
 
 	if (cpu_id == RING_BUFFER_ALL_CPUS) {
 		/* calculate the pages to update */
@@ -4346,6 +4360,29 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 	rb_head_page_activate(cpu_buffer);
 }
 
+/*
+ * Tell the user space reader about the events from @read to the reader
+ * position of the reader page, which it's been handed over.
+ */
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				unsigned read)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.lost_events = cpu_buffer->lost_events;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = read;
+	meta->reader.commit = cpu_buffer->reader_page->read;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	/* Some archs don't keep the user and kernel mappings coherent */
+	flush_dcache_page(virt_to_page(cpu_buffer->reader_page->page));
+	flush_dcache_page(virt_to_page(meta));
+}
+
 /**
  * ring_buffer_reset_cpu - reset a ring buffer per CPU buffer
  * @buffer: The ring buffer to reset a per cpu buffer of
@@ -4376,6 +4413,9 @@ void ring_buffer_reset_cpu(struct ring_buffer *buffer, int cpu)
 
 	arch_spin_unlock(&cpu_buffer->lock);
 
+	if (cpu_buffer->mapped)
+		rb_update_meta_page(cpu_buffer, 0);
+
  out:
 	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
 
@@ -4505,6 +4545,8 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	atomic_inc(&cpu_buffer_b->record_disabled);
 
 	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out_dec;
 	if (local_read(&cpu_buffer_a->committing))
 		goto out_dec;
 	if (local_read(&cpu_buffer_b->committing))
@@ -4705,7 +4747,8 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -4814,6 +4857,263 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/*
+ * Number the reader page and the pages of the ring, in the order the
+ * reader will find them, and record their data pages by number, which
+ * is the order they're mapped in after the meta page.
+ */
+static void rb_setup_ids(struct ring_buffer_per_cpu *cpu_buffer,
+			 unsigned long *subbuf_ids)
+{
+	struct buffer_page *first, *bpage;
+	unsigned id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first = bpage = rb_set_head_page(cpu_buffer);
+	if (RB_WARN_ON(cpu_buffer, !first))
+		return;
+	do {
+		if (RB_WARN_ON(cpu_buffer, id > cpu_buffer->nr_pages))
+			break;
+		subbuf_ids[id] = (unsigned long)bpage->page;
+		bpage->id = id++;
+		rb_inc_page(cpu_buffer, &bpage);
+	} while (bpage != first);
+}
+
+static int rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+		      struct vm_area_struct *vma)
+{
+	unsigned long nr_pages = cpu_buffer->nr_pages + 2;
+	unsigned long pgoff = vma->vm_pgoff;
+	unsigned long addr = vma->vm_start;
+	struct page *page;
+	int err;
+
+	/* Read-only, and shared so that the reader sees the writer */
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC) ||
+	    !(vma->vm_flags & VM_SHARED))
+		return -EPERM;
+
+	if (pgoff >= nr_pages || vma_pages(vma) > nr_pages - pgoff)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	for (; addr < vma->vm_end; addr += PAGE_SIZE, pgoff++) {
+		if (!pgoff)
+			page = virt_to_page(cpu_buffer->meta_page);
+		else
+			page = virt_to_page((void *)
+					    cpu_buffer->subbuf_ids[pgoff - 1]);
+
+		err = vm_insert_page(vma, addr, page);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ring_buffer_map - map a per cpu buffer into user space
+ * @buffer: The ring buffer the per cpu buffer is part of
+ * @cpu: The cpu of the per cpu buffer
+ * @vma: The read-only shared mapping to map it into
+ *
+ * Maps a page of struct trace_buffer_meta, followed by the data pages
+ * of the reader page and of the ring, into @vma.  The pages stay in
+ * place while mapped: the buffer can't be resized or swapped, and
+ * ring_buffer_read_page() copies the data out instead of swapping the
+ * reader page.  The reader calls ring_buffer_map_get_reader() to be
+ * handed over the next events, and reads them in place.
+ *
+ * Each call must be paired with ring_buffer_unmap().
+ *
+ * Returns 0 on success, or a negative errno.
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	void *meta;
+	int err;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (cpu_buffer->mapped) {
+		err = rb_map_vma(cpu_buffer, vma);
+		if (!err)
+			cpu_buffer->mapped++;
+		goto unlock;
+	}
+
+	err = -ENOMEM;
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!meta)
+		goto unlock;
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids)
+		goto free_meta;
+
+	/* The pages of the ring don't change from here on */
+	atomic_inc(&buffer->resize_disabled);
+	mutex_lock(&buffer->mutex);
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids(cpu_buffer, subbuf_ids);
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->meta_page->meta_page_size = PAGE_SIZE;
+	cpu_buffer->meta_page->meta_struct_len =
+		sizeof(struct trace_buffer_meta);
+	cpu_buffer->meta_page->subbuf_size = PAGE_SIZE;
+	cpu_buffer->meta_page->nr_subbufs = cpu_buffer->nr_pages + 1;
+	rb_update_meta_page(cpu_buffer, cpu_buffer->reader_page->read);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	mutex_unlock(&buffer->mutex);
+
+	err = rb_map_vma(cpu_buffer, vma);
+	if (!err)
+		goto unlock;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	atomic_dec(&buffer->resize_disabled);
+	kfree(subbuf_ids);
+ free_meta:
+	free_page((unsigned long)meta);
+ unlock:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_map_dup - account for a copy of a mapping
+ * @buffer: The ring buffer the per cpu buffer is part of
+ * @cpu: The cpu of the mapped per cpu buffer
+ *
+ * For the vm_operations open of a mapping ring_buffer_map() set up,
+ * which must then be paired with ring_buffer_unmap() as well.
+ */
+void ring_buffer_map_dup(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+	if (!WARN_ON(!cpu_buffer->mapped))
+		cpu_buffer->mapped++;
+	mutex_unlock(&cpu_buffer->mapping_lock);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_dup);
+
+/**
+ * ring_buffer_unmap - drop a mapping of a per cpu buffer
+ * @buffer: The ring buffer the per cpu buffer is part of
+ * @cpu: The cpu of the mapped per cpu buffer
+ *
+ * Once the last mapping is gone, the buffer can be resized and swapped
+ * again.
+ */
+void ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (WARN_ON(!cpu_buffer->mapped) || --cpu_buffer->mapped)
+		goto unlock;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	meta = cpu_buffer->meta_page;
+	subbuf_ids = cpu_buffer->subbuf_ids;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	atomic_dec(&buffer->resize_disabled);
+	kfree(subbuf_ids);
+	free_page((unsigned long)meta);
+ unlock:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - hand the next events over to the mapping
+ * @buffer: The ring buffer the per cpu buffer is part of
+ * @cpu: The cpu of the mapped per cpu buffer
+ *
+ * Consumes the events not read yet of the reader page, swapping the
+ * next page of the ring in first when the reader page has been read
+ * already, and tells the user space reader where to find them through
+ * the reader fields of the meta page.  The events stay in place until
+ * the next call.  When the buffer is empty, no events are handed over.
+ *
+ * Returns 0 on success, or -ENODEV if the buffer isn't mapped.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	unsigned long flags;
+	unsigned read;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out_unlock;
+	}
+
+	reader = rb_get_reader_page(cpu_buffer);
+	if (!reader) {
+		/* Nothing new, the reader page has been handed over */
+		read = cpu_buffer->reader_page->read;
+		goto out;
+	}
+
+	read = reader->read;
+	while (reader->read < rb_page_size(reader))
+		rb_advance_reader(cpu_buffer);
+ out:
+	rb_update_meta_page(cpu_buffer, read);
+	cpu_buffer->lost_events = 0;
+ out_unlock:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
@@ -218,6 +218,8 @@ struct trace_array {
 	struct trace_buffer	max_buffer;
 	bool			allocated_snapshot;
 #endif
+	/* mappings of trace_pipe_raw, which keep the buffers in place */
+	unsigned int		mapped;
 #if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER)
 	unsigned long		max_latency;
 #endif
@@ -994,6 +996,19 @@ void ftrace_init_tracefs_toplevel(struct trace_array *tr,
 void ftrace_clear_pids(struct trace_array *tr);
 int init_function_trace(void);
 void ftrace_pid_follow_fork(struct trace_array *tr, bool enable);
+
+extern u64 ftrace_sample_period;
+extern u64 ftrace_sample_interval;
+bool __ftrace_sample_call(unsigned long ip);
+
+/* Whether to trace this call of @ip, see function_sample_period */
+static __always_inline bool ftrace_sample_call(unsigned long ip)
+{
+	if (likely(READ_ONCE(ftrace_sample_period) <= 1 &&
+		   !READ_ONCE(ftrace_sample_interval)))
+		return true;
+	return __ftrace_sample_call(ip);
+}
 #else
 static inline int ftrace_trace_task(struct trace_array *tr)
 {
@@ -1015,6 +1030,7 @@ static inline void ftrace_init_tracefs_toplevel(struct trace_array *tr, struct d
 static inline void ftrace_clear_pids(struct trace_array *tr) { }
 static inline int init_function_trace(void) { return 0; }
 static inline void ftrace_pid_follow_fork(struct trace_array *tr, bool enable) { }
+static inline bool ftrace_sample_call(unsigned long ip) { return true; }
 /* ftace_func_t type is not defined, use macro instead of static inline */
 #define ftrace_init_array_ops(tr, func) do { } while (0)
 #endif /* CONFIG_FUNCTION_TRACER */
@@ -1269,6 +1285,7 @@ struct prog_entry;
 
 struct event_filter {
 	struct prog_entry __rcu	*prog;
+	struct bpf_prog		*bpf_prog;	/* prog compiled, if it was */
 	char			*filter_string;
 };
 
@@ -10,6 +10,7 @@
 #include <linux/mutex.h>
 #include <linux/perf_event.h>
 #include <linux/slab.h>
+#include <linux/filter.h>
 
 #include "trace.h"
 #include "trace_output.h"
@@ -893,6 +894,11 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 	if (!prog)
 		return 1;
 
+#ifdef CONFIG_BPF_JIT
+	if (filter->bpf_prog)
+		return BPF_PROG_RUN(filter->bpf_prog, rec);
+#endif
+
 	for (i = 0; prog[i].pred; i++) {
 		struct filter_pred *pred = prog[i].pred;
 		int match = pred->fn(pred, rec);
@@ -1012,6 +1018,10 @@ static void __free_filter(struct event_filter *filter)
 		return;
 
 	free_prog(filter);
+#ifdef CONFIG_BPF_JIT
+	if (filter->bpf_prog)
+		bpf_prog_free(filter->bpf_prog);
+#endif
 	kfree(filter->filter_string);
 	kfree(filter);
 }
@@ -1475,6 +1485,200 @@ static int calc_stack(const char *str, int *parens, int *preds, int *err)
 	return 0;
 }
 
+#ifdef CONFIG_BPF_JIT
+/*
+ * A filter made of numeric comparisons only is also compiled to eBPF,
+ * which the JIT turns into native code that filter_match_preds() runs
+ * instead of walking the program.  Anything else, or a JIT that's off
+ * or fails, leaves the filter to the walk.
+ *
+ * The compiled program takes the event record in R1, loads each field
+ * into R2 and its value into R3, and jumps where the walk would branch
+ * to: entry N of the program starts at label N, and labels n and n + 1
+ * return TRUE and FALSE.
+ */
+static bool filter_pred_compilable(struct filter_pred *pred)
+{
+	struct ftrace_event_field *field = pred->field;
+
+	if (!field || is_string_field(field) || is_function_field(field) ||
+	    field->filter_type == FILTER_CPU || pred->op == OP_GLOB)
+		return false;
+
+	return pred->fn == select_comparison_fn(pred->op, field->size,
+						field->is_signed);
+}
+
+/*
+ * Emit the code of @pred to @insn, if not NULL, ending with a jump @off
+ * past it when the result is @when_to_branch.  Returns its length.
+ */
+static int filter_emit_pred(struct bpf_insn *insn, struct filter_pred *pred,
+			    int when_to_branch, int off)
+{
+	struct ftrace_event_field *field = pred->field;
+	unsigned int shift = 64 - field->size * 8;
+	bool is_signed = field->is_signed;
+	u64 val = pred->val;
+	int size, jmp, n = 0;
+
+	switch (field->size) {
+	case 1:
+		size = BPF_B;
+		break;
+	case 2:
+		size = BPF_H;
+		break;
+	case 4:
+		size = BPF_W;
+		break;
+	default:
+		size = BPF_DW;
+		break;
+	}
+
+	/* Equality compares the unsigned bits, as filter_pred_64() does */
+	if (pred->op == OP_EQ || pred->op == OP_NE)
+		is_signed = false;
+
+	if (insn)
+		insn[n] = BPF_LDX_MEM(size, BPF_REG_2, BPF_REG_1, pred->offset);
+	n++;
+
+	/* Compare both sides as 64-bit values of the type of the field */
+	if (shift && is_signed) {
+		if (insn) {
+			insn[n] = BPF_ALU64_IMM(BPF_LSH, BPF_REG_2, shift);
+			insn[n + 1] = BPF_ALU64_IMM(BPF_ARSH, BPF_REG_2, shift);
+		}
+		n += 2;
+		val = (u64)((s64)(val << shift) >> shift);
+	} else if (shift) {
+		val &= (1ULL << (64 - shift)) - 1;
+	}
+
+	if (insn) {
+		struct bpf_insn ld[] = { BPF_LD_IMM64(BPF_REG_3, val) };
+
+		insn[n] = ld[0];
+		insn[n + 1] = ld[1];
+	}
+	n += 2;
+
+	switch (pred->op) {
+	case OP_EQ:
+	case OP_NE:
+		jmp = (when_to_branch ^ pred->not) ? BPF_JEQ : BPF_JNE;
+		break;
+	case OP_LT:
+		if (when_to_branch)
+			jmp = is_signed ? BPF_JSLT : BPF_JLT;
+		else
+			jmp = is_signed ? BPF_JSGE : BPF_JGE;
+		break;
+	case OP_LE:
+		if (when_to_branch)
+			jmp = is_signed ? BPF_JSLE : BPF_JLE;
+		else
+			jmp = is_signed ? BPF_JSGT : BPF_JGT;
+		break;
+	case OP_GT:
+		if (when_to_branch)
+			jmp = is_signed ? BPF_JSGT : BPF_JGT;
+		else
+			jmp = is_signed ? BPF_JSLE : BPF_JLE;
+		break;
+	case OP_GE:
+		if (when_to_branch)
+			jmp = is_signed ? BPF_JSGE : BPF_JGE;
+		else
+			jmp = is_signed ? BPF_JSLT : BPF_JLT;
+		break;
+	default:	/* OP_BAND */
+		if (when_to_branch) {
+			jmp = BPF_JSET;
+			break;
+		}
+		if (insn) {
+			insn[n] = BPF_ALU64_REG(BPF_AND, BPF_REG_2, BPF_REG_3);
+			insn[n + 1] = BPF_JMP_IMM(BPF_JEQ, BPF_REG_2, 0, off);
+		}
+		return n + 2;
+	}
+
+	if (insn)
+		insn[n] = BPF_JMP_REG(jmp, BPF_REG_2, BPF_REG_3, off);
+
+	return n + 1;
+}
+
+static struct bpf_prog *filter_compile_bpf(struct prog_entry *prog)
+{
+	struct bpf_prog *fp = NULL;
+	struct bpf_insn *insn;
+	unsigned int *label;
+	int i, n, len = 0;
+	int err;
+
+	if (!ebpf_jit_enabled())
+		return NULL;
+
+	for (n = 0; prog[n].pred; n++)
+		if (!filter_pred_compilable(prog[n].pred))
+			return NULL;
+
+	label = kcalloc(n + 2, sizeof(*label), GFP_KERNEL);
+	if (!label)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		label[i] = len;
+		len += filter_emit_pred(NULL, prog[i].pred,
+					prog[i].when_to_branch, 0);
+	}
+	label[n] = len;
+	label[n + 1] = len + 2;
+	len += 4;
+
+	/* Which also keeps the jumps within their 16-bit offsets */
+	if (len > BPF_MAXINSNS)
+		goto out;
+
+	fp = bpf_prog_alloc(bpf_prog_size(len), 0);
+	if (!fp)
+		goto out;
+
+	insn = fp->insnsi;
+	for (i = 0; i < n; i++) {
+		/* A branch to entry target goes on with the one after it */
+		int target = prog[i].target + 1;
+
+		if (WARN_ON_ONCE(target > n + 1)) {
+			__bpf_prog_free(fp);
+			fp = NULL;
+			goto out;
+		}
+		filter_emit_pred(insn + label[i], prog[i].pred,
+				 prog[i].when_to_branch,
+				 label[target] - label[i + 1]);
+	}
+	insn[label[n]] = BPF_MOV64_IMM(BPF_REG_0, 1);
+	insn[label[n] + 1] = BPF_EXIT_INSN();
+	insn[label[n + 1]] = BPF_MOV64_IMM(BPF_REG_0, 0);
+	insn[label[n + 1] + 1] = BPF_EXIT_INSN();
+	fp->len = len;
+
+	fp = bpf_prog_select_runtime(fp, &err);
+	if (err || !fp->jited) {
+		bpf_prog_free(fp);
+		fp = NULL;
+	}
+ out:
+	kfree(label);
+	return fp;
+}
+#endif /* CONFIG_BPF_JIT */
+
 static int process_preds(struct trace_event_call *call,
 			 const char *filter_string,
 			 struct event_filter *filter,
@@ -1510,6 +1714,9 @@ static int process_preds(struct trace_event_call *call,
 		return PTR_ERR(prog);
 
 	rcu_assign_pointer(filter->prog, prog);
+#ifdef CONFIG_BPF_JIT
+	filter->bpf_prog = filter_compile_bpf(prog);
+#endif
 	return 0;
 }
 
@@ -2163,6 +2370,14 @@ static void update_pred_fn(struct event_filter *filter, char *fields)
 						lockdep_is_held(&event_mutex));
 	int i;
 
+#ifdef CONFIG_BPF_JIT
+	/* Only the walk calls the test functions */
+	if (filter->bpf_prog) {
+		bpf_prog_free(filter->bpf_prog);
+		filter->bpf_prog = NULL;
+	}
+#endif
+
 	for (i = 0; prog[i].pred; i++) {
 		struct filter_pred *pred = prog[i].pred;
 		struct ftrace_event_field *field = pred->field;
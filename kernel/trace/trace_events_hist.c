@@ -220,6 +220,7 @@ enum hist_field_flags {
 	HIST_FIELD_FL_VAR_REF		= 1 << 14,
 	HIST_FIELD_FL_CPU		= 1 << 15,
 	HIST_FIELD_FL_ALIAS		= 1 << 16,
+	HIST_FIELD_FL_PERCENTILES	= 1 << 17,
 };
 
 struct var_defs {
@@ -238,6 +239,7 @@ struct hist_trigger_attrs {
 	bool		cont;
 	bool		clear;
 	bool		ts_in_usecs;
+	bool		percpu;
 	unsigned int	map_bits;
 
 	char		*assignment_str[TRACING_MAP_VARS_MAX];
@@ -1918,6 +1920,8 @@ static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
 			attrs->cont = true;
 		else if (strcmp(str, "clear") == 0)
 			attrs->clear = true;
+		else if (strcmp(str, "percpu") == 0)
+			attrs->percpu = true;
 		else {
 			ret = parse_action(str, attrs);
 			if (ret)
@@ -2052,6 +2056,8 @@ static const char *get_hist_field_flags(struct hist_field *hist_field)
 		flags_str = "log2";
 	else if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP_USECS)
 		flags_str = "usecs";
+	else if (hist_field->flags & HIST_FIELD_FL_PERCENTILES)
+		flags_str = "percentiles";
 
 	return flags_str;
 }
@@ -2476,6 +2482,8 @@ parse_field(struct hist_trigger_data *hist_data, struct trace_event_file *file,
 			*flags |= HIST_FIELD_FL_LOG2;
 		else if (strcmp(modifier, "usecs") == 0)
 			*flags |= HIST_FIELD_FL_TIMESTAMP_USECS;
+		else if (strcmp(modifier, "percentiles") == 0)
+			*flags |= HIST_FIELD_FL_PERCENTILES;
 		else {
 			hist_err("Invalid field modifier: ", modifier);
 			field = ERR_PTR(-EINVAL);
@@ -3974,6 +3982,14 @@ static int create_key_field(struct hist_trigger_data *hist_data,
 			goto out;
 		}
 
+		if (hist_field->flags & HIST_FIELD_FL_PERCENTILES) {
+			hist_err("Percentiles are only computed for values: ",
+				 field_str);
+			destroy_hist_field(hist_field, 0);
+			ret = -EINVAL;
+			goto out;
+		}
+
 		key_size = hist_field->size;
 	}
 
@@ -4493,7 +4509,10 @@ static int create_tracing_map_fields(struct hist_trigger_data *hist_data)
 			idx = tracing_map_add_key_field(map,
 							hist_field->offset,
 							cmp_fn);
-		} else if (!(hist_field->flags & HIST_FIELD_FL_VAR))
+		} else if (hist_field->flags & HIST_FIELD_FL_PERCENTILES &&
+			   !(hist_field->flags & HIST_FIELD_FL_VAR))
+			idx = tracing_map_add_hist_field(map);
+		else if (!(hist_field->flags & HIST_FIELD_FL_VAR))
 			idx = tracing_map_add_sum_field(map);
 
 		if (idx < 0)
@@ -4550,6 +4569,7 @@ create_hist_data(unsigned int map_bits,
 		hist_data->map = NULL;
 		goto free;
 	}
+	hist_data->map->percpu = attrs->percpu;
 
 	ret = create_tracing_map_fields(hist_data);
 	if (ret)
@@ -4587,7 +4607,10 @@ static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 			tracing_map_set_var(elt, var_idx, hist_val);
 			continue;
 		}
-		tracing_map_update_sum(elt, i, hist_val);
+		if (hist_field->flags & HIST_FIELD_FL_PERCENTILES)
+			tracing_map_update_hist(elt, i, hist_val);
+		else
+			tracing_map_update_sum(elt, i, hist_val);
 	}
 
 	for_each_hist_key_field(i, hist_data) {
@@ -4718,6 +4741,24 @@ static void hist_trigger_stacktrace_print(struct seq_file *m,
 	}
 }
 
+static const unsigned int hist_percentiles[] = { 50, 90, 99 };
+
+static void hist_trigger_percentiles_print(struct seq_file *m,
+					   const char *field_name,
+					   struct tracing_map_elt *elt,
+					   unsigned int idx)
+{
+	u64 vals[ARRAY_SIZE(hist_percentiles)];
+	unsigned int i;
+
+	tracing_map_read_percentiles(elt, idx, hist_percentiles, vals,
+				     ARRAY_SIZE(hist_percentiles));
+
+	for (i = 0; i < ARRAY_SIZE(hist_percentiles); i++)
+		seq_printf(m, "  %s.p%u: %10llu", field_name,
+			   hist_percentiles[i], vals[i]);
+}
+
 static void
 hist_trigger_entry_print(struct seq_file *m,
 			 struct hist_trigger_data *hist_data, void *key,
@@ -4815,6 +4856,9 @@ hist_trigger_entry_print(struct seq_file *m,
 			seq_printf(m, "  %s: %10llu", field_name,
 				   tracing_map_read_sum(elt, i));
 		}
+
+		if (hist_data->fields[i]->flags & HIST_FIELD_FL_PERCENTILES)
+			hist_trigger_percentiles_print(m, field_name, elt, i);
 	}
 
 	print_actions(m, hist_data, elt);
@@ -4864,8 +4908,8 @@ static void hist_trigger_show(struct seq_file *m,
 		n_entries = 0;
 
 	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
-		   (u64)atomic64_read(&hist_data->map->hits),
-		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+		   tracing_map_read_hits(hist_data->map),
+		   n_entries, tracing_map_read_drops(hist_data->map));
 }
 
 static int hist_show(struct seq_file *m, void *v)
@@ -5029,6 +5073,8 @@ static int event_hist_trigger_print(struct seq_file *m,
 			seq_puts(m, ".descending");
 	}
 	seq_printf(m, ":size=%u", (1 << hist_data->map->map_bits));
+	if (hist_data->map->percpu)
+		seq_puts(m, ":percpu");
 	if (hist_data->enable_timestamps)
 		seq_printf(m, ":clock=%s", hist_data->attrs->clock);
 
@@ -11,9 +11,12 @@
  *  Copyright (C) 2004 Nadia Yvette Chambers
  */
 #include <linux/ring_buffer.h>
+#include <linux/trace_clock.h>
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
 #include <linux/ftrace.h>
+#include <linux/percpu.h>
+#include <linux/hash.h>
 #include <linux/slab.h>
 #include <linux/fs.h>
 
@@ -34,6 +37,54 @@ enum {
 	TRACE_FUNC_OPT_STACK	= 0x1,
 };
 
+/*
+ * Sampling of the function and function_graph tracers: with
+ * function_sample_period set to N, only every Nth call of a function on
+ * a CPU is traced, and with function_sample_interval set to T, at most
+ * one call of a function per T nanoseconds on a CPU is.  The counts are
+ * kept per CPU in a small table indexed by a hash of the function's
+ * address, so functions which collide share their count.
+ */
+#define FTRACE_SAMPLE_BITS	9
+
+struct ftrace_sample {
+	unsigned long		count;
+	u64			last;
+};
+
+static DEFINE_PER_CPU(struct ftrace_sample [1 << FTRACE_SAMPLE_BITS],
+		      ftrace_samples);
+
+u64 __read_mostly ftrace_sample_period;
+u64 __read_mostly ftrace_sample_interval;
+
+bool __ftrace_sample_call(unsigned long ip)
+{
+	u64 period = READ_ONCE(ftrace_sample_period);
+	u64 interval = READ_ONCE(ftrace_sample_interval);
+	struct ftrace_sample *s;
+	bool ret = false;
+	u64 now;
+
+	preempt_disable_notrace();
+	s = this_cpu_ptr(&ftrace_samples[hash_long(ip, FTRACE_SAMPLE_BITS)]);
+
+	if (period > 1 && ++s->count < period)
+		goto out;
+	s->count = 0;
+
+	if (interval) {
+		now = trace_clock_local();
+		if (now - s->last < interval)
+			goto out;
+		s->last = now;
+	}
+	ret = true;
+ out:
+	preempt_enable_notrace();
+	return ret;
+}
+
 static int allocate_ftrace_ops(struct trace_array *tr)
 {
 	struct ftrace_ops *ops;
@@ -144,7 +195,7 @@ function_trace_call(unsigned long ip, unsigned long parent_ip,
 
 	cpu = smp_processor_id();
 	data = per_cpu_ptr(tr->trace_buffer.data, cpu);
-	if (!atomic_read(&data->disabled)) {
+	if (!atomic_read(&data->disabled) && ftrace_sample_call(ip)) {
 		local_save_flags(flags);
 		trace_function(tr, ip, parent_ip, flags, pc);
 	}
@@ -195,7 +246,7 @@ function_stack_trace_call(unsigned long ip, unsigned long parent_ip,
 	data = per_cpu_ptr(tr->trace_buffer.data, cpu);
 	disabled = atomic_inc_return(&data->disabled);
 
-	if (likely(disabled == 1)) {
+	if (likely(disabled == 1) && ftrace_sample_call(ip)) {
 		pc = preempt_count();
 		trace_function(tr, ip, parent_ip, flags, pc);
 		__trace_stack(tr, flags, STACK_SKIP, pc);
@@ -807,6 +858,62 @@ static inline int init_func_cmd_traceon(void)
 }
 #endif /* CONFIG_DYNAMIC_FTRACE */
 
+static ssize_t
+function_sample_write(struct file *filp, const char __user *ubuf, size_t cnt,
+		      loff_t *ppos)
+{
+	u64 *knob = filp->private_data;
+	u64 val;
+	int ret;
+
+	ret = kstrtoull_from_user(ubuf, cnt, 10, &val);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(*knob, val);
+
+	*ppos += cnt;
+
+	return cnt;
+}
+
+static ssize_t
+function_sample_read(struct file *filp, char __user *ubuf, size_t cnt,
+		     loff_t *ppos)
+{
+	u64 *knob = filp->private_data;
+	char buf[24]; /* More than enough to hold U64_MAX + "\n" */
+	int n;
+
+	n = sprintf(buf, "%llu\n", READ_ONCE(*knob));
+
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, n);
+}
+
+static const struct file_operations function_sample_fops = {
+	.open		= tracing_open_generic,
+	.write		= function_sample_write,
+	.read		= function_sample_read,
+	.llseek		= generic_file_llseek,
+};
+
+static __init int init_function_sample_tracefs(void)
+{
+	struct dentry *d_tracer;
+
+	d_tracer = tracing_init_dentry();
+	if (IS_ERR(d_tracer))
+		return 0;
+
+	trace_create_file("function_sample_period", 0644, d_tracer,
+			  &ftrace_sample_period, &function_sample_fops);
+	trace_create_file("function_sample_interval", 0644, d_tracer,
+			  &ftrace_sample_interval, &function_sample_fops);
+
+	return 0;
+}
+fs_initcall(init_function_sample_tracefs);
+
 __init int init_function_trace(void)
 {
 	init_func_cmd_traceon();
@@ -412,6 +412,15 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	if (!ftrace_trace_task(tr))
 		return 0;
 
+	/*
+	 * Sample before set_graph_function is looked at, so an unsampled
+	 * call does not leave it marked as traced, and trace everything
+	 * nested in a sampled one.
+	 */
+	if (!trace_recursion_test(TRACE_GRAPH_BIT) &&
+	    !ftrace_sample_call(trace->func))
+		return 0;
+
 	if (ftrace_graph_ignore_func(trace))
 		return 0;
 
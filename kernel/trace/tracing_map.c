@@ -15,6 +15,7 @@
 #include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/sort.h>
+#include <linux/percpu.h>
 
 #include "tracing_map.h"
 #include "trace.h"
@@ -37,7 +38,69 @@
  */
 void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
 {
-	atomic64_add(n, &elt->fields[i].sum);
+	if (elt->map->percpu)
+		this_cpu_add(elt->percpu_sums[i], n);
+	else
+		atomic64_add(n, &elt->fields[i].sum);
+}
+
+static unsigned int tracing_map_hist_bucket(u64 n)
+{
+	unsigned int msb;
+
+	if (n < (1 << TRACING_MAP_HIST_SUB_BITS))
+		return n;
+
+	msb = fls64(n) - 1;
+
+	return ((msb - TRACING_MAP_HIST_SUB_BITS + 1) <<
+		TRACING_MAP_HIST_SUB_BITS) |
+		((n >> (msb - TRACING_MAP_HIST_SUB_BITS)) &
+		 ((1 << TRACING_MAP_HIST_SUB_BITS) - 1));
+}
+
+/* The largest value counted in bucket b */
+static u64 tracing_map_hist_bucket_max(unsigned int b)
+{
+	unsigned int sub = b & ((1 << TRACING_MAP_HIST_SUB_BITS) - 1);
+	unsigned int shift = (b >> TRACING_MAP_HIST_SUB_BITS) - 1;
+	u64 base;
+
+	if (b < (1 << TRACING_MAP_HIST_SUB_BITS))
+		return b;
+
+	base = (u64)((1 << TRACING_MAP_HIST_SUB_BITS) | sub) << shift;
+
+	return base + ((1ULL << shift) - 1);
+}
+
+/**
+ * tracing_map_update_hist - Add a value to a tracing_map_elt's hist field
+ * @elt: The tracing_map_elt
+ * @i: The index of the given hist field associated with the tracing_map_elt
+ * @n: The value to add to the sum and to count in the histogram
+ *
+ * Add n to sum i associated with the specified tracing_map_elt
+ * instance, as tracing_map_update_sum() does, and count n in the
+ * histogram of the field.  The index i is the index returned by the
+ * call to tracing_map_add_hist_field() when the tracing map was set
+ * up.
+ */
+void tracing_map_update_hist(struct tracing_map_elt *elt, unsigned int i, u64 n)
+{
+	struct tracing_map *map = elt->map;
+	unsigned int b;
+
+	b = map->hist_idx[i] * TRACING_MAP_HIST_BUCKETS +
+		tracing_map_hist_bucket(n);
+
+	if (map->percpu) {
+		this_cpu_add(elt->percpu_sums[i], n);
+		this_cpu_inc(elt->percpu_hists[b]);
+	} else {
+		atomic64_add(n, &elt->fields[i].sum);
+		atomic64_inc(&elt->hists[b]);
+	}
 }
 
 /**
@@ -54,7 +117,110 @@ void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
  */
 u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i)
 {
-	return (u64)atomic64_read(&elt->fields[i].sum);
+	u64 sum = 0;
+	int cpu;
+
+	if (!elt->map->percpu)
+		return (u64)atomic64_read(&elt->fields[i].sum);
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(elt->percpu_sums, cpu)[i];
+
+	return sum;
+}
+
+static u64 tracing_map_read_bucket(struct tracing_map_elt *elt,
+				   unsigned int b)
+{
+	u64 count = 0;
+	int cpu;
+
+	if (!elt->map->percpu)
+		return (u64)atomic64_read(&elt->hists[b]);
+
+	for_each_possible_cpu(cpu)
+		count += per_cpu_ptr(elt->percpu_hists, cpu)[b];
+
+	return count;
+}
+
+/**
+ * tracing_map_read_percentiles - Return percentiles of a hist field
+ * @elt: The tracing_map_elt
+ * @i: The index of the given hist field associated with the tracing_map_elt
+ * @pcts: The percentiles to compute, in ascending order
+ * @vals: outval: the value of each of the @pcts percentiles
+ * @n: The number of @pcts and @vals
+ *
+ * Compute the values below which the given percentages of the values
+ * counted in hist field i of the specified tracing_map_elt instance
+ * fall.  Each value is the upper bound of the histogram bucket the
+ * percentile falls into, so it may exceed the exact percentile by up
+ * to a fourth.  The values are 0 if nothing was counted yet.
+ */
+void tracing_map_read_percentiles(struct tracing_map_elt *elt,
+				  unsigned int i, const unsigned int *pcts,
+				  u64 *vals, unsigned int n)
+{
+	unsigned int first = elt->map->hist_idx[i] * TRACING_MAP_HIST_BUCKETS;
+	unsigned int b, p = 0;
+	u64 total = 0, count = 0;
+
+	for (b = 0; b < TRACING_MAP_HIST_BUCKETS; b++)
+		total += tracing_map_read_bucket(elt, first + b);
+
+	for (b = 0; b < TRACING_MAP_HIST_BUCKETS && p < n; b++) {
+		count += tracing_map_read_bucket(elt, first + b);
+		if (!count)
+			continue;
+
+		while (p < n && count * 100 >= total * pcts[p])
+			vals[p++] = tracing_map_hist_bucket_max(b);
+	}
+
+	while (p < n)
+		vals[p++] = 0;
+}
+
+/**
+ * tracing_map_read_hits - Return the number of hits of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: the number of successful insertions and retrievals, see
+ * tracing_map_insert().
+ */
+u64 tracing_map_read_hits(struct tracing_map *map)
+{
+	u64 hits = 0;
+	int cpu;
+
+	if (!map->percpu)
+		return (u64)atomic64_read(&map->hits);
+
+	for_each_possible_cpu(cpu)
+		hits += *per_cpu_ptr(map->percpu_hits, cpu);
+
+	return hits;
+}
+
+/**
+ * tracing_map_read_drops - Return the number of drops of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: the number of failed insertions, see tracing_map_insert().
+ */
+u64 tracing_map_read_drops(struct tracing_map *map)
+{
+	u64 drops = 0;
+	int cpu;
+
+	if (!map->percpu)
+		return (u64)atomic64_read(&map->drops);
+
+	for_each_possible_cpu(cpu)
+		drops += *per_cpu_ptr(map->percpu_drops, cpu);
+
+	return drops;
 }
 
 /**
@@ -228,6 +394,30 @@ int tracing_map_add_sum_field(struct tracing_map *map)
 	return tracing_map_add_field(map, tracing_map_cmp_atomic64);
 }
 
+/**
+ * tracing_map_add_hist_field - Add a sum field with a histogram of values
+ * @map: The tracing_map
+ *
+ * Add a sum field to the key and return the index identifying it in
+ * the map and associated tracing_map_elts, as
+ * tracing_map_add_sum_field() does.  The values the field is updated
+ * with via tracing_map_update_hist() are also counted in a log-linear
+ * histogram, from which tracing_map_read_percentiles() computes
+ * percentiles.
+ *
+ * Return: The index identifying the field in the map and associated
+ * tracing_map_elts, or -EINVAL on error.
+ */
+int tracing_map_add_hist_field(struct tracing_map *map)
+{
+	int ret = tracing_map_add_sum_field(map);
+
+	if (ret >= 0)
+		map->hist_idx[ret] = map->n_hists++;
+
+	return ret;
+}
+
 /**
  * tracing_map_add_var - Add a field describing a tracing_map var
  * @map: The tracing_map
@@ -360,6 +550,23 @@ static void tracing_map_elt_clear(struct tracing_map_elt *elt)
 		if (elt->fields[i].cmp_fn == tracing_map_cmp_atomic64)
 			atomic64_set(&elt->fields[i].sum, 0);
 
+	if (elt->map->percpu) {
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			memset(per_cpu_ptr(elt->percpu_sums, cpu), 0,
+			       elt->map->n_fields * sizeof(u64));
+			if (elt->percpu_hists)
+				memset(per_cpu_ptr(elt->percpu_hists, cpu), 0,
+				       elt->map->n_hists *
+				       TRACING_MAP_HIST_BUCKETS * sizeof(u64));
+		}
+	} else {
+		for (i = 0; i < elt->map->n_hists * TRACING_MAP_HIST_BUCKETS;
+		     i++)
+			atomic64_set(&elt->hists[i], 0);
+	}
+
 	for (i = 0; i < elt->map->n_vars; i++) {
 		atomic64_set(&elt->vars[i], 0);
 		elt->var_set[i] = false;
@@ -393,6 +600,9 @@ static void tracing_map_elt_free(struct tracing_map_elt *elt)
 	kfree(elt->fields);
 	kfree(elt->vars);
 	kfree(elt->var_set);
+	free_percpu(elt->percpu_sums);
+	kvfree(elt->hists);
+	free_percpu(elt->percpu_hists);
 	kfree(elt->key);
 	kfree(elt);
 }
@@ -432,6 +642,33 @@ static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
 		goto free;
 	}
 
+	if (map->percpu) {
+		elt->percpu_sums = __alloc_percpu(map->n_fields * sizeof(u64),
+						  __alignof__(u64));
+		if (!elt->percpu_sums) {
+			err = -ENOMEM;
+			goto free;
+		}
+	}
+
+	if (map->n_hists && map->percpu) {
+		elt->percpu_hists = __alloc_percpu(map->n_hists *
+						   TRACING_MAP_HIST_BUCKETS *
+						   sizeof(u64),
+						   __alignof__(u64));
+		if (!elt->percpu_hists) {
+			err = -ENOMEM;
+			goto free;
+		}
+	} else if (map->n_hists) {
+		elt->hists = kvcalloc(map->n_hists * TRACING_MAP_HIST_BUCKETS,
+				      sizeof(*elt->hists), GFP_KERNEL);
+		if (!elt->hists) {
+			err = -ENOMEM;
+			goto free;
+		}
+	}
+
 	tracing_map_elt_init_fields(elt);
 
 	if (map->ops && map->ops->elt_alloc) {
@@ -509,6 +746,22 @@ static inline bool keys_match(void *key, void *test_key, unsigned key_size)
 	return match;
 }
 
+static inline void tracing_map_inc_hits(struct tracing_map *map)
+{
+	if (map->percpu)
+		this_cpu_inc(*map->percpu_hits);
+	else
+		atomic64_inc(&map->hits);
+}
+
+static inline void tracing_map_inc_drops(struct tracing_map *map)
+{
+	if (map->percpu)
+		this_cpu_inc(*map->percpu_drops);
+	else
+		atomic64_inc(&map->drops);
+}
+
 static inline struct tracing_map_elt *
 __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 {
@@ -532,7 +785,7 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 			if (val &&
 			    keys_match(key, val->key, map->key_size)) {
 				if (!lookup_only)
-					atomic64_inc(&map->hits);
+					tracing_map_inc_hits(map);
 				return val;
 			} else if (unlikely(!val)) {
 				/*
@@ -549,7 +802,7 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 
 				dup_try++;
 				if (dup_try > map->map_size) {
-					atomic64_inc(&map->drops);
+					tracing_map_inc_drops(map);
 					break;
 				}
 				continue;
@@ -565,14 +818,14 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 
 				elt = get_free_elt(map);
 				if (!elt) {
-					atomic64_inc(&map->drops);
+					tracing_map_inc_drops(map);
 					entry->key = 0;
 					break;
 				}
 
 				memcpy(elt->key, key, map->key_size);
 				entry->val = elt;
-				atomic64_inc(&map->hits);
+				tracing_map_inc_hits(map);
 
 				return entry->val;
 			} else {
@@ -673,6 +926,8 @@ void tracing_map_destroy(struct tracing_map *map)
 	tracing_map_free_elts(map);
 
 	tracing_map_array_free(map->map);
+	free_percpu(map->percpu_hits);
+	free_percpu(map->percpu_drops);
 	kfree(map);
 }
 
@@ -695,6 +950,15 @@ void tracing_map_clear(struct tracing_map *map)
 	atomic64_set(&map->hits, 0);
 	atomic64_set(&map->drops, 0);
 
+	if (map->percpu) {
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			*per_cpu_ptr(map->percpu_hits, cpu) = 0;
+			*per_cpu_ptr(map->percpu_drops, cpu) = 0;
+		}
+	}
+
 	tracing_map_array_clear(map->map);
 
 	for (i = 0; i < map->max_elts; i++)
@@ -790,6 +1054,8 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 	map->key_size = key_size;
 	for (i = 0; i < TRACING_MAP_KEYS_MAX; i++)
 		map->key_idx[i] = -1;
+	for (i = 0; i < TRACING_MAP_FIELDS_MAX; i++)
+		map->hist_idx[i] = -1;
  out:
 	return map;
  free:
@@ -825,6 +1091,13 @@ int tracing_map_init(struct tracing_map *map)
 	if (map->n_fields < 2)
 		return -EINVAL; /* need at least 1 key and 1 val */
 
+	if (map->percpu) {
+		map->percpu_hits = alloc_percpu(u64);
+		map->percpu_drops = alloc_percpu(u64);
+		if (!map->percpu_hits || !map->percpu_drops)
+			return -ENOMEM;
+	}
+
 	err = tracing_map_alloc_elts(map);
 	if (err)
 		return err;
@@ -931,6 +1204,17 @@ void tracing_map_destroy_sort_entries(struct tracing_map_sort_entry **entries,
 	vfree(entries);
 }
 
+/* Add up the per-cpu sums of elt into the sums the sort compares */
+static void tracing_map_elt_fold_sums(struct tracing_map_elt *elt)
+{
+	unsigned int i;
+
+	for (i = 0; i < elt->map->n_fields; i++)
+		if (elt->fields[i].cmp_fn == tracing_map_cmp_atomic64)
+			atomic64_set(&elt->fields[i].sum,
+				     tracing_map_read_sum(elt, i));
+}
+
 static struct tracing_map_sort_entry *
 create_sort_entry(void *key, struct tracing_map_elt *elt)
 {
@@ -1078,6 +1362,9 @@ int tracing_map_sort_entries(struct tracing_map *map,
 		if (!entry->key || !entry->val)
 			continue;
 
+		if (map->percpu)
+			tracing_map_elt_fold_sums(entry->val);
+
 		entries[n_entries] = create_sort_entry(entry->val->key,
 						       entry->val);
 		if (!entries[n_entries++]) {
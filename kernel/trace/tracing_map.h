@@ -13,6 +13,16 @@
 #define TRACING_MAP_VARS_MAX		16
 #define TRACING_MAP_SORT_KEYS_MAX	2
 
+/*
+ * Histogram fields count their values in log-linear buckets: values
+ * below 1 << TRACING_MAP_HIST_SUB_BITS have a bucket each, and every
+ * larger power of two range is split in 1 << TRACING_MAP_HIST_SUB_BITS
+ * buckets, bounding the error of a percentile to 25% of its value.
+ */
+#define TRACING_MAP_HIST_SUB_BITS	2
+#define TRACING_MAP_HIST_BUCKETS	\
+	((64 - TRACING_MAP_HIST_SUB_BITS + 1) << TRACING_MAP_HIST_SUB_BITS)
+
 typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
 
 /*
@@ -95,6 +105,20 @@ typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
  * tracing_map_elts is allocated as a single block and is stored in
  * the elts field of struct tracing_map.
  *
+ * A map whose 'percpu' field is set before tracing_map_init() gives
+ * each tracing_map_elt a per-cpu copy of its sums (percpu_sums), and
+ * counts its hits and drops per cpu as well, so that frequent events
+ * hitting the same key from many cpus don't bounce the cachelines of
+ * shared atomic counters.  Keys are still inserted once into the
+ * shared tracing_map_entry array, which after the first hit is only
+ * read.  The per-cpu sums are added up when read, and folded into the
+ * 'sum' of each field before sorting.
+ *
+ * Sum fields added with tracing_map_add_hist_field() additionally
+ * count the values they're updated with in TRACING_MAP_HIST_BUCKETS
+ * log-linear buckets, per cpu in a per-cpu map, which is what
+ * tracing_map_read_percentiles() computes percentiles from.
+ *
  * There is also a set of structures used for sorting that might
  * benefit from some minimal explanation.
  *
@@ -142,6 +166,9 @@ struct tracing_map_elt {
 	bool				*var_set;
 	void				*key;
 	void				*private_data;
+	u64 __percpu			*percpu_sums;
+	atomic64_t			*hists;
+	u64 __percpu			*percpu_hists;
 };
 
 struct tracing_map_entry {
@@ -196,8 +223,13 @@ struct tracing_map {
 	unsigned int			n_keys;
 	struct tracing_map_sort_key	sort_key;
 	unsigned int			n_vars;
+	int				hist_idx[TRACING_MAP_FIELDS_MAX];
+	unsigned int			n_hists;
+	bool				percpu;
 	atomic64_t			hits;
 	atomic64_t			drops;
+	u64 __percpu			*percpu_hits;
+	u64 __percpu			*percpu_drops;
 };
 
 /**
@@ -245,6 +277,7 @@ tracing_map_create(unsigned int map_bits,
 extern int tracing_map_init(struct tracing_map *map);
 
 extern int tracing_map_add_sum_field(struct tracing_map *map);
+extern int tracing_map_add_hist_field(struct tracing_map *map);
 extern int tracing_map_add_var(struct tracing_map *map);
 extern int tracing_map_add_key_field(struct tracing_map *map,
 				     unsigned int offset,
@@ -265,10 +298,18 @@ extern int tracing_map_cmp_none(void *val_a, void *val_b);
 
 extern void tracing_map_update_sum(struct tracing_map_elt *elt,
 				   unsigned int i, u64 n);
+extern void tracing_map_update_hist(struct tracing_map_elt *elt,
+				    unsigned int i, u64 n);
 extern void tracing_map_set_var(struct tracing_map_elt *elt,
 				unsigned int i, u64 n);
 extern bool tracing_map_var_set(struct tracing_map_elt *elt, unsigned int i);
 extern u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i);
+extern void tracing_map_read_percentiles(struct tracing_map_elt *elt,
+					 unsigned int i,
+					 const unsigned int *pcts,
+					 u64 *vals, unsigned int n);
+extern u64 tracing_map_read_hits(struct tracing_map *map);
+extern u64 tracing_map_read_drops(struct tracing_map *map);
 extern u64 tracing_map_read_var(struct tracing_map_elt *elt, unsigned int i);
 extern u64 tracing_map_read_var_once(struct tracing_map_elt *elt, unsigned int i);
 
@@ -121,7 +121,17 @@ const struct raid6_recov_calls *const raid6_recov_algos[] = {
 	NULL
 };
 
+/*
+ * The gen_syndrome() implementation to use instead of benchmarking them all
+ * at boot, as in raid6_pq.algo=neonx4.  It reads back as the one in use,
+ * to be given on the next boots.
+ */
+static char raid6_algo[16];
+
 #ifdef __KERNEL__
+module_param_string(algo, raid6_algo, sizeof(raid6_algo), 0444);
+MODULE_PARM_DESC(algo, "gen_syndrome() implementation to use without benchmarking");
+
 #define RAID6_TIME_JIFFIES_LG2	4
 #else
 /* Need more time to be stable in userspace */
@@ -158,6 +168,22 @@ static inline const struct raid6_calls *raid6_choose_gen(
 	const struct raid6_calls *const *algo;
 	const struct raid6_calls *best;
 
+	if (raid6_algo[0]) {
+		for (algo = raid6_algos; *algo; algo++) {
+			if (strcmp((*algo)->name, raid6_algo))
+				continue;
+			if ((*algo)->valid && !(*algo)->valid())
+				break;
+
+			pr_info("raid6: using algorithm %s, as asked for\n",
+				(*algo)->name);
+			raid6_call = **algo;
+			return *algo;
+		}
+		pr_err("raid6: algorithm %s is not usable, benchmarking\n",
+		       raid6_algo);
+	}
+
 	for (bestgenperf = 0, bestxorperf = 0, best = NULL, algo = raid6_algos; *algo; algo++) {
 		if (!best || (*algo)->prefer >= best->prefer) {
 			if ((*algo)->valid && !(*algo)->valid())
@@ -216,6 +242,7 @@ static inline const struct raid6_calls *raid6_choose_gen(
 			pr_info("raid6: .... xor() %ld MB/s, rmw enabled\n",
 			       (bestxorperf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2+1));
 		raid6_call = *best;
+		snprintf(raid6_algo, sizeof(raid6_algo), "%s", best->name);
 	} else
 		pr_err("raid6: Yikes!  No algorithm found!\n");
 
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Pools of zstd workspaces
+ *
+ * The contexts and digested dictionaries of zstd are emplaced into large
+ * workspaces given by their users, which users compressing small blocks
+ * would otherwise allocate and free around every call.  An idle workspace
+ * keeps the list_head linking it in the pool in its first bytes, which
+ * the next context initialized in it overwrites.
+ */
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/zstd.h>
+
+struct ZSTD_wsPool_s {
+	spinlock_t lock;
+	struct list_head idle;
+	unsigned int nrIdle;
+	unsigned int maxIdle;
+	size_t workspaceSize;
+};
+
+ZSTD_wsPool *ZSTD_createWsPool(size_t workspaceSize, unsigned int maxIdle)
+{
+	ZSTD_wsPool *pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+
+	if (!pool)
+		return NULL;
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->idle);
+	pool->maxIdle = maxIdle;
+	pool->workspaceSize = max(workspaceSize, sizeof(struct list_head));
+	return pool;
+}
+
+void ZSTD_freeWsPool(ZSTD_wsPool *pool)
+{
+	struct list_head *ws, *next;
+
+	if (!pool)
+		return;
+	list_for_each_safe(ws, next, &pool->idle)
+		kvfree(ws);
+	kfree(pool);
+}
+
+size_t ZSTD_wsPoolWorkspaceSize(const ZSTD_wsPool *pool)
+{
+	return pool->workspaceSize;
+}
+
+void *ZSTD_getWorkspace(ZSTD_wsPool *pool, gfp_t gfp)
+{
+	struct list_head *ws = NULL;
+
+	spin_lock(&pool->lock);
+	if (!list_empty(&pool->idle)) {
+		ws = pool->idle.next;
+		list_del(ws);
+		pool->nrIdle--;
+	}
+	spin_unlock(&pool->lock);
+
+	if (!ws)
+		ws = kvmalloc(pool->workspaceSize, gfp);
+	return ws;
+}
+
+void ZSTD_putWorkspace(ZSTD_wsPool *pool, void *workspace)
+{
+	struct list_head *ws = workspace;
+
+	spin_lock(&pool->lock);
+	if (pool->nrIdle < pool->maxIdle) {
+		list_add(ws, &pool->idle);
+		pool->nrIdle++;
+		ws = NULL;
+	}
+	spin_unlock(&pool->lock);
+
+	kvfree(ws);
+}
+
+EXPORT_SYMBOL(ZSTD_createWsPool);
+EXPORT_SYMBOL(ZSTD_freeWsPool);
+EXPORT_SYMBOL(ZSTD_wsPoolWorkspaceSize);
+EXPORT_SYMBOL(ZSTD_getWorkspace);
+EXPORT_SYMBOL(ZSTD_putWorkspace);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Zstd Workspace Pools");
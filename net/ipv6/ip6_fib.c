@@ -89,6 +89,10 @@ static void fib6_walker_unlink(struct net *net, struct fib6_walker *w)
 	write_unlock_bh(&net->ipv6.fib6_walker_lock);
 }
 
+/* Called after the change of the trees it stands for: the cmpxchg is
+ * fully ordered, so it releases the change to the lookups that acquire
+ * the new sernum in fib6_cached_lookup().
+ */
 static int fib6_new_sernum(struct net *net)
 {
 	int new, old;
@@ -1206,7 +1210,6 @@ int fib6_add(struct fib6_node *root, struct fib6_info *rt,
 	int err = -ENOMEM;
 	int allow_create = 1;
 	int replace_required = 0;
-	int sernum = fib6_new_sernum(info->nl_net);
 
 	if (info->nlh) {
 		if (!(info->nlh->nlmsg_flags & NLM_F_CREATE))
@@ -1304,7 +1307,8 @@ int fib6_add(struct fib6_node *root, struct fib6_info *rt,
 
 	err = fib6_add_rt2node(fn, rt, info, extack);
 	if (!err) {
-		__fib6_update_sernum_upto_root(rt, sernum);
+		/* Only now that rt is linked, see fib6_new_sernum() */
+		fib6_update_sernum_upto_root(info->nl_net, rt);
 		fib6_start_gc(info->nl_net, rt);
 	}
 
@@ -1731,6 +1735,8 @@ static void fib6_del_route(struct fib6_table *table, struct fib6_node *fn,
 	/* Unlink it */
 	*rtp = rt->fib6_next;
 	rt->fib6_node = NULL;
+	/* Invalidates the lookups cached by ip6_pol_route() */
+	fib6_new_sernum(net);
 	net->ipv6.rt6_stats->fib_rt_entries--;
 	net->ipv6.rt6_stats->fib_discarded_routes++;
 
@@ -1856,6 +1856,91 @@ struct fib6_info *fib6_table_lookup(struct net *net, struct fib6_table *table,
 	return f6i;
 }
 
+/* A per-cpu cache of the fib6_table_lookup() results of ip6_pol_route(),
+ * keyed by the lookup arguments.  Each change of the fib6 trees, routes
+ * added, deleted or changed state, gives a new net->ipv6.fib6_sernum and
+ * so invalidates all the entries of the netns, like it does for the dsts
+ * cached by sockets.  Lookups which ask for a reachable router, as those
+ * of hosts do, bypass the cache: rt6_select() has to probe the routers
+ * and round robin between them on each of them.  The sernum is read
+ * before the lookup, and an unchanged sernum means the route was not
+ * unlinked, so the entries need no reference: they are only used under
+ * RCU.
+ */
+#define FIB6_LOOKUP_CACHE_BITS	6
+#define FIB6_LOOKUP_CACHE_SIZE	(1 << FIB6_LOOKUP_CACHE_BITS)
+
+struct fib6_lookup_cache_entry {
+	struct in6_addr		daddr;
+	struct in6_addr		saddr;
+	struct fib6_table	*table;
+	struct fib6_info	*f6i;
+	int			oif;
+	int			strict;
+	int			sernum;
+};
+
+struct fib6_lookup_cache {
+	struct fib6_lookup_cache_entry entries[FIB6_LOOKUP_CACHE_SIZE];
+};
+
+/* must be called with rcu lock held */
+static struct fib6_info *fib6_cached_lookup(struct net *net,
+					    struct fib6_table *table,
+					    int oif, struct flowi6 *fl6,
+					    int strict)
+{
+	struct fib6_lookup_cache_entry *e;
+	struct fib6_info *f6i;
+	int sernum;
+	u32 hash;
+
+	if (strict & RT6_LOOKUP_F_REACHABLE)
+		return fib6_table_lookup(net, table, oif, fl6, strict);
+
+	/* Key on the oif fib6_table_lookup() actually matches against */
+	if (fl6->flowi6_flags & FLOWI_FLAG_SKIP_NH_OIF)
+		oif = 0;
+
+	hash = jhash_3words(ipv6_addr_hash(&fl6->daddr),
+			    ipv6_addr_hash(&fl6->saddr),
+			    oif ^ table->tb6_id, strict);
+	/* Pairs with the cmpxchg in fib6_new_sernum() */
+	sernum = atomic_read_acquire(&net->ipv6.fib6_sernum);
+
+	local_bh_disable();
+	e = &this_cpu_ptr(net->ipv6.fib6_lookup_cache)->entries[
+		hash_32(hash, FIB6_LOOKUP_CACHE_BITS)];
+	if (e->sernum == sernum && e->table == table && e->oif == oif &&
+	    e->strict == strict &&
+	    ipv6_addr_equal(&e->daddr, &fl6->daddr) &&
+	    ipv6_addr_equal(&e->saddr, &fl6->saddr) &&
+	    !fib6_check_expired(e->f6i)) {
+		f6i = e->f6i;
+		local_bh_enable();
+		return f6i;
+	}
+	local_bh_enable();
+
+	f6i = fib6_table_lookup(net, table, oif, fl6, strict);
+	if (f6i == net->ipv6.fib6_null_entry)
+		return f6i;
+
+	local_bh_disable();
+	e = &this_cpu_ptr(net->ipv6.fib6_lookup_cache)->entries[
+		hash_32(hash, FIB6_LOOKUP_CACHE_BITS)];
+	e->daddr = fl6->daddr;
+	e->saddr = fl6->saddr;
+	e->table = table;
+	e->f6i = f6i;
+	e->oif = oif;
+	e->strict = strict;
+	e->sernum = sernum;
+	local_bh_enable();
+
+	return f6i;
+}
+
 struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table,
 			       int oif, struct flowi6 *fl6,
 			       const struct sk_buff *skb, int flags)
@@ -1871,7 +1956,7 @@ struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table,
 
 	rcu_read_lock();
 
-	f6i = fib6_table_lookup(net, table, oif, fl6, strict);
+	f6i = fib6_cached_lookup(net, table, oif, fl6, strict);
 	if (f6i->fib6_nsiblings)
 		f6i = fib6_multipath_select(net, f6i, fl6, oif, skb, strict);
 
@@ -4047,6 +4132,7 @@ static int fib6_ifdown(struct fib6_info *rt, void *p_arg)
 		    rt->fib6_flags & (RTF_LOCAL | RTF_ANYCAST))
 			break;
 		rt->fib6_nh.nh_flags |= RTNH_F_LINKDOWN;
+		fib6_update_sernum_upto_root(net, rt);
 		rt6_multipath_rebalance(rt);
 		break;
 	}
@@ -5196,13 +5282,17 @@ static int __net_init ip6_route_net_init(struct net *net)
 	dst_init_metrics(&net->ipv6.ip6_null_entry->dst,
 			 ip6_template_metrics, true);
 
+	net->ipv6.fib6_lookup_cache = alloc_percpu(struct fib6_lookup_cache);
+	if (!net->ipv6.fib6_lookup_cache)
+		goto out_ip6_null_entry;
+
 #ifdef CONFIG_IPV6_MULTIPLE_TABLES
 	net->ipv6.fib6_has_custom_rules = false;
 	net->ipv6.ip6_prohibit_entry = kmemdup(&ip6_prohibit_entry_template,
 					       sizeof(*net->ipv6.ip6_prohibit_entry),
 					       GFP_KERNEL);
 	if (!net->ipv6.ip6_prohibit_entry)
-		goto out_ip6_null_entry;
+		goto out_fib6_lookup_cache;
 	net->ipv6.ip6_prohibit_entry->dst.ops = &net->ipv6.ip6_dst_ops;
 	dst_init_metrics(&net->ipv6.ip6_prohibit_entry->dst,
 			 ip6_template_metrics, true);
@@ -5235,9 +5325,11 @@ static int __net_init ip6_route_net_init(struct net *net)
 #ifdef CONFIG_IPV6_MULTIPLE_TABLES
 out_ip6_prohibit_entry:
 	kfree(net->ipv6.ip6_prohibit_entry);
+out_fib6_lookup_cache:
+#endif
+	free_percpu(net->ipv6.fib6_lookup_cache);
 out_ip6_null_entry:
 	kfree(net->ipv6.ip6_null_entry);
-#endif
 out_fib6_null_entry:
 	kfree(net->ipv6.fib6_null_entry);
 out_ip6_dst_entries:
@@ -5248,6 +5340,7 @@ static int __net_init ip6_route_net_init(struct net *net)
 
 static void __net_exit ip6_route_net_exit(struct net *net)
 {
+	free_percpu(net->ipv6.fib6_lookup_cache);
 	kfree(net->ipv6.fib6_null_entry);
 	kfree(net->ipv6.ip6_null_entry);
 #ifdef CONFIG_IPV6_MULTIPLE_TABLES
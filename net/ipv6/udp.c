@@ -772,6 +772,39 @@ static int udp6_unicast_rcv_skb(struct sock *sk, struct sk_buff *skb,
 	return 0;
 }
 
+/* Fraglist GRO only builds packets for flows with no local socket, but
+ * some are still delivered locally, e.g. when a socket was bound in the
+ * meantime or after a DNAT.  Split them back into the packets they were
+ * built from, and receive these one at a time.
+ */
+static int udp6_rcv_segment_list(struct sk_buff *skb,
+				 struct udp_table *udptable, int proto)
+{
+	struct sk_buff *segs, *next;
+
+	__skb_push(skb, -skb_mac_offset(skb));
+	segs = __skb_gso_segment(skb, NETIF_F_SG, false);
+	if (IS_ERR_OR_NULL(segs)) {
+		__UDP6_INC_STATS(dev_net(skb->dev), UDP_MIB_INERRORS,
+				 proto == IPPROTO_UDPLITE);
+		kfree_skb(skb);
+		return 0;
+	}
+	consume_skb(skb);
+
+	for (skb = segs; skb; skb = next) {
+		next = skb->next;
+		skb->next = NULL;
+		__skb_pull(skb, skb_transport_offset(skb));
+
+		/* No resubmission for the packets of the list */
+		if (__udp6_lib_rcv(skb, udptable, proto) > 0)
+			kfree_skb(skb);
+	}
+
+	return 0;
+}
+
 int __udp6_lib_rcv(struct sk_buff *skb, struct udp_table *udptable,
 		   int proto)
 {
@@ -781,6 +814,10 @@ int __udp6_lib_rcv(struct sk_buff *skb, struct udp_table *udptable,
 	struct sock *sk;
 	u32 ulen = 0;
 
+	if (skb_is_gso(skb) &&
+	    (skb_shinfo(skb)->gso_type & SKB_GSO_FRAGLIST))
+		return udp6_rcv_segment_list(skb, udptable, proto);
+
 	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 		goto discard;
 
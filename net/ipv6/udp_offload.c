@@ -8,6 +8,13 @@
  *      2 of the License, or (at your option) any later version.
  *
  *      UDPv6 GSO support
+ *
+ *      Forwarded UDP flows are aggregated by GRO on devices with
+ *      NETIF_F_GRO_FRAGLIST: the packets are chained to the frag_list of
+ *      the first one instead of being merged, and are split back, with
+ *      the headers of the first one, only by the GSO of the egress
+ *      device, or not at all if it has NETIF_F_GSO_FRAGLIST.  Those
+ *      delivered locally after all are split back by __udp6_lib_rcv().
  */
 #include <linux/skbuff.h>
 #include <linux/netdevice.h>
@@ -17,6 +24,117 @@
 #include <net/ip6_checksum.h>
 #include "ip6_offload.h"
 
+#define UDP6_GRO_CNT_MAX 64
+
+/* Make the UDP header of a packet of the list match the head, whose
+ * addresses and ports may have been rewritten on the way.  @oiph is the
+ * original IPv6 header of the packet.
+ */
+static void udp6_segment_list_fixup(struct sk_buff *seg,
+				    const struct ipv6hdr *oiph,
+				    const struct sk_buff *skb)
+{
+	const struct ipv6hdr *iph = ipv6_hdr(skb);
+	const struct udphdr *uh = udp_hdr(skb);
+	struct udphdr *uh2 = udp_hdr(seg);
+
+	if (!ipv6_addr_equal(&oiph->saddr, &iph->saddr))
+		inet_proto_csum_replace16(&uh2->check, seg,
+					  oiph->saddr.s6_addr32,
+					  iph->saddr.s6_addr32, true);
+	if (!ipv6_addr_equal(&oiph->daddr, &iph->daddr))
+		inet_proto_csum_replace16(&uh2->check, seg,
+					  oiph->daddr.s6_addr32,
+					  iph->daddr.s6_addr32, true);
+	if (uh2->source != uh->source) {
+		inet_proto_csum_replace2(&uh2->check, seg, uh2->source,
+					 uh->source, false);
+		uh2->source = uh->source;
+	}
+	if (uh2->dest != uh->dest) {
+		inet_proto_csum_replace2(&uh2->check, seg, uh2->dest,
+					 uh->dest, false);
+		uh2->dest = uh->dest;
+	}
+	if (!uh2->check)
+		uh2->check = CSUM_MANGLED_0;
+}
+
+/* Split a GRO fraglist packet back into the packets it was built from.
+ * They keep their own UDP header and payload, and get the link and
+ * network headers of the head, as changed while forwarding it.
+ */
+static struct sk_buff *udp6_gso_segment_list(struct sk_buff *skb,
+					     netdev_features_t features)
+{
+	struct sk_buff *list_skb = skb_shinfo(skb)->frag_list;
+	unsigned int mss = skb_shinfo(skb)->gso_size;
+	unsigned int delta_truesize = 0;
+	unsigned int delta_len = 0;
+	struct sk_buff *tail = NULL;
+	struct sk_buff *nskb;
+	struct ipv6hdr oiph;
+	unsigned int hlen;
+
+	if (!list_skb || skb->encapsulation)
+		return ERR_PTR(-EINVAL);
+
+	hlen = skb_transport_header(skb) - skb_mac_header(skb);
+	__skb_push(skb, hlen);
+	skb_shinfo(skb)->frag_list = NULL;
+
+	do {
+		nskb = list_skb;
+		list_skb = list_skb->next;
+
+		if (!tail)
+			skb->next = nskb;
+		else
+			tail->next = nskb;
+		tail = nskb;
+
+		delta_len += nskb->len;
+		delta_truesize += nskb->truesize;
+
+		/* Back to its own headers, pulled by udp6_gro_receive_list() */
+		__skb_push(nskb, hlen + sizeof(struct udphdr));
+		oiph = *ipv6_hdr(nskb);
+
+		skb_release_head_state(nskb);
+		skb_copy_header(nskb, skb);
+		skb_gso_reset(nskb);
+		skb_headers_offset_update(nskb, skb_headroom(nskb) -
+					  skb_headroom(skb));
+		skb_copy_to_linear_data(nskb, skb->data, hlen);
+		udp6_segment_list_fixup(nskb, &oiph, skb);
+
+		if (skb_needs_linearize(nskb, features) &&
+		    __skb_linearize(nskb))
+			goto err_linearize;
+	} while (list_skb);
+
+	skb->truesize -= delta_truesize;
+	skb->data_len -= delta_len;
+	skb->len -= delta_len;
+	udp_hdr(skb)->len = htons(sizeof(struct udphdr) + mss);
+	skb_gso_reset(skb);
+	skb->prev = tail;
+
+	if (skb_needs_linearize(skb, features) &&
+	    __skb_linearize(skb))
+		goto err_linearize;
+
+	/* The caller consumes the original skb, which is the first segment */
+	skb_get(skb);
+
+	return skb;
+
+err_linearize:
+	kfree_skb_list(skb->next);
+	skb->next = NULL;
+	return ERR_PTR(-ENOMEM);
+}
+
 static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -48,6 +166,9 @@ static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 		if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 			goto out;
 
+		if (skb_shinfo(skb)->gso_type & SKB_GSO_FRAGLIST)
+			return udp6_gso_segment_list(skb, features);
+
 		if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
 			return __udp_gso_segment(skb, features);
 
@@ -114,10 +235,99 @@ static struct sk_buff *udp6_ufo_fragment(struct sk_buff *skb,
 	return segs;
 }
 
+/* Chain @skb to the frag_list of @p, without merging its payload */
+static int udp6_gro_receive_list(struct sk_buff *p, struct sk_buff *skb)
+{
+	if (unlikely(p->len + skb->len >= 65536))
+		return -E2BIG;
+
+	if (skb->ip_summed != p->ip_summed ||
+	    skb->csum_level != p->csum_level)
+		return -EINVAL;
+
+	/* The headers are restored from the linear data on segmentation */
+	if (!pskb_may_pull(skb, skb_gro_offset(skb)))
+		return -ENOMEM;
+
+	if (NAPI_GRO_CB(p)->last == p)
+		skb_shinfo(p)->frag_list = skb;
+	else
+		NAPI_GRO_CB(p)->last->next = skb;
+
+	__skb_pull(skb, skb_gro_offset(skb));
+
+	NAPI_GRO_CB(p)->last = skb;
+	NAPI_GRO_CB(p)->count++;
+	p->data_len += skb->len;
+	p->truesize += skb->truesize;
+	p->len += skb->len;
+
+	NAPI_GRO_CB(skb)->same_flow = 1;
+
+	return 0;
+}
+
+/* GRO of a flow with no local socket, that is to be forwarded */
+static struct sk_buff *udp6_gro_receive_fwd(struct list_head *head,
+					    struct sk_buff *skb,
+					    struct udphdr *uh)
+{
+	unsigned int off = skb_gro_offset(skb);
+	struct sk_buff *pp = NULL;
+	struct udphdr *uh2;
+	struct sk_buff *p;
+	unsigned int ulen;
+
+	/* The checksum of each packet is kept, and a zero one is invalid */
+	if (!uh->check)
+		goto flush;
+
+	ulen = ntohs(uh->len);
+	if (ulen <= sizeof(*uh) || ulen != skb_gro_len(skb))
+		goto flush;
+
+	skb_gro_pull(skb, sizeof(struct udphdr));
+	skb_gro_postpull_rcsum(skb, uh, sizeof(struct udphdr));
+	NAPI_GRO_CB(skb)->is_flist = 1;
+
+	list_for_each_entry(p, head, list) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+
+		/* The addresses were matched by ipv6_gro_receive() */
+		if (!NAPI_GRO_CB(p)->is_flist ||
+		    *(u32 *)&uh->source != *(u32 *)&uh2->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		/* Packets are all of the size of the first one, but for the
+		 * last one which may be shorter.  Do not let the count grow
+		 * unbounded under a small packet flood either.
+		 */
+		if (NAPI_GRO_CB(skb)->flush || NAPI_GRO_CB(p)->flush ||
+		    ulen > ntohs(uh2->len) || udp6_gro_receive_list(p, skb) ||
+		    ulen != ntohs(uh2->len) ||
+		    NAPI_GRO_CB(p)->count >= UDP6_GRO_CNT_MAX)
+			pp = p;
+
+		return pp;
+	}
+
+	return NULL;
+
+flush:
+	NAPI_GRO_CB(skb)->flush = 1;
+	return NULL;
+}
+
 static struct sk_buff *udp6_gro_receive(struct list_head *head,
 					struct sk_buff *skb)
 {
 	struct udphdr *uh = udp_gro_udphdr(skb);
+	struct sock *sk;
 
 	if (unlikely(!uh))
 		goto flush;
@@ -135,6 +345,17 @@ static struct sk_buff *udp6_gro_receive(struct list_head *head,
 
 skip:
 	NAPI_GRO_CB(skb)->is_ipv6 = 1;
+	NAPI_GRO_CB(skb)->is_flist = 0;
+
+	if ((skb->dev->features & NETIF_F_GRO_FRAGLIST) &&
+	    !NAPI_GRO_CB(skb)->encap_mark) {
+		rcu_read_lock();
+		sk = udp6_lib_lookup_skb(skb, uh->source, uh->dest);
+		rcu_read_unlock();
+		if (!sk)
+			return udp6_gro_receive_fwd(head, skb, uh);
+	}
+
 	return udp_gro_receive(head, skb, uh, udp6_lib_lookup_skb);
 
 flush:
@@ -147,6 +368,14 @@ static int udp6_gro_complete(struct sk_buff *skb, int nhoff)
 	const struct ipv6hdr *ipv6h = ipv6_hdr(skb);
 	struct udphdr *uh = (struct udphdr *)(skb->data + nhoff);
 
+	if (NAPI_GRO_CB(skb)->is_flist) {
+		uh->len = htons(skb->len - nhoff);
+		skb_shinfo(skb)->gso_type |= SKB_GSO_FRAGLIST | SKB_GSO_UDP_L4;
+		skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+		__skb_incr_checksum_unnecessary(skb);
+		return 0;
+	}
+
 	if (uh->check) {
 		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_TUNNEL_CSUM;
 		uh->check = ~udp_v6_check(skb->len - nhoff, &ipv6h->saddr,
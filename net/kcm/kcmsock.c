@@ -188,7 +188,8 @@ static void kcm_rfree(struct sk_buff *skb)
 	}
 }
 
-static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+static int __kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb,
+			       bool notify)
 {
 	struct sk_buff_head *list = &sk->sk_receive_queue;
 
@@ -208,12 +209,17 @@ static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	skb_queue_tail(list, skb);
 
-	if (!sock_flag(sk, SOCK_DEAD))
+	if (notify && !sock_flag(sk, SOCK_DEAD))
 		sk->sk_data_ready(sk);
 
 	return 0;
 }
 
+static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	return __kcm_queue_rcv_skb(sk, skb, true);
+}
+
 /* Requeue received messages for a kcm socket to other kcm sockets. This is
  * called with a kcm socket is receive disabled.
  * RX mux lock held.
@@ -309,6 +315,11 @@ static void unreserve_rx_kcm(struct kcm_psock *psock,
 	if (!kcm)
 		return;
 
+	/* Wake the reader once for all the messages queued while reserved */
+	if (!skb_queue_empty(&kcm->sk.sk_receive_queue) &&
+	    !sock_flag(&kcm->sk, SOCK_DEAD))
+		kcm->sk.sk_data_ready(&kcm->sk);
+
 	spin_lock_bh(&mux->rx_lock);
 
 	psock->rx_kcm = NULL;
@@ -370,7 +381,10 @@ static void kcm_rcv_strparser(struct strparser *strp, struct sk_buff *skb)
 		return;
 	}
 
-	if (kcm_queue_rcv_skb(&kcm->sk, skb)) {
+	/* The reader is woken when the psock unreserves the KCM, at the end
+	 * of this read pass, so all the messages it brings are seen at once.
+	 */
+	if (__kcm_queue_rcv_skb(&kcm->sk, skb, false)) {
 		/* Should mean socket buffer full */
 		unreserve_rx_kcm(psock, false);
 		goto try_queue;
@@ -131,6 +131,9 @@ static const char *const nlk_cb_mutex_key_strings[MAX_LINKS + 1] = {
 
 static int netlink_dump(struct sock *sk);
 
+/* Largest skb a dump is filled in, if recvmsg() is given buffers that large */
+#define NETLINK_DUMP_MAX_ALLOC	SKB_WITH_OVERHEAD(65536)
+
 /* nl_table locking explained:
  * Lookup and traversal are protected with an RCU read-side lock. Insertion
  * and removal are protected with per bucket lock while using RCU list
@@ -1406,10 +1409,51 @@ struct netlink_broadcast_data {
 	void *tx_data;
 };
 
+/* Run the filters of @sk on the skb being broadcast, before it is cloned
+ * for @sk: a listener filtering out most of the messages of its groups
+ * then no longer costs a clone and a free for each of them.  sk_filter()
+ * may trim the skb, so only the length the filter accepted is returned,
+ * the trimming is left to the caller once it has its own clone.
+ * Returns 0 if @sk does not want the skb at all.
+ */
+static unsigned int netlink_broadcast_filter(struct sock *sk,
+					     struct netlink_broadcast_data *p)
+{
+	struct sk_buff *skb = p->skb;
+	struct sk_filter *filter;
+	unsigned int res = skb->len;
+	struct sock *save_sk;
+
+	if (p->tx_filter && p->tx_filter(sk, skb, p->tx_data))
+		return 0;
+
+	if (skb_pfmemalloc(skb) && !sock_flag(sk, SOCK_MEMALLOC))
+		return 0;
+
+	if (security_sock_rcv_skb(sk, skb))
+		return 0;
+
+	rcu_read_lock();
+	filter = rcu_dereference(sk->sk_filter);
+	if (filter) {
+		/* The program sees the listener as the owner, as it would
+		 * on the clone queued to it.
+		 */
+		save_sk = skb->sk;
+		skb->sk = sk;
+		res = min(res, bpf_prog_run_save_cb(filter->prog, skb));
+		skb->sk = save_sk;
+	}
+	rcu_read_unlock();
+
+	return res;
+}
+
 static void do_one_broadcast(struct sock *sk,
 				    struct netlink_broadcast_data *p)
 {
 	struct netlink_sock *nlk = nlk_sk(sk);
+	unsigned int len;
 	int val;
 
 	if (p->exclude_sk == sk)
@@ -1436,9 +1480,18 @@ static void do_one_broadcast(struct sock *sk,
 		return;
 	}
 
+	len = netlink_broadcast_filter(sk, p);
+	if (!len)
+		return;
+
 	sock_hold(sk);
+	if (len < p->skb->len && p->skb2 == p->skb) {
+		/* Trimming it would trim the skb of the next listeners */
+		consume_skb(p->skb2);
+		p->skb2 = NULL;
+	}
 	if (p->skb2 == NULL) {
-		if (skb_shared(p->skb)) {
+		if (skb_shared(p->skb) || len < p->skb->len) {
 			p->skb2 = skb_clone(p->skb, p->allocation);
 		} else {
 			p->skb2 = skb_get(p->skb);
@@ -1457,12 +1510,7 @@ static void do_one_broadcast(struct sock *sk,
 			p->delivery_failure = 1;
 		goto out;
 	}
-	if (p->tx_filter && p->tx_filter(sk, p->skb2, p->tx_data)) {
-		kfree_skb(p->skb2);
-		p->skb2 = NULL;
-		goto out;
-	}
-	if (sk_filter(sk, p->skb2)) {
+	if (len < p->skb2->len && pskb_trim(p->skb2, len)) {
 		kfree_skb(p->skb2);
 		p->skb2 = NULL;
 		goto out;
@@ -1475,6 +1523,10 @@ static void do_one_broadcast(struct sock *sk,
 		netlink_overrun(sk);
 		if (nlk->flags & NETLINK_F_BROADCAST_SEND_ERROR)
 			p->delivery_failure = 1;
+		if (len < p->skb->len) {
+			kfree_skb(p->skb2);
+			p->skb2 = NULL;
+		}
 	} else {
 		p->congested |= val;
 		p->delivered = 1;
@@ -1954,7 +2006,7 @@ static int netlink_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	/* Record the max length of recvmsg() calls for future allocations */
 	nlk->max_recvmsg_len = max(nlk->max_recvmsg_len, len);
 	nlk->max_recvmsg_len = min_t(size_t, nlk->max_recvmsg_len,
-				     SKB_WITH_OVERHEAD(32768));
+				     NETLINK_DUMP_MAX_ALLOC);
 
 	copied = data_skb->len;
 	if (len < copied) {
@@ -2196,9 +2248,10 @@ static int netlink_dump(struct sock *sk)
 		goto errout_skb;
 
 	/* NLMSG_GOODSIZE is small to avoid high order allocations being
-	 * required, but it makes sense to _attempt_ a 16K bytes allocation
-	 * to reduce number of system calls on dump operations, if user
-	 * ever provided a big enough buffer.
+	 * required, but it makes sense to _attempt_ an allocation as large
+	 * as the buffers of the recvmsg() calls of the user, up to
+	 * NETLINK_DUMP_MAX_ALLOC, to reduce number of system calls on dump
+	 * operations.
 	 */
 	cb = &nlk->cb;
 	alloc_min_size = max_t(int, cb->min_dump_alloc, NLMSG_GOODSIZE);
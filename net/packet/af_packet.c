@@ -71,6 +71,7 @@
 #include <net/protocol.h>
 #include <linux/skbuff.h>
 #include <net/sock.h>
+#include <net/busy_poll.h>
 #include <linux/errno.h>
 #include <linux/timer.h>
 #include <linux/uaccess.h>
@@ -1133,6 +1134,26 @@ static void *packet_previous_rx_frame(struct packet_sock *po,
 	return __prb_previous_block(po, rb, status);
 }
 
+/* TPACKET_V3: close the current block once PACKET_RX_RETIRE_FRAMES frames
+ * were copied to it, instead of waiting until it is full or its retire timer
+ * fires.  Whoever copies the last of these frames closes it.
+ */
+static void prb_retire_filled_block(struct packet_sock *po)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	struct sock *sk = &po->sk;
+	struct tpacket_block_desc *pbd;
+
+	spin_lock(&sk->sk_receive_queue.lock);
+	pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+	if (!prb_queue_frozen(pkc) && !atomic_read(&pkc->blk_fill_in_prog) &&
+	    BLOCK_NUM_PKTS(pbd) >= READ_ONCE(po->rx_retire_frames)) {
+		prb_retire_current_block(pkc, po, 0);
+		prb_dispatch_next_block(pkc, po);
+	}
+	spin_unlock(&sk->sk_receive_queue.lock);
+}
+
 static void packet_increment_rx_head(struct packet_sock *po,
 					    struct packet_ring_buffer *rb)
 {
@@ -2068,6 +2089,8 @@ static int packet_rcv(struct sk_buff *skb, struct net_device *dev,
 	res = run_filter(skb, sk, snaplen);
 	if (!res)
 		goto drop_n_restore;
+
+	sk_mark_napi_id(sk, skb);
 	if (snaplen > res)
 		snaplen = res;
 
@@ -2191,6 +2214,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	if (!res)
 		goto drop_n_restore;
 
+	sk_mark_napi_id(sk, skb);
+
 	if (skb->ip_summed == CHECKSUM_PARTIAL)
 		status |= TP_STATUS_CSUMNOTREADY;
 	else if (skb->pkt_type != PACKET_OUTGOING &&
@@ -2362,6 +2387,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		sk->sk_data_ready(sk);
 	} else {
 		prb_clear_blk_fill_status(&po->rx_ring);
+		if (READ_ONCE(po->rx_retire_frames))
+			prb_retire_filled_block(po);
 	}
 
 drop_n_restore:
@@ -3669,6 +3696,22 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		pkt_sk(sk)->copy_thresh = val;
 		return 0;
 	}
+	case PACKET_RX_RETIRE_FRAMES:
+	{
+		int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (copy_from_user(&val, optval, sizeof(val)))
+			return -EFAULT;
+		if (val < 0)
+			return -EINVAL;
+		if (po->tp_version != TPACKET_V3)
+			return -EINVAL;
+
+		WRITE_ONCE(po->rx_retire_frames, val);
+		return 0;
+	}
 	case PACKET_VERSION:
 	{
 		int val;
@@ -3951,6 +3994,9 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	case PACKET_QDISC_BYPASS:
 		val = packet_use_direct_xmit(po);
 		break;
+	case PACKET_RX_RETIRE_FRAMES:
+		val = po->rx_retire_frames;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -4095,7 +4141,9 @@ static __poll_t packet_poll(struct file *file, struct socket *sock,
 {
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
-	__poll_t mask = datagram_poll(file, sock, wait);
+	__poll_t mask;
+
+	mask = datagram_poll(file, sock, wait);
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
 	if (po->rx_ring.pg_vec) {
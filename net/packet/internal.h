@@ -102,6 +102,10 @@ struct packet_rollover {
 	u32			history[ROLLOVER_HLEN] ____cacheline_aligned;
 } ____cacheline_aligned_in_smp;
 
+#ifndef PACKET_RX_RETIRE_FRAMES
+#define PACKET_RX_RETIRE_FRAMES		32
+#endif
+
 struct packet_sock {
 	/* struct sock has to be the first member of packet_sock */
 	struct sock		sk;
@@ -110,6 +114,7 @@ struct packet_sock {
 	struct packet_ring_buffer	rx_ring;
 	struct packet_ring_buffer	tx_ring;
 	int			copy_thresh;
+	unsigned int		rx_retire_frames;
 	spinlock_t		bind_lock;
 	struct mutex		pg_vec_lock;
 	unsigned int		running;	/* bind_lock must be held */
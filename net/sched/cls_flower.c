@@ -81,9 +81,20 @@ struct fl_flow_tmplt {
 	struct tcf_chain *chain;
 };
 
+/* All the keys of all the masks of a head: fl_classify() dissects an skb
+ * once with it, rather than once per mask.
+ */
+struct fl_union_dissector {
+	struct fl_flow_key key;
+	struct fl_flow_mask_range range;
+	struct flow_dissector dissector;
+	struct rcu_head rcu;
+};
+
 struct cls_fl_head {
 	struct rhashtable ht;
 	struct list_head masks;
+	struct fl_union_dissector __rcu *dissector;
 	struct rcu_work rwork;
 	struct idr handle_idr;
 };
@@ -115,10 +126,11 @@ static unsigned short int fl_mask_range(const struct fl_flow_mask *mask)
 	return mask->range.end - mask->range.start;
 }
 
-static void fl_mask_update_range(struct fl_flow_mask *mask)
+static void fl_key_update_range(const struct fl_flow_key *key,
+				struct fl_flow_mask_range *range)
 {
-	const u8 *bytes = (const u8 *) &mask->key;
-	size_t size = sizeof(mask->key);
+	const u8 *bytes = (const u8 *) key;
+	size_t size = sizeof(*key);
 	size_t i, first = 0, last;
 
 	for (i = 0; i < size; i++) {
@@ -134,8 +146,13 @@ static void fl_mask_update_range(struct fl_flow_mask *mask)
 			break;
 		}
 	}
-	mask->range.start = rounddown(first, sizeof(long));
-	mask->range.end = roundup(last + 1, sizeof(long));
+	range->start = rounddown(first, sizeof(long));
+	range->end = roundup(last + 1, sizeof(long));
+}
+
+static void fl_mask_update_range(struct fl_flow_mask *mask)
+{
+	fl_key_update_range(&mask->key, &mask->range);
 }
 
 static void *fl_key_get_start(struct fl_flow_key *key,
@@ -186,25 +203,55 @@ static struct cls_fl_filter *fl_lookup(struct fl_flow_mask *mask,
 				      mask->filter_ht_params);
 }
 
+static void fl_dissect(struct sk_buff *skb, struct flow_dissector *dissector,
+		       struct fl_flow_key *skb_key)
+{
+	skb_key->indev_ifindex = skb->skb_iif;
+	/* skb_flow_dissect() does not set n_proto in case an unknown
+	 * protocol, so do it rather here.
+	 */
+	skb_key->basic.n_proto = skb->protocol;
+	skb_flow_dissect_tunnel_info(skb, dissector, skb_key);
+	skb_flow_dissect(skb, dissector, skb_key, 0);
+}
+
+/* Whether the keys dissected with @ud hold all the keys of @mask */
+static bool fl_union_covers(const struct fl_union_dissector *ud,
+			    const struct fl_flow_mask *mask)
+{
+	return !(mask->dissector.used_keys & ~ud->dissector.used_keys) &&
+	       mask->range.start >= ud->range.start &&
+	       mask->range.end <= ud->range.end;
+}
+
 static int fl_classify(struct sk_buff *skb, const struct tcf_proto *tp,
 		       struct tcf_result *res)
 {
 	struct cls_fl_head *head = rcu_dereference_bh(tp->root);
+	struct fl_union_dissector *ud;
 	struct cls_fl_filter *f;
 	struct fl_flow_mask *mask;
 	struct fl_flow_key skb_key;
 	struct fl_flow_key skb_mkey;
 
-	list_for_each_entry_rcu(mask, &head->masks, list) {
-		fl_clear_masked_range(&skb_key, mask);
+	/* The keys dissected for a mask do not depend on the other keys
+	 * asked for, so one pass gives what each mask would have got.  From
+	 * a mask the union does not cover on, should it have been added
+	 * while the union could not be rebuilt, each mask gets its own pass.
+	 */
+	ud = rcu_dereference_bh(head->dissector);
+	if (ud) {
+		memset(&skb_key, 0, sizeof(skb_key));
+		fl_dissect(skb, &ud->dissector, &skb_key);
+	}
 
-		skb_key.indev_ifindex = skb->skb_iif;
-		/* skb_flow_dissect() does not set n_proto in case an unknown
-		 * protocol, so do it rather here.
-		 */
-		skb_key.basic.n_proto = skb->protocol;
-		skb_flow_dissect_tunnel_info(skb, &mask->dissector, &skb_key);
-		skb_flow_dissect(skb, &mask->dissector, &skb_key, 0);
+	list_for_each_entry_rcu(mask, &head->masks, list) {
+		if (ud && !fl_union_covers(ud, mask))
+			ud = NULL;
+		if (!ud) {
+			fl_clear_masked_range(&skb_key, mask);
+			fl_dissect(skb, &mask->dissector, &skb_key);
+		}
 
 		fl_set_masked_key(&skb_mkey, &skb_key, mask);
 
@@ -232,6 +279,9 @@ static int fl_init(struct tcf_proto *tp)
 	return rhashtable_init(&head->ht, &mask_ht_params);
 }
 
+static void fl_update_dissector(struct cls_fl_head *head,
+				struct fl_flow_mask *newmask);
+
 static void fl_mask_free(struct fl_flow_mask *mask)
 {
 	rhashtable_destroy(&mask->ht);
@@ -254,6 +304,7 @@ static bool fl_mask_put(struct cls_fl_head *head, struct fl_flow_mask *mask,
 
 	rhashtable_remove_fast(&head->ht, &mask->ht_node, mask_ht_params);
 	list_del_rcu(&mask->list);
+	fl_update_dissector(head, NULL);
 	if (async)
 		tcf_queue_work(&mask->rwork, fl_mask_free_work);
 	else
@@ -371,6 +422,7 @@ static void fl_destroy_sleepable(struct work_struct *work)
 						rwork);
 
 	rhashtable_destroy(&head->ht);
+	kfree(rcu_dereference_protected(head->dissector, 1));
 	kfree(head);
 	module_put(THIS_MODULE);
 }
@@ -1074,6 +1126,45 @@ static void fl_init_dissector(struct flow_dissector *dissector,
 	skb_flow_dissector_init(dissector, keys, cnt);
 }
 
+static void fl_union_add_mask(struct fl_union_dissector *ud,
+			      const struct fl_flow_mask *mask)
+{
+	const long *lmask = (const long *) &mask->key;
+	long *lkey = (long *) &ud->key;
+	int i;
+
+	for (i = 0; i < sizeof(ud->key); i += sizeof(long))
+		*lkey++ |= *lmask++;
+}
+
+/* Called with RTNL, after a mask left head->masks or before @newmask is
+ * added to it.  A union larger than needed is harmless, so if memory is
+ * short the current one is kept: fl_classify() falls back to one pass per
+ * mask from the first mask it does not cover on.
+ */
+static void fl_update_dissector(struct cls_fl_head *head,
+				struct fl_flow_mask *newmask)
+{
+	struct fl_union_dissector *ud, *old;
+	struct fl_flow_mask *mask;
+
+	old = rtnl_dereference(head->dissector);
+	ud = kzalloc(sizeof(*ud), GFP_KERNEL);
+	if (!ud)
+		return;
+
+	list_for_each_entry(mask, &head->masks, list)
+		fl_union_add_mask(ud, mask);
+	if (newmask)
+		fl_union_add_mask(ud, newmask);
+	fl_key_update_range(&ud->key, &ud->range);
+	fl_init_dissector(&ud->dissector, &ud->key);
+
+	rcu_assign_pointer(head->dissector, ud);
+	if (old)
+		kfree_rcu(old, rcu);
+}
+
 static struct fl_flow_mask *fl_create_new_mask(struct cls_fl_head *head,
 					       struct fl_flow_mask *mask)
 {
@@ -1099,6 +1190,7 @@ static struct fl_flow_mask *fl_create_new_mask(struct cls_fl_head *head,
 	if (err)
 		goto errout_destroy;
 
+	fl_update_dissector(head, newmask);
 	list_add_tail_rcu(&newmask->list, &head->masks);
 
 	return newmask;
@@ -37,6 +37,8 @@
 #include <net/pkt_sched.h>
 #include <net/pkt_cls.h>
 
+#include "sch_dev_shared.h"
+
 /*
 
    Short review.
@@ -447,6 +449,52 @@ void qdisc_put_rtab(struct qdisc_rate_table *tab)
 }
 EXPORT_SYMBOL(qdisc_put_rtab);
 
+/* State shared by all the instances of a qdisc on a device */
+
+static LIST_HEAD(qdisc_dev_shared_list);
+static DEFINE_SPINLOCK(qdisc_dev_shared_lock);
+
+/* Returns the state of the qdisc of @sch on its device, allocating
+ * @size zeroed bytes if this is the first instance to ask for it.
+ */
+struct qdisc_dev_shared *qdisc_dev_shared_get(struct Qdisc *sch, size_t size)
+{
+	const struct net_device *dev = qdisc_dev(sch);
+	struct qdisc_dev_shared *shared, *new;
+
+	new = kzalloc(size, GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	spin_lock(&qdisc_dev_shared_lock);
+	list_for_each_entry(shared, &qdisc_dev_shared_list, list) {
+		if (shared->dev == dev && shared->ops == sch->ops) {
+			refcount_inc(&shared->refcnt);
+			spin_unlock(&qdisc_dev_shared_lock);
+			kfree(new);
+			return shared;
+		}
+	}
+	new->dev = dev;
+	new->ops = sch->ops;
+	refcount_set(&new->refcnt, 1);
+	list_add(&new->list, &qdisc_dev_shared_list);
+	spin_unlock(&qdisc_dev_shared_lock);
+	return new;
+}
+EXPORT_SYMBOL(qdisc_dev_shared_get);
+
+void qdisc_dev_shared_put(struct qdisc_dev_shared *shared)
+{
+	spin_lock(&qdisc_dev_shared_lock);
+	if (refcount_dec_and_test(&shared->refcnt)) {
+		list_del(&shared->list);
+		kfree(shared);
+	}
+	spin_unlock(&qdisc_dev_shared_lock);
+}
+EXPORT_SYMBOL(qdisc_dev_shared_put);
+
 static LIST_HEAD(qdisc_stab_list);
 
 static const struct nla_policy stab_policy[TCA_STAB_MAX + 1] = {
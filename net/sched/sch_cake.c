@@ -74,6 +74,14 @@
 #include <net/netfilter/nf_conntrack_core.h>
 #endif
 
+#include "sch_dev_shared.h"
+
+#ifndef TCA_CAKE_SHARED_SHAPER
+#define TCA_CAKE_SHARED_SHAPER 32
+#endif
+
+#define CAKE_ATTR_MAX TCA_CAKE_SHARED_SHAPER
+
 #define CAKE_SET_WAYS (8)
 #define CAKE_MAX_TINS (8)
 #define CAKE_QUEUES (1024)
@@ -251,8 +259,26 @@ struct cake_sched_data {
 	u16		max_adjlen;
 	u16		min_netlen;
 	u16		min_adjlen;
+
+	/* global shaper shared with the other instances of the device */
+	struct cake_shared *shared;
+	u64		shared_debt;
 };
 
+/* With TCA_CAKE_SHARED_SHAPER, the cake instances of a device, typically
+ * the children of mq, each shape and share fairly their own TX queue, and
+ * also all charge their packets to this common clock, so that together
+ * they do not exceed the rate they were all given.  An instance charges
+ * it by CAKE_SHARED_BATCH_NS at a time, so that the cache line is not
+ * bounced for each packet.
+ */
+struct cake_shared {
+	struct qdisc_dev_shared	common;
+	atomic64_t		time_next_packet;
+};
+
+#define CAKE_SHARED_BATCH_NS (20 * NSEC_PER_USEC)
+
 enum {
 	CAKE_FLAG_OVERHEAD	   = BIT(0),
 	CAKE_FLAG_AUTORATE_INGRESS = BIT(1),
@@ -1418,6 +1444,43 @@ static void cake_heapify_up(struct cake_sched_data *q, u16 i)
 	}
 }
 
+static struct cake_shared *cake_shared_get(struct Qdisc *sch)
+{
+	struct qdisc_dev_shared *shared;
+
+	shared = qdisc_dev_shared_get(sch, sizeof(struct cake_shared));
+	return shared ? container_of(shared, struct cake_shared, common) : NULL;
+}
+
+static void cake_shared_charge(struct cake_sched_data *q, ktime_t now,
+			       u64 dur)
+{
+	struct cake_shared *shared = q->shared;
+	s64 next;
+
+	q->shared_debt += dur;
+	if (q->shared_debt < CAKE_SHARED_BATCH_NS)
+		return;
+
+	/* Like q->time_next_packet, idle time is not banked */
+	next = atomic64_read(&shared->time_next_packet);
+	if (next < ktime_to_ns(now))
+		atomic64_cmpxchg(&shared->time_next_packet, next,
+				 ktime_to_ns(now));
+	atomic64_add(q->shared_debt, &shared->time_next_packet);
+	q->shared_debt = 0;
+}
+
+static bool cake_shared_throttled(const struct cake_sched_data *q,
+				  ktime_t now, u64 *next)
+{
+	if (!q->shared)
+		return false;
+
+	*next = atomic64_read(&q->shared->time_next_packet);
+	return (s64)*next > ktime_to_ns(now);
+}
+
 static int cake_advance_shaper(struct cake_sched_data *q,
 			       struct cake_tin_data *b,
 			       struct sk_buff *skb,
@@ -1443,6 +1506,8 @@ static int cake_advance_shaper(struct cake_sched_data *q,
 
 		q->time_next_packet = ktime_add_ns(q->time_next_packet,
 						   global_dur);
+		if (q->shared)
+			cake_shared_charge(q, now, global_dur);
 		if (!drop)
 			q->failsafe_next_packet = \
 				ktime_add_ns(q->failsafe_next_packet,
@@ -1870,6 +1935,7 @@ static struct sk_buff *cake_dequeue(struct Qdisc *sch)
 	bool first_flow = true;
 	struct sk_buff *skb;
 	u16 host_load;
+	u64 shared_next;
 	u64 delay;
 	u32 len;
 
@@ -1877,6 +1943,13 @@ static struct sk_buff *cake_dequeue(struct Qdisc *sch)
 	if (!sch->q.qlen)
 		return NULL;
 
+	/* shaper shared with the other instances of the device */
+	if (cake_shared_throttled(q, now, &shared_next)) {
+		sch->qstats.overlimits++;
+		qdisc_watchdog_schedule_ns(&q->watchdog, shared_next);
+		return NULL;
+	}
+
 	/* global hard shaper */
 	if (ktime_after(q->time_next_packet, now) &&
 	    ktime_after(q->failsafe_next_packet, now)) {
@@ -2127,7 +2200,7 @@ static void cake_reset(struct Qdisc *sch)
 		cake_clear_tin(sch, c);
 }
 
-static const struct nla_policy cake_policy[TCA_CAKE_MAX + 1] = {
+static const struct nla_policy cake_policy[CAKE_ATTR_MAX + 1] = {
 	[TCA_CAKE_BASE_RATE64]   = { .type = NLA_U64 },
 	[TCA_CAKE_DIFFSERV_MODE] = { .type = NLA_U32 },
 	[TCA_CAKE_ATM]		 = { .type = NLA_U32 },
@@ -2143,6 +2216,7 @@ static const struct nla_policy cake_policy[TCA_CAKE_MAX + 1] = {
 	[TCA_CAKE_MPU]		 = { .type = NLA_U32 },
 	[TCA_CAKE_INGRESS]	 = { .type = NLA_U32 },
 	[TCA_CAKE_ACK_FILTER]	 = { .type = NLA_U32 },
+	[TCA_CAKE_SHARED_SHAPER] = { .type = NLA_U32 },
 };
 
 static void cake_set_rate(struct cake_tin_data *b, u64 rate, u32 mtu,
@@ -2483,13 +2557,13 @@ static int cake_change(struct Qdisc *sch, struct nlattr *opt,
 		       struct netlink_ext_ack *extack)
 {
 	struct cake_sched_data *q = qdisc_priv(sch);
-	struct nlattr *tb[TCA_CAKE_MAX + 1];
+	struct nlattr *tb[CAKE_ATTR_MAX + 1];
 	int err;
 
 	if (!opt)
 		return -EINVAL;
 
-	err = nla_parse_nested(tb, TCA_CAKE_MAX, opt, cake_policy, extack);
+	err = nla_parse_nested(tb, CAKE_ATTR_MAX, opt, cake_policy, extack);
 	if (err < 0)
 		return err;
 
@@ -2589,6 +2663,23 @@ static int cake_change(struct Qdisc *sch, struct nlattr *opt,
 			q->rate_flags &= ~CAKE_FLAG_SPLIT_GSO;
 	}
 
+	if (tb[TCA_CAKE_SHARED_SHAPER]) {
+		struct cake_shared *shared = NULL, *old;
+
+		if (nla_get_u32(tb[TCA_CAKE_SHARED_SHAPER])) {
+			shared = q->shared ?: cake_shared_get(sch);
+			if (!shared)
+				return -ENOMEM;
+		}
+		sch_tree_lock(sch);
+		old = q->shared;
+		q->shared = shared;
+		q->shared_debt = 0;
+		sch_tree_unlock(sch);
+		if (old && old != shared)
+			qdisc_dev_shared_put(&old->common);
+	}
+
 	if (q->tins) {
 		sch_tree_lock(sch);
 		cake_reconfigure(sch);
@@ -2605,6 +2696,8 @@ static void cake_destroy(struct Qdisc *sch)
 	qdisc_watchdog_cancel(&q->watchdog);
 	tcf_block_put(q->block);
 	kvfree(q->tins);
+	if (q->shared)
+		qdisc_dev_shared_put(&q->shared->common);
 }
 
 static int cake_init(struct Qdisc *sch, struct nlattr *opt,
@@ -2748,6 +2841,9 @@ static int cake_dump(struct Qdisc *sch, struct sk_buff *skb)
 			!!(q->rate_flags & CAKE_FLAG_SPLIT_GSO)))
 		goto nla_put_failure;
 
+	if (q->shared && nla_put_u32(skb, TCA_CAKE_SHARED_SHAPER, 1))
+		goto nla_put_failure;
+
 	return nla_nest_end(skb, opts);
 
 nla_put_failure:
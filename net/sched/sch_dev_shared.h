@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * net/sched/sch_dev_shared.h	State shared by the instances of a qdisc
+ *				on one device, such as the children of mq.
+ */
+#ifndef __NET_SCHED_SCH_DEV_SHARED_H
+#define __NET_SCHED_SCH_DEV_SHARED_H
+
+#include <linux/list.h>
+#include <linux/refcount.h>
+#include <net/sch_generic.h>
+
+/* Must be the first member of the qdisc's own shared structure */
+struct qdisc_dev_shared {
+	struct list_head	list;
+	const struct net_device	*dev;
+	const struct Qdisc_ops	*ops;
+	refcount_t		refcnt;
+};
+
+struct qdisc_dev_shared *qdisc_dev_shared_get(struct Qdisc *sch, size_t size);
+void qdisc_dev_shared_put(struct qdisc_dev_shared *shared);
+
+#endif
@@ -68,12 +68,35 @@ struct fq_flow {
 	int		qlen;		/* number of packets in flow queue */
 	int		credit;
 	u32		socket_hash;	/* sk_hash */
+	u16		wheel_slot;	/* slot in q->wheel, or FQ_WHEEL_NONE */
 	struct fq_flow *next;		/* next pointer in RR lists, or &detached */
 
-	struct rb_node  rate_node;	/* anchor in q->delayed tree */
+	union {
+		struct rb_node  rate_node;	/* anchor in q->delayed tree */
+		struct hlist_node wheel_node;	/* anchor in q->wheel slot */
+	};
 	u64		time_next_packet;
 };
 
+/* Throttled flows due within FQ_WHEEL_SLOTS << FQ_WHEEL_GRAN_LOG ns (~33 ms)
+ * are kept in a timing wheel: throttling a flow and releasing it once due
+ * cost O(1), instead of O(log n) and cache misses in the q->delayed tree,
+ * which only keeps the flows paced further away, until the wheel gets
+ * close enough to them.
+ */
+#define FQ_WHEEL_LOG		10
+#define FQ_WHEEL_SLOTS		(1U << FQ_WHEEL_LOG)
+#define FQ_WHEEL_MASK		(FQ_WHEEL_SLOTS - 1)
+#define FQ_WHEEL_GRAN_LOG	15		/* 32.768 usec per slot */
+#define FQ_WHEEL_NONE		U16_MAX
+
+struct fq_wheel {
+	DECLARE_BITMAP(map, FQ_WHEEL_SLOTS);	/* non empty slots */
+	u64		base;		/* time of the current slot */
+	u32		count;		/* number of flows in the wheel */
+	struct hlist_head slots[FQ_WHEEL_SLOTS];
+};
+
 struct fq_flow_head {
 	struct fq_flow *first;
 	struct fq_flow *last;
@@ -85,6 +108,7 @@ struct fq_sched_data {
 	struct fq_flow_head old_flows;
 
 	struct rb_root	delayed;	/* for rate limited flows */
+	struct fq_wheel	*wheel;		/* for those due soon */
 	u64		time_next_delayed_flow;
 	unsigned long	unthrottle_latency_ns;
 
@@ -145,12 +169,21 @@ static void fq_flow_add_tail(struct fq_flow_head *head, struct fq_flow *flow)
 
 static void fq_flow_unset_throttled(struct fq_sched_data *q, struct fq_flow *f)
 {
-	rb_erase(&f->rate_node, &q->delayed);
+	struct fq_wheel *w = q->wheel;
+
+	if (f->wheel_slot != FQ_WHEEL_NONE) {
+		hlist_del(&f->wheel_node);
+		if (hlist_empty(&w->slots[f->wheel_slot]))
+			__clear_bit(f->wheel_slot, w->map);
+		w->count--;
+	} else {
+		rb_erase(&f->rate_node, &q->delayed);
+	}
 	q->throttled_flows--;
 	fq_flow_add_tail(&q->old_flows, f);
 }
 
-static void fq_flow_set_throttled(struct fq_sched_data *q, struct fq_flow *f)
+static void fq_delayed_insert(struct fq_sched_data *q, struct fq_flow *f)
 {
 	struct rb_node **p = &q->delayed.rb_node, *parent = NULL;
 
@@ -166,6 +199,29 @@ static void fq_flow_set_throttled(struct fq_sched_data *q, struct fq_flow *f)
 	}
 	rb_link_node(&f->rate_node, parent, p);
 	rb_insert_color(&f->rate_node, &q->delayed);
+	f->wheel_slot = FQ_WHEEL_NONE;
+}
+
+static void fq_wheel_insert(struct fq_sched_data *q, struct fq_flow *f)
+{
+	struct fq_wheel *w = q->wheel;
+	u64 t = f->time_next_packet >> FQ_WHEEL_GRAN_LOG;
+	unsigned int slot;
+
+	if (t >= w->base + FQ_WHEEL_SLOTS) {
+		fq_delayed_insert(q, f);
+		return;
+	}
+	slot = max(t, w->base) & FQ_WHEEL_MASK;
+	hlist_add_head(&f->wheel_node, &w->slots[slot]);
+	__set_bit(slot, w->map);
+	f->wheel_slot = slot;
+	w->count++;
+}
+
+static void fq_flow_set_throttled(struct fq_sched_data *q, struct fq_flow *f)
+{
+	fq_wheel_insert(q, f);
 	q->throttled_flows++;
 	q->stat_throttled++;
 
@@ -430,10 +486,45 @@ static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	return NET_XMIT_SUCCESS;
 }
 
+static u64 fq_time_next_delayed_flow(const struct fq_sched_data *q)
+{
+	const struct fq_wheel *w = q->wheel;
+	u64 next = ~0ULL;
+	struct rb_node *p;
+	struct fq_flow *f;
+	unsigned int slot;
+
+	if (w->count) {
+		slot = find_next_bit(w->map, FQ_WHEEL_SLOTS,
+				     w->base & FQ_WHEEL_MASK);
+		if (slot >= FQ_WHEEL_SLOTS)
+			slot = find_first_bit(w->map, FQ_WHEEL_SLOTS);
+		hlist_for_each_entry(f, &w->slots[slot], wheel_node)
+			next = min(next, f->time_next_packet);
+	}
+	/* The wheel moved since the flows of the tree were inserted, it may
+	 * now cover them too.
+	 */
+	p = rb_first(&q->delayed);
+	if (p) {
+		f = rb_entry(p, struct fq_flow, rate_node);
+		next = min(next, f->time_next_packet);
+	}
+	return next;
+}
+
 static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 {
+	struct fq_wheel *w = q->wheel;
+	u64 tnow = now >> FQ_WHEEL_GRAN_LOG;
+	unsigned int i, span, first;
 	unsigned long sample;
+	struct hlist_node *n;
 	struct rb_node *p;
+	struct fq_flow *f;
+
+	if (!w->count)
+		w->base = tnow;
 
 	if (q->time_next_delayed_flow > now)
 		return;
@@ -445,16 +536,41 @@ static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 	q->unthrottle_latency_ns -= q->unthrottle_latency_ns >> 3;
 	q->unthrottle_latency_ns += sample >> 3;
 
-	q->time_next_delayed_flow = ~0ULL;
+	/* Slots behind the current one only hold due flows.  We usually run
+	 * at least once per slot, so span is 1 or 2.
+	 */
+	span = min_t(u64, tnow - w->base + 1, FQ_WHEEL_SLOTS);
+	first = w->base & FQ_WHEEL_MASK;
+	for (i = 0; i < span && w->count; i++) {
+		unsigned int slot = (first + i) & FQ_WHEEL_MASK;
+
+		if (!test_bit(slot, w->map))
+			continue;
+		hlist_for_each_entry_safe(f, n, &w->slots[slot], wheel_node) {
+			if (f->time_next_packet <= now)
+				fq_flow_unset_throttled(q, f);
+		}
+	}
+	w->base = tnow;
+
+	/* Release the due flows of the tree, and move to the wheel the ones
+	 * it now covers.
+	 */
 	while ((p = rb_first(&q->delayed)) != NULL) {
-		struct fq_flow *f = rb_entry(p, struct fq_flow, rate_node);
+		f = rb_entry(p, struct fq_flow, rate_node);
 
 		if (f->time_next_packet > now) {
-			q->time_next_delayed_flow = f->time_next_packet;
-			break;
+			if ((f->time_next_packet >> FQ_WHEEL_GRAN_LOG) >=
+			    w->base + FQ_WHEEL_SLOTS)
+				break;
+			rb_erase(p, &q->delayed);
+			fq_wheel_insert(q, f);
+			continue;
 		}
 		fq_flow_unset_throttled(q, f);
 	}
+
+	q->time_next_delayed_flow = fq_time_next_delayed_flow(q);
 }
 
 static struct sk_buff *fq_dequeue(struct Qdisc *sch)
@@ -592,6 +708,10 @@ static void fq_reset(struct Qdisc *sch)
 			kmem_cache_free(fq_flow_cachep, f);
 		}
 	}
+	bitmap_zero(q->wheel->map, FQ_WHEEL_SLOTS);
+	for (idx = 0; idx < FQ_WHEEL_SLOTS; idx++)
+		INIT_HLIST_HEAD(&q->wheel->slots[idx]);
+	q->wheel->count		= 0;
 	q->new_flows.first	= NULL;
 	q->old_flows.first	= NULL;
 	q->delayed		= RB_ROOT;
@@ -799,6 +919,7 @@ static void fq_destroy(struct Qdisc *sch)
 
 	fq_reset(sch);
 	fq_free(q->fq_root);
+	kvfree(q->wheel);
 	qdisc_watchdog_cancel(&q->watchdog);
 }
 
@@ -825,6 +946,11 @@ static int fq_init(struct Qdisc *sch, struct nlattr *opt,
 	q->low_rate_threshold	= 550000 / 8;
 	qdisc_watchdog_init(&q->watchdog, sch);
 
+	q->wheel = kvzalloc(sizeof(*q->wheel), GFP_KERNEL);
+	if (!q->wheel)
+		return -ENOMEM;
+	q->wheel->base = ktime_get_ns() >> FQ_WHEEL_GRAN_LOG;
+
 	if (opt)
 		err = fq_change(sch, opt, extack);
 	else
@@ -28,6 +28,8 @@
 #include <net/codel_impl.h>
 #include <net/codel_qdisc.h>
 
+#include "sch_dev_shared.h"
+
 /*	Fair Queue CoDel.
  *
  * Principles :
@@ -53,6 +55,22 @@ struct fq_codel_flow {
 	struct codel_vars cvars;
 }; /* please try to keep this structure <= 64 bytes */
 
+#ifndef TCA_FQ_CODEL_DEV_MEMORY_LIMIT
+#define TCA_FQ_CODEL_DEV_MEMORY_LIMIT	32
+#endif
+
+#define FQ_CODEL_ATTR_MAX	TCA_FQ_CODEL_DEV_MEMORY_LIMIT
+
+/* Memory budget shared by the fq_codel instances of a device, typically
+ * the children of mq: each TX queue keeps its own lock and flows, while
+ * the device as a whole keeps the bound of a single fq_codel.
+ */
+struct fq_codel_shared {
+	struct qdisc_dev_shared	common;
+	u32			memory_limit;
+	atomic_t		memory_usage;
+};
+
 struct fq_codel_sched_data {
 	struct tcf_proto __rcu *filter_list; /* optional external classifier */
 	struct tcf_block *block;
@@ -68,11 +86,39 @@ struct fq_codel_sched_data {
 	u32		drop_overmemory;
 	u32		drop_overlimit;
 	u32		new_flow_count;
+	struct fq_codel_shared *shared;	/* device wide memory budget */
 
 	struct list_head new_flows;	/* list of new flows */
 	struct list_head old_flows;	/* list of old flows */
 };
 
+static struct fq_codel_shared *fq_codel_shared_get(struct Qdisc *sch)
+{
+	struct qdisc_dev_shared *shared;
+
+	shared = qdisc_dev_shared_get(sch, sizeof(struct fq_codel_shared));
+	return shared ? container_of(shared, struct fq_codel_shared, common) :
+			NULL;
+}
+
+/* Returns true if the device wide memory budget is exceeded */
+static bool fq_codel_charge(struct fq_codel_sched_data *q, unsigned int mem)
+{
+	q->memory_usage += mem;
+	if (q->shared &&
+	    atomic_add_return(mem, &q->shared->memory_usage) >
+	    READ_ONCE(q->shared->memory_limit))
+		return true;
+	return q->memory_usage > q->memory_limit;
+}
+
+static void fq_codel_uncharge(struct fq_codel_sched_data *q, unsigned int mem)
+{
+	q->memory_usage -= mem;
+	if (q->shared)
+		atomic_sub(mem, &q->shared->memory_usage);
+}
+
 static unsigned int fq_codel_hash(const struct fq_codel_sched_data *q,
 				  struct sk_buff *skb)
 {
@@ -179,7 +225,7 @@ static unsigned int fq_codel_drop(struct Qdisc *sch, unsigned int max_packets,
 
 	flow->dropped += i;
 	q->backlogs[idx] -= len;
-	q->memory_usage -= mem;
+	fq_codel_uncharge(q, mem);
 	sch->qstats.drops += i;
 	sch->qstats.backlog -= len;
 	sch->q.qlen -= i;
@@ -218,8 +264,7 @@ static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 		flow->dropped = 0;
 	}
 	get_codel_cb(skb)->mem_usage = skb->truesize;
-	q->memory_usage += get_codel_cb(skb)->mem_usage;
-	memory_limited = q->memory_usage > q->memory_limit;
+	memory_limited = fq_codel_charge(q, get_codel_cb(skb)->mem_usage);
 	if (++sch->q.qlen <= sch->limit && !memory_limited)
 		return NET_XMIT_SUCCESS;
 
@@ -229,7 +274,9 @@ static int fq_codel_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 	/* save this packet length as it might be dropped by fq_codel_drop() */
 	pkt_len = qdisc_pkt_len(skb);
 	/* fq_codel_drop() is quite expensive, as it performs a linear search
-	 * in q->backlogs[] to find a fat flow.
+	 * in q->backlogs[] to find a fat flow.  Over the device wide budget,
+	 * the fat flow is looked for among our own flows only: the other
+	 * instances sharing it run under their own locks.
 	 * So instead of dropping a single packet, drop half of its backlog
 	 * with a 64 packets limit to not add a too big cpu spike here.
 	 */
@@ -269,7 +316,7 @@ static struct sk_buff *dequeue_func(struct codel_vars *vars, void *ctx)
 	if (flow->head) {
 		skb = dequeue_head(flow);
 		q->backlogs[flow - q->flows] -= qdisc_pkt_len(skb);
-		q->memory_usage -= get_codel_cb(skb)->mem_usage;
+		fq_codel_uncharge(q, get_codel_cb(skb)->mem_usage);
 		sch->q.qlen--;
 		sch->qstats.backlog -= qdisc_pkt_len(skb);
 	}
@@ -362,10 +409,10 @@ static void fq_codel_reset(struct Qdisc *sch)
 	memset(q->backlogs, 0, q->flows_cnt * sizeof(u32));
 	sch->q.qlen = 0;
 	sch->qstats.backlog = 0;
-	q->memory_usage = 0;
+	fq_codel_uncharge(q, q->memory_usage);
 }
 
-static const struct nla_policy fq_codel_policy[TCA_FQ_CODEL_MAX + 1] = {
+static const struct nla_policy fq_codel_policy[FQ_CODEL_ATTR_MAX + 1] = {
 	[TCA_FQ_CODEL_TARGET]	= { .type = NLA_U32 },
 	[TCA_FQ_CODEL_LIMIT]	= { .type = NLA_U32 },
 	[TCA_FQ_CODEL_INTERVAL]	= { .type = NLA_U32 },
@@ -375,19 +422,22 @@ static const struct nla_policy fq_codel_policy[TCA_FQ_CODEL_MAX + 1] = {
 	[TCA_FQ_CODEL_CE_THRESHOLD] = { .type = NLA_U32 },
 	[TCA_FQ_CODEL_DROP_BATCH_SIZE] = { .type = NLA_U32 },
 	[TCA_FQ_CODEL_MEMORY_LIMIT] = { .type = NLA_U32 },
+	[TCA_FQ_CODEL_DEV_MEMORY_LIMIT] = { .type = NLA_U32 },
 };
 
 static int fq_codel_change(struct Qdisc *sch, struct nlattr *opt,
 			   struct netlink_ext_ack *extack)
 {
 	struct fq_codel_sched_data *q = qdisc_priv(sch);
-	struct nlattr *tb[TCA_FQ_CODEL_MAX + 1];
+	struct fq_codel_shared *shared = NULL, *old = NULL;
+	struct nlattr *tb[FQ_CODEL_ATTR_MAX + 1];
+	u32 dev_memory_limit = 0;
 	int err;
 
 	if (!opt)
 		return -EINVAL;
 
-	err = nla_parse_nested(tb, TCA_FQ_CODEL_MAX, opt, fq_codel_policy,
+	err = nla_parse_nested(tb, FQ_CODEL_ATTR_MAX, opt, fq_codel_policy,
 			       NULL);
 	if (err < 0)
 		return err;
@@ -399,8 +449,32 @@ static int fq_codel_change(struct Qdisc *sch, struct nlattr *opt,
 		    q->flows_cnt > 65536)
 			return -EINVAL;
 	}
+	if (tb[TCA_FQ_CODEL_DEV_MEMORY_LIMIT]) {
+		u32 val = nla_get_u32(tb[TCA_FQ_CODEL_DEV_MEMORY_LIMIT]);
+
+		dev_memory_limit = min(1U << 31, val);
+		if (dev_memory_limit && !q->shared) {
+			shared = fq_codel_shared_get(sch);
+			if (!shared)
+				return -ENOMEM;
+		}
+	}
 	sch_tree_lock(sch);
 
+	if (tb[TCA_FQ_CODEL_DEV_MEMORY_LIMIT]) {
+		if (shared) {
+			q->shared = shared;
+			atomic_add(q->memory_usage, &shared->memory_usage);
+		} else if (!dev_memory_limit && q->shared) {
+			old = q->shared;
+			atomic_sub(q->memory_usage, &old->memory_usage);
+			q->shared = NULL;
+		}
+		/* The last value given applies to the whole device */
+		if (q->shared)
+			WRITE_ONCE(q->shared->memory_limit, dev_memory_limit);
+	}
+
 	if (tb[TCA_FQ_CODEL_TARGET]) {
 		u64 target = nla_get_u32(tb[TCA_FQ_CODEL_TARGET]);
 
@@ -447,6 +521,8 @@ static int fq_codel_change(struct Qdisc *sch, struct nlattr *opt,
 	q->cstats.drop_len = 0;
 
 	sch_tree_unlock(sch);
+	if (old)
+		qdisc_dev_shared_put(&old->common);
 	return 0;
 }
 
@@ -455,6 +531,10 @@ static void fq_codel_destroy(struct Qdisc *sch)
 	struct fq_codel_sched_data *q = qdisc_priv(sch);
 
 	tcf_block_put(q->block);
+	if (q->shared) {
+		fq_codel_uncharge(q, q->memory_usage);
+		qdisc_dev_shared_put(&q->shared->common);
+	}
 	kvfree(q->backlogs);
 	kvfree(q->flows);
 }
@@ -549,6 +629,11 @@ static int fq_codel_dump(struct Qdisc *sch, struct sk_buff *skb)
 			q->flows_cnt))
 		goto nla_put_failure;
 
+	if (q->shared &&
+	    nla_put_u32(skb, TCA_FQ_CODEL_DEV_MEMORY_LIMIT,
+			READ_ONCE(q->shared->memory_limit)))
+		goto nla_put_failure;
+
 	if (q->cparams.ce_threshold != CODEL_DISABLED_THRESHOLD &&
 	    nla_put_u32(skb, TCA_FQ_CODEL_CE_THRESHOLD,
 			codel_time_to_us(q->cparams.ce_threshold)))
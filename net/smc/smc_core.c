@@ -698,6 +698,41 @@ static struct smc_buf_desc *smc_buf_get_slot(int compressed_bufsize,
 	return NULL;
 }
 
+/* number of size classes above the wanted one a free buffer may be taken
+ * from, rather than creating a buffer of the wanted size
+ */
+#define SMC_BUF_REUSE_LARGER	2
+
+/* creating a buffer means allocating, mapping and, for an RMB, registering
+ * it with the device, which costs much more than the rest of connection
+ * setup; so prefer a free buffer of the link group up to
+ * SMC_BUF_REUSE_LARGER size classes larger than the wanted one
+ */
+static struct smc_buf_desc *smc_buf_get_larger_slot(struct smc_link_group *lgr,
+						    bool is_rmb,
+						    int *bufsize_short)
+{
+	struct smc_buf_desc *buf_desc;
+	rwlock_t *lock;
+	int i;
+
+	lock = is_rmb ? &lgr->rmbs_lock : &lgr->sndbufs_lock;
+	for (i = *bufsize_short + 1;
+	     i <= *bufsize_short + SMC_BUF_REUSE_LARGER && i < SMC_RMBE_SIZES;
+	     i++) {
+		if ((1 << get_order(smc_uncompress_bufsize(i))) >
+		    SG_MAX_SINGLE_ALLOC)
+			break;
+		buf_desc = smc_buf_get_slot(i, lock, is_rmb ? &lgr->rmbs[i] :
+							      &lgr->sndbufs[i]);
+		if (buf_desc) {
+			*bufsize_short = i;
+			return buf_desc;
+		}
+	}
+	return NULL;
+}
+
 /* one of the conditions for announcing a receiver's current window size is
  * that it "results in a minimum increase in the window size of 10% of the
  * receive buffer space" [RFC7609]
@@ -810,6 +845,7 @@ static int __smc_buf_create(struct smc_sock *smc, bool is_smcd, bool is_rmb)
 	struct smc_link_group *lgr = conn->lgr;
 	struct list_head *buf_list;
 	int bufsize, bufsize_short;
+	bool tried_larger = false;
 	int sk_buf_size;
 	rwlock_t *lock;
 
@@ -836,6 +872,12 @@ static int __smc_buf_create(struct smc_sock *smc, bool is_smcd, bool is_rmb)
 
 		/* check for reusable slot in the link group */
 		buf_desc = smc_buf_get_slot(bufsize_short, lock, buf_list);
+		if (!buf_desc && !tried_larger) {
+			tried_larger = true;
+			buf_desc = smc_buf_get_larger_slot(lgr, is_rmb,
+							   &bufsize_short);
+			bufsize = smc_uncompress_bufsize(bufsize_short);
+		}
 		if (buf_desc) {
 			memset(buf_desc->cpu_addr, 0, bufsize);
 			break; /* found reusable slot */
@@ -45,6 +45,8 @@ static LIST_HEAD(svc_xprt_class_list);
 /* SMP locking strategy:
  *
  *	svc_pool->sp_lock protects most of the fields of that pool.
+ *	Transports are queued to a pool on its sp_new_sockets llist without
+ *	it; they are moved to sp_sockets under sp_lock when it runs empty.
  *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt.
  *	when both need to be taken (rare), svc_serv->sv_lock is first.
  *	The "service mutex" protects svc_serv->sv_nrthread.
@@ -398,15 +400,19 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 
 	atomic_long_inc(&pool->sp_stats.packets);
 
-	spin_lock_bh(&pool->sp_lock);
-	list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
-	pool->sp_stats.sockets_queued++;
-	spin_unlock_bh(&pool->sp_lock);
+	/* XPT_BUSY makes us the only one queueing it, so no lock is needed
+	 * against the other producers; the consumers take sp_lock.
+	 */
+	llist_add(&xprt->xpt_ready_node, &pool->sp_new_sockets);
+	atomic_long_inc(&pool->sp_stats.sockets_queued);
 
-	/* find a thread for this xprt */
+	/* find a thread for this xprt; only write to the flags of one that
+	 * looks idle, not to the cache lines of all the busy ones
+	 */
 	rcu_read_lock();
 	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
+		if (test_bit(RQ_BUSY, &rqstp->rq_flags) ||
+		    test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
 			continue;
 		atomic_long_inc(&pool->sp_stats.threads_woken);
 		rqstp->rq_qtime = ktime_get();
@@ -435,6 +441,27 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 
+static bool svc_pool_has_sockets(struct svc_pool *pool)
+{
+	return !list_empty(&pool->sp_sockets) ||
+	       !llist_empty(&pool->sp_new_sockets);
+}
+
+/*
+ * Move all the transports queued since the last call to the tail of
+ * sp_sockets, oldest first.  Called with sp_lock held; whatever is on
+ * sp_sockets already was queued before them, so the order is kept.
+ */
+static void svc_pool_splice_new(struct svc_pool *pool)
+{
+	struct llist_node *node = llist_del_all(&pool->sp_new_sockets);
+	struct svc_xprt *xprt, *tmp;
+
+	node = llist_reverse_order(node);
+	llist_for_each_entry_safe(xprt, tmp, node, xpt_ready_node)
+		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
+}
+
 /*
  * Dequeue the first transport, if there is one.
  */
@@ -442,10 +469,13 @@ static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 {
 	struct svc_xprt	*xprt = NULL;
 
-	if (list_empty(&pool->sp_sockets))
+	if (!svc_pool_has_sockets(pool))
 		goto out;
 
 	spin_lock_bh(&pool->sp_lock);
+	/* Take the whole batch queued meanwhile in one go */
+	if (list_empty(&pool->sp_sockets))
+		svc_pool_splice_new(pool);
 	if (likely(!list_empty(&pool->sp_sockets))) {
 		xprt = list_first_entry(&pool->sp_sockets,
 					struct svc_xprt, xpt_ready);
@@ -664,7 +694,7 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 		return false;
 
 	/* was a socket queued? */
-	if (!list_empty(&pool->sp_sockets))
+	if (svc_pool_has_sockets(pool))
 		return false;
 
 	/* are we shutting down? */
@@ -1069,6 +1099,7 @@ static struct svc_xprt *svc_dequeue_net(struct svc_serv *serv, struct net *net)
 		pool = &serv->sv_pools[i];
 
 		spin_lock_bh(&pool->sp_lock);
+		svc_pool_splice_new(pool);
 		list_for_each_entry_safe(xprt, tmp, &pool->sp_sockets, xpt_ready) {
 			if (xprt->xpt_net != net)
 				continue;
@@ -1391,7 +1422,7 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 	seq_printf(m, "%u %lu %lu %lu %lu\n",
 		pool->sp_id,
 		(unsigned long)atomic_long_read(&pool->sp_stats.packets),
-		pool->sp_stats.sockets_queued,
+		(unsigned long)atomic_long_read(&pool->sp_stats.sockets_queued),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_woken),
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout));
 
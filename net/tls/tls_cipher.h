@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0 OR Linux-OpenIB */
+/*
+ * TLS 1.3 record framing and ChaCha20-Poly1305 for the software path.
+ *
+ * Both keep no explicit nonce in the records: the nonce of a record is
+ * the IV given at setsockopt() time xor'ed with its sequence number, so
+ * cipher_context.iv_size, the size of the explicit nonce, is 0 for them.
+ */
+#ifndef _TLS_CIPHER_H
+#define _TLS_CIPHER_H
+
+#include <net/tls.h>
+
+/* The uapi definitions, for uapi/linux/tls.h versions lacking them */
+#ifndef TLS_1_3_VERSION
+#define TLS_1_3_VERSION_MAJOR	0x3
+#define TLS_1_3_VERSION_MINOR	0x4
+#define TLS_1_3_VERSION		TLS_VERSION_NUMBER(TLS_1_3)
+#endif
+
+#ifndef TLS_CIPHER_CHACHA20_POLY1305
+#define TLS_CIPHER_CHACHA20_POLY1305			54
+#define TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE		12
+#define TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE		32
+#define TLS_CIPHER_CHACHA20_POLY1305_SALT_SIZE		0
+#define TLS_CIPHER_CHACHA20_POLY1305_TAG_SIZE		16
+#define TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE	8
+
+struct tls12_crypto_info_chacha20_poly1305 {
+	struct tls_crypto_info info;
+	unsigned char iv[TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE];
+	unsigned char key[TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE];
+	unsigned char salt[TLS_CIPHER_CHACHA20_POLY1305_SALT_SIZE];
+	unsigned char rec_seq[TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE];
+};
+#endif
+
+/* Size of the AEAD nonce of both ciphers */
+#define TLS_NONCE_SIZE		12
+
+/* The AAD of a TLS 1.3 record is its header */
+#define TLS_1_3_AAD_SIZE	TLS_HEADER_SIZE
+
+/* How much larger than its plaintext a TLS 1.3 record may be */
+#define TLS_1_3_MAX_EXPANSION	256
+
+static inline bool tls_is_tls13(const struct tls_crypto_info *info)
+{
+	return info->version == TLS_1_3_VERSION;
+}
+
+static inline bool tls_implicit_nonce(const struct tls_crypto_info *info)
+{
+	return tls_is_tls13(info) ||
+	       info->cipher_type == TLS_CIPHER_CHACHA20_POLY1305;
+}
+
+/* union tls_crypto_context has no room for a ChaCha20-Poly1305 key, so
+ * its crypto info is given here and only its header is kept in the
+ * context.
+ */
+int tls_set_sw_offload_info(struct sock *sk, struct tls_context *ctx, int tx,
+			    struct tls_crypto_info *crypto_info);
+
+#endif /* _TLS_CIPHER_H */
@@ -42,6 +42,8 @@
 
 #include <net/tls.h>
 
+#include "tls_cipher.h"
+
 MODULE_AUTHOR("Mellanox Technologies");
 MODULE_DESCRIPTION("Transport Layer Security Support");
 MODULE_LICENSE("Dual BSD/GPL");
@@ -378,6 +380,26 @@ static int do_tls_getsockopt_tx(struct sock *sk, char __user *optval,
 			rc = -EFAULT;
 		break;
 	}
+	case TLS_CIPHER_CHACHA20_POLY1305: {
+		/* The key is not kept, see tls_set_sw_offload_info() */
+		struct tls12_crypto_info_chacha20_poly1305 chacha_info = {
+			.info = *crypto_info,
+		};
+
+		if (len != sizeof(chacha_info)) {
+			rc = -EINVAL;
+			goto out;
+		}
+		lock_sock(sk);
+		memcpy(chacha_info.iv, ctx->tx.iv,
+		       TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE);
+		memcpy(chacha_info.rec_seq, ctx->tx.rec_seq,
+		       TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE);
+		release_sock(sk);
+		if (copy_to_user(optval, &chacha_info, sizeof(chacha_info)))
+			rc = -EFAULT;
+		break;
+	}
 	default:
 		rc = -EINVAL;
 	}
@@ -416,8 +438,10 @@ static int tls_getsockopt(struct sock *sk, int level, int optname,
 static int do_tls_setsockopt_conf(struct sock *sk, char __user *optval,
 				  unsigned int optlen, int tx)
 {
+	struct tls12_crypto_info_chacha20_poly1305 chacha_info;
 	struct tls_crypto_info *crypto_info;
 	struct tls_context *ctx = tls_get_ctx(sk);
+	bool chacha = false;
 	int rc = 0;
 	int conf;
 
@@ -444,7 +468,8 @@ static int do_tls_setsockopt_conf(struct sock *sk, char __user *optval,
 	}
 
 	/* check version */
-	if (crypto_info->version != TLS_1_2_VERSION) {
+	if (crypto_info->version != TLS_1_2_VERSION &&
+	    crypto_info->version != TLS_1_3_VERSION) {
 		rc = -ENOTSUPP;
 		goto err_crypto_info;
 	}
@@ -463,12 +488,30 @@ static int do_tls_setsockopt_conf(struct sock *sk, char __user *optval,
 		}
 		break;
 	}
+	case TLS_CIPHER_CHACHA20_POLY1305: {
+		/* Too large for the context, only its header is kept there */
+		if (optlen != sizeof(chacha_info)) {
+			rc = -EINVAL;
+			goto err_crypto_info;
+		}
+		if (copy_from_user(&chacha_info, optval, sizeof(chacha_info))) {
+			rc = -EFAULT;
+			goto err_crypto_info;
+		}
+		chacha = true;
+		break;
+	}
 	default:
 		rc = -EINVAL;
 		goto err_crypto_info;
 	}
 
-	if (tx) {
+	if (chacha) {
+		/* Only done in software */
+		rc = tls_set_sw_offload_info(sk, ctx, tx, &chacha_info.info);
+		memzero_explicit(&chacha_info, sizeof(chacha_info));
+		conf = TLS_SW;
+	} else if (tx) {
 #ifdef CONFIG_TLS_DEVICE
 		rc = tls_set_device_offload(sk, ctx);
 		conf = TLS_HW;
@@ -41,24 +41,130 @@
 #include <net/strparser.h>
 #include <net/tls.h>
 
+#include "tls_cipher.h"
+
 #define MAX_IV_SIZE	TLS_CIPHER_AES_GCM_128_IV_SIZE
 
+/* A closed record, being encrypted or waiting for its turn on the wire.
+ * Records are queued in sequence number order and only sent from the head
+ * of the queue, so they reach TCP in order whatever the order in which
+ * their encryptions complete.
+ */
+struct tls_rec {
+	struct list_head list;
+	struct sock *sk;
+	bool tx_ready;
+	int err;
+
+	int sg_plaintext_num_elem;
+	unsigned int sg_plaintext_size;
+	int sg_encrypted_num_elem;
+	unsigned int sg_encrypted_size;
+	/* One more entry for the content type of a TLS 1.3 record */
+	struct scatterlist sg_plaintext_data[MAX_SKB_FRAGS + 1];
+	struct scatterlist sg_encrypted_data[MAX_SKB_FRAGS];
+	struct scatterlist sg_aead_in[2];
+	struct scatterlist sg_aead_out[2];
+
+	char aad_space[TLS_AAD_SPACE_SIZE];
+	unsigned int aad_size;
+	char content_type;
+	u8 iv[TLS_NONCE_SIZE];
+
+	/* Must be last, followed by the request context of the tfm */
+	struct aead_request aead_req;
+};
+
+/* The software TX context, with the records encrypted asynchronously */
+struct tls_sw_context_tx_async {
+	struct tls_sw_context_tx base;
+	struct sock *sk;
+	struct list_head tx_list;
+	/* Where tls_push_sg() stopped in the record at the head of tx_list */
+	struct scatterlist *partial_sg;
+	u16 partial_offset;
+	/* In flight encryptions, plus one until the context is freed */
+	atomic_t encrypt_pending;
+	bool async_capable;
+	struct work_struct tx_work;
+};
+
+static inline struct tls_sw_context_tx_async *
+tls_sw_ctx_tx_async(struct tls_sw_context_tx *ctx)
+{
+	return container_of(ctx, struct tls_sw_context_tx_async, base);
+}
+
+/* The asynchronous decryptions of one tls_sw_recvmsg() call */
+struct tls_decrypt_async {
+	atomic_t pending;
+	int err;
+	struct completion done;
+};
+
+/* Follows the aead_request of an asynchronous decryption */
+struct tls_decrypt_ctx {
+	struct tls_decrypt_async *async;
+	struct sk_buff *skb;
+	struct scatterlist *sgout;
+	int pages;
+};
+
+static void tls_decrypt_done(struct crypto_async_request *req, int err)
+{
+	struct aead_request *aead_req = (struct aead_request *)req;
+	struct tls_decrypt_ctx *dctx = req->data;
+	struct tls_decrypt_async *async = dctx->async;
+
+	/* A backlogged request was started, its result is still to come */
+	if (err == -EINPROGRESS)
+		return;
+
+	if (err)
+		WRITE_ONCE(async->err, err);
+
+	/* Release the pages the iov was mapped to, the skb and the request */
+	for (; dctx->pages > 0; dctx->pages--)
+		put_page(sg_page(&dctx->sgout[dctx->pages]));
+	kfree_skb(dctx->skb);
+	kfree(aead_req);
+
+	if (atomic_dec_and_test(&async->pending))
+		complete(&async->done);
+}
+
 static int tls_do_decryption(struct sock *sk,
 			     struct scatterlist *sgin,
 			     struct scatterlist *sgout,
 			     char *iv_recv,
 			     size_t data_len,
-			     struct aead_request *aead_req)
+			     unsigned int aad_size,
+			     struct aead_request *aead_req,
+			     struct tls_decrypt_ctx *dctx)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
 	int ret;
 
 	aead_request_set_tfm(aead_req, ctx->aead_recv);
-	aead_request_set_ad(aead_req, TLS_AAD_SPACE_SIZE);
+	aead_request_set_ad(aead_req, aad_size);
 	aead_request_set_crypt(aead_req, sgin, sgout,
 			       data_len + tls_ctx->rx.tag_size,
 			       (u8 *)iv_recv);
+
+	if (dctx) {
+		aead_request_set_callback(aead_req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+					  tls_decrypt_done, dctx);
+		atomic_inc(&dctx->async->pending);
+		ret = crypto_aead_decrypt(aead_req);
+		if (ret == -EINPROGRESS || ret == -EBUSY)
+			return -EINPROGRESS;
+
+		/* Completed synchronously, without calling back */
+		atomic_dec(&dctx->async->pending);
+		return ret;
+	}
+
 	aead_request_set_callback(aead_req, CRYPTO_TFM_REQ_MAY_BACKLOG,
 				  crypto_req_done, &ctx->async_wait);
 
@@ -172,88 +278,295 @@ static void tls_free_both_sg(struct sock *sk)
 		&ctx->sg_plaintext_size);
 }
 
+/* The nonce of the next record: the IV and the explicit nonce of TLS 1.2
+ * with AES-GCM, the IV xor'ed with the sequence number otherwise.
+ */
+static void tls_sw_make_nonce(u8 *nonce, const struct tls_crypto_info *info,
+			      const struct cipher_context *cctx)
+{
+	int i;
+
+	memcpy(nonce, cctx->iv, TLS_NONCE_SIZE);
+	if (!tls_implicit_nonce(info))
+		return;
+
+	for (i = 0; i < cctx->rec_seq_size; i++)
+		nonce[TLS_NONCE_SIZE - cctx->rec_seq_size + i] ^=
+			cctx->rec_seq[i];
+}
+
+/* The header of a record of data_len bytes of (inner) plaintext */
+static void tls_sw_fill_prepend(struct tls_context *tls_ctx, char *buf,
+				size_t data_len, unsigned char record_type)
+{
+	size_t pkt_len;
+
+	if (!tls_implicit_nonce(&tls_ctx->crypto_send.info)) {
+		tls_fill_prepend(tls_ctx, buf, data_len, record_type);
+		return;
+	}
+
+	/* No explicit nonce, and TLS 1.3 claims to be TLS 1.2 on the wire */
+	pkt_len = data_len + tls_ctx->tx.tag_size;
+	buf[0] = record_type;
+	buf[1] = TLS_VERSION_MINOR(TLS_1_2_VERSION);
+	buf[2] = TLS_VERSION_MAJOR(TLS_1_2_VERSION);
+	buf[3] = pkt_len >> 8;
+	buf[4] = pkt_len & 0xFF;
+}
+
+static void tls_free_rec(struct sock *sk, struct tls_rec *rec)
+{
+	free_sg(sk, rec->sg_plaintext_data, &rec->sg_plaintext_num_elem,
+		&rec->sg_plaintext_size);
+	free_sg(sk, rec->sg_encrypted_data, &rec->sg_encrypted_num_elem,
+		&rec->sg_encrypted_size);
+	kfree(rec);
+}
+
+static void tls_encrypt_done(struct crypto_async_request *req, int err)
+{
+	struct tls_rec *rec = req->data;
+	struct tls_context *tls_ctx = tls_get_ctx(rec->sk);
+	struct tls_sw_context_tx_async *actx;
+
+	/* A backlogged request was started, its result is still to come */
+	if (err == -EINPROGRESS)
+		return;
+
+	actx = tls_sw_ctx_tx_async(tls_sw_ctx_tx(tls_ctx));
+
+	rec->sg_encrypted_data[0].offset -= tls_ctx->tx.prepend_size;
+	rec->sg_encrypted_data[0].length += tls_ctx->tx.prepend_size;
+	rec->err = err;
+	smp_store_release(&rec->tx_ready, true);
+
+	/* The records are sent from process context, under the socket lock */
+	schedule_work(&actx->tx_work);
+
+	if (atomic_dec_and_test(&actx->encrypt_pending))
+		complete(&actx->base.async_wait.completion);
+}
+
 static int tls_do_encryption(struct tls_context *tls_ctx,
 			     struct tls_sw_context_tx *ctx,
-			     struct aead_request *aead_req,
+			     struct tls_rec *rec,
 			     size_t data_len)
 {
+	struct tls_sw_context_tx_async *actx = tls_sw_ctx_tx_async(ctx);
+	struct aead_request *aead_req = &rec->aead_req;
 	int rc;
 
-	ctx->sg_encrypted_data[0].offset += tls_ctx->tx.prepend_size;
-	ctx->sg_encrypted_data[0].length -= tls_ctx->tx.prepend_size;
+	rec->sg_encrypted_data[0].offset += tls_ctx->tx.prepend_size;
+	rec->sg_encrypted_data[0].length -= tls_ctx->tx.prepend_size;
 
 	aead_request_set_tfm(aead_req, ctx->aead_send);
-	aead_request_set_ad(aead_req, TLS_AAD_SPACE_SIZE);
-	aead_request_set_crypt(aead_req, ctx->sg_aead_in, ctx->sg_aead_out,
-			       data_len, tls_ctx->tx.iv);
+	aead_request_set_ad(aead_req, rec->aad_size);
+	aead_request_set_crypt(aead_req, rec->sg_aead_in, rec->sg_aead_out,
+			       data_len, rec->iv);
 
 	aead_request_set_callback(aead_req, CRYPTO_TFM_REQ_MAY_BACKLOG,
-				  crypto_req_done, &ctx->async_wait);
+				  tls_encrypt_done, rec);
+
+	atomic_inc(&actx->encrypt_pending);
+	rc = crypto_aead_encrypt(aead_req);
+	if (rc == -EINPROGRESS || rc == -EBUSY)
+		return -EINPROGRESS;
+
+	/* Completed synchronously, without calling back */
+	atomic_dec(&actx->encrypt_pending);
+
+	rec->sg_encrypted_data[0].offset -= tls_ctx->tx.prepend_size;
+	rec->sg_encrypted_data[0].length += tls_ctx->tx.prepend_size;
+	rec->tx_ready = true;
 
-	rc = crypto_wait_req(crypto_aead_encrypt(aead_req), &ctx->async_wait);
+	return rc;
+}
+
+/* Send the records at the head of tx_list whose encryption is done.  Ready
+ * records following each other go to TCP as one batch, only the last one
+ * pushing the frames out.
+ */
+static int tls_tx_records(struct sock *sk, int flags)
+{
+	struct tls_context *tls_ctx = tls_get_ctx(sk);
+	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
+	struct tls_sw_context_tx_async *actx = tls_sw_ctx_tx_async(ctx);
+	struct tls_rec *rec, *next;
+	struct scatterlist *sg;
+	u16 offset;
+	int rc = 0;
+
+	/* Called from sk_write_space() in the middle of tls_push_sg() */
+	if (tls_ctx->in_tcp_sendpages)
+		return 0;
+
+	list_for_each_entry_safe(rec, next, &actx->tx_list, list) {
+		int tx_flags = flags;
+
+		if (!smp_load_acquire(&rec->tx_ready))
+			break;
+
+		if (rec->err) {
+			rc = -EBADMSG;
+			break;
+		}
 
-	ctx->sg_encrypted_data[0].offset -= tls_ctx->tx.prepend_size;
-	ctx->sg_encrypted_data[0].length += tls_ctx->tx.prepend_size;
+		free_sg(sk, rec->sg_plaintext_data,
+			&rec->sg_plaintext_num_elem, &rec->sg_plaintext_size);
+
+		if (!list_is_last(&rec->list, &actx->tx_list) &&
+		    smp_load_acquire(&next->tx_ready))
+			tx_flags |= MSG_SENDPAGE_NOTLAST;
+
+		if (actx->partial_sg) {
+			sg = actx->partial_sg;
+			offset = actx->partial_offset;
+			actx->partial_sg = NULL;
+		} else {
+			sg = rec->sg_encrypted_data;
+			offset = 0;
+		}
+
+		rc = tls_push_sg(sk, tls_ctx, sg, offset, tx_flags);
+		if (rc) {
+			/* The rest of the record is resent from here, keep
+			 * tls_push_pending_closed_record() off it.
+			 */
+			actx->partial_sg = tls_ctx->partially_sent_record;
+			actx->partial_offset = tls_ctx->partially_sent_offset;
+			tls_ctx->partially_sent_record = NULL;
+
+			/* Retried from tls_write_space() */
+			set_bit(TLS_PENDING_CLOSED_RECORD, &tls_ctx->flags);
+			break;
+		}
+
+		list_del(&rec->list);
+		kfree(rec);
+	}
+
+	if (rc < 0 && rc != -EAGAIN)
+		tls_err_abort(sk, EBADMSG);
 
 	return rc;
 }
 
+static void tls_tx_work_handler(struct work_struct *work)
+{
+	struct tls_sw_context_tx_async *actx =
+		container_of(work, struct tls_sw_context_tx_async, tx_work);
+	struct sock *sk = actx->sk;
+
+	lock_sock(sk);
+	tls_tx_records(sk, MSG_DONTWAIT | MSG_NOSIGNAL);
+	release_sock(sk);
+}
+
 static int tls_push_record(struct sock *sk, int flags,
 			   unsigned char record_type)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
-	struct aead_request *req;
+	struct tls_sw_context_tx_async *actx = tls_sw_ctx_tx_async(ctx);
+	struct tls_crypto_info *info = &tls_ctx->crypto_send.info;
+	size_t data_len;
+	struct tls_rec *rec;
+	char *prepend;
 	int rc;
 
-	req = aead_request_alloc(ctx->aead_send, sk->sk_allocation);
-	if (!req)
+	rec = kmalloc(sizeof(*rec) + crypto_aead_reqsize(ctx->aead_send),
+		      sk->sk_allocation);
+	if (!rec)
 		return -ENOMEM;
 
 	sg_mark_end(ctx->sg_plaintext_data + ctx->sg_plaintext_num_elem - 1);
 	sg_mark_end(ctx->sg_encrypted_data + ctx->sg_encrypted_num_elem - 1);
 
-	tls_make_aad(ctx->aad_space, ctx->sg_plaintext_size,
-		     tls_ctx->tx.rec_seq, tls_ctx->tx.rec_seq_size,
-		     record_type);
-
-	tls_fill_prepend(tls_ctx,
-			 page_address(sg_page(&ctx->sg_encrypted_data[0])) +
-			 ctx->sg_encrypted_data[0].offset,
-			 ctx->sg_plaintext_size, record_type);
+	/* Move the record out of the context, which opens the next one */
+	rec->sk = sk;
+	rec->tx_ready = false;
+	rec->err = 0;
+	rec->sg_plaintext_num_elem = ctx->sg_plaintext_num_elem;
+	rec->sg_plaintext_size = ctx->sg_plaintext_size;
+	rec->sg_encrypted_num_elem = ctx->sg_encrypted_num_elem;
+	rec->sg_encrypted_size = ctx->sg_encrypted_size;
+	memcpy(rec->sg_plaintext_data, ctx->sg_plaintext_data,
+	       ctx->sg_plaintext_num_elem * sizeof(struct scatterlist));
+	memcpy(rec->sg_encrypted_data, ctx->sg_encrypted_data,
+	       ctx->sg_encrypted_num_elem * sizeof(struct scatterlist));
+
+	data_len = rec->sg_plaintext_size;
+	if (tls_is_tls13(info)) {
+		/* The real record type is encrypted after the data */
+		struct scatterlist *sg = rec->sg_plaintext_data +
+					 rec->sg_plaintext_num_elem;
+
+		rec->content_type = record_type;
+		record_type = TLS_RECORD_TYPE_DATA;
+		sg_unmark_end(sg - 1);
+		sg_set_buf(sg, &rec->content_type, 1);
+		sg_mark_end(sg);
+		data_len++;
+	}
 
-	tls_ctx->pending_open_record_frags = 0;
-	set_bit(TLS_PENDING_CLOSED_RECORD, &tls_ctx->flags);
+	prepend = page_address(sg_page(&rec->sg_encrypted_data[0])) +
+		  rec->sg_encrypted_data[0].offset;
+	tls_sw_fill_prepend(tls_ctx, prepend, data_len, record_type);
 
-	rc = tls_do_encryption(tls_ctx, ctx, req, ctx->sg_plaintext_size);
-	if (rc < 0) {
-		/* If we are called from write_space and
-		 * we fail, we need to set this SOCK_NOSPACE
-		 * to trigger another write_space in the future.
-		 */
-		set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
-		goto out_req;
+	if (tls_is_tls13(info)) {
+		rec->aad_size = TLS_1_3_AAD_SIZE;
+		memcpy(rec->aad_space, prepend, TLS_1_3_AAD_SIZE);
+	} else {
+		rec->aad_size = TLS_AAD_SPACE_SIZE;
+		tls_make_aad(rec->aad_space, rec->sg_plaintext_size,
+			     tls_ctx->tx.rec_seq, tls_ctx->tx.rec_seq_size,
+			     record_type);
 	}
 
-	free_sg(sk, ctx->sg_plaintext_data, &ctx->sg_plaintext_num_elem,
-		&ctx->sg_plaintext_size);
+	sg_init_table(rec->sg_aead_in, 2);
+	sg_set_buf(&rec->sg_aead_in[0], rec->aad_space, rec->aad_size);
+	sg_unmark_end(&rec->sg_aead_in[1]);
+	sg_chain(rec->sg_aead_in, 2, rec->sg_plaintext_data);
+	sg_init_table(rec->sg_aead_out, 2);
+	sg_set_buf(&rec->sg_aead_out[0], rec->aad_space, rec->aad_size);
+	sg_unmark_end(&rec->sg_aead_out[1]);
+	sg_chain(rec->sg_aead_out, 2, rec->sg_encrypted_data);
+
+	/* The record keeps its nonce while the next ones are encrypted */
+	tls_sw_make_nonce(rec->iv, info, &tls_ctx->tx);
 
+	ctx->sg_plaintext_num_elem = 0;
+	ctx->sg_plaintext_size = 0;
 	ctx->sg_encrypted_num_elem = 0;
 	ctx->sg_encrypted_size = 0;
+	tls_ctx->pending_open_record_frags = 0;
 
-	/* Only pass through MSG_DONTWAIT and MSG_NOSIGNAL flags */
-	rc = tls_push_sg(sk, tls_ctx, ctx->sg_encrypted_data, 0, flags);
-	if (rc < 0 && rc != -EAGAIN)
-		tls_err_abort(sk, EBADMSG);
+	list_add_tail(&rec->list, &actx->tx_list);
 
+	rc = tls_do_encryption(tls_ctx, ctx, rec, data_len);
 	tls_advance_record_sn(sk, &tls_ctx->tx);
-out_req:
-	aead_request_free(req);
-	return rc;
+	if (rc == -EINPROGRESS)
+		return 0;
+	if (rc < 0) {
+		list_del(&rec->list);
+		tls_free_rec(sk, rec);
+		tls_err_abort(sk, EBADMSG);
+		return rc;
+	}
+
+	/* Only pass through MSG_DONTWAIT and MSG_NOSIGNAL flags */
+	return tls_tx_records(sk, flags);
 }
 
 static int tls_sw_push_pending_record(struct sock *sk, int flags)
 {
+	struct tls_context *tls_ctx = tls_get_ctx(sk);
+
+	/* The closed records went out of the context, resume sending them */
+	if (tls_is_pending_closed_record(tls_ctx))
+		return tls_tx_records(sk, flags);
+
 	return tls_push_record(sk, flags, TLS_RECORD_TYPE_DATA);
 }
 
@@ -354,6 +667,8 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
+	struct tls_sw_context_tx_async *actx = tls_sw_ctx_tx_async(ctx);
+	bool retry_push = false;
 	int ret = 0;
 	int required_size;
 	long timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
@@ -412,7 +727,10 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 			try_to_copy -= required_size - ctx->sg_encrypted_size;
 			full_record = true;
 		}
-		if (!is_kvec && (full_record || eor)) {
+		/* An asynchronous encryption would read the user pages
+		 * after we return, copy them instead.
+		 */
+		if (!is_kvec && (full_record || eor) && !actx->async_capable) {
 			ret = zerocopy_from_iter(sk, &msg->msg_iter,
 				try_to_copy, &ctx->sg_plaintext_num_elem,
 				&ctx->sg_plaintext_size,
@@ -465,8 +783,10 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 push_record:
 			ret = tls_push_record(sk, msg->msg_flags, record_type);
 			if (ret) {
-				if (ret == -ENOMEM)
+				if (ret == -ENOMEM) {
+					retry_push = true;
 					goto wait_for_memory;
+				}
 
 				goto send_end;
 			}
@@ -484,8 +804,10 @@ int tls_sw_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
 			goto send_end;
 		}
 
-		if (tls_is_pending_closed_record(tls_ctx))
+		if (retry_push) {
+			retry_push = false;
 			goto push_record;
+		}
 
 		if (ctx->sg_encrypted_size < required_size)
 			goto alloc_encrypted;
@@ -511,6 +833,7 @@ int tls_sw_sendpage(struct sock *sk, struct page *page,
 	size_t orig_size = size;
 	unsigned char record_type = TLS_RECORD_TYPE_DATA;
 	struct scatterlist *sg;
+	bool retry_push = false;
 	bool full_record;
 	int record_room;
 
@@ -582,8 +905,10 @@ int tls_sw_sendpage(struct sock *sk, struct page *page,
 push_record:
 			ret = tls_push_record(sk, flags, record_type);
 			if (ret) {
-				if (ret == -ENOMEM)
+				if (ret == -ENOMEM) {
+					retry_push = true;
 					goto wait_for_memory;
+				}
 
 				goto sendpage_end;
 			}
@@ -598,8 +923,10 @@ int tls_sw_sendpage(struct sock *sk, struct page *page,
 			goto sendpage_end;
 		}
 
-		if (tls_is_pending_closed_record(tls_ctx))
+		if (retry_push) {
+			retry_push = false;
 			goto push_record;
+		}
 
 		goto alloc_payload;
 	}
@@ -661,19 +988,25 @@ static struct sk_buff *tls_wait_data(struct sock *sk, int flags,
  * out_iov or out_sg must be non-NULL. In case both out_iov and out_sg are
  * NULL, then the decryption happens inside skb buffers itself, i.e.
  * zero-copy gets disabled and 'zc' is updated.
+ * Decryption into out_iov may complete after this function returns when
+ * 'async' is non-NULL, the caller then waits for async->done.
  */
 
 static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 			    struct iov_iter *out_iov,
 			    struct scatterlist *out_sg,
-			    int *chunk, bool *zc)
+			    int *chunk, bool *zc,
+			    struct tls_decrypt_async *async)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
 	struct strp_msg *rxm = strp_msg(skb);
 	int n_sgin, n_sgout, nsg, mem_size, aead_size, err, pages = 0;
+	struct tls_crypto_info *info = &tls_ctx->crypto_recv.info;
+	struct tls_decrypt_ctx *dctx = NULL;
 	struct aead_request *aead_req;
 	struct sk_buff *unused;
+	unsigned int aad_size;
 	u8 *aad, *iv, *mem = NULL;
 	struct scatterlist *sgin = NULL;
 	struct scatterlist *sgout = NULL;
@@ -699,12 +1032,13 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	nsg = n_sgin + n_sgout;
 
 	aead_size = sizeof(*aead_req) + crypto_aead_reqsize(ctx->aead_recv);
+	aead_size = aead_size + sizeof(*dctx);
 	mem_size = aead_size + (nsg * sizeof(struct scatterlist));
 	mem_size = mem_size + TLS_AAD_SPACE_SIZE;
 	mem_size = mem_size + crypto_aead_ivsize(ctx->aead_recv);
 
 	/* Allocate a single block of memory which contains
-	 * aead_req || sgin[] || sgout[] || aad || iv.
+	 * aead_req || dctx || sgin[] || sgout[] || aad || iv.
 	 * This order achieves correct alignment for aead_req, sgin, sgout.
 	 */
 	mem = kmalloc(mem_size, sk->sk_allocation);
@@ -719,23 +1053,37 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	iv = aad + TLS_AAD_SPACE_SIZE;
 
 	/* Prepare IV */
-	err = skb_copy_bits(skb, rxm->offset + TLS_HEADER_SIZE,
-			    iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
-			    tls_ctx->rx.iv_size);
-	if (err < 0) {
-		kfree(mem);
-		return err;
+	if (tls_implicit_nonce(info)) {
+		tls_sw_make_nonce(iv, info, &tls_ctx->rx);
+	} else {
+		err = skb_copy_bits(skb, rxm->offset + TLS_HEADER_SIZE,
+				    iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
+				    tls_ctx->rx.iv_size);
+		if (err < 0) {
+			kfree(mem);
+			return err;
+		}
+		memcpy(iv, tls_ctx->rx.iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
 	}
-	memcpy(iv, tls_ctx->rx.iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
 
 	/* Prepare AAD */
-	tls_make_aad(aad, rxm->full_len - tls_ctx->rx.overhead_size,
-		     tls_ctx->rx.rec_seq, tls_ctx->rx.rec_seq_size,
-		     ctx->control);
+	if (tls_is_tls13(info)) {
+		aad_size = TLS_1_3_AAD_SIZE;
+		err = skb_copy_bits(skb, rxm->offset, aad, aad_size);
+		if (err < 0) {
+			kfree(mem);
+			return err;
+		}
+	} else {
+		aad_size = TLS_AAD_SPACE_SIZE;
+		tls_make_aad(aad, rxm->full_len - tls_ctx->rx.overhead_size,
+			     tls_ctx->rx.rec_seq, tls_ctx->rx.rec_seq_size,
+			     ctx->control);
+	}
 
 	/* Prepare sgin */
 	sg_init_table(sgin, n_sgin);
-	sg_set_buf(&sgin[0], aad, TLS_AAD_SPACE_SIZE);
+	sg_set_buf(&sgin[0], aad, aad_size);
 	err = skb_to_sgvec(skb, &sgin[1],
 			   rxm->offset + tls_ctx->rx.prepend_size,
 			   rxm->full_len - tls_ctx->rx.prepend_size);
@@ -747,7 +1095,7 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	if (n_sgout) {
 		if (out_iov) {
 			sg_init_table(sgout, n_sgout);
-			sg_set_buf(&sgout[0], aad, TLS_AAD_SPACE_SIZE);
+			sg_set_buf(&sgout[0], aad, aad_size);
 
 			*chunk = 0;
 			err = zerocopy_from_iter(sk, out_iov, data_len, &pages,
@@ -768,8 +1116,23 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 		*zc = false;
 	}
 
+	if (async && out_iov && *zc) {
+		dctx = (struct tls_decrypt_ctx *)(mem + aead_size -
+						  sizeof(*dctx));
+		dctx->async = async;
+		dctx->skb = skb_get(skb);
+		dctx->sgout = sgout;
+		dctx->pages = pages;
+	}
+
 	/* Prepare and submit AEAD request */
-	err = tls_do_decryption(sk, sgin, sgout, iv, data_len, aead_req);
+	err = tls_do_decryption(sk, sgin, sgout, iv, data_len, aad_size,
+				aead_req, dctx);
+	if (err == -EINPROGRESS)
+		return 0;
+
+	if (dctx)
+		consume_skb(skb);
 
 	/* Release the pages in case iov was mapped to pages */
 	for (; pages > 0; pages--)
@@ -779,8 +1142,35 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	return err;
 }
 
+/* Strip the padding of a decrypted TLS 1.3 record, and take its real
+ * record type from the last non zero byte of the plaintext.
+ */
+static int tls13_strip_padding(struct sock *sk, struct sk_buff *skb)
+{
+	struct tls_context *tls_ctx = tls_get_ctx(sk);
+	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
+	struct strp_msg *rxm = strp_msg(skb);
+	char content_type = 0;
+	int err;
+
+	while (!content_type && rxm->full_len > 0) {
+		err = skb_copy_bits(skb, rxm->offset + rxm->full_len - 1,
+				    &content_type, 1);
+		if (err < 0)
+			return err;
+		rxm->full_len--;
+	}
+
+	if (!content_type)
+		return -EBADMSG;
+
+	ctx->control = content_type;
+	return 0;
+}
+
 static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
-			      struct iov_iter *dest, int *chunk, bool *zc)
+			      struct iov_iter *dest, int *chunk, bool *zc,
+			      struct tls_decrypt_async *async)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
@@ -793,7 +1183,7 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 		return err;
 #endif
 	if (!ctx->decrypted) {
-		err = decrypt_internal(sk, skb, dest, NULL, chunk, zc);
+		err = decrypt_internal(sk, skb, dest, NULL, chunk, zc, async);
 		if (err < 0)
 			return err;
 	} else {
@@ -803,6 +1193,11 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 	rxm->offset += tls_ctx->rx.prepend_size;
 	rxm->full_len -= tls_ctx->rx.overhead_size;
 	tls_advance_record_sn(sk, &tls_ctx->rx);
+	if (tls_is_tls13(&tls_ctx->crypto_recv.info)) {
+		err = tls13_strip_padding(sk, skb);
+		if (err < 0)
+			return err;
+	}
 	ctx->decrypted = true;
 	ctx->saved_data_ready(sk);
 
@@ -815,7 +1210,7 @@ int decrypt_skb(struct sock *sk, struct sk_buff *skb,
 	bool zc = true;
 	int chunk;
 
-	return decrypt_internal(sk, skb, NULL, sgout, &chunk, &zc);
+	return decrypt_internal(sk, skb, NULL, sgout, &chunk, &zc, NULL);
 }
 
 static bool tls_sw_advance_skb(struct sock *sk, struct sk_buff *skb,
@@ -849,6 +1244,7 @@ int tls_sw_recvmsg(struct sock *sk,
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
+	struct tls_decrypt_async async;
 	unsigned char control;
 	struct strp_msg *rxm;
 	struct sk_buff *skb;
@@ -857,12 +1253,20 @@ int tls_sw_recvmsg(struct sock *sk,
 	int target, err = 0;
 	long timeo;
 	bool is_kvec = msg->msg_iter.type & ITER_KVEC;
+	bool tls13 = tls_is_tls13(&tls_ctx->crypto_recv.info);
 
 	flags |= nonblock;
 
 	if (unlikely(flags & MSG_ERRQUEUE))
 		return sock_recv_errqueue(sk, msg, len, SOL_IP, IP_RECVERR);
 
+	/* Records decrypted into the iov asynchronously are waited for once,
+	 * at the end, letting the next records be parsed and submitted.
+	 */
+	atomic_set(&async.pending, 1);
+	async.err = 0;
+	init_completion(&async.done);
+
 	lock_sock(sk);
 
 	target = sock_rcvlowat(sk, flags & MSG_WAITALL, len);
@@ -876,6 +1280,19 @@ int tls_sw_recvmsg(struct sock *sk,
 			goto recv_end;
 
 		rxm = strp_msg(skb);
+
+		/* The type of a TLS 1.3 record is only known once decrypted,
+		 * so it is decrypted in place before it is looked at.
+		 */
+		if (tls13 && !ctx->decrypted) {
+			err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc,
+						 NULL);
+			if (err < 0) {
+				tls_err_abort(sk, EBADMSG);
+				goto recv_end;
+			}
+		}
+
 		if (!cmsg) {
 			int cerr;
 
@@ -901,7 +1318,7 @@ int tls_sw_recvmsg(struct sock *sk,
 				zc = true;
 
 			err = decrypt_skb_update(sk, skb, &msg->msg_iter,
-						 &chunk, &zc);
+						 &chunk, &zc, &async);
 			if (err < 0) {
 				tls_err_abort(sk, EBADMSG);
 				goto recv_end;
@@ -946,6 +1363,14 @@ int tls_sw_recvmsg(struct sock *sk,
 	} while (len);
 
 recv_end:
+	if (!atomic_dec_and_test(&async.pending))
+		wait_for_completion(&async.done);
+	if (async.err) {
+		tls_err_abort(sk, EBADMSG);
+		copied = 0;
+		err = -EBADMSG;
+	}
+
 	release_sock(sk);
 	return copied ? : err;
 }
@@ -973,14 +1398,8 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 	if (!skb)
 		goto splice_read_end;
 
-	/* splice does not support reading control messages */
-	if (ctx->control != TLS_RECORD_TYPE_DATA) {
-		err = -ENOTSUPP;
-		goto splice_read_end;
-	}
-
 	if (!ctx->decrypted) {
-		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc);
+		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc, NULL);
 
 		if (err < 0) {
 			tls_err_abort(sk, EBADMSG);
@@ -988,6 +1407,14 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 		}
 		ctx->decrypted = true;
 	}
+
+	/* splice does not support reading control messages, whose type is
+	 * only known after decryption with TLS 1.3
+	 */
+	if (ctx->control != TLS_RECORD_TYPE_DATA) {
+		err = -ENOTSUPP;
+		goto splice_read_end;
+	}
 	rxm = strp_msg(skb);
 
 	chunk = min_t(unsigned int, rxm->full_len, len);
@@ -1028,7 +1455,9 @@ static int tls_read_size(struct strparser *strp, struct sk_buff *skb)
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
 	char header[TLS_HEADER_SIZE + MAX_IV_SIZE];
 	struct strp_msg *rxm = strp_msg(skb);
-	size_t cipher_overhead;
+	struct tls_crypto_info *info = &tls_ctx->crypto_recv.info;
+	size_t cipher_overhead, max_len;
+	u16 version = info->version;
 	size_t data_len = 0;
 	int ret;
 
@@ -1053,8 +1482,15 @@ static int tls_read_size(struct strparser *strp, struct sk_buff *skb)
 	data_len = ((header[4] & 0xFF) | (header[3] << 8));
 
 	cipher_overhead = tls_ctx->rx.tag_size + tls_ctx->rx.iv_size;
+	max_len = TLS_MAX_PAYLOAD_SIZE + cipher_overhead;
+
+	/* TLS 1.3 records claim to be TLS 1.2 ones, and may be padded */
+	if (tls_is_tls13(info)) {
+		max_len = TLS_MAX_PAYLOAD_SIZE + TLS_1_3_MAX_EXPANSION;
+		version = TLS_1_2_VERSION;
+	}
 
-	if (data_len > TLS_MAX_PAYLOAD_SIZE + cipher_overhead) {
+	if (data_len > max_len) {
 		ret = -EMSGSIZE;
 		goto read_failure;
 	}
@@ -1063,8 +1499,8 @@ static int tls_read_size(struct strparser *strp, struct sk_buff *skb)
 		goto read_failure;
 	}
 
-	if (header[1] != TLS_VERSION_MINOR(tls_ctx->crypto_recv.info.version) ||
-	    header[2] != TLS_VERSION_MAJOR(tls_ctx->crypto_recv.info.version)) {
+	if (header[1] != TLS_VERSION_MINOR(version) ||
+	    header[2] != TLS_VERSION_MAJOR(version)) {
 		ret = -EINVAL;
 		goto read_failure;
 	}
@@ -1106,11 +1542,37 @@ void tls_sw_free_resources_tx(struct sock *sk)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_tx *ctx = tls_sw_ctx_tx(tls_ctx);
+	struct tls_sw_context_tx_async *actx = tls_sw_ctx_tx_async(ctx);
+	struct tls_rec *rec, *tmp;
+
+	/* Wait for the encryptions in flight and for the work sending them */
+	if (!atomic_dec_and_test(&actx->encrypt_pending))
+		wait_for_completion(&ctx->async_wait.completion);
+	release_sock(sk);
+	cancel_work_sync(&actx->tx_work);
+	lock_sock(sk);
+
+	tls_tx_records(sk, 0);
+
+	list_for_each_entry_safe(rec, tmp, &actx->tx_list, list) {
+		if (actx->partial_sg) {
+			struct scatterlist *sg = actx->partial_sg;
+
+			for (; sg; sg = sg_next(sg)) {
+				put_page(sg_page(sg));
+				sk_mem_uncharge(sk, sg->length);
+			}
+			rec->sg_encrypted_num_elem = 0;
+			actx->partial_sg = NULL;
+		}
+		list_del(&rec->list);
+		tls_free_rec(sk, rec);
+	}
 
 	crypto_free_aead(ctx->aead_send);
 	tls_free_both_sg(sk);
 
-	kfree(ctx);
+	kfree(actx);
 }
 
 void tls_sw_release_resources_rx(struct sock *sk)
@@ -1142,17 +1604,20 @@ void tls_sw_free_resources_rx(struct sock *sk)
 	kfree(ctx);
 }
 
-int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
+int tls_set_sw_offload_info(struct sock *sk, struct tls_context *ctx, int tx,
+			    struct tls_crypto_info *crypto_info)
 {
-	struct tls_crypto_info *crypto_info;
+	struct tls12_crypto_info_chacha20_poly1305 *chacha_info;
 	struct tls12_crypto_info_aes_gcm_128 *gcm_128_info;
+	struct tls_sw_context_tx_async *sw_actx_tx;
 	struct tls_sw_context_tx *sw_ctx_tx = NULL;
 	struct tls_sw_context_rx *sw_ctx_rx = NULL;
 	struct cipher_context *cctx;
 	struct crypto_aead **aead;
 	struct strp_callbacks cb;
-	u16 nonce_size, tag_size, iv_size, rec_seq_size;
-	char *iv, *rec_seq;
+	u16 nonce_size, tag_size, iv_size, salt_size, rec_seq_size, key_size;
+	char *iv, *salt, *rec_seq, *key;
+	const char *cipher_name;
 	int rc = 0;
 
 	if (!ctx) {
@@ -1162,11 +1627,16 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 
 	if (tx) {
 		if (!ctx->priv_ctx_tx) {
-			sw_ctx_tx = kzalloc(sizeof(*sw_ctx_tx), GFP_KERNEL);
-			if (!sw_ctx_tx) {
+			sw_actx_tx = kzalloc(sizeof(*sw_actx_tx), GFP_KERNEL);
+			if (!sw_actx_tx) {
 				rc = -ENOMEM;
 				goto out;
 			}
+			sw_actx_tx->sk = sk;
+			INIT_LIST_HEAD(&sw_actx_tx->tx_list);
+			atomic_set(&sw_actx_tx->encrypt_pending, 1);
+			INIT_WORK(&sw_actx_tx->tx_work, tls_tx_work_handler);
+			sw_ctx_tx = &sw_actx_tx->base;
 			ctx->priv_ctx_tx = sw_ctx_tx;
 		} else {
 			sw_ctx_tx =
@@ -1188,27 +1658,46 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 
 	if (tx) {
 		crypto_init_wait(&sw_ctx_tx->async_wait);
-		crypto_info = &ctx->crypto_send.info;
 		cctx = &ctx->tx;
 		aead = &sw_ctx_tx->aead_send;
 	} else {
 		crypto_init_wait(&sw_ctx_rx->async_wait);
-		crypto_info = &ctx->crypto_recv.info;
 		cctx = &ctx->rx;
 		aead = &sw_ctx_rx->aead_recv;
 	}
 
 	switch (crypto_info->cipher_type) {
 	case TLS_CIPHER_AES_GCM_128: {
+		gcm_128_info =
+			(struct tls12_crypto_info_aes_gcm_128 *)crypto_info;
 		nonce_size = TLS_CIPHER_AES_GCM_128_IV_SIZE;
 		tag_size = TLS_CIPHER_AES_GCM_128_TAG_SIZE;
 		iv_size = TLS_CIPHER_AES_GCM_128_IV_SIZE;
-		iv = ((struct tls12_crypto_info_aes_gcm_128 *)crypto_info)->iv;
+		iv = gcm_128_info->iv;
+		salt_size = TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+		salt = gcm_128_info->salt;
 		rec_seq_size = TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE;
-		rec_seq =
-		 ((struct tls12_crypto_info_aes_gcm_128 *)crypto_info)->rec_seq;
-		gcm_128_info =
-			(struct tls12_crypto_info_aes_gcm_128 *)crypto_info;
+		rec_seq = gcm_128_info->rec_seq;
+		key_size = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+		key = gcm_128_info->key;
+		cipher_name = "gcm(aes)";
+		break;
+	}
+	case TLS_CIPHER_CHACHA20_POLY1305: {
+		chacha_info = container_of(crypto_info,
+				struct tls12_crypto_info_chacha20_poly1305,
+				info);
+		nonce_size = 0;
+		tag_size = TLS_CIPHER_CHACHA20_POLY1305_TAG_SIZE;
+		iv_size = TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE;
+		iv = chacha_info->iv;
+		salt_size = TLS_CIPHER_CHACHA20_POLY1305_SALT_SIZE;
+		salt = chacha_info->salt;
+		rec_seq_size = TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE;
+		rec_seq = chacha_info->rec_seq;
+		key_size = TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE;
+		key = chacha_info->key;
+		cipher_name = "rfc7539(chacha20,poly1305)";
 		break;
 	}
 	default:
@@ -1216,8 +1705,12 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 		goto free_priv;
 	}
 
+	/* TLS 1.3 derives the nonce from the sequence number alone */
+	if (tls_is_tls13(crypto_info))
+		nonce_size = 0;
+
 	/* Sanity-check the IV size for stack allocations. */
-	if (iv_size > MAX_IV_SIZE || nonce_size > MAX_IV_SIZE) {
+	if (salt_size + iv_size != TLS_NONCE_SIZE || nonce_size > MAX_IV_SIZE) {
 		rc = -EINVAL;
 		goto free_priv;
 	}
@@ -1225,15 +1718,18 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 	cctx->prepend_size = TLS_HEADER_SIZE + nonce_size;
 	cctx->tag_size = tag_size;
 	cctx->overhead_size = cctx->prepend_size + cctx->tag_size;
-	cctx->iv_size = iv_size;
-	cctx->iv = kmalloc(iv_size + TLS_CIPHER_AES_GCM_128_SALT_SIZE,
-			   GFP_KERNEL);
+	/* The content type, encrypted after the data */
+	if (tx && tls_is_tls13(crypto_info))
+		cctx->overhead_size++;
+	/* Only the explicit nonce is advanced with the record number */
+	cctx->iv_size = nonce_size;
+	cctx->iv = kmalloc(TLS_NONCE_SIZE, GFP_KERNEL);
 	if (!cctx->iv) {
 		rc = -ENOMEM;
 		goto free_priv;
 	}
-	memcpy(cctx->iv, gcm_128_info->salt, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
-	memcpy(cctx->iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE, iv, iv_size);
+	memcpy(cctx->iv, salt, salt_size);
+	memcpy(cctx->iv + salt_size, iv, iv_size);
 	cctx->rec_seq_size = rec_seq_size;
 	cctx->rec_seq = kmemdup(rec_seq, rec_seq_size, GFP_KERNEL);
 	if (!cctx->rec_seq) {
@@ -1246,23 +1742,10 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 			      ARRAY_SIZE(sw_ctx_tx->sg_encrypted_data));
 		sg_init_table(sw_ctx_tx->sg_plaintext_data,
 			      ARRAY_SIZE(sw_ctx_tx->sg_plaintext_data));
-
-		sg_init_table(sw_ctx_tx->sg_aead_in, 2);
-		sg_set_buf(&sw_ctx_tx->sg_aead_in[0], sw_ctx_tx->aad_space,
-			   sizeof(sw_ctx_tx->aad_space));
-		sg_unmark_end(&sw_ctx_tx->sg_aead_in[1]);
-		sg_chain(sw_ctx_tx->sg_aead_in, 2,
-			 sw_ctx_tx->sg_plaintext_data);
-		sg_init_table(sw_ctx_tx->sg_aead_out, 2);
-		sg_set_buf(&sw_ctx_tx->sg_aead_out[0], sw_ctx_tx->aad_space,
-			   sizeof(sw_ctx_tx->aad_space));
-		sg_unmark_end(&sw_ctx_tx->sg_aead_out[1]);
-		sg_chain(sw_ctx_tx->sg_aead_out, 2,
-			 sw_ctx_tx->sg_encrypted_data);
 	}
 
 	if (!*aead) {
-		*aead = crypto_alloc_aead("gcm(aes)", 0, 0);
+		*aead = crypto_alloc_aead(cipher_name, 0, 0);
 		if (IS_ERR(*aead)) {
 			rc = PTR_ERR(*aead);
 			*aead = NULL;
@@ -1272,8 +1755,7 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 
 	ctx->push_pending_record = tls_sw_push_pending_record;
 
-	rc = crypto_aead_setkey(*aead, gcm_128_info->key,
-				TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+	rc = crypto_aead_setkey(*aead, key, key_size);
 	if (rc)
 		goto free_aead;
 
@@ -1281,6 +1763,13 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 	if (rc)
 		goto free_aead;
 
+	if (sw_ctx_tx) {
+		struct crypto_tfm *tfm = crypto_aead_tfm(*aead);
+
+		tls_sw_ctx_tx_async(sw_ctx_tx)->async_capable =
+			tfm->__crt_alg->cra_flags & CRYPTO_ALG_ASYNC;
+	}
+
 	if (sw_ctx_rx) {
 		/* Set up strparser */
 		memset(&cb, 0, sizeof(cb));
@@ -1321,3 +1810,10 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 out:
 	return rc;
 }
+
+int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
+{
+	return tls_set_sw_offload_info(sk, ctx, tx, tx ?
+				       &ctx->crypto_send.info :
+				       &ctx->crypto_recv.info);
+}
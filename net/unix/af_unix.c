@@ -119,6 +119,8 @@
 #include <linux/freezer.h>
 #include <linux/file.h>
 
+#include "ring.h"
+
 struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
 EXPORT_SYMBOL_GPL(unix_socket_table);
 DEFINE_SPINLOCK(unix_table_lock);
@@ -491,6 +493,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	unix_ring_release(sk);
 
 	WARN_ON(refcount_read(&sk->sk_wmem_alloc));
 	WARN_ON(!sk_unhashed(sk));
@@ -543,7 +546,8 @@ static void unix_release_sock(struct sock *sk, int embrion)
 			unix_state_lock(skpair);
 			/* No more writes */
 			skpair->sk_shutdown = SHUTDOWN_MASK;
-			if (!skb_queue_empty(&sk->sk_receive_queue) || embrion)
+			if (!skb_queue_empty(&sk->sk_receive_queue) ||
+			    unix_ring_inq(sk) || embrion)
 				skpair->sk_err = ECONNRESET;
 			unix_state_unlock(skpair);
 			skpair->sk_state_change(skpair);
@@ -583,7 +587,7 @@ static void unix_release_sock(struct sock *sk, int embrion)
 	 *	  What the above comment does talk about? --ANK(980817)
 	 */
 
-	if (unix_tot_inflight)
+	if (READ_ONCE(unix_tot_inflight))
 		unix_gc();		/* Garbage collect fds */
 }
 
@@ -747,7 +751,7 @@ static const struct proto_ops unix_seqpacket_ops = {
 static struct proto unix_proto = {
 	.name			= "UNIX",
 	.owner			= THIS_MODULE,
-	.obj_size		= sizeof(struct unix_sock),
+	.obj_size		= sizeof(struct unix_ring_sock),
 };
 
 static struct sock *unix_create1(struct net *net, struct socket *sock, int kern)
@@ -1205,6 +1209,7 @@ static int unix_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 	struct sock *sk = sock->sk;
 	struct net *net = sock_net(sk);
 	struct unix_sock *u = unix_sk(sk), *newu, *otheru;
+	struct unix_ring *rx = NULL, *tx = NULL;
 	struct sock *newsk = NULL;
 	struct sock *other = NULL;
 	struct sk_buff *skb = NULL;
@@ -1247,6 +1252,10 @@ static int unix_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 	if (!other)
 		goto out;
 
+	err = unix_ring_prepare(sk, other, &rx, &tx);
+	if (err)
+		goto out;
+
 	/* Latch state of peer */
 	unix_state_lock(other);
 
@@ -1342,6 +1351,8 @@ static int unix_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 	/* Set credentials */
 	copy_peercred(sk, other);
 
+	unix_ring_attach(sk, newsk, other, &rx, &tx);
+
 	sock->state	= SS_CONNECTED;
 	sk->sk_state	= TCP_ESTABLISHED;
 	sock_hold(newsk);
@@ -1358,6 +1369,8 @@ static int unix_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 	unix_state_unlock(other);
 	other->sk_data_ready(other);
 	sock_put(other);
+	unix_ring_put(rx);
+	unix_ring_put(tx);
 	return 0;
 
 out_unlock:
@@ -1365,6 +1378,8 @@ static int unix_stream_connect(struct socket *sock, struct sockaddr *uaddr,
 		unix_state_unlock(other);
 
 out:
+	unix_ring_put(rx);
+	unix_ring_put(tx);
 	kfree_skb(skb);
 	if (newsk)
 		unix_release_sock(newsk, 0);
@@ -1858,6 +1873,13 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if (unix_ring_active(sk)) {
+		err = unix_ring_sendmsg(sk, other, &scm, msg, len);
+		if (err == -EPIPE)
+			goto pipe_err;
+		goto out_err;
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
@@ -1940,6 +1962,9 @@ static ssize_t unix_stream_sendpage(struct socket *socket, struct page *page,
 	if (!other || sk->sk_state != TCP_ESTABLISHED)
 		return -ENOTCONN;
 
+	if (unix_ring_active(sk))
+		return sock_no_sendpage(socket, page, offset, size, flags);
+
 	if (false) {
 alloc_skb:
 		unix_state_unlock(other);
@@ -2460,6 +2485,9 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.flags = flags
 	};
 
+	if (unix_ring_active(sock->sk))
+		return unix_ring_recvmsg(sock->sk, msg, size, flags);
+
 	return unix_stream_read_generic(&state, true);
 }
 
@@ -2487,6 +2515,10 @@ static ssize_t unix_stream_splice_read(struct socket *sock,  loff_t *ppos,
 	if (unlikely(*ppos))
 		return -ESPIPE;
 
+	/* There are no skbs to splice from in ring mode */
+	if (unix_ring_active(sock->sk))
+		return -EOPNOTSUPP;
+
 	if (sock->file->f_flags & O_NONBLOCK ||
 	    flags & SPLICE_F_NONBLOCK)
 		state.flags = MSG_DONTWAIT;
@@ -2553,6 +2585,7 @@ long unix_inq_len(struct sock *sk)
 	    sk->sk_type == SOCK_SEQPACKET) {
 		skb_queue_walk(&sk->sk_receive_queue, skb)
 			amount += unix_skb_len(skb);
+		amount += unix_ring_inq(sk);
 	} else {
 		skb = skb_peek(&sk->sk_receive_queue);
 		if (skb)
@@ -2566,7 +2599,7 @@ EXPORT_SYMBOL_GPL(unix_inq_len);
 
 long unix_outq_len(struct sock *sk)
 {
-	return sk_wmem_alloc_get(sk);
+	return sk_wmem_alloc_get(sk) + unix_ring_outq(sk);
 }
 EXPORT_SYMBOL_GPL(unix_outq_len);
 
@@ -2628,6 +2661,9 @@ static int unix_ioctl(struct socket *sock, unsigned int cmd, unsigned long arg)
 	case SIOCUNIXFILE:
 		err = unix_open_file(sk);
 		break;
+	case SIOCUNIXRING:
+		err = unix_ring_set_size(sk, (int __user *)arg);
+		break;
 	default:
 		err = -ENOIOCTLCMD;
 		break;
@@ -2652,7 +2688,7 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 		mask |= EPOLLRDHUP | EPOLLIN | EPOLLRDNORM;
 
 	/* readable? */
-	if (!skb_queue_empty(&sk->sk_receive_queue))
+	if (!skb_queue_empty(&sk->sk_receive_queue) || unix_ring_inq(sk))
 		mask |= EPOLLIN | EPOLLRDNORM;
 
 	/* Connection-based need to check for termination and startup */
@@ -2664,7 +2700,7 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 	 * we set writable also when the other side has shut down the
 	 * connection. This prevents stuck sockets.
 	 */
-	if (unix_writable(sk))
+	if (unix_ring_active(sk) ? unix_ring_writable(sk) : unix_writable(sk))
 		mask |= EPOLLOUT | EPOLLWRNORM | EPOLLWRBAND;
 
 	return mask;
@@ -0,0 +1,442 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NET4:	Ring mode of AF_UNIX stream sockets.
+ *
+ * A stream socket asks for the mode with SIOCUNIXRING before connect()
+ * or listen().  When both the connecting and the listening socket did,
+ * each end of the connection gets a receive ring of pages, which the
+ * other end copies its data to.  Data then goes through the rings only,
+ * with no skb allocated per write, and wakeups are batched: the reader
+ * is only woken when it had consumed everything before the write, and
+ * the writer when at least half of the ring became free again.
+ *
+ * A ring has a single reader, serialized by the iolock of its socket,
+ * and the writers are serialized by the lock of the ring.  File
+ * descriptors can't be passed in this mode, nor credentials received.
+ */
+
+#include <linux/freezer.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <net/sock.h>
+
+#include "ring.h"
+
+/**
+ * struct unix_ring - receive ring of a unix stream socket in ring mode
+ * @refcnt: one reference for each end of the connection
+ * @lock: serializes the writers
+ * @mask: size of @data minus one, the size being a power of two
+ * @data: the ring
+ * @head: number of bytes written, updated by the writer
+ * @tail: number of bytes read, updated by the reader
+ */
+struct unix_ring {
+	refcount_t	refcnt;
+	struct mutex	lock;
+	unsigned int	mask;
+	void		*data;
+
+	unsigned int	head ____cacheline_aligned_in_smp;
+	unsigned int	tail ____cacheline_aligned_in_smp;
+};
+
+static unsigned int unix_ring_size(const struct unix_ring *ring)
+{
+	return ring->mask + 1;
+}
+
+static struct unix_ring *unix_ring_alloc(unsigned int size)
+{
+	struct unix_ring *ring;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL_ACCOUNT);
+	if (!ring)
+		return NULL;
+
+	ring->data = kvmalloc(size, GFP_KERNEL_ACCOUNT);
+	if (!ring->data) {
+		kfree(ring);
+		return NULL;
+	}
+
+	refcount_set(&ring->refcnt, 1);
+	mutex_init(&ring->lock);
+	ring->mask = size - 1;
+
+	return ring;
+}
+
+void unix_ring_put(struct unix_ring *ring)
+{
+	if (ring && refcount_dec_and_test(&ring->refcnt)) {
+		kvfree(ring->data);
+		kfree(ring);
+	}
+}
+
+/* Called from the destructor of the socket */
+void unix_ring_release(struct sock *sk)
+{
+	struct unix_ring_sock *ur = unix_ring_sk(sk);
+
+	unix_ring_put(ur->rx);
+	unix_ring_put(ur->tx);
+	ur->rx = NULL;
+	ur->tx = NULL;
+}
+
+int unix_ring_set_size(struct sock *sk, int __user *arg)
+{
+	int err = 0;
+	int size;
+
+	if (get_user(size, arg))
+		return -EFAULT;
+
+	if (sk->sk_type != SOCK_STREAM)
+		return -EOPNOTSUPP;
+	if (size < 0 || size > UNIX_RING_MAX_SIZE)
+		return -EINVAL;
+	if (size)
+		size = max_t(unsigned int, roundup_pow_of_two(size), PAGE_SIZE);
+
+	/* The size of a listening socket is read by unix_ring_attach() */
+	unix_state_lock(sk);
+	if (sk->sk_state != TCP_CLOSE)
+		err = -EINVAL;
+	else
+		WRITE_ONCE(unix_ring_sk(sk)->ring_size, size);
+	unix_state_unlock(sk);
+
+	return err;
+}
+
+/**
+ * unix_ring_prepare - allocate the rings of a connection to be made
+ * @sk: the connecting socket
+ * @other: the listening socket
+ * @rx: the receive ring of @sk
+ * @tx: the receive ring of the socket @sk is connecting to
+ *
+ * Called before the state of @other is locked, and again if connect
+ * restarts.  The rings are only allocated if both @sk and @other asked
+ * for them.
+ */
+int unix_ring_prepare(struct sock *sk, struct sock *other,
+		      struct unix_ring **rx, struct unix_ring **tx)
+{
+	unsigned int rx_size = unix_ring_sk(sk)->ring_size;
+	unsigned int tx_size = READ_ONCE(unix_ring_sk(other)->ring_size);
+
+	if (!rx_size || !tx_size)
+		return 0;
+
+	if (*tx && unix_ring_size(*tx) != tx_size) {
+		unix_ring_put(*tx);
+		*tx = NULL;
+	}
+
+	if (!*rx)
+		*rx = unix_ring_alloc(rx_size);
+	if (!*tx)
+		*tx = unix_ring_alloc(tx_size);
+
+	return *rx && *tx ? 0 : -ENOMEM;
+}
+
+/**
+ * unix_ring_attach - set up the ring mode of a new connection
+ * @sk: the connecting socket
+ * @newsk: the socket of the connection on the listening side
+ * @other: the listening socket
+ * @rx: the receive ring of @sk, from unix_ring_prepare()
+ * @tx: the receive ring of @newsk, from unix_ring_prepare()
+ *
+ * Called with the states of @sk and @other locked, before the connection
+ * is visible to either side.  The rings are used and cleared, unless
+ * @other changed its ring size meanwhile, which leaves the connection in
+ * the normal mode.
+ */
+void unix_ring_attach(struct sock *sk, struct sock *newsk, struct sock *other,
+		      struct unix_ring **rx, struct unix_ring **tx)
+{
+	struct unix_ring_sock *ur = unix_ring_sk(sk);
+	struct unix_ring_sock *newur = unix_ring_sk(newsk);
+
+	if (!*rx || !*tx ||
+	    unix_ring_size(*tx) != unix_ring_sk(other)->ring_size)
+		return;
+
+	refcount_inc(&(*rx)->refcnt);
+	refcount_inc(&(*tx)->refcnt);
+	newur->rx = *tx;
+	newur->tx = *rx;
+	ur->rx = *rx;
+	WRITE_ONCE(ur->tx, *tx);
+
+	/* The references for @sk */
+	*rx = NULL;
+	*tx = NULL;
+}
+
+static unsigned int unix_ring_used(const struct unix_ring *ring)
+{
+	return READ_ONCE(ring->head) - smp_load_acquire(&ring->tail);
+}
+
+unsigned int unix_ring_inq(const struct sock *sk)
+{
+	struct unix_ring *ring = unix_ring_sk(sk)->rx;
+
+	return ring ? unix_ring_used(ring) : 0;
+}
+
+unsigned int unix_ring_outq(const struct sock *sk)
+{
+	struct unix_ring *ring = READ_ONCE(unix_ring_sk(sk)->tx);
+
+	return ring ? unix_ring_used(ring) : 0;
+}
+
+/* Matches the threshold at which unix_ring_consume() wakes the writer */
+bool unix_ring_writable(const struct sock *sk)
+{
+	struct unix_ring *ring = unix_ring_sk(sk)->tx;
+
+	return (sk->sk_shutdown & SEND_SHUTDOWN) ||
+	       unix_ring_used(ring) <= unix_ring_size(ring) / 2;
+}
+
+static int unix_ring_wait_space(struct sock *sk, struct sock *other,
+				struct unix_ring *ring, long *timeo)
+{
+	DEFINE_WAIT(wait);
+	int err = 0;
+
+	for (;;) {
+		prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
+
+		if (unix_ring_used(ring) < unix_ring_size(ring))
+			break;
+		if (sock_flag(other, SOCK_DEAD) ||
+		    (other->sk_shutdown & RCV_SHUTDOWN)) {
+			err = -EPIPE;
+			break;
+		}
+		if (!*timeo) {
+			err = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			err = sock_intr_errno(*timeo);
+			break;
+		}
+
+		sk_set_bit(SOCKWQ_ASYNC_NOSPACE, sk);
+		*timeo = schedule_timeout(*timeo);
+	}
+
+	finish_wait(sk_sleep(sk), &wait);
+	return err;
+}
+
+static int unix_ring_copy_from(struct unix_ring *ring, unsigned int pos,
+			       struct iov_iter *from, unsigned int len)
+{
+	unsigned int off = pos & ring->mask;
+	unsigned int first = min(len, unix_ring_size(ring) - off);
+
+	if (copy_from_iter(ring->data + off, first, from) != first ||
+	    copy_from_iter(ring->data, len - first, from) != len - first)
+		return -EFAULT;
+
+	return 0;
+}
+
+int unix_ring_sendmsg(struct sock *sk, struct sock *other,
+		      struct scm_cookie *scm, struct msghdr *msg, size_t len)
+{
+	struct unix_ring *ring = unix_ring_sk(sk)->tx;
+	bool nonblock = msg->msg_flags & MSG_DONTWAIT;
+	long timeo = sock_sndtimeo(sk, nonblock);
+	size_t sent = 0;
+	int err = 0;
+
+	if (scm->fp)
+		return -EOPNOTSUPP;
+
+	if (nonblock) {
+		if (!mutex_trylock(&ring->lock))
+			return -EAGAIN;
+	} else if (mutex_lock_interruptible(&ring->lock)) {
+		return sock_intr_errno(timeo);
+	}
+
+	while (sent < len) {
+		unsigned int head = ring->head;
+		unsigned int avail, n;
+
+		if (sock_flag(other, SOCK_DEAD) ||
+		    (other->sk_shutdown & RCV_SHUTDOWN)) {
+			err = -EPIPE;
+			break;
+		}
+
+		avail = unix_ring_size(ring) - unix_ring_used(ring);
+		if (!avail) {
+			err = unix_ring_wait_space(sk, other, ring, &timeo);
+			if (err)
+				break;
+			continue;
+		}
+
+		n = min_t(size_t, len - sent, avail);
+		err = unix_ring_copy_from(ring, head, &msg->msg_iter, n);
+		if (err)
+			break;
+
+		smp_store_release(&ring->head, head + n);
+		sent += n;
+
+		/* Only wake a reader which consumed all there was before,
+		 * pairs with the barrier of prepare_to_wait() in
+		 * unix_ring_data_wait().
+		 */
+		smp_mb();
+		if (READ_ONCE(ring->tail) == head)
+			other->sk_data_ready(other);
+	}
+
+	mutex_unlock(&ring->lock);
+
+	return sent ? : err;
+}
+
+static long unix_ring_data_wait(struct sock *sk, struct unix_ring *ring,
+				unsigned int tail, long timeo)
+{
+	DEFINE_WAIT(wait);
+
+	for (;;) {
+		prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
+
+		if (READ_ONCE(ring->head) != tail ||
+		    sk->sk_err ||
+		    (sk->sk_shutdown & RCV_SHUTDOWN) ||
+		    signal_pending(current) ||
+		    !timeo)
+			break;
+
+		sk_set_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+		timeo = freezable_schedule_timeout(timeo);
+		sk_clear_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+	}
+
+	finish_wait(sk_sleep(sk), &wait);
+	return timeo;
+}
+
+static void unix_ring_consume(struct sock *sk, struct unix_ring *ring,
+			      unsigned int tail)
+{
+	unsigned int half = unix_ring_size(ring) / 2;
+	unsigned int old_tail = ring->tail;
+	unsigned int head;
+
+	smp_store_release(&ring->tail, tail);
+
+	/* Pairs with the barrier of prepare_to_wait() in
+	 * unix_ring_wait_space(), so that a writer which saw a full ring
+	 * is seen here.
+	 */
+	smp_mb();
+	head = READ_ONCE(ring->head);
+	if (head - old_tail > half && head - tail <= half) {
+		struct sock *other = unix_peer(sk);
+
+		other->sk_write_space(other);
+	}
+}
+
+static int unix_ring_copy_to(struct unix_ring *ring, unsigned int pos,
+			     struct iov_iter *to, unsigned int len)
+{
+	unsigned int off = pos & ring->mask;
+	unsigned int first = min(len, unix_ring_size(ring) - off);
+
+	if (copy_to_iter(ring->data + off, first, to) != first ||
+	    copy_to_iter(ring->data, len - first, to) != len - first)
+		return -EFAULT;
+
+	return 0;
+}
+
+int unix_ring_recvmsg(struct sock *sk, struct msghdr *msg, size_t size,
+		      int flags)
+{
+	struct unix_ring *ring = unix_ring_sk(sk)->rx;
+	struct unix_sock *u = unix_sk(sk);
+	int target = sock_rcvlowat(sk, flags & MSG_WAITALL, size);
+	long timeo = sock_rcvtimeo(sk, flags & MSG_DONTWAIT);
+	size_t copied = 0;
+	unsigned int tail;
+	int err = 0;
+
+	if (unlikely(flags & MSG_OOB))
+		return -EOPNOTSUPP;
+
+	mutex_lock(&u->iolock);
+	tail = ring->tail;
+
+	while (copied < size) {
+		unsigned int used = smp_load_acquire(&ring->head) - tail;
+		unsigned int n;
+
+		if (!used) {
+			/* A peek does not move the tail the writer checks
+			 * before waking us, so it does not wait once it
+			 * got some data.
+			 */
+			if (copied >= target || (copied && (flags & MSG_PEEK)))
+				break;
+
+			err = sock_error(sk);
+			if (err)
+				break;
+			if (sk->sk_shutdown & RCV_SHUTDOWN)
+				break;
+			if (!timeo) {
+				err = -EAGAIN;
+				break;
+			}
+
+			mutex_unlock(&u->iolock);
+			timeo = unix_ring_data_wait(sk, ring, tail, timeo);
+			if (signal_pending(current)) {
+				err = sock_intr_errno(timeo);
+				goto out;
+			}
+			mutex_lock(&u->iolock);
+			tail = ring->tail;
+			continue;
+		}
+
+		n = min_t(size_t, used, size - copied);
+		err = unix_ring_copy_to(ring, tail, &msg->msg_iter, n);
+		if (err)
+			break;
+
+		tail += n;
+		copied += n;
+		if (!(flags & MSG_PEEK))
+			unix_ring_consume(sk, ring, tail);
+	}
+
+	mutex_unlock(&u->iolock);
+out:
+	return copied ? : err;
+}
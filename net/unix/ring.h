@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __NET_UNIX_RING_H
+#define __NET_UNIX_RING_H
+
+#include <linux/sockios.h>
+#include <net/af_unix.h>
+#include <net/scm.h>
+
+#ifndef SIOCUNIXRING
+#define SIOCUNIXRING	(SIOCPROTOPRIVATE + 1)
+#endif
+
+#define UNIX_RING_MAX_SIZE	(4U << 20)
+
+struct unix_ring;
+
+/**
+ * struct unix_ring_sock - unix socket with the state of the ring mode
+ * @u: the unix socket, must be first
+ * @ring_size: size of the receive ring asked for with SIOCUNIXRING
+ * @rx: ring the peer writes to, and this socket reads from
+ * @tx: ring this socket writes to, the @rx ring of the peer
+ */
+struct unix_ring_sock {
+	struct unix_sock	u;
+	unsigned int		ring_size;
+	struct unix_ring	*rx;
+	struct unix_ring	*tx;
+};
+
+static inline struct unix_ring_sock *unix_ring_sk(const struct sock *sk)
+{
+	return (struct unix_ring_sock *)sk;
+}
+
+/* Set for both ends of an established connection, before it is visible */
+static inline bool unix_ring_active(const struct sock *sk)
+{
+	return READ_ONCE(unix_ring_sk(sk)->tx);
+}
+
+int unix_ring_set_size(struct sock *sk, int __user *arg);
+int unix_ring_prepare(struct sock *sk, struct sock *other,
+		      struct unix_ring **rx, struct unix_ring **tx);
+void unix_ring_attach(struct sock *sk, struct sock *newsk, struct sock *other,
+		      struct unix_ring **rx, struct unix_ring **tx);
+void unix_ring_put(struct unix_ring *ring);
+void unix_ring_release(struct sock *sk);
+
+int unix_ring_sendmsg(struct sock *sk, struct sock *other,
+		      struct scm_cookie *scm, struct msghdr *msg, size_t len);
+int unix_ring_recvmsg(struct sock *sk, struct msghdr *msg, size_t size,
+		      int flags);
+
+unsigned int unix_ring_inq(const struct sock *sk);
+unsigned int unix_ring_outq(const struct sock *sk);
+bool unix_ring_writable(const struct sock *sk);
+
+#endif /* __NET_UNIX_RING_H */
@@ -35,6 +35,17 @@ static struct xdp_sock *xdp_sk(struct sock *sk)
 	return (struct xdp_sock *)sk;
 }
 
+/* The fill and completion rings used by the copy mode paths of a socket */
+static struct xsk_queue *xsk_fq(struct xdp_sock *xs)
+{
+	return xs->rx->umem_ring ?: xs->umem->fq;
+}
+
+static struct xsk_queue *xsk_cq(struct xdp_sock *xs)
+{
+	return xs->tx->umem_ring ?: xs->umem->cq;
+}
+
 bool xsk_is_setup_for_bpf_map(struct xdp_sock *xs)
 {
 	return READ_ONCE(xs->rx) &&  READ_ONCE(xs->umem) &&
@@ -53,13 +64,61 @@ void xsk_umem_discard_addr(struct xdp_umem *umem)
 }
 EXPORT_SYMBOL(xsk_umem_discard_addr);
 
+/* With XDP_USE_NEED_WAKEUP a zero-copy driver sets the need_wakeup flag of
+ * the fill ring when it stops polling it, typically when it ran out of
+ * buffers, and of the TX rings when it stops transmitting, and clears them
+ * when it polls again on its own.  The application only kicks the driver,
+ * with poll(), recvmsg() or sendmsg(), while a flag is set.
+ */
+bool xsk_umem_uses_need_wakeup(struct xdp_umem *umem)
+{
+	return umem->fq->need_wakeup;
+}
+EXPORT_SYMBOL(xsk_umem_uses_need_wakeup);
+
+void xsk_set_rx_need_wakeup(struct xdp_umem *umem)
+{
+	xskq_set_need_wakeup(umem->fq);
+}
+EXPORT_SYMBOL(xsk_set_rx_need_wakeup);
+
+void xsk_clear_rx_need_wakeup(struct xdp_umem *umem)
+{
+	xskq_clear_need_wakeup(umem->fq);
+}
+EXPORT_SYMBOL(xsk_clear_rx_need_wakeup);
+
+void xsk_set_tx_need_wakeup(struct xdp_umem *umem)
+{
+	struct xdp_sock *xs;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(xs, &umem->xsk_list, list) {
+		xskq_set_need_wakeup(xs->tx);
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(xsk_set_tx_need_wakeup);
+
+void xsk_clear_tx_need_wakeup(struct xdp_umem *umem)
+{
+	struct xdp_sock *xs;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(xs, &umem->xsk_list, list) {
+		xskq_clear_need_wakeup(xs->tx);
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(xsk_clear_tx_need_wakeup);
+
 static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
 {
 	void *buffer;
 	u64 addr;
 	int err;
 
-	if (!xskq_peek_addr(xs->umem->fq, &addr) ||
+	if (!xskq_peek_addr(xsk_fq(xs), &addr) ||
 	    len > xs->umem->chunk_size_nohr) {
 		xs->rx_dropped++;
 		return -ENOSPC;
@@ -71,7 +130,7 @@ static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
 	memcpy(buffer, xdp->data, len);
 	err = xskq_produce_batch_desc(xs->rx, addr, len);
 	if (!err) {
-		xskq_discard_addr(xs->umem->fq);
+		xskq_discard_addr(xsk_fq(xs));
 		xdp_return_buff(xdp);
 		return 0;
 	}
@@ -119,7 +178,7 @@ int xsk_generic_rcv(struct xdp_sock *xs, struct xdp_buff *xdp)
 	if (xs->dev != xdp->rxq->dev || xs->queue_id != xdp->rxq->queue_index)
 		return -EINVAL;
 
-	if (!xskq_peek_addr(xs->umem->fq, &addr) ||
+	if (!xskq_peek_addr(xsk_fq(xs), &addr) ||
 	    len > xs->umem->chunk_size_nohr) {
 		xs->rx_dropped++;
 		return -ENOSPC;
@@ -131,7 +190,7 @@ int xsk_generic_rcv(struct xdp_sock *xs, struct xdp_buff *xdp)
 	memcpy(buffer, xdp->data, len);
 	err = xskq_produce_batch_desc(xs->rx, addr, len);
 	if (!err) {
-		xskq_discard_addr(xs->umem->fq);
+		xskq_discard_addr(xsk_fq(xs));
 		xsk_flush(xs);
 		return 0;
 	}
@@ -200,7 +259,7 @@ static void xsk_destruct_skb(struct sk_buff *skb)
 	unsigned long flags;
 
 	spin_lock_irqsave(&xs->tx_completion_lock, flags);
-	WARN_ON_ONCE(xskq_produce_addr(xs->umem->cq, addr));
+	WARN_ON_ONCE(xskq_produce_addr(xsk_cq(xs), addr));
 	spin_unlock_irqrestore(&xs->tx_completion_lock, flags);
 
 	sock_wfree(skb);
@@ -228,7 +287,7 @@ static int xsk_generic_xmit(struct sock *sk, struct msghdr *m,
 			goto out;
 		}
 
-		if (xskq_reserve_addr(xs->umem->cq))
+		if (xskq_reserve_addr(xsk_cq(xs)))
 			goto out;
 
 		if (xs->queue_id >= xs->dev->real_num_tx_queues)
@@ -294,6 +353,28 @@ static int xsk_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
 	return (xs->zc) ? xsk_zc_xmit(sk) : xsk_generic_xmit(sk, m, total_len);
 }
 
+/* Kicks the driver to refill its RX queue from the fill ring */
+static int xsk_recvmsg(struct socket *sock, struct msghdr *m, size_t len,
+		       int flags)
+{
+	bool need_wait = !(flags & MSG_DONTWAIT);
+	struct sock *sk = sock->sk;
+	struct xdp_sock *xs = xdp_sk(sk);
+
+	if (unlikely(!xs->dev))
+		return -ENXIO;
+	if (unlikely(!(xs->dev->flags & IFF_UP)))
+		return -ENETDOWN;
+	if (unlikely(!xs->rx))
+		return -ENOBUFS;
+	if (need_wait)
+		return -EOPNOTSUPP;
+
+	if (xs->zc && xskq_needs_wakeup(xs->umem->fq))
+		return xsk_zc_xmit(sk);
+	return 0;
+}
+
 static unsigned int xsk_poll(struct file *file, struct socket *sock,
 			     struct poll_table_struct *wait)
 {
@@ -301,6 +382,17 @@ static unsigned int xsk_poll(struct file *file, struct socket *sock,
 	struct sock *sk = sock->sk;
 	struct xdp_sock *xs = xdp_sk(sk);
 
+	/* A single poll() both waits for RX and does the kicks asked for */
+	if (xs->dev && xs->umem) {
+		if (xs->zc) {
+			if (xskq_needs_wakeup(xs->tx) ||
+			    xskq_needs_wakeup(xs->umem->fq))
+				xsk_zc_xmit(sk);
+		} else if (xskq_needs_wakeup(xs->tx)) {
+			xsk_generic_xmit(sk, NULL, 0);
+		}
+	}
+
 	if (xs->rx && !xskq_empty_desc(xs->rx))
 		mask |= POLLIN | POLLRDNORM;
 	if (xs->tx && !xskq_full_desc(xs->tx))
@@ -381,6 +473,7 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 	struct sock *sk = sock->sk;
 	struct xdp_sock *xs = xdp_sk(sk);
 	struct net_device *dev;
+	bool need_wakeup;
 	u32 flags, qid;
 	int err = 0;
 
@@ -415,12 +508,16 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 	}
 
 	flags = sxdp->sxdp_flags;
+	need_wakeup = flags & XDP_USE_NEED_WAKEUP;
 
 	if (flags & XDP_SHARED_UMEM) {
+		bool own_rings = (xs->rx && xs->rx->umem_ring) ||
+				 (xs->tx && xs->tx->umem_ring);
 		struct xdp_sock *umem_xs;
 		struct socket *sock;
 
-		if ((flags & XDP_COPY) || (flags & XDP_ZEROCOPY)) {
+		if ((flags & XDP_COPY) || (flags & XDP_ZEROCOPY) ||
+		    need_wakeup) {
 			/* Cannot specify flags for shared sockets. */
 			err = -EINVAL;
 			goto out_unlock;
@@ -444,7 +541,18 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 			err = -EBADF;
 			sockfd_put(sock);
 			goto out_unlock;
-		} else if (umem_xs->dev != dev || umem_xs->queue_id != qid) {
+		} else if (umem_xs->umem->zc && (own_rings ||
+			   umem_xs->dev != dev || umem_xs->queue_id != qid)) {
+			/* The driver owns the rings of a zero-copy umem */
+			err = -EINVAL;
+			sockfd_put(sock);
+			goto out_unlock;
+		} else if ((umem_xs->dev != dev || umem_xs->queue_id != qid) &&
+			   ((xs->rx && !xs->rx->umem_ring) ||
+			    (xs->tx && !xs->tx->umem_ring))) {
+			/* Other queues need fill and completion rings of
+			 * their own, as they may run concurrently.
+			 */
 			err = -EINVAL;
 			sockfd_put(sock);
 			goto out_unlock;
@@ -453,6 +561,16 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 		xdp_get_umem(umem_xs->umem);
 		xs->umem = umem_xs->umem;
 		sockfd_put(sock);
+		need_wakeup = xs->umem->fq->need_wakeup;
+		if (xs->rx)
+			xskq_set_umem(xs->rx->umem_ring, &xs->umem->props);
+		if (xs->tx)
+			xskq_set_umem(xs->tx->umem_ring, &xs->umem->props);
+	} else if ((xs->rx && xs->rx->umem_ring) ||
+		   (xs->tx && xs->tx->umem_ring)) {
+		/* Rings of its own only make sense on a shared umem */
+		err = -EINVAL;
+		goto out_unlock;
 	} else if (!xs->umem || !xdp_umem_validate_queues(xs->umem)) {
 		err = -EINVAL;
 		goto out_unlock;
@@ -464,6 +582,11 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 		err = xdp_umem_assign_dev(xs->umem, dev, qid, flags);
 		if (err)
 			goto out_unlock;
+
+		/* Until the driver says otherwise it needs a kick for RX */
+		xs->umem->fq->need_wakeup = need_wakeup;
+		if (xs->umem->zc)
+			xskq_set_need_wakeup(xs->umem->fq);
 	}
 
 	xs->dev = dev;
@@ -471,6 +594,11 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 	xs->queue_id = qid;
 	xskq_set_umem(xs->rx, &xs->umem->props);
 	xskq_set_umem(xs->tx, &xs->umem->props);
+	/* TX is always started by a syscall, and in copy mode run by one */
+	if (xs->tx) {
+		xs->tx->need_wakeup = need_wakeup;
+		xskq_set_need_wakeup(xs->tx);
+	}
 	xdp_add_sk_umem(xs->umem, xs);
 
 out_unlock:
@@ -545,13 +673,25 @@ static int xsk_setsockopt(struct socket *sock, int level, int optname,
 			return -EFAULT;
 
 		mutex_lock(&xs->mutex);
-		if (!xs->umem) {
-			mutex_unlock(&xs->mutex);
-			return -EINVAL;
+		if (xs->umem) {
+			q = (optname == XDP_UMEM_FILL_RING) ? &xs->umem->fq :
+				&xs->umem->cq;
+		} else {
+			/* Rings of its own, for a socket that will be bound
+			 * with XDP_SHARED_UMEM to another queue or device.
+			 * They belong to its RX and TX rings, which have to
+			 * be created first.
+			 */
+			struct xsk_queue *ring = xs->tx;
+
+			if (optname == XDP_UMEM_FILL_RING)
+				ring = xs->rx;
+			if (!ring || xs->dev) {
+				mutex_unlock(&xs->mutex);
+				return -EINVAL;
+			}
+			q = &ring->umem_ring;
 		}
-
-		q = (optname == XDP_UMEM_FILL_RING) ? &xs->umem->fq :
-			&xs->umem->cq;
 		err = xsk_init_queue(entries, q, true);
 		mutex_unlock(&xs->mutex);
 		return err;
@@ -601,28 +741,54 @@ static int xsk_getsockopt(struct socket *sock, int level, int optname,
 	}
 	case XDP_MMAP_OFFSETS:
 	{
-		struct xdp_mmap_offsets off;
+		struct xdp_mmap_offsets_v2 off;
 
-		if (len < sizeof(off))
+		if (len < sizeof(struct xdp_mmap_offsets))
 			return -EINVAL;
 
 		off.rx.producer = offsetof(struct xdp_rxtx_ring, ptrs.producer);
 		off.rx.consumer = offsetof(struct xdp_rxtx_ring, ptrs.consumer);
 		off.rx.desc	= offsetof(struct xdp_rxtx_ring, desc);
+		off.rx.flags	= offsetof(struct xdp_rxtx_ring, ptrs.flags);
 		off.tx.producer = offsetof(struct xdp_rxtx_ring, ptrs.producer);
 		off.tx.consumer = offsetof(struct xdp_rxtx_ring, ptrs.consumer);
 		off.tx.desc	= offsetof(struct xdp_rxtx_ring, desc);
+		off.tx.flags	= offsetof(struct xdp_rxtx_ring, ptrs.flags);
 
 		off.fr.producer = offsetof(struct xdp_umem_ring, ptrs.producer);
 		off.fr.consumer = offsetof(struct xdp_umem_ring, ptrs.consumer);
 		off.fr.desc	= offsetof(struct xdp_umem_ring, desc);
+		off.fr.flags	= offsetof(struct xdp_umem_ring, ptrs.flags);
 		off.cr.producer = offsetof(struct xdp_umem_ring, ptrs.producer);
 		off.cr.consumer = offsetof(struct xdp_umem_ring, ptrs.consumer);
 		off.cr.desc	= offsetof(struct xdp_umem_ring, desc);
-
-		len = sizeof(off);
-		if (copy_to_user(optval, &off, len))
-			return -EFAULT;
+		off.cr.flags	= offsetof(struct xdp_umem_ring, ptrs.flags);
+
+		if (len >= sizeof(off)) {
+			len = sizeof(off);
+			if (copy_to_user(optval, &off, len))
+				return -EFAULT;
+		} else {
+			struct xdp_mmap_offsets off_v1;
+
+			/* Old layout, without the flags */
+			off_v1.rx.producer = off.rx.producer;
+			off_v1.rx.consumer = off.rx.consumer;
+			off_v1.rx.desc = off.rx.desc;
+			off_v1.tx.producer = off.tx.producer;
+			off_v1.tx.consumer = off.tx.consumer;
+			off_v1.tx.desc = off.tx.desc;
+			off_v1.fr.producer = off.fr.producer;
+			off_v1.fr.consumer = off.fr.consumer;
+			off_v1.fr.desc = off.fr.desc;
+			off_v1.cr.producer = off.cr.producer;
+			off_v1.cr.consumer = off.cr.consumer;
+			off_v1.cr.desc = off.cr.desc;
+
+			len = sizeof(off_v1);
+			if (copy_to_user(optval, &off_v1, len))
+				return -EFAULT;
+		}
 		if (put_user(len, optlen))
 			return -EFAULT;
 
@@ -650,14 +816,17 @@ static int xsk_mmap(struct file *file, struct socket *sock,
 		q = READ_ONCE(xs->rx);
 	} else if (offset == XDP_PGOFF_TX_RING) {
 		q = READ_ONCE(xs->tx);
-	} else {
+	} else if (offset == XDP_UMEM_PGOFF_FILL_RING) {
+		q = READ_ONCE(xs->rx);
+		q = q ? READ_ONCE(q->umem_ring) : NULL;
 		umem = READ_ONCE(xs->umem);
-		if (!umem)
-			return -EINVAL;
-
-		if (offset == XDP_UMEM_PGOFF_FILL_RING)
+		if (!q && umem)
 			q = READ_ONCE(umem->fq);
-		else if (offset == XDP_UMEM_PGOFF_COMPLETION_RING)
+	} else if (offset == XDP_UMEM_PGOFF_COMPLETION_RING) {
+		q = READ_ONCE(xs->tx);
+		q = q ? READ_ONCE(q->umem_ring) : NULL;
+		umem = READ_ONCE(xs->umem);
+		if (!q && umem)
 			q = READ_ONCE(umem->cq);
 	}
 
@@ -695,7 +864,7 @@ static const struct proto_ops xsk_proto_ops = {
 	.setsockopt	= xsk_setsockopt,
 	.getsockopt	= xsk_getsockopt,
 	.sendmsg	= xsk_sendmsg,
-	.recvmsg	= sock_no_recvmsg,
+	.recvmsg	= xsk_recvmsg,
 	.mmap		= xsk_mmap,
 	.sendpage	= sock_no_sendpage,
 };
@@ -707,6 +876,10 @@ static void xsk_destruct(struct sock *sk)
 	if (!sock_flag(sk, SOCK_DEAD))
 		return;
 
+	if (xs->rx)
+		xskq_destroy(xs->rx->umem_ring);
+	if (xs->tx)
+		xskq_destroy(xs->tx->umem_ring);
 	xskq_destroy(xs->rx);
 	xskq_destroy(xs->tx);
 	xdp_del_sk_umem(xs->umem, xs);
@@ -13,9 +13,33 @@
 #define RX_BATCH_SIZE 16
 #define LAZY_UPDATE_THRESHOLD 128
 
+/* Bind flag: the kernel tells through the rings when it needs a syscall */
+#define XDP_USE_NEED_WAKEUP (1 << 3)
+
+/* Ring flag: the kernel will not look at the ring again until kicked */
+#define XDP_RING_NEED_WAKEUP (1 << 0)
+
 struct xdp_ring {
 	u32 producer ____cacheline_aligned_in_smp;
 	u32 consumer ____cacheline_aligned_in_smp;
+	u32 flags;
+};
+
+/* XDP_MMAP_OFFSETS with the offset of the ring flags, returned when the
+ * option buffer is large enough for it.
+ */
+struct xdp_ring_offset_v2 {
+	__u64 producer;
+	__u64 consumer;
+	__u64 desc;
+	__u64 flags;
+};
+
+struct xdp_mmap_offsets_v2 {
+	struct xdp_ring_offset_v2 rx;
+	struct xdp_ring_offset_v2 tx;
+	struct xdp_ring_offset_v2 fr; /* Fill */
+	struct xdp_ring_offset_v2 cr; /* Completion */
 };
 
 /* Used for the RX and TX queues for packets */
@@ -40,6 +64,11 @@ struct xsk_queue {
 	u32 cons_tail;
 	struct xdp_ring *ring;
 	u64 invalid_descs;
+	bool need_wakeup;
+	/* Fill ring of an RX queue or completion ring of a TX queue, for a
+	 * socket with rings of its own on a umem shared across queues
+	 */
+	struct xsk_queue *umem_ring;
 };
 
 /* Common functions operating for both RXTX and umem queues */
@@ -74,6 +103,32 @@ static inline u32 xskq_nb_free(struct xsk_queue *q, u32 producer, u32 dcnt)
 	return q->nentries - (producer - q->cons_tail);
 }
 
+static inline bool xskq_needs_wakeup(struct xsk_queue *q)
+{
+	return q && q->need_wakeup &&
+	       (READ_ONCE(q->ring->flags) & XDP_RING_NEED_WAKEUP);
+}
+
+static inline void xskq_set_need_wakeup(struct xsk_queue *q)
+{
+	if (!q || !q->need_wakeup ||
+	    (q->ring->flags & XDP_RING_NEED_WAKEUP))
+		return;
+
+	WRITE_ONCE(q->ring->flags, q->ring->flags | XDP_RING_NEED_WAKEUP);
+	/* Order the flag before the last look at the producer */
+	smp_mb();
+}
+
+static inline void xskq_clear_need_wakeup(struct xsk_queue *q)
+{
+	if (!q || !q->need_wakeup ||
+	    !(q->ring->flags & XDP_RING_NEED_WAKEUP))
+		return;
+
+	WRITE_ONCE(q->ring->flags, q->ring->flags & ~XDP_RING_NEED_WAKEUP);
+}
+
 /* UMEM queue */
 
 static inline bool xskq_is_valid_addr(struct xsk_queue *q, u64 addr)
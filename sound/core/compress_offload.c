@@ -37,6 +37,7 @@
 #include <linux/types.h>
 #include <linux/uio.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <linux/module.h>
 #include <linux/compat.h>
 #include <sound/core.h>
@@ -171,7 +172,7 @@ static int snd_compr_free(struct inode *inode, struct file *f)
 	}
 
 	data->stream.ops->free(&data->stream);
-	kfree(data->stream.runtime->buffer);
+	kvfree(data->stream.runtime->buffer);
 	kfree(data->stream.runtime);
 	kfree(data);
 	return 0;
@@ -391,9 +392,81 @@ static ssize_t snd_compr_read(struct file *f, char __user *buf,
 	return retval;
 }
 
+/*
+ * The ring buffer the core allocates for a playback stream can be mapped
+ * when the driver asked for it with mmap_buffer, so that the compressed
+ * data is written to it in place and handed over with SNDRV_COMPRESS_COMMIT
+ * instead of being copied by write().  The ring buffers of drivers
+ * implementing copy live on their side and can't.  No driver in the tree
+ * sets mmap_buffer yet, so until one does both return -ENXIO.
+ */
 static int snd_compr_mmap(struct file *f, struct vm_area_struct *vma)
 {
-	return -ENXIO;
+	struct snd_compr_file *data = f->private_data;
+	struct snd_compr_stream *stream;
+	int retval = -ENXIO;
+
+	if (snd_BUG_ON(!data))
+		return -EFAULT;
+
+	stream = &data->stream;
+	mutex_lock(&stream->device->lock);
+	if (stream->direction == SND_COMPRESS_PLAYBACK &&
+	    stream->mmap_buffer && stream->runtime->buffer)
+		retval = remap_vmalloc_range(vma, stream->runtime->buffer,
+					     vma->vm_pgoff);
+	mutex_unlock(&stream->device->lock);
+	return retval;
+}
+
+static int snd_compr_commit(struct snd_compr_stream *stream, unsigned long arg)
+{
+	struct snd_compr_runtime *runtime = stream->runtime;
+	__u32 count;
+
+	if (get_user(count, (__u32 __user *)arg))
+		return -EFAULT;
+	if (stream->direction != SND_COMPRESS_PLAYBACK ||
+	    !stream->mmap_buffer || !runtime->buffer)
+		return -ENXIO;
+
+	switch (runtime->state) {
+	case SNDRV_PCM_STATE_SETUP:
+	case SNDRV_PCM_STATE_PREPARED:
+	case SNDRV_PCM_STATE_RUNNING:
+		break;
+	default:
+		return -EBADFD;
+	}
+
+	if (count > snd_compr_get_avail(stream))
+		return -EINVAL;
+
+	/* if DSP cares, let it know data has been written */
+	if (stream->ops->ack)
+		stream->ops->ack(stream, count);
+	runtime->total_bytes_available += count;
+
+	/* as for write, the first commit moves the stream to PREPARED */
+	if (runtime->state == SNDRV_PCM_STATE_SETUP)
+		runtime->state = SNDRV_PCM_STATE_PREPARED;
+	return 0;
+}
+
+static int
+snd_compr_set_avail_min(struct snd_compr_stream *stream, unsigned long arg)
+{
+	__u32 avail_min;
+
+	if (get_user(avail_min, (__u32 __user *)arg))
+		return -EFAULT;
+	if (stream->runtime->state == SNDRV_PCM_STATE_OPEN)
+		return -EBADFD;
+	if (!avail_min || avail_min > stream->runtime->buffer_size)
+		return -EINVAL;
+
+	stream->runtime->avail_min = avail_min;
+	return 0;
 }
 
 static __poll_t snd_compr_get_poll(struct snd_compr_stream *stream)
@@ -443,7 +516,9 @@ static __poll_t snd_compr_poll(struct file *f, poll_table *wait)
 	case SNDRV_PCM_STATE_RUNNING:
 	case SNDRV_PCM_STATE_PREPARED:
 	case SNDRV_PCM_STATE_PAUSED:
-		if (avail >= stream->runtime->fragment_size)
+		if (stream->direction == SND_COMPRESS_PLAYBACK ?
+		    avail >= stream->runtime->avail_min :
+		    avail >= stream->runtime->fragment_size)
 			retval = snd_compr_get_poll(stream);
 		break;
 	default:
@@ -513,6 +588,12 @@ static int snd_compr_allocate_buffer(struct snd_compr_stream *stream,
 		/* if copy is defined the driver will be required to copy
 		 * the data from core
 		 */
+	} else if (stream->mmap_buffer &&
+		   stream->direction == SND_COMPRESS_PLAYBACK) {
+		/* vmalloc_user() so that it can be mmapped */
+		buffer = vmalloc_user(buffer_size);
+		if (!buffer)
+			return -ENOMEM;
 	} else {
 		buffer = kmalloc(buffer_size, GFP_KERNEL);
 		if (!buffer)
@@ -520,6 +601,8 @@ static int snd_compr_allocate_buffer(struct snd_compr_stream *stream,
 	}
 	stream->runtime->fragment_size = params->buffer.fragment_size;
 	stream->runtime->fragments = params->buffer.fragments;
+	stream->runtime->avail_min = params->buffer.fragment_size;
+	stream->runtime->no_wake_mode = params->no_wake_mode;
 	stream->runtime->buffer = buffer;
 	stream->runtime->buffer_size = buffer_size;
 	return 0;
@@ -896,6 +979,12 @@ static long snd_compr_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 	case _IOC_NR(SNDRV_COMPRESS_AVAIL):
 		retval = snd_compr_ioctl_avail(stream, arg);
 		break;
+	case _IOC_NR(SNDRV_COMPRESS_SET_AVAIL_MIN):
+		retval = snd_compr_set_avail_min(stream, arg);
+		break;
+	case _IOC_NR(SNDRV_COMPRESS_COMMIT):
+		retval = snd_compr_commit(stream, arg);
+		break;
 	case _IOC_NR(SNDRV_COMPRESS_PAUSE):
 		retval = snd_compr_pause(stream);
 		break;
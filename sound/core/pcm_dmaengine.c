@@ -146,7 +146,15 @@ static void dmaengine_pcm_dma_complete(void *arg)
 	if (prtd->pos >= snd_pcm_lib_buffer_bytes(substream))
 		prtd->pos = 0;
 
-	snd_pcm_period_elapsed(substream);
+	/*
+	 * Some DMA controllers call back on each segment of a cyclic
+	 * transfer even without DMA_PREP_INTERRUPT.  Without period wakeups
+	 * only keep the status record current then.
+	 */
+	if (substream->runtime->no_period_wakeup)
+		snd_pcm_position_update(substream);
+	else
+		snd_pcm_period_elapsed(substream);
 }
 
 static int dmaengine_pcm_prepare_and_submit(struct snd_pcm_substream *substream)
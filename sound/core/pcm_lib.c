@@ -1816,6 +1816,35 @@ void snd_pcm_period_elapsed(struct snd_pcm_substream *substream)
 }
 EXPORT_SYMBOL(snd_pcm_period_elapsed);
 
+/**
+ * snd_pcm_position_update - update the pcm status outside of period handling
+ * @substream: the pcm substream instance
+ *
+ * This function is called by drivers which learn about the progress of
+ * the hardware pointer other than by period interrupts, e.g. from a DSP
+ * position report, or from DMA callbacks while the stream runs without
+ * period wakeups.  It refreshes the hardware pointer and the timestamps
+ * in the status record, which the application may have mmapped, and
+ * wakes up sleepers once avail_min is reached, but unlike
+ * snd_pcm_period_elapsed() it does not assume that a period boundary
+ * was crossed, kick the PCM timer or send SIGIO.
+ *
+ * It may be called from interrupt context.
+ */
+void snd_pcm_position_update(struct snd_pcm_substream *substream)
+{
+	unsigned long flags;
+
+	if (PCM_RUNTIME_CHECK(substream))
+		return;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	if (snd_pcm_running(substream))
+		snd_pcm_update_hw_ptr0(substream, 0);
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+}
+EXPORT_SYMBOL(snd_pcm_position_update);
+
 /*
  * Wait until avail_min data becomes available
  * Returns a negative error code if any error occurs during operation.
@@ -103,6 +103,10 @@ enum bpf_cmd {
 	BPF_BTF_LOAD,
 	BPF_BTF_GET_FD_BY_ID,
 	BPF_TASK_FD_QUERY,
+	/* taken ahead of the commands before them, at their upstream values */
+	BPF_MAP_LOOKUP_BATCH = 24,
+	BPF_MAP_UPDATE_BATCH = 26,
+	BPF_MAP_DELETE_BATCH,
 };
 
 enum bpf_map_type {
@@ -127,6 +131,9 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_SOCKHASH,
 	BPF_MAP_TYPE_CGROUP_STORAGE,
 	BPF_MAP_TYPE_REUSEPORT_SOCKARRAY,
+	/* taken ahead of the types before them, at their upstream values */
+	BPF_MAP_TYPE_DEVMAP_HASH = 25,
+	BPF_MAP_TYPE_RINGBUF = 27,
 };
 
 enum bpf_prog_type {
@@ -263,6 +270,55 @@ enum bpf_attach_type {
 /* Flag for stack_map, store build_id+offset instead of pointer */
 #define BPF_F_STACK_BUILD_ID	(1U << 5)
 
+/* Flag for array maps: the values can be mmap()ed from the map fd, at
+ * offset 0 and round_up(value_size, 8) bytes apart.  Same value as
+ * upstream.
+ */
+#define BPF_F_MMAPABLE		(1U << 10)
+
+/* The flags below have no upstream counterpart, and are allocated from the
+ * top bit down to stay clear of the ones upstream allocates.
+ */
+
+/* Flag for BPF_F_NO_PREALLOC hash maps, start with few buckets and grow
+ * them as elements are added, up to what max_entries would allocate.
+ */
+#define BPF_F_RESIZABLE		(1U << 31)
+
+/* Like BPF_F_NO_COMMON_LRU, a percpu LRU list, but a CPU whose list has
+ * nothing left to evict takes free and inactive nodes from the lists of
+ * the other CPUs, rather than evicting its own recently used ones.
+ */
+#define BPF_F_SHARDED_LRU	(1U << 30)
+
+/* Flag for BPF_MAP_TYPE_LPM_TRIE: lookups of keys of the full prefix length
+ * go through a stride 8 table, rebuilt from the trie shortly after updates.
+ * Until a rebuild completes, they walk the trie as without the flag.
+ */
+#define BPF_F_LPM_MULTIBIT	(1U << 29)
+
+/* BPF_MAP_TYPE_RINGBUF: max_entries is the size of the ring in bytes, a
+ * power of 2 multiple of the page size.  mmap() of the map fd maps the
+ * consumer position at page 0, which is the only page that can be mapped
+ * writable, then the producer position at page 1 and the data, mapped twice
+ * in a row, from page 2 on.  Each record starts with a BPF_RINGBUF_HDR_SZ
+ * header, a __u32 length of the data followed by a reserved __u32, and the
+ * next one follows at round_up(length + BPF_RINGBUF_HDR_SZ, 8).  The length
+ * has BPF_RINGBUF_BUSY_BIT set while the record is still being written.
+ */
+#define BPF_RINGBUF_BUSY_BIT	(1U << 31)
+#define BPF_RINGBUF_HDR_SZ	8
+
+/* flags for bpf_ringbuf_output() */
+#define BPF_RB_NO_WAKEUP	(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP	(1ULL << 1)
+
+/* what bpf_ringbuf_query() reports */
+#define BPF_RB_AVAIL_DATA	0
+#define BPF_RB_RING_SIZE	1
+#define BPF_RB_CONS_POS		2
+#define BPF_RB_PROD_POS		3
+
 enum bpf_stack_build_id_status {
 	/* user space need an empty entry to identify end of a trace */
 	BPF_STACK_BUILD_ID_EMPTY = 0,
@@ -312,6 +368,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input: # of elements in keys
+						 * and values (room for them
+						 * on lookup)
+						 * output: # of elements done
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;	/* BPF_ANY etc. for updates */
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -1460,8 +1533,11 @@ union bpf_attr {
  * 		but this is only implemented for native XDP (with driver
  * 		support) as of this writing).
  *
- * 		All values for *flags* are reserved for future usage, and must
- * 		be left at zero.
+ * 		For net device maps, **BPF_F_BROADCAST** in *flags* sends a
+ * 		copy of the packet to every device of the *map*, and *key* is
+ * 		ignored.  **BPF_F_EXCLUDE_INGRESS** then leaves out the device
+ * 		the packet came in from.  All other values for *flags* are
+ * 		reserved for future usage, and must be left at zero.
  *
  * 		When used to redirect packets to net devices, this helper
  * 		provides a high performance increase over **bpf_redirect**\ ().
@@ -2141,6 +2217,31 @@ union bpf_attr {
  *		request in the skb.
  *	Return
  *		0 on success, or a negative error in case of failure.
+ *
+ * int bpf_ringbuf_output(void *ringbuf, void *data, u64 size, u64 flags)
+ *	Description
+ *		Copy *size* bytes from *data* into a new record of the
+ *		**BPF_MAP_TYPE_RINGBUF** map *ringbuf*.  The records of all
+ *		the CPUs are read in the order they were written.
+ *
+ *		The consumer is only woken up when it has read all the
+ *		records before this one.  With **BPF_RB_NO_WAKEUP** it isn't
+ *		woken up at all, and with **BPF_RB_FORCE_WAKEUP** it always
+ *		is.
+ *	Return
+ *		0 on success, **-EAGAIN** if the ring is full, or another
+ *		negative error in case of failure.
+ *
+ * u64 bpf_ringbuf_query(void *ringbuf, u64 flags)
+ *	Description
+ *		Query a property of the **BPF_MAP_TYPE_RINGBUF** map
+ *		*ringbuf*: **BPF_RB_AVAIL_DATA** for the bytes not consumed
+ *		yet, **BPF_RB_RING_SIZE** for the size of the ring,
+ *		**BPF_RB_CONS_POS** and **BPF_RB_PROD_POS** for the consumer
+ *		and producer positions.
+ *	Return
+ *		The value asked for, or 0 for unknown *flags*.  The value
+ *		may be out of date by the time it is used.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -2228,14 +2329,22 @@ union bpf_attr {
 	FN(sk_select_reuseport),	\
 	FN(skb_ancestor_cgroup_id),
 
+/* Helpers taken ahead of the ones before them, at their upstream ids */
+#define __BPF_FUNC_MAPPER_FIXED(FN)	\
+	FN(ringbuf_output, 130),	\
+	FN(ringbuf_query, 134),
+
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
  */
 #define __BPF_ENUM_FN(x) BPF_FUNC_ ## x
+#define __BPF_ENUM_FIXED_FN(x, id) BPF_FUNC_ ## x = id
 enum bpf_func_id {
 	__BPF_FUNC_MAPPER(__BPF_ENUM_FN)
+	__BPF_FUNC_MAPPER_FIXED(__BPF_ENUM_FIXED_FN)
 	__BPF_FUNC_MAX_ID,
 };
+#undef __BPF_ENUM_FIXED_FN
 #undef __BPF_ENUM_FN
 
 /* All flags used by eBPF helper functions, placed here. */
@@ -2282,6 +2391,10 @@ enum bpf_func_id {
 /* BPF_FUNC_perf_event_output for sk_buff input context. */
 #define BPF_F_CTXLEN_MASK		(0xfffffULL << 32)
 
+/* BPF_FUNC_redirect_map flags for BPF_MAP_TYPE_DEVMAP{,_HASH}. */
+#define BPF_F_BROADCAST			(1ULL << 3)
+#define BPF_F_EXCLUDE_INGRESS		(1ULL << 4)
+
 /* Mode for BPF_FUNC_skb_adjust_room helper. */
 enum bpf_adj_room_mode {
 	BPF_ADJ_ROOM_NET,
@@ -2769,6 +2882,19 @@ struct bpf_fib_lookup {
 	__u8	dmac[6];     /* ETH_ALEN */
 };
 
+/* BPF_MAP_TYPE_CPUMAP value, with a value_size of 8.  The XDP program, if
+ * fd is positive, runs on the remote CPU before the frames are turned into
+ * skbs; XDP_PASS hands them to the stack, XDP_DROP and any other action
+ * drop them.
+ */
+struct bpf_cpumap_val {
+	__u32 qsize;	/* queue size to remote target CPU */
+	union {
+		int   fd;	/* prog fd on map write */
+		__u32 id;	/* prog id on map read */
+	} bpf_prog;
+};
+
 enum bpf_task_fd_type {
 	BPF_FD_TYPE_RAW_TRACEPOINT,	/* tp name */
 	BPF_FD_TYPE_TRACEPOINT,		/* tp name */
@@ -0,0 +1,479 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * ipc-binder: Benchmark for binder transactions
+ *
+ * A server process becomes the context manager of the binder device and
+ * answers transactions from client threads of the parent, which all call
+ * handle 0.  Transactions are synchronous unless --oneway is given, and may
+ * carry a file descriptor each with --fd.
+ *
+ * The device needs not to have a context manager already, so on a running
+ * Android system use one of its own, such as a new binderfs instance.
+ *
+ * Oneway transactions to a node are delivered one at a time, so more server
+ * threads only help synchronous ones.  The latency of a oneway transaction
+ * is the time its sender waits for the driver to take it.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/time64.h>
+#include "../builtin.h"
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+/* Needs pid_t and uid_t */
+#include <linux/android/binder.h>
+
+#define BINDER_MAP_SIZE		((1 << 20) - 2 * 4096)
+#define BINDER_READ_SIZE	1024
+#define BINDER_WRITE_SIZE	256
+
+struct client {
+	pthread_t		thread;
+	u64			*lat_ns;	/* its slice of lat_ns[] */
+	unsigned int		retries;
+};
+
+static const char		*device = "/dev/binder";
+static unsigned int		loops = 100000;
+static unsigned int		nclients = 1;
+static unsigned int		nthreads = 1;
+static unsigned int		size = 64;
+static unsigned int		reply_size = 16;
+static bool			oneway;
+static bool			pass_fd;
+
+static int			binder_fd;
+static char			*payload;
+
+static const struct option options[] = {
+	OPT_STRING('d', "device", &device, "path", "Binder device to use"),
+	OPT_UINTEGER('l', "loops", &loops, "Transactions per client"),
+	OPT_UINTEGER('c', "clients", &nclients, "Number of client threads"),
+	OPT_UINTEGER('t', "threads", &nthreads, "Number of server threads"),
+	OPT_UINTEGER('s', "size", &size, "Size of a transaction, in bytes"),
+	OPT_UINTEGER('r', "reply-size", &reply_size, "Size of a reply, in bytes"),
+	OPT_BOOLEAN('o', "oneway", &oneway, "Use oneway transactions"),
+	OPT_BOOLEAN('f', "fd", &pass_fd, "Pass a file descriptor with each transaction"),
+	OPT_END()
+};
+
+static const char * const bench_ipc_binder_usage[] = {
+	"perf bench ipc binder <options>",
+	NULL
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int binder_open(void)
+{
+	struct binder_version version;
+	void *map;
+	int fd;
+
+	fd = open(device, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		err(EXIT_FAILURE, "open %s", device);
+
+	if (ioctl(fd, BINDER_VERSION, &version) ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION)
+		errx(EXIT_FAILURE, "%s: unsupported binder protocol", device);
+
+	map = mmap(NULL, BINDER_MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap %s", device);
+
+	return fd;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wsize,
+			     void *rbuf, size_t rsize, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_buffer	= (binder_uintptr_t)wbuf,
+		.write_size	= wsize,
+		.read_buffer	= (binder_uintptr_t)rbuf,
+		.read_size	= rsize,
+	};
+	int ret;
+
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret && errno == EINTR);
+
+	*consumed = bwr.read_consumed;
+	return ret;
+}
+
+#define put_cmd(p, cmd)					\
+	do {						\
+		*(u32 *)(p) = (cmd);			\
+		(p) += sizeof(u32);			\
+	} while (0)
+
+#define put_obj(p, obj)					\
+	do {						\
+		memcpy((p), &(obj), sizeof(obj));	\
+		(p) += sizeof(obj);			\
+	} while (0)
+
+/* Closes the file descriptors a transaction brought */
+static void close_fds(struct binder_transaction_data *tr)
+{
+	binder_size_t *offs = (binder_size_t *)tr->data.ptr.offsets;
+	char *data = (char *)tr->data.ptr.buffer;
+	size_t i;
+
+	for (i = 0; i < tr->offsets_size / sizeof(*offs); i++) {
+		struct binder_fd_object *obj = (void *)(data + offs[i]);
+
+		if (obj->hdr.type == BINDER_TYPE_FD)
+			close(obj->fd);
+	}
+}
+
+static void *server_thread(void *arg __maybe_unused)
+{
+	char rbuf[BINDER_READ_SIZE], wbuf[BINDER_WRITE_SIZE];
+	char *w = wbuf;
+
+	put_cmd(w, BC_ENTER_LOOPER);
+
+	for (;;) {
+		size_t consumed;
+		char *r = rbuf;
+
+		if (binder_write_read(binder_fd, wbuf, w - wbuf,
+				      rbuf, sizeof(rbuf), &consumed))
+			err(EXIT_FAILURE, "server BINDER_WRITE_READ");
+
+		w = wbuf;
+		while (r < rbuf + consumed) {
+			u32 cmd = *(u32 *)r;
+			struct binder_transaction_data tr;
+			struct binder_ptr_cookie pc;
+
+			r += sizeof(u32);
+			switch (cmd) {
+			case BR_TRANSACTION:
+				memcpy(&tr, r, sizeof(tr));
+				r += sizeof(tr);
+				close_fds(&tr);
+
+				put_cmd(w, BC_FREE_BUFFER);
+				put_obj(w, tr.data.ptr.buffer);
+				if (tr.flags & TF_ONE_WAY)
+					break;
+
+				memset(&tr, 0, sizeof(tr));
+				tr.data_size = reply_size;
+				tr.data.ptr.buffer = (binder_uintptr_t)payload;
+				put_cmd(w, BC_REPLY);
+				put_obj(w, tr);
+				break;
+			case BR_INCREFS:
+			case BR_ACQUIRE:
+				memcpy(&pc, r, sizeof(pc));
+				r += sizeof(pc);
+				put_cmd(w, cmd == BR_INCREFS ? BC_INCREFS_DONE :
+					   BC_ACQUIRE_DONE);
+				put_obj(w, pc);
+				break;
+			case BR_RELEASE:
+			case BR_DECREFS:
+				r += sizeof(pc);
+				break;
+			case BR_NOOP:
+			case BR_TRANSACTION_COMPLETE:
+			case BR_SPAWN_LOOPER:
+				break;
+			default:
+				errx(EXIT_FAILURE,
+				     "server: unexpected command %#x", cmd);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void server(int ready)
+{
+	struct flat_binder_object obj = {
+		.flags = pass_fd ? FLAT_BINDER_FLAG_ACCEPTS_FDS : 0,
+	};
+	pthread_t thread;
+	unsigned int i;
+
+	binder_fd = binder_open();
+	if (ioctl(binder_fd, BINDER_SET_CONTEXT_MGR_EXT, &obj))
+		err(EXIT_FAILURE, "%s: can't become the context manager",
+		    device);
+
+	for (i = 1; i < nthreads; i++)
+		if (pthread_create(&thread, NULL, server_thread, NULL))
+			err(EXIT_FAILURE, "pthread_create");
+
+	if (write(ready, "", 1) != 1)
+		err(EXIT_FAILURE, "write");
+	close(ready);
+
+	server_thread(NULL);
+}
+
+/* Sends one transaction, returning false if oneway and out of space */
+static bool client_call(int fd, binder_uintptr_t *reply)
+{
+	char rbuf[BINDER_READ_SIZE], wbuf[BINDER_WRITE_SIZE];
+	struct binder_transaction_data tr = {
+		.target.handle	= 0,
+		.flags		= (oneway ? TF_ONE_WAY : 0) |
+				  (pass_fd ? TF_ACCEPT_FDS : 0),
+		.data_size	= size,
+		.data.ptr.buffer = (binder_uintptr_t)payload,
+	};
+	static const binder_size_t fd_offset;
+	char *w = wbuf;
+
+	if (pass_fd) {
+		tr.offsets_size = sizeof(fd_offset);
+		tr.data.ptr.offsets = (binder_uintptr_t)&fd_offset;
+	}
+
+	if (*reply) {
+		put_cmd(w, BC_FREE_BUFFER);
+		put_obj(w, *reply);
+		*reply = 0;
+	}
+	put_cmd(w, BC_TRANSACTION);
+	put_obj(w, tr);
+
+	for (;;) {
+		size_t consumed;
+		char *r = rbuf;
+
+		if (binder_write_read(fd, wbuf, w - wbuf,
+				      rbuf, sizeof(rbuf), &consumed))
+			err(EXIT_FAILURE, "client BINDER_WRITE_READ");
+
+		w = wbuf;
+		while (r < rbuf + consumed) {
+			u32 cmd = *(u32 *)r;
+
+			r += sizeof(u32);
+			switch (cmd) {
+			case BR_NOOP:
+				break;
+			case BR_TRANSACTION_COMPLETE:
+				if (oneway)
+					return true;
+				break;
+			case BR_REPLY:
+				memcpy(&tr, r, sizeof(tr));
+				r += sizeof(tr);
+				*reply = tr.data.ptr.buffer;
+				return true;
+			case BR_FAILED_REPLY:
+				if (oneway)
+					return false;
+				/* fall through */
+			default:
+				errx(EXIT_FAILURE,
+				     "client: unexpected command %#x", cmd);
+			}
+		}
+	}
+}
+
+static void *client_thread(void *arg)
+{
+	struct client *c = arg;
+	binder_uintptr_t reply = 0;
+	unsigned int i;
+
+	for (i = 0; i < loops; i++) {
+		u64 start = now_ns();
+
+		while (!client_call(binder_fd, &reply)) {
+			c->retries++;
+			sched_yield();
+		}
+		c->lat_ns[i] = now_ns() - start;
+	}
+
+	/* Free the last reply */
+	if (reply) {
+		char wbuf[BINDER_WRITE_SIZE], *w = wbuf;
+		size_t consumed;
+
+		put_cmd(w, BC_FREE_BUFFER);
+		put_obj(w, reply);
+		binder_write_read(binder_fd, wbuf, w - wbuf, NULL, 0,
+				  &consumed);
+	}
+
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* The latencies of all the clients, which are sorted in place */
+static void print_summary(struct client *clients, u64 *lat,
+			  struct timeval *runtime)
+{
+	size_t i, n = (size_t)loops * nclients;
+	unsigned int retries = 0;
+	struct stats lat_stats;
+	u64 usecs;
+
+	init_stats(&lat_stats);
+	for (i = 0; i < nclients; i++)
+		retries += clients[i].retries;
+	for (i = 0; i < n; i++)
+		update_stats(&lat_stats, lat[i]);
+	qsort(lat, n, sizeof(*lat), cmp_u64);
+
+	usecs = runtime->tv_sec * USEC_PER_SEC + runtime->tv_usec;
+
+	if (bench_format == BENCH_FORMAT_SIMPLE) {
+		printf("%lu.%03lu\n", runtime->tv_sec,
+		       (unsigned long)(runtime->tv_usec / USEC_PER_MSEC));
+		return;
+	}
+
+	printf("# %u %s transactions of %u bytes by %u clients, %u server threads%s\n\n",
+	       loops * nclients, oneway ? "oneway" : "sync", size,
+	       nclients, nthreads, pass_fd ? ", with an fd each" : "");
+
+	printf(" %14s: %lu.%03lu [sec]\n", "Total time", runtime->tv_sec,
+	       (unsigned long)(runtime->tv_usec / USEC_PER_MSEC));
+	printf(" %14.0f transactions/sec\n\n",
+	       usecs ? (double)n * USEC_PER_SEC / usecs : 0.0);
+
+	printf(" Latency [usecs]: avg %.3f (+- %.2f%%)\n",
+	       avg_stats(&lat_stats) / NSEC_PER_USEC,
+	       rel_stddev_stats(stddev_stats(&lat_stats),
+				avg_stats(&lat_stats)));
+	printf("   p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+	       (double)lat[(n - 1) * 500 / 1000] / NSEC_PER_USEC,
+	       (double)lat[(n - 1) * 900 / 1000] / NSEC_PER_USEC,
+	       (double)lat[(n - 1) * 990 / 1000] / NSEC_PER_USEC,
+	       (double)lat[(n - 1) * 999 / 1000] / NSEC_PER_USEC,
+	       (double)lat[n - 1] / NSEC_PER_USEC);
+	if (oneway)
+		printf(" Retries, out of async buffer space: %u\n", retries);
+}
+
+int bench_ipc_binder(int argc, const char **argv)
+{
+	struct timeval start, stop, runtime;
+	struct client *clients;
+	u64 *lat;
+	int ready[2], status;
+	unsigned int i;
+	pid_t pid;
+	char c;
+
+	argc = parse_options(argc, argv, options, bench_ipc_binder_usage, 0);
+	if (argc)
+		usage_with_options(bench_ipc_binder_usage, options);
+
+	if (!loops || !nclients || !nthreads)
+		errx(EXIT_FAILURE,
+		     "loops, clients and threads must be non-zero");
+	if (pass_fd && size < sizeof(struct binder_fd_object))
+		size = sizeof(struct binder_fd_object);
+
+	payload = calloc(1, max(size, reply_size));
+	if (!payload)
+		err(EXIT_FAILURE, "calloc");
+
+	if (pass_fd) {
+		struct binder_fd_object obj = {
+			.hdr.type = BINDER_TYPE_FD,
+			.fd = open("/dev/null", O_RDONLY | O_CLOEXEC),
+		};
+
+		if ((int)obj.fd < 0)
+			err(EXIT_FAILURE, "open /dev/null");
+		memcpy(payload, &obj, sizeof(obj));
+	}
+
+	if (pipe(ready))
+		err(EXIT_FAILURE, "pipe");
+
+	pid = fork();
+	if (pid < 0)
+		err(EXIT_FAILURE, "fork");
+	if (!pid) {
+		close(ready[0]);
+		server(ready[1]);
+		exit(EXIT_SUCCESS);
+	}
+
+	close(ready[1]);
+	if (read(ready[0], &c, 1) != 1)
+		errx(EXIT_FAILURE, "server failed to start");
+	close(ready[0]);
+
+	binder_fd = binder_open();
+
+	clients = calloc(nclients, sizeof(*clients));
+	lat = calloc((size_t)loops * nclients, sizeof(*lat));
+	if (!clients || !lat)
+		err(EXIT_FAILURE, "calloc");
+	for (i = 0; i < nclients; i++)
+		clients[i].lat_ns = lat + (size_t)i * loops;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nclients; i++)
+		if (pthread_create(&clients[i].thread, NULL, client_thread,
+				   &clients[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	for (i = 0; i < nclients; i++)
+		pthread_join(clients[i].thread, NULL);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &runtime);
+
+	kill(pid, SIGKILL);
+	waitpid(pid, &status, 0);
+
+	print_summary(clients, lat, &runtime);
+
+	free(lat);
+	free(clients);
+	free(payload);
+	close(binder_fd);
+
+	return 0;
+}
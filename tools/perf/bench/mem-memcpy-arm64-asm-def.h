@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+MEMCPY_FN(memcpy_arm64,
+	"arm64",
+	"memcpy() in arch/arm64/lib/memcpy.S")
+
+MEMCPY_FN(memcpy_arm64_prfm,
+	"arm64-prfm",
+	"memcpy() in arch/arm64/lib/memcpy.S, with software prefetching")
@@ -0,0 +1,311 @@
+/*
+ * ionbench.c
+ *
+ * It is a user space utility to measure the latency of allocating,
+ * mapping and freeing ion buffers, for a heap type and a range of sizes.
+ * It reports the distribution of each, so that changes to the heaps and
+ * their page pools can be compared against numbers.
+ *
+ * The page pools of the system heap can be drained through the shrinkers
+ * before each allocation (-d, needs root), or are left filled by a warm up
+ * pass otherwise.  Memory pressure can be added with a child process that
+ * keeps some anonymous memory in use during the run (-p).
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "ionutils.h"
+#include "../../bench_lat.h"
+
+#define DEFAULT_ITERATIONS	1000
+
+static const unsigned long default_sizes[] = {
+	4096, 65536, 1 << 20, 8 << 20,
+};
+
+struct lat_stats {
+	unsigned long long *ns;
+	unsigned int nr;
+};
+
+void print_usage(int argc, char *argv[])
+{
+	printf("Usage: %s [-h <help>] [-i <heap type>] [-s <size in bytes>]\n"
+	       "\t[-n <iterations>] [-c <cached>] [-d <drain pools>]\n"
+	       "\t[-p <pressure in MB>]\n", argv[0]);
+}
+
+static int ion_heap_id(int ionfd, unsigned int heap_type)
+{
+	struct ion_heap_data heap_data[MAX_HEAP_COUNT];
+	struct ion_heap_query query;
+	int i;
+
+	memset(&query, 0, sizeof(query));
+	query.cnt = MAX_HEAP_COUNT;
+	query.heaps = (unsigned long int)&heap_data[0];
+	if (ioctl(ionfd, ION_IOC_HEAP_QUERY, &query) < 0) {
+		fprintf(stderr, "<%s>: Failed: ION_IOC_HEAP_QUERY: %s\n",
+			__func__, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < query.cnt; i++)
+		if (heap_data[i].type == heap_type)
+			return heap_data[i].heap_id;
+
+	fprintf(stderr, "<%s>: ERROR: heap type does not exists\n", __func__);
+	return -1;
+}
+
+/* Runs the shrinkers, the ion page pools being one of them */
+static int drain_pools(void)
+{
+	int fd, ret;
+
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, "2", 1) == 1 ? 0 : -1;
+	close(fd);
+
+	return ret;
+}
+
+/* Keeps @mb megabytes of anonymous memory in use until killed */
+static pid_t start_pressure(unsigned long mb)
+{
+	pid_t pid;
+	char *mem;
+
+	pid = fork();
+	if (pid)
+		return pid;
+
+	mem = malloc(mb << 20);
+	if (!mem)
+		exit(1);
+	for (;;) {
+		memset(mem, 0x5a, mb << 20);
+		sleep(1);
+	}
+}
+
+static int alloc_one(int ionfd, unsigned int heap_id, unsigned int flags,
+		     unsigned long size, unsigned long long *lat)
+{
+	struct ion_allocation_data alloc_data;
+	unsigned long long start;
+	unsigned char *map;
+	unsigned long i;
+
+	memset(&alloc_data, 0, sizeof(alloc_data));
+	alloc_data.len = size;
+	alloc_data.heap_id_mask = 1 << heap_id;
+	alloc_data.flags = flags;
+
+	start = bench_now_ns();
+	if (ioctl(ionfd, ION_IOC_ALLOC, &alloc_data) < 0) {
+		fprintf(stderr, "<%s>: Failed: ION_IOC_ALLOC: %s\n",
+			__func__, strerror(errno));
+		return -1;
+	}
+	lat[0] = bench_now_ns() - start;
+
+	/* Mapping includes faulting every page in */
+	start = bench_now_ns();
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   alloc_data.fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "<%s>: Failed: mmap: %s\n",
+			__func__, strerror(errno));
+		close(alloc_data.fd);
+		return -1;
+	}
+	for (i = 0; i < size; i += 4096)
+		map[i] = 0;
+	lat[1] = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	munmap(map, size);
+	close(alloc_data.fd);
+	lat[2] = bench_now_ns() - start;
+
+	return 0;
+}
+
+static void print_stats(const char *name, struct lat_stats *s)
+{
+	unsigned long long sum = 0;
+	unsigned int i, n = s->nr;
+
+	bench_lat_sort(s->ns, n);
+	for (i = 0; i < n; i++)
+		sum += s->ns[i];
+
+	printf("  %-6s avg %9.2f  min %9.2f  p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f\n",
+	       name, sum / 1000.0 / n, bench_lat_pct(s->ns, n, 0) / 1000.0,
+	       bench_lat_pct(s->ns, n, 50) / 1000.0,
+	       bench_lat_pct(s->ns, n, 90) / 1000.0,
+	       bench_lat_pct(s->ns, n, 99) / 1000.0,
+	       bench_lat_pct(s->ns, n, 100) / 1000.0);
+}
+
+static int run_size(int ionfd, unsigned int heap_id, unsigned int flags,
+		    unsigned long size, unsigned int iterations, int drain)
+{
+	static const char * const names[] = { "alloc", "map", "free" };
+	struct lat_stats stats[3];
+	unsigned long long lat[3], start, total;
+	unsigned int i, j;
+	int ret = -1;
+
+	for (j = 0; j < 3; j++) {
+		stats[j].nr = 0;
+		stats[j].ns = calloc(iterations, sizeof(*stats[j].ns));
+		if (!stats[j].ns)
+			goto out;
+	}
+
+	/* Fill the pools with the buffers of a first pass */
+	if (!drain)
+		for (i = 0; i < iterations / 10 + 1; i++)
+			if (alloc_one(ionfd, heap_id, flags, size, lat))
+				goto out;
+
+	total = 0;
+	for (i = 0; i < iterations; i++) {
+		if (drain && drain_pools()) {
+			fprintf(stderr, "<%s>: Failed to drain the pools: %s\n",
+				__func__, strerror(errno));
+			goto out;
+		}
+
+		start = bench_now_ns();
+		if (alloc_one(ionfd, heap_id, flags, size, lat))
+			goto out;
+		total += bench_now_ns() - start;
+
+		for (j = 0; j < 3; j++)
+			stats[j].ns[stats[j].nr++] = lat[j];
+	}
+
+	printf("size %lu: %u buffers, %.0f buffers/sec, %.1f MB/sec, latency in usecs:\n",
+	       size, iterations, iterations * 1e9 / total,
+	       (double)size * iterations * 1e9 / total / (1 << 20));
+	for (j = 0; j < 3; j++)
+		print_stats(names[j], &stats[j]);
+	ret = 0;
+out:
+	for (j = 0; j < 3; j++)
+		free(stats[j].ns);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long size = 0, pressure = 0;
+	unsigned int heap_type = ION_HEAP_TYPE_SYSTEM;
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	unsigned int flags = 0, i;
+	int opt, ionfd, heap_id, drain = 0, ret = 0;
+	pid_t pressure_pid = 0;
+
+	while ((opt = getopt(argc, argv, "hi:s:n:cdp:")) != -1) {
+		switch (opt) {
+		case 'h':
+			print_usage(argc, argv);
+			exit(0);
+		case 'i':
+			heap_type = atoi(optarg);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'c':
+			flags |= ION_FLAG_CACHED;
+			break;
+		case 'd':
+			drain = 1;
+			break;
+		case 'p':
+			pressure = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			print_usage(argc, argv);
+			exit(1);
+		}
+	}
+
+	if (!iterations) {
+		print_usage(argc, argv);
+		exit(1);
+	}
+
+	ionfd = open(ION_DEVICE, O_RDWR);
+	if (ionfd < 0) {
+		fprintf(stderr, "<%s>: Failed to open ion client: %s\n",
+			__func__, strerror(errno));
+		return -1;
+	}
+
+	heap_id = ion_heap_id(ionfd, heap_type);
+	if (heap_id < 0) {
+		close(ionfd);
+		return -1;
+	}
+
+	if (pressure) {
+		pressure_pid = start_pressure(pressure);
+		if (pressure_pid < 0) {
+			fprintf(stderr, "<%s>: Failed: fork: %s\n",
+				__func__, strerror(errno));
+			close(ionfd);
+			return -1;
+		}
+		/* Let it fault its memory in first */
+		sleep(1);
+	}
+
+	printf("heap type %u%s, pools %s%s\n", heap_type,
+	       flags & ION_FLAG_CACHED ? " cached" : "",
+	       drain ? "drained" : "filled",
+	       pressure ? ", under memory pressure" : "");
+
+	for (i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++) {
+		ret = run_size(ionfd, heap_id, flags,
+			       size ? size : default_sizes[i], iterations, drain);
+		if (ret || size)
+			break;
+	}
+
+	if (pressure_pid > 0) {
+		kill(pressure_pid, SIGKILL);
+		waitpid(pressure_pid, NULL, 0);
+	}
+	close(ionfd);
+
+	return ret;
+}
@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Latency samples of the selftest benchmarks
+ *
+ * The benchmarks record one sample in ns per operation, then sort them
+ * with bench_lat_sort() and read percentiles off them with bench_lat_pct().
+ */
+#ifndef __BENCH_LAT_H
+#define __BENCH_LAT_H
+
+#include <stdlib.h>
+#include <time.h>
+
+static inline unsigned long long bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int bench_lat_cmp(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static inline void bench_lat_sort(unsigned long long *ns, unsigned long nr)
+{
+	qsort(ns, nr, sizeof(*ns), bench_lat_cmp);
+}
+
+/* The @pct percentile of the @nr sorted samples at @ns, 100 being the max */
+static inline unsigned long long bench_lat_pct(const unsigned long long *ns,
+					       unsigned long nr,
+					       unsigned int pct)
+{
+	return ns[(nr - 1) * pct / 100];
+}
+
+#endif /* __BENCH_LAT_H */
@@ -0,0 +1,420 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * zram_bench: page granular throughput and latency benchmark of zram
+ *
+ * Sets up a zram device for each compression algorithm asked for, writes
+ * every page of it once with O_DIRECT, reads it all back and checks it,
+ * and optionally writes it back to a backing device and reads it again
+ * from there.  The pages are either synthetic ones, the given percentage
+ * of each being filled with the same byte and the rest with random ones,
+ * or come from a corpus file of captured pages.
+ *
+ * For each algorithm it prints the throughput and the latency distribution
+ * of every pass, and the changes in mm_stat (and bd_stat) they made.
+ *
+ * ./zram_bench [-a lzo,lz4,...] [-s size_mb] [-c compressible_percent]
+ *		[-f corpus] [-b backing_dev] [-d device_id]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../bench_lat.h"
+#include "../kselftest.h"
+
+#define ZRAM_CONTROL	"/sys/class/zram-control"
+#define MM_STAT_FIELDS	11
+#define BD_STAT_FIELDS	3
+
+static const char * const mm_stat_names[MM_STAT_FIELDS] = {
+	"orig_data_size", "compr_data_size", "mem_used_total",
+	"mem_limit", "mem_used_max", "same_pages", "pages_compacted",
+	"huge_pages", "recomp_pages", "dup_data_size", "meta_data_size",
+};
+
+static const char * const bd_stat_names[BD_STAT_FIELDS] = {
+	"bd_count", "bd_reads", "bd_writes",
+};
+
+static int dev_id = -1;
+static unsigned long size_mb = 64;
+static unsigned int compressible = 50;
+static const char *corpus_path;
+static const char *backing_dev;
+
+static long page_size;
+static unsigned long nr_pages;
+static unsigned char *corpus;
+static unsigned long corpus_pages;
+
+static int write_attr(const char *attr, const char *val)
+{
+	char path[128];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "/sys/block/zram%d/%s", dev_id, attr);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	ret = write(fd, val, strlen(val)) < 0 ? -errno : 0;
+	close(fd);
+
+	return ret;
+}
+
+static int read_file(const char *path, char *buf, size_t len)
+{
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n < 0)
+		return -errno;
+	buf[n] = 0;
+
+	return 0;
+}
+
+static int read_attr(const char *attr, char *buf, size_t len)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path), "/sys/block/zram%d/%s", dev_id, attr);
+	return read_file(path, buf, len);
+}
+
+static int read_stat(const char *attr, unsigned long long *vals, int nr)
+{
+	char buf[512], *p = buf;
+	int i;
+
+	memset(vals, 0, nr * sizeof(*vals));
+	if (read_attr(attr, buf, sizeof(buf)))
+		return -1;
+	for (i = 0; i < nr && *p; i++)
+		vals[i] = strtoull(p, &p, 10);
+
+	return 0;
+}
+
+/* The same contents for a page index every time, to check reads against */
+static void fill_page(unsigned char *buf, unsigned long index)
+{
+	uint64_t x = index * 0x9e3779b97f4a7c15ULL + 1;
+	long i, same = page_size * compressible / 100;
+
+	if (corpus) {
+		memcpy(buf, corpus + (index % corpus_pages) * page_size,
+		       page_size);
+		return;
+	}
+
+	memset(buf, 0xa5, same);
+	for (i = same; i < page_size; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		buf[i] = x;
+	}
+}
+
+static void print_pass(const char *name, unsigned long long *lat,
+		       unsigned long long total)
+{
+	bench_lat_sort(lat, nr_pages);
+	printf("  %-9s %8.1f MB/s  latency usecs: p50 %.2f p90 %.2f p99 %.2f max %.2f\n",
+	       name, (double)nr_pages * page_size * 1e9 / total / (1 << 20),
+	       bench_lat_pct(lat, nr_pages, 50) / 1000.0,
+	       bench_lat_pct(lat, nr_pages, 90) / 1000.0,
+	       bench_lat_pct(lat, nr_pages, 99) / 1000.0,
+	       bench_lat_pct(lat, nr_pages, 100) / 1000.0);
+}
+
+static void print_delta(const char *attr, const char * const *names,
+			unsigned long long *before, int nr)
+{
+	unsigned long long after[MM_STAT_FIELDS];
+	int i;
+
+	read_stat(attr, after, nr);
+	printf("  %s:", attr);
+	for (i = 0; i < nr; i++)
+		printf(" %s %+lld", names[i],
+		       (long long)(after[i] - before[i]));
+	printf("\n");
+	memcpy(before, after, nr * sizeof(*after));
+}
+
+/* Returns the number of pages that did not read back right, or -1 */
+static long run_pass(int fd, int rw, unsigned char *buf,
+		     unsigned char *expect, unsigned long long *lat,
+		     unsigned long long *total)
+{
+	unsigned long long start, t0;
+	unsigned long i;
+	long bad = 0;
+	ssize_t n;
+
+	*total = 0;
+	for (i = 0; i < nr_pages; i++) {
+		if (rw)
+			fill_page(buf, i);
+
+		start = bench_now_ns();
+		if (rw)
+			n = pwrite(fd, buf, page_size, i * page_size);
+		else
+			n = pread(fd, buf, page_size, i * page_size);
+		t0 = bench_now_ns();
+		if (n != page_size) {
+			ksft_print_msg("%s of page %lu failed: %s\n",
+				       rw ? "write" : "read", i,
+				       strerror(errno));
+			return -1;
+		}
+		lat[i] = t0 - start;
+		*total += lat[i];
+
+		if (!rw) {
+			fill_page(expect, i);
+			if (memcmp(buf, expect, page_size))
+				bad++;
+		}
+	}
+
+	if (rw && fsync(fd))
+		return -1;
+
+	return bad;
+}
+
+static int bench_algo(const char *algo, unsigned char *buf,
+		      unsigned char *expect, unsigned long long *lat)
+{
+	unsigned long long mm[MM_STAT_FIELDS], bd[BD_STAT_FIELDS], total;
+	char dev[64], disksize[32];
+	long bad;
+	int fd, ret;
+
+	write_attr("reset", "1");
+	ret = write_attr("comp_algorithm", algo);
+	if (ret) {
+		ksft_print_msg("%s: can't select it: %s\n", algo,
+			       strerror(-ret));
+		return -1;
+	}
+	if (backing_dev) {
+		ret = write_attr("backing_dev", backing_dev);
+		if (ret) {
+			ksft_print_msg("can't set backing_dev %s: %s\n",
+				       backing_dev, strerror(-ret));
+			return -1;
+		}
+	}
+	snprintf(disksize, sizeof(disksize), "%lu", nr_pages * page_size);
+	ret = write_attr("disksize", disksize);
+	if (ret) {
+		ksft_print_msg("can't set disksize: %s\n", strerror(-ret));
+		return -1;
+	}
+
+	snprintf(dev, sizeof(dev), "/dev/zram%d", dev_id);
+	fd = open(dev, O_RDWR | O_DIRECT);
+	if (fd < 0) {
+		ksft_print_msg("open %s: %s\n", dev, strerror(errno));
+		return -1;
+	}
+
+	printf("%s: %lu pages\n", algo, nr_pages);
+	read_stat("mm_stat", mm, MM_STAT_FIELDS);
+	read_stat("bd_stat", bd, BD_STAT_FIELDS);
+
+	ret = -1;
+	if (run_pass(fd, 1, buf, expect, lat, &total) < 0)
+		goto out;
+	print_pass("write", lat, total);
+	print_delta("mm_stat", mm_stat_names, mm, MM_STAT_FIELDS);
+
+	bad = run_pass(fd, 0, buf, expect, lat, &total);
+	if (bad < 0)
+		goto out;
+	print_pass("read", lat, total);
+	if (bad) {
+		ksft_print_msg("%s: %ld pages read back wrong\n", algo, bad);
+		goto out;
+	}
+
+	if (backing_dev) {
+		unsigned long long start = bench_now_ns();
+
+		if (write_attr("idle", "all") ||
+		    write_attr("writeback", "idle")) {
+			ksft_print_msg("writeback failed: %s\n",
+				       strerror(errno));
+			goto out;
+		}
+		printf("  %-9s %8.1f MB/s\n", "writeback",
+		       (double)nr_pages * page_size * 1e9 /
+		       (bench_now_ns() - start) / (1 << 20));
+		print_delta("mm_stat", mm_stat_names, mm, MM_STAT_FIELDS);
+		print_delta("bd_stat", bd_stat_names, bd, BD_STAT_FIELDS);
+
+		bad = run_pass(fd, 0, buf, expect, lat, &total);
+		if (bad < 0)
+			goto out;
+		print_pass("bd read", lat, total);
+		if (bad) {
+			ksft_print_msg("%s: %ld pages read back wrong from %s\n",
+				       algo, bad, backing_dev);
+			goto out;
+		}
+	}
+	ret = 0;
+out:
+	close(fd);
+	write_attr("reset", "1");
+	return ret;
+}
+
+static int load_corpus(void)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(corpus_path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st))
+		return -1;
+
+	corpus_pages = st.st_size / page_size;
+	if (!corpus_pages) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	corpus = malloc(corpus_pages * page_size);
+	if (!corpus ||
+	    read(fd, corpus, corpus_pages * page_size) !=
+	    (ssize_t)(corpus_pages * page_size)) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char algos[256] = "", buf[32], *algo, *save;
+	unsigned char *page, *expect;
+	unsigned long long *lat;
+	int opt, hot_added = 0, failed = 0;
+
+	while ((opt = getopt(argc, argv, "a:s:c:f:b:d:")) != -1) {
+		switch (opt) {
+		case 'a':
+			snprintf(algos, sizeof(algos), "%s", optarg);
+			break;
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			compressible = atoi(optarg);
+			if (compressible > 100)
+				compressible = 100;
+			break;
+		case 'f':
+			corpus_path = optarg;
+			break;
+		case 'b':
+			backing_dev = optarg;
+			break;
+		case 'd':
+			dev_id = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-a algos] [-s size_mb] [-c compressible%%] [-f corpus] [-b backing_dev] [-d dev_id]\n",
+				argv[0]);
+			return KSFT_FAIL;
+		}
+	}
+
+	if (geteuid()) {
+		ksft_print_msg("must be run as root\n");
+		return KSFT_SKIP;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nr_pages = (size_mb << 20) / page_size;
+	if (!nr_pages)
+		return KSFT_FAIL;
+
+	if (corpus_path && load_corpus()) {
+		ksft_print_msg("can't load %s: %s\n", corpus_path,
+			       strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	if (dev_id < 0) {
+		if (read_file(ZRAM_CONTROL "/hot_add", buf, sizeof(buf))) {
+			ksft_print_msg("no zram-control, is zram loaded?\n");
+			return KSFT_SKIP;
+		}
+		dev_id = atoi(buf);
+		hot_added = 1;
+	}
+
+	/* Every algorithm the device offers, by default */
+	if (!algos[0]) {
+		char *p;
+
+		if (read_attr("comp_algorithm", algos, sizeof(algos)))
+			return KSFT_SKIP;
+		for (p = algos; *p; p++)
+			if (*p == '[' || *p == ']' || *p == '\n')
+				*p = ' ';
+	}
+
+	lat = calloc(nr_pages, sizeof(*lat));
+	if (!lat || posix_memalign((void **)&page, page_size, page_size) ||
+	    posix_memalign((void **)&expect, page_size, page_size))
+		return KSFT_FAIL;
+
+	printf("zram%d, %s pages\n", dev_id,
+	       corpus ? corpus_path : "synthetic");
+	for (algo = strtok_r(algos, ", ", &save); algo;
+	     algo = strtok_r(NULL, ", ", &save))
+		if (bench_algo(algo, page, expect, lat))
+			failed = 1;
+
+	if (hot_added) {
+		int fd = open(ZRAM_CONTROL "/hot_remove", O_WRONLY);
+
+		snprintf(buf, sizeof(buf), "%d", dev_id);
+		if (fd >= 0) {
+			if (write(fd, buf, strlen(buf)) < 0)
+				ksft_print_msg("hot_remove failed\n");
+			close(fd);
+		}
+	}
+
+	free(lat);
+	free(page);
+	free(expect);
+	free(corpus);
+
+	return failed ? KSFT_FAIL : KSFT_PASS;
+}